@@ -1,7 +1,14 @@
 #include <Windows.h>
 #include <sddl.h>
+#include <NTSecAPI.h>
+#include <algorithm>
 #include "MachineSid.h"
 #include "CSid.h"
+#include "SidNameCache.h"
+#include "SidCodec.h"
+#include "WellKnownSids.h"
+#include "SysErrorMessage.h"
+#include "Timings.h"
 
 
 // ------------------------------------------------------------------------------------------
@@ -10,22 +17,29 @@ static MachineSid machineSid;
 
 // ------------------------------------------------------------------------------------------
 
-CSid::CSid() : m_pBuf(NULL)
+CSid::CSid() : m_dwLength(0)
 {
 }
 
-CSid::CSid(PSID pSid) : m_pBuf(NULL)
+CSid::CSid(PSID pSid) : m_dwLength(0)
 {
 	SetBuffer(pSid);
 }
 
-CSid::CSid(const wchar_t* szSid) : m_pBuf(NULL)
+CSid::CSid(const wchar_t* szSid) : m_dwLength(0)
 {
-	PSID pSidToFree = NULL;
-	if (ConvertStringSidToSidW(szSid, &pSidToFree))
+	if (NULL == szSid)
+		return;
+	// S-1-... strings are parsed directly; anything else (e.g., SDDL aliases such as SY) goes through Win32.
+	m_dwLength = (DWORD)SidCodec::Parse(szSid, wcslen(szSid), m_buf, sizeof(m_buf));
+	if (0 == m_dwLength)
 	{
-		SetBuffer(pSidToFree);
-		LocalFree(pSidToFree);
+		PSID pSidToFree = NULL;
+		if (ConvertStringSidToSidW(szSid, &pSidToFree))
+		{
+			SetBuffer(pSidToFree);
+			LocalFree(pSidToFree);
+		}
 	}
 }
 
@@ -34,18 +48,31 @@ CSid::~CSid()
 	ClearBuffer();
 }
 
-CSid::CSid(const CSid& other) : m_pBuf(NULL)
+CSid::CSid(const CSid& other) noexcept : m_dwLength(other.m_dwLength)
 {
-	SetBuffer(other.psid());
+	memcpy(m_buf, other.m_buf, m_dwLength);
 }
 
-CSid& CSid::operator=(const CSid& other)
+CSid::CSid(CSid&& other) noexcept : m_dwLength(other.m_dwLength)
 {
-	ClearBuffer();
-	SetBuffer(other.psid());
+	memcpy(m_buf, other.m_buf, m_dwLength);
+}
+
+CSid& CSid::operator=(const CSid& other) noexcept
+{
+	if (this != &other)
+	{
+		m_dwLength = other.m_dwLength;
+		memcpy(m_buf, other.m_buf, m_dwLength);
+	}
 	return *this;
 }
 
+CSid& CSid::operator=(CSid&& other) noexcept
+{
+	return *this = static_cast<const CSid&>(other);
+}
+
 bool CSid::operator==(PSID pSid) const
 {
 	if (NULL == pSid || NULL == this->psid())
@@ -55,34 +82,44 @@ bool CSid::operator==(PSID pSid) const
 
 bool CSid::operator==(const CSid& other) const
 {
-	if (NULL == other.psid() || NULL == this->psid())
-		return false;
-	return 0 != EqualSid(this->psid(), other.psid());
+	// Same as EqualSid for valid SIDs, which compares the revision and every other byte
+	return m_dwLength == other.m_dwLength && 0 == memcmp(m_buf, other.m_buf, m_dwLength);
+}
+
+int CSid::Compare(const CSid& other) const
+{
+	DWORD dwMinLength = (m_dwLength < other.m_dwLength) ? m_dwLength : other.m_dwLength;
+	int cmp = memcmp(m_buf, other.m_buf, dwMinLength);
+	if (0 != cmp)
+		return cmp;
+	return (m_dwLength < other.m_dwLength) ? -1 : (m_dwLength > other.m_dwLength) ? 1 : 0;
+}
+
+size_t CSid::Hash() const
+{
+	// FNV-1a over the SID bytes
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (DWORD ix = 0; ix < m_dwLength; ++ix)
+	{
+		hash ^= m_buf[ix];
+		hash *= 0x100000001B3ULL;
+	}
+	return (size_t)hash;
 }
 
 CSid::operator PSID() const
 {
-	return (PSID)m_pBuf;
+	return psid();
 }
 
 PSID CSid::psid() const
 {
-	return (PSID)m_pBuf;
+	return (0 == m_dwLength) ? NULL : (PSID)m_buf;
 }
 
 std::wstring CSid::toSidString() const
 {
-	std::wstring retval;
-	if (m_pBuf)
-	{
-		wchar_t* szSid = NULL;
-		if (ConvertSidToStringSidW(this->psid(), &szSid))
-		{
-			retval = szSid;
-			LocalFree(szSid);
-		}
-	}
-	return retval;
+	return SidCodec::ToString(m_buf, m_dwLength);
 }
 
 std::wstring CSid::toDomainAndUsername(bool bReturnSidOnFailure /*= false*/) const
@@ -148,7 +185,9 @@ bool CSid::IsMachineLocal() const
 bool CSid::IsNtServiceSid(PSID pSid)
 {
 	// Check whether NT AUTHORITY (S-1-5-) with first subauth == NT SERVICE
-	return TestNtAuthorityRID(pSid, SECURITY_SERVICE_ID_BASE_RID);
+	if (NULL == pSid || !IsValidSid(pSid))
+		return false;
+	return WellKnownSids::Category_t::Service == WellKnownSids::Classify((const uint8_t*)pSid, GetLengthSid(pSid));
 }
 
 bool CSid::IsNtServiceSid() const
@@ -172,44 +211,160 @@ bool CSid::TestNtAuthorityRID(PSID pSid, DWORD dwRid)
 	return (dwRid == *GetSidSubAuthority(pSid, 0));
 }
 
+// ------------------------------------------------------------------------------------------
+// Internal: the lookup that the process-wide name cache memoizes
+static bool LookupSidName(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	if (CSid::LookupWellKnownName(pSid, cbSid, sDomainName, sUserName))
+		return true;
+
+	const DWORD cchMaxName = 256;
+	WCHAR UserName[cchMaxName];
+	WCHAR DomainName[cchMaxName];
+	DWORD cchUserSize = cchMaxName;
+	DWORD cchDomainSize = cchMaxName;
+	SID_NAME_USE eNameUse;
+	if (TIMED_CALL(LookupAccountSid, LookupAccountSidW(NULL, (PSID)pSid, UserName, &cchUserSize, DomainName, &cchDomainSize, &eNameUse)))
+	{
+		sDomainName = DomainName;
+		sUserName = UserName;
+		return true;
+	}
+	return false;
+}
+
+// Internal: success and informational statuses are non-negative (from ntdef.h, which conflicts with Windows.h)
+#ifndef NT_SUCCESS
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#endif
+// Internal: the LSA lookup error status that still returns per-SID results (from ntstatus.h, which conflicts with
+// Windows.h). STATUS_SOME_NOT_MAPPED also does, and is a success status.
+static const NTSTATUS StatusNoneMapped = (NTSTATUS)0xC0000073L;
+// Internal: the most SIDs that LsaLookupSids2 translates in one call
+static const size_t MaxSidsPerLsaLookup = 20480;
+
+// Internal: copy of a counted LSA string
+static std::wstring LsaString(const LSA_UNICODE_STRING& str)
+{
+	if (NULL == str.Buffer)
+		return std::wstring();
+	return std::wstring(str.Buffer, str.Length / sizeof(WCHAR));
+}
+
+// Internal: the batch lookup that the process-wide name cache memoizes. Well-known SIDs are named from the table;
+// the rest are translated with as few LsaLookupSids2 calls as possible.
+static bool LookupSidNames(SidNameCache::BatchItemList_t& items, std::wstring& sErrorInfo)
+{
+	// The SIDs that need LSA
+	std::vector<SidNameCache::BatchItem_t*> lsaItems;
+	for (size_t ix = 0; ix < items.size(); ++ix)
+	{
+		SidNameCache::BatchItem_t& item = items[ix];
+		item.bFound = CSid::LookupWellKnownName(item.pSid, item.cbSid, item.sDomainName, item.sUserName);
+		if (!item.bFound)
+			lsaItems.push_back(&item);
+	}
+	if (lsaItems.empty())
+		return true;
+
+	LSA_OBJECT_ATTRIBUTES objectAttributes = { 0 };
+	LSA_HANDLE hPolicy = NULL;
+	NTSTATUS status = LsaOpenPolicy(NULL, &objectAttributes, POLICY_LOOKUP_NAMES, &hPolicy);
+	if (!NT_SUCCESS(status))
+	{
+		sErrorInfo = SysErrorMessageWithCode((DWORD)status, true);
+		return false;
+	}
+
+	bool bResult = true;
+	for (size_t ixFirst = 0; bResult && ixFirst < lsaItems.size(); ixFirst += MaxSidsPerLsaLookup)
+	{
+		const size_t nSids = std::min(MaxSidsPerLsaLookup, lsaItems.size() - ixFirst);
+		std::vector<PSID> pSids(nSids);
+		for (size_t ix = 0; ix < nSids; ++ix)
+			pSids[ix] = (PSID)lsaItems[ixFirst + ix]->pSid;
+
+		PLSA_REFERENCED_DOMAIN_LIST pDomains = NULL;
+		PLSA_TRANSLATED_NAME pNames = NULL;
+		status = TIMED_CALL(LsaLookupSids2, LsaLookupSids2(hPolicy, 0, (ULONG)nSids, pSids.data(), &pDomains, &pNames));
+		if (NT_SUCCESS(status) || StatusNoneMapped == status)
+		{
+			for (size_t ix = 0; ix < nSids; ++ix)
+			{
+				SidNameCache::BatchItem_t& item = *lsaItems[ixFirst + ix];
+				if (NULL != pNames && SidTypeUnknown != pNames[ix].Use && SidTypeInvalid != pNames[ix].Use)
+				{
+					item.bFound = true;
+					item.sUserName = LsaString(pNames[ix].Name);
+					if (NULL != pDomains && pNames[ix].DomainIndex >= 0 && (ULONG)pNames[ix].DomainIndex < pDomains->Entries)
+						item.sDomainName = LsaString(pDomains->Domains[pNames[ix].DomainIndex].Name);
+					// LookupAccountSid reports a domain SID's name as both the domain and the account name.
+					if (item.sUserName.empty())
+						item.sUserName = item.sDomainName;
+				}
+			}
+		}
+		else
+		{
+			sErrorInfo = SysErrorMessageWithCode((DWORD)status, true);
+			bResult = false;
+		}
+		if (NULL != pDomains)
+			LsaFreeMemory(pDomains);
+		if (NULL != pNames)
+			LsaFreeMemory(pNames);
+	}
+	LsaClose(hPolicy);
+	return bResult;
+}
+
+SidNameCache& CSid::NameCache()
+{
+	// Initialized on first use (thread-safe), so lookups from other static initializers are safe.
+	// Intentionally never destroyed: destroying it would wait at exit for any lookups still blocked.
+	static SidNameCache* pNameCache = new SidNameCache(LookupSidName, LookupSidNames);
+	return *pNameCache;
+}
+
+bool CSid::LookupWellKnownName(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	// LSA returns well-known names in the system's UI language; the table has the English names.
+	static const bool bEnglish = (LANG_ENGLISH == PRIMARYLANGID(GetSystemDefaultUILanguage()));
+	WellKnownSids::Category_t category;
+	if (!bEnglish || !WellKnownSids::Lookup(pSid, cbSid, category, sDomainName, sUserName) ||
+		!WellKnownSids::IsFixedName(category) || sUserName.empty())
+	{
+		sDomainName.clear();
+		sUserName.clear();
+		return false;
+	}
+	return true;
+}
+
 bool CSid::Lookup(std::wstring& sDomainName, std::wstring& sUserName) const
 {
 	sDomainName.clear();
 	sUserName.clear();
-	if (m_pBuf)
+	if (0 != m_dwLength)
 	{
-		const DWORD cchMaxName = 256;
-		WCHAR UserName[cchMaxName];
-		WCHAR DomainName[cchMaxName];
-		DWORD cchUserSize = cchMaxName;
-		DWORD cchDomainSize = cchMaxName;
-		SID_NAME_USE eNameUse;
-		if (LookupAccountSidW(NULL, psid(), UserName, &cchUserSize, DomainName, &cchDomainSize, &eNameUse))
-		{
-			sDomainName = DomainName;
-			sUserName = UserName;
-			return true;
-		}
+		return NameCache().Lookup(m_buf, m_dwLength, sDomainName, sUserName);
 	}
 	return false;
 }
 
 void CSid::ClearBuffer()
 {
-	if (m_pBuf)
-	{
-		delete[] m_pBuf;
-		m_pBuf = NULL;
-	}
+	m_dwLength = 0;
 }
 
 void CSid::SetBuffer(PSID pSid)
 {
-	if (IsValidSid(pSid))
+	ClearBuffer();
+	if (NULL != pSid && IsValidSid(pSid))
 	{
 		DWORD dwLength = GetLengthSid(pSid);
-		m_pBuf = new byte[dwLength];
-		CopySid(dwLength, m_pBuf, pSid);
+		if (dwLength <= sizeof(m_buf) && CopySid(dwLength, m_buf, pSid))
+			m_dwLength = dwLength;
 	}
 }
 
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <Windows.h>
+#include <cstdint>
 #include <string>
+#include <functional>
+
+class SidNameCache;
 
 // ------------------------------------------------------------------------------------------
 /// <summary>
-/// Class to represent a SID and manage its memory
+/// Class to represent a SID and manage its memory.
+/// The SID is stored inline (a SID is at most SECURITY_MAX_SID_SIZE bytes), so creating, copying, and moving
+/// a CSid never allocates. CSids can be compared, ordered, and hashed (std::hash), so they can be used as keys.
 /// </summary>
 class CSid
 {
@@ -30,13 +36,37 @@ public:
 	CSid(const wchar_t* szSid);
 	// Destructor
 	~CSid();
-	// Copy constructor
-	CSid(const CSid& other);
-	// assignment operator
-	CSid& operator = (const CSid& other);
-	// equality operators
+	// Copy and move constructors (a move is a copy of the inline buffer)
+	CSid(const CSid& other) noexcept;
+	CSid(CSid&& other) noexcept;
+	// assignment operators
+	CSid& operator = (const CSid& other) noexcept;
+	CSid& operator = (CSid&& other) noexcept;
+	// equality operators. Comparison with a NULL PSID is always false; two empty CSids are equal.
 	bool operator == (PSID pSid) const;
 	bool operator == (const CSid& other) const;
+	bool operator != (const CSid& other) const { return !(*this == other); }
+	// ordering operators: by binary SID bytes, then by length; an empty CSid sorts first
+	bool operator < (const CSid& other) const { return Compare(other) < 0; }
+	bool operator <= (const CSid& other) const { return Compare(other) <= 0; }
+	bool operator > (const CSid& other) const { return Compare(other) > 0; }
+	bool operator >= (const CSid& other) const { return Compare(other) >= 0; }
+
+	/// <summary>
+	/// Three-way comparison for the ordering operators
+	/// </summary>
+	/// <returns>negative, zero, or positive as this SID sorts before, the same as, or after the other</returns>
+	int Compare(const CSid& other) const;
+
+	/// <summary>
+	/// Length of the binary SID in bytes; 0 if empty
+	/// </summary>
+	DWORD Length() const { return m_dwLength; }
+
+	/// <summary>
+	/// Hash of the binary SID, for std::hash
+	/// </summary>
+	size_t Hash() const;
 
 	// Conversion to raw type
 	operator PSID() const;
@@ -90,6 +120,22 @@ public:
 	/// <returns>true if the SID is an NT SERVICE SID; false otherwise</returns>
 	bool IsNtServiceSid() const;
 
+	/// <summary>
+	/// The process-wide cache of SID-to-name lookups that Lookup and the name conversions go through.
+	/// </summary>
+	static SidNameCache& NameCache();
+
+	/// <summary>
+	/// Name a well-known SID (SYSTEM, BUILTIN\Administrators, logon session SIDs, ...) from the built-in table instead of
+	/// asking LSA. Only on systems whose UI language is English, where the table's names are the ones LSA returns.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: length of the binary SID in bytes</param>
+	/// <param name="sDomainName">Output: domain name</param>
+	/// <param name="sUserName">Output: user name</param>
+	/// <returns>true if the SID was named from the table</returns>
+	static bool LookupWellKnownName(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName);
+
 private:
 	/// <summary>
 	/// Reports whether the SID is an NT AUTHORITY SID (S-1-5-) with a specific RID (S-1-5-XX).
@@ -99,12 +145,22 @@ private:
 	/// <returns></returns>
 	static bool TestNtAuthorityRID(PSID pSid, DWORD dwRid);
 
-	// Conversion to domain\name strings
+	// Conversion to domain\name strings. Results are cached process-wide; see NameCache().
 	bool Lookup(std::wstring& sDomainName, std::wstring& sUserName) const;
 
 private:
 	void ClearBuffer();
 	void SetBuffer(PSID pSid);
-	byte* m_pBuf;
+	// Only the first m_dwLength bytes are meaningful; 0 length means no SID.
+	byte m_buf[SECURITY_MAX_SID_SIZE];
+	DWORD m_dwLength;
 };
 
+namespace std
+{
+	template <> struct hash<CSid>
+	{
+		size_t operator()(const CSid& sid) const { return sid.Hash(); }
+	};
+}
+
@@ -0,0 +1,194 @@
+// DeltaRenderer.cpp: renders the differences between two samples for watch mode.
+
+#include "DeltaRenderer.h"
+#include "StringUtils.h"
+#include "HEX.h"
+
+DeltaRenderer::DeltaRenderer(const TextRenderOptions_t& options)
+	: m_options(options), m_textRenderer(options)
+{
+}
+
+/// <summary>
+/// "+", "-", or "~" prefix for added, removed, or changed items
+/// </summary>
+const wchar_t* DeltaRenderer::ChangeMarker(ChangeKind_t kind)
+{
+	switch (kind)
+	{
+	case ChangeKind_t::Added:
+		return L"+";
+	case ChangeKind_t::Removed:
+		return L"-";
+	case ChangeKind_t::Changed:
+	default:
+		return L"~";
+	}
+}
+
+/// <summary>
+/// Write the differences, preceded by a timestamped header line. Writes nothing if there are no differences.
+/// </summary>
+void DeltaRenderer::Render(std::wostream& sOut, const SnapshotDiff_t& diff, const SystemSnapshot_t& after) const
+{
+	if (diff.IsEmpty())
+		return;
+
+	sOut << L"==== " << TimestampUTC() << L" UTC: " << diff.ChangeCount() << L" change(s)" << std::endl << std::endl;
+
+	if (diff.bCurrentInfoChanged)
+	{
+		sOut << L"~ Current context:" << std::endl;
+		m_textRenderer.RenderCurrentInfo(sOut, after.currentInfo);
+	}
+
+	if (diff.bSessionEnumChanged)
+	{
+		if (after.sessions.bValid)
+			sOut << L"~ Terminal sessions can be enumerated again: " << after.sessions.value.size() << std::endl << std::endl;
+		else
+			sOut << L"~ Unable to enumerate terminal sessions: " << after.sessions.sErrorInfo << std::endl << std::endl;
+	}
+
+	std::vector<Change_t<SessionSnapshot_t>>::const_iterator sessionIter;
+	for (sessionIter = diff.sessions.begin(); sessionIter != diff.sessions.end(); sessionIter++)
+	{
+		if (ChangeKind_t::Removed == sessionIter->kind)
+		{
+			sOut << L"- Session " << sessionIter->before.dwSessionId << L" (" << sessionIter->before.sName << L")" << std::endl << std::endl;
+		}
+		else
+		{
+			const SessionSnapshot_t& before = sessionIter->before;
+			const SessionSnapshot_t& after = sessionIter->after;
+			sOut << ChangeMarker(sessionIter->kind) << L" Session " << after.dwSessionId;
+			if (ChangeKind_t::Changed == sessionIter->kind)
+			{
+				// Call out state transitions (e.g., Active -> Disconnected, Unlocked -> Locked)
+				if (before.state != after.state)
+					sOut << L" [State: " << before.sState << L" -> " << after.sState << L"]";
+				if (before.sessionFlags != after.sessionFlags)
+					sOut << L" [SessionFlags: " << before.sSessionFlags << L" -> " << after.sSessionFlags << L"]";
+			}
+			sOut << L":" << std::endl;
+			m_textRenderer.RenderSession(sOut, after);
+		}
+	}
+
+	RenderProcesses(sOut, diff.processes);
+
+	if (diff.bWindowStationEnumChanged)
+	{
+		if (after.windowStations.bValid)
+			sOut << L"~ Window stations can be enumerated again: " << after.windowStations.value.size() << std::endl << std::endl;
+		else
+			sOut << L"~ Unable to enumerate window stations: " << after.windowStations.sErrorInfo << std::endl << std::endl;
+	}
+
+	std::vector<Change_t<WindowStationSnapshot_t>>::const_iterator wsIter;
+	for (wsIter = diff.windowStations.begin(); wsIter != diff.windowStations.end(); wsIter++)
+	{
+		if (ChangeKind_t::Removed == wsIter->kind)
+		{
+			sOut << L"- Window station " << wsIter->before.sName << std::endl << std::endl;
+		}
+		else
+		{
+			// Desktops of a changed window station are listed individually if they changed.
+			sOut << ChangeMarker(wsIter->kind) << L" Window station:" << std::endl;
+			m_textRenderer.RenderWindowStation(sOut, wsIter->after, ChangeKind_t::Added == wsIter->kind);
+		}
+	}
+
+	std::vector<DesktopChange_t>::const_iterator desktopIter;
+	for (desktopIter = diff.desktops.begin(); desktopIter != diff.desktops.end(); desktopIter++)
+	{
+		const Change_t<DesktopSnapshot_t>& change = desktopIter->change;
+		if (ChangeKind_t::Removed == change.kind)
+		{
+			sOut << L"- Desktop " << desktopIter->sWindowStation << L"\\" << change.before.sName << std::endl << std::endl;
+		}
+		else
+		{
+			sOut << ChangeMarker(change.kind) << L" Desktop in WS " << desktopIter->sWindowStation << L":" << std::endl;
+			m_textRenderer.RenderDesktop(sOut, change.after);
+		}
+	}
+
+	RenderWindows(sOut, diff.windows);
+	RenderSecurityDescriptors(sOut, diff.securityDescriptors);
+
+	sOut.flush();
+}
+
+/// <summary>
+/// Internal: one line per process started, exited, or changed
+/// </summary>
+void DeltaRenderer::RenderProcesses(std::wostream& sOut, const std::vector<ProcessChange_t>& processes) const
+{
+	if (processes.empty())
+		return;
+
+	std::vector<ProcessChange_t>::const_iterator procIter;
+	for (procIter = processes.begin(); procIter != processes.end(); procIter++)
+	{
+		const Change_t<ProcessSnapshot_t>& change = procIter->change;
+		const ProcessSnapshot_t& process = (ChangeKind_t::Removed == change.kind ? change.before : change.after);
+		sOut << ChangeMarker(change.kind) << L" Process " << process.dwPID << L" " << process.sProcessName << L" in session " << procIter->dwSessionId;
+		if (ChangeKind_t::Removed != change.kind)
+			sOut << L" (" << process.user.DisplayName() << L")";
+		sOut << std::endl;
+	}
+	sOut << std::endl;
+}
+
+/// <summary>
+/// Internal: one line per top-level window created, destroyed, or changed
+/// </summary>
+void DeltaRenderer::RenderWindows(std::wostream& sOut, const std::vector<WindowChange_t>& windows) const
+{
+	if (windows.empty())
+		return;
+
+	std::vector<WindowChange_t>::const_iterator windowIter;
+	for (windowIter = windows.begin(); windowIter != windows.end(); windowIter++)
+	{
+		const Change_t<WindowSnapshot_t>& change = windowIter->change;
+		const WindowSnapshot_t& window = (ChangeKind_t::Removed == change.kind ? change.before : change.after);
+		sOut
+			<< ChangeMarker(change.kind) << L" Window " << HEX((unsigned long long)window.hwnd, 8, true, false)
+			<< L" in " << windowIter->sWindowStation << L"\\" << windowIter->sDesktop << L": ";
+		if (!window.bIsValid)
+		{
+			sOut << L"(INVALID)" << std::endl;
+			continue;
+		}
+		sOut
+			<< (window.bIsVisible ? L"Visible" : L"Hidden")
+			<< L", class \"" << escapeCrLfTabNul(window.sClassName) << L"\""
+			<< L", text \"" << escapeCrLfTabNul(window.sWindowText) << L"\""
+			<< L", PID " << window.PID << L" " << GetFileNameFromFilePath(window.sProcessPath)
+			<< std::endl;
+	}
+	sOut << std::endl;
+}
+
+/// <summary>
+/// Internal: each changed security descriptor, in the configured format
+/// </summary>
+void DeltaRenderer::RenderSecurityDescriptors(std::wostream& sOut, const std::vector<SecurityDescriptorChange_t>& securityDescriptors) const
+{
+	std::vector<SecurityDescriptorChange_t>::const_iterator sdIter;
+	for (sdIter = securityDescriptors.begin(); sdIter != securityDescriptors.end(); sdIter++)
+	{
+		const bool bWindowStation = sdIter->sDesktop.empty();
+		if (bWindowStation)
+			sOut << L"~ Security descriptor of WS " << sdIter->sWindowStation << L":" << std::endl;
+		else
+			sOut << L"~ Security descriptor of desktop " << sdIter->sWindowStation << L"\\" << sdIter->sDesktop << L":" << std::endl;
+		m_textRenderer.RenderSecurityDescriptor(sOut, sdIter->change.after, bWindowStation, 4);
+		// The detailed format ends with a blank line; SDDL doesn't.
+		if (SecDescOptions_t::SecDesc != m_options.secDescOption)
+			sOut << std::endl;
+	}
+}
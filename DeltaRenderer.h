@@ -0,0 +1,42 @@
+#pragma once
+
+// DeltaRenderer.h: renders the differences between two samples for watch mode.
+
+#include <iostream>
+#include "SnapshotDiff.h"
+#include "TextRenderer.h"
+
+/// <summary>
+/// Renders a SnapshotDiff_t. Added and changed sessions, window stations, and desktops are shown with their
+/// current details, in the same format as the full report; removed items are shown by name only.
+/// Process, window, and security descriptor changes are listed individually.
+/// </summary>
+class DeltaRenderer
+{
+public:
+	explicit DeltaRenderer(const TextRenderOptions_t& options);
+	~DeltaRenderer() = default;
+
+	/// <summary>
+	/// Write the differences, preceded by a timestamped header line. Writes nothing if there are no differences.
+	/// </summary>
+	/// <param name="sOut">Output stream</param>
+	/// <param name="diff">Differences to render</param>
+	/// <param name="after">The later sample the differences were computed against</param>
+	void Render(std::wostream& sOut, const SnapshotDiff_t& diff, const SystemSnapshot_t& after) const;
+
+private:
+	static const wchar_t* ChangeMarker(ChangeKind_t kind);
+	void RenderProcesses(std::wostream& sOut, const std::vector<ProcessChange_t>& processes) const;
+	void RenderWindows(std::wostream& sOut, const std::vector<WindowChange_t>& windows) const;
+	void RenderSecurityDescriptors(std::wostream& sOut, const std::vector<SecurityDescriptorChange_t>& securityDescriptors) const;
+
+private:
+	const TextRenderOptions_t m_options;
+	const TextRenderer m_textRenderer;
+
+private:
+	// Not implemented
+	DeltaRenderer(const DeltaRenderer&) = delete;
+	DeltaRenderer& operator = (const DeltaRenderer&) = delete;
+};
@@ -0,0 +1,510 @@
+// LiveSystemSource.cpp: SystemSource that queries the running Windows system.
+
+#include "LiveSystemSource.h"
+#include "TerminalSessions.h"
+#include "WinstaDesktop.h"
+#include "WhoAmI.h"
+#include "Token.h"
+#include "CSid.h"
+#include "SidNameCache.h"
+#include "SysErrorMessage.h"
+
+// ----------------------------------------------------------------------------------------------------
+// Internal helpers shared by window stations and desktops
+
+/// <summary>
+/// Internal helper: the user SID of a window station or desktop. Returns true with an empty SidInfo_t if the object has no user.
+/// </summary>
+static bool UserObjectUser(const UserObject& obj, SidInfo_t& user, std::wstring& sErrorInfo)
+{
+	user = SidInfo_t();
+	CSid sid;
+	if (obj.UserSID(sid, sErrorInfo))
+	{
+		LiveSystemSource::SidToSidInfo(sid, user);
+		return true;
+	}
+	// No error information means no user associated with the object
+	return sErrorInfo.empty();
+}
+
+/// <summary>
+/// Internal helper: captured user SID of a window station or desktop
+/// </summary>
+static void CaptureUserObjectUser(const UserObject& obj, Captured_t<SidInfo_t>& user)
+{
+	SidInfo_t sidInfo;
+	std::wstring sErrorInfo;
+	if (UserObjectUser(obj, sidInfo, sErrorInfo))
+		user.Set(sidInfo);
+	else
+		user.SetError(sErrorInfo);
+}
+
+/// <summary>
+/// Internal helper: the security descriptor of a window station or desktop, with SACL if possible
+/// </summary>
+static bool UserObjectSecurity(const UserObject& obj, std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo)
+{
+	sd.clear();
+	securityInformation = 0;
+	SecurityDescriptor objSD;
+	SECURITY_INFORMATION siWithSacl =
+		OWNER_SECURITY_INFORMATION |
+		GROUP_SECURITY_INFORMATION |
+		DACL_SECURITY_INFORMATION |
+		LABEL_SECURITY_INFORMATION |
+		SACL_SECURITY_INFORMATION;
+	SECURITY_INFORMATION siNoSacl =
+		OWNER_SECURITY_INFORMATION |
+		GROUP_SECURITY_INFORMATION |
+		DACL_SECURITY_INFORMATION |
+		LABEL_SECURITY_INFORMATION;
+	// Try to get SD with SACL; if that fails, try without.
+	if (obj.GetSecurity(objSD, siWithSacl, sErrorInfo))
+	{
+		securityInformation = siWithSacl;
+	}
+	else if (obj.GetSecurity(objSD, siNoSacl, sErrorInfo))
+	{
+		securityInformation = siNoSacl;
+	}
+	else
+	{
+		return false;
+	}
+	const uint8_t* pSD = (const uint8_t*)objSD.GetSD();
+	sd.assign(pSD, pSD + objSD.Size());
+	return true;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: an opened desktop
+/// </summary>
+class LiveDesktop : public SourceDesktop
+{
+public:
+	explicit LiveDesktop(const WindowStation& ws) : m_desktop(ws) {}
+	virtual ~LiveDesktop() = default;
+
+	bool Open(const std::wstring& sDesktopName, std::wstring& sErrorInfo)
+	{
+		return m_desktop.Open(sDesktopName.c_str(), MAXIMUM_ALLOWED, sErrorInfo);
+	}
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return m_desktop.Flags(sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return UserObjectUser(m_desktop, user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return UserObjectSecurity(m_desktop, sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool HeapSize(uint32_t& heapSizeKb, std::wstring& sErrorInfo) const override
+	{
+		ULONG uHeapSize = 0;
+		if (!m_desktop.HeapSize(uHeapSize, sErrorInfo))
+			return false;
+		heapSizeKb = uHeapSize;
+		return true;
+	}
+
+	virtual bool IsReceivingInput(bool& bReceivingInput, std::wstring& sErrorInfo) const override
+	{
+		BOOL bIsReceivingInput = FALSE;
+		if (!m_desktop.IsReceivingInput(bIsReceivingInput, sErrorInfo))
+			return false;
+		bReceivingInput = (bIsReceivingInput ? true : false);
+		return true;
+	}
+
+	virtual bool TopLevelWindows(WindowSnapshotList_t& windows, std::wstring& sErrorInfo) override
+	{
+		windows.clear();
+		WindowInfoCollection_t windowInfoCollection;
+		// Image paths are resolved once per process by the caller rather than once per window here.
+		if (!m_desktop.GetTopLevelWindows(windowInfoCollection, sErrorInfo, false))
+			return false;
+
+		// The collection is a map keyed by HWND, so the list is sorted by HWND.
+		windows.reserve(windowInfoCollection.size());
+		WindowInfoCollection_t::const_iterator infoCollIter;
+		for (infoCollIter = windowInfoCollection.begin(); infoCollIter != windowInfoCollection.end(); infoCollIter++)
+		{
+			const WindowInfo_t& windowInfo = infoCollIter->second;
+			WindowSnapshot_t window;
+			window.hwnd = (uint64_t)(uintptr_t)windowInfo.hwnd;
+			window.bIsValid = windowInfo.bIsValid;
+			window.bIsVisible = windowInfo.bIsVisible;
+			window.PID = windowInfo.PID;
+			window.TID = windowInfo.TID;
+			window.sClassName = windowInfo.sClassName;
+			window.sWindowText = windowInfo.sWindowText;
+			windows.push_back(window);
+		}
+		// GetTopLevelWindows can succeed with a warning, which is left in sErrorInfo.
+		return true;
+	}
+
+private:
+	Desktop m_desktop;
+};
+
+/// <summary>
+/// Internal: an opened window station
+/// </summary>
+class LiveWindowStation : public SourceWindowStation
+{
+public:
+	LiveWindowStation() = default;
+	virtual ~LiveWindowStation() = default;
+
+	bool Open(const std::wstring& sWindowStationName, std::wstring& sErrorInfo)
+	{
+		return m_ws.Open(sWindowStationName.c_str(), MAXIMUM_ALLOWED, sErrorInfo);
+	}
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return m_ws.Flags(sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return UserObjectUser(m_ws, user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return UserObjectSecurity(m_ws, sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool DesktopNames(std::vector<std::wstring>& desktopNames, std::wstring& sErrorInfo) const override
+	{
+		DesktopNameList_t desktopNameList;
+		if (!m_ws.GetDesktopNames(desktopNameList, sErrorInfo))
+			return false;
+		desktopNames.assign(desktopNameList.begin(), desktopNameList.end());
+		return true;
+	}
+
+	virtual std::unique_ptr<SourceDesktop> OpenDesktop(const std::wstring& sDesktopName, std::wstring& sErrorInfo) const override
+	{
+		LiveDesktop* pLiveDesktop = new LiveDesktop(m_ws);
+		std::unique_ptr<SourceDesktop> pDesktop(pLiveDesktop);
+		if (!pLiveDesktop->Open(sDesktopName, sErrorInfo))
+			return nullptr;
+		return pDesktop;
+	}
+
+private:
+	WindowStation m_ws;
+};
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal helper: a TerminalSession for the session ID, for the queries that need only the ID
+/// (user token). WTSSessionInfoEx isn't queried.
+/// </summary>
+static TerminalSession SessionFromId(uint32_t dwSessionId)
+{
+	WTS_SESSION_INFOW sessionInfo = { dwSessionId, nullptr, WTSInit };
+	TerminalSession session;
+	std::wstring sErrorInfo;
+	session.Initialize(sessionInfo, sErrorInfo, false);
+	return session;
+}
+
+/// <summary>
+/// Information about the context this process is running in (SIDs without names)
+/// </summary>
+void LiveSystemSource::CurrentInfo(CurrentInfoSnapshot_t& currentInfo)
+{
+	std::wstring sErrorInfo, sTextData;
+
+	DWORD dwSessionId = 0;
+	if (TerminalSession::CurrentProcessSessionId(dwSessionId, sErrorInfo))
+		currentInfo.sessionId.Set(dwSessionId);
+	else
+		currentInfo.sessionId.SetError(sErrorInfo);
+
+	const Desktop& desktop = Desktop::Original();
+	const WindowStation& winsta = desktop.WinSta();
+
+	if (winsta.Name(sTextData, sErrorInfo))
+		currentInfo.winstaName.Set(sTextData);
+	else
+		currentInfo.winstaName.SetError(sErrorInfo);
+	CaptureUserObjectUser(winsta, currentInfo.winstaUser);
+	if (winsta.Flags(sTextData, sErrorInfo))
+		currentInfo.winstaFlags.Set(sTextData);
+	else
+		currentInfo.winstaFlags.SetError(sErrorInfo);
+
+	if (desktop.Name(sTextData, sErrorInfo))
+		currentInfo.desktopName.Set(sTextData);
+	else
+		currentInfo.desktopName.SetError(sErrorInfo);
+	CaptureUserObjectUser(desktop, currentInfo.desktopUser);
+	if (desktop.Flags(sTextData, sErrorInfo))
+		currentInfo.desktopFlags.Set(sTextData);
+	else
+		currentInfo.desktopFlags.SetError(sErrorInfo);
+	ULONG heapSize = 0;
+	if (desktop.HeapSize(heapSize, sErrorInfo))
+		currentInfo.desktopHeapSizeKb.Set(heapSize);
+	else
+		currentInfo.desktopHeapSizeKb.SetError(sErrorInfo);
+
+	WhoAmI whoAmI;
+	SidToSidInfo(whoAmI.GetUserCSid(), currentInfo.runningAs);
+
+	Desktop inputDesktop(WindowStation::Original());
+	if (inputDesktop.InitFromInputDesktop(MAXIMUM_ALLOWED, sErrorInfo) && inputDesktop.Name(sTextData, sErrorInfo))
+		currentInfo.inputDesktopName.Set(sTextData);
+	else
+		currentInfo.inputDesktopName.SetError(sErrorInfo);
+
+	currentInfo.activeConsoleSessionId = TerminalSession::ActiveConsoleSessionId();
+	currentInfo.bChildSessionsEnabled = TerminalSession::AreChildSessionsEnabled();
+}
+
+/// <summary>
+/// Enumerate terminal sessions. Fills in only the ID, name, and state of each session.
+/// </summary>
+bool LiveSystemSource::EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo)
+{
+	sessions.clear();
+	TerminalSessionList_t tsList;
+	if (!TerminalSession::GetTerminalSessions(tsList, sErrorInfo, false))
+		return false;
+
+	sessions.reserve(tsList.size());
+	TerminalSessionList_t::const_iterator sessionIter;
+	for (sessionIter = tsList.begin(); sessionIter != tsList.end(); sessionIter++)
+	{
+		SessionSnapshot_t session;
+		session.dwSessionId = sessionIter->ID();
+		session.sName = sessionIter->Name();
+		session.state = (uint32_t)sessionIter->SessionInfoEx().SessionState;
+		session.sState = sessionIter->State();
+		sessions.push_back(session);
+	}
+	return true;
+}
+
+/// <summary>
+/// Query a session's detailed information: ID, name, state, session flags, user, and times.
+/// </summary>
+bool LiveSystemSource::QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo)
+{
+	TerminalSession ts;
+	if (!ts.Initialize(dwSessionId, sErrorInfo))
+		return false;
+
+	const WTSINFOEX_LEVEL1_W& tsInfo = ts.SessionInfoEx();
+	session.dwSessionId = ts.ID();
+	session.sName = ts.Name();
+	session.state = (uint32_t)tsInfo.SessionState;
+	session.sState = ts.State();
+	session.sessionFlags = tsInfo.SessionFlags;
+	session.sSessionFlags = ts.SessionFlags();
+	session.sDomainName = ts.DomainName();
+	session.sUserName = ts.UserName();
+	session.logonTime = tsInfo.LogonTime.QuadPart;
+	session.connectTime = tsInfo.ConnectTime.QuadPart;
+	session.disconnectTime = tsInfo.DisconnectTime.QuadPart;
+	session.lastInputTime = tsInfo.LastInputTime.QuadPart;
+	session.currentTime = tsInfo.CurrentTime.QuadPart;
+	return true;
+}
+
+/// <summary>
+/// Retrieve a session's user token(s).
+/// </summary>
+void LiveSystemSource::QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session)
+{
+	HANDLE hToken = NULL, hLinkedToken = NULL;
+	DWORD dwLastErr = 0;
+	if (SessionFromId(dwSessionId).GetUserToken(hToken, dwLastErr))
+	{
+		session.tokenStatus = TokenStatus_t::Retrieved;
+		CollectToken(hToken, session.token);
+		if (Token::GetLinkedToken(hToken, hLinkedToken))
+		{
+			session.bHasLinkedToken = true;
+			CollectToken(hLinkedToken, session.linkedToken);
+			CloseHandle(hLinkedToken);
+		}
+		CloseHandle(hToken);
+	}
+	else
+	{
+		switch (dwLastErr)
+		{
+		case ERROR_PRIVILEGE_NOT_HELD:
+			session.tokenStatus = TokenStatus_t::PrivilegeNotHeld;
+			break;
+		case ERROR_NO_TOKEN:
+		case ERROR_FILE_NOT_FOUND: // seeing sessions in Listen state returning ERROR_FILE_NOT_FOUND for some reason
+			session.tokenStatus = TokenStatus_t::NoToken;
+			break;
+		default:
+			session.tokenStatus = TokenStatus_t::Error;
+			session.sTokenError = SysErrorMessageWithCode(dwLastErr);
+			break;
+		}
+	}
+}
+
+/// <summary>
+/// Internal: collect the attributes of a token
+/// </summary>
+void LiveSystemSource::CollectToken(HANDLE hToken, TokenSnapshot_t& tokenSnapshot)
+{
+	// Value-initialize so that fields Token::GetTokenInfo can't retrieve are zero rather than garbage.
+	TokenInfo_t tokenInfo = TokenInfo_t();
+	std::wstring sErrorInfo;
+	Token::GetTokenInfo(hToken, tokenInfo, sErrorInfo);
+	SidToSidInfo(tokenInfo.sid, tokenSnapshot.user);
+	tokenSnapshot.logonSessionHigh = (uint32_t)tokenInfo.logonSession.HighPart;
+	tokenSnapshot.logonSessionLow = tokenInfo.logonSession.LowPart;
+	tokenSnapshot.integrityLevel = tokenInfo.integrityLevel;
+	tokenSnapshot.sIntegrityLevelName = tokenInfo.IntegrityLevelName();
+}
+
+/// <summary>
+/// Enumerate the processes in all sessions with one system-wide query. User SIDs are without names.
+/// </summary>
+bool LiveSystemSource::EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo)
+{
+	processes.Clear();
+	TSProcessInfoList_t procList;
+	if (!TerminalSession::GetAllProcesses(procList, sErrorInfo))
+		return false;
+
+	TSProcessInfoList_t::const_iterator procIter;
+	for (procIter = procList.begin(); procIter != procList.end(); procIter++)
+	{
+		ProcessSnapshot_t process;
+		process.dwPID = procIter->dwPID;
+		process.createTime = procIter->createTime;
+		process.sProcessName = procIter->sProcessName;
+		process.threadCount = procIter->dwThreadCount;
+		process.handleCount = procIter->dwHandleCount;
+		process.workingSetSize = procIter->workingSetSize;
+		process.pagefileUsage = procIter->pagefileUsage;
+		process.userTime = procIter->userTime;
+		process.kernelTime = procIter->kernelTime;
+		SidToSidInfo(procIter->userSid, process.user);
+		processes.Add(procIter->dwSessionId, process);
+	}
+	return true;
+}
+
+/// <summary>
+/// The full path of a process' executable image
+/// </summary>
+bool LiveSystemSource::ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo)
+{
+	return TerminalSession::GetProcessImagePath(dwPID, sImagePath, sErrorInfo);
+}
+
+/// <summary>
+/// Look up DOMAIN\username for a SID; returns false if the name can't be resolved.
+/// </summary>
+bool LiveSystemSource::LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername)
+{
+	sDomainAndUsername.clear();
+	// The Win32 SID functions don't modify the SID but aren't declared const.
+	PSID pSid = (PSID)sid.Data();
+	if (sid.IsEmpty() || !IsValidSid(pSid) || GetLengthSid(pSid) > sid.Length())
+		return false;
+	sDomainAndUsername = CSid(pSid).toDomainAndUsername();
+	return !sDomainAndUsername.empty();
+}
+
+/// <summary>
+/// Internal helper: DOMAIN\username as CSid::toDomainAndUsername formats it
+/// </summary>
+static std::wstring DomainAndUsername(const std::wstring& sDomainName, const std::wstring& sUserName)
+{
+	if (sDomainName.empty())
+		return sUserName;
+	return sDomainName + L"\\" + sUserName;
+}
+
+/// <summary>
+/// Look up DOMAIN\username for many SIDs at once, through the process-wide name cache: SIDs it has cached aren't
+/// looked up again, and the rest are translated together (LsaLookupSids2) on a resolver thread, waited on up to the
+/// --sid-timeout deadline. SIDs not resolved by then are left without names, so they render as SID strings.
+/// </summary>
+bool LiveSystemSource::LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	SidNameCache::BatchItemList_t items(sids.size());
+	for (size_t ix = 0; ix < sids.size(); ++ix)
+	{
+		// The Win32 SID functions don't modify the SID but aren't declared const.
+		PSID pSid = (PSID)sids[ix].Data();
+		if (sids[ix].IsEmpty() || !IsValidSid(pSid) || GetLengthSid(pSid) > sids[ix].Length())
+			continue;
+		items[ix].pSid = sids[ix].Data();
+		items[ix].cbSid = GetLengthSid(pSid);
+	}
+	CSid::NameCache().LookupBatch(items);
+	for (size_t ix = 0; ix < sids.size(); ++ix)
+	{
+		sids[ix].SetName(items[ix].bFound ? DomainAndUsername(items[ix].sDomainName, items[ix].sUserName) : std::wstring());
+	}
+	return true;
+}
+
+/// <summary>
+/// Enumerate the window stations in the current session
+/// </summary>
+bool LiveSystemSource::WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo)
+{
+	windowStationNames.clear();
+	WindowStationNameList_t wsNameList;
+	if (!WindowStation::GetWindowStationNames(wsNameList, sErrorInfo))
+		return false;
+	windowStationNames.assign(wsNameList.begin(), wsNameList.end());
+	return true;
+}
+
+/// <summary>
+/// Open a window station; returns nullptr with error information on failure.
+/// </summary>
+std::unique_ptr<SourceWindowStation> LiveSystemSource::OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo)
+{
+	LiveWindowStation* pLiveWindowStation = new LiveWindowStation();
+	std::unique_ptr<SourceWindowStation> pWindowStation(pLiveWindowStation);
+	if (!pLiveWindowStation->Open(sWindowStationName, sErrorInfo))
+		return nullptr;
+	return pWindowStation;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// A SID's binary form (no name lookup); empty if the SID is empty or invalid.
+/// </summary>
+void LiveSystemSource::SidToSidInfo(const CSid& sid, SidInfo_t& sidInfo)
+{
+	sidInfo = SidInfo_t();
+	PSID pSid = sid.psid();
+	if (nullptr == pSid || !IsValidSid(pSid))
+		return;
+	sidInfo.Assign((const uint8_t*)pSid, GetLengthSid(pSid));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// LiveSystemSource.h: SystemSource that queries the running Windows system.
+
+#include <Windows.h>
+#include "SystemSource.h"
+
+class CSid;
+
+/// <summary>
+/// Queries the running system through the TerminalSession, WindowStation, Desktop, CSid, Token, and WhoAmI classes.
+/// </summary>
+class LiveSystemSource : public SystemSource
+{
+public:
+	LiveSystemSource() = default;
+	virtual ~LiveSystemSource() = default;
+
+	virtual void CurrentInfo(CurrentInfoSnapshot_t& currentInfo) override;
+	virtual bool EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo) override;
+	virtual bool QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo) override;
+	virtual void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) override;
+	virtual bool EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo) override;
+	virtual bool ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo) override;
+	virtual bool LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) override;
+	virtual bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) override;
+	virtual bool WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo) override;
+	virtual std::unique_ptr<SourceWindowStation> OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo) override;
+
+	/// <summary>
+	/// A SID's binary form (no name lookup); empty if the SID is empty or invalid.
+	/// </summary>
+	static void SidToSidInfo(const CSid& sid, SidInfo_t& sidInfo);
+
+private:
+	/// <summary>
+	/// Internal: collect the attributes of a token
+	/// </summary>
+	static void CollectToken(HANDLE hToken, TokenSnapshot_t& tokenSnapshot);
+};
@@ -0,0 +1,286 @@
+// MappedFile.cpp: read-only memory-mapped file, and whole-file binary writes.
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include "SysErrorMessage.h"
+#else
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+// ------------------------------------------------------------------------------------------
+// POSIX helpers
+
+/// <summary>
+/// Internal: convert a wide-character path to the UTF-8 that POSIX file APIs expect
+/// </summary>
+static std::string PathToUtf8(const std::wstring& sPath)
+{
+	std::string sUtf8;
+	for (size_t ix = 0; ix < sPath.size(); ++ix)
+	{
+		uint32_t ch = (uint32_t)sPath[ix];
+		if (ch < 0x80)
+		{
+			sUtf8.push_back((char)ch);
+		}
+		else if (ch < 0x800)
+		{
+			sUtf8.push_back((char)(0xC0 | (ch >> 6)));
+			sUtf8.push_back((char)(0x80 | (ch & 0x3F)));
+		}
+		else if (ch < 0x10000)
+		{
+			sUtf8.push_back((char)(0xE0 | (ch >> 12)));
+			sUtf8.push_back((char)(0x80 | ((ch >> 6) & 0x3F)));
+			sUtf8.push_back((char)(0x80 | (ch & 0x3F)));
+		}
+		else
+		{
+			sUtf8.push_back((char)(0xF0 | (ch >> 18)));
+			sUtf8.push_back((char)(0x80 | ((ch >> 12) & 0x3F)));
+			sUtf8.push_back((char)(0x80 | ((ch >> 6) & 0x3F)));
+			sUtf8.push_back((char)(0x80 | (ch & 0x3F)));
+		}
+	}
+	return sUtf8;
+}
+
+/// <summary>
+/// Internal: error text for the current errno value
+/// </summary>
+static std::wstring ErrnoMessage()
+{
+	int nErr = errno;
+	const char* szErr = strerror(nErr);
+	std::wstring sErr;
+	for (const char* pc = szErr; *pc; ++pc)
+		sErr.push_back((wchar_t)(unsigned char)*pc);
+	return sErr + L" (errno " + std::to_wstring(nErr) + L")";
+}
+#endif
+
+// ------------------------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+/// <summary>
+/// Map the named file. Closes any file previously mapped by this object.
+/// </summary>
+bool MappedFile::Open(const std::wstring& sPath, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	Close();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileW(sPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		sErrorInfo = L"Cannot open " + sPath + L": " + SysErrorMessageWithCode();
+		return false;
+	}
+	m_hFile = hFile;
+
+	LARGE_INTEGER fileSize = { 0 };
+	if (!GetFileSizeEx(hFile, &fileSize))
+	{
+		sErrorInfo = L"Cannot get size of " + sPath + L": " + SysErrorMessageWithCode();
+		Close();
+		return false;
+	}
+	if ((uint64_t)fileSize.QuadPart > (uint64_t)SIZE_MAX)
+	{
+		sErrorInfo = L"File too large to map: " + sPath;
+		Close();
+		return false;
+	}
+	// An empty file can't be mapped; report it as mapped with no data.
+	if (0 == fileSize.QuadPart)
+		return true;
+
+	m_hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (NULL == m_hMapping)
+	{
+		sErrorInfo = L"Cannot map " + sPath + L": " + SysErrorMessageWithCode();
+		Close();
+		return false;
+	}
+	m_pData = (const uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (nullptr == m_pData)
+	{
+		sErrorInfo = L"Cannot map " + sPath + L": " + SysErrorMessageWithCode();
+		Close();
+		return false;
+	}
+	m_size = (size_t)fileSize.QuadPart;
+#else
+	m_fd = open(PathToUtf8(sPath).c_str(), O_RDONLY);
+	if (m_fd < 0)
+	{
+		sErrorInfo = L"Cannot open " + sPath + L": " + ErrnoMessage();
+		return false;
+	}
+
+	struct stat statBuf;
+	if (0 != fstat(m_fd, &statBuf))
+	{
+		sErrorInfo = L"Cannot get size of " + sPath + L": " + ErrnoMessage();
+		Close();
+		return false;
+	}
+	if ((uint64_t)statBuf.st_size > (uint64_t)SIZE_MAX)
+	{
+		sErrorInfo = L"File too large to map: " + sPath;
+		Close();
+		return false;
+	}
+	// An empty file can't be mapped; report it as mapped with no data.
+	if (0 == statBuf.st_size)
+		return true;
+
+	void* pMapped = mmap(nullptr, (size_t)statBuf.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (MAP_FAILED == pMapped)
+	{
+		sErrorInfo = L"Cannot map " + sPath + L": " + ErrnoMessage();
+		Close();
+		return false;
+	}
+	m_pData = (const uint8_t*)pMapped;
+	m_size = (size_t)statBuf.st_size;
+#endif
+
+	return true;
+}
+
+/// <summary>
+/// Unmap the file and release its handles.
+/// </summary>
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (nullptr != m_pData)
+		UnmapViewOfFile(m_pData);
+	if (nullptr != m_hMapping)
+		CloseHandle(m_hMapping);
+	if (nullptr != m_hFile)
+		CloseHandle(m_hFile);
+	m_hMapping = m_hFile = nullptr;
+#else
+	if (nullptr != m_pData)
+		munmap((void*)m_pData, m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+	m_pData = nullptr;
+	m_size = 0;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Create or overwrite a file with the supplied bytes.
+/// </summary>
+bool WriteBinaryFile(const std::wstring& sPath, const std::vector<uint8_t>& data, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileW(sPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		sErrorInfo = L"Cannot create " + sPath + L": " + SysErrorMessageWithCode();
+		return false;
+	}
+	bool retval = true;
+	size_t nWritten = 0;
+	while (retval && nWritten < data.size())
+	{
+		// WriteFile takes a DWORD count; write in chunks of at most 1 GB.
+		const size_t maxChunk = 0x40000000;
+		DWORD dwToWrite = (DWORD)(data.size() - nWritten < maxChunk ? data.size() - nWritten : maxChunk);
+		DWORD dwWritten = 0;
+		if (!WriteFile(hFile, data.data() + nWritten, dwToWrite, &dwWritten, NULL))
+		{
+			sErrorInfo = L"Cannot write " + sPath + L": " + SysErrorMessageWithCode();
+			retval = false;
+		}
+		nWritten += dwWritten;
+	}
+	CloseHandle(hFile);
+	return retval;
+#else
+	int fd = open(PathToUtf8(sPath).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		sErrorInfo = L"Cannot create " + sPath + L": " + ErrnoMessage();
+		return false;
+	}
+	bool retval = true;
+	size_t nWritten = 0;
+	while (retval && nWritten < data.size())
+	{
+		ssize_t nResult = write(fd, data.data() + nWritten, data.size() - nWritten);
+		if (nResult < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			sErrorInfo = L"Cannot write " + sPath + L": " + ErrnoMessage();
+			retval = false;
+		}
+		else
+		{
+			nWritten += (size_t)nResult;
+		}
+	}
+	if (0 != close(fd) && retval)
+	{
+		sErrorInfo = L"Cannot write " + sPath + L": " + ErrnoMessage();
+		retval = false;
+	}
+	return retval;
+#endif
+}
+
+/// <summary>
+/// Create or replace a file with the supplied bytes so that readers see either the old contents or the new.
+/// </summary>
+bool ReplaceBinaryFile(const std::wstring& sPath, const std::vector<uint8_t>& data, std::wstring& sErrorInfo)
+{
+	// The process ID keeps concurrent writers from sharing a temporary file.
+#ifdef _WIN32
+	const std::wstring sTempPath = sPath + L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+#else
+	const std::wstring sTempPath = sPath + L"." + std::to_wstring(getpid()) + L".tmp";
+#endif
+	if (!WriteBinaryFile(sTempPath, data, sErrorInfo))
+		return false;
+
+#ifdef _WIN32
+	if (!MoveFileExW(sTempPath.c_str(), sPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		sErrorInfo = L"Cannot replace " + sPath + L": " + SysErrorMessageWithCode();
+		DeleteFileW(sTempPath.c_str());
+		return false;
+	}
+#else
+	if (0 != rename(PathToUtf8(sTempPath).c_str(), PathToUtf8(sPath).c_str()))
+	{
+		sErrorInfo = L"Cannot replace " + sPath + L": " + ErrnoMessage();
+		unlink(PathToUtf8(sTempPath).c_str());
+		return false;
+	}
+#endif
+	return true;
+}
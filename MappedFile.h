@@ -0,0 +1,77 @@
+#pragma once
+
+// MappedFile.h: read-only memory-mapped file, and whole-file binary writes.
+// Portable: Win32 file mapping on Windows, mmap elsewhere.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Maps an entire file read-only into memory for the lifetime of the object (or until Close).
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	/// <summary>
+	/// Map the named file. Closes any file previously mapped by this object.
+	/// </summary>
+	/// <param name="sPath">Input: path of the file to map</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Open(const std::wstring& sPath, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Unmap the file and release its handles.
+	/// </summary>
+	void Close();
+
+	/// <summary>
+	/// Start of the mapped file contents; nullptr if no file is mapped or the file is empty.
+	/// </summary>
+	const uint8_t* Data() const { return m_pData; }
+
+	/// <summary>
+	/// Size of the mapped file in bytes
+	/// </summary>
+	size_t Size() const { return m_size; }
+
+private:
+	const uint8_t* m_pData = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	// File and file-mapping HANDLEs (kept as void* so this header doesn't need Windows.h)
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+
+private:
+	// Not implemented
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+};
+
+/// <summary>
+/// Create or overwrite a file with the supplied bytes.
+/// </summary>
+/// <param name="sPath">Input: path of the file to write</param>
+/// <param name="data">Input: the complete file contents</param>
+/// <param name="sErrorInfo">Output: error information on failure</param>
+/// <returns>true on success, false otherwise</returns>
+bool WriteBinaryFile(const std::wstring& sPath, const std::vector<uint8_t>& data, std::wstring& sErrorInfo);
+
+/// <summary>
+/// Create or replace a file with the supplied bytes so that readers see either the old contents or the new,
+/// never a partial file: the data is written to a temporary file in the same directory, which then replaces the target.
+/// </summary>
+/// <param name="sPath">Input: path of the file to write</param>
+/// <param name="data">Input: the complete file contents</param>
+/// <param name="sErrorInfo">Output: error information on failure</param>
+/// <returns>true on success, false otherwise</returns>
+bool ReplaceBinaryFile(const std::wstring& sPath, const std::vector<uint8_t>& data, std::wstring& sErrorInfo);
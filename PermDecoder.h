@@ -0,0 +1,102 @@
+#pragma once
+
+// PermDecoder.h: compile-time decoding tables that name the bits of an access mask. The names come from perm_t
+// arrays scanned in order, each match removing its bits from the mask; a PermDecoder_t holds the outcome of that
+// scan for every bit, so that decoding a mask is a few lookups.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// Generic and object-specific permission values.
+/// The xSpecific arrays are object-specific bitmasks.
+/// The xMask arrays are standard/generic bitmasks.
+/// The xMatch arrays are aggregated sets of permissions.
+/// </summary>
+struct perm_t { uint32_t mask; const wchar_t * szName; };
+
+/// <summary>
+/// Decoding table for one object type's permissions: the generic rights, then the type's xSpecific array, then the
+/// standard rights, each of them a null-terminated perm_t array.
+/// </summary>
+struct PermDecoder_t
+{
+	// The type's xMatch array, if it has one
+	const perm_t* pPermsMatch;
+	// Names of the bits the scan can match, in the order the scan outputs them
+	const wchar_t* szNames[32];
+	// For each byte of an access mask and each value of that byte: bit n is set if szNames[n] is one of its bits
+	uint32_t nameBits[4][256];
+	// All the bits that have names; the rest are output in hex
+	uint32_t namedBits;
+	// Whether every name the scan can match is for a single bit, as the lookups require
+	bool bSingleBitNames;
+
+	/// <summary>
+	/// The names in an access mask, as a set of szNames indexes: bit n is set if szNames[n] is output.
+	/// </summary>
+	uint32_t NameBits(uint32_t mask) const
+	{
+		return
+			nameBits[0][mask & 0xFF] |
+			nameBits[1][(mask >> 8) & 0xFF] |
+			nameBits[2][(mask >> 16) & 0xFF] |
+			nameBits[3][(mask >> 24) & 0xFF];
+	}
+};
+
+/// <summary>
+/// Build the decoding table for an object type from its arrays, in scan order.
+/// An entry can match only if none of its bits belongs to an earlier entry: a single-bit entry removes its bit
+/// when the bit is present, and if it isn't present, nothing later that includes it can match either.
+/// </summary>
+/// <param name="pPermsGeneric">Input: generic rights</param>
+/// <param name="pPermsSpecific">Input: the type's xSpecific array; can be nullptr</param>
+/// <param name="pPermsStandard">Input: standard rights</param>
+/// <param name="pPermsMatch">Input: the type's xMatch array; can be nullptr</param>
+constexpr PermDecoder_t BuildPermDecoder(const perm_t* pPermsGeneric, const perm_t* pPermsSpecific, const perm_t* pPermsStandard, const perm_t* pPermsMatch)
+{
+	PermDecoder_t decoder = {};
+	decoder.pPermsMatch = pPermsMatch;
+	decoder.bSingleBitNames = true;
+
+	size_t nameOfBit[32] = {};
+	size_t nNames = 0;
+	const perm_t* scanOrder[] = { pPermsGeneric, pPermsSpecific, pPermsStandard };
+	for (size_t ixArray = 0; ixArray < sizeof(scanOrder) / sizeof(scanOrder[0]); ++ixArray)
+	{
+		for (const perm_t* pPerm = scanOrder[ixArray]; nullptr != pPerm && nullptr != pPerm->szName; pPerm++)
+		{
+			if (0 != (pPerm->mask & decoder.namedBits))
+				continue;
+			if (0 == pPerm->mask || 0 != (pPerm->mask & (pPerm->mask - 1)))
+			{
+				decoder.bSingleBitNames = false;
+				continue;
+			}
+			size_t ixBit = 0;
+			while (0 == (pPerm->mask & (1u << ixBit)))
+				++ixBit;
+			nameOfBit[ixBit] = nNames;
+			decoder.szNames[nNames++] = pPerm->szName;
+			decoder.namedBits |= pPerm->mask;
+		}
+	}
+
+	// Single-bit values first; every other value is its lowest bit plus the rest, which is a smaller value.
+	for (size_t ixBit = 0; ixBit < 32; ++ixBit)
+	{
+		if (0 != (decoder.namedBits & (1u << ixBit)))
+			decoder.nameBits[ixBit / 8][(size_t)1 << (ixBit % 8)] = 1u << nameOfBit[ixBit];
+	}
+	for (size_t ixByte = 0; ixByte < 4; ++ixByte)
+	{
+		for (size_t value = 3; value < 256; ++value)
+		{
+			const size_t rest = value & (value - 1);
+			decoder.nameBits[ixByte][value] = decoder.nameBits[ixByte][value - rest] | decoder.nameBits[ixByte][rest];
+		}
+	}
+	return decoder;
+}
@@ -0,0 +1,75 @@
+// ProcessTable.cpp: every process on the system from one enumeration, indexed by PID and by session ID.
+
+#include "ProcessTable.h"
+
+/// <summary>
+/// Remove all processes and image paths
+/// </summary>
+void ProcessTable::Clear()
+{
+	m_sessionIds.clear();
+	m_processes.clear();
+	m_pidIndex.clear();
+	m_sessionIndex.clear();
+	m_imagePaths.clear();
+}
+
+/// <summary>
+/// Add a process. Processes are kept in the order added.
+/// </summary>
+void ProcessTable::Add(uint32_t dwSessionId, const ProcessSnapshot_t& process)
+{
+	size_t ix = m_processes.size();
+	m_sessionIds.push_back(dwSessionId);
+	m_processes.push_back(process);
+	m_pidIndex[process.dwPID] = ix;
+	m_sessionIndex[dwSessionId].push_back(ix);
+}
+
+/// <summary>
+/// The process with the given PID; nullptr if it isn't in the table.
+/// </summary>
+const ProcessSnapshot_t* ProcessTable::FindByPid(uint32_t dwPID) const
+{
+	std::unordered_map<uint32_t, size_t>::const_iterator iter = m_pidIndex.find(dwPID);
+	if (m_pidIndex.end() == iter)
+		return nullptr;
+	return &m_processes[iter->second];
+}
+
+/// <summary>
+/// The processes in one session, in enumeration order (empty if the session has none)
+/// </summary>
+void ProcessTable::SessionProcesses(uint32_t dwSessionId, ProcessSnapshotList_t& processes) const
+{
+	processes.clear();
+	std::map<uint32_t, std::vector<size_t>>::const_iterator iter = m_sessionIndex.find(dwSessionId);
+	if (m_sessionIndex.end() == iter)
+		return;
+	processes.reserve(iter->second.size());
+	std::vector<size_t>::const_iterator ixIter;
+	for (ixIter = iter->second.begin(); ixIter != iter->second.end(); ixIter++)
+	{
+		processes.push_back(m_processes[*ixIter]);
+	}
+}
+
+/// <summary>
+/// A previously resolved image path (or the error text from trying to resolve it)
+/// </summary>
+bool ProcessTable::FindImagePath(uint32_t dwPID, std::wstring& sImagePath) const
+{
+	std::unordered_map<uint32_t, std::wstring>::const_iterator iter = m_imagePaths.find(dwPID);
+	if (m_imagePaths.end() == iter)
+		return false;
+	sImagePath = iter->second;
+	return true;
+}
+
+/// <summary>
+/// Record a PID's resolved image path (or the error text from trying to resolve it).
+/// </summary>
+void ProcessTable::SetImagePath(uint32_t dwPID, const std::wstring& sImagePath)
+{
+	m_imagePaths[dwPID] = sImagePath;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// ProcessTable.h: every process on the system from one enumeration, indexed by PID and by session ID.
+// Shared by the per-session process listings and the join from top-level windows to their processes.
+// Portable C++ (no Windows dependencies).
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SystemSnapshot.h"
+
+/// <summary>
+/// All processes from one system-wide enumeration, plus the image paths resolved for them so far
+/// </summary>
+class ProcessTable
+{
+public:
+	ProcessTable() = default;
+	~ProcessTable() = default;
+
+	/// <summary>
+	/// Remove all processes and image paths
+	/// </summary>
+	void Clear();
+
+	/// <summary>
+	/// Add a process. Processes are kept in the order added.
+	/// </summary>
+	void Add(uint32_t dwSessionId, const ProcessSnapshot_t& process);
+
+	size_t Size() const { return m_processes.size(); }
+	uint32_t SessionId(size_t ix) const { return m_sessionIds[ix]; }
+	const ProcessSnapshot_t& Process(size_t ix) const { return m_processes[ix]; }
+
+	/// <summary>
+	/// The process with the given PID; nullptr if it isn't in the table.
+	/// </summary>
+	const ProcessSnapshot_t* FindByPid(uint32_t dwPID) const;
+
+	/// <summary>
+	/// The processes in one session, in enumeration order (empty if the session has none)
+	/// </summary>
+	void SessionProcesses(uint32_t dwSessionId, ProcessSnapshotList_t& processes) const;
+
+	/// <summary>
+	/// A previously resolved image path (or the error text from trying to resolve it)
+	/// </summary>
+	/// <returns>true if the PID's image path has been resolved</returns>
+	bool FindImagePath(uint32_t dwPID, std::wstring& sImagePath) const;
+
+	/// <summary>
+	/// Record a PID's resolved image path (or the error text from trying to resolve it). The PID needn't be in the table.
+	/// </summary>
+	void SetImagePath(uint32_t dwPID, const std::wstring& sImagePath);
+
+private:
+	std::vector<uint32_t> m_sessionIds;
+	std::vector<ProcessSnapshot_t> m_processes;
+	// PID -> index
+	std::unordered_map<uint32_t, size_t> m_pidIndex;
+	// Session ID -> indexes, in enumeration order
+	std::map<uint32_t, std::vector<size_t>> m_sessionIndex;
+	// PID -> image path or error text
+	std::unordered_map<uint32_t, std::wstring> m_imagePaths;
+};
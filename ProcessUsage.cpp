@@ -0,0 +1,216 @@
+// ProcessUsage.cpp: host-wide, per-session, and per-user rollups of process resource usage.
+
+#include "ProcessUsage.h"
+#include <algorithm>
+#include <functional>
+
+void UsageTotals_t::Add(const ProcessUsage_t& process)
+{
+	++nProcesses;
+	threadCount += process.threadCount;
+	handleCount += process.handleCount;
+	workingSetSize += process.workingSetSize;
+	pagefileUsage += process.pagefileUsage;
+	userTime += process.userTime;
+	kernelTime += process.kernelTime;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Replace the contents with the collected processes of every session.
+/// </summary>
+void ProcessUsageTable::Load(const SessionSnapshotList_t& sessions)
+{
+	m_processes.clear();
+	m_users.clear();
+	m_userIndex.clear();
+
+	size_t nProcesses = 0;
+	SessionSnapshotList_t::const_iterator sessionIter;
+	for (sessionIter = sessions.begin(); sessionIter != sessions.end(); sessionIter++)
+	{
+		nProcesses += sessionIter->processes.value.size();
+	}
+	m_processes.reserve(nProcesses);
+
+	for (sessionIter = sessions.begin(); sessionIter != sessions.end(); sessionIter++)
+	{
+		ProcessSnapshotList_t::const_iterator procIter;
+		for (procIter = sessionIter->processes.value.begin(); procIter != sessionIter->processes.value.end(); procIter++)
+		{
+			Add(sessionIter->dwSessionId, *procIter);
+		}
+	}
+}
+
+/// <summary>
+/// Add one process. Processes with the same user SID share a user index.
+/// </summary>
+void ProcessUsageTable::Add(uint32_t dwSessionId, const ProcessSnapshot_t& process)
+{
+	ProcessUsage_t usage;
+	usage.dwSessionId = dwSessionId;
+	UserIndex_t::const_iterator userIter = m_userIndex.find(process.user);
+	if (m_userIndex.end() == userIter)
+	{
+		usage.userIndex = (uint32_t)m_users.size();
+		m_userIndex[process.user] = usage.userIndex;
+		m_users.push_back(&process.user);
+	}
+	else
+	{
+		usage.userIndex = userIter->second;
+	}
+	usage.threadCount = process.threadCount;
+	usage.handleCount = process.handleCount;
+	usage.workingSetSize = process.workingSetSize;
+	usage.pagefileUsage = process.pagefileUsage;
+	usage.userTime = process.userTime;
+	usage.kernelTime = process.kernelTime;
+	usage.pProcess = &process;
+	m_processes.push_back(usage);
+}
+
+// Internal: identifies a process across samples, even if its PID is reused
+struct ProcessKey_t
+{
+	uint32_t dwPID;
+	int64_t createTime;
+
+	bool operator == (const ProcessKey_t& other) const { return dwPID == other.dwPID && createTime == other.createTime; }
+};
+
+struct ProcessKeyHash_t
+{
+	size_t operator()(const ProcessKey_t& key) const
+	{
+		return std::hash<uint64_t>()(((uint64_t)key.createTime * 0x9E3779B97F4A7C15ULL) ^ key.dwPID);
+	}
+};
+
+static ProcessKey_t ProcessKey(const ProcessSnapshot_t& process)
+{
+	ProcessKey_t key = { process.dwPID, process.createTime };
+	return key;
+}
+
+/// <summary>
+/// Replace each process' CPU times with the CPU time it used since an earlier sample.
+/// </summary>
+void ProcessUsageTable::SubtractCpuTime(const ProcessUsageTable& earlier)
+{
+	typedef std::unordered_map<ProcessKey_t, size_t, ProcessKeyHash_t> ProcessIndex_t;
+	ProcessIndex_t earlierIndex;
+	earlierIndex.reserve(earlier.m_processes.size());
+	for (size_t ix = 0; ix < earlier.m_processes.size(); ++ix)
+		earlierIndex[ProcessKey(*earlier.m_processes[ix].pProcess)] = ix;
+
+	std::vector<ProcessUsage_t>::iterator procIter;
+	for (procIter = m_processes.begin(); procIter != m_processes.end(); procIter++)
+	{
+		ProcessIndex_t::const_iterator earlierIter = earlierIndex.find(ProcessKey(*procIter->pProcess));
+		if (earlierIndex.end() == earlierIter)
+			continue;
+		const ProcessUsage_t& earlierProcess = earlier.m_processes[earlierIter->second];
+		// The creation time is 0 if it wasn't known, so a reused PID can match a different process;
+		// never report negative usage.
+		procIter->userTime = std::max<int64_t>(0, procIter->userTime - earlierProcess.userTime);
+		procIter->kernelTime = std::max<int64_t>(0, procIter->kernelTime - earlierProcess.kernelTime);
+	}
+}
+
+/// <summary>
+/// The value a process is ranked by
+/// </summary>
+uint64_t ProcessUsageTable::Weight(const ProcessUsage_t& process, UsageMetric_t metric)
+{
+	switch (metric)
+	{
+	case UsageMetric_t::WorkingSet:
+		return process.workingSetSize;
+	case UsageMetric_t::Handles:
+		return process.handleCount;
+	case UsageMetric_t::Cpu:
+	default:
+		return (uint64_t)(process.userTime + process.kernelTime);
+	}
+}
+
+/// <summary>
+/// Compute the totals and the nTop heaviest processes for all processes, each session, and each user,
+/// in one pass over the processes.
+/// </summary>
+void ProcessUsageTable::RollUp(UsageMetric_t metric, size_t nTop, UsageRollup_t& rollup) const
+{
+	rollup = UsageRollup_t();
+	rollup.users.resize(m_users.size());
+	for (size_t ix = 0; ix < rollup.users.size(); ++ix)
+		rollup.users[ix].key = (uint32_t)ix;
+
+	// Each process' weight is computed as the pass reaches it; the heaps compare them by process index.
+	std::vector<uint64_t> weights(m_processes.size());
+
+	// "Less heavy" ordering for a min-heap: the lightest kept candidate is at the front.
+	// Ties go to the earlier process.
+	auto heavier = [&weights](size_t ixA, size_t ixB)
+	{
+		return weights[ixA] > weights[ixB] || (weights[ixA] == weights[ixB] && ixA < ixB);
+	};
+	auto offer = [nTop, &heavier](std::vector<size_t>& heap, size_t ix)
+	{
+		if (heap.size() < nTop)
+		{
+			heap.push_back(ix);
+			std::push_heap(heap.begin(), heap.end(), heavier);
+		}
+		else if (nTop > 0 && heavier(ix, heap.front()))
+		{
+			std::pop_heap(heap.begin(), heap.end(), heavier);
+			heap.back() = ix;
+			std::push_heap(heap.begin(), heap.end(), heavier);
+		}
+	};
+
+	// Session ID -> index into rollup.sessions. Processes are usually grouped by session,
+	// so the previous process' session is checked first.
+	std::unordered_map<uint32_t, size_t> sessionGroups;
+	size_t ixSessionGroup = 0;
+	for (size_t ix = 0; ix < m_processes.size(); ++ix)
+	{
+		const ProcessUsage_t& process = m_processes[ix];
+		weights[ix] = Weight(process, metric);
+		if (rollup.sessions.empty() || rollup.sessions[ixSessionGroup].key != process.dwSessionId)
+		{
+			std::unordered_map<uint32_t, size_t>::const_iterator groupIter = sessionGroups.find(process.dwSessionId);
+			if (sessionGroups.end() == groupIter)
+			{
+				ixSessionGroup = rollup.sessions.size();
+				sessionGroups[process.dwSessionId] = ixSessionGroup;
+				rollup.sessions.push_back(UsageGroup_t());
+				rollup.sessions.back().key = process.dwSessionId;
+			}
+			else
+			{
+				ixSessionGroup = groupIter->second;
+			}
+		}
+		UsageGroup_t& sessionGroup = rollup.sessions[ixSessionGroup];
+		UsageGroup_t& userGroup = rollup.users[process.userIndex];
+
+		rollup.all.totals.Add(process);
+		sessionGroup.totals.Add(process);
+		userGroup.totals.Add(process);
+		offer(rollup.all.top, ix);
+		offer(sessionGroup.top, ix);
+		offer(userGroup.top, ix);
+	}
+
+	// Heaviest first
+	std::sort_heap(rollup.all.top.begin(), rollup.all.top.end(), heavier);
+	UsageGroupList_t::iterator groupIter;
+	for (groupIter = rollup.sessions.begin(); groupIter != rollup.sessions.end(); groupIter++)
+		std::sort_heap(groupIter->top.begin(), groupIter->top.end(), heavier);
+	for (groupIter = rollup.users.begin(); groupIter != rollup.users.end(); groupIter++)
+		std::sort_heap(groupIter->top.begin(), groupIter->top.end(), heavier);
+}
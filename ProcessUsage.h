@@ -0,0 +1,130 @@
+#pragma once
+
+// ProcessUsage.h: host-wide, per-session, and per-user rollups of process resource usage.
+// Processes are flattened into one contiguous array; the totals and each group's heaviest processes
+// are computed in a single pass over it, keeping only a bounded heap of candidates per group.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SystemSnapshot.h"
+
+/// <summary>
+/// What "heaviest" means when ranking processes
+/// </summary>
+enum class UsageMetric_t { Cpu, WorkingSet, Handles };
+
+/// <summary>
+/// One process' resource usage, flattened for aggregation
+/// </summary>
+struct ProcessUsage_t
+{
+	uint32_t dwSessionId = 0;
+	// Index into the table's users
+	uint32_t userIndex = 0;
+	uint32_t threadCount = 0;
+	uint32_t handleCount = 0;
+	uint64_t workingSetSize = 0;
+	uint64_t pagefileUsage = 0;
+	int64_t userTime = 0;
+	int64_t kernelTime = 0;
+	// The process this row was made from
+	const ProcessSnapshot_t* pProcess = nullptr;
+};
+
+/// <summary>
+/// Sums over a group of processes. Memory sizes are in bytes; CPU times are 100-nanosecond intervals.
+/// </summary>
+struct UsageTotals_t
+{
+	uint64_t nProcesses = 0;
+	uint64_t threadCount = 0;
+	uint64_t handleCount = 0;
+	uint64_t workingSetSize = 0;
+	uint64_t pagefileUsage = 0;
+	int64_t userTime = 0;
+	int64_t kernelTime = 0;
+
+	void Add(const ProcessUsage_t& process);
+};
+
+/// <summary>
+/// Totals and heaviest processes of one group: all processes, one session, or one user
+/// </summary>
+struct UsageGroup_t
+{
+	// Session ID, or index into the table's users; 0 for all processes
+	uint32_t key = 0;
+	UsageTotals_t totals;
+	// Indexes into the table's processes, heaviest first
+	std::vector<size_t> top;
+};
+typedef std::vector<UsageGroup_t> UsageGroupList_t;
+
+/// <summary>
+/// Result of ProcessUsageTable::RollUp
+/// </summary>
+struct UsageRollup_t
+{
+	UsageGroup_t all;
+	// Sessions and users in the order of their first process in the table
+	UsageGroupList_t sessions;
+	UsageGroupList_t users;
+};
+
+/// <summary>
+/// Flattened process usage, and the rollups computed from it
+/// </summary>
+class ProcessUsageTable
+{
+public:
+	ProcessUsageTable() = default;
+	~ProcessUsageTable() = default;
+
+	/// <summary>
+	/// Replace the contents with the collected processes of every session.
+	/// The sessions must outlive the table, and must not be modified while it's in use.
+	/// </summary>
+	void Load(const SessionSnapshotList_t& sessions);
+
+	/// <summary>
+	/// Add one process. Processes with the same user SID share a user index.
+	/// The process must outlive the table, and must not be modified while it's in use.
+	/// </summary>
+	void Add(uint32_t dwSessionId, const ProcessSnapshot_t& process);
+
+	/// <summary>
+	/// Replace each process' CPU times with the CPU time it used since an earlier sample, so that rankings
+	/// reflect current load rather than lifetime totals. Processes are matched by PID and creation time;
+	/// a process not in the earlier sample started since, so all of its CPU time counts.
+	/// </summary>
+	void SubtractCpuTime(const ProcessUsageTable& earlier);
+
+	const std::vector<ProcessUsage_t>& Processes() const { return m_processes; }
+	size_t UserCount() const { return m_users.size(); }
+	const SidInfo_t& User(size_t userIndex) const { return *m_users[userIndex]; }
+
+	/// <summary>
+	/// Compute the totals and the nTop heaviest processes for all processes, each session, and each user,
+	/// in one pass over the processes. Ties rank in table order.
+	/// </summary>
+	/// <param name="metric">Input: what to rank processes by</param>
+	/// <param name="nTop">Input: maximum number of processes to keep per group; 0 for totals only</param>
+	/// <param name="rollup">Output: the totals and heaviest processes</param>
+	void RollUp(UsageMetric_t metric, size_t nTop, UsageRollup_t& rollup) const;
+
+	/// <summary>
+	/// The value a process is ranked by
+	/// </summary>
+	static uint64_t Weight(const ProcessUsage_t& process, UsageMetric_t metric);
+
+private:
+	std::vector<ProcessUsage_t> m_processes;
+	// Each user's SID, from the first process seen with it
+	std::vector<const SidInfo_t*> m_users;
+	// SID -> user index
+	typedef std::unordered_map<SidInfo_t, uint32_t, SidInfo_t::Hash_t> UserIndex_t;
+	UserIndex_t m_userIndex;
+};
@@ -0,0 +1,149 @@
+// QueryPlan.cpp: field projection and the queries each field set requires.
+
+#include "QueryPlan.h"
+#include <cwctype>
+
+/// <summary>
+/// Internal: field names accepted by --fields
+/// </summary>
+struct FieldName_t
+{
+	const wchar_t* szName;
+	Field_t field;
+};
+
+static const FieldName_t st_fieldNames[] =
+{
+	{ L"current", Field_Current },
+	{ L"id", Field_SessionId },
+	{ L"name", Field_SessionName },
+	{ L"state", Field_SessionState },
+	{ L"sessionflags", Field_SessionFlags },
+	{ L"user", Field_SessionUser },
+	{ L"times", Field_SessionTimes },
+	{ L"token", Field_SessionToken },
+	{ L"processes", Field_Processes },
+	{ L"winsta", Field_WindowStation },
+	{ L"desktop", Field_Desktop },
+	{ L"objflags", Field_ObjectFlags },
+	{ L"objuser", Field_ObjectUser },
+	{ L"heap", Field_DesktopHeap },
+	{ L"input", Field_DesktopInput },
+	{ L"sd", Field_SecurityDescriptor },
+	{ L"windows", Field_Windows },
+	{ L"usage", Field_ProcessUsage },
+	{ L"top", Field_TopProcesses },
+};
+
+/// <summary>
+/// Internal: case-insensitive comparison of ASCII names
+/// </summary>
+static bool SameName(const std::wstring& sA, const wchar_t* szB)
+{
+	size_t ix = 0;
+	for (; ix < sA.size() && szB[ix]; ++ix)
+	{
+		if (std::towlower(sA[ix]) != std::towlower(szB[ix]))
+			return false;
+	}
+	return ix == sA.size() && 0 == szB[ix];
+}
+
+/// <summary>
+/// Parse a comma-separated, case-insensitive list of field names (or "all").
+/// </summary>
+bool ParseFieldList(const std::wstring& sFieldList, FieldSet_t& fields, std::wstring& sErrorInfo)
+{
+	fields = Field_None;
+	sErrorInfo.clear();
+	size_t ixStart = 0;
+	while (ixStart <= sFieldList.size())
+	{
+		size_t ixComma = sFieldList.find(L',', ixStart);
+		if (std::wstring::npos == ixComma)
+			ixComma = sFieldList.size();
+		std::wstring sName = sFieldList.substr(ixStart, ixComma - ixStart);
+		ixStart = ixComma + 1;
+		if (sName.empty())
+			continue;
+
+		if (SameName(sName, L"all"))
+		{
+			fields |= Field_All;
+			continue;
+		}
+		bool bFound = false;
+		for (size_t ix = 0; ix < sizeof(st_fieldNames) / sizeof(st_fieldNames[0]) && !bFound; ++ix)
+		{
+			if (SameName(sName, st_fieldNames[ix].szName))
+			{
+				fields |= st_fieldNames[ix].field;
+				bFound = true;
+			}
+		}
+		if (!bFound)
+		{
+			sErrorInfo = sName;
+			return false;
+		}
+	}
+	if (Field_None == fields)
+	{
+		sErrorInfo = L"(empty)";
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Comma-separated list of all field names, for usage text
+/// </summary>
+std::wstring FieldNames()
+{
+	std::wstring sNames;
+	for (size_t ix = 0; ix < sizeof(st_fieldNames) / sizeof(st_fieldNames[0]); ++ix)
+	{
+		if (ix > 0)
+			sNames += L",";
+		sNames += st_fieldNames[ix].szName;
+	}
+	return sNames;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Derive the queries needed to produce a field set.
+/// </summary>
+QueryPlan_t PlanQueries(FieldSet_t fields)
+{
+	QueryPlan_t plan;
+
+	plan.bCurrentInfo = 0 != (fields & Field_Current);
+
+	// Session ID, name, and state come with the enumeration itself.
+	plan.bSessions = 0 != (fields & Field_AnySession);
+	plan.bSessionInfoEx = 0 != (fields & (Field_SessionFlags | Field_SessionUser | Field_SessionTimes));
+	plan.bUserToken = 0 != (fields & Field_SessionToken);
+	plan.bProcesses = 0 != (fields & (Field_Processes | Field_ProcessSummaries));
+
+	// Window station and desktop names come with enumeration; everything else needs the object opened.
+	plan.bWindowStations = 0 != (fields & Field_AnyWindowStation);
+	plan.bDesktops = 0 != (fields & Field_AnyDesktop);
+	plan.bWindowStationFlags = 0 != (fields & Field_ObjectFlags);
+	plan.bWindowStationUser = 0 != (fields & Field_ObjectUser);
+	plan.bWindowStationSecurity = 0 != (fields & Field_SecurityDescriptor);
+	plan.bOpenWindowStations = plan.bDesktops || plan.bWindowStationFlags || plan.bWindowStationUser || plan.bWindowStationSecurity;
+
+	plan.bDesktopFlags = plan.bDesktops && 0 != (fields & Field_ObjectFlags);
+	plan.bDesktopUser = plan.bDesktops && 0 != (fields & Field_ObjectUser);
+	plan.bDesktopHeapSize = 0 != (fields & Field_DesktopHeap);
+	plan.bDesktopInput = 0 != (fields & Field_DesktopInput);
+	plan.bDesktopSecurity = plan.bDesktops && 0 != (fields & Field_SecurityDescriptor);
+	plan.bDesktopWindows = 0 != (fields & Field_Windows);
+	plan.bOpenDesktops =
+		plan.bDesktopFlags || plan.bDesktopUser || plan.bDesktopHeapSize ||
+		plan.bDesktopInput || plan.bDesktopSecurity || plan.bDesktopWindows;
+
+	return plan;
+}
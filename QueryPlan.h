@@ -0,0 +1,118 @@
+#pragma once
+
+// QueryPlan.h: field projection. A field set names the report fields a consumer needs; the query plan
+// derived from it says which queries the collector has to make to produce them.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// Projectable report fields (bit flags)
+/// </summary>
+enum Field_t : uint32_t
+{
+	Field_None = 0,
+
+	// "This process/thread running in" section
+	Field_Current = 0x00000001,
+
+	// Terminal sessions
+	Field_SessionId = 0x00000002,
+	Field_SessionName = 0x00000004,
+	Field_SessionState = 0x00000008,
+	Field_SessionFlags = 0x00000010,
+	Field_SessionUser = 0x00000020,
+	Field_SessionTimes = 0x00000040,
+	Field_SessionToken = 0x00000080,
+	Field_Processes = 0x00000100,
+
+	// Window stations and desktops
+	Field_WindowStation = 0x00000200,
+	Field_Desktop = 0x00000400,
+	Field_ObjectFlags = 0x00000800,
+	Field_ObjectUser = 0x00001000,
+	Field_DesktopHeap = 0x00002000,
+	Field_DesktopInput = 0x00004000,
+	Field_SecurityDescriptor = 0x00008000,
+	Field_Windows = 0x00010000,
+
+	// Process resource usage rollups, and the heaviest processes host-wide and per session
+	Field_ProcessUsage = 0x00020000,
+	Field_TopProcesses = 0x00040000,
+};
+typedef uint32_t FieldSet_t;
+
+// Fields reported when they aren't requested by an option (-p, -w, -sd, --usage, --top)
+const FieldSet_t Field_Optional = Field_Processes | Field_SecurityDescriptor | Field_Windows | Field_ProcessUsage | Field_TopProcesses;
+const FieldSet_t Field_All = 0x0007FFFF;
+const FieldSet_t Field_Default = Field_All & ~Field_Optional;
+
+const FieldSet_t Field_AnySession =
+	Field_SessionId | Field_SessionName | Field_SessionState | Field_SessionFlags | Field_SessionUser |
+	Field_SessionTimes | Field_SessionToken | Field_Processes | Field_ProcessUsage | Field_TopProcesses;
+// Session fields that are reported in sections of their own rather than with each session
+const FieldSet_t Field_ProcessSummaries = Field_ProcessUsage | Field_TopProcesses;
+const FieldSet_t Field_AnyWindowStation =
+	Field_WindowStation | Field_Desktop | Field_ObjectFlags | Field_ObjectUser | Field_DesktopHeap |
+	Field_DesktopInput | Field_SecurityDescriptor | Field_Windows;
+// Fields that require listing desktops
+const FieldSet_t Field_AnyDesktop = Field_Desktop | Field_DesktopHeap | Field_DesktopInput | Field_Windows;
+
+/// <summary>
+/// Parse a comma-separated, case-insensitive list of field names (or "all").
+/// </summary>
+/// <param name="sFieldList">Input: field list, e.g., "id,state,user"</param>
+/// <param name="fields">Output: the field set</param>
+/// <param name="sErrorInfo">Output: the unrecognized name on failure</param>
+/// <returns>true on success, false otherwise</returns>
+bool ParseFieldList(const std::wstring& sFieldList, FieldSet_t& fields, std::wstring& sErrorInfo);
+
+/// <summary>
+/// Comma-separated list of all field names, for usage text
+/// </summary>
+std::wstring FieldNames();
+
+/// <summary>
+/// The queries the collector has to make to produce a field set. Anything false is skipped.
+/// </summary>
+struct QueryPlan_t
+{
+	// The current process' session, window station, desktop, and identity
+	bool bCurrentInfo = false;
+
+	// WTSEnumerateSessions (session ID, name, and state)
+	bool bSessions = false;
+	// WTSQuerySessionInformation(WTSSessionInfoEx) per session: session flags, user, and times
+	bool bSessionInfoEx = false;
+	// WTSQueryUserToken and token queries per session
+	bool bUserToken = false;
+	// WTSEnumerateProcessesEx, once for all sessions
+	bool bProcesses = false;
+
+	// EnumWindowStations (names only)
+	bool bWindowStations = false;
+	// OpenWindowStation; needed for any window station attribute and for enumerating its desktops
+	bool bOpenWindowStations = false;
+	bool bWindowStationFlags = false;
+	bool bWindowStationUser = false;
+	bool bWindowStationSecurity = false;
+
+	// EnumDesktops (names only)
+	bool bDesktops = false;
+	// OpenDesktop; needed for any desktop attribute
+	bool bOpenDesktops = false;
+	bool bDesktopFlags = false;
+	bool bDesktopUser = false;
+	bool bDesktopHeapSize = false;
+	bool bDesktopInput = false;
+	bool bDesktopSecurity = false;
+	bool bDesktopWindows = false;
+};
+
+/// <summary>
+/// Derive the queries needed to produce a field set.
+/// Object flags, user, and security descriptor fields apply to desktops only if desktops are listed
+/// (any of Field_AnyDesktop).
+/// </summary>
+QueryPlan_t PlanQueries(FieldSet_t fields);
@@ -0,0 +1,328 @@
+// RecordingSystemSource.cpp: SystemSource decorator that records every response, with its latency, into a Capture.
+
+#include "RecordingSystemSource.h"
+
+using namespace SourceCapture;
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers: record the Flags/User/Security responses common to window stations and desktops
+
+static bool RecordFlags(RecordingSystemSource& recorder, const SourceUserObject& obj, const Key_t& key, std::wstring& sFlags, std::wstring& sErrorInfo)
+{
+	RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+	bool bResult = obj.Flags(sFlags, sErrorInfo);
+	RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).String(sFlags);
+	recorder.Record(key, start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+static bool RecordUser(RecordingSystemSource& recorder, const SourceUserObject& obj, const Key_t& key, SidInfo_t& user, std::wstring& sErrorInfo)
+{
+	RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+	bool bResult = obj.User(user, sErrorInfo);
+	RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).Sid(user);
+	recorder.Record(key, start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+static bool RecordSecurity(RecordingSystemSource& recorder, const SourceUserObject& obj, const Key_t& key, std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo)
+{
+	RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+	bool bResult = obj.Security(sd, securityInformation, sErrorInfo);
+	RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+	{
+		CaptureEncoder encoder(payload);
+		encoder.Bytes(sd);
+		encoder.U32(securityInformation);
+	}
+	recorder.Record(key, start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: records calls on a desktop opened through a RecordingSystemSource
+/// </summary>
+class RecordingDesktop : public SourceDesktop
+{
+public:
+	RecordingDesktop(RecordingSystemSource& recorder, std::unique_ptr<SourceDesktop> pDesktop, const std::wstring& sWindowStationName, const std::wstring& sDesktopName)
+		: m_recorder(recorder), m_pDesktop(std::move(pDesktop)), m_sWindowStationName(sWindowStationName), m_sDesktopName(sDesktopName)
+	{}
+	virtual ~RecordingDesktop() = default;
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return RecordFlags(m_recorder, *m_pDesktop, Key(Call_DesktopFlags), sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return RecordUser(m_recorder, *m_pDesktop, Key(Call_DesktopUser), user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return RecordSecurity(m_recorder, *m_pDesktop, Key(Call_DesktopSecurity), sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool HeapSize(uint32_t& heapSizeKb, std::wstring& sErrorInfo) const override
+	{
+		RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+		bool bResult = m_pDesktop->HeapSize(heapSizeKb, sErrorInfo);
+		RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+		std::vector<uint8_t> payload;
+		if (bResult)
+			CaptureEncoder(payload).U32(heapSizeKb);
+		m_recorder.Record(Key(Call_DesktopHeapSize), start, end, bResult, sErrorInfo, payload);
+		return bResult;
+	}
+
+	virtual bool IsReceivingInput(bool& bReceivingInput, std::wstring& sErrorInfo) const override
+	{
+		RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+		bool bResult = m_pDesktop->IsReceivingInput(bReceivingInput, sErrorInfo);
+		RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+		std::vector<uint8_t> payload;
+		if (bResult)
+			CaptureEncoder(payload).Bool(bReceivingInput);
+		m_recorder.Record(Key(Call_DesktopInput), start, end, bResult, sErrorInfo, payload);
+		return bResult;
+	}
+
+	virtual bool TopLevelWindows(WindowSnapshotList_t& windows, std::wstring& sErrorInfo) override
+	{
+		RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+		bool bResult = m_pDesktop->TopLevelWindows(windows, sErrorInfo);
+		RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+		std::vector<uint8_t> payload;
+		if (bResult)
+			CaptureEncoder(payload).Windows(windows);
+		m_recorder.Record(Key(Call_DesktopWindows), start, end, bResult, sErrorInfo, payload);
+		return bResult;
+	}
+
+private:
+	Key_t Key(Call_t call) const { return MakeKey(call, m_sWindowStationName, m_sDesktopName); }
+
+	RecordingSystemSource& m_recorder;
+	std::unique_ptr<SourceDesktop> m_pDesktop;
+	const std::wstring m_sWindowStationName, m_sDesktopName;
+};
+
+/// <summary>
+/// Internal: records calls on a window station opened through a RecordingSystemSource
+/// </summary>
+class RecordingWindowStation : public SourceWindowStation
+{
+public:
+	RecordingWindowStation(RecordingSystemSource& recorder, std::unique_ptr<SourceWindowStation> pWindowStation, const std::wstring& sWindowStationName)
+		: m_recorder(recorder), m_pWindowStation(std::move(pWindowStation)), m_sWindowStationName(sWindowStationName)
+	{}
+	virtual ~RecordingWindowStation() = default;
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return RecordFlags(m_recorder, *m_pWindowStation, MakeKey(Call_WindowStationFlags, m_sWindowStationName), sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return RecordUser(m_recorder, *m_pWindowStation, MakeKey(Call_WindowStationUser, m_sWindowStationName), user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return RecordSecurity(m_recorder, *m_pWindowStation, MakeKey(Call_WindowStationSecurity, m_sWindowStationName), sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool DesktopNames(std::vector<std::wstring>& desktopNames, std::wstring& sErrorInfo) const override
+	{
+		RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+		bool bResult = m_pWindowStation->DesktopNames(desktopNames, sErrorInfo);
+		RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+		std::vector<uint8_t> payload;
+		if (bResult)
+			CaptureEncoder(payload).StringList(desktopNames);
+		m_recorder.Record(MakeKey(Call_DesktopNames, m_sWindowStationName), start, end, bResult, sErrorInfo, payload);
+		return bResult;
+	}
+
+	virtual std::unique_ptr<SourceDesktop> OpenDesktop(const std::wstring& sDesktopName, std::wstring& sErrorInfo) const override
+	{
+		RecordingSystemSource::TimePoint_t start = RecordingSystemSource::Now();
+		std::unique_ptr<SourceDesktop> pDesktop = m_pWindowStation->OpenDesktop(sDesktopName, sErrorInfo);
+		RecordingSystemSource::TimePoint_t end = RecordingSystemSource::Now();
+		m_recorder.Record(MakeKey(Call_OpenDesktop, m_sWindowStationName, sDesktopName), start, end, nullptr != pDesktop, sErrorInfo, std::vector<uint8_t>());
+		if (!pDesktop)
+			return nullptr;
+		return std::unique_ptr<SourceDesktop>(new RecordingDesktop(m_recorder, std::move(pDesktop), m_sWindowStationName, sDesktopName));
+	}
+
+private:
+	RecordingSystemSource& m_recorder;
+	std::unique_ptr<SourceWindowStation> m_pWindowStation;
+	const std::wstring m_sWindowStationName;
+};
+
+// ------------------------------------------------------------------------------------------
+
+void RecordingSystemSource::CurrentInfo(CurrentInfoSnapshot_t& currentInfo)
+{
+	TimePoint_t start = Now();
+	m_source.CurrentInfo(currentInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	CaptureEncoder(payload).CurrentInfo(currentInfo);
+	Record(MakeKey(Call_CurrentInfo), start, end, true, std::wstring(), payload);
+}
+
+bool RecordingSystemSource::EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.EnumerateSessions(sessions, sErrorInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).Sessions(sessions);
+	Record(MakeKey(Call_EnumerateSessions), start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+bool RecordingSystemSource::QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.QuerySessionInfo(dwSessionId, session, sErrorInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).Session(session);
+	Record(MakeKey(Call_QuerySessionInfo, dwSessionId), start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+void RecordingSystemSource::QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session)
+{
+	TimePoint_t start = Now();
+	m_source.QueryUserToken(dwSessionId, session);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	CaptureEncoder(payload).TokenStatus(session);
+	Record(MakeKey(Call_QueryUserToken, dwSessionId), start, end, true, std::wstring(), payload);
+}
+
+bool RecordingSystemSource::EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.EnumerateProcesses(processes, sErrorInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).Processes(processes);
+	Record(MakeKey(Call_EnumerateAllProcesses), start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+bool RecordingSystemSource::ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.ProcessImagePath(dwPID, sImagePath, sErrorInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).String(sImagePath);
+	Record(MakeKey(Call_ProcessImagePath, dwPID), start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+bool RecordingSystemSource::LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.LookupSidName(sid, sDomainAndUsername);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).String(sDomainAndUsername);
+	Record(MakeKey(Call_LookupSidName, sid.ToString()), start, end, bResult, std::wstring(), payload);
+	return bResult;
+}
+
+bool RecordingSystemSource::LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.LookupSidNames(sids, sErrorInfo);
+	TimePoint_t end = Now();
+	// Recorded as one Call_LookupSidName per SID, so that a capture replays the same whether names were looked up
+	// one at a time or in batches. The batch's latency is divided evenly among its SIDs.
+	if (bResult && !sids.empty())
+	{
+		TimePoint_t::duration share = (end - start) / (long long)sids.size();
+		std::vector<SidInfo_t>::const_iterator sidIter;
+		for (sidIter = sids.begin(); sidIter != sids.end(); sidIter++)
+		{
+			bool bResolved = !sidIter->Name().empty();
+			std::vector<uint8_t> payload;
+			if (bResolved)
+				CaptureEncoder(payload).String(sidIter->Name());
+			Record(MakeKey(Call_LookupSidName, sidIter->ToString()), start, start + share, bResolved, std::wstring(), payload);
+		}
+	}
+	return bResult;
+}
+
+bool RecordingSystemSource::WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	bool bResult = m_source.WindowStationNames(windowStationNames, sErrorInfo);
+	TimePoint_t end = Now();
+	std::vector<uint8_t> payload;
+	if (bResult)
+		CaptureEncoder(payload).StringList(windowStationNames);
+	Record(MakeKey(Call_WindowStationNames), start, end, bResult, sErrorInfo, payload);
+	return bResult;
+}
+
+std::unique_ptr<SourceWindowStation> RecordingSystemSource::OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo)
+{
+	TimePoint_t start = Now();
+	std::unique_ptr<SourceWindowStation> pWindowStation = m_source.OpenWindowStation(sWindowStationName, sErrorInfo);
+	TimePoint_t end = Now();
+	Record(MakeKey(Call_OpenWindowStation, sWindowStationName), start, end, nullptr != pWindowStation, sErrorInfo, std::vector<uint8_t>());
+	if (!pWindowStation)
+		return nullptr;
+	return std::unique_ptr<SourceWindowStation>(new RecordingWindowStation(*this, std::move(pWindowStation), sWindowStationName));
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Write everything recorded so far to a capture file.
+/// </summary>
+bool RecordingSystemSource::Save(const std::wstring& sPath, std::wstring& sErrorInfo) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_capture.Save(sPath, sErrorInfo);
+}
+
+/// <summary>
+/// Record one response. Thread-safe.
+/// </summary>
+void RecordingSystemSource::Record(const Key_t& key, TimePoint_t start, TimePoint_t end, bool bResult, const std::wstring& sErrorInfo, const std::vector<uint8_t>& payload)
+{
+	Response_t response;
+	response.latencyNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	response.bResult = bResult;
+	response.sErrorInfo = sErrorInfo;
+	response.payload = payload;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_capture.Add(key, response);
+}
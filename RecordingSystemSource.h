@@ -0,0 +1,54 @@
+#pragma once
+
+// RecordingSystemSource.h: SystemSource decorator that records every response, with its latency, into a Capture.
+// Portable C++ (no Windows dependencies).
+
+#include <chrono>
+#include <mutex>
+#include "SystemSource.h"
+#include "SourceCapture.h"
+
+/// <summary>
+/// Passes every call through to another source and records the response for later replay (see ReplaySystemSource).
+/// </summary>
+class RecordingSystemSource : public SystemSource
+{
+public:
+	explicit RecordingSystemSource(SystemSource& source) : m_source(source) {}
+	virtual ~RecordingSystemSource() = default;
+
+	virtual void CurrentInfo(CurrentInfoSnapshot_t& currentInfo) override;
+	virtual bool EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo) override;
+	virtual bool QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo) override;
+	virtual void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) override;
+	virtual bool EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo) override;
+	virtual bool ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo) override;
+	virtual bool LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) override;
+	virtual bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) override;
+	virtual bool WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo) override;
+	virtual std::unique_ptr<SourceWindowStation> OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo) override;
+
+	/// <summary>
+	/// Write everything recorded so far to a capture file.
+	/// </summary>
+	bool Save(const std::wstring& sPath, std::wstring& sErrorInfo) const;
+
+	typedef std::chrono::steady_clock::time_point TimePoint_t;
+	static TimePoint_t Now() { return std::chrono::steady_clock::now(); }
+
+	/// <summary>
+	/// Record one response. Thread-safe.
+	/// </summary>
+	/// <param name="key">Input: the call and its arguments</param>
+	/// <param name="start">Input: when the call started</param>
+	/// <param name="end">Input: when the call returned</param>
+	/// <param name="bResult">Input: the call's result</param>
+	/// <param name="sErrorInfo">Input: error (or warning) information</param>
+	/// <param name="payload">Input: output data encoded with CaptureEncoder</param>
+	void Record(const SourceCapture::Key_t& key, TimePoint_t start, TimePoint_t end, bool bResult, const std::wstring& sErrorInfo, const std::vector<uint8_t>& payload);
+
+private:
+	SystemSource& m_source;
+	mutable std::mutex m_mutex;
+	Capture m_capture;
+};
@@ -0,0 +1,371 @@
+// ReplaySystemSource.cpp: SystemSource that serves responses recorded by RecordingSystemSource, on any platform.
+
+#include <chrono>
+#include <thread>
+#include "ReplaySystemSource.h"
+
+using namespace SourceCapture;
+
+static const wchar_t* const szCorrupt = L"Recorded response is corrupt";
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers: replay the Flags/User/Security responses common to window stations and desktops
+
+static bool ReplayFlags(const ReplaySystemSource& replay, const Key_t& key, std::wstring& sFlags, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!replay.Replay(key, pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	sFlags = decoder.String();
+	if (!decoder.Done())
+	{
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+static bool ReplayUser(const ReplaySystemSource& replay, const Key_t& key, SidInfo_t& user, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!replay.Replay(key, pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	decoder.Sid(user);
+	if (!decoder.Done())
+	{
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+static bool ReplaySecurity(const ReplaySystemSource& replay, const Key_t& key, std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!replay.Replay(key, pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	sd = decoder.Bytes();
+	securityInformation = decoder.U32();
+	if (!decoder.Done())
+	{
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: a desktop opened from a capture; its responses are looked up by window station and desktop name.
+/// </summary>
+class ReplayDesktop : public SourceDesktop
+{
+public:
+	ReplayDesktop(const ReplaySystemSource& replay, const std::wstring& sWindowStationName, const std::wstring& sDesktopName)
+		: m_replay(replay), m_sWindowStationName(sWindowStationName), m_sDesktopName(sDesktopName)
+	{}
+	virtual ~ReplayDesktop() = default;
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return ReplayFlags(m_replay, Key(Call_DesktopFlags), sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return ReplayUser(m_replay, Key(Call_DesktopUser), user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return ReplaySecurity(m_replay, Key(Call_DesktopSecurity), sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool HeapSize(uint32_t& heapSizeKb, std::wstring& sErrorInfo) const override
+	{
+		const Response_t* pResponse = nullptr;
+		if (!m_replay.Replay(Key(Call_DesktopHeapSize), pResponse, sErrorInfo))
+			return false;
+		CaptureDecoder decoder(pResponse->payload);
+		heapSizeKb = decoder.U32();
+		if (!decoder.Done())
+		{
+			sErrorInfo = szCorrupt;
+			return false;
+		}
+		return true;
+	}
+
+	virtual bool IsReceivingInput(bool& bReceivingInput, std::wstring& sErrorInfo) const override
+	{
+		const Response_t* pResponse = nullptr;
+		if (!m_replay.Replay(Key(Call_DesktopInput), pResponse, sErrorInfo))
+			return false;
+		CaptureDecoder decoder(pResponse->payload);
+		bReceivingInput = decoder.Bool();
+		if (!decoder.Done())
+		{
+			sErrorInfo = szCorrupt;
+			return false;
+		}
+		return true;
+	}
+
+	virtual bool TopLevelWindows(WindowSnapshotList_t& windows, std::wstring& sErrorInfo) override
+	{
+		const Response_t* pResponse = nullptr;
+		if (!m_replay.Replay(Key(Call_DesktopWindows), pResponse, sErrorInfo))
+			return false;
+		CaptureDecoder decoder(pResponse->payload);
+		decoder.Windows(windows);
+		if (!decoder.Done())
+		{
+			windows.clear();
+			sErrorInfo = szCorrupt;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	Key_t Key(Call_t call) const { return MakeKey(call, m_sWindowStationName, m_sDesktopName); }
+
+	const ReplaySystemSource& m_replay;
+	const std::wstring m_sWindowStationName, m_sDesktopName;
+};
+
+/// <summary>
+/// Internal: a window station opened from a capture; its responses are looked up by window station name.
+/// </summary>
+class ReplayWindowStation : public SourceWindowStation
+{
+public:
+	ReplayWindowStation(const ReplaySystemSource& replay, const std::wstring& sWindowStationName)
+		: m_replay(replay), m_sWindowStationName(sWindowStationName)
+	{}
+	virtual ~ReplayWindowStation() = default;
+
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+	{
+		return ReplayFlags(m_replay, MakeKey(Call_WindowStationFlags, m_sWindowStationName), sFlags, sErrorInfo);
+	}
+
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+	{
+		return ReplayUser(m_replay, MakeKey(Call_WindowStationUser, m_sWindowStationName), user, sErrorInfo);
+	}
+
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+	{
+		return ReplaySecurity(m_replay, MakeKey(Call_WindowStationSecurity, m_sWindowStationName), sd, securityInformation, sErrorInfo);
+	}
+
+	virtual bool DesktopNames(std::vector<std::wstring>& desktopNames, std::wstring& sErrorInfo) const override
+	{
+		const Response_t* pResponse = nullptr;
+		if (!m_replay.Replay(MakeKey(Call_DesktopNames, m_sWindowStationName), pResponse, sErrorInfo))
+			return false;
+		CaptureDecoder decoder(pResponse->payload);
+		decoder.StringList(desktopNames);
+		if (!decoder.Done())
+		{
+			desktopNames.clear();
+			sErrorInfo = szCorrupt;
+			return false;
+		}
+		return true;
+	}
+
+	virtual std::unique_ptr<SourceDesktop> OpenDesktop(const std::wstring& sDesktopName, std::wstring& sErrorInfo) const override
+	{
+		const Response_t* pResponse = nullptr;
+		if (!m_replay.Replay(MakeKey(Call_OpenDesktop, m_sWindowStationName, sDesktopName), pResponse, sErrorInfo))
+			return nullptr;
+		return std::unique_ptr<SourceDesktop>(new ReplayDesktop(m_replay, m_sWindowStationName, sDesktopName));
+	}
+
+private:
+	const ReplaySystemSource& m_replay;
+	const std::wstring m_sWindowStationName;
+};
+
+// ------------------------------------------------------------------------------------------
+
+void ReplaySystemSource::CurrentInfo(CurrentInfoSnapshot_t& currentInfo)
+{
+	currentInfo = CurrentInfoSnapshot_t();
+	const Response_t* pResponse = nullptr;
+	std::wstring sErrorInfo;
+	if (Replay(MakeKey(Call_CurrentInfo), pResponse, sErrorInfo))
+	{
+		CaptureDecoder decoder(pResponse->payload);
+		decoder.CurrentInfo(currentInfo);
+		if (decoder.Done())
+			return;
+		currentInfo = CurrentInfoSnapshot_t();
+		sErrorInfo = szCorrupt;
+	}
+	currentInfo.sessionId.SetError(sErrorInfo);
+	currentInfo.winstaName.SetError(sErrorInfo);
+	currentInfo.desktopName.SetError(sErrorInfo);
+	currentInfo.inputDesktopName.SetError(sErrorInfo);
+}
+
+bool ReplaySystemSource::EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_EnumerateSessions), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	decoder.Sessions(sessions);
+	if (!decoder.Done())
+	{
+		sessions.clear();
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+bool ReplaySystemSource::QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_QuerySessionInfo, dwSessionId), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	decoder.Session(session);
+	if (!decoder.Done())
+	{
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+void ReplaySystemSource::QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session)
+{
+	const Response_t* pResponse = nullptr;
+	std::wstring sErrorInfo;
+	if (Replay(MakeKey(Call_QueryUserToken, dwSessionId), pResponse, sErrorInfo))
+	{
+		CaptureDecoder decoder(pResponse->payload);
+		decoder.TokenStatus(session);
+		if (decoder.Done())
+			return;
+		sErrorInfo = szCorrupt;
+	}
+	session.tokenStatus = TokenStatus_t::Error;
+	session.sTokenError = sErrorInfo;
+	session.token = TokenSnapshot_t();
+	session.bHasLinkedToken = false;
+	session.linkedToken = TokenSnapshot_t();
+}
+
+bool ReplaySystemSource::EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_EnumerateAllProcesses), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	decoder.Processes(processes);
+	if (!decoder.Done())
+	{
+		processes.Clear();
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+bool ReplaySystemSource::ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_ProcessImagePath, dwPID), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	sImagePath = decoder.String();
+	if (!decoder.Done())
+	{
+		sImagePath.clear();
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+bool ReplaySystemSource::LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername)
+{
+	sDomainAndUsername.clear();
+	const Response_t* pResponse = nullptr;
+	std::wstring sErrorInfo;
+	if (!Replay(MakeKey(Call_LookupSidName, sid.ToString()), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	sDomainAndUsername = decoder.String();
+	if (!decoder.Done())
+	{
+		sDomainAndUsername.clear();
+		return false;
+	}
+	return true;
+}
+
+bool ReplaySystemSource::LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& /*sErrorInfo*/)
+{
+	// Names are recorded per SID (see RecordingSystemSource::LookupSidNames); SIDs not in the capture stay unresolved.
+	std::vector<SidInfo_t>::iterator sidIter;
+	for (sidIter = sids.begin(); sidIter != sids.end(); sidIter++)
+	{
+		std::wstring sDomainAndUsername;
+		LookupSidName(*sidIter, sDomainAndUsername);
+		sidIter->SetName(sDomainAndUsername);
+	}
+	return true;
+}
+
+bool ReplaySystemSource::WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_WindowStationNames), pResponse, sErrorInfo))
+		return false;
+	CaptureDecoder decoder(pResponse->payload);
+	decoder.StringList(windowStationNames);
+	if (!decoder.Done())
+	{
+		windowStationNames.clear();
+		sErrorInfo = szCorrupt;
+		return false;
+	}
+	return true;
+}
+
+std::unique_ptr<SourceWindowStation> ReplaySystemSource::OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo)
+{
+	const Response_t* pResponse = nullptr;
+	if (!Replay(MakeKey(Call_OpenWindowStation, sWindowStationName), pResponse, sErrorInfo))
+		return nullptr;
+	return std::unique_ptr<SourceWindowStation>(new ReplayWindowStation(*this, sWindowStationName));
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Look up a recorded response, after the simulated latency.
+/// </summary>
+bool ReplaySystemSource::Replay(const Key_t& key, const Response_t*& pResponse, std::wstring& sErrorInfo) const
+{
+	pResponse = m_capture.Find(key);
+	if (nullptr == pResponse)
+	{
+		sErrorInfo = L"Not recorded";
+		return false;
+	}
+	if (m_bSimulateLatency && pResponse->latencyNs > 0)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(pResponse->latencyNs));
+	sErrorInfo = pResponse->sErrorInfo;
+	return pResponse->bResult;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// ReplaySystemSource.h: SystemSource that serves responses recorded by RecordingSystemSource, on any platform.
+// Portable C++ (no Windows dependencies).
+
+#include "SystemSource.h"
+#include "SourceCapture.h"
+
+/// <summary>
+/// Serves recorded responses from a Capture. Calls that weren't recorded fail with "Not recorded" error information.
+/// All calls are thread-safe: the capture isn't modified after it's loaded.
+/// </summary>
+class ReplaySystemSource : public SystemSource
+{
+public:
+	ReplaySystemSource() = default;
+	virtual ~ReplaySystemSource() = default;
+
+	/// <summary>
+	/// Load the capture file to replay.
+	/// </summary>
+	bool Load(const std::wstring& sPath, std::wstring& sErrorInfo) { return m_capture.Load(sPath, sErrorInfo); }
+
+	/// <summary>
+	/// The capture to replay, e.g., to build one in memory
+	/// </summary>
+	Capture& GetCapture() { return m_capture; }
+
+	/// <summary>
+	/// If true, each call sleeps for the latency recorded with its response, so that replayed collection
+	/// takes about as long as on the recorded host. Default is false.
+	/// </summary>
+	void SimulateLatency(bool bSimulateLatency) { m_bSimulateLatency = bSimulateLatency; }
+
+	virtual void CurrentInfo(CurrentInfoSnapshot_t& currentInfo) override;
+	virtual bool EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo) override;
+	virtual bool QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo) override;
+	virtual void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) override;
+	virtual bool EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo) override;
+	virtual bool ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo) override;
+	virtual bool LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) override;
+	virtual bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) override;
+	virtual bool WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo) override;
+	virtual std::unique_ptr<SourceWindowStation> OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo) override;
+
+	/// <summary>
+	/// Look up a recorded response, after the simulated latency.
+	/// </summary>
+	/// <param name="key">Input: the call and its arguments</param>
+	/// <param name="pResponse">Output: the recorded response; nullptr if not recorded</param>
+	/// <param name="sErrorInfo">Output: recorded error or warning information, or "Not recorded"</param>
+	/// <returns>the recorded result; false if not recorded</returns>
+	bool Replay(const SourceCapture::Key_t& key, const SourceCapture::Response_t*& pResponse, std::wstring& sErrorInfo) const;
+
+private:
+	Capture m_capture;
+	bool m_bSimulateLatency = false;
+};
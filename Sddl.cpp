@@ -0,0 +1,1159 @@
+// Sddl.cpp: native SDDL parsing into the structured security descriptor model, and SDDL output from binary
+// self-relative security descriptors.
+
+#include "Sddl.h"
+#include "SddlConditional.h"
+#include "SecDescView.h"
+#include "SidCodec.h"
+
+using namespace SecDescModel;
+
+// ------------------------------------------------------------------------------------------
+// Tables
+
+// Which domain a domain-relative alias's RID is relative to
+enum class AliasDomain_t { None, Account, Primary, Root };
+
+// Most subauthorities of any alias's SID
+static const size_t MaxAliasSubAuthorities = 6;
+
+/// <summary>
+/// An SDDL SID alias. For domain-relative aliases, the one subauthority is the RID.
+/// </summary>
+struct Alias_t
+{
+	wchar_t szAlias[3];
+	// Identifier authority; all aliased authorities fit in a byte
+	uint8_t authority;
+	uint8_t subAuthorityCount;
+	uint32_t subAuthorities[MaxAliasSubAuthorities];
+	AliasDomain_t domain;
+};
+
+static const Alias_t Aliases[] = {
+	{ L"AA", 5, 2, { 32, 579 },         AliasDomain_t::None },    // Access control assistance operators
+	{ L"AC", 15, 2, { 2, 1 },           AliasDomain_t::None },    // All app packages
+	{ L"AN", 5, 1, { 7 },               AliasDomain_t::None },    // Anonymous logon
+	{ L"AO", 5, 2, { 32, 548 },         AliasDomain_t::None },    // Account operators
+	{ L"AP", 0, 1, { 525 },             AliasDomain_t::Primary }, // Protected users
+	{ L"AS", 18, 1, { 1 },              AliasDomain_t::None },    // Authentication authority asserted identity
+	{ L"AU", 5, 1, { 11 },              AliasDomain_t::None },    // Authenticated users
+	{ L"BA", 5, 2, { 32, 544 },         AliasDomain_t::None },    // Administrators
+	{ L"BG", 5, 2, { 32, 546 },         AliasDomain_t::None },    // Guests
+	{ L"BO", 5, 2, { 32, 551 },         AliasDomain_t::None },    // Backup operators
+	{ L"BU", 5, 2, { 32, 545 },         AliasDomain_t::None },    // Users
+	{ L"CA", 0, 1, { 517 },             AliasDomain_t::Primary }, // Cert publishers
+	{ L"CD", 5, 2, { 32, 574 },         AliasDomain_t::None },    // Certificate service DCOM access
+	{ L"CG", 3, 1, { 1 },               AliasDomain_t::None },    // Creator group
+	{ L"CN", 0, 1, { 522 },             AliasDomain_t::Primary }, // Cloneable domain controllers
+	{ L"CO", 3, 1, { 0 },               AliasDomain_t::None },    // Creator owner
+	{ L"CY", 5, 2, { 32, 569 },         AliasDomain_t::None },    // Cryptographic operators
+	{ L"DA", 0, 1, { 512 },             AliasDomain_t::Primary }, // Domain admins
+	{ L"DC", 0, 1, { 515 },             AliasDomain_t::Primary }, // Domain computers
+	{ L"DD", 0, 1, { 516 },             AliasDomain_t::Primary }, // Domain controllers
+	{ L"DG", 0, 1, { 514 },             AliasDomain_t::Primary }, // Domain guests
+	{ L"DU", 0, 1, { 513 },             AliasDomain_t::Primary }, // Domain users
+	{ L"EA", 0, 1, { 519 },             AliasDomain_t::Root },    // Enterprise admins
+	{ L"ED", 5, 1, { 9 },               AliasDomain_t::None },    // Enterprise domain controllers
+	{ L"EK", 0, 1, { 527 },             AliasDomain_t::Root },    // Enterprise key admins
+	{ L"ER", 5, 2, { 32, 573 },         AliasDomain_t::None },    // Event log readers
+	{ L"ES", 5, 2, { 32, 576 },         AliasDomain_t::None },    // RDS endpoint servers
+	{ L"HA", 5, 2, { 32, 578 },         AliasDomain_t::None },    // Hyper-V administrators
+	{ L"HI", 16, 1, { 12288 },          AliasDomain_t::None },    // High integrity level
+	{ L"IS", 5, 2, { 32, 568 },         AliasDomain_t::None },    // IIS_IUSRS
+	{ L"IU", 5, 1, { 4 },               AliasDomain_t::None },    // Interactive
+	{ L"KA", 0, 1, { 526 },             AliasDomain_t::Primary }, // Key admins
+	{ L"LA", 0, 1, { 500 },             AliasDomain_t::Account }, // Local administrator
+	{ L"LG", 0, 1, { 501 },             AliasDomain_t::Account }, // Local guest
+	{ L"LS", 5, 1, { 19 },              AliasDomain_t::None },    // Local service
+	{ L"LU", 5, 2, { 32, 559 },         AliasDomain_t::None },    // Performance log users
+	{ L"LW", 16, 1, { 4096 },           AliasDomain_t::None },    // Low integrity level
+	{ L"ME", 16, 1, { 8192 },           AliasDomain_t::None },    // Medium integrity level
+	{ L"MP", 16, 1, { 8448 },           AliasDomain_t::None },    // Medium plus integrity level
+	{ L"MS", 5, 2, { 32, 577 },         AliasDomain_t::None },    // RDS management servers
+	{ L"MU", 5, 2, { 32, 558 },         AliasDomain_t::None },    // Performance monitor users
+	{ L"NO", 5, 2, { 32, 556 },         AliasDomain_t::None },    // Network configuration operators
+	{ L"NS", 5, 1, { 20 },              AliasDomain_t::None },    // Network service
+	{ L"NU", 5, 1, { 2 },               AliasDomain_t::None },    // Network
+	{ L"OW", 3, 1, { 4 },               AliasDomain_t::None },    // Owner rights
+	{ L"PA", 0, 1, { 520 },             AliasDomain_t::Primary }, // Group policy creator owners
+	{ L"PO", 5, 2, { 32, 550 },         AliasDomain_t::None },    // Print operators
+	{ L"PS", 5, 1, { 10 },              AliasDomain_t::None },    // Principal self
+	{ L"PU", 5, 2, { 32, 547 },         AliasDomain_t::None },    // Power users
+	{ L"RA", 5, 2, { 32, 575 },         AliasDomain_t::None },    // RDS remote access servers
+	{ L"RC", 5, 1, { 12 },              AliasDomain_t::None },    // Restricted code
+	{ L"RD", 5, 2, { 32, 555 },         AliasDomain_t::None },    // Remote desktop users
+	{ L"RE", 5, 2, { 32, 552 },         AliasDomain_t::None },    // Replicator
+	{ L"RM", 5, 2, { 32, 580 },         AliasDomain_t::None },    // Remote management users
+	{ L"RO", 0, 1, { 498 },             AliasDomain_t::Root },    // Enterprise read-only domain controllers
+	{ L"RS", 0, 1, { 553 },             AliasDomain_t::Primary }, // RAS servers
+	{ L"RU", 5, 2, { 32, 554 },         AliasDomain_t::None },    // Pre-Windows 2000 compatible access
+	{ L"SA", 0, 1, { 518 },             AliasDomain_t::Root },    // Schema admins
+	{ L"SI", 16, 1, { 16384 },          AliasDomain_t::None },    // System integrity level
+	{ L"SO", 5, 2, { 32, 549 },         AliasDomain_t::None },    // Server operators
+	{ L"SS", 18, 1, { 2 },              AliasDomain_t::None },    // Service asserted identity
+	{ L"SU", 5, 1, { 6 },               AliasDomain_t::None },    // Service
+	{ L"SY", 5, 1, { 18 },              AliasDomain_t::None },    // Local system
+	{ L"UD", 5, 6, { 84, 0, 0, 0, 0, 0 }, AliasDomain_t::None },  // User-mode drivers
+	{ L"WD", 1, 1, { 0 },               AliasDomain_t::None },    // Everyone
+	{ L"WR", 5, 1, { 33 },              AliasDomain_t::None },    // Write restricted code
+};
+
+/// <summary>
+/// An SDDL abbreviation and its value
+/// </summary>
+struct Abbreviation_t { const wchar_t* szName; uint32_t value; };
+
+static const Abbreviation_t AceTypeNames[] = {
+	{ L"A",  AccessAllowedAceType },
+	{ L"D",  AccessDeniedAceType },
+	{ L"OA", AccessAllowedObjectAceType },
+	{ L"OD", AccessDeniedObjectAceType },
+	{ L"AU", SystemAuditAceType },
+	{ L"AL", SystemAlarmAceType },
+	{ L"OU", SystemAuditObjectAceType },
+	{ L"OL", SystemAlarmObjectAceType },
+	{ L"ML", SystemMandatoryLabelAceType },
+	{ L"XA", AccessAllowedCallbackAceType },
+	{ L"XD", AccessDeniedCallbackAceType },
+	{ L"ZA", AccessAllowedCallbackObjectAceType },
+	{ L"XU", SystemAuditCallbackAceType },
+	{ L"RA", SystemResourceAttributeAceType },
+	{ L"SP", SystemScopedPolicyIdAceType },
+	{ L"TL", SystemProcessTrustLabelAceType },
+	{ L"FL", SystemAccessFilterAceType },
+};
+
+static const Abbreviation_t AceFlagNames[] = {
+	{ L"OI", ObjectInheritAce },
+	{ L"CI", ContainerInheritAce },
+	{ L"NP", NoPropagateInheritAce },
+	{ L"IO", InheritOnlyAce },
+	{ L"ID", InheritedAce },
+	{ L"SA", SuccessfulAccessAceFlag },
+	{ L"FA", FailedAccessAceFlag },
+	{ L"TP", TrustProtectedFilterAceFlag },
+	{ L"CR", CriticalAceFlag },
+};
+
+static const Abbreviation_t RightNames[] = {
+	// Generic rights
+	{ L"GA", 0x10000000 },
+	{ L"GR", 0x80000000 },
+	{ L"GW", 0x40000000 },
+	{ L"GX", 0x20000000 },
+	// Standard rights
+	{ L"RC", 0x00020000 },
+	{ L"SD", 0x00010000 },
+	{ L"WD", 0x00040000 },
+	{ L"WO", 0x00080000 },
+	// Directory service object rights
+	{ L"RP", 0x00000010 },
+	{ L"WP", 0x00000020 },
+	{ L"CC", 0x00000001 },
+	{ L"DC", 0x00000002 },
+	{ L"LC", 0x00000004 },
+	{ L"SW", 0x00000008 },
+	{ L"LO", 0x00000080 },
+	{ L"DT", 0x00000040 },
+	{ L"CR", 0x00000100 },
+	// File rights
+	{ L"FA", 0x001F01FF },
+	{ L"FR", 0x00120089 },
+	{ L"FW", 0x00120116 },
+	{ L"FX", 0x001200A0 },
+	// Registry key rights
+	{ L"KA", 0x000F003F },
+	{ L"KR", 0x00020019 },
+	{ L"KW", 0x00020006 },
+	{ L"KX", 0x00020019 },
+	// Mandatory label rights
+	{ L"NR", 0x00000002 },
+	{ L"NW", 0x00000001 },
+	{ L"NX", 0x00000004 },
+};
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers
+
+/// <summary>
+/// Internal helper: look up an abbreviation that spans exactly the given text
+/// </summary>
+static bool LookupAbbreviation(const Abbreviation_t* pTable, size_t nEntries, const wchar_t* psz, size_t cch, uint32_t& value)
+{
+	for (size_t ix = 0; ix < nEntries; ++ix)
+	{
+		const wchar_t* szName = pTable[ix].szName;
+		size_t ixChar = 0;
+		while (ixChar < cch && 0 != szName[ixChar] && szName[ixChar] == psz[ixChar])
+			++ixChar;
+		if (ixChar == cch && 0 == szName[ixChar])
+		{
+			value = pTable[ix].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Internal helper: parse a field that's a sequence of two-letter abbreviations, ORing their values together
+/// </summary>
+static bool ParseAbbreviations(const Abbreviation_t* pTable, size_t nEntries, const wchar_t* psz, size_t cch, uint32_t& value)
+{
+	value = 0;
+	if (0 != cch % 2)
+		return false;
+	for (size_t ix = 0; ix < cch; ix += 2)
+	{
+		uint32_t abbrevValue;
+		if (!LookupAbbreviation(pTable, nEntries, psz + ix, 2, abbrevValue))
+			return false;
+		value |= abbrevValue;
+	}
+	return true;
+}
+
+static inline int HexDigit(wchar_t ch)
+{
+	if (ch >= L'0' && ch <= L'9')
+		return ch - L'0';
+	if (ch >= L'A' && ch <= L'F')
+		return ch - L'A' + 10;
+	if (ch >= L'a' && ch <= L'f')
+		return ch - L'a' + 10;
+	return -1;
+}
+
+/// <summary>
+/// Internal helper: parse a 32-bit number as wcstoul does with base 0: hexadecimal with 0x, octal with a leading 0,
+/// decimal otherwise. The number must span the whole field.
+/// </summary>
+static bool ParseNumber(const wchar_t* psz, size_t cch, uint32_t& value)
+{
+	value = 0;
+	unsigned int radix = 10;
+	size_t ix = 0;
+	if (cch > 2 && L'0' == psz[0] && (L'x' == psz[1] || L'X' == psz[1]))
+	{
+		radix = 16;
+		ix = 2;
+	}
+	else if (cch > 1 && L'0' == psz[0])
+	{
+		radix = 8;
+		ix = 1;
+	}
+	if (ix >= cch)
+		return false;
+	uint64_t value64 = 0;
+	for (; ix < cch; ++ix)
+	{
+		int digit = HexDigit(psz[ix]);
+		if (digit < 0 || (unsigned int)digit >= radix)
+			return false;
+		value64 = value64 * radix + (uint64_t)digit;
+		if (value64 > 0xFFFFFFFF)
+			return false;
+	}
+	value = (uint32_t)value64;
+	return true;
+}
+
+/// <summary>
+/// Internal helper: parse a GUID in the form SDDL writes it (bf967aba-0de6-11d0-a285-00aa003049e2) into its
+/// binary layout: Data1, Data2, and Data3 little-endian, then Data4's eight bytes in order.
+/// </summary>
+static bool ParseGuid(const wchar_t* psz, size_t cch, Guid_t& guid)
+{
+	// Byte order within the binary layout of each pair of hex digits in the string
+	static const size_t byteOrder[16] = { 3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15 };
+	if (36 != cch || L'-' != psz[8] || L'-' != psz[13] || L'-' != psz[18] || L'-' != psz[23])
+		return false;
+	size_t ixByte = 0;
+	for (size_t ix = 0; ix < cch; )
+	{
+		if (L'-' == psz[ix])
+		{
+			++ix;
+			continue;
+		}
+		int hi = HexDigit(psz[ix]), lo = HexDigit(psz[ix + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		guid.bytes[byteOrder[ixByte++]] = (uint8_t)((hi << 4) | lo);
+		ix += 2;
+	}
+	return true;
+}
+
+/// <summary>
+/// Internal helper: a single-pass parser over SDDL text, filling in a security descriptor.
+/// </summary>
+class SddlParser
+{
+public:
+	SddlParser(const wchar_t* psz, const wchar_t* pszEnd, const Sddl::Domains_t* pDomains, SecurityDescriptor_t& sd)
+		: m_pszStart(psz), m_psz(psz), m_pszEnd(pszEnd), m_pDomains(pDomains), m_sd(sd)
+	{
+	}
+
+	bool Parse();
+
+	const std::wstring& ErrorInfo() const { return m_sErrorInfo; }
+
+private:
+	bool ParseSid(const wchar_t* pszEnd, std::vector<uint8_t>& sid);
+	bool ParseAcl(bool bDacl);
+	bool ParseAce(Acl_t& acl);
+
+	/// <summary>
+	/// Whether the text at psz starts a component: O:, G:, D:, or S:
+	/// </summary>
+	bool IsComponentStart(const wchar_t* psz) const
+	{
+		return m_pszEnd - psz >= 2 && L':' == psz[1] &&
+			(L'O' == psz[0] || L'G' == psz[0] || L'D' == psz[0] || L'S' == psz[0]);
+	}
+
+	bool Match(const wchar_t* sz)
+	{
+		const wchar_t* psz = m_psz;
+		for (; *sz; ++sz, ++psz)
+		{
+			if (psz >= m_pszEnd || *psz != *sz)
+				return false;
+		}
+		m_psz = psz;
+		return true;
+	}
+
+	bool Fail(const wchar_t* szReason)
+	{
+		return Fail(m_psz, szReason);
+	}
+
+	bool Fail(const wchar_t* pszAt, const wchar_t* szReason)
+	{
+		if (m_sErrorInfo.empty())
+			m_sErrorInfo = std::wstring(L"Invalid SDDL at offset ") + std::to_wstring(pszAt - m_pszStart) + L": " + szReason;
+		return false;
+	}
+
+private:
+	const wchar_t* m_pszStart;
+	const wchar_t* m_psz;
+	const wchar_t* m_pszEnd;
+	const Sddl::Domains_t* m_pDomains;
+	SecurityDescriptor_t& m_sd;
+	std::wstring m_sErrorInfo;
+
+private:
+	// Not implemented
+	SddlParser(const SddlParser&) = delete;
+	SddlParser& operator = (const SddlParser&) = delete;
+};
+
+bool SddlParser::Parse()
+{
+	bool bOwner = false, bGroup = false, bDacl = false, bSacl = false;
+	while (m_psz < m_pszEnd)
+	{
+		if (!IsComponentStart(m_psz))
+			return Fail(L"expected O:, G:, D:, or S:");
+		wchar_t component = *m_psz;
+		bool& bSeen = (L'O' == component) ? bOwner : (L'G' == component) ? bGroup : (L'D' == component) ? bDacl : bSacl;
+		if (bSeen)
+			return Fail(L"component appears more than once");
+		bSeen = true;
+		m_psz += 2;
+
+		if (L'O' == component || L'G' == component)
+		{
+			// The SID runs to the next component.
+			const wchar_t* pszEnd = m_psz;
+			while (pszEnd < m_pszEnd && !IsComponentStart(pszEnd))
+				++pszEnd;
+			if (!ParseSid(pszEnd, (L'O' == component) ? m_sd.owner : m_sd.group))
+				return false;
+		}
+		else if (!ParseAcl(L'D' == component))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Parse the SID from the current position to pszEnd.
+/// </summary>
+bool SddlParser::ParseSid(const wchar_t* pszEnd, std::vector<uint8_t>& sid)
+{
+	uint8_t buf[SidCodec::MaxBinaryLength];
+	size_t cbSid = Sddl::ParseSid(m_psz, (size_t)(pszEnd - m_psz), m_pDomains, buf, sizeof(buf));
+	if (0 == cbSid)
+		return Fail(L"invalid SID, or domain-relative SID alias with an unknown domain");
+	sid.assign(buf, buf + cbSid);
+	m_psz = pszEnd;
+	return true;
+}
+
+/// <summary>
+/// Parse the flags and ACEs of a D: or S: component.
+/// </summary>
+bool SddlParser::ParseAcl(bool bDacl)
+{
+	Acl_t& acl = bDacl ? m_sd.dacl : m_sd.sacl;
+	m_sd.control |= bDacl ? DaclPresent : SaclPresent;
+
+	while (m_psz < m_pszEnd && L'(' != *m_psz && !IsComponentStart(m_psz))
+	{
+		if (Match(L"NO_ACCESS_CONTROL"))
+			acl.bNull = true;
+		else if (Match(L"P"))
+			m_sd.control |= bDacl ? DaclProtected : SaclProtected;
+		else if (Match(L"AI"))
+			m_sd.control |= bDacl ? DaclAutoInherited : SaclAutoInherited;
+		else if (Match(L"AR"))
+			m_sd.control |= bDacl ? DaclAutoInheritReq : SaclAutoInheritReq;
+		else
+			return Fail(L"unknown ACL flag");
+	}
+
+	while (m_psz < m_pszEnd && L'(' == *m_psz)
+	{
+		if (acl.bNull)
+			return Fail(L"ACEs in a NO_ACCESS_CONTROL ACL");
+		if (!ParseAce(acl))
+			return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Parse one ACE: (type;flags;rights;object type;inherited object type;SID[;condition or attribute])
+/// </summary>
+bool SddlParser::ParseAce(Acl_t& acl)
+{
+	const wchar_t* pszAceStart = m_psz++;
+
+	// The six fields up to the SID, which contain no parentheses
+	const size_t nFields = 6;
+	const wchar_t* pszFields[nFields];
+	size_t cchFields[nFields];
+	for (size_t ix = 0; ix < nFields; ++ix)
+	{
+		pszFields[ix] = m_psz;
+		while (m_psz < m_pszEnd && L';' != *m_psz && L')' != *m_psz && L'(' != *m_psz)
+			++m_psz;
+		cchFields[ix] = (size_t)(m_psz - pszFields[ix]);
+		if (ix + 1 < nFields && !Match(L";"))
+			return Fail(L"ACE has too few fields");
+	}
+
+	acl.aces.emplace_back();
+	Ace_t& ace = acl.aces.back();
+
+	uint32_t value;
+	if (!LookupAbbreviation(AceTypeNames, sizeof(AceTypeNames) / sizeof(AceTypeNames[0]), pszFields[0], cchFields[0], value))
+		return Fail(pszFields[0], L"unknown ACE type");
+	ace.type = (uint8_t)value;
+
+	if (!ParseAbbreviations(AceFlagNames, sizeof(AceFlagNames) / sizeof(AceFlagNames[0]), pszFields[1], cchFields[1], value))
+		return Fail(pszFields[1], L"unknown ACE flag");
+	ace.flags = (uint8_t)value;
+
+	bool bRights = (0 != cchFields[2] && pszFields[2][0] >= L'0' && pszFields[2][0] <= L'9') ?
+		ParseNumber(pszFields[2], cchFields[2], ace.mask) :
+		ParseAbbreviations(RightNames, sizeof(RightNames) / sizeof(RightNames[0]), pszFields[2], cchFields[2], ace.mask);
+	if (!bRights)
+		return Fail(pszFields[2], L"invalid access rights");
+
+	if (0 != cchFields[3] || 0 != cchFields[4])
+	{
+		if (!IsObjectAceType(ace.type))
+			return Fail(pszFields[3], L"object type in an ACE that isn't an object ACE");
+		ace.bObjectType = (0 != cchFields[3]);
+		if (ace.bObjectType && !ParseGuid(pszFields[3], cchFields[3], ace.objectType))
+			return Fail(pszFields[3], L"invalid object type GUID");
+		ace.bInheritedObjectType = (0 != cchFields[4]);
+		if (ace.bInheritedObjectType && !ParseGuid(pszFields[4], cchFields[4], ace.inheritedObjectType))
+			return Fail(pszFields[4], L"invalid inherited object type GUID");
+	}
+
+	m_psz = pszFields[5];
+	if (!ParseSid(pszFields[5] + cchFields[5], ace.sid))
+		return false;
+
+	// Conditional expression or resource attribute: runs to the ACE's closing parenthesis, skipping quoted strings.
+	const bool bResourceAttribute = (SystemResourceAttributeAceType == ace.type);
+	if (Match(L";"))
+	{
+		const wchar_t* pszExtra = m_psz;
+		size_t depth = 0;
+		for (; m_psz < m_pszEnd && (0 != depth || L')' != *m_psz); ++m_psz)
+		{
+			if (L'"' == *m_psz)
+			{
+				while (++m_psz < m_pszEnd && L'"' != *m_psz)
+					;
+				if (m_psz >= m_pszEnd)
+					break;
+			}
+			else if (L'(' == *m_psz)
+				++depth;
+			else if (L')' == *m_psz)
+				--depth;
+		}
+		if (m_psz >= m_pszEnd)
+			return Fail(pszAceStart, L"unterminated ACE");
+
+		std::wstring sErrorInfo;
+		size_t cchExtra = (size_t)(m_psz - pszExtra);
+		bool bCompiled = false;
+		if (bResourceAttribute)
+			bCompiled = SddlConditional::CompileAttribute(pszExtra, cchExtra, m_pDomains, ace.applicationData, sErrorInfo);
+		else if (IsCallbackAceType(ace.type) || SystemAccessFilterAceType == ace.type)
+			bCompiled = SddlConditional::Compile(pszExtra, cchExtra, m_pDomains, ace.applicationData, sErrorInfo);
+		else
+			return Fail(pszExtra, L"condition in an ACE type that doesn't take one");
+		if (!bCompiled)
+			return Fail(pszExtra, sErrorInfo.c_str());
+	}
+	else if (bResourceAttribute)
+	{
+		return Fail(L"resource attribute ACE without an attribute");
+	}
+
+	if (!Match(L")"))
+		return Fail(L"expected ')'");
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Parse a SID as SDDL writes it: a two-letter alias or an S-1- string.
+/// </summary>
+size_t Sddl::ParseSid(const wchar_t* pszSid, size_t cchSid, const Domains_t* pDomains, uint8_t* pSid, size_t cbBuf)
+{
+	if (nullptr == pszSid || 2 != cchSid)
+		return SidCodec::Parse(pszSid, cchSid, pSid, cbBuf);
+
+	for (size_t ixAlias = 0; ixAlias < sizeof(Aliases) / sizeof(Aliases[0]); ++ixAlias)
+	{
+		const Alias_t& alias = Aliases[ixAlias];
+		if (alias.szAlias[0] != pszSid[0] || alias.szAlias[1] != pszSid[1])
+			continue;
+
+		uint8_t sid[SidCodec::MaxBinaryLength];
+		size_t length;
+		if (AliasDomain_t::None == alias.domain)
+		{
+			sid[0] = 1;
+			sid[1] = alias.subAuthorityCount;
+			for (size_t ix = 2; ix < 7; ++ix)
+				sid[ix] = 0;
+			sid[7] = alias.authority;
+			length = 8;
+			for (size_t ix = 0; ix < alias.subAuthorityCount; ++ix)
+			{
+				for (size_t ixByte = 0; ixByte < 4; ++ixByte)
+					sid[length++] = (uint8_t)(alias.subAuthorities[ix] >> (8 * ixByte));
+			}
+		}
+		else
+		{
+			// Domain SID plus the RID
+			if (nullptr == pDomains)
+				return 0;
+			const std::vector<uint8_t>& domain =
+				(AliasDomain_t::Account == alias.domain) ? pDomains->accountDomain :
+				(AliasDomain_t::Primary == alias.domain) ? pDomains->primaryDomain :
+				pDomains->rootDomain;
+			length = SidCodec::BinaryLength(domain.data(), domain.size());
+			if (0 == length || domain[1] >= SidCodec::MaxSubAuthorities)
+				return 0;
+			for (size_t ix = 0; ix < length; ++ix)
+				sid[ix] = domain[ix];
+			sid[1]++;
+			for (size_t ixByte = 0; ixByte < 4; ++ixByte)
+				sid[length++] = (uint8_t)(alias.subAuthorities[0] >> (8 * ixByte));
+		}
+
+		if (length > cbBuf)
+			return 0;
+		for (size_t ix = 0; ix < length; ++ix)
+			pSid[ix] = sid[ix];
+		return length;
+	}
+	return 0;
+}
+
+/// <summary>
+/// Parse SDDL into a structured security descriptor.
+/// </summary>
+bool Sddl::Parse(const wchar_t* pszSddl, size_t cchSddl, const Domains_t* pDomains, SecurityDescriptor_t& sd, std::wstring& sErrorInfo)
+{
+	sd.clear();
+	sErrorInfo.clear();
+	SddlParser parser(pszSddl, pszSddl + cchSddl, pDomains, sd);
+	if (!parser.Parse())
+	{
+		sErrorInfo = parser.ErrorInfo();
+		sd.clear();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Parse SDDL into a structured security descriptor.
+/// </summary>
+bool Sddl::Parse(const std::wstring& sSddl, const Domains_t* pDomains, SecurityDescriptor_t& sd, std::wstring& sErrorInfo)
+{
+	return Parse(sSddl.c_str(), sSddl.length(), pDomains, sd, sErrorInfo);
+}
+
+// ------------------------------------------------------------------------------------------
+// SDDL output
+
+// Rights that Windows writes as one abbreviation only when they're the entire access mask. KR and KX have the
+// same value; Windows writes KR.
+static const Abbreviation_t CompositeRightNames[] = {
+	{ L"FA", 0x001F01FF },
+	{ L"FR", 0x00120089 },
+	{ L"FW", 0x00120116 },
+	{ L"FX", 0x001200A0 },
+	{ L"KA", 0x000F003F },
+	{ L"KR", 0x00020019 },
+	{ L"KW", 0x00020006 },
+};
+
+// Single-bit rights, in the order Windows writes them: ascending bit order
+static const Abbreviation_t SingleRightNames[] = {
+	{ L"CC", 0x00000001 },
+	{ L"DC", 0x00000002 },
+	{ L"LC", 0x00000004 },
+	{ L"SW", 0x00000008 },
+	{ L"RP", 0x00000010 },
+	{ L"WP", 0x00000020 },
+	{ L"DT", 0x00000040 },
+	{ L"LO", 0x00000080 },
+	{ L"CR", 0x00000100 },
+	{ L"SD", 0x00010000 },
+	{ L"RC", 0x00020000 },
+	{ L"WD", 0x00040000 },
+	{ L"WO", 0x00080000 },
+	{ L"GA", 0x10000000 },
+	{ L"GX", 0x20000000 },
+	{ L"GW", 0x40000000 },
+	{ L"GR", 0x80000000 },
+};
+
+// Mandatory label ACE rights
+static const Abbreviation_t LabelRightNames[] = {
+	{ L"NW", 0x00000001 },
+	{ L"NR", 0x00000002 },
+	{ L"NX", 0x00000004 },
+};
+
+// ACE flags, in the order Windows writes them: ascending bit order. 0x40 is SA except in access filter ACEs,
+// where it's TP.
+static const Abbreviation_t FlagNames[] = {
+	{ L"OI", ObjectInheritAce },
+	{ L"CI", ContainerInheritAce },
+	{ L"NP", NoPropagateInheritAce },
+	{ L"IO", InheritOnlyAce },
+	{ L"ID", InheritedAce },
+	{ L"CR", CriticalAceFlag },
+	{ L"SA", SuccessfulAccessAceFlag },
+	{ L"FA", FailedAccessAceFlag },
+};
+
+/// <summary>
+/// Internal helper: read little-endian values; the caller has checked the bounds.
+/// </summary>
+static inline uint16_t Read16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/// <summary>
+/// Internal helper: writes characters into a caller-supplied buffer, counting past its end so that the caller can
+/// learn the size it needs.
+/// </summary>
+class SddlWriter
+{
+public:
+	SddlWriter(wchar_t* pszBuf, size_t cchBuf)
+		: m_pszBuf(pszBuf), m_cchBuf(cchBuf), m_cch(0)
+	{
+	}
+
+	void Put(wchar_t ch)
+	{
+		if (m_cch < m_cchBuf)
+			m_pszBuf[m_cch] = ch;
+		++m_cch;
+	}
+
+	void Put(const wchar_t* psz, size_t cch)
+	{
+		for (size_t ix = 0; ix < cch; ++ix)
+			Put(psz[ix]);
+	}
+
+	void Put(const wchar_t* sz)
+	{
+		while (0 != *sz)
+			Put(*sz++);
+	}
+
+	void PutHex(uint32_t value)
+	{
+		Put(L"0x");
+		PutHexDigits(value, 1);
+	}
+
+	/// <summary>
+	/// Write a value in lowercase hex, with at least nMinDigits digits.
+	/// </summary>
+	void PutHexDigits(uint32_t value, int nMinDigits)
+	{
+		int nDigits = 1;
+		while (nDigits < 8 && 0 != (value >> (4 * nDigits)))
+			++nDigits;
+		if (nDigits < nMinDigits)
+			nDigits = nMinDigits;
+		for (int ix = nDigits - 1; ix >= 0; --ix)
+			Put(L"0123456789abcdef"[(value >> (4 * ix)) & 0xF]);
+	}
+
+	// Null-terminate if there's room
+	void Terminate()
+	{
+		if (m_cch < m_cchBuf)
+			m_pszBuf[m_cch] = 0;
+	}
+
+	size_t Length() const { return m_cch; }
+
+private:
+	wchar_t* m_pszBuf;
+	size_t m_cchBuf;
+	size_t m_cch;
+};
+
+/// <summary>
+/// Internal helper: writes SDDL for a binary self-relative security descriptor, read through a
+/// SecurityDescriptorView that has checked every offset and length against the buffer.
+/// </summary>
+class SddlFormatter
+{
+public:
+	SddlFormatter(const uint8_t* pSD, size_t cbSD, uint32_t securityInformation, const Sddl::Domains_t* pDomains, wchar_t* pszBuf, size_t cchBuf)
+		: m_view(pSD, cbSD), m_securityInformation(securityInformation), m_pDomains(pDomains), m_writer(pszBuf, cchBuf)
+	{
+	}
+
+	bool Format();
+
+	size_t Length() const { return m_writer.Length(); }
+
+	const std::wstring& ErrorInfo() const { return m_sErrorInfo; }
+
+private:
+	bool WriteSid(const wchar_t* szPrefix, const uint8_t* pSid, size_t cbSid);
+	bool WriteAcl(bool bDacl);
+	bool WriteAce(const AceView& ace);
+	void WriteAclFlags(bool bDacl);
+	void WriteRights(uint8_t aceType, uint32_t mask);
+	void WriteGuid(const uint8_t* pGuid);
+	bool IsSelected(uint8_t aceType) const;
+
+	bool Fail(const wchar_t* szReason)
+	{
+		if (m_sErrorInfo.empty())
+			m_sErrorInfo = szReason;
+		return false;
+	}
+
+private:
+	SecurityDescriptorView m_view;
+	uint32_t m_securityInformation;
+	const Sddl::Domains_t* m_pDomains;
+	SddlWriter m_writer;
+	std::wstring m_sErrorInfo;
+
+private:
+	// Not implemented
+	SddlFormatter(const SddlFormatter&) = delete;
+	SddlFormatter& operator = (const SddlFormatter&) = delete;
+};
+
+/// <summary>
+/// Write the owner, group, DACL, and SACL, in that order, for the parts that the security information selects.
+/// </summary>
+bool SddlFormatter::Format()
+{
+	if (!m_view.IsValid())
+	{
+		m_sErrorInfo = m_view.ErrorInfo();
+		return false;
+	}
+
+	if (0 != (m_securityInformation & Sddl::OwnerSecurityInformation) && !WriteSid(L"O:", m_view.Owner(), m_view.OwnerLength()))
+		return false;
+	if (0 != (m_securityInformation & Sddl::GroupSecurityInformation) && !WriteSid(L"G:", m_view.Group(), m_view.GroupLength()))
+		return false;
+	if (0 != (m_securityInformation & Sddl::DaclSecurityInformation) && !WriteAcl(true))
+		return false;
+	if (!WriteAcl(false))
+		return false;
+	m_writer.Terminate();
+	return true;
+}
+
+/// <summary>
+/// Write an owner or group SID, if there is one.
+/// </summary>
+bool SddlFormatter::WriteSid(const wchar_t* szPrefix, const uint8_t* pSid, size_t cbSid)
+{
+	if (nullptr == pSid)
+		return true;
+	wchar_t szSid[SidCodec::MaxStringLength + 1];
+	if (0 == Sddl::FormatSid(pSid, cbSid, m_pDomains, szSid, sizeof(szSid) / sizeof(szSid[0])))
+		return Fail(L"SID can't be represented in SDDL");
+	m_writer.Put(szPrefix);
+	m_writer.Put(szSid);
+	return true;
+}
+
+/// <summary>
+/// Write the P, AR, and AI flags of a DACL or SACL.
+/// </summary>
+void SddlFormatter::WriteAclFlags(bool bDacl)
+{
+	const uint16_t control = m_view.Control();
+	if (0 != (control & (bDacl ? DaclProtected : SaclProtected)))
+		m_writer.Put(L"P");
+	if (0 != (control & (bDacl ? DaclAutoInheritReq : SaclAutoInheritReq)))
+		m_writer.Put(L"AR");
+	if (0 != (control & (bDacl ? DaclAutoInherited : SaclAutoInherited)))
+		m_writer.Put(L"AI");
+}
+
+/// <summary>
+/// Whether a SACL ACE is one of the parts that the security information selects. Mandatory labels, resource
+/// attributes, scoped policy IDs, trust labels, and access filters each have their own SECURITY_INFORMATION bit;
+/// everything else needs SACL_SECURITY_INFORMATION.
+/// </summary>
+bool SddlFormatter::IsSelected(uint8_t aceType) const
+{
+	if (0 != (m_securityInformation & Sddl::SaclSecurityInformation))
+		return true;
+	switch (aceType)
+	{
+	case SystemMandatoryLabelAceType:
+		return 0 != (m_securityInformation & Sddl::LabelSecurityInformation);
+	case SystemResourceAttributeAceType:
+		return 0 != (m_securityInformation & Sddl::AttributeSecurityInformation);
+	case SystemScopedPolicyIdAceType:
+		return 0 != (m_securityInformation & Sddl::ScopeSecurityInformation);
+	case SystemProcessTrustLabelAceType:
+		return 0 != (m_securityInformation & Sddl::ProcessTrustLabelSecurityInformation);
+	case SystemAccessFilterAceType:
+		return 0 != (m_securityInformation & Sddl::AccessFilterSecurityInformation);
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Write the DACL or the selected parts of the SACL. A DACL, or a SACL when all of it is selected, is written even
+/// if it has no ACEs; when only some SACL ACE types are selected, "S:" appears only if there are ACEs to write.
+/// </summary>
+bool SddlFormatter::WriteAcl(bool bDacl)
+{
+	const bool bWholeAcl = bDacl || 0 != (m_securityInformation & Sddl::SaclSecurityInformation);
+	const wchar_t* szPrefix = bDacl ? L"D:" : L"S:";
+	const AclView& acl = bDacl ? m_view.Dacl() : m_view.Sacl();
+
+	if (!acl.IsPresent())
+	{
+		// No ACL, but Windows still writes its flags.
+		const uint16_t flags = bDacl ? (DaclProtected | DaclAutoInheritReq | DaclAutoInherited) : (SaclProtected | SaclAutoInheritReq | SaclAutoInherited);
+		if (bWholeAcl && 0 != (m_view.Control() & flags))
+		{
+			m_writer.Put(szPrefix);
+			WriteAclFlags(bDacl);
+		}
+		return true;
+	}
+
+	if (acl.IsNull())
+	{
+		if (bWholeAcl)
+		{
+			m_writer.Put(szPrefix);
+			WriteAclFlags(bDacl);
+			m_writer.Put(L"NO_ACCESS_CONTROL");
+		}
+		return true;
+	}
+
+	bool bPrefixWritten = false;
+	if (bWholeAcl)
+	{
+		m_writer.Put(szPrefix);
+		WriteAclFlags(bDacl);
+		bPrefixWritten = true;
+	}
+
+	for (AclView::const_iterator aceIter = acl.begin(); aceIter != acl.end(); ++aceIter)
+	{
+		if (bDacl || IsSelected(aceIter->Type()))
+		{
+			if (!bPrefixWritten)
+			{
+				m_writer.Put(szPrefix);
+				bPrefixWritten = true;
+			}
+			if (!WriteAce(*aceIter))
+				return Fail(L"ACE can't be represented in SDDL");
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Write an access mask: a composite abbreviation if the mask is exactly one, otherwise single-bit abbreviations
+/// if they cover all the bits, otherwise hex.
+/// </summary>
+void SddlFormatter::WriteRights(uint8_t aceType, uint32_t mask)
+{
+	const Abbreviation_t* pSingles = SingleRightNames;
+	size_t nSingles = sizeof(SingleRightNames) / sizeof(SingleRightNames[0]);
+	if (SystemMandatoryLabelAceType == aceType)
+	{
+		pSingles = LabelRightNames;
+		nSingles = sizeof(LabelRightNames) / sizeof(LabelRightNames[0]);
+	}
+	else
+	{
+		for (size_t ix = 0; ix < sizeof(CompositeRightNames) / sizeof(CompositeRightNames[0]); ++ix)
+		{
+			if (CompositeRightNames[ix].value == mask)
+			{
+				m_writer.Put(CompositeRightNames[ix].szName);
+				return;
+			}
+		}
+	}
+
+	uint32_t covered = 0;
+	for (size_t ix = 0; ix < nSingles; ++ix)
+		covered |= pSingles[ix].value;
+	if (0 != (mask & ~covered))
+	{
+		m_writer.PutHex(mask);
+		return;
+	}
+	for (size_t ix = 0; ix < nSingles; ++ix)
+	{
+		if (0 != (mask & pSingles[ix].value))
+			m_writer.Put(pSingles[ix].szName);
+	}
+}
+
+/// <summary>
+/// Write a GUID in lowercase registry format without braces.
+/// </summary>
+void SddlFormatter::WriteGuid(const uint8_t* pGuid)
+{
+	m_writer.PutHexDigits(Read32(pGuid), 8);
+	m_writer.Put(L'-');
+	m_writer.PutHexDigits(Read16(pGuid + 4), 4);
+	m_writer.Put(L'-');
+	m_writer.PutHexDigits(Read16(pGuid + 6), 4);
+	m_writer.Put(L'-');
+	for (size_t ix = 8; ix < 16; ++ix)
+	{
+		if (10 == ix)
+			m_writer.Put(L'-');
+		m_writer.PutHexDigits(pGuid[ix], 2);
+	}
+}
+
+/// <summary>
+/// Write one ACE: (type;flags;rights;object type;inherited object type;SID[;condition or attribute])
+/// </summary>
+bool SddlFormatter::WriteAce(const AceView& ace)
+{
+	const uint8_t aceType = ace.Type();
+	const uint8_t aceFlags = ace.Flags();
+
+	const wchar_t* szType = nullptr;
+	for (size_t ix = 0; ix < sizeof(AceTypeNames) / sizeof(AceTypeNames[0]); ++ix)
+	{
+		if (AceTypeNames[ix].value == aceType)
+			szType = AceTypeNames[ix].szName;
+	}
+	if (nullptr == szType || nullptr == ace.Sid())
+		return false;
+
+	wchar_t szSid[SidCodec::MaxStringLength + 1];
+	size_t cchSid = Sddl::FormatSid(ace.Sid(), ace.SidLength(), m_pDomains, szSid, sizeof(szSid) / sizeof(szSid[0]));
+	if (0 == cchSid)
+		return false;
+
+	m_writer.Put(L'(');
+	m_writer.Put(szType);
+	m_writer.Put(L';');
+	for (size_t ix = 0; ix < sizeof(FlagNames) / sizeof(FlagNames[0]); ++ix)
+	{
+		if (0 != (aceFlags & FlagNames[ix].value))
+			m_writer.Put((SystemAccessFilterAceType == aceType && TrustProtectedFilterAceFlag == FlagNames[ix].value) ? L"TP" : FlagNames[ix].szName);
+	}
+	m_writer.Put(L';');
+	WriteRights(aceType, ace.Mask());
+	m_writer.Put(L';');
+	if (nullptr != ace.ObjectType())
+		WriteGuid(ace.ObjectType());
+	m_writer.Put(L';');
+	if (nullptr != ace.InheritedObjectType())
+		WriteGuid(ace.InheritedObjectType());
+	m_writer.Put(L';');
+	m_writer.Put(szSid, cchSid);
+
+	// Conditional expression or resource attribute in the application data
+	const bool bCondition = IsCallbackAceType(aceType) || SystemAccessFilterAceType == aceType;
+	const bool bAttribute = SystemResourceAttributeAceType == aceType;
+	if ((bCondition && 0 != ace.ApplicationDataLength()) || bAttribute)
+	{
+		std::wstring sExtra, sErrorInfo;
+		bool ret = bAttribute ?
+			SddlConditional::DecompileAttribute(ace.ApplicationData(), ace.ApplicationDataLength(), m_pDomains, sExtra, sErrorInfo) :
+			SddlConditional::Decompile(ace.ApplicationData(), ace.ApplicationDataLength(), m_pDomains, sExtra, sErrorInfo);
+		if (!ret)
+			return Fail(sErrorInfo.c_str());
+		m_writer.Put(L';');
+		m_writer.Put(sExtra.c_str(), sExtra.length());
+	}
+	m_writer.Put(L')');
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Format a binary SID as SDDL writes it: its alias if it has one, otherwise its S-1- string.
+/// </summary>
+size_t Sddl::FormatSid(const uint8_t* pSid, size_t cbSid, const Domains_t* pDomains, wchar_t* pszBuf, size_t cchBuf)
+{
+	const size_t length = SidCodec::BinaryLength(pSid, cbSid);
+	if (0 == length)
+		return 0;
+
+	const uint8_t subAuthorityCount = pSid[1];
+	const uint32_t rid = Read32(pSid + length - 4);
+	bool bNullAuthorityHigh = (0 == pSid[2] && 0 == pSid[3] && 0 == pSid[4] && 0 == pSid[5] && 0 == pSid[6]);
+	for (size_t ixAlias = 0; ixAlias < sizeof(Aliases) / sizeof(Aliases[0]); ++ixAlias)
+	{
+		const Alias_t& alias = Aliases[ixAlias];
+		bool bMatch;
+		if (AliasDomain_t::None == alias.domain)
+		{
+			bMatch = bNullAuthorityHigh && alias.authority == pSid[7] && alias.subAuthorityCount == subAuthorityCount;
+			for (size_t ix = 0; bMatch && ix < subAuthorityCount; ++ix)
+				bMatch = (alias.subAuthorities[ix] == Read32(pSid + 8 + 4 * ix));
+		}
+		else
+		{
+			// Domain SID plus the RID
+			if (alias.subAuthorities[0] != rid)
+				continue;
+			const std::vector<uint8_t>* pDomain = nullptr;
+			if (nullptr != pDomains)
+			{
+				pDomain =
+					(AliasDomain_t::Account == alias.domain) ? &pDomains->accountDomain :
+					(AliasDomain_t::Primary == alias.domain) ? &pDomains->primaryDomain :
+					&pDomains->rootDomain;
+			}
+			if (nullptr == pDomain || pDomain->empty())
+			{
+				// An S-1-5-21-x-y-z-RID SID might be this alias in a domain that isn't known, so the output might
+				// not match what Windows writes.
+				if (bNullAuthorityHigh && 5 == pSid[7] && 5 == subAuthorityCount && 21 == Read32(pSid + 8))
+					return 0;
+				continue;
+			}
+			const std::vector<uint8_t>& domain = *pDomain;
+			bMatch = (domain.size() + 4 == length && domain.size() >= 8 && domain[1] + 1 == subAuthorityCount && domain[0] == pSid[0]);
+			for (size_t ix = 2; bMatch && ix < domain.size(); ++ix)
+				bMatch = (domain[ix] == pSid[ix]);
+		}
+		if (bMatch)
+		{
+			if (cchBuf < 3)
+				return 0;
+			pszBuf[0] = alias.szAlias[0];
+			pszBuf[1] = alias.szAlias[1];
+			pszBuf[2] = 0;
+			return 2;
+		}
+	}
+	return SidCodec::Format(pSid, length, pszBuf, cchBuf);
+}
+
+/// <summary>
+/// Write SDDL for a binary self-relative security descriptor into a caller-supplied buffer.
+/// </summary>
+bool Sddl::Format(const uint8_t* pSD, size_t cbSD, uint32_t securityInformation, const Domains_t* pDomains, wchar_t* pszBuf, size_t cchBuf, size_t& cchSddl, std::wstring& sErrorInfo)
+{
+	cchSddl = 0;
+	sErrorInfo.clear();
+	if (nullptr == pszBuf)
+		cchBuf = 0;
+	SddlFormatter formatter(pSD, (nullptr == pSD) ? 0 : cbSD, securityInformation, pDomains, pszBuf, cchBuf);
+	if (!formatter.Format())
+	{
+		sErrorInfo = formatter.ErrorInfo();
+		if (cchBuf > 0)
+			pszBuf[0] = 0;
+		return false;
+	}
+	cchSddl = formatter.Length();
+	return true;
+}
+
+/// <summary>
+/// Write SDDL for a binary self-relative security descriptor.
+/// </summary>
+bool Sddl::Format(const uint8_t* pSD, size_t cbSD, uint32_t securityInformation, const Domains_t* pDomains, std::wstring& sSddl, std::wstring& sErrorInfo)
+{
+	// Most security descriptors fit on the stack; otherwise try again with the exact size.
+	wchar_t szBuf[512];
+	size_t cchSddl;
+	sSddl.clear();
+	if (!Format(pSD, cbSD, securityInformation, pDomains, szBuf, sizeof(szBuf) / sizeof(szBuf[0]), cchSddl, sErrorInfo))
+		return false;
+	if (cchSddl < sizeof(szBuf) / sizeof(szBuf[0]))
+	{
+		sSddl.assign(szBuf, cchSddl);
+		return true;
+	}
+	std::vector<wchar_t> buf(cchSddl + 1);
+	if (!Format(pSD, cbSD, securityInformation, pDomains, buf.data(), buf.size(), cchSddl, sErrorInfo))
+		return false;
+	sSddl.assign(buf.data(), cchSddl);
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+// Sddl.h: native SDDL support for the structured security descriptor model (SecDescModel.h). Parse reads SDDL
+// without ConvertStringSecurityDescriptorToSecurityDescriptor; Format writes it from binary self-relative security
+// descriptors without ConvertSecurityDescriptorToStringSecurityDescriptor.
+// Parse accepts SDDL revision 1 as Windows writes it: O:, G:, D:, and S: components, every ACE type that has an
+// SDDL abbreviation (including object, callback, mandatory label, resource attribute, scoped policy, trust label,
+// and access filter ACEs), conditional expressions, and the SID aliases (BA, SY, WD, ...). Strings Windows might
+// accept but doesn't write, such as lowercase abbreviations, are rejected; callers that must accept anything
+// Windows does can fall back to the Win32 function on failure.
+// Format writes what Windows writes: SID aliases, right abbreviations (GA, FA, KR, ...), and flag order.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "SecDescModel.h"
+
+namespace Sddl
+{
+	/// <summary>
+	/// The domain SIDs that domain-relative SID aliases are relative to. Parse rejects aliases whose domain isn't
+	/// known, and Format fails for SIDs that might be them.
+	/// </summary>
+	struct Domains_t
+	{
+		// Local account domain (the machine SID): LA, LG
+		std::vector<uint8_t> accountDomain;
+		// Primary domain: DA, DU, DG, DC, DD, CA, CN, RS, PA, AP, KA
+		std::vector<uint8_t> primaryDomain;
+		// Forest root domain: EA, SA, RO, EK
+		std::vector<uint8_t> rootDomain;
+	};
+
+	/// <summary>
+	/// Parse a SID as SDDL writes it: a two-letter alias or an S-1- string.
+	/// </summary>
+	/// <param name="pszSid">Input: the SID text; not necessarily null-terminated</param>
+	/// <param name="cchSid">Input: length of the SID text in characters</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases; can be nullptr</param>
+	/// <param name="pSid">Output: the binary SID; a buffer of SidCodec::MaxBinaryLength bytes is always enough</param>
+	/// <param name="cbBuf">Input: size of the pSid buffer in bytes</param>
+	/// <returns>Length of the binary SID in bytes; 0 if the text isn't a valid SID or the buffer is too small</returns>
+	size_t ParseSid(const wchar_t* pszSid, size_t cchSid, const Domains_t* pDomains, uint8_t* pSid, size_t cbBuf);
+
+	// SECURITY_INFORMATION bits that select the parts of a security descriptor that Format writes
+	const uint32_t OwnerSecurityInformation = 0x00000001;
+	const uint32_t GroupSecurityInformation = 0x00000002;
+	const uint32_t DaclSecurityInformation = 0x00000004;
+	const uint32_t SaclSecurityInformation = 0x00000008;
+	const uint32_t LabelSecurityInformation = 0x00000010;
+	const uint32_t AttributeSecurityInformation = 0x00000020;
+	const uint32_t ScopeSecurityInformation = 0x00000040;
+	const uint32_t ProcessTrustLabelSecurityInformation = 0x00000080;
+	const uint32_t AccessFilterSecurityInformation = 0x00000100;
+
+	/// <summary>
+	/// Format a binary SID as SDDL writes it: its alias if it has one, otherwise its S-1- string.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: number of bytes available at pSid</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases; can be nullptr</param>
+	/// <param name="pszBuf">Output: the SID text, null-terminated; a buffer of SidCodec::MaxStringLength + 1 characters is always enough</param>
+	/// <param name="cchBuf">Input: size of pszBuf in characters</param>
+	/// <returns>Number of characters written, not counting the null; 0 if the SID is invalid, the buffer is too small,
+	/// or the SID might be a domain-relative alias for a domain that pDomains doesn't give</returns>
+	size_t FormatSid(const uint8_t* pSid, size_t cbSid, const Domains_t* pDomains, wchar_t* pszBuf, size_t cchBuf);
+
+	/// <summary>
+	/// Write SDDL for a binary self-relative security descriptor into a caller-supplied buffer.
+	/// </summary>
+	/// <param name="pSD">Input: the self-relative security descriptor</param>
+	/// <param name="cbSD">Input: number of bytes available at pSD</param>
+	/// <param name="securityInformation">Input: SECURITY_INFORMATION bits selecting the parts to write</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases; can be nullptr</param>
+	/// <param name="pszBuf">Output: the SDDL, null-terminated, if the buffer is big enough; can be nullptr if cchBuf is 0</param>
+	/// <param name="cchBuf">Input: size of pszBuf in characters</param>
+	/// <param name="cchSddl">Output: length of the SDDL, not counting the null. If it isn't less than cchBuf, the
+	/// buffer was too small and its contents aren't usable.</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success; false if the security descriptor is invalid or can't be represented in SDDL</returns>
+	bool Format(const uint8_t* pSD, size_t cbSD, uint32_t securityInformation, const Domains_t* pDomains, wchar_t* pszBuf, size_t cchBuf, size_t& cchSddl, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Write SDDL for a binary self-relative security descriptor.
+	/// </summary>
+	bool Format(const uint8_t* pSD, size_t cbSD, uint32_t securityInformation, const Domains_t* pDomains, std::wstring& sSddl, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Parse SDDL into a structured security descriptor.
+	/// </summary>
+	/// <param name="pszSddl">Input: the SDDL; not necessarily null-terminated</param>
+	/// <param name="cchSddl">Input: length of the SDDL in characters</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases; can be nullptr</param>
+	/// <param name="sd">Output: the security descriptor</param>
+	/// <param name="sErrorInfo">Output: error information on failure, including the offset of the error</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Parse(const wchar_t* pszSddl, size_t cchSddl, const Domains_t* pDomains, SecDescModel::SecurityDescriptor_t& sd, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Parse SDDL into a structured security descriptor.
+	/// </summary>
+	bool Parse(const std::wstring& sSddl, const Domains_t* pDomains, SecDescModel::SecurityDescriptor_t& sd, std::wstring& sErrorInfo);
+}
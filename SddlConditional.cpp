@@ -0,0 +1,1289 @@
+// SddlConditional.cpp: conversion of conditional expressions and resource attributes from SDDL to binary form.
+
+#include "SddlConditional.h"
+#include <cstring>
+#include <cwchar>
+#include "SidCodec.h"
+
+using namespace SddlConditional;
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers
+
+/// <summary>
+/// Internal helper: append a little-endian 32-bit value
+/// </summary>
+static void Append32(std::vector<uint8_t>& data, uint32_t value)
+{
+	for (size_t ix = 0; ix < 4; ++ix)
+		data.push_back((uint8_t)(value >> (8 * ix)));
+}
+
+/// <summary>
+/// Internal helper: append a little-endian 64-bit value
+/// </summary>
+static void Append64(std::vector<uint8_t>& data, uint64_t value)
+{
+	for (size_t ix = 0; ix < 8; ++ix)
+		data.push_back((uint8_t)(value >> (8 * ix)));
+}
+
+/// <summary>
+/// Internal helper: overwrite a little-endian 32-bit value
+/// </summary>
+static void Put32(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+{
+	for (size_t ix = 0; ix < 4; ++ix)
+		data[offset + ix] = (uint8_t)(value >> (8 * ix));
+}
+
+/// <summary>
+/// Internal helper: append UTF-16LE characters
+/// </summary>
+static void AppendUtf16(std::vector<uint8_t>& data, const std::wstring& str)
+{
+	for (std::wstring::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+	{
+		data.push_back((uint8_t)*iter);
+		data.push_back((uint8_t)(*iter >> 8));
+	}
+}
+
+/// <summary>
+/// Internal helper: zero-pad to a multiple of 4 bytes
+/// </summary>
+static void PadTo4(std::vector<uint8_t>& data)
+{
+	while (0 != data.size() % 4)
+		data.push_back(TokenPadding);
+}
+
+static inline bool IsSpace(wchar_t ch)
+{
+	return L' ' == ch || L'\t' == ch || L'\r' == ch || L'\n' == ch;
+}
+
+static inline bool IsAlnum(wchar_t ch)
+{
+	return (ch >= L'A' && ch <= L'Z') || (ch >= L'a' && ch <= L'z') || (ch >= L'0' && ch <= L'9');
+}
+
+static inline int HexDigit(wchar_t ch)
+{
+	if (ch >= L'0' && ch <= L'9')
+		return ch - L'0';
+	if (ch >= L'A' && ch <= L'F')
+		return ch - L'A' + 10;
+	if (ch >= L'a' && ch <= L'f')
+		return ch - L'a' + 10;
+	return -1;
+}
+
+static inline wchar_t ToUpper(wchar_t ch)
+{
+	return (ch >= L'a' && ch <= L'z') ? (wchar_t)(ch - L'a' + L'A') : ch;
+}
+
+/// <summary>
+/// Internal helper: a recursive-descent parser over an expression's text, appending the binary tokens in postfix
+/// order as it goes.
+/// </summary>
+class ExpressionParser
+{
+public:
+	ExpressionParser(const wchar_t* psz, const wchar_t* pszEnd, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& data)
+		: m_pszStart(psz), m_psz(psz), m_pszEnd(pszEnd), m_pDomains(pDomains), m_data(data)
+	{
+	}
+
+	/// <summary>
+	/// Parse the whole expression, which must be enclosed in parentheses.
+	/// </summary>
+	bool ParseExpression()
+	{
+		SkipSpace();
+		if (!Peek(L'('))
+			return Fail(L"expected '('");
+		if (!ParseTerm())
+			return false;
+		SkipSpace();
+		if (m_psz != m_pszEnd)
+			return Fail(L"unexpected text after the expression");
+		return true;
+	}
+
+	/// <summary>
+	/// Parse a resource attribute: "(name,type,flags,values...)"
+	/// </summary>
+	bool ParseAttribute();
+
+	const std::wstring& ErrorInfo() const { return m_sErrorInfo; }
+
+private:
+	// Grammar, lowest precedence first: || and && are left-associative; ! and the parenthesized, relational,
+	// membership, and existence terms bind tightest.
+	bool ParseOr();
+	bool ParseAnd();
+	bool ParseTerm();
+	bool ParseRelational();
+	bool ParseAttributeName(bool bLocalAllowed);
+	bool ParseValueOrComposite(bool bSidsOnly);
+	bool ParseValue(bool bSidsOnly);
+	bool ParseInteger();
+	bool ParseString(std::wstring& str);
+	bool ParseOctetString(std::vector<uint8_t>& bytes);
+	bool ParseSidLiteral(uint8_t* pSid, size_t& cbSid);
+
+	void SkipSpace()
+	{
+		while (m_psz < m_pszEnd && IsSpace(*m_psz))
+			++m_psz;
+	}
+
+	bool Peek(wchar_t ch) const
+	{
+		return m_psz < m_pszEnd && ch == *m_psz;
+	}
+
+	/// <summary>
+	/// Consume a punctuation string if it comes next.
+	/// </summary>
+	bool Match(const wchar_t* sz)
+	{
+		const wchar_t* psz = m_psz;
+		for (; *sz; ++sz, ++psz)
+		{
+			if (psz >= m_pszEnd || *psz != *sz)
+				return false;
+		}
+		m_psz = psz;
+		return true;
+	}
+
+	/// <summary>
+	/// Consume a keyword, case-insensitive, if it comes next and isn't the start of a longer name.
+	/// </summary>
+	bool MatchKeyword(const wchar_t* sz)
+	{
+		const wchar_t* psz = m_psz;
+		for (; *sz; ++sz, ++psz)
+		{
+			if (psz >= m_pszEnd || ToUpper(*psz) != ToUpper(*sz))
+				return false;
+		}
+		if (psz < m_pszEnd && (IsAlnum(*psz) || L'_' == *psz))
+			return false;
+		m_psz = psz;
+		return true;
+	}
+
+	bool Fail(const wchar_t* szReason)
+	{
+		if (m_sErrorInfo.empty())
+			m_sErrorInfo = std::wstring(L"Invalid expression at offset ") + std::to_wstring(m_psz - m_pszStart) + L": " + szReason;
+		return false;
+	}
+
+	/// <summary>
+	/// Append a length-prefixed token.
+	/// </summary>
+	void AppendToken(uint8_t token, const uint8_t* pBytes, size_t nBytes)
+	{
+		m_data.push_back(token);
+		Append32(m_data, (uint32_t)nBytes);
+		m_data.insert(m_data.end(), pBytes, pBytes + nBytes);
+	}
+
+	void AppendStringToken(uint8_t token, const std::wstring& str)
+	{
+		m_data.push_back(token);
+		Append32(m_data, (uint32_t)(str.length() * sizeof(uint16_t)));
+		AppendUtf16(m_data, str);
+	}
+
+private:
+	const wchar_t* m_pszStart;
+	const wchar_t* m_psz;
+	const wchar_t* m_pszEnd;
+	const Sddl::Domains_t* m_pDomains;
+	std::vector<uint8_t>& m_data;
+	std::wstring m_sErrorInfo;
+
+private:
+	// Not implemented
+	ExpressionParser(const ExpressionParser&) = delete;
+	ExpressionParser& operator = (const ExpressionParser&) = delete;
+};
+
+// Operators that take an attribute on the left and an attribute or value on the right
+struct BinaryOperator_t { const wchar_t* szName; bool bKeyword; uint8_t token; };
+static const BinaryOperator_t BinaryOperators[] = {
+	// Longer punctuation first, so that "<=" isn't taken for "<"
+	{ L"==", false, TokenEqual },
+	{ L"!=", false, TokenNotEqual },
+	{ L"<=", false, TokenLessOrEqual },
+	{ L">=", false, TokenGreaterOrEqual },
+	{ L"<", false, TokenLess },
+	{ L">", false, TokenGreater },
+	{ L"Contains", true, TokenContains },
+	{ L"Any_of", true, TokenAnyOf },
+	{ L"Not_Contains", true, TokenNotContains },
+	{ L"Not_Any_of", true, TokenNotAnyOf },
+};
+
+// Operators that take a SID or a composite of SIDs
+struct UnaryOperator_t { const wchar_t* szName; uint8_t token; };
+static const UnaryOperator_t MembershipOperators[] = {
+	// Longer names first, so that "Member_of_Any" isn't taken for "Member_of"
+	{ L"Member_of_Any", TokenMemberOfAny },
+	{ L"Member_of", TokenMemberOf },
+	{ L"Device_Member_of_Any", TokenDeviceMemberOfAny },
+	{ L"Device_Member_of", TokenDeviceMemberOf },
+	{ L"Not_Member_of_Any", TokenNotMemberOfAny },
+	{ L"Not_Member_of", TokenNotMemberOf },
+	{ L"Not_Device_Member_of_Any", TokenNotDeviceMemberOfAny },
+	{ L"Not_Device_Member_of", TokenNotDeviceMemberOf },
+};
+
+bool ExpressionParser::ParseOr()
+{
+	if (!ParseAnd())
+		return false;
+	for (;;)
+	{
+		SkipSpace();
+		if (!Match(L"||"))
+			return true;
+		if (!ParseAnd())
+			return false;
+		m_data.push_back(TokenOr);
+	}
+}
+
+bool ExpressionParser::ParseAnd()
+{
+	if (!ParseTerm())
+		return false;
+	for (;;)
+	{
+		SkipSpace();
+		if (!Match(L"&&"))
+			return true;
+		if (!ParseTerm())
+			return false;
+		m_data.push_back(TokenAnd);
+	}
+}
+
+bool ExpressionParser::ParseTerm()
+{
+	SkipSpace();
+	if (m_psz >= m_pszEnd)
+		return Fail(L"unexpected end of expression");
+
+	if (Match(L"("))
+	{
+		if (!ParseOr())
+			return false;
+		SkipSpace();
+		if (!Match(L")"))
+			return Fail(L"expected ')'");
+		return true;
+	}
+
+	// "!=" can't start a term, so '!' here is logical NOT.
+	if (Match(L"!"))
+	{
+		if (!ParseTerm())
+			return false;
+		m_data.push_back(TokenNot);
+		return true;
+	}
+
+	for (size_t ix = 0; ix < sizeof(MembershipOperators) / sizeof(MembershipOperators[0]); ++ix)
+	{
+		if (MatchKeyword(MembershipOperators[ix].szName))
+		{
+			SkipSpace();
+			if (!ParseValueOrComposite(true))
+				return false;
+			m_data.push_back(MembershipOperators[ix].token);
+			return true;
+		}
+	}
+
+	uint8_t existsToken = TokenPadding;
+	if (MatchKeyword(L"Not_Exists"))
+		existsToken = TokenNotExists;
+	else if (MatchKeyword(L"Exists"))
+		existsToken = TokenExists;
+	if (TokenPadding != existsToken)
+	{
+		SkipSpace();
+		if (!ParseAttributeName(true))
+			return false;
+		m_data.push_back(existsToken);
+		return true;
+	}
+
+	return ParseRelational();
+}
+
+bool ExpressionParser::ParseRelational()
+{
+	if (!ParseAttributeName(true))
+		return false;
+	SkipSpace();
+	for (size_t ix = 0; ix < sizeof(BinaryOperators) / sizeof(BinaryOperators[0]); ++ix)
+	{
+		const BinaryOperator_t& op = BinaryOperators[ix];
+		if (op.bKeyword ? MatchKeyword(op.szName) : Match(op.szName))
+		{
+			SkipSpace();
+			if (Peek(L'@'))
+			{
+				if (!ParseAttributeName(false))
+					return false;
+			}
+			else if (!ParseValueOrComposite(false))
+			{
+				return false;
+			}
+			m_data.push_back(op.token);
+			return true;
+		}
+	}
+	// An attribute on its own: true if it's present and nonzero
+	return true;
+}
+
+/// <summary>
+/// Parse an attribute name: @User., @Device., or @Resource. and a name, or a local attribute's bare name.
+/// </summary>
+bool ExpressionParser::ParseAttributeName(bool bLocalAllowed)
+{
+	struct Prefix_t { const wchar_t* szPrefix; uint8_t token; };
+	static const Prefix_t prefixes[] = {
+		{ L"@User.", TokenUserAttribute },
+		{ L"@Device.", TokenDeviceAttribute },
+		{ L"@Resource.", TokenResourceAttribute },
+	};
+
+	uint8_t token = TokenLocalAttribute;
+	if (Peek(L'@'))
+	{
+		bool bFound = false;
+		for (size_t ix = 0; ix < sizeof(prefixes) / sizeof(prefixes[0]) && !bFound; ++ix)
+		{
+			const wchar_t* psz = m_psz;
+			const wchar_t* szPrefix = prefixes[ix].szPrefix;
+			for (; *szPrefix && psz < m_pszEnd && ToUpper(*psz) == ToUpper(*szPrefix); ++szPrefix, ++psz)
+				;
+			if (0 == *szPrefix)
+			{
+				m_psz = psz;
+				token = prefixes[ix].token;
+				bFound = true;
+			}
+		}
+		if (!bFound)
+			return Fail(L"unknown attribute prefix");
+	}
+	else if (!bLocalAllowed)
+	{
+		return Fail(L"expected an attribute");
+	}
+
+	// Name characters; prefixed names can also have %XXXX escapes and more punctuation.
+	std::wstring sName;
+	for (; m_psz < m_pszEnd; ++m_psz)
+	{
+		wchar_t ch = *m_psz;
+		if (IsAlnum(ch) || L':' == ch || L'.' == ch || L'/' == ch || L'_' == ch)
+		{
+			sName += ch;
+		}
+		else if (TokenLocalAttribute != token && L'%' == ch)
+		{
+			if (m_pszEnd - m_psz < 5)
+				return Fail(L"incomplete escape in attribute name");
+			unsigned int value = 0;
+			for (size_t ix = 1; ix <= 4; ++ix)
+			{
+				int digit = HexDigit(m_psz[ix]);
+				if (digit < 0)
+					return Fail(L"invalid escape in attribute name");
+				value = (value << 4) | (unsigned int)digit;
+			}
+			sName += (wchar_t)value;
+			m_psz += 4;
+		}
+		else if (TokenLocalAttribute != token && 0 != ch && nullptr != wcschr(L"$'*+-?[\\]^`~", ch))
+		{
+			sName += ch;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (sName.empty())
+		return Fail(L"expected an attribute name");
+	AppendStringToken(token, sName);
+	return true;
+}
+
+/// <summary>
+/// Parse a value, or a composite of values in braces.
+/// </summary>
+bool ExpressionParser::ParseValueOrComposite(bool bSidsOnly)
+{
+	if (!Match(L"{"))
+		return ParseValue(bSidsOnly);
+
+	// Composite: token and length, then the values' tokens; the length is filled in at the end.
+	m_data.push_back(TokenComposite);
+	size_t lengthOffset = m_data.size();
+	Append32(m_data, 0);
+	size_t contentStart = m_data.size();
+	SkipSpace();
+	if (!Match(L"}"))
+	{
+		for (;;)
+		{
+			SkipSpace();
+			if (!ParseValue(bSidsOnly))
+				return false;
+			SkipSpace();
+			if (Match(L"}"))
+				break;
+			if (!Match(L","))
+				return Fail(L"expected ',' or '}'");
+		}
+	}
+	Put32(m_data, lengthOffset, (uint32_t)(m_data.size() - contentStart));
+	return true;
+}
+
+/// <summary>
+/// Parse a literal: integer, string, octet string, or SID.
+/// </summary>
+bool ExpressionParser::ParseValue(bool bSidsOnly)
+{
+	if (m_psz >= m_pszEnd)
+		return Fail(L"expected a value");
+
+	if (MatchKeyword(L"SID"))
+	{
+		uint8_t sid[SidCodec::MaxBinaryLength];
+		size_t cbSid = 0;
+		if (!ParseSidLiteral(sid, cbSid))
+			return false;
+		AppendToken(TokenSid, sid, cbSid);
+		return true;
+	}
+	if (bSidsOnly)
+		return Fail(L"expected SID()");
+
+	if (Peek(L'"'))
+	{
+		std::wstring str;
+		if (!ParseString(str))
+			return false;
+		AppendStringToken(TokenUnicodeString, str);
+		return true;
+	}
+	if (Peek(L'#'))
+	{
+		std::vector<uint8_t> bytes;
+		if (!ParseOctetString(bytes))
+			return false;
+		AppendToken(TokenOctetString, bytes.data(), bytes.size());
+		return true;
+	}
+	return ParseInteger();
+}
+
+/// <summary>
+/// Parse a signed integer in decimal, octal (leading 0), or hexadecimal (0x), keeping its sign and base.
+/// </summary>
+bool ExpressionParser::ParseInteger()
+{
+	uint8_t sign = SignNone;
+	if (Match(L"+"))
+		sign = SignPlus;
+	else if (Match(L"-"))
+		sign = SignMinus;
+
+	uint8_t base = BaseDecimal;
+	unsigned int radix = 10;
+	if (m_pszEnd - m_psz >= 3 && L'0' == m_psz[0] && (L'x' == m_psz[1] || L'X' == m_psz[1]) && HexDigit(m_psz[2]) >= 0)
+	{
+		base = BaseHexadecimal;
+		radix = 16;
+		m_psz += 2;
+	}
+	else if (Peek(L'0'))
+	{
+		base = BaseOctal;
+		radix = 8;
+	}
+
+	const wchar_t* pszDigits = m_psz;
+	uint64_t value = 0;
+	for (; m_psz < m_pszEnd; ++m_psz)
+	{
+		int digit = HexDigit(*m_psz);
+		if (digit < 0 || (unsigned int)digit >= radix)
+			break;
+		// Magnitude of a signed 64-bit value: up to 2^63 if negative, 2^63 - 1 otherwise
+		uint64_t maxValue = (SignMinus == sign) ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL;
+		if (value > (maxValue - (uint64_t)digit) / radix)
+			return Fail(L"integer out of range");
+		value = value * radix + (uint64_t)digit;
+	}
+	if (m_psz == pszDigits)
+		return Fail(L"expected a value");
+	if (m_psz < m_pszEnd && (IsAlnum(*m_psz) || L'_' == *m_psz))
+		return Fail(L"invalid integer");
+
+	m_data.push_back(TokenInt64);
+	Append64(m_data, (SignMinus == sign) ? (uint64_t)0 - value : value);
+	m_data.push_back(sign);
+	m_data.push_back(base);
+	return true;
+}
+
+/// <summary>
+/// Parse a double-quoted string; SDDL strings have no escapes.
+/// </summary>
+bool ExpressionParser::ParseString(std::wstring& str)
+{
+	if (!Match(L"\""))
+		return Fail(L"expected '\"'");
+	const wchar_t* pszStart = m_psz;
+	while (m_psz < m_pszEnd && L'"' != *m_psz)
+		++m_psz;
+	if (m_psz >= m_pszEnd)
+		return Fail(L"unterminated string");
+	str.assign(pszStart, m_psz);
+	++m_psz;
+	return true;
+}
+
+/// <summary>
+/// Parse an octet string: '#' and pairs of hex digits
+/// </summary>
+bool ExpressionParser::ParseOctetString(std::vector<uint8_t>& bytes)
+{
+	if (!Match(L"#"))
+		return Fail(L"expected '#'");
+	for (; m_psz < m_pszEnd && HexDigit(*m_psz) >= 0; m_psz += 2)
+	{
+		if (m_pszEnd - m_psz < 2 || HexDigit(m_psz[1]) < 0)
+			return Fail(L"odd number of hex digits");
+		bytes.push_back((uint8_t)((HexDigit(m_psz[0]) << 4) | HexDigit(m_psz[1])));
+	}
+	return true;
+}
+
+/// <summary>
+/// Parse the parenthesized part of a SID(...) literal, after "SID".
+/// </summary>
+bool ExpressionParser::ParseSidLiteral(uint8_t* pSid, size_t& cbSid)
+{
+	SkipSpace();
+	if (!Match(L"("))
+		return Fail(L"expected '(' after SID");
+	SkipSpace();
+	const wchar_t* pszSid = m_psz;
+	while (m_psz < m_pszEnd && L')' != *m_psz && !IsSpace(*m_psz))
+		++m_psz;
+	cbSid = Sddl::ParseSid(pszSid, (size_t)(m_psz - pszSid), m_pDomains, pSid, SidCodec::MaxBinaryLength);
+	if (0 == cbSid)
+	{
+		m_psz = pszSid;
+		return Fail(L"invalid SID");
+	}
+	SkipSpace();
+	if (!Match(L")"))
+		return Fail(L"expected ')' after SID");
+	return true;
+}
+
+/// <summary>
+/// Parse a resource attribute: "(name,type,flags,values...)"
+/// </summary>
+bool ExpressionParser::ParseAttribute()
+{
+	struct Type_t { const wchar_t* szName; uint16_t valueType; };
+	static const Type_t types[] = {
+		{ L"TI", AttributeInt64 },
+		{ L"TU", AttributeUInt64 },
+		{ L"TS", AttributeString },
+		{ L"TD", AttributeSid },
+		{ L"TX", AttributeOctetString },
+		{ L"TB", AttributeBoolean },
+	};
+
+	SkipSpace();
+	if (!Match(L"("))
+		return Fail(L"expected '('");
+	SkipSpace();
+	std::wstring sName;
+	if (!ParseString(sName))
+		return false;
+	SkipSpace();
+	if (!Match(L","))
+		return Fail(L"expected ','");
+	SkipSpace();
+	uint16_t valueType = 0;
+	for (size_t ix = 0; ix < sizeof(types) / sizeof(types[0]) && 0 == valueType; ++ix)
+	{
+		if (Match(types[ix].szName))
+			valueType = types[ix].valueType;
+	}
+	if (0 == valueType)
+		return Fail(L"unknown attribute type");
+	SkipSpace();
+	if (!Match(L","))
+		return Fail(L"expected ','");
+	SkipSpace();
+
+	// Flags, and each value, are parsed as integer tokens into a scratch buffer and read back from there.
+	std::vector<uint8_t>& data = m_data;
+	size_t scratchStart = data.size();
+	if (!ParseInteger())
+		return false;
+	uint32_t flags = 0;
+	for (size_t ix = 0; ix < 4; ++ix)
+		flags |= (uint32_t)data[scratchStart + 1 + ix] << (8 * ix);
+	data.resize(scratchStart);
+
+	// Values: 8-byte integers; null-terminated strings; SIDs and octet strings as a length and bytes
+	std::vector<std::vector<uint8_t>> values;
+	for (;;)
+	{
+		SkipSpace();
+		if (Match(L")"))
+			break;
+		if (!Match(L","))
+			return Fail(L"expected ',' or ')'");
+		SkipSpace();
+
+		std::vector<uint8_t> value;
+		switch (valueType)
+		{
+		case AttributeInt64:
+		case AttributeUInt64:
+		case AttributeBoolean:
+			if (!ParseInteger())
+				return false;
+			value.assign(data.begin() + scratchStart + 1, data.begin() + scratchStart + 9);
+			data.resize(scratchStart);
+			break;
+		case AttributeString:
+		{
+			std::wstring str;
+			if (!ParseString(str))
+				return false;
+			AppendUtf16(value, str);
+			value.push_back(0);
+			value.push_back(0);
+			break;
+		}
+		case AttributeSid:
+		{
+			uint8_t sid[SidCodec::MaxBinaryLength];
+			size_t cbSid = 0;
+			if (!MatchKeyword(L"SID"))
+				return Fail(L"expected SID()");
+			if (!ParseSidLiteral(sid, cbSid))
+				return false;
+			Append32(value, (uint32_t)cbSid);
+			value.insert(value.end(), sid, sid + cbSid);
+			break;
+		}
+		default:
+		{
+			std::vector<uint8_t> bytes;
+			if (!ParseOctetString(bytes))
+				return false;
+			Append32(value, (uint32_t)bytes.size());
+			value.insert(value.end(), bytes.begin(), bytes.end());
+			break;
+		}
+		}
+		values.push_back(value);
+	}
+	SkipSpace();
+	if (m_psz != m_pszEnd)
+		return Fail(L"unexpected text after the attribute");
+
+	// CLAIM_SECURITY_ATTRIBUTE_RELATIVE_V1: name offset, value type, reserved, flags, value count, value offsets;
+	// then the name and the values, each 4-byte aligned. Offsets are from the start of the structure.
+	size_t start = data.size();
+	Append32(data, 0);
+	data.push_back((uint8_t)valueType);
+	data.push_back((uint8_t)(valueType >> 8));
+	data.push_back(0);
+	data.push_back(0);
+	Append32(data, flags);
+	Append32(data, (uint32_t)values.size());
+	size_t offsetsStart = data.size();
+	for (size_t ix = 0; ix < values.size(); ++ix)
+		Append32(data, 0);
+
+	Put32(data, start, (uint32_t)(data.size() - start));
+	AppendUtf16(data, sName);
+	data.push_back(0);
+	data.push_back(0);
+	PadTo4(data);
+	for (size_t ix = 0; ix < values.size(); ++ix)
+	{
+		Put32(data, offsetsStart + 4 * ix, (uint32_t)(data.size() - start));
+		data.insert(data.end(), values[ix].begin(), values[ix].end());
+		PadTo4(data);
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Compile a conditional expression, including its outer parentheses, to its binary form.
+/// </summary>
+bool SddlConditional::Compile(const wchar_t* pszExpr, size_t cchExpr, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& data, std::wstring& sErrorInfo)
+{
+	data.assign(Signature, Signature + sizeof(Signature));
+	ExpressionParser parser(pszExpr, pszExpr + cchExpr, pDomains, data);
+	if (!parser.ParseExpression())
+	{
+		sErrorInfo = parser.ErrorInfo();
+		data.clear();
+		return false;
+	}
+	PadTo4(data);
+	return true;
+}
+
+/// <summary>
+/// Compile a resource attribute, including its outer parentheses, to its binary form.
+/// </summary>
+bool SddlConditional::CompileAttribute(const wchar_t* pszAttr, size_t cchAttr, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& data, std::wstring& sErrorInfo)
+{
+	data.clear();
+	ExpressionParser parser(pszAttr, pszAttr + cchAttr, pDomains, data);
+	if (!parser.ParseAttribute())
+	{
+		sErrorInfo = parser.ErrorInfo();
+		data.clear();
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+// Binary to SDDL
+
+/// <summary>
+/// Internal helper: read little-endian values
+/// </summary>
+static uint32_t Read32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t Read64(const uint8_t* p)
+{
+	return (uint64_t)Read32(p) | ((uint64_t)Read32(p + 4) << 32);
+}
+
+/// <summary>
+/// Internal helper: append UTF-16LE bytes to a string
+/// </summary>
+static void AppendFromUtf16(std::wstring& str, const uint8_t* p, size_t cb)
+{
+	for (size_t ix = 0; ix + 1 < cb; ix += 2)
+		str += (wchar_t)(p[ix] | (p[ix + 1] << 8));
+}
+
+/// <summary>
+/// Internal helper: append a value in the given radix, lowercase
+/// </summary>
+static void AppendUnsigned(std::wstring& str, uint64_t value, unsigned int radix)
+{
+	wchar_t digits[64];
+	size_t nDigits = 0;
+	do
+	{
+		digits[nDigits++] = L"0123456789abcdef"[value % radix];
+		value /= radix;
+	} while (0 != value);
+	while (nDigits > 0)
+		str += digits[--nDigits];
+}
+
+/// <summary>
+/// Internal helper: append bytes as pairs of lowercase hex digits
+/// </summary>
+static void AppendHexBytes(std::wstring& str, const uint8_t* p, size_t cb)
+{
+	for (size_t ix = 0; ix < cb; ++ix)
+	{
+		str += L"0123456789abcdef"[p[ix] >> 4];
+		str += L"0123456789abcdef"[p[ix] & 0xF];
+	}
+}
+
+/// <summary>
+/// Internal helper: append a SID as SID(alias) or SID(S-1-...)
+/// </summary>
+static bool AppendSid(std::wstring& str, const uint8_t* pSid, size_t cbSid, const Sddl::Domains_t* pDomains)
+{
+	wchar_t szSid[SidCodec::MaxStringLength + 1];
+	if (SidCodec::BinaryLength(pSid, cbSid) != cbSid || 0 == Sddl::FormatSid(pSid, cbSid, pDomains, szSid, sizeof(szSid) / sizeof(szSid[0])))
+		return false;
+	str += L"SID(";
+	str += szSid;
+	str += L")";
+	return true;
+}
+
+/// <summary>
+/// Internal helper: converts binary tokens back to SDDL. Operands go on a stack as text; each operator pops its
+/// operands and pushes its own text, in parentheses.
+/// </summary>
+class ExpressionWriter
+{
+public:
+	ExpressionWriter(const uint8_t* pData, size_t cbData, const Sddl::Domains_t* pDomains)
+		: m_pStart(pData), m_p(pData), m_pEnd(pData + cbData), m_pDomains(pDomains)
+	{
+	}
+
+	bool WriteExpression(std::wstring& sExpr);
+
+	bool WriteAttribute(std::wstring& sAttr);
+
+	const std::wstring& ErrorInfo() const { return m_sErrorInfo; }
+
+private:
+	struct Operand_t
+	{
+		std::wstring sText;
+		// Whether the text is an operation already in parentheses
+		bool bParenthesized;
+	};
+
+	bool WriteLiteral(uint8_t token, std::wstring& str);
+	bool WriteAttributeName(uint8_t token, std::wstring& str);
+	bool ReadLength(size_t& cb);
+
+	bool Fail(const wchar_t* szReason)
+	{
+		if (m_sErrorInfo.empty())
+			m_sErrorInfo = std::wstring(L"Invalid binary expression at offset ") + std::to_wstring(m_p - m_pStart) + L": " + szReason;
+		return false;
+	}
+
+private:
+	const uint8_t* m_pStart;
+	const uint8_t* m_p;
+	const uint8_t* m_pEnd;
+	const Sddl::Domains_t* m_pDomains;
+	std::wstring m_sErrorInfo;
+
+private:
+	// Not implemented
+	ExpressionWriter(const ExpressionWriter&) = delete;
+	ExpressionWriter& operator = (const ExpressionWriter&) = delete;
+};
+
+/// <summary>
+/// Read the 32-bit length that follows a token, and check that that many bytes follow.
+/// </summary>
+bool ExpressionWriter::ReadLength(size_t& cb)
+{
+	if (m_pEnd - m_p < 4)
+		return Fail(L"truncated token");
+	cb = Read32(m_p);
+	m_p += 4;
+	if ((size_t)(m_pEnd - m_p) < cb)
+		return Fail(L"token extends past the end of the data");
+	return true;
+}
+
+/// <summary>
+/// Write an attribute name with its prefix. Characters that can't appear literally are written as %XXXX escapes.
+/// </summary>
+bool ExpressionWriter::WriteAttributeName(uint8_t token, std::wstring& str)
+{
+	size_t cb;
+	if (!ReadLength(cb))
+		return false;
+	if (0 != cb % 2)
+		return Fail(L"odd-length attribute name");
+	switch (token)
+	{
+	case TokenUserAttribute:
+		str += L"@USER.";
+		break;
+	case TokenDeviceAttribute:
+		str += L"@DEVICE.";
+		break;
+	case TokenResourceAttribute:
+		str += L"@RESOURCE.";
+		break;
+	default:
+		break;
+	}
+	std::wstring sName;
+	AppendFromUtf16(sName, m_p, cb);
+	m_p += cb;
+	for (std::wstring::const_iterator iter = sName.begin(); iter != sName.end(); ++iter)
+	{
+		wchar_t ch = *iter;
+		if (IsAlnum(ch) || L':' == ch || L'.' == ch || L'/' == ch || L'_' == ch || TokenLocalAttribute == token)
+		{
+			str += ch;
+		}
+		else
+		{
+			const wchar_t* szHex = L"0123456789ABCDEF";
+			str += L'%';
+			for (int shift = 12; shift >= 0; shift -= 4)
+				str += szHex[(ch >> shift) & 0xF];
+		}
+	}
+	return true;
+}
+
+/// <summary>
+/// Write a literal: integer, string, octet string, SID, or composite.
+/// </summary>
+bool ExpressionWriter::WriteLiteral(uint8_t token, std::wstring& str)
+{
+	size_t cb;
+	switch (token)
+	{
+	case TokenInt8:
+	case TokenInt16:
+	case TokenInt32:
+	case TokenInt64:
+	{
+		// Always a 64-bit value, then sign and base
+		if (m_pEnd - m_p < 10)
+			return Fail(L"truncated integer");
+		int64_t value = (int64_t)Read64(m_p);
+		uint8_t sign = m_p[8], base = m_p[9];
+		m_p += 10;
+		uint64_t magnitude = (value < 0) ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+		if (value < 0)
+			str += L'-';
+		else if (SignPlus == sign)
+			str += L'+';
+		switch (base)
+		{
+		case BaseOctal:
+			str += L'0';
+			if (0 != magnitude)
+				AppendUnsigned(str, magnitude, 8);
+			break;
+		case BaseHexadecimal:
+			str += L"0x";
+			AppendUnsigned(str, magnitude, 16);
+			break;
+		default:
+			AppendUnsigned(str, magnitude, 10);
+			break;
+		}
+		return true;
+	}
+
+	case TokenUnicodeString:
+		if (!ReadLength(cb))
+			return false;
+		str += L'"';
+		AppendFromUtf16(str, m_p, cb);
+		str += L'"';
+		m_p += cb;
+		return true;
+
+	case TokenOctetString:
+		if (!ReadLength(cb))
+			return false;
+		str += L'#';
+		AppendHexBytes(str, m_p, cb);
+		m_p += cb;
+		return true;
+
+	case TokenSid:
+		if (!ReadLength(cb))
+			return false;
+		if (!AppendSid(str, m_p, cb, m_pDomains))
+			return Fail(L"invalid SID");
+		m_p += cb;
+		return true;
+
+	case TokenComposite:
+	{
+		if (!ReadLength(cb))
+			return false;
+		const uint8_t* pCompositeEnd = m_p + cb;
+		str += L'{';
+		bool bFirst = true;
+		while (m_p < pCompositeEnd)
+		{
+			if (!bFirst)
+				str += L", ";
+			bFirst = false;
+			uint8_t itemToken = *m_p++;
+			// Items can't extend past the composite.
+			const uint8_t* pEnd = m_pEnd;
+			m_pEnd = pCompositeEnd;
+			bool bItem = WriteLiteral(itemToken, str);
+			m_pEnd = pEnd;
+			if (!bItem)
+				return false;
+		}
+		str += L'}';
+		return true;
+	}
+
+	default:
+		--m_p;
+		return Fail(L"unknown token");
+	}
+}
+
+bool ExpressionWriter::WriteExpression(std::wstring& sExpr)
+{
+	sExpr.clear();
+	if (m_pEnd - m_p < (ptrdiff_t)sizeof(Signature) || 0 != memcmp(m_p, Signature, sizeof(Signature)))
+		return Fail(L"missing signature");
+	m_p += sizeof(Signature);
+
+	std::vector<Operand_t> stack;
+	while (m_p < m_pEnd)
+	{
+		uint8_t token = *m_p++;
+		if (TokenPadding == token)
+		{
+			// Padding runs to the end.
+			for (; m_p < m_pEnd; ++m_p)
+			{
+				if (TokenPadding != *m_p)
+					return Fail(L"data after padding");
+			}
+			break;
+		}
+
+		const wchar_t* szBinary = nullptr;
+		const wchar_t* szUnary = nullptr;
+		switch (token)
+		{
+		case TokenEqual:               szBinary = L" == "; break;
+		case TokenNotEqual:            szBinary = L" != "; break;
+		case TokenLess:                szBinary = L" < "; break;
+		case TokenLessOrEqual:         szBinary = L" <= "; break;
+		case TokenGreater:             szBinary = L" > "; break;
+		case TokenGreaterOrEqual:      szBinary = L" >= "; break;
+		case TokenContains:            szBinary = L" Contains "; break;
+		case TokenAnyOf:               szBinary = L" Any_of "; break;
+		case TokenNotContains:         szBinary = L" Not_Contains "; break;
+		case TokenNotAnyOf:            szBinary = L" Not_Any_of "; break;
+		case TokenAnd:                 szBinary = L" && "; break;
+		case TokenOr:                  szBinary = L" || "; break;
+		case TokenExists:              szUnary = L"Exists "; break;
+		case TokenNotExists:           szUnary = L"Not_Exists "; break;
+		case TokenMemberOf:            szUnary = L"Member_of "; break;
+		case TokenDeviceMemberOf:      szUnary = L"Device_Member_of "; break;
+		case TokenMemberOfAny:         szUnary = L"Member_of_Any "; break;
+		case TokenDeviceMemberOfAny:   szUnary = L"Device_Member_of_Any "; break;
+		case TokenNotMemberOf:         szUnary = L"Not_Member_of "; break;
+		case TokenNotDeviceMemberOf:   szUnary = L"Not_Device_Member_of "; break;
+		case TokenNotMemberOfAny:      szUnary = L"Not_Member_of_Any "; break;
+		case TokenNotDeviceMemberOfAny: szUnary = L"Not_Device_Member_of_Any "; break;
+		case TokenNot:                 szUnary = L"!"; break;
+		default: break;
+		}
+
+		if (nullptr != szBinary)
+		{
+			if (stack.size() < 2)
+				return Fail(L"operator without its operands");
+			Operand_t& left = stack[stack.size() - 2];
+			left.sText = L"(" + left.sText + szBinary + stack.back().sText + L")";
+			left.bParenthesized = true;
+			stack.pop_back();
+		}
+		else if (nullptr != szUnary)
+		{
+			if (stack.empty())
+				return Fail(L"operator without its operand");
+			Operand_t& operand = stack.back();
+			operand.sText = std::wstring(L"(") + szUnary + operand.sText + L")";
+			operand.bParenthesized = true;
+		}
+		else
+		{
+			Operand_t operand;
+			operand.bParenthesized = false;
+			bool bOperand = (token >= TokenLocalAttribute && token <= TokenDeviceAttribute) ?
+				WriteAttributeName(token, operand.sText) :
+				WriteLiteral(token, operand.sText);
+			if (!bOperand)
+				return false;
+			stack.push_back(operand);
+		}
+	}
+
+	if (1 != stack.size())
+		return Fail(L"expression doesn't reduce to one value");
+	sExpr = stack.back().bParenthesized ? stack.back().sText : L"(" + stack.back().sText + L")";
+	return true;
+}
+
+bool ExpressionWriter::WriteAttribute(std::wstring& sAttr)
+{
+	struct Type_t { uint16_t valueType; const wchar_t* szName; };
+	static const Type_t types[] = {
+		{ AttributeInt64, L"TI" },
+		{ AttributeUInt64, L"TU" },
+		{ AttributeString, L"TS" },
+		{ AttributeSid, L"TD" },
+		{ AttributeOctetString, L"TX" },
+		{ AttributeBoolean, L"TB" },
+	};
+
+	sAttr.clear();
+	const size_t cbData = (size_t)(m_pEnd - m_pStart);
+	const size_t headerSize = 16;
+	if (cbData < headerSize)
+		return Fail(L"truncated attribute");
+	uint32_t nameOffset = Read32(m_pStart);
+	uint16_t valueType = (uint16_t)(m_pStart[4] | (m_pStart[5] << 8));
+	uint32_t flags = Read32(m_pStart + 8);
+	uint32_t valueCount = Read32(m_pStart + 12);
+	if (valueCount > (cbData - headerSize) / 4)
+		return Fail(L"too many values");
+
+	const wchar_t* szType = nullptr;
+	for (size_t ix = 0; ix < sizeof(types) / sizeof(types[0]); ++ix)
+	{
+		if (types[ix].valueType == valueType)
+			szType = types[ix].szName;
+	}
+	if (nullptr == szType)
+		return Fail(L"unknown attribute type");
+
+	// Null-terminated strings at offsets from the start
+	struct Local
+	{
+		static bool ReadString(const uint8_t* pStart, size_t cbData, size_t offset, std::wstring& str)
+		{
+			for (size_t ix = offset; ix + 1 < cbData; ix += 2)
+			{
+				wchar_t ch = (wchar_t)(pStart[ix] | (pStart[ix + 1] << 8));
+				if (0 == ch)
+					return true;
+				str += ch;
+			}
+			return false;
+		}
+	};
+
+	sAttr = L"(\"";
+	if (!Local::ReadString(m_pStart, cbData, nameOffset, sAttr))
+		return Fail(L"invalid attribute name");
+	sAttr += L"\",";
+	sAttr += szType;
+	sAttr += L",0x";
+	AppendUnsigned(sAttr, flags, 16);
+
+	for (uint32_t ixValue = 0; ixValue < valueCount; ++ixValue)
+	{
+		size_t offset = Read32(m_pStart + headerSize + 4 * ixValue);
+		sAttr += L',';
+		switch (valueType)
+		{
+		case AttributeInt64:
+		case AttributeUInt64:
+		case AttributeBoolean:
+		{
+			if (offset > cbData || cbData - offset < 8)
+				return Fail(L"value out of range");
+			uint64_t value = Read64(m_pStart + offset);
+			if (AttributeInt64 == valueType && (int64_t)value < 0)
+			{
+				sAttr += L'-';
+				value = (uint64_t)0 - value;
+			}
+			AppendUnsigned(sAttr, value, 10);
+			break;
+		}
+		case AttributeString:
+			sAttr += L'"';
+			if (!Local::ReadString(m_pStart, cbData, offset, sAttr))
+				return Fail(L"invalid string value");
+			sAttr += L'"';
+			break;
+		default:
+		{
+			// SIDs and octet strings: a length, then the bytes
+			if (offset > cbData || cbData - offset < 4)
+				return Fail(L"value out of range");
+			size_t cb = Read32(m_pStart + offset);
+			if (cb > cbData - offset - 4)
+				return Fail(L"value out of range");
+			const uint8_t* pValue = m_pStart + offset + 4;
+			if (AttributeSid == valueType)
+			{
+				if (!AppendSid(sAttr, pValue, cb, m_pDomains))
+					return Fail(L"invalid SID value");
+			}
+			else
+			{
+				sAttr += L'#';
+				AppendHexBytes(sAttr, pValue, cb);
+			}
+			break;
+		}
+		}
+	}
+	sAttr += L')';
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Convert a binary conditional expression to SDDL.
+/// </summary>
+bool SddlConditional::Decompile(const uint8_t* pData, size_t cbData, const Sddl::Domains_t* pDomains, std::wstring& sExpr, std::wstring& sErrorInfo)
+{
+	ExpressionWriter writer(pData, cbData, pDomains);
+	if (!writer.WriteExpression(sExpr))
+	{
+		sErrorInfo = writer.ErrorInfo();
+		sExpr.clear();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Convert a binary resource attribute to SDDL.
+/// </summary>
+bool SddlConditional::DecompileAttribute(const uint8_t* pData, size_t cbData, const Sddl::Domains_t* pDomains, std::wstring& sAttr, std::wstring& sErrorInfo)
+{
+	ExpressionWriter writer(pData, cbData, pDomains);
+	if (!writer.WriteAttribute(sAttr))
+	{
+		sErrorInfo = writer.ErrorInfo();
+		sAttr.clear();
+		return false;
+	}
+	return true;
+}
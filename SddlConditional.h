@@ -0,0 +1,119 @@
+#pragma once
+
+// SddlConditional.h: the conditional expressions of callback ACEs ("(@User.Title == \"PM\")") and the attributes of
+// resource attribute ACEs, converted between SDDL and the binary forms stored in the ACEs' application data
+// ([MS-DTYP] 2.4.4.17 and 2.4.10.1).
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Sddl.h"
+
+namespace SddlConditional
+{
+	// Binary conditional expressions start with "artx", followed by tokens in postfix order, zero-padded to a
+	// multiple of 4 bytes.
+	const uint8_t Signature[4] = { 'a', 'r', 't', 'x' };
+
+	// Token types
+	const uint8_t TokenPadding = 0x00;
+	const uint8_t TokenInt8 = 0x01;
+	const uint8_t TokenInt16 = 0x02;
+	const uint8_t TokenInt32 = 0x03;
+	const uint8_t TokenInt64 = 0x04;
+	const uint8_t TokenUnicodeString = 0x10;
+	const uint8_t TokenOctetString = 0x18;
+	const uint8_t TokenComposite = 0x50;
+	const uint8_t TokenSid = 0x51;
+	const uint8_t TokenEqual = 0x80;
+	const uint8_t TokenNotEqual = 0x81;
+	const uint8_t TokenLess = 0x82;
+	const uint8_t TokenLessOrEqual = 0x83;
+	const uint8_t TokenGreater = 0x84;
+	const uint8_t TokenGreaterOrEqual = 0x85;
+	const uint8_t TokenContains = 0x86;
+	const uint8_t TokenExists = 0x87;
+	const uint8_t TokenAnyOf = 0x88;
+	const uint8_t TokenMemberOf = 0x89;
+	const uint8_t TokenDeviceMemberOf = 0x8A;
+	const uint8_t TokenMemberOfAny = 0x8B;
+	const uint8_t TokenDeviceMemberOfAny = 0x8C;
+	const uint8_t TokenNotExists = 0x8D;
+	const uint8_t TokenNotContains = 0x8E;
+	const uint8_t TokenNotAnyOf = 0x8F;
+	const uint8_t TokenNotMemberOf = 0x90;
+	const uint8_t TokenNotDeviceMemberOf = 0x91;
+	const uint8_t TokenNotMemberOfAny = 0x92;
+	const uint8_t TokenNotDeviceMemberOfAny = 0x93;
+	const uint8_t TokenAnd = 0xA0;
+	const uint8_t TokenOr = 0xA1;
+	const uint8_t TokenNot = 0xA2;
+	const uint8_t TokenLocalAttribute = 0xF8;
+	const uint8_t TokenUserAttribute = 0xF9;
+	const uint8_t TokenResourceAttribute = 0xFA;
+	const uint8_t TokenDeviceAttribute = 0xFB;
+
+	// Integer literal signs and bases
+	const uint8_t SignPlus = 0x01;
+	const uint8_t SignMinus = 0x02;
+	const uint8_t SignNone = 0x03;
+	const uint8_t BaseOctal = 0x01;
+	const uint8_t BaseDecimal = 0x02;
+	const uint8_t BaseHexadecimal = 0x03;
+
+	// Resource attribute value types (CLAIM_SECURITY_ATTRIBUTE_TYPE_INT64 and so on)
+	const uint16_t AttributeInt64 = 0x01;
+	const uint16_t AttributeUInt64 = 0x02;
+	const uint16_t AttributeString = 0x03;
+	const uint16_t AttributeSid = 0x05;
+	const uint16_t AttributeBoolean = 0x06;
+	const uint16_t AttributeOctetString = 0x10;
+
+	/// <summary>
+	/// Compile a conditional expression, including its outer parentheses, to its binary form.
+	/// </summary>
+	/// <param name="pszExpr">Input: the expression; not necessarily null-terminated</param>
+	/// <param name="cchExpr">Input: length of the expression in characters</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases in SID() literals; can be nullptr</param>
+	/// <param name="data">Output: the binary form, padded to a multiple of 4 bytes</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Compile(const wchar_t* pszExpr, size_t cchExpr, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& data, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Compile a resource attribute ("\"Project\",TS,0x0,\"Windows\",\"SQL\"", including its outer parentheses) to
+	/// its binary CLAIM_SECURITY_ATTRIBUTE_RELATIVE_V1 form.
+	/// </summary>
+	/// <param name="pszAttr">Input: the attribute; not necessarily null-terminated</param>
+	/// <param name="cchAttr">Input: length of the attribute in characters</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases in SID values; can be nullptr</param>
+	/// <param name="data">Output: the binary form, padded to a multiple of 4 bytes</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool CompileAttribute(const wchar_t* pszAttr, size_t cchAttr, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& data, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Convert a binary conditional expression to SDDL, as Windows writes it: each operation in parentheses,
+	/// attribute prefixes in uppercase (@USER., @DEVICE., @RESOURCE.), and integers in their original sign and base.
+	/// </summary>
+	/// <param name="pData">Input: the binary form, starting with the signature</param>
+	/// <param name="cbData">Input: length of the binary form in bytes, including any padding</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases in SID() literals; can be nullptr</param>
+	/// <param name="sExpr">Output: the expression, including its outer parentheses</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success; false if the binary form is malformed</returns>
+	bool Decompile(const uint8_t* pData, size_t cbData, const Sddl::Domains_t* pDomains, std::wstring& sExpr, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Convert a binary CLAIM_SECURITY_ATTRIBUTE_RELATIVE_V1 resource attribute to SDDL.
+	/// </summary>
+	/// <param name="pData">Input: the binary form</param>
+	/// <param name="cbData">Input: length of the binary form in bytes, including any padding</param>
+	/// <param name="pDomains">Input: domain SIDs for domain-relative aliases in SID values; can be nullptr</param>
+	/// <param name="sAttr">Output: the attribute, including its outer parentheses</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success; false if the binary form is malformed</returns>
+	bool DecompileAttribute(const uint8_t* pData, size_t cbData, const Sddl::Domains_t* pDomains, std::wstring& sAttr, std::wstring& sErrorInfo);
+}
@@ -0,0 +1,230 @@
+// SecDescModel.cpp: structured security descriptors and their conversion to the binary self-relative form.
+
+#include "SecDescModel.h"
+
+using namespace SecDescModel;
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers
+
+// Largest ACE or ACL: sizes are 16-bit fields
+static const size_t MaxAclSize = 0xFFFF;
+
+/// <summary>
+/// Internal helper: append little-endian integers of 1, 2, or 4 bytes
+/// </summary>
+static void Append8(std::vector<uint8_t>& data, uint8_t value)
+{
+	data.push_back(value);
+}
+
+static void Append16(std::vector<uint8_t>& data, uint16_t value)
+{
+	data.push_back((uint8_t)value);
+	data.push_back((uint8_t)(value >> 8));
+}
+
+static void Append32(std::vector<uint8_t>& data, uint32_t value)
+{
+	for (size_t ix = 0; ix < 4; ++ix)
+		data.push_back((uint8_t)(value >> (8 * ix)));
+}
+
+/// <summary>
+/// Internal helper: overwrite a little-endian 32-bit value
+/// </summary>
+static void Put32(std::vector<uint8_t>& data, size_t offset, uint32_t value)
+{
+	for (size_t ix = 0; ix < 4; ++ix)
+		data[offset + ix] = (uint8_t)(value >> (8 * ix));
+}
+
+/// <summary>
+/// Internal helper: binary size of an ACL, or 0 if it's too large
+/// </summary>
+static size_t AclSize(const Acl_t& acl)
+{
+	size_t size = AclHeaderSize;
+	for (AceList_t::const_iterator iter = acl.aces.begin(); iter != acl.aces.end(); ++iter)
+	{
+		size_t aceSize = AceSize(*iter);
+		if (aceSize > MaxAclSize)
+			return 0;
+		size += aceSize;
+	}
+	return (size <= MaxAclSize) ? size : 0;
+}
+
+/// <summary>
+/// Internal helper: append an ACL in binary form. Its size must already have been checked with AclSize.
+/// </summary>
+static void AppendAcl(std::vector<uint8_t>& data, const Acl_t& acl)
+{
+	// ACL_REVISION_DS is needed only if the ACL holds object ACEs
+	uint8_t revision = AclRevision;
+	for (AceList_t::const_iterator iter = acl.aces.begin(); iter != acl.aces.end(); ++iter)
+	{
+		if (IsObjectAceType(iter->type))
+			revision = AclRevisionDs;
+	}
+
+	Append8(data, revision);
+	Append8(data, 0);
+	Append16(data, (uint16_t)AclSize(acl));
+	Append16(data, (uint16_t)acl.aces.size());
+	Append16(data, 0);
+
+	for (AceList_t::const_iterator iter = acl.aces.begin(); iter != acl.aces.end(); ++iter)
+	{
+		const Ace_t& ace = *iter;
+		size_t aceSize = AceSize(ace);
+		size_t aceStart = data.size();
+		Append8(data, ace.type);
+		Append8(data, ace.flags);
+		Append16(data, (uint16_t)aceSize);
+		Append32(data, ace.mask);
+		if (IsObjectAceType(ace.type))
+		{
+			uint32_t objectFlags =
+				(ace.bObjectType ? ObjectTypePresent : 0) |
+				(ace.bInheritedObjectType ? InheritedObjectTypePresent : 0);
+			Append32(data, objectFlags);
+			if (ace.bObjectType)
+				data.insert(data.end(), ace.objectType.bytes, ace.objectType.bytes + sizeof(ace.objectType.bytes));
+			if (ace.bInheritedObjectType)
+				data.insert(data.end(), ace.inheritedObjectType.bytes, ace.inheritedObjectType.bytes + sizeof(ace.inheritedObjectType.bytes));
+		}
+		data.insert(data.end(), ace.sid.begin(), ace.sid.end());
+		data.insert(data.end(), ace.applicationData.begin(), ace.applicationData.end());
+		// Zero padding up to the ACE size
+		data.resize(aceStart + aceSize, 0);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Whether an ACE type has the object ACE layout (flags and optional GUIDs before the SID)
+/// </summary>
+bool SecDescModel::IsObjectAceType(uint8_t aceType)
+{
+	switch (aceType)
+	{
+	case AccessAllowedObjectAceType:
+	case AccessDeniedObjectAceType:
+	case SystemAuditObjectAceType:
+	case SystemAlarmObjectAceType:
+	case AccessAllowedCallbackObjectAceType:
+	case AccessDeniedCallbackObjectAceType:
+	case SystemAuditCallbackObjectAceType:
+	case SystemAlarmCallbackObjectAceType:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Whether an ACE type is a callback ACE, whose application data holds a conditional expression
+/// </summary>
+bool SecDescModel::IsCallbackAceType(uint8_t aceType)
+{
+	switch (aceType)
+	{
+	case AccessAllowedCallbackAceType:
+	case AccessDeniedCallbackAceType:
+	case AccessAllowedCallbackObjectAceType:
+	case AccessDeniedCallbackObjectAceType:
+	case SystemAuditCallbackAceType:
+	case SystemAlarmCallbackAceType:
+	case SystemAuditCallbackObjectAceType:
+	case SystemAlarmCallbackObjectAceType:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Reset to an empty security descriptor
+/// </summary>
+void SecurityDescriptor_t::clear()
+{
+	control = 0;
+	owner.clear();
+	group.clear();
+	dacl.bNull = sacl.bNull = false;
+	dacl.aces.clear();
+	sacl.aces.clear();
+}
+
+/// <summary>
+/// Binary size of an ACE, rounded up to a multiple of 4 bytes as ACE sizes must be
+/// </summary>
+size_t SecDescModel::AceSize(const Ace_t& ace)
+{
+	// Header and mask
+	size_t size = AceHeaderSize + 4;
+	if (IsObjectAceType(ace.type))
+	{
+		size += 4;
+		if (ace.bObjectType)
+			size += sizeof(ace.objectType.bytes);
+		if (ace.bInheritedObjectType)
+			size += sizeof(ace.inheritedObjectType.bytes);
+	}
+	size += ace.sid.size() + ace.applicationData.size();
+	return (size + 3) & ~(size_t)3;
+}
+
+/// <summary>
+/// Convert a security descriptor to its binary self-relative form.
+/// </summary>
+bool SecDescModel::ToSelfRelative(const SecurityDescriptor_t& sd, std::vector<uint8_t>& binary, std::wstring& sErrorInfo)
+{
+	binary.clear();
+	sErrorInfo.clear();
+
+	const bool bDacl = (0 != (sd.control & DaclPresent)) && !sd.dacl.bNull;
+	const bool bSacl = (0 != (sd.control & SaclPresent)) && !sd.sacl.bNull;
+	size_t daclSize = bDacl ? AclSize(sd.dacl) : 0;
+	size_t saclSize = bSacl ? AclSize(sd.sacl) : 0;
+	if ((bDacl && 0 == daclSize) || (bSacl && 0 == saclSize))
+	{
+		sErrorInfo = L"ACL exceeds the maximum size";
+		return false;
+	}
+
+	binary.reserve(SecurityDescriptorHeaderSize + saclSize + daclSize + sd.owner.size() + sd.group.size());
+	// Revision 1, then the resource manager control byte
+	Append8(binary, 1);
+	Append8(binary, 0);
+	Append16(binary, (uint16_t)(sd.control | SelfRelative));
+	// Offsets of owner, group, SACL, and DACL, filled in below; 0 if absent
+	Append32(binary, 0);
+	Append32(binary, 0);
+	Append32(binary, 0);
+	Append32(binary, 0);
+
+	if (bSacl)
+	{
+		Put32(binary, 12, (uint32_t)binary.size());
+		AppendAcl(binary, sd.sacl);
+	}
+	if (bDacl)
+	{
+		Put32(binary, 16, (uint32_t)binary.size());
+		AppendAcl(binary, sd.dacl);
+	}
+	if (!sd.owner.empty())
+	{
+		Put32(binary, 4, (uint32_t)binary.size());
+		binary.insert(binary.end(), sd.owner.begin(), sd.owner.end());
+	}
+	if (!sd.group.empty())
+	{
+		Put32(binary, 8, (uint32_t)binary.size());
+		binary.insert(binary.end(), sd.group.begin(), sd.group.end());
+	}
+	return true;
+}
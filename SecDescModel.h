@@ -0,0 +1,161 @@
+#pragma once
+
+// SecDescModel.h: a structured representation of a security descriptor: control flags, owner, group, and the DACL
+// and SACL as lists of ACEs. It can be built from SDDL (Sddl.h) and converted to the binary self-relative form
+// that the Win32 security functions take.
+// Constants carry the winnt.h values under names that don't collide with its macros.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SecDescModel
+{
+	// ACE types (ACCESS_ALLOWED_ACE_TYPE and so on)
+	const uint8_t AccessAllowedAceType = 0x00;
+	const uint8_t AccessDeniedAceType = 0x01;
+	const uint8_t SystemAuditAceType = 0x02;
+	const uint8_t SystemAlarmAceType = 0x03;
+	const uint8_t AccessAllowedCompoundAceType = 0x04;
+	const uint8_t AccessAllowedObjectAceType = 0x05;
+	const uint8_t AccessDeniedObjectAceType = 0x06;
+	const uint8_t SystemAuditObjectAceType = 0x07;
+	const uint8_t SystemAlarmObjectAceType = 0x08;
+	const uint8_t AccessAllowedCallbackAceType = 0x09;
+	const uint8_t AccessDeniedCallbackAceType = 0x0A;
+	const uint8_t AccessAllowedCallbackObjectAceType = 0x0B;
+	const uint8_t AccessDeniedCallbackObjectAceType = 0x0C;
+	const uint8_t SystemAuditCallbackAceType = 0x0D;
+	const uint8_t SystemAlarmCallbackAceType = 0x0E;
+	const uint8_t SystemAuditCallbackObjectAceType = 0x0F;
+	const uint8_t SystemAlarmCallbackObjectAceType = 0x10;
+	const uint8_t SystemMandatoryLabelAceType = 0x11;
+	const uint8_t SystemResourceAttributeAceType = 0x12;
+	const uint8_t SystemScopedPolicyIdAceType = 0x13;
+	const uint8_t SystemProcessTrustLabelAceType = 0x14;
+	const uint8_t SystemAccessFilterAceType = 0x15;
+
+	// ACE flags (OBJECT_INHERIT_ACE and so on)
+	const uint8_t ObjectInheritAce = 0x01;
+	const uint8_t ContainerInheritAce = 0x02;
+	const uint8_t NoPropagateInheritAce = 0x04;
+	const uint8_t InheritOnlyAce = 0x08;
+	const uint8_t InheritedAce = 0x10;
+	const uint8_t CriticalAceFlag = 0x20;
+	const uint8_t TrustProtectedFilterAceFlag = 0x40;
+	const uint8_t SuccessfulAccessAceFlag = 0x40;
+	const uint8_t FailedAccessAceFlag = 0x80;
+
+	// Object ACE flags (ACE_OBJECT_TYPE_PRESENT, ACE_INHERITED_OBJECT_TYPE_PRESENT)
+	const uint32_t ObjectTypePresent = 0x1;
+	const uint32_t InheritedObjectTypePresent = 0x2;
+
+	// Security descriptor control flags (SE_OWNER_DEFAULTED and so on)
+	const uint16_t OwnerDefaulted = 0x0001;
+	const uint16_t GroupDefaulted = 0x0002;
+	const uint16_t DaclPresent = 0x0004;
+	const uint16_t DaclDefaulted = 0x0008;
+	const uint16_t SaclPresent = 0x0010;
+	const uint16_t SaclDefaulted = 0x0020;
+	const uint16_t DaclAutoInheritReq = 0x0100;
+	const uint16_t SaclAutoInheritReq = 0x0200;
+	const uint16_t DaclAutoInherited = 0x0400;
+	const uint16_t SaclAutoInherited = 0x0800;
+	const uint16_t DaclProtected = 0x1000;
+	const uint16_t SaclProtected = 0x2000;
+	const uint16_t RmControlValid = 0x4000;
+	const uint16_t SelfRelative = 0x8000;
+
+	// ACL revisions: ACL_REVISION, and ACL_REVISION_DS for ACLs that hold object ACEs
+	const uint8_t AclRevision = 2;
+	const uint8_t AclRevisionDs = 4;
+
+	// Binary layout sizes: SECURITY_DESCRIPTOR_RELATIVE, ACL, and ACE_HEADER
+	const size_t SecurityDescriptorHeaderSize = 20;
+	const size_t AclHeaderSize = 8;
+	const size_t AceHeaderSize = 4;
+
+	/// <summary>
+	/// Whether an ACE type has the object ACE layout (flags and optional GUIDs before the SID)
+	/// </summary>
+	bool IsObjectAceType(uint8_t aceType);
+
+	/// <summary>
+	/// Whether an ACE type is a callback ACE, whose application data holds a conditional expression
+	/// </summary>
+	bool IsCallbackAceType(uint8_t aceType);
+
+	/// <summary>
+	/// A GUID in its binary (GUID structure) layout
+	/// </summary>
+	struct Guid_t
+	{
+		uint8_t bytes[16];
+	};
+
+	/// <summary>
+	/// One access control entry
+	/// </summary>
+	struct Ace_t
+	{
+		uint8_t type = AccessAllowedAceType;
+		uint8_t flags = 0;
+		uint32_t mask = 0;
+		// Object ACEs only: the object type and the inherited object type, each if present
+		bool bObjectType = false;
+		bool bInheritedObjectType = false;
+		Guid_t objectType = {};
+		Guid_t inheritedObjectType = {};
+		// Trustee, as a binary SID
+		std::vector<uint8_t> sid;
+		// Data following the SID: for callback ACEs, a conditional expression in its binary form ("artx" and
+		// tokens); for resource attribute ACEs, a CLAIM_SECURITY_ATTRIBUTE_RELATIVE_V1 structure
+		std::vector<uint8_t> applicationData;
+	};
+	typedef std::vector<Ace_t> AceList_t;
+
+	/// <summary>
+	/// A DACL or SACL
+	/// </summary>
+	struct Acl_t
+	{
+		// True for a NULL ACL (present, but with no ACL at all)
+		bool bNull = false;
+		AceList_t aces;
+	};
+
+	/// <summary>
+	/// A security descriptor. The DaclPresent and SaclPresent control flags say whether each ACL is present;
+	/// owner and group are empty if absent.
+	/// </summary>
+	struct SecurityDescriptor_t
+	{
+		uint16_t control = 0;
+		std::vector<uint8_t> owner;
+		std::vector<uint8_t> group;
+		Acl_t dacl;
+		Acl_t sacl;
+
+		/// <summary>
+		/// Reset to an empty security descriptor
+		/// </summary>
+		void clear();
+	};
+
+	/// <summary>
+	/// Binary size of an ACE, rounded up to a multiple of 4 bytes as ACE sizes must be
+	/// </summary>
+	size_t AceSize(const Ace_t& ace);
+
+	/// <summary>
+	/// Convert a security descriptor to its binary self-relative form, laid out the way MakeSelfRelativeSD lays it
+	/// out: header, SACL, DACL, owner, group.
+	/// </summary>
+	/// <param name="sd">Input: the security descriptor</param>
+	/// <param name="binary">Output: the self-relative security descriptor</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success; false if an ACE or ACL exceeds the 64KB size limit</returns>
+	bool ToSelfRelative(const SecurityDescriptor_t& sd, std::vector<uint8_t>& binary, std::wstring& sErrorInfo);
+}
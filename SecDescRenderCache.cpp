@@ -0,0 +1,87 @@
+// SecDescRenderCache.cpp: process-wide memoization of rendered security descriptors.
+
+#include "SecDescRenderCache.h"
+
+const size_t SecDescRenderCache::MaxEntries;
+
+SecDescRenderCache::SecDescRenderCache()
+	: m_hits(0), m_misses(0)
+{
+}
+
+bool SecDescRenderCache::Key_t::operator==(const Key_t& other) const
+{
+	return
+		rendering.format == other.rendering.format &&
+		rendering.securityInformation == other.rendering.securityInformation &&
+		rendering.indent == other.rendering.indent &&
+		rendering.sObjType == other.rendering.sObjType &&
+		securityDescriptor == other.securityDescriptor;
+}
+
+size_t SecDescRenderCache::KeyHash_t::operator()(const Key_t& key) const
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (size_t ix = 0; ix < key.securityDescriptor.size(); ++ix)
+	{
+		hash ^= key.securityDescriptor[ix];
+		hash *= 0x100000001B3ULL;
+	}
+	const uint64_t renderingValues[] = { key.rendering.format, key.rendering.securityInformation, key.rendering.indent };
+	for (size_t ix = 0; ix < sizeof(renderingValues) / sizeof(renderingValues[0]); ++ix)
+	{
+		hash ^= renderingValues[ix];
+		hash *= 0x100000001B3ULL;
+	}
+	for (size_t ix = 0; ix < key.rendering.sObjType.size(); ++ix)
+	{
+		hash ^= (uint64_t)key.rendering.sObjType[ix];
+		hash *= 0x100000001B3ULL;
+	}
+	return (size_t)hash;
+}
+
+/// <summary>
+/// Look up text rendered earlier for a security descriptor.
+/// </summary>
+bool SecDescRenderCache::Find(const uint8_t* pSD, size_t cbSD, const Rendering_t& rendering, std::wstring& sText)
+{
+	sText.clear();
+	Key_t key = { std::vector<uint8_t>(pSD, pSD + cbSD), rendering };
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	EntryMap_t::const_iterator entryIter = m_entries.find(key);
+	if (m_entries.end() == entryIter)
+	{
+		++m_misses;
+		return false;
+	}
+	++m_hits;
+	sText = entryIter->second;
+	return true;
+}
+
+/// <summary>
+/// Cache the text rendered for a security descriptor.
+/// </summary>
+void SecDescRenderCache::Add(const uint8_t* pSD, size_t cbSD, const Rendering_t& rendering, const std::wstring& sText)
+{
+	Key_t key = { std::vector<uint8_t>(pSD, pSD + cbSD), rendering };
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_entries.size() >= MaxEntries && m_entries.end() == m_entries.find(key))
+		m_entries.clear();
+	m_entries[key] = sText;
+}
+
+void SecDescRenderCache::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+size_t SecDescRenderCache::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
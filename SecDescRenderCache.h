@@ -0,0 +1,100 @@
+#pragma once
+
+// SecDescRenderCache.h: process-wide memoization of rendered security descriptors.
+// Most window stations and desktops share one of a handful of security descriptors (every Default, Winlogon, and
+// Disconnect desktop in a session's WinSta0 typically has the same one), yet each was converted to SDDL or walked
+// ACE by ACE, with its SIDs looked up, separately. Text rendered for a security descriptor is cached by the
+// descriptor's content and how it was rendered, and repeated descriptors are output from the cache.
+// Portable C++ (no Windows dependencies): the rendering itself is done by the caller.
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// <summary>
+/// Thread-safe cache of rendered text, keyed by the binary security descriptor and how it was rendered.
+/// Text is cached as first rendered, so detailed text keeps the SID names resolved at that time.
+/// Flush it whenever the SID name cache is flushed, or it keeps serving the old names.
+/// </summary>
+class SecDescRenderCache
+{
+public:
+	/// <summary>
+	/// How a security descriptor was rendered: everything besides its bytes that the text depends on
+	/// </summary>
+	struct Rendering_t
+	{
+		// Output format, as the caller defines it (e.g., SDDL or detailed)
+		uint32_t format;
+		// SECURITY_INFORMATION bits the descriptor was read with
+		uint32_t securityInformation;
+		// Object type for permission names
+		std::wstring sObjType;
+		// Indent of the rendered text
+		size_t indent;
+	};
+
+	// When the cache holds this many descriptors, it's emptied before another is added, so that a long --watch
+	// run over short-lived objects doesn't grow without limit.
+	static const size_t MaxEntries = 4096;
+
+	SecDescRenderCache();
+	~SecDescRenderCache() = default;
+
+	/// <summary>
+	/// Look up text rendered earlier for a security descriptor.
+	/// </summary>
+	/// <param name="pSD">Input: binary security descriptor</param>
+	/// <param name="cbSD">Input: length of the security descriptor in bytes</param>
+	/// <param name="rendering">Input: how the text is to be rendered</param>
+	/// <param name="sText">Output: the rendered text, if cached</param>
+	/// <returns>true if the text is cached; false if it must be rendered (and then added)</returns>
+	bool Find(const uint8_t* pSD, size_t cbSD, const Rendering_t& rendering, std::wstring& sText);
+
+	/// <summary>
+	/// Cache the text rendered for a security descriptor. Replaces any cached text.
+	/// </summary>
+	void Add(const uint8_t* pSD, size_t cbSD, const Rendering_t& rendering, const std::wstring& sText);
+
+	/// <summary>
+	/// Discard all cached text. The counters are not reset.
+	/// </summary>
+	void Flush();
+
+	// Number of lookups answered from the cache
+	uint64_t Hits() const { return m_hits; }
+	// Number of lookups that found nothing cached
+	uint64_t Misses() const { return m_misses; }
+	// Number of renderings currently cached
+	size_t Size() const;
+
+private:
+	struct Key_t
+	{
+		std::vector<uint8_t> securityDescriptor;
+		Rendering_t rendering;
+
+		bool operator==(const Key_t& other) const;
+	};
+
+	// FNV-1a over the security descriptor bytes, then the rendering
+	struct KeyHash_t
+	{
+		size_t operator()(const Key_t& key) const;
+	};
+
+	typedef std::unordered_map<Key_t, std::wstring, KeyHash_t> EntryMap_t;
+
+	mutable std::mutex m_mutex;
+	EntryMap_t m_entries;
+	std::atomic<uint64_t> m_hits;
+	std::atomic<uint64_t> m_misses;
+
+private:
+	// Not implemented
+	SecDescRenderCache(const SecDescRenderCache&) = delete;
+	SecDescRenderCache& operator = (const SecDescRenderCache&) = delete;
+};
@@ -0,0 +1,223 @@
+// SecDescView.cpp: read-only views of binary self-relative security descriptors, ACLs, and ACEs.
+
+#include "SecDescView.h"
+#include "SidCodec.h"
+
+using namespace SecDescModel;
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers: little-endian values; the caller has checked the bounds
+
+static inline uint16_t Read16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t Read32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Work out where the parts of an ACE are. Every ACE type defined so far, other than compound ACEs, has an access
+/// mask followed by the SID; object ACEs have flags and up to two GUIDs between the two.
+/// </summary>
+bool AceView::Init(const uint8_t* pAce, size_t cbAvailable)
+{
+	m_pAce = pAce;
+	m_cbAce = 0;
+	m_objectTypeOffset = m_inheritedObjectTypeOffset = m_sidOffset = m_cbSid = 0;
+	if (cbAvailable < AceHeaderSize)
+		return false;
+	m_cbAce = Read16(pAce + 2);
+	if (m_cbAce < AceHeaderSize || m_cbAce > cbAvailable)
+		return false;
+
+	const uint8_t aceType = pAce[0];
+	if (AccessAllowedCompoundAceType == aceType || aceType > SystemAccessFilterAceType)
+		return true;
+
+	size_t sidOffset = AceHeaderSize + 4;
+	if (IsObjectAceType(aceType))
+	{
+		if (m_cbAce < sidOffset + 4)
+			return false;
+		const uint32_t objectFlags = Read32(pAce + sidOffset);
+		sidOffset += 4;
+		if (0 != (objectFlags & ObjectTypePresent))
+		{
+			m_objectTypeOffset = sidOffset;
+			sidOffset += sizeof(Guid_t);
+		}
+		if (0 != (objectFlags & InheritedObjectTypePresent))
+		{
+			m_inheritedObjectTypeOffset = sidOffset;
+			sidOffset += sizeof(Guid_t);
+		}
+	}
+	if (m_cbAce <= sidOffset)
+		return false;
+	m_cbSid = SidCodec::BinaryLength(pAce + sidOffset, m_cbAce - sidOffset);
+	if (0 == m_cbSid)
+		return false;
+	m_sidOffset = sidOffset;
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// View an ACL, checking its header and every ACE.
+/// </summary>
+AclView::AclView(const uint8_t* pAcl, size_t cbAvailable)
+	: m_pAcl(pAcl), m_cbAcl(0), m_nAces(0), m_bPresent(true), m_bValid(true), m_errorOffset(0), m_szError(nullptr)
+{
+	if (nullptr == pAcl)
+		return;
+	if (cbAvailable < AclHeaderSize)
+	{
+		Fail(0, L"truncated ACL header");
+		return;
+	}
+	if (pAcl[0] < AclRevision || pAcl[0] > AclRevisionDs)
+	{
+		Fail(0, L"unknown ACL revision");
+		return;
+	}
+	m_cbAcl = Read16(pAcl + 2);
+	m_nAces = Read16(pAcl + 4);
+	if (m_cbAcl < AclHeaderSize || m_cbAcl > cbAvailable)
+	{
+		Fail(2, L"invalid ACL size");
+		return;
+	}
+
+	size_t aceOffset = AclHeaderSize;
+	for (size_t ixAce = 0; ixAce < m_nAces; ++ixAce)
+	{
+		AceView ace;
+		if (!ace.Init(pAcl + aceOffset, m_cbAcl - aceOffset))
+		{
+			Fail(aceOffset, L"invalid ACE");
+			return;
+		}
+		aceOffset += ace.Size();
+	}
+}
+
+/// <summary>
+/// Internal: record the first problem and mark the ACL invalid
+/// </summary>
+bool AclView::Fail(size_t offset, const wchar_t* szReason)
+{
+	m_bValid = false;
+	if (nullptr == m_szError)
+	{
+		m_errorOffset = offset;
+		m_szError = szReason;
+	}
+	return false;
+}
+
+std::wstring AclView::ErrorInfo() const
+{
+	if (m_bValid)
+		return std::wstring();
+	return std::wstring(L"Invalid ACL at offset ") + std::to_wstring(m_errorOffset) + L": " + m_szError;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// View a self-relative security descriptor, checking each of its parts.
+/// </summary>
+SecurityDescriptorView::SecurityDescriptorView(const uint8_t* pSD, size_t cbSD)
+	: m_pSD(pSD), m_cbSD((nullptr == pSD) ? 0 : cbSD), m_control(0),
+	m_pOwner(nullptr), m_cbOwner(0), m_pGroup(nullptr), m_cbGroup(0),
+	m_daclOffset(0), m_saclOffset(0), m_errorOffset(0), m_szError(nullptr)
+{
+	// Header: revision, padding, control flags, then the owner, group, SACL, and DACL offsets (0 if absent)
+	if (m_cbSD < SecurityDescriptorHeaderSize)
+	{
+		m_szError = L"truncated header";
+		return;
+	}
+	if (1 != pSD[0])
+	{
+		m_szError = L"unknown revision";
+		return;
+	}
+	m_control = Read16(pSD + 2);
+	if (0 == (m_control & SelfRelative))
+	{
+		m_errorOffset = 2;
+		m_szError = L"not self-relative";
+		return;
+	}
+
+	m_pOwner = Sid(Read32(pSD + 4), m_cbOwner);
+	m_pGroup = Sid(Read32(pSD + 8), m_cbGroup);
+	m_saclOffset = Read32(pSD + 12);
+	m_daclOffset = Read32(pSD + 16);
+	if (0 != (m_control & SaclPresent))
+		Acl(m_saclOffset, m_sacl);
+	if (0 != (m_control & DaclPresent))
+		Acl(m_daclOffset, m_dacl);
+}
+
+/// <summary>
+/// Internal: the owner or group SID at an offset; nullptr if absent or invalid
+/// </summary>
+const uint8_t* SecurityDescriptorView::Sid(size_t offset, size_t& cbSid)
+{
+	cbSid = 0;
+	if (0 == offset)
+		return nullptr;
+	if (offset < m_cbSD)
+		cbSid = SidCodec::BinaryLength(m_pSD + offset, m_cbSD - offset);
+	if (0 == cbSid)
+	{
+		if (nullptr == m_szError)
+		{
+			m_errorOffset = offset;
+			m_szError = L"invalid SID";
+		}
+		return nullptr;
+	}
+	return m_pSD + offset;
+}
+
+/// <summary>
+/// Internal: view the ACL at an offset; a 0 offset is a NULL ACL
+/// </summary>
+void SecurityDescriptorView::Acl(size_t offset, AclView& acl)
+{
+	if (0 == offset)
+		acl = AclView(nullptr, 0);
+	else if (offset >= m_cbSD)
+	{
+		acl = AclView(nullptr, 0);
+		acl.Fail(0, L"ACL out of range");
+	}
+	else
+		acl = AclView(m_pSD + offset, m_cbSD - offset);
+}
+
+std::wstring SecurityDescriptorView::ErrorInfo() const
+{
+	if (nullptr != m_szError)
+		return std::wstring(L"Invalid security descriptor at offset ") + std::to_wstring(m_errorOffset) + L": " + m_szError;
+	const AclView* pAcls[] = { &m_dacl, &m_sacl };
+	const size_t offsets[] = { m_daclOffset, m_saclOffset };
+	for (size_t ix = 0; ix < sizeof(pAcls) / sizeof(pAcls[0]); ++ix)
+	{
+		if (!pAcls[ix]->IsValid())
+		{
+			// Make the ACL's offset relative to the security descriptor
+			return std::wstring(L"Invalid security descriptor at offset ") + std::to_wstring(offsets[ix] + pAcls[ix]->m_errorOffset) + L": " + pAcls[ix]->m_szError;
+		}
+	}
+	return std::wstring();
+}
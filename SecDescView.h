@@ -0,0 +1,229 @@
+#pragma once
+
+// SecDescView.h: read-only views of binary self-relative security descriptors, their ACLs, and their ACEs, directly
+// over the bytes and without copying. Every offset and length is checked once, when a view is constructed; after
+// that, iterating the ACEs and reading their parts doesn't check or allocate.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include "SecDescModel.h"
+
+/// <summary>
+/// One ACE within a validated ACL. Pointers returned point into the security descriptor's bytes.
+/// </summary>
+class AceView
+{
+public:
+	AceView()
+		: m_pAce(nullptr), m_cbAce(0), m_objectTypeOffset(0), m_inheritedObjectTypeOffset(0), m_sidOffset(0), m_cbSid(0)
+	{
+	}
+
+	/// <summary>
+	/// Work out where the parts of the ACE at pAce are.
+	/// </summary>
+	/// <param name="pAce">Input: the ACE, starting with its header</param>
+	/// <param name="cbAvailable">Input: number of bytes available at pAce</param>
+	/// <returns>true if the ACE's size fits and, for ACE types that have one, its SID is valid and fits within the ACE</returns>
+	bool Init(const uint8_t* pAce, size_t cbAvailable);
+
+	uint8_t Type() const { return m_pAce[0]; }
+	uint8_t Flags() const { return m_pAce[1]; }
+	// Size of the ACE in bytes, from its header
+	size_t Size() const { return m_cbAce; }
+	// The ACE's bytes, starting with its header
+	const uint8_t* Data() const { return m_pAce; }
+	// Access mask; 0 for ACEs too small to have one
+	uint32_t Mask() const { return (m_cbAce >= SecDescModel::AceHeaderSize + 4) ? Read32(m_pAce + SecDescModel::AceHeaderSize) : 0; }
+
+	// Object ACEs only: the 16-byte object type and inherited object type GUIDs; nullptr if not present
+	const uint8_t* ObjectType() const { return (0 != m_objectTypeOffset) ? m_pAce + m_objectTypeOffset : nullptr; }
+	const uint8_t* InheritedObjectType() const { return (0 != m_inheritedObjectTypeOffset) ? m_pAce + m_inheritedObjectTypeOffset : nullptr; }
+
+	// Trustee SID; nullptr for ACE types without a known layout (compound ACEs and types defined after
+	// SYSTEM_ACCESS_FILTER_ACE_TYPE)
+	const uint8_t* Sid() const { return (0 != m_cbSid) ? m_pAce + m_sidOffset : nullptr; }
+	size_t SidLength() const { return m_cbSid; }
+
+	// Bytes following the SID: a conditional expression for callback ACEs, a resource attribute for resource
+	// attribute ACEs, otherwise padding if anything
+	const uint8_t* ApplicationData() const { return m_pAce + ApplicationDataOffset(); }
+	size_t ApplicationDataLength() const { return m_cbAce - ApplicationDataOffset(); }
+
+private:
+	size_t ApplicationDataOffset() const { return (0 != m_cbSid) ? m_sidOffset + m_cbSid : m_cbAce; }
+
+	static uint32_t Read32(const uint8_t* p)
+	{
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+private:
+	const uint8_t* m_pAce;
+	size_t m_cbAce;
+	size_t m_objectTypeOffset;
+	size_t m_inheritedObjectTypeOffset;
+	size_t m_sidOffset;
+	size_t m_cbSid;
+};
+
+/// <summary>
+/// An ACL: absent, NULL, or a validated ACL whose ACEs can be iterated.
+/// </summary>
+class AclView
+{
+public:
+	/// <summary>
+	/// Forward iterator over the ACEs of a valid ACL
+	/// </summary>
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef AceView value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const AceView* pointer;
+		typedef const AceView& reference;
+
+		const_iterator() : m_pEnd(nullptr), m_nRemaining(0) {}
+
+		reference operator*() const { return m_ace; }
+		pointer operator->() const { return &m_ace; }
+
+		const_iterator& operator++()
+		{
+			if (0 != --m_nRemaining)
+				m_ace.Init(m_ace.Data() + m_ace.Size(), (size_t)(m_pEnd - (m_ace.Data() + m_ace.Size())));
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator prev = *this;
+			++*this;
+			return prev;
+		}
+
+		bool operator==(const const_iterator& other) const { return m_nRemaining == other.m_nRemaining; }
+		bool operator!=(const const_iterator& other) const { return m_nRemaining != other.m_nRemaining; }
+
+	private:
+		friend class AclView;
+		const_iterator(const uint8_t* pFirstAce, const uint8_t* pEnd, size_t nAces)
+			: m_pEnd(pEnd), m_nRemaining(nAces)
+		{
+			if (0 != nAces)
+				m_ace.Init(pFirstAce, (size_t)(pEnd - pFirstAce));
+		}
+
+		AceView m_ace;
+		const uint8_t* m_pEnd;
+		size_t m_nRemaining;
+	};
+
+public:
+	// An absent ACL
+	AclView()
+		: m_pAcl(nullptr), m_cbAcl(0), m_nAces(0), m_bPresent(false), m_bValid(true), m_errorOffset(0), m_szError(nullptr)
+	{
+	}
+
+	/// <summary>
+	/// View the ACL at pAcl: check its header and every ACE in it.
+	/// </summary>
+	/// <param name="pAcl">Input: the ACL; nullptr for a NULL ACL</param>
+	/// <param name="cbAvailable">Input: number of bytes available at pAcl</param>
+	AclView(const uint8_t* pAcl, size_t cbAvailable);
+
+	// Whether the ACL is present; absent ACLs have no ACEs
+	bool IsPresent() const { return m_bPresent; }
+	// Whether the ACL is a NULL ACL: present, but with no ACL at all
+	bool IsNull() const { return m_bPresent && m_bValid && nullptr == m_pAcl; }
+	// Whether the ACL's header and ACEs are all valid; iterate only valid ACLs
+	bool IsValid() const { return m_bValid; }
+
+	uint8_t Revision() const { return (nullptr != m_pAcl) ? m_pAcl[0] : 0; }
+	// Size of the ACL in bytes, from its header
+	size_t Size() const { return m_cbAcl; }
+	size_t AceCount() const { return m_nAces; }
+
+	const_iterator begin() const { return (m_bValid && nullptr != m_pAcl) ? const_iterator(m_pAcl + SecDescModel::AclHeaderSize, m_pAcl + m_cbAcl, m_nAces) : const_iterator(); }
+	const_iterator end() const { return const_iterator(); }
+
+	/// <summary>
+	/// What's wrong with an invalid ACL
+	/// </summary>
+	/// <returns>Description including the offset from the start of the ACL; empty if the ACL is valid</returns>
+	std::wstring ErrorInfo() const;
+
+private:
+	friend class SecurityDescriptorView;
+	bool Fail(size_t offset, const wchar_t* szReason);
+
+private:
+	const uint8_t* m_pAcl;
+	size_t m_cbAcl;
+	size_t m_nAces;
+	bool m_bPresent;
+	bool m_bValid;
+	size_t m_errorOffset;
+	const wchar_t* m_szError;
+};
+
+/// <summary>
+/// A self-relative security descriptor: control flags, owner, group, DACL, and SACL.
+/// </summary>
+class SecurityDescriptorView
+{
+public:
+	/// <summary>
+	/// View the self-relative security descriptor at pSD: check its header, owner, group, and ACLs.
+	/// </summary>
+	/// <param name="pSD">Input: the security descriptor</param>
+	/// <param name="cbSD">Input: number of bytes available at pSD</param>
+	SecurityDescriptorView(const uint8_t* pSD, size_t cbSD);
+
+	// Whether every part of the security descriptor is valid. When only an ACL is invalid, the other parts can
+	// still be used.
+	bool IsValid() const { return nullptr == m_szError && m_dacl.IsValid() && m_sacl.IsValid(); }
+
+	uint16_t Control() const { return m_control; }
+
+	// Owner and group SIDs; nullptr if absent or invalid
+	const uint8_t* Owner() const { return m_pOwner; }
+	size_t OwnerLength() const { return m_cbOwner; }
+	const uint8_t* Group() const { return m_pGroup; }
+	size_t GroupLength() const { return m_cbGroup; }
+
+	// DACL and SACL; absent if the DaclPresent/SaclPresent control flag isn't set or the header is invalid
+	const AclView& Dacl() const { return m_dacl; }
+	const AclView& Sacl() const { return m_sacl; }
+
+	/// <summary>
+	/// What's wrong with an invalid security descriptor
+	/// </summary>
+	/// <returns>Description including the offset from the start of the security descriptor; empty if it's valid</returns>
+	std::wstring ErrorInfo() const;
+
+private:
+	const uint8_t* Sid(size_t offset, size_t& cbSid);
+	void Acl(size_t offset, AclView& acl);
+
+private:
+	const uint8_t* m_pSD;
+	size_t m_cbSD;
+	uint16_t m_control;
+	const uint8_t* m_pOwner;
+	size_t m_cbOwner;
+	const uint8_t* m_pGroup;
+	size_t m_cbGroup;
+	AclView m_dacl;
+	AclView m_sacl;
+	size_t m_daclOffset;
+	size_t m_saclOffset;
+	size_t m_errorOffset;
+	const wchar_t* m_szError;
+};
@@ -4,6 +4,7 @@
 #include <NtDsAPI.h>
 #include <LM.h> // to get max domain and username lengths
 #include <sddl.h>
+#include <NTSecAPI.h>
 #include <iostream>
 #include <sstream>
 #include "SysErrorMessage.h"
@@ -11,6 +12,11 @@
 #include "SecurityDescriptorUtils.h"
 #include "CSid.h"
 #include "StringUtils.h"
+#include "MachineSid.h"
+#include "Sddl.h"
+#include "SecDescModel.h"
+#include "SecDescView.h"
+#include "PermDecoder.h"
 
 //TODO: Could add more object types: synch objects, job objects
 // https://docs.microsoft.com/en-us/windows/win32/sync/synchronization-object-security-and-access-rights
@@ -116,16 +122,13 @@ static void OutputFlagsOnOneLine(std::wostream& sOut, const flags_t* pFlags, DWO
 
 // --------------------------------------------------------------------------------
 // --------------------------------------------------------------------------------
-/// <summary>
-/// Generic and object-specific permission values.
-/// The xSpecific arrays are object-specific bitmasks.
-/// The xMask arrays are standard/generic bitmasks.
-/// The xMatch arrays are aggregated sets of permissions.
-/// </summary>
-struct perm_t { DWORD mask; const wchar_t * szName; };
+// Generic and object-specific permission values (perm_t, in PermDecoder.h).
+// The xSpecific arrays are object-specific bitmasks.
+// The xMask arrays are standard/generic bitmasks.
+// The xMatch arrays are aggregated sets of permissions.
 
 // --------------------------------------------------------------------------------
-static perm_t standardMask[] = {
+static constexpr perm_t standardMask[] = {
 	{ DELETE, L"DELETE" },
 	{ READ_CONTROL, L"READ_CONTROL" },
 	{ WRITE_DAC, L"WRITE_DAC" },
@@ -135,14 +138,14 @@ static perm_t standardMask[] = {
 	{ MAXIMUM_ALLOWED, L"MAXIMUM_ALLOWED" },
 	{ 0, nullptr } };
 
-static perm_t genericMask[] = {
+static constexpr perm_t genericMask[] = {
 	{ GENERIC_READ, L"GENERIC_READ" },
 	{ GENERIC_WRITE, L"GENERIC_WRITE" },
 	{ GENERIC_EXECUTE, L"GENERIC_EXECUTE" },
 	{ GENERIC_ALL, L"GENERIC_ALL" },
 	{ 0, nullptr } };
 
-static perm_t standardAndGenericMask[] = {
+static constexpr perm_t standardAndGenericMask[] = {
 	{ DELETE, L"DELETE" },
 	{ READ_CONTROL, L"READ_CONTROL" },
 	{ WRITE_DAC, L"WRITE_DAC" },
@@ -160,7 +163,7 @@ static perm_t standardAndGenericMask[] = {
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t fileSpecific[] = {
+static constexpr perm_t fileSpecific[] = {
 	{ FILE_READ_DATA, L"FILE_READ_DATA" },
 	{ FILE_WRITE_DATA, L"FILE_WRITE_DATA" },
 	{ FILE_APPEND_DATA, L"FILE_APPEND_DATA" },
@@ -171,7 +174,7 @@ static perm_t fileSpecific[] = {
 	{ FILE_WRITE_ATTRIBUTES, L"FILE_WRITE_ATTRIBUTES" },
 	{ 0, nullptr } };
 
-static perm_t dirSpecific[] = {
+static constexpr perm_t dirSpecific[] = {
 	{ FILE_LIST_DIRECTORY, L"FILE_LIST_DIRECTORY" },
 	{ FILE_ADD_FILE, L"FILE_ADD_FILE" },
 	{ FILE_ADD_SUBDIRECTORY, L"FILE_ADD_SUBDIRECTORY" },
@@ -183,7 +186,7 @@ static perm_t dirSpecific[] = {
 	{ FILE_WRITE_ATTRIBUTES, L"FILE_WRITE_ATTRIBUTES" },
 	{ 0, nullptr } };
 
-static perm_t pipeSpecific[] = {
+static constexpr perm_t pipeSpecific[] = {
 	{ FILE_READ_DATA, L"FILE_READ_DATA" },
 	{ FILE_WRITE_DATA, L"FILE_WRITE_DATA" },
 	{ FILE_CREATE_PIPE_INSTANCE, L"FILE_CREATE_PIPE_INSTANCE" },
@@ -191,7 +194,7 @@ static perm_t pipeSpecific[] = {
 	{ FILE_WRITE_ATTRIBUTES, L"FILE_WRITE_ATTRIBUTES" },
 	{ 0, nullptr } };
 
-static perm_t fileMatch[] = {
+static constexpr perm_t fileMatch[] = {
 	{ FILE_ALL_ACCESS, L"FILE_ALL_ACCESS" },
 	{ FILE_GENERIC_READ, L"FILE_GENERIC_READ" },
 	{ FILE_GENERIC_WRITE, L"FILE_GENERIC_WRITE" },
@@ -199,7 +202,7 @@ static perm_t fileMatch[] = {
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t keySpecific[] = {
+static constexpr perm_t keySpecific[] = {
 	{ KEY_QUERY_VALUE, L"KEY_QUERY_VALUE" },
 	{ KEY_SET_VALUE, L"KEY_SET_VALUE" },
 	{ KEY_CREATE_SUB_KEY, L"KEY_CREATE_SUB_KEY" },
@@ -210,7 +213,7 @@ static perm_t keySpecific[] = {
 	{ KEY_WOW64_64KEY, L"KEY_WOW64_64KEY" },
 	{ 0, nullptr } };
 
-static perm_t keyMatch[] = {
+static constexpr perm_t keyMatch[] = {
 	{ KEY_READ, L"KEY_READ" },
 	{ KEY_WRITE, L"KEY_WRITE" },
 	{ KEY_EXECUTE, L"KEY_EXECUTE" },
@@ -218,7 +221,7 @@ static perm_t keyMatch[] = {
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t serviceSpecific[] = {
+static constexpr perm_t serviceSpecific[] = {
 	{ SERVICE_QUERY_CONFIG, L"SERVICE_QUERY_CONFIG" },
 	{ SERVICE_CHANGE_CONFIG, L"SERVICE_CHANGE_CONFIG" },
 	{ SERVICE_QUERY_STATUS, L"SERVICE_QUERY_STATUS" },
@@ -230,12 +233,12 @@ static perm_t serviceSpecific[] = {
 	{ SERVICE_USER_DEFINED_CONTROL, L"SERVICE_USER_DEFINED_CONTROL" },
 	{ 0, nullptr } };
 
-static perm_t serviceMatch[] = {
+static constexpr perm_t serviceMatch[] = {
 	{ SERVICE_ALL_ACCESS, L"SERVICE_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t scmSpecific[] = {
+static constexpr perm_t scmSpecific[] = {
 	{ SC_MANAGER_CONNECT, L"SC_MANAGER_CONNECT" },
 	{ SC_MANAGER_CREATE_SERVICE, L"SC_MANAGER_CREATE_SERVICE" },
 	{ SC_MANAGER_ENUMERATE_SERVICE, L"SC_MANAGER_ENUMERATE_SERVICE" },
@@ -244,12 +247,12 @@ static perm_t scmSpecific[] = {
 	{ SC_MANAGER_MODIFY_BOOT_CONFIG, L"SC_MANAGER_MODIFY_BOOT_CONFIG" },
 	{ 0, nullptr } };
 
-static perm_t scmMatch[] = {
+static constexpr perm_t scmMatch[] = {
 	{ SC_MANAGER_ALL_ACCESS, L"SC_MANAGER_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t processSpecific[] = {
+static constexpr perm_t processSpecific[] = {
 	{ PROCESS_TERMINATE, L"PROCESS_TERMINATE" },
 	{ PROCESS_CREATE_THREAD, L"PROCESS_CREATE_THREAD" },
 	{ PROCESS_SET_SESSIONID, L"PROCESS_SET_SESSIONID" },
@@ -266,12 +269,12 @@ static perm_t processSpecific[] = {
 	{ PROCESS_SET_LIMITED_INFORMATION, L"PROCESS_SET_LIMITED_INFORMATION" },
 	{ 0, nullptr } };
 
-static perm_t processMatch[] = {
+static constexpr perm_t processMatch[] = {
 	{ PROCESS_ALL_ACCESS, L"PROCESS_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t threadSpecific[] = {
+static constexpr perm_t threadSpecific[] = {
 	{ THREAD_TERMINATE, L"THREAD_TERMINATE" },
 	{ THREAD_SUSPEND_RESUME, L"THREAD_SUSPEND_RESUME" },
 	{ THREAD_GET_CONTEXT, L"THREAD_GET_CONTEXT" },
@@ -286,7 +289,7 @@ static perm_t threadSpecific[] = {
 	{ THREAD_RESUME, L"THREAD_RESUME" },
 	{ 0, nullptr } };
 
-static perm_t threadMatch[] = {
+static constexpr perm_t threadMatch[] = {
 	{ THREAD_ALL_ACCESS, L"THREAD_ALL_ACCESS" },
 	{ 0, nullptr } };
 
@@ -295,18 +298,18 @@ static perm_t threadMatch[] = {
 #define SRVSVC_PAUSED_SHARE_CONNECT    0x0002  
 #define SRVSVC_SHARE_CONNECT_ALL_ACCESS ( STANDARD_RIGHTS_REQUIRED | SRVSVC_SHARE_CONNECT | SRVSVC_PAUSED_SHARE_CONNECT)
 
-static perm_t shareSpecific[] = {
+static constexpr perm_t shareSpecific[] = {
 	{ SRVSVC_SHARE_CONNECT, L"SRVSVC_SHARE_CONNECT" },
 	{ SRVSVC_PAUSED_SHARE_CONNECT, L"SRVSVC_PAUSED_SHARE_CONNECT" },
 	{ 0, nullptr } };
 
-static perm_t shareMatch[] = {
+static constexpr perm_t shareMatch[] = {
 	{ SRVSVC_SHARE_CONNECT_ALL_ACCESS, L"SRVSVC_SHARE_CONNECT_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
 
-static perm_t ComSpecific[] = {
+static constexpr perm_t ComSpecific[] = {
 	{ COM_RIGHTS_EXECUTE, L"COM_RIGHTS_EXECUTE" },
 	{ COM_RIGHTS_EXECUTE_LOCAL, L"COM_RIGHTS_EXECUTE_LOCAL" },
 	{ COM_RIGHTS_EXECUTE_REMOTE, L"COM_RIGHTS_EXECUTE_REMOTE" },
@@ -315,7 +318,7 @@ static perm_t ComSpecific[] = {
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t winstaSpecific[] = {
+static constexpr perm_t winstaSpecific[] = {
 	{ WINSTA_ENUMDESKTOPS, L"WINSTA_ENUMDESKTOPS" },
 	{ WINSTA_READATTRIBUTES, L"WINSTA_READATTRIBUTES" },
 	{ WINSTA_ACCESSCLIPBOARD, L"WINSTA_ACCESSCLIPBOARD" },
@@ -327,12 +330,12 @@ static perm_t winstaSpecific[] = {
 	{ WINSTA_READSCREEN, L"WINSTA_READSCREEN" },
 	{ 0, nullptr } };
 
-static perm_t winstaMatch[] = {
+static constexpr perm_t winstaMatch[] = {
 	{ WINSTA_ALL_ACCESS, L"WINSTA_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t desktopSpecific[] = {
+static constexpr perm_t desktopSpecific[] = {
 	{ DESKTOP_READOBJECTS, L"DESKTOP_READOBJECTS" },
 	{ DESKTOP_CREATEWINDOW, L"DESKTOP_CREATEWINDOW" },
 	{ DESKTOP_CREATEMENU, L"DESKTOP_CREATEMENU" },
@@ -344,11 +347,11 @@ static perm_t desktopSpecific[] = {
 	{ DESKTOP_SWITCHDESKTOP, L"DESKTOP_SWITCHDESKTOP" },
 	{ 0, nullptr } };
 
-static perm_t desktopMatch[] = {
+static constexpr perm_t desktopMatch[] = {
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
-static perm_t sectionSpecific[] = {
+static constexpr perm_t sectionSpecific[] = {
 	{ SECTION_QUERY, L"SECTION_QUERY" },
 	{ SECTION_MAP_WRITE, L"SECTION_MAP_WRITE" },
 	{ SECTION_MAP_READ, L"SECTION_MAP_READ" },
@@ -357,13 +360,13 @@ static perm_t sectionSpecific[] = {
 	{ SECTION_MAP_EXECUTE_EXPLICIT, L"SECTION_MAP_EXECUTE_EXPLICIT" },
 	{ 0, nullptr } };
 
-static perm_t sectionMatch[] = {
+static constexpr perm_t sectionMatch[] = {
 	{ SECTION_ALL_ACCESS, L"SECTION_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
 
-static perm_t filemapSpecific[] = {
+static constexpr perm_t filemapSpecific[] = {
 	{ FILE_MAP_WRITE, L"FILE_MAP_WRITE" },
 	{ FILE_MAP_READ, L"FILE_MAP_READ" },
 	{ FILE_MAP_EXECUTE, L"FILE_MAP_EXECUTE" },
@@ -373,25 +376,25 @@ static perm_t filemapSpecific[] = {
 	{ FILE_MAP_LARGE_PAGES, L"FILE_MAP_LARGE_PAGES" },
 	{ 0, nullptr } };
 
-static perm_t filemapMatch[] = {
+static constexpr perm_t filemapMatch[] = {
 	{ FILE_MAP_ALL_ACCESS, L"FILE_MAP_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
 
-static perm_t evtSpecific[] = {
+static constexpr perm_t evtSpecific[] = {
 	{ EVT_READ_ACCESS, L"EVT_READ_ACCESS" },
 	{ EVT_WRITE_ACCESS, L"EVT_WRITE_ACCESS" },
 	{ EVT_CLEAR_ACCESS, L"EVT_CLEAR_ACCESS" },
 	{ 0, nullptr } };
 
-static perm_t evtMatch[] = {
+static constexpr perm_t evtMatch[] = {
 	{ EVT_ALL_ACCESS, L"EVT_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
 
-static perm_t tokenSpecific[] = {
+static constexpr perm_t tokenSpecific[] = {
 	{ TOKEN_ASSIGN_PRIMARY, L"TOKEN_ASSIGN_PRIMARY" },
 	{ TOKEN_DUPLICATE, L"TOKEN_DUPLICATE" },
 	{ TOKEN_IMPERSONATE, L"TOKEN_IMPERSONATE" },
@@ -403,7 +406,7 @@ static perm_t tokenSpecific[] = {
 	{ TOKEN_ADJUST_SESSIONID, L"TOKEN_ADJUST_SESSIONID" },
 	{ 0, nullptr } };
 
-static perm_t tokenMatch[] = {
+static constexpr perm_t tokenMatch[] = {
 	{ TOKEN_ALL_ACCESS, L"TOKEN_ALL_ACCESS" },
 	{ TOKEN_READ, L"TOKEN_READ" },
 	{ TOKEN_WRITE, L"TOKEN_WRITE" },
@@ -424,178 +427,178 @@ static perm_t tokenMatch[] = {
 
 #define DIRECTORY_ALL_ACCESS (STANDARD_RIGHTS_REQUIRED | 0xF)
 
-static perm_t objMgrDirectorySpecific[] = {
+static constexpr perm_t objMgrDirectorySpecific[] = {
 	{ DIRECTORY_QUERY, L"DIRECTORY_QUERY" },
 	{ DIRECTORY_TRAVERSE, L"DIRECTORY_TRAVERSE" },
 	{ DIRECTORY_CREATE_OBJECT, L"DIRECTORY_CREATE_OBJECT" },
 	{ DIRECTORY_CREATE_SUBDIRECTORY, L"DIRECTORY_CREATE_SUBDIRECTORY" },
 	{ 0, nullptr } };
 
-static perm_t objMgrDirectoryMatch[] = {
+static constexpr perm_t objMgrDirectoryMatch[] = {
 	{ DIRECTORY_ALL_ACCESS, L"DIRECTORY_ALL_ACCESS" },
 	{ 0, nullptr } };
 
 // --------------------------------------------------------------------------------
 // The ADS_RIGHT_x values are defined as enums rather than as manifest constant #define values,
-// and implicit conversion to DWORD triggers some level-4 warnings that need to be disabled temporarily.
-// Examples of those warnings:
-//    Warning	C4838	conversion from '__MIDL___MIDL_itf_ads_0001_0048_0001' to 'DWORD' requires a narrowing conversion	SddlHelp	C:\Projects\Utils\SddlHelp\SecurityDescriptorUtils.cpp	339
-//    Warning	C4245	'initializing': conversion from '__MIDL___MIDL_itf_ads_0001_0048_0001' to 'DWORD', signed/unsigned mismatch	SddlHelp	C:\Projects\Utils\SddlHelp\SecurityDescriptorUtils.cpp	347
-#pragma warning(push)
-#pragma warning(disable: 4838)
-#pragma warning(disable: 4245)
-static perm_t NtdsSpecific[] = {
-	{ ADS_RIGHT_DS_CREATE_CHILD, L"ADS_RIGHT_DS_CREATE_CHILD" },
-	{ ADS_RIGHT_DS_DELETE_CHILD, L"ADS_RIGHT_DS_DELETE_CHILD" },
-	{ ADS_RIGHT_ACTRL_DS_LIST, L"ADS_RIGHT_ACTRL_DS_LIST" },
-	{ ADS_RIGHT_DS_SELF, L"ADS_RIGHT_DS_SELF" },
-	{ ADS_RIGHT_DS_READ_PROP, L"ADS_RIGHT_DS_READ_PROP" },
-	{ ADS_RIGHT_DS_WRITE_PROP, L"ADS_RIGHT_DS_WRITE_PROP" },
-	{ ADS_RIGHT_DS_DELETE_TREE, L"ADS_RIGHT_DS_DELETE_TREE" },
-	{ ADS_RIGHT_DS_LIST_OBJECT, L"ADS_RIGHT_DS_LIST_OBJECT" },
-	{ ADS_RIGHT_DS_CONTROL_ACCESS, L"ADS_RIGHT_DS_CONTROL_ACCESS" },
-	{ ADS_RIGHT_DELETE, L"ADS_RIGHT_DELETE" },
-	{ ADS_RIGHT_READ_CONTROL, L"ADS_RIGHT_READ_CONTROL" },
-	{ ADS_RIGHT_WRITE_DAC, L"ADS_RIGHT_WRITE_DAC" },
-	{ ADS_RIGHT_WRITE_OWNER, L"ADS_RIGHT_WRITE_OWNER" },
-	{ ADS_RIGHT_SYNCHRONIZE, L"ADS_RIGHT_SYNCHRONIZE" },
-	{ ADS_RIGHT_ACCESS_SYSTEM_SECURITY, L"ADS_RIGHT_ACCESS_SYSTEM_SECURITY" },
-	{ ADS_RIGHT_GENERIC_READ, L"ADS_RIGHT_GENERIC_READ" },
-	{ ADS_RIGHT_GENERIC_WRITE, L"ADS_RIGHT_GENERIC_WRITE" },
-	{ ADS_RIGHT_GENERIC_EXECUTE, L"ADS_RIGHT_GENERIC_EXECUTE" },
-	{ ADS_RIGHT_GENERIC_ALL, L"ADS_RIGHT_GENERIC_ALL" },
+// and some of them are negative ints. Implicit conversion to uint32_t is a narrowing conversion, which isn't
+// allowed in a constant expression, so they're converted explicitly.
+static constexpr perm_t NtdsSpecific[] = {
+	{ (uint32_t)ADS_RIGHT_DS_CREATE_CHILD, L"ADS_RIGHT_DS_CREATE_CHILD" },
+	{ (uint32_t)ADS_RIGHT_DS_DELETE_CHILD, L"ADS_RIGHT_DS_DELETE_CHILD" },
+	{ (uint32_t)ADS_RIGHT_ACTRL_DS_LIST, L"ADS_RIGHT_ACTRL_DS_LIST" },
+	{ (uint32_t)ADS_RIGHT_DS_SELF, L"ADS_RIGHT_DS_SELF" },
+	{ (uint32_t)ADS_RIGHT_DS_READ_PROP, L"ADS_RIGHT_DS_READ_PROP" },
+	{ (uint32_t)ADS_RIGHT_DS_WRITE_PROP, L"ADS_RIGHT_DS_WRITE_PROP" },
+	{ (uint32_t)ADS_RIGHT_DS_DELETE_TREE, L"ADS_RIGHT_DS_DELETE_TREE" },
+	{ (uint32_t)ADS_RIGHT_DS_LIST_OBJECT, L"ADS_RIGHT_DS_LIST_OBJECT" },
+	{ (uint32_t)ADS_RIGHT_DS_CONTROL_ACCESS, L"ADS_RIGHT_DS_CONTROL_ACCESS" },
+	{ (uint32_t)ADS_RIGHT_DELETE, L"ADS_RIGHT_DELETE" },
+	{ (uint32_t)ADS_RIGHT_READ_CONTROL, L"ADS_RIGHT_READ_CONTROL" },
+	{ (uint32_t)ADS_RIGHT_WRITE_DAC, L"ADS_RIGHT_WRITE_DAC" },
+	{ (uint32_t)ADS_RIGHT_WRITE_OWNER, L"ADS_RIGHT_WRITE_OWNER" },
+	{ (uint32_t)ADS_RIGHT_SYNCHRONIZE, L"ADS_RIGHT_SYNCHRONIZE" },
+	{ (uint32_t)ADS_RIGHT_ACCESS_SYSTEM_SECURITY, L"ADS_RIGHT_ACCESS_SYSTEM_SECURITY" },
+	{ (uint32_t)ADS_RIGHT_GENERIC_READ, L"ADS_RIGHT_GENERIC_READ" },
+	{ (uint32_t)ADS_RIGHT_GENERIC_WRITE, L"ADS_RIGHT_GENERIC_WRITE" },
+	{ (uint32_t)ADS_RIGHT_GENERIC_EXECUTE, L"ADS_RIGHT_GENERIC_EXECUTE" },
+	{ (uint32_t)ADS_RIGHT_GENERIC_ALL, L"ADS_RIGHT_GENERIC_ALL" },
 	{ 0, nullptr } };
-#pragma warning(pop)
 
 // --------------------------------------------------------------------------------
 
 /// <summary>
-/// Returns object-specific perm_t arrays of xSpecific and xMatch values for converting
-/// permission bits to corresponding text.
+/// Internal: decoding table for an object type, computed at compile time. OutputPermissions names the bits of an
+/// access mask by scanning genericMask, then the type's xSpecific array, then standardMask, removing each match's
+/// bits from the mask.
 /// </summary>
-/// <param name="szObjType">Input: object type from supported set of names</param>
-/// <param name="pPermsSpecific">Output: xSpecific array corresponding to object type, if found</param>
-/// <param name="pPermsMatch">Output: xMatch array corresponding to object type, if found</param>
-/// <returns>true if object type recognized, false otherwise</returns>
-static bool GetPermsForType(const wchar_t* szObjType, perm_t*& pPermsSpecific, perm_t*& pPermsMatch)
+static constexpr PermDecoder_t ObjTypeDecoder(const perm_t* pPermsSpecific, const perm_t* pPermsMatch)
 {
-	pPermsSpecific = pPermsMatch = nullptr;
+	return BuildPermDecoder(genericMask, pPermsSpecific, standardMask, pPermsMatch);
+}
 
-	if (0 == _wcsicmp(szObjType, L"file"))
-	{
-		pPermsSpecific = fileSpecific;
-		pPermsMatch = fileMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"dir"))
-	{
-		pPermsSpecific = dirSpecific;
-		pPermsMatch = fileMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"pipe"))
-	{
-		pPermsSpecific = pipeSpecific;
-		pPermsMatch = fileMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"key"))
-	{
-		pPermsSpecific = keySpecific;
-		pPermsMatch = keyMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"share"))
-	{
-		pPermsSpecific = shareSpecific;
-		pPermsMatch = shareMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"process"))
-	{
-		pPermsSpecific = processSpecific;
-		pPermsMatch = processMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"thread"))
-	{
-		pPermsSpecific = threadSpecific;
-		pPermsMatch = threadMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"service"))
-	{
-		pPermsSpecific = serviceSpecific;
-		pPermsMatch = serviceMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"scm"))
-	{
-		pPermsSpecific = scmSpecific;
-		pPermsMatch = scmMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"com"))
-	{
-		pPermsSpecific = ComSpecific;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"winsta"))
-	{
-		pPermsSpecific = winstaSpecific;
-		pPermsMatch = winstaMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"desktop"))
-	{
-		pPermsSpecific = desktopSpecific;
-		//pPermsMatch = desktopMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"section"))
-	{
-		pPermsSpecific = sectionSpecific;
-		pPermsMatch = sectionMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"filemap"))
-	{
-		pPermsSpecific = filemapSpecific;
-		pPermsMatch = filemapMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"evt"))
-	{
-		pPermsSpecific = evtSpecific;
-		pPermsMatch = evtMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"token"))
-	{
-		pPermsSpecific = tokenSpecific;
-		pPermsMatch = tokenMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"objdir"))
-	{
-		pPermsSpecific = objMgrDirectorySpecific;
-		pPermsMatch = objMgrDirectoryMatch;
-	}
-	else
-	if (0 == _wcsicmp(szObjType, L"ntds"))
+/// <summary>
+/// Object types that have permission names
+/// </summary>
+enum class ObjType_t { File, Dir, Pipe, Key, Share, Process, Thread, Service, Scm, Com, Winsta, Desktop, Section, Filemap, Evt, Token, ObjDir, Ntds, Standard, Unknown };
+
+struct ObjTypeInfo_t
+{
+	const wchar_t* szName;
+	PermDecoder_t decoder;
+};
+
+// In ObjType_t order
+static constexpr ObjTypeInfo_t objTypes[] = {
+	{ L"file", ObjTypeDecoder(fileSpecific, fileMatch) },
+	{ L"dir", ObjTypeDecoder(dirSpecific, fileMatch) },
+	{ L"pipe", ObjTypeDecoder(pipeSpecific, fileMatch) },
+	{ L"key", ObjTypeDecoder(keySpecific, keyMatch) },
+	{ L"share", ObjTypeDecoder(shareSpecific, shareMatch) },
+	{ L"process", ObjTypeDecoder(processSpecific, processMatch) },
+	{ L"thread", ObjTypeDecoder(threadSpecific, threadMatch) },
+	{ L"service", ObjTypeDecoder(serviceSpecific, serviceMatch) },
+	{ L"scm", ObjTypeDecoder(scmSpecific, scmMatch) },
+	{ L"com", ObjTypeDecoder(ComSpecific, nullptr) },
+	{ L"winsta", ObjTypeDecoder(winstaSpecific, winstaMatch) },
+	{ L"desktop", ObjTypeDecoder(desktopSpecific, nullptr /*desktopMatch*/) },
+	{ L"section", ObjTypeDecoder(sectionSpecific, sectionMatch) },
+	{ L"filemap", ObjTypeDecoder(filemapSpecific, filemapMatch) },
+	{ L"evt", ObjTypeDecoder(evtSpecific, evtMatch) },
+	{ L"token", ObjTypeDecoder(tokenSpecific, tokenMatch) },
+	{ L"objdir", ObjTypeDecoder(objMgrDirectorySpecific, objMgrDirectoryMatch) },
+	{ L"ntds", ObjTypeDecoder(NtdsSpecific, nullptr) },
+	{ L"standard", ObjTypeDecoder(standardAndGenericMask, nullptr) },
+};
+
+static const size_t ObjTypeCount = sizeof(objTypes) / sizeof(objTypes[0]);
+static_assert(ObjTypeCount == (size_t)ObjType_t::Unknown, "One objTypes entry per ObjType_t value");
+
+/// <summary>
+/// Internal: whether every object type's decoding table has only single-bit names
+/// </summary>
+static constexpr bool PermDecodersAreValid()
+{
+	for (size_t ix = 0; ix < ObjTypeCount; ++ix)
 	{
-		pPermsSpecific = NtdsSpecific;
+		if (!objTypes[ix].decoder.bSingleBitNames)
+			return false;
 	}
-	else
-	if (0 == _wcsicmp(szObjType, L"standard"))
+	return true;
+}
+
+static_assert(PermDecodersAreValid(), "A permission name that the scan can match covers more than one bit");
+
+// --------------------------------------------------------------------------------
+// Object type names to ObjType_t through a perfect hash, computed at compile time: a seed for which every name
+// hashes to its own slot.
+
+// A power of two, comfortably more than ObjTypeCount so that a seed is found quickly
+static const size_t ObjTypeSlotCount = 64;
+// Upper bound on the search for a seed; reaching it means the table has duplicate names.
+static const uint32_t MaxObjTypeSeed = 100000;
+
+static_assert(ObjTypeCount < ObjTypeSlotCount && ObjTypeSlotCount <= 256, "Slots hold objTypes indexes + 1 in a byte");
+
+struct ObjTypeHash_t
+{
+	uint32_t seed;
+	// objTypes index + 1 for each slot; 0 if the slot is empty
+	uint8_t slots[ObjTypeSlotCount];
+};
+
+/// <summary>
+/// Internal: case-insensitive hash of an object type name (FNV-1a over the lowercased characters)
+/// </summary>
+static constexpr uint32_t HashObjTypeName(uint32_t seed, const wchar_t* szName)
+{
+	uint32_t hash = 0x811C9DC5 ^ seed;
+	for (; 0 != *szName; ++szName)
 	{
-		pPermsSpecific = standardAndGenericMask;
+		wchar_t ch = (*szName >= L'A' && *szName <= L'Z') ? (wchar_t)(*szName - L'A' + L'a') : *szName;
+		hash = (uint32_t)((((uint64_t)(hash ^ (uint32_t)ch)) * 0x01000193) & 0xFFFFFFFF);
 	}
-	else
+	hash ^= hash >> 15;
+	return hash;
+}
+
+static constexpr ObjTypeHash_t BuildObjTypeHash()
+{
+	ObjTypeHash_t objTypeHash = {};
+	for (uint32_t seed = 1; seed <= MaxObjTypeSeed && 0 == objTypeHash.seed; ++seed)
 	{
-		return false;
+		uint8_t slots[ObjTypeSlotCount] = {};
+		bool bFits = true;
+		for (size_t ix = 0; bFits && ix < ObjTypeCount; ++ix)
+		{
+			size_t ixSlot = HashObjTypeName(seed, objTypes[ix].szName) % ObjTypeSlotCount;
+			bFits = (0 == slots[ixSlot]);
+			slots[ixSlot] = (uint8_t)(ix + 1);
+		}
+		if (bFits)
+		{
+			objTypeHash.seed = seed;
+			for (size_t ixSlot = 0; ixSlot < ObjTypeSlotCount; ++ixSlot)
+				objTypeHash.slots[ixSlot] = slots[ixSlot];
+		}
 	}
-	return true;
+	return objTypeHash;
+}
+
+static constexpr ObjTypeHash_t objTypeHash = BuildObjTypeHash();
+
+static_assert(0 != objTypeHash.seed, "Object type table has duplicate names");
+
+/// <summary>
+/// Returns the object type for a name from the supported set of names (case-insensitive), or ObjType_t::Unknown.
+/// </summary>
+static ObjType_t GetObjType(const wchar_t* szObjType)
+{
+	if (nullptr == szObjType)
+		return ObjType_t::Unknown;
+	size_t ixSlot = objTypeHash.slots[HashObjTypeName(objTypeHash.seed, szObjType) % ObjTypeSlotCount];
+	if (0 == ixSlot || 0 != _wcsicmp(szObjType, objTypes[ixSlot - 1].szName))
+		return ObjType_t::Unknown;
+	return (ObjType_t)(ixSlot - 1);
 }
 
 // --------------------------------------------------------------------------------
@@ -605,9 +608,10 @@ static bool GetPermsForType(const wchar_t* szObjType, perm_t*& pPermsSpecific, p
 /// <param name="sOut">stream to write results into</param>
 /// <param name="dwPermissions">Input: 32-bit flags representing the permissions to translate</param>
 /// <param name="szObjType">Input: name of the object type that the permissions are supposed to apply to</param>
+/// <param name="objType">Input: the object type named by szObjType</param>
 /// <param name="bOnePermPerLine">Input: whether to put all the permission names on one line or separate lines</param>
 /// <param name="sIndent">Input: base indent at which to start writing text</param>
-static void OutputPermissions(std::wostream& sOut, DWORD dwPermissions, const wchar_t *szObjType, bool bOnePermPerLine, const std::wstring& sIndent)
+static void OutputPermissions(std::wostream& sOut, DWORD dwPermissions, const wchar_t *szObjType, ObjType_t objType, bool bOnePermPerLine, const std::wstring& sIndent)
 {
 	// Set up whitespace for formatting, depending on whether perms all on one line or separate lines.
 	const wchar_t * szWhitespace = L"           ";
@@ -626,19 +630,19 @@ static void OutputPermissions(std::wostream& sOut, DWORD dwPermissions, const wc
 		sFinal = L"\n";
 	}
 
-	// Get the specified object type's object-specific arrays
-	perm_t * pPermsSpecific = nullptr, *pPermsMatch = nullptr;
-	if (!GetPermsForType(szObjType, pPermsSpecific, pPermsMatch))
+	// Get the specified object type's decoding table
+	if (ObjType_t::Unknown == objType)
 	{
 		sOut << szWhitespace << L"Unrecognized object type: " << szObjType << std::endl;
 		return;
 	}
+	const PermDecoder_t& decoder = objTypes[(size_t)objType].decoder;
 
 	// First look for an exact match in the object-specific pPermsMatch array (if there is one).
 	// If found, output it, and we're done.
-	if (pPermsMatch)
+	if (decoder.pPermsMatch)
 	{
-		for (perm_t * pPerm = pPermsMatch; pPerm->szName != nullptr; pPerm++)
+		for (const perm_t * pPerm = decoder.pPermsMatch; pPerm->szName != nullptr; pPerm++)
 		{
 			if (dwPermissions == pPerm->mask)
 			{
@@ -648,40 +652,16 @@ static void OutputPermissions(std::wostream& sOut, DWORD dwPermissions, const wc
 		}
 	}
 
-	// From this point on, look for bit mask matches and output corresponding text,
-	// removing that bit from the permissions and continuing the search.
-
-	// Next step is to look for bit matches in the generic permissions.
-	for (perm_t * pPerm = genericMask; pPerm->szName != nullptr; pPerm++)
+	// Then output the names of the bits that are present: generic permissions, object-specific permissions, and
+	// standard rights, in that order.
+	uint32_t nameBits = decoder.NameBits(dwPermissions);
+	for (size_t ixName = 0; 0 != nameBits; ++ixName, nameBits >>= 1)
 	{
-		if (BitPresent(pPerm->mask, dwPermissions))
-		{
-			sOut << sPrecedingWS << pPerm->szName << sFollowingWS;
-			dwPermissions -= pPerm->mask;
-		}
-	}
-	// Next, look for any matching object-specific permission bits
-	if (pPermsSpecific)
-	{
-		for (perm_t * pPerm = pPermsSpecific; pPerm->szName != nullptr; pPerm++)
-		{
-			if (BitPresent(pPerm->mask, dwPermissions))
-			{
-				sOut << sPrecedingWS << pPerm->szName << sFollowingWS;
-				dwPermissions -= pPerm->mask;
-			}
-		}
-	}
-	// Next, look for any matching standard rights
-	for (perm_t * pPerm = standardMask; pPerm->szName != nullptr; pPerm++)
-	{
-		if (BitPresent(pPerm->mask, dwPermissions))
-		{
-			sOut << sPrecedingWS << pPerm->szName << sFollowingWS;
-			dwPermissions -= pPerm->mask;
-		}
+		if (0 != (nameBits & 1))
+			sOut << sPrecedingWS << decoder.szNames[ixName] << sFollowingWS;
 	}
 	// If any bits haven't been matched, output them in hex.
+	dwPermissions &= ~decoder.namedBits;
 	if (dwPermissions != 0)
 	{
 		sOut << sPrecedingWS << HEX(dwPermissions) << sFollowingWS;
@@ -689,60 +669,6 @@ static void OutputPermissions(std::wostream& sOut, DWORD dwPermissions, const wc
 	sOut << sFinal;
 }
 
-// --------------------------------------------------------------------------------
-/// <summary>
-/// Returns the address of the SID in an ACE_HEADER (which depends on the ACE type)
-/// Returns nullptr if header contains unexpected data.
-/// </summary>
-static PSID GetAddressOfSidInHeader(const ACE_HEADER* pAceHeader)
-{
-	switch (pAceHeader->AceType)
-	{
-		// All of these are ACE_HEADER, ACCESS_MASK, DWORD SidStart:
-	case ACCESS_ALLOWED_ACE_TYPE:
-	case ACCESS_DENIED_ACE_TYPE:
-	case SYSTEM_AUDIT_ACE_TYPE:
-	case SYSTEM_ALARM_ACE_TYPE:
-	case ACCESS_ALLOWED_CALLBACK_ACE_TYPE:
-	case ACCESS_DENIED_CALLBACK_ACE_TYPE:
-	case SYSTEM_AUDIT_CALLBACK_ACE_TYPE:
-	case SYSTEM_ALARM_CALLBACK_ACE_TYPE:
-	case SYSTEM_MANDATORY_LABEL_ACE_TYPE:
-	{
-		const ACCESS_ALLOWED_ACE* pACE = (const ACCESS_ALLOWED_ACE*)pAceHeader;
-		return (PSID)(&pACE->SidStart);
-	}
-
-	// All of these are ACE_HEADER, ACCESS_MASK, DWORD, GUID, GUID, DWORD SidStart:
-	case ACCESS_ALLOWED_OBJECT_ACE_TYPE:
-	case ACCESS_DENIED_OBJECT_ACE_TYPE:
-	case SYSTEM_AUDIT_OBJECT_ACE_TYPE:
-	case SYSTEM_ALARM_OBJECT_ACE_TYPE:
-	case ACCESS_ALLOWED_CALLBACK_OBJECT_ACE_TYPE:
-	case ACCESS_DENIED_CALLBACK_OBJECT_ACE_TYPE:
-	case SYSTEM_AUDIT_CALLBACK_OBJECT_ACE_TYPE:
-	case SYSTEM_ALARM_CALLBACK_OBJECT_ACE_TYPE:
-	{
-		const ACCESS_ALLOWED_OBJECT_ACE* pACE = (const ACCESS_ALLOWED_OBJECT_ACE*)pAceHeader;
-		switch (pACE->Flags)
-		{
-		case 0:
-			return (PSID)(&pACE->ObjectType);
-		case ACE_OBJECT_TYPE_PRESENT:
-		case ACE_INHERITED_OBJECT_TYPE_PRESENT:
-			return (PSID)(&pACE->InheritedObjectType);
-		case ACE_OBJECT_TYPE_PRESENT | ACE_INHERITED_OBJECT_TYPE_PRESENT:
-			return (PSID)(&pACE->SidStart);
-		default:
-			return nullptr;
-		}
-	}
-
-	default:
-		return nullptr;
-	}
-}
-
 // --------------------------------------------------------------------------------
 
 /// <summary>
@@ -767,34 +693,21 @@ static std::wstring SidToText(PSID psid)
 /// </summary>
 /// <param name="sOut">stream to write results into</param>
 /// <param name="bDacl">Input: true for a DACL, false for a SACL</param>
-/// <param name="pSD">Input: security descriptor to convert to textual representation</param>
+/// <param name="acl">Input: view of the DACL or SACL to convert to textual representation</param>
 /// <param name="szObjType">Input: name of the object type that the SD applies to</param>
+/// <param name="objType">Input: the object type named by szObjType</param>
 /// <param name="bOnePermPerLine">Input: whether to put all the permission names on one line or separate lines</param>
 /// <param name="sIndent">Input: base indent at which to start writing text</param>
-static void OutputAcl(std::wostream& sOut, bool bDacl, const PSECURITY_DESCRIPTOR pSD, const wchar_t* szObjType, bool bOnePermPerLine, const std::wstring& sIndent)
+static void OutputAcl(std::wostream& sOut, bool bDacl, const AclView& acl, const wchar_t* szObjType, ObjType_t objType, bool bOnePermPerLine, const std::wstring& sIndent)
 {
-	PACL pAcl = nullptr;
-	BOOL bPresent = FALSE, bDefaulted = FALSE;
 	const wchar_t* szAcl = (bDacl ? L"DACL" : L"SACL");
 
-	// Get the DACL or the SACL from the SD
-	BOOL ret = bDacl ?
-		GetSecurityDescriptorDacl(pSD, &bPresent, &pAcl, &bDefaulted) :
-		GetSecurityDescriptorSacl(pSD, &bPresent, &pAcl, &bDefaulted);
-
-	if (!ret)
-	{
-		DWORD dwLastErr = GetLastError();
-		sOut << (bDacl ? L"GetSecurityDescriptorDacl" : L"GetSecurityDescriptorSacl") << L" failed:  " << SysErrorMessage(dwLastErr) << std::endl;
-		return;
-	}
-
 	// If DACL/SACL not present, output nothing.
-	if (!bPresent)
+	if (!acl.IsPresent())
 		return;
 
 	// If ACL is present and is NULL, report that.
-	if (nullptr == pAcl)
+	if (acl.IsNull())
 	{
 		sOut 
 			<< sIndent
@@ -804,25 +717,16 @@ static void OutputAcl(std::wostream& sOut, bool bDacl, const PSECURITY_DESCRIPTO
 	}
 
 	// If the ACL is not null but not valid, report that.
-	if (!IsValidAcl(pAcl))
+	if (!acl.IsValid())
 	{
 		sOut << sIndent << L"Invalid " << szAcl << std::endl;
 		return;
 	}
 
-	ACL_SIZE_INFORMATION aclSizeInfo = { 0 };
-	if (!GetAclInformation(pAcl, &aclSizeInfo, sizeof(aclSizeInfo), AclSizeInformation))
-	{
-		// This would be an unusual error at this point, but always check.
-		DWORD dwLastErr = GetLastError();
-		sOut << L"GetAclInformation error:  " << SysErrorMessage(dwLastErr) << std::endl;
-		return;
-	}
-
 	sOut << sIndent;
-	sOut << L"ACEs in " << szAcl << L":  " << aclSizeInfo.AceCount << std::endl;
+	sOut << L"ACEs in " << szAcl << L":  " << acl.AceCount() << std::endl;
 	// Check for empty DACL/SACL
-	if (0 == aclSizeInfo.AceCount)
+	if (0 == acl.AceCount())
 	{
 		sOut
 			<< sIndent
@@ -832,59 +736,117 @@ static void OutputAcl(std::wostream& sOut, bool bDacl, const PSECURITY_DESCRIPTO
 	}
 
 	// Iterate through ACEs.
-	for (DWORD ix = 0; ix < aclSizeInfo.AceCount; ++ix)
+	DWORD ix = 0;
+	for (AclView::const_iterator aceIter = acl.begin(); aceIter != acl.end(); ++aceIter, ++ix)
 	{
-		// Define a union with structures with a lot of common definitions.
-		union {
-			ACE_HEADER header;
-			ACCESS_ALLOWED_ACE allowed;
-			ACCESS_DENIED_ACE denied;
-			ACCESS_ALLOWED_OBJECT_ACE allowedObject;
-			ACCESS_DENIED_OBJECT_ACE deniedObject;
-		} *pACE = nullptr;
-		if (!GetAce(pAcl, ix, (void**)&pACE))
-		{
-			DWORD dwLastErr = GetLastError();
-			sOut << L"GetAce (" << ix << L") error: " << SysErrorMessage(dwLastErr) << std::endl;
-		}
+		sOut << sIndent << L"ACE " << ix << L"." << std::endl
+			<< sIndent << L"    ";
+		// Output ACE type
+		const wchar_t* szAceType = AceType(aceIter->Type());
+		if (szAceType)
+			sOut << szAceType;
+		else
+			sOut << L"[Unknown ACE type: " << HEX(aceIter->Type()) << L"]";
+		sOut << std::endl;
+
+		// Output the SID in the ACE
+		sOut << sIndent << L"    SID:   " << SidToText((PSID)aceIter->Sid()) << std::endl;
+
+		// Output ACE flags
+		DWORD flags = aceIter->Flags();
+		sOut << sIndent
+			<< L"    Flags: ";
+		if (0 == flags)
+			sOut << L"None";
 		else
 		{
-			sOut << sIndent << L"ACE " << ix << L"." << std::endl
-				<< sIndent << L"    ";
-			// Output ACE type
-			const wchar_t* szAceType = AceType(pACE->header.AceType);
-			if (szAceType)
-				sOut << szAceType;
-			else
-				sOut << L"[Unknown ACE type: " << HEX(pACE->header.AceType) << L"]";
-			sOut << std::endl;
-
-			// Find the SID in the ACE and output it
-			sOut << sIndent << L"    SID:   " << SidToText(GetAddressOfSidInHeader(&pACE->header)) << std::endl;
+			sOut << L"[" << HEX(flags) << L"] ";
+			OutputFlagsOnOneLine(sOut, aceFlags, flags);
+		}
+		sOut << std::endl;
 
-			// Output ACE flags
-			DWORD flags = pACE->header.AceFlags;
-			sOut << sIndent
-				<< L"    Flags: ";
-			if (0 == flags)
-				sOut << L"None";
-			else
-			{
-				sOut << L"[" << HEX(flags) << L"] ";
-				OutputFlagsOnOneLine(sOut, aceFlags, flags);
-			}
+		// Output permissions
+		DWORD dwMask = aceIter->Mask();
+		sOut << sIndent
+			<< L"    Perms: [" << HEX(dwMask) << L"] ";
+		if (bOnePermPerLine)
 			sOut << std::endl;
+		if (szObjType)
+			OutputPermissions(sOut, dwMask, szObjType, objType, bOnePermPerLine, sIndent);
+	}
+}
 
-			// Output permissions
-			sOut << sIndent
-				<< L"    Perms: [" << HEX(pACE->allowed.Mask) << L"] ";
-			if (bOnePermPerLine)
-				sOut << std::endl;
-			if (szObjType)
-				OutputPermissions(sOut, pACE->allowed.Mask, szObjType, bOnePermPerLine, sIndent);
+// --------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal helper: copy a SID into a byte vector; leaves it empty if the SID isn't valid.
+/// </summary>
+static void CopySidBytes(PSID pSid, std::vector<uint8_t>& sid)
+{
+	sid.clear();
+	if (nullptr != pSid && IsValidSid(pSid))
+	{
+		const uint8_t* pBytes = (const uint8_t*)pSid;
+		sid.assign(pBytes, pBytes + GetLengthSid(pSid));
+	}
+}
 
+/// <summary>
+/// Internal helper: get the domain SIDs that SDDL's domain-relative aliases (LA, DA, EA, ...) refer to on this
+/// system: the account domain, and the primary domain if the computer is joined to one. The primary domain is
+/// also the forest root domain if it has the forest's name; otherwise the root domain isn't known, and SDDL that
+/// uses its aliases goes through the Win32 conversion.
+/// </summary>
+static Sddl::Domains_t GetLocalSddlDomains()
+{
+	Sddl::Domains_t domains;
+	MachineSid machineSid;
+	CopySidBytes(machineSid.Get(), domains.accountDomain);
+
+	LSA_OBJECT_ATTRIBUTES objectAttributes = { 0 };
+	LSA_HANDLE hPolicy = NULL;
+	NTSTATUS status = LsaOpenPolicy(NULL, &objectAttributes, POLICY_VIEW_LOCAL_INFORMATION, &hPolicy);
+	if (0 == status) //if (STATUS_SUCCESS == status)
+	{
+		PVOID pData = NULL;
+		status = LsaQueryInformationPolicy(hPolicy, PolicyDnsDomainInformation, &pData);
+		if (0 == status && NULL != pData) //if (STATUS_SUCCESS == status)
+		{
+			POLICY_DNS_DOMAIN_INFO* pInfo = (POLICY_DNS_DOMAIN_INFO*)pData;
+			// Not joined to a domain if there's no domain SID
+			CopySidBytes(pInfo->Sid, domains.primaryDomain);
+			std::wstring sDnsDomainName(pInfo->DnsDomainName.Buffer, pInfo->DnsDomainName.Length / sizeof(wchar_t));
+			std::wstring sDnsForestName(pInfo->DnsForestName.Buffer, pInfo->DnsForestName.Length / sizeof(wchar_t));
+			if (!domains.primaryDomain.empty() && !sDnsDomainName.empty() && 0 == _wcsicmp(sDnsDomainName.c_str(), sDnsForestName.c_str()))
+				domains.rootDomain = domains.primaryDomain;
+			LsaFreeMemory(pData);
 		}
+		LsaClose(hPolicy);
 	}
+	return domains;
+}
+
+/// <summary>
+/// Internal helper: this system's domain SIDs for SDDL parsing and formatting, looked up on first use.
+/// </summary>
+static const Sddl::Domains_t& LocalSddlDomains()
+{
+	static const Sddl::Domains_t domains = GetLocalSddlDomains();
+	return domains;
+}
+
+// --------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal helper: convert a security descriptor to SDDL without the Win32 conversion. Fails for absolute
+/// security descriptors and anything else the native formatter doesn't handle, so that the caller can fall back.
+/// </summary>
+static bool NativeSecDescriptorToSDDL(const PSECURITY_DESCRIPTOR pSD, SECURITY_INFORMATION si, std::wstring& sSDDL)
+{
+	std::wstring sErrorInfo;
+	return
+		nullptr != pSD &&
+		Sddl::Format((const uint8_t*)pSD, GetSecurityDescriptorLength(pSD), si, &LocalSddlDomains(), sSDDL, sErrorInfo);
 }
 
 // --------------------------------------------------------------------------------
@@ -919,6 +881,13 @@ void OutputSecurityDescriptor(std::wostream& sOut, PSECURITY_DESCRIPTOR pSD, con
 			DACL_SECURITY_INFORMATION |
 			SACL_SECURITY_INFORMATION |
 			LABEL_SECURITY_INFORMATION;
+		// Format natively if possible; fall back to the Win32 conversion otherwise.
+		std::wstring sSDDL;
+		if (NativeSecDescriptorToSDDL(pSD, si, sSDDL))
+		{
+			sOut << sSDDL << std::endl;
+			return;
+		}
 		BOOL ret = ConvertSecurityDescriptorToStringSecurityDescriptorW(pSD, SDDL_REVISION_1, si, &pszSDDL, &sddlLen);
 		if (ret)
 		{
@@ -935,7 +904,7 @@ void OutputSecurityDescriptor(std::wostream& sOut, PSECURITY_DESCRIPTOR pSD, con
 
 	// Otherwise, output as detailed, "human-readable" security descriptor with object-specific permission names.
 	// Start with the control flags
-	SECURITY_DESCRIPTOR_CONTROL sdc;
+	SECURITY_DESCRIPTOR_CONTROL sdc = 0;
 	DWORD dwRevision;
 	if (GetSecurityDescriptorControl(pSD, &sdc, &dwRevision))
 	{
@@ -945,43 +914,41 @@ void OutputSecurityDescriptor(std::wostream& sOut, PSECURITY_DESCRIPTOR pSD, con
 		sOut << L")" << std::endl;
 	}
 
-	// Then the owner
-	PSID psid = nullptr;
-	BOOL bDefaulted;
-	if (GetSecurityDescriptorOwner(pSD, &psid, &bDefaulted))
+	// Read everything else through a view of the self-relative form; convert absolute security descriptors first.
+	std::vector<uint8_t> selfRelativeSD;
+	const uint8_t* pSDBytes = (const uint8_t*)pSD;
+	DWORD cbSD = GetSecurityDescriptorLength(pSD);
+	if (0 == (sdc & SE_SELF_RELATIVE))
 	{
-		if (nullptr != psid)
+		selfRelativeSD.resize(cbSD);
+		if (!MakeSelfRelativeSD(pSD, selfRelativeSD.data(), &cbSD))
 		{
-			sOut << sIndent;
-			sOut << L"Owner:    " << SidToText(psid) << std::endl;
+			DWORD dwLastErr = GetLastError();
+			sOut << L"MakeSelfRelativeSD failed:  " << SysErrorMessageWithCode(dwLastErr) << std::endl;
+			return;
 		}
+		pSDBytes = selfRelativeSD.data();
 	}
-	else
+	SecurityDescriptorView sdView(pSDBytes, cbSD);
+
+	// Then the owner
+	if (nullptr != sdView.Owner())
 	{
-		DWORD dwLastErr = GetLastError();
-		sOut << L"GetSecurityDescriptorOwner failed:  " << SysErrorMessageWithCode(dwLastErr) << std::endl;
+		sOut << sIndent;
+		sOut << L"Owner:    " << SidToText((PSID)sdView.Owner()) << std::endl;
 	}
 
 	// Then the primary group
-	psid = nullptr;
-	if (GetSecurityDescriptorGroup(pSD, &psid, &bDefaulted))
+	if (nullptr != sdView.Group())
 	{
-		if (nullptr != psid)
-		{
-			sOut << sIndent;
-			sOut << L"Group:    " << SidToText(psid) << std::endl;
-		}
-	}
-	else
-	{
-		DWORD dwLastErr = GetLastError();
-		sOut << L"GetSecurityDescriptorGroup failed:  " << SysErrorMessageWithCode(dwLastErr) << std::endl;
+		sOut << sIndent;
+		sOut << L"Group:    " << SidToText((PSID)sdView.Group()) << std::endl;
 	}
 
-	// Then the DACL
-	OutputAcl(sOut, true, pSD, szObjType, bOnePermPerLine, sIndent);
-	// And the SACL
-	OutputAcl(sOut, false, pSD, szObjType, bOnePermPerLine, sIndent);
+	// Then the DACL and the SACL, resolving the object type's permission names once for all their ACEs
+	const ObjType_t objType = GetObjType(szObjType);
+	OutputAcl(sOut, true, sdView.Dacl(), szObjType, objType, bOnePermPerLine, sIndent);
+	OutputAcl(sOut, false, sdView.Sacl(), szObjType, objType, bOnePermPerLine, sIndent);
 }
 
 // --------------------------------------------------------------------------------
@@ -996,7 +963,19 @@ void OutputSecurityDescriptor(std::wostream& sOut, PSECURITY_DESCRIPTOR pSD, con
 /// <param name="szIndent">Input: base indent at which to start writing text</param>
 void OutputSecurityDescriptor(std::wostream& sOut, const wchar_t* szSDDL, const wchar_t* szObjType, bool bOnePermPerLine, size_t indent)
 {
-	// Convert the SDDL to a security descriptor, and pass it to the implementation that takes a binary security descriptor
+	// Convert the SDDL to a security descriptor, and pass it to the implementation that takes a binary security descriptor.
+	// Parse natively if possible; fall back to the Win32 conversion for SDDL that the native parser doesn't accept.
+	SecDescModel::SecurityDescriptor_t sd;
+	std::vector<uint8_t> binarySD;
+	std::wstring sErrorInfo;
+	if (nullptr != szSDDL &&
+		Sddl::Parse(szSDDL, wcslen(szSDDL), &LocalSddlDomains(), sd, sErrorInfo) &&
+		SecDescModel::ToSelfRelative(sd, binarySD, sErrorInfo))
+	{
+		OutputSecurityDescriptor(sOut, (PSECURITY_DESCRIPTOR)binarySD.data(), szObjType, bOnePermPerLine, indent);
+		return;
+	}
+
 	PSECURITY_DESCRIPTOR pSD = nullptr;
 	BOOL ret = ConvertStringSecurityDescriptorToSecurityDescriptorW(szSDDL, SDDL_REVISION_1, &pSD, nullptr);
 	if (ret)
@@ -1029,6 +1008,10 @@ bool SecDescriptorToSDDL(const PSECURITY_DESCRIPTOR pSD, SECURITY_INFORMATION si
 	sSDDL.clear();
 	sErrorInfo.clear();
 
+	// Format natively if possible; fall back to the Win32 conversion otherwise.
+	if (NativeSecDescriptorToSDDL(pSD, si, sSDDL))
+		return true;
+
 	wchar_t* pszSddl = nullptr;
 	if (ConvertSecurityDescriptorToStringSecurityDescriptorW(pSD, SDDL_REVISION_1, si, &pszSddl, nullptr))
 	{
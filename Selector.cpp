@@ -0,0 +1,112 @@
+// Selector.cpp: glob-pattern selectors that restrict which sessions, window stations, and desktops
+// get collected.
+
+#include "Selector.h"
+#include <cwctype>
+
+/// <summary>
+/// Case-insensitive glob match: '*' matches any run of characters (including none), '?' matches any one character.
+/// </summary>
+bool GlobMatch(const std::wstring& sPattern, const std::wstring& sText)
+{
+	// Greedy match with backtracking to the most recent '*' only, which is sufficient for glob
+	// patterns and keeps the match O(pattern x text) in the worst case without recursion.
+	size_t ixPattern = 0, ixText = 0;
+	size_t ixStar = std::wstring::npos, ixStarText = 0;
+	while (ixText < sText.size())
+	{
+		if (ixPattern < sPattern.size() && L'*' == sPattern[ixPattern])
+		{
+			ixStar = ixPattern++;
+			ixStarText = ixText;
+		}
+		else if (ixPattern < sPattern.size() &&
+			(L'?' == sPattern[ixPattern] || std::towlower(sPattern[ixPattern]) == std::towlower(sText[ixText])))
+		{
+			++ixPattern;
+			++ixText;
+		}
+		else if (std::wstring::npos != ixStar)
+		{
+			// Let the last '*' absorb one more character and retry from there.
+			ixPattern = ixStar + 1;
+			ixText = ++ixStarText;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	// Any remaining pattern must be all '*'.
+	while (ixPattern < sPattern.size() && L'*' == sPattern[ixPattern])
+		++ixPattern;
+	return ixPattern == sPattern.size();
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Add one or more comma-separated patterns. Empty patterns are ignored, but there must be at least one.
+/// </summary>
+bool Selector::Add(const std::wstring& sPatterns, std::wstring& sErrorInfo)
+{
+	const size_t nPatterns = m_patterns.size();
+	size_t ixStart = 0;
+	while (ixStart <= sPatterns.size())
+	{
+		size_t ixComma = sPatterns.find(L',', ixStart);
+		if (std::wstring::npos == ixComma)
+			ixComma = sPatterns.size();
+		if (ixComma > ixStart)
+			m_patterns.push_back(sPatterns.substr(ixStart, ixComma - ixStart));
+		ixStart = ixComma + 1;
+	}
+	if (nPatterns == m_patterns.size())
+	{
+		sErrorInfo = L"No patterns in \"" + sPatterns + L"\"";
+		return false;
+	}
+	sErrorInfo.clear();
+	return true;
+}
+
+/// <summary>
+/// true if the selector is empty or if any of its patterns matches the text
+/// </summary>
+bool Selector::Matches(const std::wstring& sText) const
+{
+	if (m_patterns.empty())
+		return true;
+	std::vector<std::wstring>::const_iterator patternIter;
+	for (patternIter = m_patterns.begin(); patternIter != m_patterns.end(); patternIter++)
+	{
+		if (GlobMatch(*patternIter, sText))
+			return true;
+	}
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------
+
+bool SelectionOptions_t::IsEmpty() const
+{
+	return sessions.IsEmpty() && users.IsEmpty() && states.IsEmpty() && windowStations.IsEmpty() && desktops.IsEmpty();
+}
+
+/// <summary>
+/// true if a session with these attributes is selected
+/// </summary>
+bool SelectionOptions_t::MatchesSession(uint32_t dwSessionId, const std::wstring& sName, const std::wstring& sDomainName, const std::wstring& sUserName, const std::wstring& sState) const
+{
+	if (!sessions.IsEmpty() && !sessions.Matches(std::to_wstring(dwSessionId)) && !sessions.Matches(sName))
+		return false;
+	if (!users.IsEmpty())
+	{
+		bool bUserMatch = users.Matches(sUserName);
+		if (!bUserMatch && !sDomainName.empty())
+			bUserMatch = users.Matches(sDomainName + L"\\" + sUserName);
+		if (!bUserMatch)
+			return false;
+	}
+	return states.Matches(sState);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+// Selector.h: glob-pattern selectors that restrict which sessions, window stations, and desktops
+// get collected. Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Case-insensitive glob match: '*' matches any run of characters (including none), '?' matches any one character.
+/// </summary>
+/// <param name="sPattern">Input: glob pattern</param>
+/// <param name="sText">Input: text to match against the whole pattern</param>
+/// <returns>true if the entire text matches the pattern</returns>
+bool GlobMatch(const std::wstring& sPattern, const std::wstring& sText);
+
+/// <summary>
+/// A set of alternative glob patterns. An empty selector matches everything.
+/// </summary>
+class Selector
+{
+public:
+	Selector() = default;
+	~Selector() = default;
+
+	/// <summary>
+	/// Add one or more comma-separated patterns. Empty patterns are ignored, but there must be at least one:
+	/// a selector given no patterns would select everything.
+	/// </summary>
+	/// <param name="sPatterns">Input: comma-separated glob patterns</param>
+	/// <param name="sErrorInfo">Output: error information if sPatterns holds no patterns</param>
+	/// <returns>true if successful, false otherwise</returns>
+	bool Add(const std::wstring& sPatterns, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// true if no patterns have been added
+	/// </summary>
+	bool IsEmpty() const { return m_patterns.empty(); }
+
+	/// <summary>
+	/// true if the selector is empty or if any of its patterns matches the text
+	/// </summary>
+	bool Matches(const std::wstring& sText) const;
+
+private:
+	std::vector<std::wstring> m_patterns;
+};
+
+/// <summary>
+/// Selectors from the command line. Objects not selected are skipped before any further queries are made on them.
+/// </summary>
+struct SelectionOptions_t
+{
+	// Session ID or session name (e.g., "1", "Console", "RDP-Tcp#*")
+	Selector sessions;
+	// Session user as DOMAIN\user or user
+	Selector users;
+	// Session connect state (e.g., "Active", "Disconnected")
+	Selector states;
+	// Window station name
+	Selector windowStations;
+	// Desktop name
+	Selector desktops;
+
+	/// <summary>
+	/// true if no selectors are set
+	/// </summary>
+	bool IsEmpty() const;
+
+	/// <summary>
+	/// true if a session with these attributes is selected
+	/// </summary>
+	bool MatchesSession(uint32_t dwSessionId, const std::wstring& sName, const std::wstring& sDomainName, const std::wstring& sUserName, const std::wstring& sState) const;
+
+	/// <summary>
+	/// true if the named window station is selected
+	/// </summary>
+	bool MatchesWindowStation(const std::wstring& sName) const { return windowStations.Matches(sName); }
+
+	/// <summary>
+	/// true if the named desktop is selected
+	/// </summary>
+	bool MatchesDesktop(const std::wstring& sName) const { return desktops.Matches(sName); }
+};
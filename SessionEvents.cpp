@@ -0,0 +1,109 @@
+// SessionEvents.cpp: session-change event queue and dispatcher.
+
+#include "SessionEvents.h"
+#include <chrono>
+#include <unordered_map>
+#include <utility>
+
+/// <summary>
+/// Add an event to the queue. Ignored after Stop.
+/// </summary>
+void SessionEventQueue::Post(const SessionEvent_t& event)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStopped)
+			return;
+		m_events.push_back(event);
+	}
+	m_cv.notify_one();
+}
+
+/// <summary>
+/// Wake the waiting thread and make all subsequent waits return false.
+/// </summary>
+void SessionEventQueue::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStopped = true;
+	}
+	m_cv.notify_all();
+}
+
+/// <summary>
+/// Wait until at least one event is queued, the timeout elapses, or the queue is stopped.
+/// </summary>
+bool SessionEventQueue::Wait(uint32_t timeoutMs, std::vector<SessionEvent_t>& events)
+{
+	events.clear();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return m_bStopped || !m_events.empty(); });
+	if (m_bStopped)
+		return false;
+	events.assign(m_events.begin(), m_events.end());
+	m_events.clear();
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+SessionEventDispatcher::SessionEventDispatcher(ISessionRefreshTarget& target)
+	: m_target(target)
+{
+}
+
+/// <summary>
+/// Handle a batch of events with one call on the target. Each affected session is refreshed or removed once,
+/// in order of its first event in the batch; the session's last event decides which (Terminate means remove).
+/// </summary>
+void SessionEventDispatcher::Dispatch(const std::vector<SessionEvent_t>& events)
+{
+	// Sessions in order of first appearance, and each one's index in that order
+	SessionUpdateList_t updates;
+	std::unordered_map<uint32_t, size_t> updateIndex;
+	std::vector<SessionEvent_t>::const_iterator iter;
+	for (iter = events.begin(); iter != events.end(); ++iter)
+	{
+		std::unordered_map<uint32_t, size_t>::const_iterator indexIter = updateIndex.find(iter->dwSessionId);
+		if (indexIter == updateIndex.end())
+		{
+			indexIter = updateIndex.insert(std::make_pair(iter->dwSessionId, updates.size())).first;
+			updates.push_back(SessionUpdate_t());
+			updates.back().dwSessionId = iter->dwSessionId;
+		}
+		updates[indexIter->second].bRemove = (SessionEventType_t::Terminate == iter->type);
+	}
+
+	if (!updates.empty())
+		m_target.UpdateSessions(updates);
+}
+
+/// <summary>
+/// Dispatch events from the queue until it is stopped, and call FullResync whenever
+/// resyncIntervalMs elapses.
+/// </summary>
+void SessionEventDispatcher::Run(SessionEventQueue& queue, uint32_t resyncIntervalMs)
+{
+	typedef std::chrono::steady_clock steadyClock_t;
+	const steadyClock_t::duration resyncInterval = std::chrono::milliseconds(resyncIntervalMs);
+	steadyClock_t::time_point nextResync = steadyClock_t::now() + resyncInterval;
+
+	std::vector<SessionEvent_t> events;
+	for (;;)
+	{
+		steadyClock_t::time_point now = steadyClock_t::now();
+		if (now >= nextResync)
+		{
+			m_target.FullResync();
+			nextResync = steadyClock_t::now() + resyncInterval;
+			continue;
+		}
+
+		uint32_t timeoutMs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(nextResync - now).count();
+		if (!queue.Wait(timeoutMs, events))
+			return;
+		if (!events.empty())
+			Dispatch(events);
+	}
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+// SessionEvents.h: session-change events, a thread-safe queue to deliver them, and a dispatcher
+// that turns them into targeted refreshes (plus a periodic full resync).
+// Uses only the standard library: event sources and refresh targets are supplied by the caller,
+// so synthetic events can be injected without Windows.
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+/// <summary>
+/// Kinds of session change. The values are the same as the WTS_x codes delivered with WM_WTSSESSION_CHANGE.
+/// </summary>
+enum class SessionEventType_t : uint32_t
+{
+	ConsoleConnect = 0x1,
+	ConsoleDisconnect = 0x2,
+	RemoteConnect = 0x3,
+	RemoteDisconnect = 0x4,
+	Logon = 0x5,
+	Logoff = 0x6,
+	Lock = 0x7,
+	Unlock = 0x8,
+	RemoteControl = 0x9,
+	Create = 0xA,
+	Terminate = 0xB,
+};
+
+/// <summary>
+/// A change affecting one session
+/// </summary>
+struct SessionEvent_t
+{
+	SessionEventType_t type = SessionEventType_t::Create;
+	uint32_t dwSessionId = 0;
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Thread-safe queue from event sources (any thread) to the dispatcher.
+/// </summary>
+class SessionEventQueue
+{
+public:
+	SessionEventQueue() = default;
+	~SessionEventQueue() = default;
+
+	/// <summary>
+	/// Add an event to the queue. Ignored after Stop.
+	/// </summary>
+	void Post(const SessionEvent_t& event);
+
+	/// <summary>
+	/// Wake the waiting thread and make all subsequent waits return false.
+	/// </summary>
+	void Stop();
+
+	/// <summary>
+	/// Wait until at least one event is queued, the timeout elapses, or the queue is stopped.
+	/// </summary>
+	/// <param name="timeoutMs">Input: maximum time to wait, in milliseconds</param>
+	/// <param name="events">Output: all the events that were queued (empty on timeout)</param>
+	/// <returns>false if the queue has been stopped, true otherwise</returns>
+	bool Wait(uint32_t timeoutMs, std::vector<SessionEvent_t>& events);
+
+private:
+	std::deque<SessionEvent_t> m_events;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bStopped = false;
+
+private:
+	// Not implemented
+	SessionEventQueue(const SessionEventQueue&) = delete;
+	SessionEventQueue& operator = (const SessionEventQueue&) = delete;
+};
+
+/// <summary>
+/// What a batch of events calls for on one session
+/// </summary>
+struct SessionUpdate_t
+{
+	uint32_t dwSessionId = 0;
+	// true if the session has ended, false to re-query it (it might be new)
+	bool bRemove = false;
+};
+
+typedef std::vector<SessionUpdate_t> SessionUpdateList_t;
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Whatever the dispatcher refreshes in response to events
+/// </summary>
+class ISessionRefreshTarget
+{
+public:
+	virtual ~ISessionRefreshTarget() = default;
+
+	/// <summary>
+	/// Re-query or remove the sessions affected by a batch of events. Each session appears once.
+	/// Getting the whole batch at once lets the target share work between its sessions.
+	/// </summary>
+	virtual void UpdateSessions(const SessionUpdateList_t& updates) = 0;
+
+	/// <summary>
+	/// Re-query everything
+	/// </summary>
+	virtual void FullResync() = 0;
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Turns session events into calls on an ISessionRefreshTarget.
+/// </summary>
+class SessionEventDispatcher
+{
+public:
+	explicit SessionEventDispatcher(ISessionRefreshTarget& target);
+	~SessionEventDispatcher() = default;
+
+	/// <summary>
+	/// Handle a batch of events with one call on the target. Each affected session is refreshed or removed once,
+	/// in order of its first event in the batch; the session's last event decides which (Terminate means remove).
+	/// </summary>
+	void Dispatch(const std::vector<SessionEvent_t>& events);
+
+	/// <summary>
+	/// Dispatch events from the queue until it is stopped, and call FullResync whenever
+	/// resyncIntervalMs elapses.
+	/// </summary>
+	void Run(SessionEventQueue& queue, uint32_t resyncIntervalMs);
+
+private:
+	ISessionRefreshTarget& m_target;
+
+private:
+	// Not implemented
+	SessionEventDispatcher(const SessionEventDispatcher&) = delete;
+	SessionEventDispatcher& operator = (const SessionEventDispatcher&) = delete;
+};
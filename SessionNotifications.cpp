@@ -0,0 +1,141 @@
+// SessionNotifications.cpp: delivers WTS session-change notifications to a SessionEventQueue.
+
+#include "SessionNotifications.h"
+#include <WtsApi32.h>
+#pragma comment(lib, "Wtsapi32.lib")
+#include "SysErrorMessage.h"
+
+static const wchar_t* const szNotificationWindowClass = L"TSSessions_SessionNotification";
+
+WtsSessionEventSource::~WtsSessionEventSource()
+{
+	Stop();
+}
+
+/// <summary>
+/// Create the notification window and start receiving notifications.
+/// </summary>
+bool WtsSessionEventSource::Start(SessionEventQueue& queue, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	if (m_thread.joinable())
+	{
+		sErrorInfo = L"Already started";
+		return false;
+	}
+
+	m_pQueue = &queue;
+	m_sStartError.clear();
+	HANDLE hStartedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (NULL == hStartedEvent)
+	{
+		sErrorInfo = SysErrorMessageWithCode();
+		return false;
+	}
+
+	// Wait for the thread to create the window and register for notifications (or fail trying).
+	m_thread = std::thread(&WtsSessionEventSource::ThreadProc, this, hStartedEvent);
+	WaitForSingleObject(hStartedEvent, INFINITE);
+	CloseHandle(hStartedEvent);
+
+	if (NULL == m_hwnd)
+	{
+		m_thread.join();
+		sErrorInfo = m_sStartError;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Stop receiving notifications, destroy the window, and end the thread. Safe to call more than once.
+/// </summary>
+void WtsSessionEventSource::Stop()
+{
+	if (m_thread.joinable())
+	{
+		// The window has to be destroyed on the thread that created it.
+		if (NULL != m_hwnd)
+			PostMessageW(m_hwnd, WM_CLOSE, 0, 0);
+		m_thread.join();
+	}
+	m_hwnd = NULL;
+}
+
+/// <summary>
+/// Internal: notification thread; creates the window and runs its message loop
+/// </summary>
+void WtsSessionEventSource::ThreadProc(HANDLE hStartedEvent)
+{
+	HINSTANCE hInstance = GetModuleHandleW(NULL);
+
+	WNDCLASSEXW wndClass = { 0 };
+	wndClass.cbSize = sizeof(wndClass);
+	wndClass.lpfnWndProc = WndProc;
+	wndClass.hInstance = hInstance;
+	wndClass.lpszClassName = szNotificationWindowClass;
+	// Registration fails harmlessly if the class is already registered by an earlier Start.
+	RegisterClassExW(&wndClass);
+
+	// Message-only window: receives messages but is never visible and isn't enumerated.
+	HWND hwnd = CreateWindowExW(0, szNotificationWindowClass, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, this);
+	if (NULL == hwnd)
+	{
+		m_sStartError = L"Unable to create notification window: " + SysErrorMessageWithCode();
+		SetEvent(hStartedEvent);
+		return;
+	}
+	if (!WTSRegisterSessionNotification(hwnd, NOTIFY_FOR_ALL_SESSIONS))
+	{
+		m_sStartError = L"Unable to register for session notifications: " + SysErrorMessageWithCode();
+		DestroyWindow(hwnd);
+		SetEvent(hStartedEvent);
+		return;
+	}
+	m_hwnd = hwnd;
+	SetEvent(hStartedEvent);
+
+	MSG msg;
+	while (GetMessageW(&msg, NULL, 0, 0) > 0)
+	{
+		TranslateMessage(&msg);
+		DispatchMessageW(&msg);
+	}
+}
+
+/// <summary>
+/// Internal: window procedure for the notification window
+/// </summary>
+LRESULT CALLBACK WtsSessionEventSource::WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	switch (uMsg)
+	{
+	case WM_NCCREATE:
+		// Stash the object pointer passed to CreateWindowExW.
+		SetWindowLongPtrW(hwnd, GWLP_USERDATA, (LONG_PTR)((const CREATESTRUCTW*)lParam)->lpCreateParams);
+		break;
+
+	case WM_WTSSESSION_CHANGE:
+		{
+			WtsSessionEventSource* pThis = (WtsSessionEventSource*)GetWindowLongPtrW(hwnd, GWLP_USERDATA);
+			if (pThis && pThis->m_pQueue)
+			{
+				SessionEvent_t event;
+				event.type = (SessionEventType_t)wParam;
+				event.dwSessionId = (uint32_t)lParam;
+				pThis->m_pQueue->Post(event);
+			}
+		}
+		return 0;
+
+	case WM_CLOSE:
+		WTSUnRegisterSessionNotification(hwnd);
+		DestroyWindow(hwnd);
+		return 0;
+
+	case WM_DESTROY:
+		PostQuitMessage(0);
+		return 0;
+	}
+	return DefWindowProcW(hwnd, uMsg, wParam, lParam);
+}
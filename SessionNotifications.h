@@ -0,0 +1,56 @@
+#pragma once
+
+// SessionNotifications.h: delivers WTS session-change notifications (logon, logoff, connect,
+// disconnect, lock, unlock, etc.) to a SessionEventQueue.
+
+#include <Windows.h>
+#include <string>
+#include <thread>
+#include "SessionEvents.h"
+
+/// <summary>
+/// Registers a message-only window for WTS session notifications on its own thread and posts
+/// each notification to a SessionEventQueue.
+/// </summary>
+class WtsSessionEventSource
+{
+public:
+	WtsSessionEventSource() = default;
+	~WtsSessionEventSource();
+
+	/// <summary>
+	/// Create the notification window and start receiving notifications.
+	/// </summary>
+	/// <param name="queue">Input: queue to post events to; must outlive this object or the call to Stop</param>
+	/// <param name="sErrorInfo">Output: information if an error occurs</param>
+	/// <returns>true if successful, false otherwise</returns>
+	bool Start(SessionEventQueue& queue, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Stop receiving notifications, destroy the window, and end the thread. Safe to call more than once.
+	/// </summary>
+	void Stop();
+
+private:
+	/// <summary>
+	/// Internal: notification thread; creates the window and runs its message loop
+	/// </summary>
+	void ThreadProc(HANDLE hStartedEvent);
+
+	/// <summary>
+	/// Internal: window procedure for the notification window
+	/// </summary>
+	static LRESULT CALLBACK WndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+private:
+	SessionEventQueue* m_pQueue = nullptr;
+	HWND m_hwnd = NULL;
+	std::thread m_thread;
+	// Set by the notification thread if startup fails
+	std::wstring m_sStartError;
+
+private:
+	// Not implemented
+	WtsSessionEventSource(const WtsSessionEventSource&) = delete;
+	WtsSessionEventSource& operator = (const WtsSessionEventSource&) = delete;
+};
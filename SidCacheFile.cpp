@@ -0,0 +1,357 @@
+// SidCacheFile.cpp: reader and writer for on-disk SID name cache files.
+//
+// Records are read in place and copied into the file image as-is, so this assumes a little-endian host,
+// as the snapshot reader and writer do.
+
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <unordered_map>
+#include "SidCacheFile.h"
+
+using namespace SidCacheFormat;
+
+const uint32_t SidCacheFile::DefaultMaxAgeDays;
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal helper: append raw bytes to the file image
+/// </summary>
+static void AppendBytes(std::vector<uint8_t>& data, const void* pBytes, size_t nBytes)
+{
+	if (nBytes > 0)
+	{
+		size_t offset = data.size();
+		data.resize(offset + nBytes);
+		memcpy(data.data() + offset, pBytes, nBytes);
+	}
+}
+
+/// <summary>
+/// Internal helper: three-way comparison of binary SIDs, by bytes and then by length
+/// </summary>
+static int CompareSids(const uint8_t* pSid1, size_t cbSid1, const uint8_t* pSid2, size_t cbSid2)
+{
+	int cmp = (0 == cbSid1 || 0 == cbSid2) ? 0 : memcmp(pSid1, pSid2, std::min(cbSid1, cbSid2));
+	if (0 != cmp)
+		return cmp;
+	return (cbSid1 < cbSid2) ? -1 : (cbSid1 > cbSid2) ? 1 : 0;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Map and validate a SID cache file.
+/// </summary>
+bool SidCacheFile::Open(const std::wstring& sPath, std::wstring& sErrorInfo)
+{
+	Close();
+	if (!m_mappedFile.Open(sPath, sErrorInfo))
+		return false;
+	if (!Attach(m_mappedFile.Data(), m_mappedFile.Size(), sErrorInfo))
+	{
+		sErrorInfo = sPath + L": " + sErrorInfo;
+		m_mappedFile.Close();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Validate and use a SID cache image already in memory.
+/// </summary>
+bool SidCacheFile::Attach(const uint8_t* pData, size_t size, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	m_pData = pData;
+	m_size = size;
+	if (!Validate(sErrorInfo))
+	{
+		m_pData = nullptr;
+		m_size = 0;
+		m_recordSize = 0;
+		m_recordCount = 0;
+		m_pStrings = nullptr;
+		m_stringsCount = 0;
+		m_pBlobs = nullptr;
+		m_blobsSize = 0;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Stop using the file or image, and unmap the file.
+/// </summary>
+void SidCacheFile::Close()
+{
+	m_pData = nullptr;
+	m_size = 0;
+	m_recordSize = 0;
+	m_recordCount = 0;
+	m_pStrings = nullptr;
+	m_stringsCount = 0;
+	m_pBlobs = nullptr;
+	m_blobsSize = 0;
+	m_mappedFile.Close();
+}
+
+/// <summary>
+/// Internal: check the header and locate the tables.
+/// After this succeeds, every record is within the file.
+/// </summary>
+bool SidCacheFile::Validate(std::wstring& sErrorInfo)
+{
+	if (nullptr == m_pData || m_size < sizeof(FileHeader_t))
+	{
+		sErrorInfo = L"Not a TSSessions SID cache file (too small)";
+		return false;
+	}
+	if (0 != ((uintptr_t)m_pData & 7))
+	{
+		sErrorInfo = L"SID cache buffer is not 8-byte aligned";
+		return false;
+	}
+
+	FileHeader_t header;
+	memcpy(&header, m_pData, sizeof(header));
+	if (0 != memcmp(header.magic, Magic, sizeof(header.magic)))
+	{
+		sErrorInfo = L"Not a TSSessions SID cache file";
+		return false;
+	}
+	if (CurrentVersion != header.version)
+	{
+		sErrorInfo = L"Unsupported SID cache file version " + std::to_wstring(header.version);
+		return false;
+	}
+	if (header.fileSize > m_size)
+	{
+		sErrorInfo = L"SID cache file is truncated";
+		return false;
+	}
+	const uint64_t fileSize = header.fileSize;
+	// Records are read in place, so they must keep 8-byte alignment.
+	if (header.recordSize < sizeof(Record_t) || 0 != header.recordSize % 8 ||
+		header.recordCount > (fileSize - sizeof(FileHeader_t)) / header.recordSize)
+	{
+		sErrorInfo = L"SID cache records are out of bounds";
+		return false;
+	}
+	if (header.stringsOffset > fileSize || 0 != header.stringsOffset % 8 ||
+		header.stringsCount > (fileSize - header.stringsOffset) / sizeof(char16_t))
+	{
+		sErrorInfo = L"SID cache string table is out of bounds";
+		return false;
+	}
+	if (header.blobsOffset > fileSize || header.blobsSize > fileSize - header.blobsOffset)
+	{
+		sErrorInfo = L"SID cache blob table is out of bounds";
+		return false;
+	}
+
+	m_recordSize = header.recordSize;
+	m_recordCount = header.recordCount;
+	m_pStrings = reinterpret_cast<const char16_t*>(m_pData + header.stringsOffset);
+	m_stringsCount = header.stringsCount;
+	m_pBlobs = m_pData + header.blobsOffset;
+	m_blobsSize = header.blobsSize;
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+// Accessors. Each returns false if the record references anything outside the file.
+
+const Record_t* SidCacheFile::Record(size_t ix) const
+{
+	if (ix >= m_recordCount)
+		return nullptr;
+	return reinterpret_cast<const Record_t*>(m_pData + sizeof(FileHeader_t) + ix * m_recordSize);
+}
+
+bool SidCacheFile::RecordSid(const Record_t& record, const uint8_t*& pSid, size_t& cbSid) const
+{
+	if ((uint64_t)record.sid.offset + record.sid.length > m_blobsSize)
+		return false;
+	pSid = m_pBlobs + record.sid.offset;
+	cbSid = record.sid.length;
+	return true;
+}
+
+bool SidCacheFile::GetString(const SnapshotFormat::StrRef_t& ref, std::wstring& str) const
+{
+	if ((uint64_t)ref.offset + ref.length > m_stringsCount)
+		return false;
+	str = SnapshotFormat::Utf16ToWString(m_pStrings + ref.offset, ref.length);
+	return true;
+}
+
+/// <summary>
+/// Copy one entry, by index in SID order
+/// </summary>
+bool SidCacheFile::Entry(size_t ix, SidCacheEntry_t& entry) const
+{
+	entry = SidCacheEntry_t();
+	const Record_t* pRecord = Record(ix);
+	const uint8_t* pSid = nullptr;
+	size_t cbSid = 0;
+	if (nullptr == pRecord || !RecordSid(*pRecord, pSid, cbSid))
+		return false;
+	entry.sid.assign(pSid, pSid + cbSid);
+	entry.timestamp = pRecord->timestamp;
+	return GetString(pRecord->domainName, entry.sDomainName) && GetString(pRecord->userName, entry.sUserName);
+}
+
+/// <summary>
+/// Find a SID's entry by binary search
+/// </summary>
+bool SidCacheFile::Find(const uint8_t* pSid, size_t cbSid, SidCacheEntry_t& entry) const
+{
+	entry = SidCacheEntry_t();
+	if (nullptr == pSid || 0 == cbSid)
+		return false;
+	size_t ixLow = 0, ixHigh = (size_t)m_recordCount;
+	while (ixLow < ixHigh)
+	{
+		size_t ixMid = ixLow + (ixHigh - ixLow) / 2;
+		const uint8_t* pRecordSid = nullptr;
+		size_t cbRecordSid = 0;
+		if (!RecordSid(*Record(ixMid), pRecordSid, cbRecordSid))
+			return false;
+		int cmp = CompareSids(pRecordSid, cbRecordSid, pSid, cbSid);
+		if (0 == cmp)
+			return Entry(ixMid, entry);
+		if (cmp < 0)
+			ixLow = ixMid + 1;
+		else
+			ixHigh = ixMid;
+	}
+	return false;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Serialize entries as a SID cache image.
+/// </summary>
+void SidCacheFile::Write(const SidCacheEntryList_t& entries, std::vector<uint8_t>& data)
+{
+	data.clear();
+
+	// Sort by SID, newest first within a SID, and keep the first of each.
+	std::vector<const SidCacheEntry_t*> sorted;
+	sorted.reserve(entries.size());
+	for (SidCacheEntryList_t::const_iterator entryIter = entries.begin(); entryIter != entries.end(); entryIter++)
+	{
+		if (!entryIter->sid.empty())
+			sorted.push_back(&*entryIter);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const SidCacheEntry_t* pEntry1, const SidCacheEntry_t* pEntry2) {
+		int cmp = CompareSids(pEntry1->sid.data(), pEntry1->sid.size(), pEntry2->sid.data(), pEntry2->sid.size());
+		return (0 != cmp) ? (cmp < 0) : (pEntry1->timestamp > pEntry2->timestamp);
+		});
+
+	// Build the records and tables. Domain names repeat a lot, so strings are deduplicated.
+	std::vector<Record_t> records;
+	std::vector<char16_t> strings;
+	std::vector<uint8_t> blobs;
+	std::unordered_map<std::wstring, SnapshotFormat::StrRef_t> stringIndex;
+	const auto AddString = [&strings, &stringIndex](const std::wstring& str) {
+		SnapshotFormat::StrRef_t ref = {};
+		if (str.empty())
+			return ref;
+		std::unordered_map<std::wstring, SnapshotFormat::StrRef_t>::const_iterator indexIter = stringIndex.find(str);
+		if (stringIndex.end() != indexIter)
+			return indexIter->second;
+		ref.offset = (uint32_t)strings.size();
+		SnapshotFormat::AppendUtf16(str, strings);
+		ref.length = (uint32_t)(strings.size() - ref.offset);
+		stringIndex[str] = ref;
+		return ref;
+	};
+	for (size_t ix = 0; ix < sorted.size(); ++ix)
+	{
+		const SidCacheEntry_t& entry = *sorted[ix];
+		if (ix > 0 && sorted[ix - 1]->sid == entry.sid)
+			continue;
+		Record_t record = {};
+		record.sid.offset = (uint32_t)blobs.size();
+		record.sid.length = (uint32_t)entry.sid.size();
+		blobs.insert(blobs.end(), entry.sid.begin(), entry.sid.end());
+		record.domainName = AddString(entry.sDomainName);
+		record.userName = AddString(entry.sUserName);
+		record.timestamp = entry.timestamp;
+		records.push_back(record);
+	}
+
+	FileHeader_t header = {};
+	memcpy(header.magic, Magic, sizeof(header.magic));
+	header.version = CurrentVersion;
+	header.recordSize = (uint32_t)sizeof(Record_t);
+	header.recordCount = records.size();
+	header.stringsOffset = sizeof(FileHeader_t) + records.size() * sizeof(Record_t);
+	header.stringsCount = strings.size();
+	header.blobsOffset = (header.stringsOffset + strings.size() * sizeof(char16_t) + 7) & ~(uint64_t)7;
+	header.blobsSize = blobs.size();
+	header.fileSize = (header.blobsOffset + blobs.size() + 7) & ~(uint64_t)7;
+
+	data.reserve((size_t)header.fileSize);
+	AppendBytes(data, &header, sizeof(header));
+	AppendBytes(data, records.data(), records.size() * sizeof(Record_t));
+	AppendBytes(data, strings.data(), strings.size() * sizeof(char16_t));
+	data.resize((size_t)header.blobsOffset, 0);
+	AppendBytes(data, blobs.data(), blobs.size());
+	data.resize((size_t)header.fileSize, 0);
+}
+
+/// <summary>
+/// Rewrite a SID cache file with its unexpired entries plus new ones, replacing the file atomically.
+/// </summary>
+bool SidCacheFile::Update(const std::wstring& sPath, SidCacheFile& existing, const SidCacheEntryList_t& newEntries, int64_t maxAgeSeconds, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	const int64_t oldest = Now() - maxAgeSeconds;
+	bool bChanged = false;
+
+	SidCacheEntryList_t entries;
+	entries.reserve(existing.Count() + newEntries.size());
+	for (size_t ix = 0; ix < existing.Count(); ++ix)
+	{
+		SidCacheEntry_t entry;
+		if (existing.Entry(ix, entry) && entry.timestamp >= oldest)
+			entries.push_back(entry);
+		else
+			bChanged = true;
+	}
+	existing.Close();
+
+	SidCacheEntryList_t::const_iterator entryIter;
+	for (entryIter = newEntries.begin(); entryIter != newEntries.end(); entryIter++)
+	{
+		if (entryIter->timestamp >= oldest)
+		{
+			entries.push_back(*entryIter);
+			bChanged = true;
+		}
+	}
+
+	if (!bChanged)
+		return true;
+	std::vector<uint8_t> data;
+	Write(entries, data);
+	if (!ReplaceBinaryFile(sPath, data, sErrorInfo))
+	{
+		sErrorInfo = sPath + L": " + sErrorInfo;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// The current time, in seconds since 1970-01-01 UTC
+/// </summary>
+int64_t SidCacheFile::Now()
+{
+	return (int64_t)time(nullptr);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+// SidCacheFile.h: on-disk cache of SID-to-name mappings (.tssid files), shared across runs (--sid-cache).
+//
+// Layout: FileHeader_t, then the records sorted by SID bytes, then a UTF-16LE string table and a blob table
+// holding the binary SIDs, each 8-byte aligned. Each record holds a SID, its domain and user names, and when the
+// name was resolved, in seconds since 1970-01-01 UTC. Only successful lookups are stored.
+// The file is memory-mapped read-only and searched in place; it's rewritten as a whole, replacing the old file
+// atomically. All integers are little-endian; readers assume a little-endian host, as for snapshot files.
+//
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SnapshotFormat.h"
+#include "MappedFile.h"
+
+namespace SidCacheFormat
+{
+	// "TSSIDC" + two bytes that catch text-mode newline conversion
+	const char Magic[8] = { 'T', 'S', 'S', 'I', 'D', 'C', '\r', '\n' };
+	// Incremented only for changes that older readers can't handle
+	const uint32_t CurrentVersion = 1;
+
+	struct FileHeader_t
+	{
+		char magic[8];
+		uint32_t version;
+		// Size of each record; readers use it as the stride, so fields can be appended to records
+		uint32_t recordSize;
+		uint64_t recordCount;
+		// The string table: offset in bytes, length in UTF-16 code units
+		uint64_t stringsOffset;
+		uint64_t stringsCount;
+		// The blob table: offset and length in bytes
+		uint64_t blobsOffset;
+		uint64_t blobsSize;
+		uint64_t fileSize;
+	};
+
+	struct Record_t
+	{
+		SnapshotFormat::BlobRef_t sid;
+		SnapshotFormat::StrRef_t domainName;
+		SnapshotFormat::StrRef_t userName;
+		// When the name was resolved, in seconds since 1970-01-01 UTC
+		int64_t timestamp;
+	};
+
+	// Layout checks: records must have no implicit padding so that they're identical on every compiler.
+	static_assert(sizeof(FileHeader_t) == 64, "FileHeader_t layout");
+	static_assert(sizeof(Record_t) == 32, "Record_t layout");
+}
+
+/// <summary>
+/// One SID-to-name mapping
+/// </summary>
+struct SidCacheEntry_t
+{
+	std::vector<uint8_t> sid;
+	std::wstring sDomainName, sUserName;
+	// When the name was resolved, in seconds since 1970-01-01 UTC
+	int64_t timestamp = 0;
+};
+typedef std::vector<SidCacheEntry_t> SidCacheEntryList_t;
+
+/// <summary>
+/// A validated SID cache file, mapped read-only. Lookups search the mapped records in place, so opening the file
+/// costs the same however many entries it holds. Accessors return false for references that fall outside the file,
+/// so a corrupt file can't cause reads outside it.
+/// </summary>
+class SidCacheFile
+{
+public:
+	// Default for how many days entries are used before their SIDs are looked up again
+	static const uint32_t DefaultMaxAgeDays = 7;
+
+	SidCacheFile() = default;
+	~SidCacheFile() = default;
+
+	/// <summary>
+	/// Map and validate a SID cache file.
+	/// </summary>
+	/// <param name="sPath">Input: path of the SID cache file</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Open(const std::wstring& sPath, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Validate and use a SID cache image already in memory. The buffer must remain valid and unchanged
+	/// while this object is in use, and must be 8-byte aligned.
+	/// </summary>
+	bool Attach(const uint8_t* pData, size_t size, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Stop using the file or image, and unmap the file.
+	/// </summary>
+	void Close();
+
+	/// <summary>
+	/// Number of entries
+	/// </summary>
+	size_t Count() const { return (size_t)m_recordCount; }
+
+	/// <summary>
+	/// Copy one entry, by index in SID order
+	/// </summary>
+	bool Entry(size_t ix, SidCacheEntry_t& entry) const;
+
+	/// <summary>
+	/// Find a SID's entry by binary search
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: length of the binary SID in bytes</param>
+	/// <param name="entry">Output: the SID's entry</param>
+	/// <returns>true if the SID has an entry</returns>
+	bool Find(const uint8_t* pSid, size_t cbSid, SidCacheEntry_t& entry) const;
+
+	/// <summary>
+	/// Serialize entries as a SID cache image. Entries are sorted by SID; if a SID appears more than once,
+	/// the most recently resolved entry is kept.
+	/// </summary>
+	static void Write(const SidCacheEntryList_t& entries, std::vector<uint8_t>& data);
+
+	/// <summary>
+	/// Rewrite a SID cache file with its unexpired entries plus new ones, replacing the file atomically.
+	/// The file is closed first, since a mapped file can't be replaced on Windows. Nothing is written if there
+	/// are no new entries and none have expired.
+	/// </summary>
+	/// <param name="sPath">Input: path of the SID cache file</param>
+	/// <param name="existing">Input: the file's current contents, if it was opened; closed on return</param>
+	/// <param name="newEntries">Input: entries resolved since the file was opened</param>
+	/// <param name="maxAgeSeconds">Input: entries resolved longer ago than this are dropped</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	static bool Update(const std::wstring& sPath, SidCacheFile& existing, const SidCacheEntryList_t& newEntries, int64_t maxAgeSeconds, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// The current time, in seconds since 1970-01-01 UTC
+	/// </summary>
+	static int64_t Now();
+
+private:
+	/// <summary>
+	/// Internal: check the header and locate the tables.
+	/// After this succeeds, every record is within the file.
+	/// </summary>
+	bool Validate(std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Internal: a record, by index
+	/// </summary>
+	const SidCacheFormat::Record_t* Record(size_t ix) const;
+
+	/// <summary>
+	/// Internal: a record's SID bytes; false if the reference is outside the blob table
+	/// </summary>
+	bool RecordSid(const SidCacheFormat::Record_t& record, const uint8_t*& pSid, size_t& cbSid) const;
+
+	/// <summary>
+	/// Internal: a string from the string table; false if the reference is outside it
+	/// </summary>
+	bool GetString(const SnapshotFormat::StrRef_t& ref, std::wstring& str) const;
+
+private:
+	MappedFile m_mappedFile;
+	const uint8_t* m_pData = nullptr;
+	size_t m_size = 0;
+	uint32_t m_recordSize = 0;
+	uint64_t m_recordCount = 0;
+	const char16_t* m_pStrings = nullptr;
+	uint64_t m_stringsCount = 0;
+	const uint8_t* m_pBlobs = nullptr;
+	uint64_t m_blobsSize = 0;
+
+private:
+	// Not implemented
+	SidCacheFile(const SidCacheFile&) = delete;
+	SidCacheFile& operator = (const SidCacheFile&) = delete;
+};
@@ -0,0 +1,206 @@
+// SidCodec.cpp: conversion between binary SIDs and their string form, without Win32 and without allocating.
+
+#include "SidCodec.h"
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers
+
+/// <summary>
+/// Internal helper: write an unsigned value in decimal at pszBuf; returns the number of characters written.
+/// The buffer must have room for 20 characters.
+/// </summary>
+static size_t FormatDecimal(uint64_t value, wchar_t* pszBuf)
+{
+	wchar_t digits[20];
+	size_t nDigits = 0;
+	do
+	{
+		digits[nDigits++] = (wchar_t)(L'0' + value % 10);
+		value /= 10;
+	} while (0 != value);
+	for (size_t ix = 0; ix < nDigits; ++ix)
+		pszBuf[ix] = digits[nDigits - 1 - ix];
+	return nDigits;
+}
+
+/// <summary>
+/// Internal helper: parse an unsigned value in decimal, or in hexadecimal with a 0x prefix if maxHexValue isn't 0.
+/// Consumes characters up to the next '-' or the end of the string.
+/// </summary>
+/// <returns>true if the field is a well-formed number no greater than maxValue (maxHexValue if hexadecimal)</returns>
+static bool ParseNumber(const wchar_t*& psz, const wchar_t* pszEnd, uint64_t maxValue, uint64_t maxHexValue, uint64_t& value)
+{
+	value = 0;
+	const wchar_t* pszStart = psz;
+	if (0 != maxHexValue && pszEnd - psz > 2 && L'0' == psz[0] && (L'x' == psz[1] || L'X' == psz[1]))
+	{
+		psz += 2;
+		pszStart = psz;
+		for (; psz < pszEnd && L'-' != *psz; ++psz)
+		{
+			uint32_t digit;
+			if (*psz >= L'0' && *psz <= L'9')
+				digit = (uint32_t)(*psz - L'0');
+			else if (*psz >= L'A' && *psz <= L'F')
+				digit = (uint32_t)(*psz - L'A' + 10);
+			else if (*psz >= L'a' && *psz <= L'f')
+				digit = (uint32_t)(*psz - L'a' + 10);
+			else
+				return false;
+			if (value > (maxHexValue >> 4))
+				return false;
+			value = (value << 4) | digit;
+		}
+	}
+	else
+	{
+		for (; psz < pszEnd && L'-' != *psz; ++psz)
+		{
+			if (*psz < L'0' || *psz > L'9')
+				return false;
+			uint32_t digit = (uint32_t)(*psz - L'0');
+			if (value > (maxValue - digit) / 10)
+				return false;
+			value = value * 10 + digit;
+		}
+	}
+	return psz > pszStart;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Length of the binary SID at the start of a buffer.
+/// </summary>
+size_t SidCodec::BinaryLength(const uint8_t* pSid, size_t cbAvailable)
+{
+	// Revision, subauthority count, 6-byte identifier authority, then 4 bytes per subauthority
+	if (nullptr == pSid || cbAvailable < 8 || 1 != pSid[0] || pSid[1] > MaxSubAuthorities)
+		return 0;
+	size_t length = 8 + 4 * (size_t)pSid[1];
+	return (length <= cbAvailable) ? length : 0;
+}
+
+/// <summary>
+/// Format a binary SID into a caller-supplied buffer, null-terminated.
+/// </summary>
+size_t SidCodec::Format(const uint8_t* pSid, size_t cbSid, wchar_t* pszBuf, size_t cchBuf)
+{
+	if (0 == BinaryLength(pSid, cbSid) || nullptr == pszBuf)
+		return 0;
+
+	// Format into a local buffer that's always big enough, then copy out.
+	wchar_t szSid[MaxStringLength + 1];
+	size_t cch = 0;
+	szSid[cch++] = L'S';
+	szSid[cch++] = L'-';
+	cch += FormatDecimal(pSid[0], szSid + cch);
+	szSid[cch++] = L'-';
+
+	uint64_t authority = 0;
+	for (size_t ix = 2; ix < 8; ++ix)
+		authority = (authority << 8) | pSid[ix];
+	if (authority >> 32)
+	{
+		// As ConvertSidToStringSid formats it: 0x and all 12 hex digits, uppercase
+		const wchar_t* szHex = L"0123456789ABCDEF";
+		szSid[cch++] = L'0';
+		szSid[cch++] = L'x';
+		for (size_t ix = 2; ix < 8; ++ix)
+		{
+			szSid[cch++] = szHex[pSid[ix] >> 4];
+			szSid[cch++] = szHex[pSid[ix] & 0xF];
+		}
+	}
+	else
+	{
+		cch += FormatDecimal(authority, szSid + cch);
+	}
+
+	for (size_t ix = 0; ix < pSid[1]; ++ix)
+	{
+		// Subauthorities are little-endian.
+		const uint8_t* pSubAuth = pSid + 8 + 4 * ix;
+		uint32_t subAuth = (uint32_t)pSubAuth[0] | ((uint32_t)pSubAuth[1] << 8) | ((uint32_t)pSubAuth[2] << 16) | ((uint32_t)pSubAuth[3] << 24);
+		szSid[cch++] = L'-';
+		cch += FormatDecimal(subAuth, szSid + cch);
+	}
+
+	if (cch + 1 > cchBuf)
+		return 0;
+	for (size_t ix = 0; ix < cch; ++ix)
+		pszBuf[ix] = szSid[ix];
+	pszBuf[cch] = L'\0';
+	return cch;
+}
+
+/// <summary>
+/// String form of a binary SID
+/// </summary>
+std::wstring SidCodec::ToString(const uint8_t* pSid, size_t cbSid)
+{
+	wchar_t szSid[MaxStringLength + 1];
+	size_t cch = Format(pSid, cbSid, szSid, sizeof(szSid) / sizeof(szSid[0]));
+	return std::wstring(szSid, cch);
+}
+
+/// <summary>
+/// Parse a SID string into a caller-supplied buffer.
+/// </summary>
+size_t SidCodec::Parse(const wchar_t* pszSid, size_t cchSid, uint8_t* pSid, size_t cbBuf)
+{
+	if (nullptr == pszSid || nullptr == pSid)
+		return 0;
+	const wchar_t* psz = pszSid;
+	const wchar_t* pszEnd = pszSid + cchSid;
+
+	// "S-" (either case), then the revision, which must be 1
+	if (pszEnd - psz < 2 || (L'S' != psz[0] && L's' != psz[0]) || L'-' != psz[1])
+		return 0;
+	psz += 2;
+	uint64_t revision;
+	if (!ParseNumber(psz, pszEnd, 0xFF, 0, revision) || 1 != revision)
+		return 0;
+
+	// Identifier authority: 32 bits in decimal, or 48 bits in 0x-prefixed hexadecimal
+	uint64_t authority;
+	if (psz >= pszEnd || L'-' != *psz++ || !ParseNumber(psz, pszEnd, 0xFFFFFFFF, 0xFFFFFFFFFFFFULL, authority))
+		return 0;
+
+	uint8_t sid[MaxBinaryLength];
+	sid[0] = (uint8_t)revision;
+	for (size_t ix = 0; ix < 6; ++ix)
+		sid[2 + ix] = (uint8_t)(authority >> (8 * (5 - ix)));
+
+	// Up to 15 32-bit subauthorities, each preceded by '-'
+	size_t nSubAuthorities = 0;
+	while (psz < pszEnd)
+	{
+		uint64_t subAuth;
+		if (nSubAuthorities >= MaxSubAuthorities || L'-' != *psz++ || !ParseNumber(psz, pszEnd, 0xFFFFFFFF, 0, subAuth))
+			return 0;
+		uint8_t* pSubAuth = sid + 8 + 4 * nSubAuthorities;
+		for (size_t ix = 0; ix < 4; ++ix)
+			pSubAuth[ix] = (uint8_t)(subAuth >> (8 * ix));
+		++nSubAuthorities;
+	}
+	sid[1] = (uint8_t)nSubAuthorities;
+
+	size_t length = 8 + 4 * nSubAuthorities;
+	if (length > cbBuf)
+		return 0;
+	for (size_t ix = 0; ix < length; ++ix)
+		pSid[ix] = sid[ix];
+	return length;
+}
+
+/// <summary>
+/// Parse a SID string.
+/// </summary>
+bool SidCodec::Parse(const std::wstring& sSid, std::vector<uint8_t>& sid)
+{
+	uint8_t buf[MaxBinaryLength];
+	size_t length = Parse(sSid.c_str(), sSid.length(), buf, sizeof(buf));
+	sid.assign(buf, buf + length);
+	return 0 != length;
+}
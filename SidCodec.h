@@ -0,0 +1,65 @@
+#pragma once
+
+// SidCodec.h: conversion between binary SIDs and their string form (S-1-5-21-...), without Win32 and without
+// allocating. Output matches ConvertSidToStringSid, including the hexadecimal form used for identifier authorities
+// of 2^32 and above (S-1-0x123456789ABC-...). Parsing accepts what ConvertStringSidToSid accepts for S-1- strings;
+// SDDL aliases such as SY and BA aren't supported.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SidCodec
+{
+	// Largest binary SID: revision, subauthority count, 6-byte identifier authority, and 15 subauthorities
+	// (the same as SECURITY_MAX_SID_SIZE)
+	const size_t MaxBinaryLength = 68;
+	const size_t MaxSubAuthorities = 15;
+	// Longest string form, not counting the terminating null: "S-1-", a 14-character hex authority, and
+	// 15 subauthorities of up to 10 digits, each preceded by '-'
+	const size_t MaxStringLength = 4 + 14 + MaxSubAuthorities * 11;
+
+	/// <summary>
+	/// Length of the binary SID at the start of a buffer.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbAvailable">Input: number of bytes available at pSid</param>
+	/// <returns>Length of the SID in bytes; 0 if the buffer doesn't start with a valid revision-1 SID</returns>
+	size_t BinaryLength(const uint8_t* pSid, size_t cbAvailable);
+
+	/// <summary>
+	/// Format a binary SID into a caller-supplied buffer, null-terminated.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: number of bytes available at pSid</param>
+	/// <param name="pszBuf">Output: the SID string; a buffer of MaxStringLength + 1 characters is always enough</param>
+	/// <param name="cchBuf">Input: size of pszBuf in characters</param>
+	/// <returns>Number of characters written, not counting the null; 0 if the SID is invalid or the buffer is too small</returns>
+	size_t Format(const uint8_t* pSid, size_t cbSid, wchar_t* pszBuf, size_t cchBuf);
+
+	/// <summary>
+	/// String form of a binary SID
+	/// </summary>
+	/// <returns>The SID string; empty if the SID is invalid</returns>
+	std::wstring ToString(const uint8_t* pSid, size_t cbSid);
+
+	/// <summary>
+	/// Parse a SID string into a caller-supplied buffer.
+	/// </summary>
+	/// <param name="pszSid">Input: the SID string; not necessarily null-terminated</param>
+	/// <param name="cchSid">Input: length of the SID string in characters</param>
+	/// <param name="pSid">Output: the binary SID; a buffer of MaxBinaryLength bytes is always enough</param>
+	/// <param name="cbBuf">Input: size of the pSid buffer in bytes</param>
+	/// <returns>Length of the binary SID in bytes; 0 if the string isn't a valid SID or the buffer is too small</returns>
+	size_t Parse(const wchar_t* pszSid, size_t cchSid, uint8_t* pSid, size_t cbBuf);
+
+	/// <summary>
+	/// Parse a SID string.
+	/// </summary>
+	/// <param name="sSid">Input: the SID string</param>
+	/// <param name="sid">Output: the binary SID; empty on failure</param>
+	/// <returns>true if the string is a valid SID</returns>
+	bool Parse(const std::wstring& sSid, std::vector<uint8_t>& sid);
+}
@@ -0,0 +1,167 @@
+// SidNameBatch.cpp: gathers every distinct SID in collected snapshot data for batch name resolution.
+
+#include "SidNameBatch.h"
+#include "SecDescView.h"
+#include "SidCodec.h"
+
+// ------------------------------------------------------------------------------------------
+// Internal helpers
+
+/// <summary>
+/// Internal helper: add a SID from a security descriptor to a list, if it's there
+/// </summary>
+static void AppendSid(const uint8_t* pSid, size_t cbSid, std::vector<SidInfo_t>& sids)
+{
+	SidInfo_t sid;
+	if (nullptr != pSid && sid.Assign(pSid, cbSid))
+		sids.push_back(sid);
+}
+
+/// <summary>
+/// Internal helper: the trustee SIDs of the ACEs in a valid ACL
+/// </summary>
+static void AclSids(const AclView& acl, std::vector<SidInfo_t>& sids)
+{
+	if (!acl.IsValid())
+		return;
+	for (AclView::const_iterator aceIter = acl.begin(); aceIter != acl.end(); ++aceIter)
+	{
+		AppendSid(aceIter->Sid(), aceIter->SidLength(), sids);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: index of a distinct SID, added if new
+/// </summary>
+size_t SidNameBatch::Intern(const SidInfo_t& sid)
+{
+	Index_t::const_iterator indexIter = m_index.find(sid);
+	if (m_index.end() != indexIter)
+		return indexIter->second;
+	size_t ix = m_sids.size();
+	m_index[sid] = ix;
+	m_sids.push_back(sid);
+	m_sids.back().pName.reset();
+	m_targets.push_back(std::vector<SidInfo_t*>());
+	return ix;
+}
+
+/// <summary>
+/// Add a SID whose name Resolve fills in. Empty SIDs are ignored.
+/// </summary>
+void SidNameBatch::Add(SidInfo_t& sid)
+{
+	if (0 == SidCodec::BinaryLength(sid.Data(), sid.Length()))
+		return;
+	m_targets[Intern(sid)].push_back(&sid);
+}
+
+/// <summary>
+/// Add the owner, group, and ACE trustee SIDs of a self-relative security descriptor.
+/// </summary>
+void SidNameBatch::AddSecurityDescriptor(const std::vector<uint8_t>& sd)
+{
+	SecurityDescriptorView sdView(sd.data(), sd.size());
+	std::vector<SidInfo_t> sids;
+	AppendSid(sdView.Owner(), sdView.OwnerLength(), sids);
+	AppendSid(sdView.Group(), sdView.GroupLength(), sids);
+	AclSids(sdView.Sacl(), sids);
+	AclSids(sdView.Dacl(), sids);
+
+	std::vector<SidInfo_t>::const_iterator sidIter;
+	for (sidIter = sids.begin(); sidIter != sids.end(); sidIter++)
+	{
+		Intern(*sidIter);
+	}
+}
+
+/// <summary>
+/// Add the window station, desktop, and running-as SIDs of the current context
+/// </summary>
+void SidNameBatch::AddCurrentInfo(CurrentInfoSnapshot_t& currentInfo)
+{
+	if (currentInfo.winstaUser.bValid)
+		Add(currentInfo.winstaUser.value);
+	if (currentInfo.desktopUser.bValid)
+		Add(currentInfo.desktopUser.value);
+	Add(currentInfo.runningAs);
+}
+
+/// <summary>
+/// Add the process owner SIDs of a session
+/// </summary>
+void SidNameBatch::AddSession(SessionSnapshot_t& session)
+{
+	// Token user names aren't looked up.
+	ProcessSnapshotList_t::iterator procIter;
+	for (procIter = session.processes.value.begin(); procIter != session.processes.value.end(); procIter++)
+	{
+		Add(procIter->user);
+	}
+}
+
+/// <summary>
+/// Add the process owner SIDs of sessions
+/// </summary>
+void SidNameBatch::AddSessions(SessionSnapshotList_t& sessions)
+{
+	SessionSnapshotList_t::iterator sessionIter;
+	for (sessionIter = sessions.begin(); sessionIter != sessions.end(); sessionIter++)
+	{
+		AddSession(*sessionIter);
+	}
+}
+
+/// <summary>
+/// Add the user SIDs and security descriptors of window stations and their desktops
+/// </summary>
+void SidNameBatch::AddWindowStations(WindowStationSnapshotList_t& windowStations)
+{
+	WindowStationSnapshotList_t::iterator wsIter;
+	for (wsIter = windowStations.begin(); wsIter != windowStations.end(); wsIter++)
+	{
+		if (wsIter->user.bValid)
+			Add(wsIter->user.value);
+		if (wsIter->securityDescriptor.sd.bValid)
+			AddSecurityDescriptor(wsIter->securityDescriptor.sd.value);
+		DesktopSnapshotList_t::iterator desktopIter;
+		for (desktopIter = wsIter->desktops.value.begin(); desktopIter != wsIter->desktops.value.end(); desktopIter++)
+		{
+			if (desktopIter->user.bValid)
+				Add(desktopIter->user.value);
+			if (desktopIter->securityDescriptor.sd.bValid)
+				AddSecurityDescriptor(desktopIter->securityDescriptor.sd.value);
+		}
+	}
+}
+
+/// <summary>
+/// Resolve the names of all the SIDs with one batch request to the source, and fill them in.
+/// </summary>
+void SidNameBatch::Resolve(SystemSource& source)
+{
+	if (m_sids.empty())
+		return;
+	std::wstring sErrorInfo;
+	if (!source.LookupSidNames(m_sids, sErrorInfo))
+	{
+		std::vector<SidInfo_t>::iterator sidIter;
+		for (sidIter = m_sids.begin(); sidIter != m_sids.end(); sidIter++)
+		{
+			std::wstring sDomainAndUsername;
+			source.LookupSidName(*sidIter, sDomainAndUsername);
+			sidIter->SetName(sDomainAndUsername);
+		}
+	}
+	// Every reference to a SID shares its one name.
+	for (size_t ix = 0; ix < m_sids.size(); ++ix)
+	{
+		std::vector<SidInfo_t*>::const_iterator targetIter;
+		for (targetIter = m_targets[ix].begin(); targetIter != m_targets[ix].end(); targetIter++)
+		{
+			(*targetIter)->pName = m_sids[ix].pName;
+		}
+	}
+}
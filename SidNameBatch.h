@@ -0,0 +1,85 @@
+#pragma once
+
+// SidNameBatch.h: gathers every distinct SID in collected snapshot data so that their names can be resolved
+// with a few batch translations (SystemSource::LookupSidNames) instead of one lookup per reference.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SystemSnapshot.h"
+#include "SystemSource.h"
+
+/// <summary>
+/// Distinct SIDs awaiting name resolution, and the places to fill in each one's DOMAIN\username.
+/// Each distinct SID's name is stored once and shared by every place it's filled in.
+/// The snapshot data added must stay in place (no container reallocation) until Resolve is called.
+/// </summary>
+class SidNameBatch
+{
+public:
+	SidNameBatch() = default;
+	~SidNameBatch() = default;
+
+	/// <summary>
+	/// Add a SID whose name Resolve fills in. Empty SIDs are ignored.
+	/// </summary>
+	void Add(SidInfo_t& sid);
+
+	/// <summary>
+	/// Add the owner, group, and ACE trustee SIDs of a self-relative security descriptor.
+	/// Their names aren't stored anywhere in the snapshot; resolving them lets the source cache them for rendering.
+	/// </summary>
+	void AddSecurityDescriptor(const std::vector<uint8_t>& sd);
+
+	/// <summary>
+	/// Add the window station, desktop, and running-as SIDs of the current context
+	/// </summary>
+	void AddCurrentInfo(CurrentInfoSnapshot_t& currentInfo);
+
+	/// <summary>
+	/// Add the process owner SIDs of a session
+	/// </summary>
+	void AddSession(SessionSnapshot_t& session);
+
+	/// <summary>
+	/// Add the process owner SIDs of sessions
+	/// </summary>
+	void AddSessions(SessionSnapshotList_t& sessions);
+
+	/// <summary>
+	/// Add the user SIDs and security descriptors of window stations and their desktops
+	/// </summary>
+	void AddWindowStations(WindowStationSnapshotList_t& windowStations);
+
+	/// <summary>
+	/// Number of distinct SIDs added
+	/// </summary>
+	size_t Count() const { return m_sids.size(); }
+
+	/// <summary>
+	/// Resolve the names of all the SIDs with one batch request to the source, and fill them in.
+	/// If the batch request fails, each SID is looked up individually instead.
+	/// </summary>
+	void Resolve(SystemSource& source);
+
+private:
+	/// <summary>
+	/// Internal: index of a distinct SID, added if new
+	/// </summary>
+	size_t Intern(const SidInfo_t& sid);
+
+	// Distinct SIDs, in the order first added
+	std::vector<SidInfo_t> m_sids;
+	// For each distinct SID, the snapshot SIDs to fill in
+	std::vector<std::vector<SidInfo_t*>> m_targets;
+	// SID -> index into m_sids
+	typedef std::unordered_map<SidInfo_t, size_t, SidInfo_t::Hash_t> Index_t;
+	Index_t m_index;
+
+private:
+	// Not implemented
+	SidNameBatch(const SidNameBatch&) = delete;
+	SidNameBatch& operator = (const SidNameBatch&) = delete;
+};
@@ -0,0 +1,441 @@
+// SidNameCache.cpp: process-wide memoization of SID-to-name lookups.
+
+#include "SidNameCache.h"
+
+const uint32_t SidNameCache::DefaultTimeoutMilliseconds;
+const uint32_t SidNameCache::DefaultNegativeTtlMilliseconds;
+const size_t SidNameCache::DefaultResolverThreads;
+
+SidNameCache::SidNameCache(const LookupFn_t& lookup, size_t nResolverThreads /*= DefaultResolverThreads*/)
+	: m_lookup(lookup),
+	m_timeoutMilliseconds(DefaultTimeoutMilliseconds),
+	m_negativeTtlMilliseconds(DefaultNegativeTtlMilliseconds),
+	m_pStore(nullptr), m_storeMaxAgeSeconds(0),
+	m_hits(0), m_misses(0), m_timeouts(0),
+	m_resolvers(nResolverThreads)
+{
+}
+
+SidNameCache::SidNameCache(const LookupFn_t& lookup, const BatchLookupFn_t& batchLookup, size_t nResolverThreads /*= DefaultResolverThreads*/)
+	: m_lookup(lookup), m_batchLookup(batchLookup),
+	m_timeoutMilliseconds(DefaultTimeoutMilliseconds),
+	m_negativeTtlMilliseconds(DefaultNegativeTtlMilliseconds),
+	m_pStore(nullptr), m_storeMaxAgeSeconds(0),
+	m_hits(0), m_misses(0), m_timeouts(0),
+	m_resolvers(nResolverThreads)
+{
+}
+
+bool SidNameCache::Key_t::Assign(const uint8_t* pSid, size_t cb)
+{
+	cbSid = 0;
+	if (nullptr == pSid || 0 == cb || cb > sizeof(bytes))
+		return false;
+	memcpy(bytes, pSid, cb);
+	cbSid = (uint8_t)cb;
+	return true;
+}
+
+size_t SidNameCache::Key_t::Hash_t::operator()(const Key_t& key) const
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (size_t ix = 0; ix < key.cbSid; ++ix)
+	{
+		hash ^= key.bytes[ix];
+		hash *= 0x100000001B3ULL;
+	}
+	return (size_t)hash;
+}
+
+/// <summary>
+/// Look up a SID's domain and user names, from the cache if it has been looked up before.
+/// </summary>
+bool SidNameCache::Lookup(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	sDomainName.clear();
+	sUserName.clear();
+	Key_t key;
+	if (!key.Assign(pSid, cbSid))
+		return false;
+
+	const uint32_t timeoutMilliseconds = m_timeoutMilliseconds;
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const std::chrono::steady_clock::time_point deadline = now + std::chrono::milliseconds(timeoutMilliseconds);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	bool bNew = false;
+	EntryPtr_t pEntry = Acquire(key, now, bNew);
+	if (bNew)
+	{
+		if (0 == timeoutMilliseconds)
+		{
+			lock.unlock();
+			Resolve(key, pEntry);
+			lock.lock();
+			return Result(*pEntry, sDomainName, sUserName);
+		}
+		m_resolvers.Submit([this, key, pEntry]() { Resolve(key, pEntry); });
+	}
+	else if (State_t::Pending != pEntry->state)
+	{
+		return Result(*pEntry, sDomainName, sUserName);
+	}
+	else if (pEntry->bTimedOut)
+	{
+		// Someone already waited out the deadline on this lookup; don't make every reference wait again.
+		++m_timeouts;
+		return false;
+	}
+
+	// Wait for this lookup, or one another caller started, to complete.
+	if (0 == timeoutMilliseconds)
+	{
+		m_cv.wait(lock, [&pEntry]() { return State_t::Pending != pEntry->state; });
+	}
+	else if (!m_cv.wait_until(lock, deadline, [&pEntry]() { return State_t::Pending != pEntry->state; }))
+	{
+		pEntry->bTimedOut = true;
+		++m_timeouts;
+		return false;
+	}
+	return Result(*pEntry, sDomainName, sUserName);
+}
+
+/// <summary>
+/// Look up many SIDs' domain and user names, with one batch lookup for those not cached.
+/// </summary>
+void SidNameCache::LookupBatch(BatchItemList_t& items)
+{
+	const uint32_t timeoutMilliseconds = m_timeoutMilliseconds;
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	const std::chrono::steady_clock::time_point deadline = now + std::chrono::milliseconds(timeoutMilliseconds);
+	// For each item, the running lookup it waits on, if any
+	EntryList_t waits(items.size());
+	// The SIDs this call looks up
+	KeyList_t newKeys;
+	EntryList_t newEntries;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (size_t ix = 0; ix < items.size(); ++ix)
+	{
+		BatchItem_t& item = items[ix];
+		item.bFound = false;
+		item.sDomainName.clear();
+		item.sUserName.clear();
+		Key_t key;
+		if (!key.Assign(item.pSid, item.cbSid))
+			continue;
+		bool bNew = false;
+		EntryPtr_t pEntry = Acquire(key, now, bNew);
+		if (bNew)
+		{
+			newKeys.push_back(key);
+			newEntries.push_back(pEntry);
+		}
+		else if (State_t::Pending != pEntry->state)
+		{
+			item.bFound = Result(*pEntry, item.sDomainName, item.sUserName);
+			continue;
+		}
+		else if (pEntry->bTimedOut)
+		{
+			++m_timeouts;
+			continue;
+		}
+		waits[ix] = pEntry;
+	}
+
+	if (!newKeys.empty())
+	{
+		if (0 == timeoutMilliseconds)
+		{
+			lock.unlock();
+			ResolveBatch(newKeys, newEntries);
+			lock.lock();
+		}
+		else if (m_batchLookup)
+		{
+			m_resolvers.Submit([this, newKeys, newEntries]() { ResolveBatch(newKeys, newEntries); });
+		}
+		else
+		{
+			// No batch lookup: the SIDs are looked up in parallel instead.
+			for (size_t ix = 0; ix < newKeys.size(); ++ix)
+			{
+				const Key_t& key = newKeys[ix];
+				const EntryPtr_t& pEntry = newEntries[ix];
+				m_resolvers.Submit([this, key, pEntry]() { Resolve(key, pEntry); });
+			}
+		}
+	}
+
+	// Wait for the lookups, up to one deadline for all of them.
+	for (size_t ix = 0; ix < items.size(); ++ix)
+	{
+		const EntryPtr_t pEntry = waits[ix];
+		if (!pEntry)
+			continue;
+		if (0 == timeoutMilliseconds)
+		{
+			m_cv.wait(lock, [&pEntry]() { return State_t::Pending != pEntry->state; });
+		}
+		else if (!m_cv.wait_until(lock, deadline, [&pEntry]() { return State_t::Pending != pEntry->state; }))
+		{
+			pEntry->bTimedOut = true;
+			++m_timeouts;
+			continue;
+		}
+		items[ix].bFound = Result(*pEntry, items[ix].sDomainName, items[ix].sUserName);
+	}
+}
+
+/// <summary>
+/// Internal: the entry for a SID -- cached in memory or on disk, or a new pending entry that the caller must resolve.
+/// </summary>
+SidNameCache::EntryPtr_t SidNameCache::Acquire(const Key_t& key, const std::chrono::steady_clock::time_point& now, bool& bNew)
+{
+	bNew = false;
+	EntryMap_t::const_iterator entryIter = m_entries.find(key);
+	if (m_entries.end() == entryIter)
+	{
+		// Not cached in memory yet; use the on-disk cache's entry if it has a fresh one.
+		EntryPtr_t pEntry = FromStore(key);
+		if (pEntry)
+		{
+			++m_hits;
+			m_entries[key] = pEntry;
+			return pEntry;
+		}
+	}
+	else if (!(State_t::NotFound == entryIter->second->state && now >= entryIter->second->expires))
+	{
+		if (!(State_t::Pending == entryIter->second->state && entryIter->second->bTimedOut))
+			++m_hits;
+		return entryIter->second;
+	}
+
+	// Not cached, or a failure whose TTL has passed: start a new lookup.
+	++m_misses;
+	bNew = true;
+	EntryPtr_t pEntry = std::make_shared<Entry_t>();
+	m_entries[key] = pEntry;
+	return pEntry;
+}
+
+/// <summary>
+/// Internal: perform one lookup and publish its result to the entry
+/// </summary>
+void SidNameCache::Resolve(const Key_t& key, const EntryPtr_t& pEntry)
+{
+	std::wstring sDomainName, sUserName;
+	bool bFound = m_lookup(key.Data(), key.Length(), sDomainName, sUserName);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Already completed if a batch lookup supplied the result meanwhile
+		if (State_t::Pending == pEntry->state)
+			Complete(*pEntry, bFound, sDomainName, sUserName);
+	}
+	m_cv.notify_all();
+}
+
+/// <summary>
+/// Internal: perform one batch lookup and publish its results to the entries
+/// </summary>
+void SidNameCache::ResolveBatch(const KeyList_t& keys, const EntryList_t& entries)
+{
+	if (!m_batchLookup)
+	{
+		for (size_t ix = 0; ix < keys.size(); ++ix)
+			Resolve(keys[ix], entries[ix]);
+		return;
+	}
+
+	BatchItemList_t items(keys.size());
+	for (size_t ix = 0; ix < keys.size(); ++ix)
+	{
+		items[ix].pSid = keys[ix].Data();
+		items[ix].cbSid = keys[ix].Length();
+	}
+	std::wstring sErrorInfo;
+	if (!m_batchLookup(items, sErrorInfo))
+	{
+		// The batch request as a whole failed; look the SIDs up one at a time.
+		for (size_t ix = 0; ix < keys.size(); ++ix)
+			Resolve(keys[ix], entries[ix]);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t ix = 0; ix < keys.size(); ++ix)
+		{
+			if (State_t::Pending == entries[ix]->state)
+				Complete(*entries[ix], items[ix].bFound, items[ix].sDomainName, items[ix].sUserName);
+		}
+	}
+	m_cv.notify_all();
+}
+
+/// <summary>
+/// Look up a SID in the cache only, without starting a lookup or waiting for one that's running.
+/// </summary>
+bool SidNameCache::Find(const uint8_t* pSid, size_t cbSid, bool& bFound, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	bFound = false;
+	sDomainName.clear();
+	sUserName.clear();
+	Key_t key;
+	if (!key.Assign(pSid, cbSid))
+		return false;
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	EntryMap_t::const_iterator entryIter = m_entries.find(key);
+	if (m_entries.end() == entryIter)
+	{
+		EntryPtr_t pEntry = FromStore(key);
+		if (!pEntry)
+			return false;
+		entryIter = m_entries.insert(EntryMap_t::value_type(key, pEntry)).first;
+	}
+	const Entry_t& entry = *entryIter->second;
+	if (State_t::Pending == entry.state || (State_t::NotFound == entry.state && now >= entry.expires))
+		return false;
+	++m_hits;
+	bFound = Result(entry, sDomainName, sUserName);
+	return true;
+}
+
+/// <summary>
+/// Cache the result of a lookup made elsewhere.
+/// </summary>
+void SidNameCache::Add(const uint8_t* pSid, size_t cbSid, bool bFound, const std::wstring& sDomainName, const std::wstring& sUserName)
+{
+	Key_t key;
+	if (!key.Assign(pSid, cbSid))
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		EntryPtr_t& pEntry = m_entries[key];
+		// A running lookup's entry is completed in place so that its waiters see the result.
+		if (!pEntry || State_t::Pending != pEntry->state)
+			pEntry = std::make_shared<Entry_t>();
+		Complete(*pEntry, bFound, sDomainName, sUserName);
+	}
+	m_cv.notify_all();
+}
+
+/// <summary>
+/// Internal: store a lookup result in an entry. The caller must hold the lock.
+/// </summary>
+void SidNameCache::Complete(Entry_t& entry, bool bFound, const std::wstring& sDomainName, const std::wstring& sUserName)
+{
+	if (bFound)
+	{
+		entry.state = State_t::Found;
+		entry.sDomainName = sDomainName;
+		entry.sUserName = sUserName;
+		entry.timestamp = SidCacheFile::Now();
+	}
+	else
+	{
+		entry.state = State_t::NotFound;
+		entry.expires = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_negativeTtlMilliseconds);
+	}
+}
+
+/// <summary>
+/// Internal: an entry for a SID from the on-disk cache, or nullptr if it has no fresh entry. The caller must hold the lock.
+/// </summary>
+SidNameCache::EntryPtr_t SidNameCache::FromStore(const Key_t& key) const
+{
+	SidCacheEntry_t storeEntry;
+	if (nullptr == m_pStore || !m_pStore->Find(key.Data(), key.Length(), storeEntry) ||
+		storeEntry.timestamp < SidCacheFile::Now() - m_storeMaxAgeSeconds)
+		return EntryPtr_t();
+	EntryPtr_t pEntry = std::make_shared<Entry_t>();
+	pEntry->state = State_t::Found;
+	pEntry->bFromStore = true;
+	pEntry->sDomainName = storeEntry.sDomainName;
+	pEntry->sUserName = storeEntry.sUserName;
+	pEntry->timestamp = storeEntry.timestamp;
+	return pEntry;
+}
+
+/// <summary>
+/// Internal: copy a completed entry's result to the caller
+/// </summary>
+bool SidNameCache::Result(const Entry_t& entry, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	if (State_t::Found != entry.state)
+		return false;
+	sDomainName = entry.sDomainName;
+	sUserName = entry.sUserName;
+	return true;
+}
+
+/// <summary>
+/// Consult an on-disk cache for SIDs not yet cached in memory.
+/// </summary>
+void SidNameCache::SetStore(const SidCacheFile* pStore, int64_t maxAgeSeconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pStore = pStore;
+	m_storeMaxAgeSeconds = maxAgeSeconds;
+}
+
+/// <summary>
+/// The SIDs resolved successfully by lookups and still cached, for saving to the on-disk cache.
+/// </summary>
+void SidNameCache::Entries(SidCacheEntryList_t& entries) const
+{
+	entries.clear();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	// A SID can be in both maps; SidCacheFile::Write keeps the newer result.
+	const EntryMap_t* entryMaps[] = { &m_flushed, &m_entries };
+	for (size_t ixMap = 0; ixMap < sizeof(entryMaps) / sizeof(entryMaps[0]); ++ixMap)
+	{
+		EntryMap_t::const_iterator entryIter;
+		for (entryIter = entryMaps[ixMap]->begin(); entryIter != entryMaps[ixMap]->end(); entryIter++)
+		{
+			const Entry_t& entry = *entryIter->second;
+			if (State_t::Found == entry.state && !entry.bFromStore)
+			{
+				SidCacheEntry_t storeEntry;
+				storeEntry.sid.assign(entryIter->first.Data(), entryIter->first.Data() + entryIter->first.Length());
+				storeEntry.sDomainName = entry.sDomainName;
+				storeEntry.sUserName = entry.sUserName;
+				storeEntry.timestamp = entry.timestamp;
+				entries.push_back(storeEntry);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Discard the cached names, keeping failures within their TTL and lookups still running.
+/// </summary>
+void SidNameCache::Flush()
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	EntryMap_t::iterator entryIter = m_entries.begin();
+	while (entryIter != m_entries.end())
+	{
+		const Entry_t& entry = *entryIter->second;
+		// A failed SID isn't retried before its TTL passes, and a hung lookup isn't submitted again.
+		if (State_t::Pending == entry.state || (State_t::NotFound == entry.state && now < entry.expires))
+		{
+			entryIter++;
+			continue;
+		}
+		if (State_t::Found == entry.state && !entry.bFromStore)
+			m_flushed[entryIter->first] = entryIter->second;
+		entryIter = m_entries.erase(entryIter);
+	}
+}
+
+size_t SidNameCache::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_entries.size();
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+// SidNameCache.h: process-wide memoization of SID-to-name lookups.
+// The same few SIDs (SYSTEM, Administrators, logon session SIDs, the session users) are looked up over and over
+// for process owners and security descriptor entries; each distinct SID is looked up once and the result reused.
+// Lookups run on a small pool of resolver threads, and callers wait only up to a deadline, so a SID that can't be
+// resolved quickly (an orphaned domain SID, an unreachable domain controller) doesn't stall the report.
+// Many SIDs can be looked up together with one batch translation (e.g., LsaLookupSids2), under the same deadline.
+// Results can also be read from and saved to an on-disk cache shared across runs (SidCacheFile).
+// Portable C++ (no Windows dependencies): the lookup itself is supplied by the caller.
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "WorkerPool.h"
+#include "SidCacheFile.h"
+#include "SidCodec.h"
+
+/// <summary>
+/// Thread-safe cache of SID-to-name lookup results, keyed by the binary SID.
+/// Failed lookups are cached for a limited time (the negative TTL), so an unresolvable SID isn't retried on every
+/// reference. A lookup that misses its deadline keeps running in the background; until it finishes, later requests
+/// for the same SID fail immediately rather than waiting again, and once it finishes its result is cached as usual.
+/// </summary>
+class SidNameCache
+{
+public:
+	/// <summary>
+	/// Function that performs the actual lookup: returns true and sets the domain and user names on success.
+	/// Called on the resolver threads, so it must be safe to call from multiple threads at once.
+	/// </summary>
+	typedef std::function<bool(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)> LookupFn_t;
+
+	/// <summary>
+	/// One SID of a batch lookup, and its result
+	/// </summary>
+	struct BatchItem_t
+	{
+		// Input: binary SID
+		const uint8_t* pSid = nullptr;
+		size_t cbSid = 0;
+		// Output: whether the SID resolved, and its domain and user names
+		bool bFound = false;
+		std::wstring sDomainName, sUserName;
+	};
+	typedef std::vector<BatchItem_t> BatchItemList_t;
+
+	/// <summary>
+	/// Function that looks up many SIDs at once: sets bFound and the names of each item.
+	/// Returns false with sErrorInfo if the batch request as a whole fails; its SIDs are then looked up one at a time.
+	/// Called on the resolver threads, so it must be safe to call from multiple threads at once.
+	/// </summary>
+	typedef std::function<bool(BatchItemList_t& items, std::wstring& sErrorInfo)> BatchLookupFn_t;
+
+	// Defaults
+	static const uint32_t DefaultTimeoutMilliseconds = 3000;
+	static const uint32_t DefaultNegativeTtlMilliseconds = 10 * 60 * 1000;
+	static const size_t DefaultResolverThreads = 4;
+
+	/// <summary>
+	/// Create a cache with its resolver threads.
+	/// Destroying the cache waits for lookups that are still running, so a process-wide instance that might have
+	/// lookups blocked at exit should not be destroyed.
+	/// </summary>
+	explicit SidNameCache(const LookupFn_t& lookup, size_t nResolverThreads = DefaultResolverThreads);
+
+	/// <summary>
+	/// Create a cache that also has a batch lookup, used by LookupBatch.
+	/// </summary>
+	SidNameCache(const LookupFn_t& lookup, const BatchLookupFn_t& batchLookup, size_t nResolverThreads = DefaultResolverThreads);
+	~SidNameCache() = default;
+
+	/// <summary>
+	/// Look up a SID's domain and user names, from the cache if it has been looked up before.
+	/// Concurrent requests for the same uncached SID share one lookup.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: length of the binary SID in bytes</param>
+	/// <param name="sDomainName">Output: domain name; empty on failure</param>
+	/// <param name="sUserName">Output: user name; empty on failure</param>
+	/// <returns>true if the SID resolved to a name before the deadline</returns>
+	bool Lookup(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName);
+
+	/// <summary>
+	/// Look up many SIDs' domain and user names. Cached SIDs are answered from the cache; the rest are looked up
+	/// together with one call to the batch lookup (or one lookup each if the cache has none) on a resolver thread.
+	/// Waits up to one timeout for the whole batch: SIDs still unresolved then are reported not found, and are
+	/// treated like any lookup that missed its deadline.
+	/// </summary>
+	/// <param name="items">Input: SIDs; output: results. Items without a SID are reported not found.</param>
+	void LookupBatch(BatchItemList_t& items);
+
+	/// <summary>
+	/// Look up a SID in the cache only, without starting a lookup or waiting for one that's running.
+	/// </summary>
+	/// <param name="bFound">Output: whether the cached lookup succeeded</param>
+	/// <returns>true if a completed result (success, or failure within its TTL) is cached</returns>
+	bool Find(const uint8_t* pSid, size_t cbSid, bool& bFound, std::wstring& sDomainName, std::wstring& sUserName);
+
+	/// <summary>
+	/// Cache the result of a lookup made elsewhere, such as a batch translation of many SIDs at once.
+	/// Replaces any cached result; callers waiting on a running lookup of the SID get this result.
+	/// </summary>
+	void Add(const uint8_t* pSid, size_t cbSid, bool bFound, const std::wstring& sDomainName, const std::wstring& sUserName);
+
+	/// <summary>
+	/// How long a caller waits for an uncached SID to resolve. 0 means no deadline: the lookup runs on the calling thread.
+	/// </summary>
+	void SetTimeout(uint32_t milliseconds) { m_timeoutMilliseconds = milliseconds; }
+	uint32_t Timeout() const { return m_timeoutMilliseconds; }
+
+	/// <summary>
+	/// How long a failed lookup is remembered before the SID is tried again.
+	/// </summary>
+	void SetNegativeTtl(uint32_t milliseconds) { m_negativeTtlMilliseconds = milliseconds; }
+
+	/// <summary>
+	/// Consult an on-disk cache for SIDs not yet cached in memory, using its entries no older than maxAgeSeconds.
+	/// The file must stay open until SetStore is called again (nullptr to stop using it).
+	/// </summary>
+	void SetStore(const SidCacheFile* pStore, int64_t maxAgeSeconds);
+
+	/// <summary>
+	/// The SIDs resolved successfully by lookups (not from the on-disk cache) and still cached, for saving to the on-disk cache.
+	/// </summary>
+	void Entries(SidCacheEntryList_t& entries) const;
+
+	/// <summary>
+	/// Discard the cached names, so that SIDs are looked up again. Failures are kept until their negative TTL passes,
+	/// and lookups still running are kept and cache their results, so that neither is submitted again.
+	/// The counters are not reset, and successful lookups are still reported by Entries.
+	/// </summary>
+	void Flush();
+
+	// Number of lookups answered from the cache, including those that waited for another caller's lookup
+	uint64_t Hits() const { return m_hits; }
+	// Number of lookups that started a new lookup
+	uint64_t Misses() const { return m_misses; }
+	// Number of lookups that gave up at the deadline, or failed at once because an earlier lookup of the SID had
+	uint64_t Timeouts() const { return m_timeouts; }
+	// Number of distinct SIDs currently cached, including lookups still running
+	size_t Size() const;
+
+private:
+	enum class State_t { Pending, Found, NotFound };
+
+	struct Entry_t
+	{
+		State_t state = State_t::Pending;
+		// Set when a caller gives up waiting on a pending lookup
+		bool bTimedOut = false;
+		// Set when the result came from the on-disk cache
+		bool bFromStore = false;
+		std::wstring sDomainName, sUserName;
+		// When a NotFound entry may be retried
+		std::chrono::steady_clock::time_point expires;
+		// When the result was obtained, in seconds since 1970-01-01 UTC
+		int64_t timestamp = 0;
+	};
+	typedef std::shared_ptr<Entry_t> EntryPtr_t;
+
+	/// <summary>
+	/// A binary SID held inline, like SidInfo_t's, so that a lookup's key doesn't allocate
+	/// </summary>
+	struct Key_t
+	{
+		uint8_t bytes[SidCodec::MaxBinaryLength] = {};
+		uint8_t cbSid = 0;
+
+		const uint8_t* Data() const { return bytes; }
+		size_t Length() const { return cbSid; }
+
+		// Returns false if there is no SID, or it's longer than any SID can be
+		bool Assign(const uint8_t* pSid, size_t cb);
+
+		bool operator == (const Key_t& other) const { return cbSid == other.cbSid && 0 == memcmp(bytes, other.bytes, cbSid); }
+
+		// FNV-1a over the SID bytes
+		struct Hash_t
+		{
+			size_t operator()(const Key_t& key) const;
+		};
+	};
+
+	typedef std::unordered_map<Key_t, EntryPtr_t, Key_t::Hash_t> EntryMap_t;
+	typedef std::vector<Key_t> KeyList_t;
+	typedef std::vector<EntryPtr_t> EntryList_t;
+
+	/// <summary>
+	/// Internal: the entry for a SID -- cached in memory or on disk, or a new pending entry (bNew) that the caller
+	/// must resolve. Counts hits and misses; a pending entry that timed out is the caller's to count. The caller must hold the lock.
+	/// </summary>
+	EntryPtr_t Acquire(const Key_t& key, const std::chrono::steady_clock::time_point& now, bool& bNew);
+
+	/// <summary>
+	/// Internal: perform one lookup and publish its result to the entry
+	/// </summary>
+	void Resolve(const Key_t& key, const EntryPtr_t& pEntry);
+
+	/// <summary>
+	/// Internal: perform one batch lookup and publish its results to the entries
+	/// </summary>
+	void ResolveBatch(const KeyList_t& keys, const EntryList_t& entries);
+
+	/// <summary>
+	/// Internal: store a lookup result in an entry. The caller must hold the lock.
+	/// </summary>
+	void Complete(Entry_t& entry, bool bFound, const std::wstring& sDomainName, const std::wstring& sUserName);
+
+	/// <summary>
+	/// Internal: an entry for a SID from the on-disk cache, or nullptr if it has no fresh entry. The caller must hold the lock.
+	/// </summary>
+	EntryPtr_t FromStore(const Key_t& key) const;
+
+	/// <summary>
+	/// Internal: copy a completed entry's result to the caller
+	/// </summary>
+	static bool Result(const Entry_t& entry, std::wstring& sDomainName, std::wstring& sUserName);
+
+	const LookupFn_t m_lookup;
+	// Empty if the cache has no batch lookup
+	const BatchLookupFn_t m_batchLookup;
+	std::atomic<uint32_t> m_timeoutMilliseconds;
+	std::atomic<uint32_t> m_negativeTtlMilliseconds;
+	mutable std::mutex m_mutex;
+	// Signaled whenever a pending entry completes
+	std::condition_variable m_cv;
+	EntryMap_t m_entries;
+	// Successful lookups discarded by Flush, kept for Entries
+	EntryMap_t m_flushed;
+	const SidCacheFile* m_pStore;
+	int64_t m_storeMaxAgeSeconds;
+	std::atomic<uint64_t> m_hits;
+	std::atomic<uint64_t> m_misses;
+	std::atomic<uint64_t> m_timeouts;
+	// Declared last so that it's destroyed first, while running lookups can still publish their results
+	WorkerPool m_resolvers;
+
+private:
+	// Not implemented
+	SidNameCache(const SidNameCache&) = delete;
+	SidNameCache& operator = (const SidNameCache&) = delete;
+};
@@ -0,0 +1,497 @@
+// SnapshotCollector.cpp: queries a SystemSource and fills a SystemSnapshot_t.
+
+#include "SnapshotCollector.h"
+#include <algorithm>
+#include <utility>
+#include "WorkerPool.h"
+#include "Timings.h"
+
+SnapshotCollector::SnapshotCollector(SystemSource& source, const CollectionOptions_t& options)
+	: m_source(source), m_options(options), m_plan(PlanQueries(options.fields))
+{
+}
+
+/// <summary>
+/// Collect everything requested by the options.
+/// </summary>
+void SnapshotCollector::Collect(SystemSnapshot_t& snapshot) const
+{
+	// One process enumeration, shared by the sessions' process lists and the windows' process image paths
+	Captured_t<ProcessTable> processes;
+	// Every SID collected, for one batch name resolution at the end
+	SidNameBatch sidNames;
+	if (m_plan.bCurrentInfo)
+		CollectCurrentInfo(snapshot.currentInfo, sidNames);
+	if (m_plan.bSessions)
+		CollectSessions(snapshot.sessions, processes, sidNames);
+	if (m_plan.bWindowStations)
+		CollectWindowStations(snapshot.windowStations, processes.value, sidNames);
+	ResolveSidNames(sidNames);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Collect information about the context this process is running in.
+/// </summary>
+void SnapshotCollector::CollectCurrentInfo(CurrentInfoSnapshot_t& currentInfo) const
+{
+	SidNameBatch sidNames;
+	CollectCurrentInfo(currentInfo, sidNames);
+	ResolveSidNames(sidNames);
+}
+
+/// <summary>
+/// Internal: collect information about the context this process is running in, adding its SIDs to the batch
+/// </summary>
+void SnapshotCollector::CollectCurrentInfo(CurrentInfoSnapshot_t& currentInfo, SidNameBatch& sidNames) const
+{
+	TIMING_PHASE(CurrentInfo);
+	m_source.CurrentInfo(currentInfo);
+	sidNames.AddCurrentInfo(currentInfo);
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Collect all terminal sessions, using the configured number of threads.
+/// </summary>
+void SnapshotCollector::CollectSessions(Captured_t<SessionSnapshotList_t>& sessions, Captured_t<ProcessTable>& processes) const
+{
+	SidNameBatch sidNames;
+	CollectSessions(sessions, processes, sidNames);
+	ResolveSidNames(sidNames);
+}
+
+/// <summary>
+/// Internal: collect all terminal sessions, adding their SIDs to the batch
+/// </summary>
+void SnapshotCollector::CollectSessions(Captured_t<SessionSnapshotList_t>& sessions, Captured_t<ProcessTable>& processes, SidNameBatch& sidNames) const
+{
+	TIMING_PHASE(Sessions);
+	SessionSnapshotList_t sessionList;
+	std::wstring sErrorInfo;
+	if (!m_source.EnumerateSessions(sessionList, sErrorInfo))
+	{
+		sessions.SetError(sErrorInfo);
+		return;
+	}
+
+	// The user selector matches on information that only WTSSessionInfoEx provides.
+	// If the query fails (e.g., the session just ended), the enumerated ID, name, and state remain.
+	bool bQuerySessionInfoEx = m_plan.bSessionInfoEx || !m_options.selection.users.IsEmpty();
+	if (bQuerySessionInfoEx)
+	{
+		SessionSnapshotList_t::iterator sessionIter;
+		for (sessionIter = sessionList.begin(); sessionIter != sessionList.end(); sessionIter++)
+		{
+			SessionSnapshot_t sessionInfo;
+			if (m_source.QuerySessionInfo(sessionIter->dwSessionId, sessionInfo, sErrorInfo))
+				CopySessionInfo(sessionInfo, *sessionIter);
+		}
+	}
+
+	// Drop unselected sessions before any per-session queries (user token, processes).
+	if (!m_options.selection.IsEmpty())
+	{
+		sessionList.erase(
+			std::remove_if(sessionList.begin(), sessionList.end(), [this](const SessionSnapshot_t& session) { return !IsSelected(session); }),
+			sessionList.end());
+	}
+
+	if (m_plan.bProcesses && !sessionList.empty())
+		CollectProcesses(processes);
+
+	if (m_options.nThreads <= 1 || sessionList.size() <= 1)
+	{
+		SessionSnapshotList_t::iterator sessionIter;
+		for (sessionIter = sessionList.begin(); sessionIter != sessionList.end(); sessionIter++)
+		{
+			CollectSessionDetails(*sessionIter, processes);
+		}
+	}
+	else
+	{
+		// Each worker collects one session; results are appended in the original session order.
+		WorkerPool pool(std::min(m_options.nThreads, sessionList.size()));
+		SessionSnapshotList_t collected;
+		collected.reserve(sessionList.size());
+		ForEachOrdered(
+			pool, sessionList.begin(), sessionList.end(),
+			[this, &processes](const SessionSnapshot_t& session)
+			{
+				SessionSnapshot_t sessionSnapshot = session;
+				CollectSessionDetails(sessionSnapshot, processes);
+				return sessionSnapshot;
+			},
+			[&collected](const SessionSnapshot_t& sessionSnapshot)
+			{
+				collected.push_back(sessionSnapshot);
+			});
+		sessionList.swap(collected);
+	}
+	sessions.Set(sessionList);
+	sidNames.AddSessions(sessions.value);
+}
+
+/// <summary>
+/// Collect one terminal session by session ID. Safe to call concurrently for different sessions.
+/// </summary>
+bool SnapshotCollector::CollectSession(uint32_t dwSessionId, SessionSnapshot_t& sessionSnapshot, std::wstring& sErrorInfo) const
+{
+	std::vector<Captured_t<SessionSnapshot_t>> collected;
+	CollectSessions(std::vector<uint32_t>(1, dwSessionId), collected);
+	if (!collected[0].bValid)
+	{
+		sErrorInfo = collected[0].sErrorInfo;
+		return false;
+	}
+	sessionSnapshot = std::move(collected[0].value);
+	return true;
+}
+
+/// <summary>
+/// Collect terminal sessions by session ID, with one process enumeration and one SID name lookup for all of them.
+/// Safe to call concurrently.
+/// </summary>
+void SnapshotCollector::CollectSessions(const std::vector<uint32_t>& sessionIds, std::vector<Captured_t<SessionSnapshot_t>>& sessionSnapshots) const
+{
+	TIMING_PHASE(Sessions);
+	sessionSnapshots.assign(sessionIds.size(), Captured_t<SessionSnapshot_t>());
+	bool bAnySelected = false;
+	for (size_t ix = 0; ix < sessionIds.size(); ++ix)
+	{
+		SessionSnapshot_t sessionInfo;
+		std::wstring sErrorInfo;
+		if (!m_source.QuerySessionInfo(sessionIds[ix], sessionInfo, sErrorInfo))
+		{
+			sessionSnapshots[ix].SetError(sErrorInfo);
+			continue;
+		}
+		if (!IsSelected(sessionInfo))
+		{
+			sessionSnapshots[ix].SetError(L"Session not selected");
+			continue;
+		}
+		SessionSnapshot_t& sessionSnapshot = sessionSnapshots[ix].value;
+		sessionSnapshot.dwSessionId = sessionInfo.dwSessionId;
+		sessionSnapshot.sName = sessionInfo.sName;
+		sessionSnapshot.state = sessionInfo.state;
+		sessionSnapshot.sState = sessionInfo.sState;
+		if (m_plan.bSessionInfoEx)
+			CopySessionInfo(sessionInfo, sessionSnapshot);
+		sessionSnapshots[ix].bValid = true;
+		bAnySelected = true;
+	}
+
+	// The sessions take their processes from a single enumeration, as in a full collection.
+	Captured_t<ProcessTable> processes;
+	if (m_plan.bProcesses && bAnySelected)
+		CollectProcesses(processes);
+	SidNameBatch sidNames;
+	std::vector<Captured_t<SessionSnapshot_t>>::iterator sessionIter;
+	for (sessionIter = sessionSnapshots.begin(); sessionIter != sessionSnapshots.end(); sessionIter++)
+	{
+		if (sessionIter->bValid)
+		{
+			CollectSessionDetails(sessionIter->value, processes);
+			sidNames.AddSession(sessionIter->value);
+		}
+	}
+	ResolveSidNames(sidNames);
+}
+
+/// <summary>
+/// Internal: whether the session is selected. Uses only the information already retrieved for the session.
+/// </summary>
+bool SnapshotCollector::IsSelected(const SessionSnapshot_t& session) const
+{
+	return m_options.selection.MatchesSession(session.dwSessionId, session.sName, session.sDomainName, session.sUserName, session.sState);
+}
+
+/// <summary>
+/// Internal: enumerate every process on the system once
+/// </summary>
+void SnapshotCollector::CollectProcesses(Captured_t<ProcessTable>& processes) const
+{
+	TIMING_PHASE(Processes);
+	std::wstring sErrorInfo;
+	if (m_source.EnumerateProcesses(processes.value, sErrorInfo))
+	{
+		processes.bValid = true;
+		processes.sErrorInfo.clear();
+	}
+	else
+	{
+		processes.SetError(sErrorInfo);
+	}
+}
+
+/// <summary>
+/// Internal: collect a session's user token(s), and take its processes from the system-wide enumeration.
+/// </summary>
+void SnapshotCollector::CollectSessionDetails(SessionSnapshot_t& sessionSnapshot, const Captured_t<ProcessTable>& processes) const
+{
+	if (m_plan.bUserToken)
+	{
+		TIMING_PHASE(Tokens);
+		// Token user names aren't looked up.
+		m_source.QueryUserToken(sessionSnapshot.dwSessionId, sessionSnapshot);
+	}
+
+	if (m_plan.bProcesses)
+	{
+		TIMING_PHASE(Processes);
+		sessionSnapshot.bProcessesCollected = true;
+		if (processes.bValid)
+		{
+			// Owner names are resolved afterward, in one batch for all sessions.
+			ProcessSnapshotList_t processList;
+			processes.value.SessionProcesses(sessionSnapshot.dwSessionId, processList);
+			sessionSnapshot.processes.Set(processList);
+		}
+		else
+		{
+			sessionSnapshot.processes.SetError(processes.sErrorInfo);
+		}
+	}
+}
+
+/// <summary>
+/// Internal: copy the WTSSessionInfoEx information from a QuerySessionInfo result
+/// </summary>
+void SnapshotCollector::CopySessionInfo(const SessionSnapshot_t& sessionInfo, SessionSnapshot_t& sessionSnapshot)
+{
+	sessionSnapshot.sessionFlags = sessionInfo.sessionFlags;
+	sessionSnapshot.sSessionFlags = sessionInfo.sSessionFlags;
+	sessionSnapshot.sDomainName = sessionInfo.sDomainName;
+	sessionSnapshot.sUserName = sessionInfo.sUserName;
+	sessionSnapshot.logonTime = sessionInfo.logonTime;
+	sessionSnapshot.connectTime = sessionInfo.connectTime;
+	sessionSnapshot.disconnectTime = sessionInfo.disconnectTime;
+	sessionSnapshot.lastInputTime = sessionInfo.lastInputTime;
+	sessionSnapshot.currentTime = sessionInfo.currentTime;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Collect the window stations in the current session, and their desktops.
+/// Not thread-safe: window enumeration switches the process' window station.
+/// </summary>
+void SnapshotCollector::CollectWindowStations(Captured_t<WindowStationSnapshotList_t>& windowStations, ProcessTable& processes) const
+{
+	SidNameBatch sidNames;
+	CollectWindowStations(windowStations, processes, sidNames);
+	ResolveSidNames(sidNames);
+}
+
+/// <summary>
+/// Internal: collect the window stations in the current session, adding their SIDs to the batch
+/// </summary>
+void SnapshotCollector::CollectWindowStations(Captured_t<WindowStationSnapshotList_t>& windowStations, ProcessTable& processes, SidNameBatch& sidNames) const
+{
+	TIMING_PHASE(WindowStations);
+	std::vector<std::wstring> wsNameList;
+	std::wstring sErrorInfo;
+	if (!m_source.WindowStationNames(wsNameList, sErrorInfo))
+	{
+		windowStations.SetError(sErrorInfo);
+		return;
+	}
+
+	WindowStationSnapshotList_t wsList;
+	std::vector<std::wstring>::const_iterator wsNameIter;
+	for (wsNameIter = wsNameList.begin(); wsNameIter != wsNameList.end(); wsNameIter++)
+	{
+		// Unselected window stations aren't opened at all.
+		if (!m_options.selection.MatchesWindowStation(*wsNameIter))
+			continue;
+
+		wsList.push_back(WindowStationSnapshot_t());
+		WindowStationSnapshot_t& wsSnapshot = wsList.back();
+		wsSnapshot.sName = *wsNameIter;
+
+		// Names only: nothing else requires the window station to be opened.
+		if (!m_plan.bOpenWindowStations)
+			continue;
+
+		std::unique_ptr<SourceWindowStation> pWs = m_source.OpenWindowStation(*wsNameIter, sErrorInfo);
+		if (!pWs)
+		{
+			wsSnapshot.sOpenError = sErrorInfo;
+			continue;
+		}
+		wsSnapshot.bOpened = true;
+
+		std::wstring sFlags;
+		if (m_plan.bWindowStationFlags)
+		{
+			if (pWs->Flags(sFlags, sErrorInfo))
+				wsSnapshot.flags.Set(sFlags);
+			else
+				wsSnapshot.flags.SetError(sErrorInfo);
+		}
+		if (m_plan.bWindowStationUser)
+			CollectUserObjectSid(*pWs, wsSnapshot.user);
+		if (m_plan.bWindowStationSecurity)
+			CollectUserObjectSecurity(*pWs, wsSnapshot.securityDescriptor);
+
+		if (!m_plan.bDesktops)
+			continue;
+
+		std::vector<std::wstring> desktopNameList;
+		if (pWs->DesktopNames(desktopNameList, sErrorInfo))
+		{
+			DesktopSnapshotList_t desktopList;
+			std::vector<std::wstring>::const_iterator desktopNameIter;
+			for (desktopNameIter = desktopNameList.begin(); desktopNameIter != desktopNameList.end(); desktopNameIter++)
+			{
+				// Unselected desktops aren't opened, so their windows and security descriptors aren't queried.
+				if (!m_options.selection.MatchesDesktop(*desktopNameIter))
+					continue;
+				desktopList.push_back(DesktopSnapshot_t());
+				CollectDesktop(*pWs, *desktopNameIter, processes, desktopList.back());
+			}
+			wsSnapshot.desktops.Set(desktopList);
+		}
+		else
+		{
+			wsSnapshot.desktops.SetError(sErrorInfo);
+		}
+	}
+	windowStations.Set(wsList);
+	sidNames.AddWindowStations(windowStations.value);
+}
+
+/// <summary>
+/// Internal: collect one desktop in an opened window station
+/// </summary>
+void SnapshotCollector::CollectDesktop(const SourceWindowStation& ws, const std::wstring& sDesktopName, ProcessTable& processes, DesktopSnapshot_t& desktopSnapshot) const
+{
+	TIMING_PHASE(Desktops);
+	std::wstring sErrorInfo;
+	desktopSnapshot.sName = sDesktopName;
+
+	// Names only: nothing else requires the desktop to be opened.
+	if (!m_plan.bOpenDesktops)
+		return;
+
+	std::unique_ptr<SourceDesktop> pDesk = ws.OpenDesktop(sDesktopName, sErrorInfo);
+	if (!pDesk)
+	{
+		desktopSnapshot.sOpenError = sErrorInfo;
+		return;
+	}
+	desktopSnapshot.bOpened = true;
+
+	std::wstring sFlags;
+	if (m_plan.bDesktopFlags)
+	{
+		if (pDesk->Flags(sFlags, sErrorInfo))
+			desktopSnapshot.flags.Set(sFlags);
+		else
+			desktopSnapshot.flags.SetError(sErrorInfo);
+	}
+	if (m_plan.bDesktopUser)
+		CollectUserObjectSid(*pDesk, desktopSnapshot.user);
+	if (m_plan.bDesktopHeapSize)
+	{
+		uint32_t heapSizeKb = 0;
+		if (pDesk->HeapSize(heapSizeKb, sErrorInfo))
+			desktopSnapshot.heapSizeKb.Set(heapSizeKb);
+		else
+			desktopSnapshot.heapSizeKb.SetError(sErrorInfo);
+	}
+	if (m_plan.bDesktopInput)
+	{
+		bool bIsReceivingInput = false;
+		if (pDesk->IsReceivingInput(bIsReceivingInput, sErrorInfo))
+			desktopSnapshot.receivingInput.Set(bIsReceivingInput);
+		else
+			desktopSnapshot.receivingInput.SetError(sErrorInfo);
+	}
+
+	if (m_plan.bDesktopSecurity)
+		CollectUserObjectSecurity(*pDesk, desktopSnapshot.securityDescriptor);
+
+	if (m_plan.bDesktopWindows)
+	{
+		desktopSnapshot.bWindowsCollected = true;
+		CollectDesktopWindows(*pDesk, processes, desktopSnapshot.windows);
+	}
+}
+
+/// <summary>
+/// Internal: collect the user SID of a window station or desktop
+/// </summary>
+void SnapshotCollector::CollectUserObjectSid(const SourceUserObject& obj, Captured_t<SidInfo_t>& user) const
+{
+	std::wstring sErrorInfo;
+	SidInfo_t sidInfo;
+	if (obj.User(sidInfo, sErrorInfo))
+	{
+		// Empty if there's no user associated with the object
+		user.Set(sidInfo);
+	}
+	else
+	{
+		user.SetError(sErrorInfo);
+	}
+}
+
+/// <summary>
+/// Internal: collect the security descriptor of a window station or desktop
+/// </summary>
+void SnapshotCollector::CollectUserObjectSecurity(const SourceUserObject& obj, SecurityDescriptorSnapshot_t& sdSnapshot)
+{
+	TIMING_PHASE(SecurityDescriptors);
+	sdSnapshot.bCollected = true;
+	std::wstring sErrorInfo;
+	std::vector<uint8_t> sd;
+	if (obj.Security(sd, sdSnapshot.securityInformation, sErrorInfo))
+		sdSnapshot.sd.Set(sd);
+	else
+		sdSnapshot.sd.SetError(sErrorInfo);
+}
+
+/// <summary>
+/// Internal: collect the top-level windows on a desktop, and join each to its process' image path.
+/// Many windows typically belong to the same few processes, so each PID is resolved only once per collection.
+/// </summary>
+void SnapshotCollector::CollectDesktopWindows(SourceDesktop& desktop, ProcessTable& processes, Captured_t<WindowSnapshotList_t>& windows) const
+{
+	TIMING_PHASE(Windows);
+	WindowSnapshotList_t windowList;
+	std::wstring sErrorInfo;
+	if (!desktop.TopLevelWindows(windowList, sErrorInfo))
+	{
+		windows.SetError(sErrorInfo);
+		return;
+	}
+	WindowSnapshotList_t::iterator windowIter;
+	for (windowIter = windowList.begin(); windowIter != windowList.end(); windowIter++)
+	{
+		if (0 == windowIter->PID || processes.FindImagePath(windowIter->PID, windowIter->sProcessPath))
+			continue;
+		// On failure, the error information is reported in place of the path.
+		std::wstring sPathError;
+		if (!m_source.ProcessImagePath(windowIter->PID, windowIter->sProcessPath, sPathError))
+			windowIter->sProcessPath = sPathError;
+		processes.SetImagePath(windowIter->PID, windowIter->sProcessPath);
+	}
+	windows.Set(windowList);
+	// TopLevelWindows can succeed with a warning
+	windows.sErrorInfo = sErrorInfo;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: resolve the names of the SIDs in the batch
+/// </summary>
+void SnapshotCollector::ResolveSidNames(SidNameBatch& sidNames) const
+{
+	TIMING_PHASE(SidNames);
+	sidNames.Resolve(m_source);
+}
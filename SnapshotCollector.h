@@ -0,0 +1,160 @@
+#pragma once
+
+// SnapshotCollector.h: queries a SystemSource and fills a SystemSnapshot_t.
+// All queries for the report are made here; renderers work only from the snapshot.
+// SID names are resolved last, with one batch request for every distinct SID collected.
+// Portable C++ (no Windows dependencies): the operating-system calls are behind SystemSource.
+
+#include <string>
+#include "SystemSnapshot.h"
+#include "SystemSource.h"
+#include "Selector.h"
+#include "QueryPlan.h"
+#include "SidNameBatch.h"
+
+/// <summary>
+/// Options controlling what gets collected. Anything not requested is left marked as not collected.
+/// </summary>
+struct CollectionOptions_t
+{
+	// Fields to collect (typically a renderer's RequiredFields()); queries needed only for other fields are skipped.
+	FieldSet_t fields = Field_Default;
+	// Number of threads for per-session collection
+	size_t nThreads = 1;
+	// Sessions, window stations, and desktops to collect; everything if empty
+	SelectionOptions_t selection;
+};
+
+/// <summary>
+/// Collects a SystemSnapshot_t
+/// </summary>
+class SnapshotCollector
+{
+public:
+	/// <summary>
+	/// Collect from the supplied source (which must outlive the collector).
+	/// </summary>
+	SnapshotCollector(SystemSource& source, const CollectionOptions_t& options);
+	~SnapshotCollector() = default;
+
+	/// <summary>
+	/// The queries that the configured fields require
+	/// </summary>
+	const QueryPlan_t& Plan() const { return m_plan; }
+
+	/// <summary>
+	/// Collect everything requested by the options.
+	/// </summary>
+	void Collect(SystemSnapshot_t& snapshot) const;
+
+	/// <summary>
+	/// Collect information about the context this process is running in.
+	/// </summary>
+	void CollectCurrentInfo(CurrentInfoSnapshot_t& currentInfo) const;
+
+	/// <summary>
+	/// Collect all terminal sessions, using the configured number of threads.
+	/// </summary>
+	/// <param name="sessions">Output: the selected sessions</param>
+	/// <param name="processes">Output: all processes on the system, if the plan includes processes</param>
+	void CollectSessions(Captured_t<SessionSnapshotList_t>& sessions, Captured_t<ProcessTable>& processes) const;
+
+	/// <summary>
+	/// Collect one terminal session by session ID. Safe to call concurrently for different sessions.
+	/// </summary>
+	/// <param name="dwSessionId">Input: session to collect</param>
+	/// <param name="sessionSnapshot">Output: the session's information</param>
+	/// <param name="sErrorInfo">Output: information if the session can't be queried (e.g., it no longer exists) or isn't selected</param>
+	/// <returns>true if successful, false otherwise</returns>
+	bool CollectSession(uint32_t dwSessionId, SessionSnapshot_t& sessionSnapshot, std::wstring& sErrorInfo) const;
+
+	/// <summary>
+	/// Collect terminal sessions by session ID, with one process enumeration and one SID name lookup for all of them.
+	/// Safe to call concurrently.
+	/// </summary>
+	/// <param name="sessionIds">Input: sessions to collect</param>
+	/// <param name="sessionSnapshots">Output: one per session ID, in the same order; not valid if the session can't be queried (e.g., it no longer exists) or isn't selected</param>
+	void CollectSessions(const std::vector<uint32_t>& sessionIds, std::vector<Captured_t<SessionSnapshot_t>>& sessionSnapshots) const;
+
+	/// <summary>
+	/// Collect the window stations in the current session, and their desktops.
+	/// Not thread-safe: window enumeration switches the process' window station.
+	/// </summary>
+	/// <param name="windowStations">Output: the selected window stations</param>
+	/// <param name="processes">Input/output: windows' process image paths are looked up here first, and added when resolved</param>
+	void CollectWindowStations(Captured_t<WindowStationSnapshotList_t>& windowStations, ProcessTable& processes) const;
+
+private:
+	/// <summary>
+	/// Internal: whether the session is selected. Uses only the information already retrieved for the session.
+	/// </summary>
+	bool IsSelected(const SessionSnapshot_t& session) const;
+
+	/// <summary>
+	/// Internal: collect information about the context this process is running in, adding its SIDs to the batch
+	/// </summary>
+	void CollectCurrentInfo(CurrentInfoSnapshot_t& currentInfo, SidNameBatch& sidNames) const;
+
+	/// <summary>
+	/// Internal: collect all terminal sessions, adding their SIDs to the batch
+	/// </summary>
+	void CollectSessions(Captured_t<SessionSnapshotList_t>& sessions, Captured_t<ProcessTable>& processes, SidNameBatch& sidNames) const;
+
+	/// <summary>
+	/// Internal: collect the window stations in the current session, adding their SIDs to the batch
+	/// </summary>
+	void CollectWindowStations(Captured_t<WindowStationSnapshotList_t>& windowStations, ProcessTable& processes, SidNameBatch& sidNames) const;
+
+	/// <summary>
+	/// Internal: resolve the names of the SIDs in the batch
+	/// </summary>
+	void ResolveSidNames(SidNameBatch& sidNames) const;
+
+	/// <summary>
+	/// Internal: enumerate every process on the system once
+	/// </summary>
+	void CollectProcesses(Captured_t<ProcessTable>& processes) const;
+
+	/// <summary>
+	/// Internal: collect a session's user token(s), and take its processes from the system-wide enumeration.
+	/// The session's ID, name, state (and WTSSessionInfoEx information, if planned) must already be filled in.
+	/// Safe to call concurrently for different sessions.
+	/// </summary>
+	void CollectSessionDetails(SessionSnapshot_t& sessionSnapshot, const Captured_t<ProcessTable>& processes) const;
+
+	/// <summary>
+	/// Internal: copy the WTSSessionInfoEx information from a QuerySessionInfo result
+	/// </summary>
+	static void CopySessionInfo(const SessionSnapshot_t& sessionInfo, SessionSnapshot_t& sessionSnapshot);
+
+	/// <summary>
+	/// Internal: collect one desktop in an opened window station
+	/// </summary>
+	void CollectDesktop(const SourceWindowStation& ws, const std::wstring& sDesktopName, ProcessTable& processes, DesktopSnapshot_t& desktopSnapshot) const;
+
+	/// <summary>
+	/// Internal: collect the user SID of a window station or desktop
+	/// </summary>
+	void CollectUserObjectSid(const SourceUserObject& obj, Captured_t<SidInfo_t>& user) const;
+
+	/// <summary>
+	/// Internal: collect the security descriptor of a window station or desktop
+	/// </summary>
+	static void CollectUserObjectSecurity(const SourceUserObject& obj, SecurityDescriptorSnapshot_t& sdSnapshot);
+
+	/// <summary>
+	/// Internal: collect the top-level windows on a desktop, and join each to its process' image path.
+	/// Each PID's image path is resolved only once per collection.
+	/// </summary>
+	void CollectDesktopWindows(SourceDesktop& desktop, ProcessTable& processes, Captured_t<WindowSnapshotList_t>& windows) const;
+
+private:
+	SystemSource& m_source;
+	const CollectionOptions_t m_options;
+	const QueryPlan_t m_plan;
+
+private:
+	// Not implemented
+	SnapshotCollector(const SnapshotCollector&) = delete;
+	SnapshotCollector& operator = (const SnapshotCollector&) = delete;
+};
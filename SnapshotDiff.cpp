@@ -0,0 +1,377 @@
+// SnapshotDiff.cpp: computes what was added, removed, or changed between two SystemSnapshot_t samples.
+
+#include "SnapshotDiff.h"
+#include <functional>
+#include <unordered_map>
+
+// ------------------------------------------------------------------------------------------
+// Internal comparison helpers
+
+static bool SameCaptureStatus(bool bValidA, const std::wstring& sErrorA, bool bValidB, const std::wstring& sErrorB)
+{
+	return bValidA == bValidB && sErrorA == sErrorB;
+}
+
+/// <summary>
+/// Captured values are the same if both have the same status and, if valid, equal values (compared with sameFn).
+/// </summary>
+template <typename T, typename SameFn_t>
+static bool SameCaptured(const Captured_t<T>& a, const Captured_t<T>& b, SameFn_t sameFn)
+{
+	return SameCaptureStatus(a.bValid, a.sErrorInfo, b.bValid, b.sErrorInfo) && (!a.bValid || sameFn(a.value, b.value));
+}
+
+template <typename T>
+static bool SameCaptured(const Captured_t<T>& a, const Captured_t<T>& b)
+{
+	return SameCaptured(a, b, [](const T& x, const T& y) { return x == y; });
+}
+
+static bool SameSid(const SidInfo_t& a, const SidInfo_t& b)
+{
+	return a == b && a.Name() == b.Name();
+}
+
+static bool SameToken(const TokenSnapshot_t& a, const TokenSnapshot_t& b)
+{
+	return
+		SameSid(a.user, b.user) &&
+		a.logonSessionHigh == b.logonSessionHigh &&
+		a.logonSessionLow == b.logonSessionLow &&
+		a.integrityLevel == b.integrityLevel;
+}
+
+static bool SameProcess(const ProcessSnapshot_t& a, const ProcessSnapshot_t& b)
+{
+	return a.sProcessName == b.sProcessName && SameSid(a.user, b.user);
+}
+
+static bool SameSession(const SessionSnapshot_t& a, const SessionSnapshot_t& b)
+{
+	// CurrentTime and LastInputTime are deliberately not compared.
+	if (!(
+		a.dwSessionId == b.dwSessionId &&
+		a.sName == b.sName &&
+		a.state == b.state &&
+		a.sessionFlags == b.sessionFlags &&
+		a.sDomainName == b.sDomainName &&
+		a.sUserName == b.sUserName &&
+		a.logonTime == b.logonTime &&
+		a.connectTime == b.connectTime &&
+		a.disconnectTime == b.disconnectTime &&
+		a.tokenStatus == b.tokenStatus &&
+		a.sTokenError == b.sTokenError &&
+		a.bHasLinkedToken == b.bHasLinkedToken &&
+		a.bProcessesCollected == b.bProcessesCollected
+		))
+		return false;
+	if (TokenStatus_t::Retrieved == a.tokenStatus && !SameToken(a.token, b.token))
+		return false;
+	if (a.bHasLinkedToken && !SameToken(a.linkedToken, b.linkedToken))
+		return false;
+	// Individual processes are compared separately.
+	if (a.bProcessesCollected && !SameCaptureStatus(a.processes.bValid, a.processes.sErrorInfo, b.processes.bValid, b.processes.sErrorInfo))
+		return false;
+	return true;
+}
+
+static bool SameSecurityDescriptor(const SecurityDescriptorSnapshot_t& a, const SecurityDescriptorSnapshot_t& b)
+{
+	return
+		a.bCollected == b.bCollected &&
+		a.securityInformation == b.securityInformation &&
+		SameCaptured(a.sd, b.sd);
+}
+
+static bool SameWindow(const WindowSnapshot_t& a, const WindowSnapshot_t& b)
+{
+	return
+		a.bIsValid == b.bIsValid &&
+		a.bIsVisible == b.bIsVisible &&
+		a.PID == b.PID &&
+		a.TID == b.TID &&
+		a.sProcessPath == b.sProcessPath &&
+		a.sClassName == b.sClassName &&
+		a.sWindowText == b.sWindowText;
+}
+
+/// <summary>
+/// Compares a desktop's own attributes. Its windows and security descriptor are compared separately.
+/// </summary>
+static bool SameDesktop(const DesktopSnapshot_t& a, const DesktopSnapshot_t& b)
+{
+	return
+		a.sName == b.sName &&
+		a.bOpened == b.bOpened &&
+		a.sOpenError == b.sOpenError &&
+		SameCaptured(a.flags, b.flags) &&
+		SameCaptured(a.user, b.user, SameSid) &&
+		SameCaptured(a.heapSizeKb, b.heapSizeKb) &&
+		SameCaptured(a.receivingInput, b.receivingInput) &&
+		a.bWindowsCollected == b.bWindowsCollected &&
+		(!a.bWindowsCollected || SameCaptureStatus(a.windows.bValid, a.windows.sErrorInfo, b.windows.bValid, b.windows.sErrorInfo));
+}
+
+/// <summary>
+/// Compares a window station's own attributes. Its desktops and security descriptor are compared separately.
+/// </summary>
+static bool SameWindowStation(const WindowStationSnapshot_t& a, const WindowStationSnapshot_t& b)
+{
+	return
+		a.sName == b.sName &&
+		a.bOpened == b.bOpened &&
+		a.sOpenError == b.sOpenError &&
+		SameCaptured(a.flags, b.flags) &&
+		SameCaptured(a.user, b.user, SameSid) &&
+		SameCaptureStatus(a.desktops.bValid, a.desktops.sErrorInfo, b.desktops.bValid, b.desktops.sErrorInfo);
+}
+
+static bool SameCurrentInfo(const CurrentInfoSnapshot_t& a, const CurrentInfoSnapshot_t& b)
+{
+	return
+		SameCaptured(a.sessionId, b.sessionId) &&
+		SameCaptured(a.winstaName, b.winstaName) &&
+		SameCaptured(a.winstaFlags, b.winstaFlags) &&
+		SameCaptured(a.winstaUser, b.winstaUser, SameSid) &&
+		SameCaptured(a.desktopName, b.desktopName) &&
+		SameCaptured(a.desktopFlags, b.desktopFlags) &&
+		SameCaptured(a.desktopUser, b.desktopUser, SameSid) &&
+		SameCaptured(a.desktopHeapSizeKb, b.desktopHeapSizeKb) &&
+		SameSid(a.runningAs, b.runningAs) &&
+		SameCaptured(a.inputDesktopName, b.inputDesktopName) &&
+		a.activeConsoleSessionId == b.activeConsoleSessionId &&
+		a.bChildSessionsEnabled == b.bChildSessionsEnabled;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: match the items in two lists by key (one hash lookup per item) and record the items that were
+/// removed (in "before" order), then the items that were added or changed (in "after" order).
+/// matchedFn is called for each item present in both lists, so that the caller can compare their children.
+/// </summary>
+template <typename T, typename Key_t, typename Hash_t = std::hash<Key_t>, typename KeyFn_t, typename SameFn_t, typename MatchedFn_t>
+static void DiffKeyedLists(const std::vector<T>& before, const std::vector<T>& after, KeyFn_t keyFn, SameFn_t sameFn, MatchedFn_t matchedFn, std::vector<Change_t<T>>& changes)
+{
+	std::unordered_map<Key_t, size_t, Hash_t> beforeByKey;
+	beforeByKey.reserve(before.size());
+	for (size_t ix = 0; ix < before.size(); ++ix)
+		beforeByKey.emplace(keyFn(before[ix]), ix);
+
+	std::vector<bool> matched(before.size(), false);
+	std::vector<Change_t<T>> addedOrChanged;
+	typename std::vector<T>::const_iterator iter;
+	for (iter = after.begin(); iter != after.end(); ++iter)
+	{
+		typename std::unordered_map<Key_t, size_t, Hash_t>::const_iterator found = beforeByKey.find(keyFn(*iter));
+		if (found == beforeByKey.end())
+		{
+			Change_t<T> change;
+			change.kind = ChangeKind_t::Added;
+			change.after = *iter;
+			addedOrChanged.push_back(change);
+		}
+		else
+		{
+			const T& beforeItem = before[found->second];
+			matched[found->second] = true;
+			if (!sameFn(beforeItem, *iter))
+			{
+				Change_t<T> change;
+				change.kind = ChangeKind_t::Changed;
+				change.before = beforeItem;
+				change.after = *iter;
+				addedOrChanged.push_back(change);
+			}
+			matchedFn(beforeItem, *iter);
+		}
+	}
+
+	for (size_t ix = 0; ix < before.size(); ++ix)
+	{
+		if (!matched[ix])
+		{
+			Change_t<T> change;
+			change.kind = ChangeKind_t::Removed;
+			change.before = before[ix];
+			changes.push_back(change);
+		}
+	}
+	changes.insert(changes.end(), addedOrChanged.begin(), addedOrChanged.end());
+}
+
+/// <summary>
+/// Internal: for lists whose items have no children to compare
+/// </summary>
+template <typename T>
+static void NoChildren(const T&, const T&)
+{
+}
+
+static uint32_t SessionKey(const SessionSnapshot_t& session)
+{
+	return session.dwSessionId;
+}
+
+/// <summary>
+/// Internal: processes are identified by PID and creation time, so a reused PID is a different process.
+/// </summary>
+struct ProcessKey_t
+{
+	uint32_t dwPID;
+	int64_t createTime;
+
+	bool operator == (const ProcessKey_t& other) const { return dwPID == other.dwPID && createTime == other.createTime; }
+};
+
+struct ProcessKeyHash_t
+{
+	size_t operator()(const ProcessKey_t& key) const
+	{
+		return std::hash<uint64_t>()(((uint64_t)key.createTime * 0x9E3779B97F4A7C15ULL) ^ key.dwPID);
+	}
+};
+
+static ProcessKey_t ProcessKey(const ProcessSnapshot_t& process)
+{
+	ProcessKey_t key = { process.dwPID, process.createTime };
+	return key;
+}
+
+static std::wstring WindowStationKey(const WindowStationSnapshot_t& ws)
+{
+	return ws.sName;
+}
+
+static std::wstring DesktopKey(const DesktopSnapshot_t& desktop)
+{
+	return desktop.sName;
+}
+
+static uint64_t WindowKey(const WindowSnapshot_t& window)
+{
+	return window.hwnd;
+}
+
+/// <summary>
+/// Total number of differences
+/// </summary>
+size_t SnapshotDiff_t::ChangeCount() const
+{
+	return
+		(bCurrentInfoChanged ? 1 : 0) +
+		(bSessionEnumChanged ? 1 : 0) +
+		(bWindowStationEnumChanged ? 1 : 0) +
+		sessions.size() +
+		windowStations.size() +
+		desktops.size() +
+		processes.size() +
+		windows.size() +
+		securityDescriptors.size();
+}
+
+// ------------------------------------------------------------------------------------------
+// Internal: compare the children of items present in both samples
+
+static void DiffSessionProcesses(const SessionSnapshot_t& before, const SessionSnapshot_t& after, SnapshotDiff_t& diff)
+{
+	if (!before.bProcessesCollected || !after.bProcessesCollected || !before.processes.bValid || !after.processes.bValid)
+		return;
+
+	std::vector<Change_t<ProcessSnapshot_t>> processChanges;
+	DiffKeyedLists<ProcessSnapshot_t, ProcessKey_t, ProcessKeyHash_t>(before.processes.value, after.processes.value, ProcessKey, SameProcess, NoChildren<ProcessSnapshot_t>, processChanges);
+	for (size_t ix = 0; ix < processChanges.size(); ++ix)
+	{
+		ProcessChange_t processChange;
+		processChange.dwSessionId = after.dwSessionId;
+		processChange.change = processChanges[ix];
+		diff.processes.push_back(processChange);
+	}
+}
+
+static void DiffSecurityDescriptors(const std::wstring& sWindowStation, const std::wstring& sDesktop, const SecurityDescriptorSnapshot_t& before, const SecurityDescriptorSnapshot_t& after, SnapshotDiff_t& diff)
+{
+	if (SameSecurityDescriptor(before, after))
+		return;
+
+	SecurityDescriptorChange_t sdChange;
+	sdChange.sWindowStation = sWindowStation;
+	sdChange.sDesktop = sDesktop;
+	sdChange.change.kind = ChangeKind_t::Changed;
+	sdChange.change.before = before;
+	sdChange.change.after = after;
+	diff.securityDescriptors.push_back(sdChange);
+}
+
+static void DiffDesktopChildren(const std::wstring& sWindowStation, const DesktopSnapshot_t& before, const DesktopSnapshot_t& after, SnapshotDiff_t& diff)
+{
+	DiffSecurityDescriptors(sWindowStation, after.sName, before.securityDescriptor, after.securityDescriptor, diff);
+
+	if (!before.bWindowsCollected || !after.bWindowsCollected || !before.windows.bValid || !after.windows.bValid)
+		return;
+
+	std::vector<Change_t<WindowSnapshot_t>> windowChanges;
+	DiffKeyedLists<WindowSnapshot_t, uint64_t>(before.windows.value, after.windows.value, WindowKey, SameWindow, NoChildren<WindowSnapshot_t>, windowChanges);
+	for (size_t ix = 0; ix < windowChanges.size(); ++ix)
+	{
+		WindowChange_t windowChange;
+		windowChange.sWindowStation = sWindowStation;
+		windowChange.sDesktop = after.sName;
+		windowChange.change = windowChanges[ix];
+		diff.windows.push_back(windowChange);
+	}
+}
+
+static void DiffWindowStationChildren(const WindowStationSnapshot_t& before, const WindowStationSnapshot_t& after, SnapshotDiff_t& diff)
+{
+	const std::wstring& sWindowStation = after.sName;
+	DiffSecurityDescriptors(sWindowStation, std::wstring(), before.securityDescriptor, after.securityDescriptor, diff);
+
+	if (!before.desktops.bValid || !after.desktops.bValid)
+		return;
+
+	std::vector<Change_t<DesktopSnapshot_t>> desktopChanges;
+	DiffKeyedLists<DesktopSnapshot_t, std::wstring>(before.desktops.value, after.desktops.value, DesktopKey, SameDesktop,
+		[&](const DesktopSnapshot_t& beforeDesktop, const DesktopSnapshot_t& afterDesktop) { DiffDesktopChildren(sWindowStation, beforeDesktop, afterDesktop, diff); },
+		desktopChanges);
+	for (size_t ix = 0; ix < desktopChanges.size(); ++ix)
+	{
+		DesktopChange_t desktopChange;
+		desktopChange.sWindowStation = sWindowStation;
+		desktopChange.change = desktopChanges[ix];
+		diff.desktops.push_back(desktopChange);
+	}
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Compute the differences between two samples.
+/// Values that change on every sample (a session's CurrentTime and LastInputTime) are not treated as changes.
+/// </summary>
+/// <param name="before">Input: earlier sample</param>
+/// <param name="after">Input: later sample</param>
+/// <param name="diff">Output: the differences</param>
+void DiffSnapshots(const SystemSnapshot_t& before, const SystemSnapshot_t& after, SnapshotDiff_t& diff)
+{
+	diff = SnapshotDiff_t();
+
+	diff.bCurrentInfoChanged = !SameCurrentInfo(before.currentInfo, after.currentInfo);
+
+	// If enumeration failed in either sample, report the status change but don't treat every item as added or removed.
+	diff.bSessionEnumChanged = !SameCaptureStatus(before.sessions.bValid, before.sessions.sErrorInfo, after.sessions.bValid, after.sessions.sErrorInfo);
+	if (before.sessions.bValid && after.sessions.bValid)
+	{
+		DiffKeyedLists<SessionSnapshot_t, uint32_t>(before.sessions.value, after.sessions.value, SessionKey, SameSession,
+			[&](const SessionSnapshot_t& beforeSession, const SessionSnapshot_t& afterSession) { DiffSessionProcesses(beforeSession, afterSession, diff); },
+			diff.sessions);
+	}
+
+	diff.bWindowStationEnumChanged = !SameCaptureStatus(before.windowStations.bValid, before.windowStations.sErrorInfo, after.windowStations.bValid, after.windowStations.sErrorInfo);
+	if (before.windowStations.bValid && after.windowStations.bValid)
+	{
+		DiffKeyedLists<WindowStationSnapshot_t, std::wstring>(before.windowStations.value, after.windowStations.value, WindowStationKey, SameWindowStation,
+			[&](const WindowStationSnapshot_t& beforeWs, const WindowStationSnapshot_t& afterWs) { DiffWindowStationChildren(beforeWs, afterWs, diff); },
+			diff.windowStations);
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+// SnapshotDiff.h: computes what was added, removed, or changed between two SystemSnapshot_t samples.
+// Works only on the plain snapshot data (no Windows dependencies).
+
+#include <string>
+#include <vector>
+#include "SystemSnapshot.h"
+
+/// <summary>
+/// Kind of difference between two samples
+/// </summary>
+enum class ChangeKind_t { Added, Removed, Changed };
+
+/// <summary>
+/// One added, removed, or changed item.
+/// </summary>
+template <typename T>
+struct Change_t
+{
+	ChangeKind_t kind = ChangeKind_t::Changed;
+	// Value in the earlier sample; default-constructed if Added
+	T before;
+	// Value in the later sample; default-constructed if Removed
+	T after;
+};
+
+/// <summary>
+/// A desktop change, with the name of the window station the desktop belongs to.
+/// </summary>
+struct DesktopChange_t
+{
+	std::wstring sWindowStation;
+	Change_t<DesktopSnapshot_t> change;
+};
+
+/// <summary>
+/// A process started, exited, or changed, with the ID of its session.
+/// </summary>
+struct ProcessChange_t
+{
+	uint32_t dwSessionId = 0;
+	Change_t<ProcessSnapshot_t> change;
+};
+
+/// <summary>
+/// A top-level window created, destroyed, or changed, with the names of its window station and desktop.
+/// </summary>
+struct WindowChange_t
+{
+	std::wstring sWindowStation, sDesktop;
+	Change_t<WindowSnapshot_t> change;
+};
+
+/// <summary>
+/// A window station's or desktop's security descriptor changed (always ChangeKind_t::Changed).
+/// sDesktop is empty for the window station's own security descriptor.
+/// </summary>
+struct SecurityDescriptorChange_t
+{
+	std::wstring sWindowStation, sDesktop;
+	Change_t<SecurityDescriptorSnapshot_t> change;
+};
+
+/// <summary>
+/// All differences between two samples.
+/// Items are matched by stable keys: sessions by session ID, processes by PID and creation time within
+/// their session, window stations by name, desktops by name within their window station, and windows
+/// by HWND within their desktop. Each list is matched in linear time through hash lookups.
+/// Changes within an item are reported only for items present in both samples: e.g., processes of added
+/// or removed sessions, and desktops of added or removed window stations, aren't listed separately.
+/// A session, window station, or desktop is listed as changed only if its own attributes changed;
+/// its processes, windows, and security descriptor are reported in their own lists.
+/// </summary>
+struct SnapshotDiff_t
+{
+	// The process' own context changed (e.g., input desktop or console session)
+	bool bCurrentInfoChanged = false;
+	// Session enumeration started or stopped failing, or failed differently
+	bool bSessionEnumChanged = false;
+	// Window station enumeration started or stopped failing, or failed differently
+	bool bWindowStationEnumChanged = false;
+
+	std::vector<Change_t<SessionSnapshot_t>> sessions;
+	std::vector<Change_t<WindowStationSnapshot_t>> windowStations;
+	std::vector<DesktopChange_t> desktops;
+	std::vector<ProcessChange_t> processes;
+	std::vector<WindowChange_t> windows;
+	std::vector<SecurityDescriptorChange_t> securityDescriptors;
+
+	/// <summary>
+	/// Total number of differences
+	/// </summary>
+	size_t ChangeCount() const;
+
+	/// <summary>
+	/// True if the two samples are equivalent
+	/// </summary>
+	bool IsEmpty() const { return 0 == ChangeCount(); }
+};
+
+/// <summary>
+/// Compute the differences between two samples.
+/// Values that change on every sample (a session's CurrentTime and LastInputTime) are not treated as changes.
+/// </summary>
+/// <param name="before">Input: earlier sample</param>
+/// <param name="after">Input: later sample</param>
+/// <param name="diff">Output: the differences</param>
+void DiffSnapshots(const SystemSnapshot_t& before, const SystemSnapshot_t& after, SnapshotDiff_t& diff);
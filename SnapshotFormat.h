@@ -0,0 +1,302 @@
+#pragma once
+
+// SnapshotFormat.h: on-disk layout of TSSessions binary snapshot files (.tssnap).
+//
+// Layout: FileHeader_t, then an array of SectionEntry_t, then the sections, each 8-byte aligned.
+// Strings are UTF-16LE in one deduplicated string table and referenced by StrRef_t.
+// Binary SIDs and self-relative security descriptors are stored raw in one blob table and referenced by BlobRef_t.
+// SIDs are deduplicated into a SID table referenced by index.
+// Sessions, processes, window stations, desktops, and windows are arrays of fixed-width records;
+// parents reference their children as a contiguous range of the child array.
+// All integers are little-endian. Readers use each section's recordSize as the stride, so fields can be
+// appended to records without breaking older readers; the version changes only for incompatible layouts,
+// and readers reject versions they don't know. Readers ignore sections with unrecognized IDs.
+//
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+namespace SnapshotFormat
+{
+	// "TSSNAP" + two bytes that catch text-mode newline conversion
+	const char Magic[8] = { 'T', 'S', 'S', 'N', 'A', 'P', '\r', '\n' };
+	// Incremented only for changes that older readers can't handle
+	const uint32_t CurrentVersion = 1;
+
+	// Index value meaning "no SID"
+	const uint32_t NoSid = 0xFFFFFFFF;
+
+	enum SectionId_t : uint32_t
+	{
+		Section_Strings = 1,
+		Section_Blobs = 2,
+		Section_Sids = 3,
+		Section_Snapshot = 4,
+		Section_Sessions = 5,
+		Section_Processes = 6,
+		Section_WindowStations = 7,
+		Section_Desktops = 8,
+		Section_Windows = 9,
+	};
+
+	struct FileHeader_t
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t sectionCount;
+		uint64_t fileSize;
+	};
+
+	struct SectionEntry_t
+	{
+		uint32_t id;
+		// Size of each record; 1 for byte blobs, 2 for the string table
+		uint32_t recordSize;
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	// Offset and length in UTF-16 code units within the string table
+	struct StrRef_t
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// Offset and length in bytes within the blob table
+	struct BlobRef_t
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// Contiguous range of records in a child section, with capture status
+	struct CapturedRange_t
+	{
+		uint32_t first;
+		uint32_t count;
+		uint32_t bValid;
+		uint32_t reserved;
+		StrRef_t error;
+	};
+
+	struct CapturedStr_t
+	{
+		StrRef_t value;
+		StrRef_t error;
+		uint32_t bValid;
+		uint32_t reserved;
+	};
+
+	// Also used for SIDs (value is a SID table index) and booleans
+	struct CapturedU32_t
+	{
+		uint32_t value;
+		uint32_t bValid;
+		StrRef_t error;
+	};
+
+	struct CapturedBlob_t
+	{
+		BlobRef_t value;
+		uint32_t bValid;
+		uint32_t reserved;
+		StrRef_t error;
+	};
+
+	struct SidRecord_t
+	{
+		BlobRef_t bytes;
+		StrRef_t sSid;
+		StrRef_t sDomainAndUsername;
+	};
+
+	struct TokenRecord_t
+	{
+		uint32_t userSid;
+		uint32_t logonSessionHigh;
+		uint32_t logonSessionLow;
+		uint32_t integrityLevel;
+		StrRef_t sIntegrityLevelName;
+	};
+
+	struct SessionRecord_t
+	{
+		uint32_t dwSessionId;
+		uint32_t state;
+		int32_t sessionFlags;
+		uint32_t tokenStatus;
+		StrRef_t sName;
+		StrRef_t sState;
+		StrRef_t sSessionFlags;
+		StrRef_t sDomainName;
+		StrRef_t sUserName;
+		StrRef_t sTokenError;
+		int64_t logonTime;
+		int64_t connectTime;
+		int64_t disconnectTime;
+		int64_t lastInputTime;
+		int64_t currentTime;
+		TokenRecord_t token;
+		TokenRecord_t linkedToken;
+		uint32_t bHasLinkedToken;
+		uint32_t bProcessesCollected;
+		CapturedRange_t processes;
+	};
+
+	struct ProcessRecord_t
+	{
+		uint32_t dwPID;
+		uint32_t userSid;
+		StrRef_t sProcessName;
+		int64_t createTime;
+		// Resource usage; appended, so absent from files written before it was added
+		uint32_t threadCount;
+		uint32_t handleCount;
+		uint64_t workingSetSize;
+		uint64_t pagefileUsage;
+		int64_t userTime;
+		int64_t kernelTime;
+	};
+	// Size of ProcessRecord_t without the resource usage fields, the minimum a reader accepts
+	const size_t ProcessRecordBaseSize = offsetof(ProcessRecord_t, threadCount);
+
+	struct SecurityDescriptorRecord_t
+	{
+		uint32_t bCollected;
+		uint32_t securityInformation;
+		CapturedBlob_t sd;
+	};
+
+	enum WindowFlags_t : uint32_t
+	{
+		WindowFlag_Valid = 0x1,
+		WindowFlag_Visible = 0x2,
+	};
+
+	struct WindowRecord_t
+	{
+		uint64_t hwnd;
+		uint32_t PID;
+		uint32_t TID;
+		uint32_t flags;
+		uint32_t reserved;
+		StrRef_t sProcessPath;
+		StrRef_t sClassName;
+		StrRef_t sWindowText;
+	};
+
+	struct DesktopRecord_t
+	{
+		StrRef_t sName;
+		StrRef_t sOpenError;
+		uint32_t bOpened;
+		uint32_t bWindowsCollected;
+		CapturedStr_t flags;
+		CapturedU32_t user;
+		CapturedU32_t heapSizeKb;
+		CapturedU32_t receivingInput;
+		SecurityDescriptorRecord_t securityDescriptor;
+		CapturedRange_t windows;
+	};
+
+	struct WindowStationRecord_t
+	{
+		StrRef_t sName;
+		StrRef_t sOpenError;
+		uint32_t bOpened;
+		uint32_t reserved;
+		CapturedStr_t flags;
+		CapturedU32_t user;
+		SecurityDescriptorRecord_t securityDescriptor;
+		CapturedRange_t desktops;
+	};
+
+	// The single record in Section_Snapshot: current context plus the top-level collections
+	struct SnapshotRecord_t
+	{
+		CapturedU32_t sessionId;
+		CapturedStr_t winstaName;
+		CapturedStr_t winstaFlags;
+		CapturedU32_t winstaUser;
+		CapturedStr_t desktopName;
+		CapturedStr_t desktopFlags;
+		CapturedU32_t desktopUser;
+		CapturedU32_t desktopHeapSizeKb;
+		CapturedStr_t inputDesktopName;
+		uint32_t runningAs;
+		uint32_t activeConsoleSessionId;
+		uint32_t bChildSessionsEnabled;
+		uint32_t reserved;
+		CapturedRange_t sessions;
+		CapturedRange_t windowStations;
+	};
+
+	// Layout checks: records must have no implicit padding so that they're identical on every compiler.
+	static_assert(sizeof(FileHeader_t) == 24, "FileHeader_t layout");
+	static_assert(sizeof(SectionEntry_t) == 24, "SectionEntry_t layout");
+	static_assert(sizeof(CapturedRange_t) == 24, "CapturedRange_t layout");
+	static_assert(sizeof(CapturedStr_t) == 24, "CapturedStr_t layout");
+	static_assert(sizeof(CapturedU32_t) == 16, "CapturedU32_t layout");
+	static_assert(sizeof(CapturedBlob_t) == 24, "CapturedBlob_t layout");
+	static_assert(sizeof(SidRecord_t) == 24, "SidRecord_t layout");
+	static_assert(sizeof(TokenRecord_t) == 24, "TokenRecord_t layout");
+	static_assert(sizeof(SessionRecord_t) == 184, "SessionRecord_t layout");
+	static_assert(sizeof(ProcessRecord_t) == 64, "ProcessRecord_t layout");
+	static_assert(ProcessRecordBaseSize == 24, "ProcessRecord_t layout");
+	static_assert(sizeof(SecurityDescriptorRecord_t) == 32, "SecurityDescriptorRecord_t layout");
+	static_assert(sizeof(WindowRecord_t) == 48, "WindowRecord_t layout");
+	static_assert(sizeof(DesktopRecord_t) == 152, "DesktopRecord_t layout");
+	static_assert(sizeof(WindowStationRecord_t) == 120, "WindowStationRecord_t layout");
+	static_assert(sizeof(SnapshotRecord_t) == 248, "SnapshotRecord_t layout");
+
+	// ------------------------------------------------------------------------------------------
+	// UTF-16 conversion (wchar_t is UTF-16 on Windows and UTF-32 elsewhere)
+
+	/// <summary>
+	/// Append a wide string to a UTF-16 buffer
+	/// </summary>
+	inline void AppendUtf16(const std::wstring& str, std::vector<char16_t>& utf16)
+	{
+		for (size_t ix = 0; ix < str.size(); ++ix)
+		{
+			uint32_t ch = (uint32_t)str[ix];
+#if WCHAR_MAX > 0xFFFF
+			if (ch >= 0x10000)
+			{
+				ch -= 0x10000;
+				utf16.push_back((char16_t)(0xD800 + (ch >> 10)));
+				utf16.push_back((char16_t)(0xDC00 + (ch & 0x3FF)));
+				continue;
+			}
+#endif
+			utf16.push_back((char16_t)ch);
+		}
+	}
+
+	/// <summary>
+	/// Convert UTF-16 code units to a wide string
+	/// </summary>
+	inline std::wstring Utf16ToWString(const char16_t* psz, size_t length)
+	{
+		std::wstring str;
+		str.reserve(length);
+		for (size_t ix = 0; ix < length; ++ix)
+		{
+			uint32_t ch = psz[ix];
+#if WCHAR_MAX > 0xFFFF
+			if (ch >= 0xD800 && ch < 0xDC00 && ix + 1 < length && psz[ix + 1] >= 0xDC00 && psz[ix + 1] < 0xE000)
+			{
+				ch = 0x10000 + ((ch - 0xD800) << 10) + (psz[ix + 1] - 0xDC00);
+				++ix;
+			}
+#endif
+			str.push_back((wchar_t)ch);
+		}
+		return str;
+	}
+}
@@ -0,0 +1,434 @@
+// SnapshotReader.cpp: memory-mapped reader for binary snapshot files.
+//
+// Records are read in place, so this assumes a little-endian host, matching the writer.
+
+#include <cstring>
+#include "SnapshotReader.h"
+#include "SidCodec.h"
+
+using namespace SnapshotFormat;
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Map and validate a snapshot file.
+/// </summary>
+bool SnapshotFile::Open(const std::wstring& sPath, std::wstring& sErrorInfo)
+{
+	if (!m_mappedFile.Open(sPath, sErrorInfo))
+		return false;
+	if (!Attach(m_mappedFile.Data(), m_mappedFile.Size(), sErrorInfo))
+	{
+		sErrorInfo = sPath + L": " + sErrorInfo;
+		m_mappedFile.Close();
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Validate and use a snapshot image already in memory.
+/// </summary>
+bool SnapshotFile::Attach(const uint8_t* pData, size_t size, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	m_pData = pData;
+	m_size = size;
+	if (!Validate(sErrorInfo))
+	{
+		m_pData = nullptr;
+		m_size = 0;
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Internal: check the header and section directory, and locate the sections.
+/// After this succeeds, every record of every known section is within the file.
+/// </summary>
+bool SnapshotFile::Validate(std::wstring& sErrorInfo)
+{
+	m_strings = m_blobs = m_sids = m_snapshot = m_sessions = m_processes = m_windowStations = m_desktops = m_windows = Section_t();
+	m_sidNames.clear();
+
+	if (nullptr == m_pData || m_size < sizeof(FileHeader_t))
+	{
+		sErrorInfo = L"Not a TSSessions snapshot file (too small)";
+		return false;
+	}
+	if (0 != ((uintptr_t)m_pData & 7))
+	{
+		sErrorInfo = L"Snapshot buffer is not 8-byte aligned";
+		return false;
+	}
+
+	FileHeader_t header;
+	memcpy(&header, m_pData, sizeof(header));
+	if (0 != memcmp(header.magic, Magic, sizeof(header.magic)))
+	{
+		sErrorInfo = L"Not a TSSessions snapshot file";
+		return false;
+	}
+	if (CurrentVersion != header.version)
+	{
+		sErrorInfo = L"Unsupported snapshot file version " + std::to_wstring(header.version);
+		return false;
+	}
+	if (header.fileSize > m_size)
+	{
+		sErrorInfo = L"Snapshot file is truncated";
+		return false;
+	}
+	const uint64_t fileSize = header.fileSize;
+	if (sizeof(FileHeader_t) + (uint64_t)header.sectionCount * sizeof(SectionEntry_t) > fileSize)
+	{
+		sErrorInfo = L"Snapshot section directory is truncated";
+		return false;
+	}
+
+	for (uint32_t ixSection = 0; ixSection < header.sectionCount; ++ixSection)
+	{
+		SectionEntry_t entry;
+		memcpy(&entry, m_pData + sizeof(FileHeader_t) + ixSection * sizeof(SectionEntry_t), sizeof(entry));
+
+		Section_t* pSection = nullptr;
+		size_t minRecordSize = 0;
+		bool bFixedSize = false;
+		switch (entry.id)
+		{
+		case Section_Strings:        pSection = &m_strings;        minRecordSize = sizeof(char16_t); bFixedSize = true; break;
+		case Section_Blobs:          pSection = &m_blobs;          minRecordSize = 1; bFixedSize = true; break;
+		case Section_Sids:           pSection = &m_sids;           minRecordSize = sizeof(SidRecord_t); break;
+		case Section_Snapshot:       pSection = &m_snapshot;       minRecordSize = sizeof(SnapshotRecord_t); break;
+		case Section_Sessions:       pSection = &m_sessions;       minRecordSize = sizeof(SessionRecord_t); break;
+		case Section_Processes:      pSection = &m_processes;      minRecordSize = ProcessRecordBaseSize; break;
+		case Section_WindowStations: pSection = &m_windowStations; minRecordSize = sizeof(WindowStationRecord_t); break;
+		case Section_Desktops:       pSection = &m_desktops;       minRecordSize = sizeof(DesktopRecord_t); break;
+		case Section_Windows:        pSection = &m_windows;        minRecordSize = sizeof(WindowRecord_t); break;
+		default:
+			// Unknown section from a later writer; ignore it.
+			continue;
+		}
+
+		const std::wstring sSectionId = std::to_wstring(entry.id);
+		if (nullptr != pSection->pBase)
+		{
+			sErrorInfo = L"Duplicate snapshot section " + sSectionId;
+			return false;
+		}
+		// Records are read in place, so fixed-width records must keep 8-byte alignment.
+		if (bFixedSize ? (entry.recordSize != minRecordSize) : (entry.recordSize < minRecordSize || 0 != entry.recordSize % 8))
+		{
+			sErrorInfo = L"Invalid record size in snapshot section " + sSectionId;
+			return false;
+		}
+		if (entry.offset > fileSize || 0 != entry.offset % 8 || entry.count > (fileSize - entry.offset) / entry.recordSize)
+		{
+			sErrorInfo = L"Snapshot section " + sSectionId + L" is out of bounds";
+			return false;
+		}
+		pSection->pBase = m_pData + entry.offset;
+		pSection->recordSize = entry.recordSize;
+		pSection->count = (size_t)entry.count;
+	}
+
+	if (0 == m_snapshot.count)
+	{
+		sErrorInfo = L"Snapshot file has no snapshot record";
+		return false;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// View of a string in the string table; false if the reference is out of range.
+/// </summary>
+bool SnapshotFile::String(const StrRef_t& ref, Utf16View_t& view) const
+{
+	view = Utf16View_t();
+	if ((uint64_t)ref.offset + ref.length > m_strings.count)
+		return false;
+	if (ref.length > 0)
+	{
+		view.psz = (const char16_t*)m_strings.pBase + ref.offset;
+		view.length = ref.length;
+	}
+	return true;
+}
+
+/// <summary>
+/// View of bytes in the blob table; false if the reference is out of range.
+/// </summary>
+bool SnapshotFile::Blob(const BlobRef_t& ref, ByteView_t& view) const
+{
+	view = ByteView_t();
+	if ((uint64_t)ref.offset + ref.length > m_blobs.count)
+		return false;
+	if (ref.length > 0)
+	{
+		view.pBytes = m_blobs.pBase + ref.offset;
+		view.length = ref.length;
+	}
+	return true;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Convert the entire file into a SystemSnapshot_t.
+/// </summary>
+bool SnapshotFile::ToSnapshot(SystemSnapshot_t& snapshot, std::wstring& sErrorInfo) const
+{
+	sErrorInfo.clear();
+	snapshot = SystemSnapshot_t();
+	if (nullptr == m_pData)
+	{
+		sErrorInfo = L"No snapshot file open";
+		return false;
+	}
+
+	const SnapshotRecord_t& rec = Snapshot();
+	CurrentInfoSnapshot_t& currentInfo = snapshot.currentInfo;
+	bool bOk =
+		GetCapturedU32(rec.sessionId, currentInfo.sessionId) &&
+		GetCapturedStr(rec.winstaName, currentInfo.winstaName) &&
+		GetCapturedStr(rec.winstaFlags, currentInfo.winstaFlags) &&
+		GetCapturedSid(rec.winstaUser, currentInfo.winstaUser) &&
+		GetCapturedStr(rec.desktopName, currentInfo.desktopName) &&
+		GetCapturedStr(rec.desktopFlags, currentInfo.desktopFlags) &&
+		GetCapturedSid(rec.desktopUser, currentInfo.desktopUser) &&
+		GetCapturedU32(rec.desktopHeapSizeKb, currentInfo.desktopHeapSizeKb) &&
+		GetCapturedStr(rec.inputDesktopName, currentInfo.inputDesktopName) &&
+		GetSid(rec.runningAs, currentInfo.runningAs) &&
+		GetString(rec.sessions.error, snapshot.sessions.sErrorInfo) &&
+		GetString(rec.windowStations.error, snapshot.windowStations.sErrorInfo);
+	currentInfo.activeConsoleSessionId = rec.activeConsoleSessionId;
+	currentInfo.bChildSessionsEnabled = (0 != rec.bChildSessionsEnabled);
+
+	snapshot.sessions.bValid = (0 != rec.sessions.bValid);
+	for (uint64_t ix = rec.sessions.first; bOk && ix < (uint64_t)rec.sessions.first + rec.sessions.count; ++ix)
+	{
+		const SessionRecord_t* pSession = Session((size_t)ix);
+		SessionSnapshot_t sessionSnapshot;
+		bOk = (nullptr != pSession) && GetSession(*pSession, sessionSnapshot);
+		if (bOk)
+			snapshot.sessions.value.push_back(sessionSnapshot);
+	}
+
+	snapshot.windowStations.bValid = (0 != rec.windowStations.bValid);
+	for (uint64_t ix = rec.windowStations.first; bOk && ix < (uint64_t)rec.windowStations.first + rec.windowStations.count; ++ix)
+	{
+		const WindowStationRecord_t* pWinsta = WindowStation((size_t)ix);
+		WindowStationSnapshot_t winstaSnapshot;
+		bOk = (nullptr != pWinsta) && GetWindowStation(*pWinsta, winstaSnapshot);
+		if (bOk)
+			snapshot.windowStations.value.push_back(winstaSnapshot);
+	}
+
+	if (!bOk)
+	{
+		sErrorInfo = L"Snapshot file is corrupt (reference out of range)";
+		snapshot = SystemSnapshot_t();
+	}
+	return bOk;
+}
+
+// ------------------------------------------------------------------------------------------
+// Conversion helpers. Each returns false if the record references anything outside the file.
+
+bool SnapshotFile::GetString(const StrRef_t& ref, std::wstring& str) const
+{
+	Utf16View_t view;
+	if (!String(ref, view))
+		return false;
+	str = view.ToWString();
+	return true;
+}
+
+bool SnapshotFile::GetSid(uint32_t ix, SidInfo_t& sidInfo) const
+{
+	sidInfo = SidInfo_t();
+	if (NoSid == ix)
+		return true;
+	const SidRecord_t* pSid = Sid(ix);
+	ByteView_t bytes;
+	if (nullptr == pSid || !Blob(pSid->bytes, bytes))
+		return false;
+	// The bytes must be exactly one valid SID: later code reads as far as the SID's own length says.
+	if (0 == bytes.length || SidCodec::BinaryLength(bytes.pBytes, bytes.length) != bytes.length)
+		return false;
+	if (!sidInfo.Assign(bytes.pBytes, bytes.length))
+		return false;
+	// The string form is derived from the binary SID. The name is read once per record and shared by its references.
+	if (ix >= m_sidNames.size())
+		m_sidNames.resize(m_sids.count);
+	if (!m_sidNames[ix])
+	{
+		std::wstring sDomainAndUsername;
+		if (!GetString(pSid->sDomainAndUsername, sDomainAndUsername))
+			return false;
+		m_sidNames[ix] = std::make_shared<const std::wstring>(sDomainAndUsername);
+	}
+	if (!m_sidNames[ix]->empty())
+		sidInfo.pName = m_sidNames[ix];
+	return true;
+}
+
+bool SnapshotFile::GetCapturedStr(const CapturedStr_t& rec, Captured_t<std::wstring>& captured) const
+{
+	captured.bValid = (0 != rec.bValid);
+	return GetString(rec.value, captured.value) && GetString(rec.error, captured.sErrorInfo);
+}
+
+bool SnapshotFile::GetCapturedU32(const CapturedU32_t& rec, Captured_t<uint32_t>& captured) const
+{
+	captured.bValid = (0 != rec.bValid);
+	captured.value = rec.value;
+	return GetString(rec.error, captured.sErrorInfo);
+}
+
+bool SnapshotFile::GetCapturedSid(const CapturedU32_t& rec, Captured_t<SidInfo_t>& captured) const
+{
+	captured.bValid = (0 != rec.bValid);
+	return GetSid(rec.value, captured.value) && GetString(rec.error, captured.sErrorInfo);
+}
+
+bool SnapshotFile::GetToken(const TokenRecord_t& rec, TokenSnapshot_t& token) const
+{
+	token.logonSessionHigh = rec.logonSessionHigh;
+	token.logonSessionLow = rec.logonSessionLow;
+	token.integrityLevel = rec.integrityLevel;
+	return GetSid(rec.userSid, token.user) && GetString(rec.sIntegrityLevelName, token.sIntegrityLevelName);
+}
+
+bool SnapshotFile::GetSecurityDescriptor(const SecurityDescriptorRecord_t& rec, SecurityDescriptorSnapshot_t& sd) const
+{
+	sd.bCollected = (0 != rec.bCollected);
+	sd.securityInformation = rec.securityInformation;
+	sd.sd.bValid = (0 != rec.sd.bValid);
+	ByteView_t bytes;
+	if (!Blob(rec.sd.value, bytes))
+		return false;
+	sd.sd.value.assign(bytes.pBytes, bytes.pBytes + bytes.length);
+	return GetString(rec.sd.error, sd.sd.sErrorInfo);
+}
+
+bool SnapshotFile::GetSession(const SessionRecord_t& rec, SessionSnapshot_t& session) const
+{
+	if (rec.tokenStatus > (uint32_t)TokenStatus_t::Error)
+		return false;
+
+	session.dwSessionId = rec.dwSessionId;
+	session.state = rec.state;
+	session.sessionFlags = rec.sessionFlags;
+	session.tokenStatus = (TokenStatus_t)rec.tokenStatus;
+	session.logonTime = rec.logonTime;
+	session.connectTime = rec.connectTime;
+	session.disconnectTime = rec.disconnectTime;
+	session.lastInputTime = rec.lastInputTime;
+	session.currentTime = rec.currentTime;
+	session.bHasLinkedToken = (0 != rec.bHasLinkedToken);
+	session.bProcessesCollected = (0 != rec.bProcessesCollected);
+	session.processes.bValid = (0 != rec.processes.bValid);
+	bool bOk =
+		GetString(rec.sName, session.sName) &&
+		GetString(rec.sState, session.sState) &&
+		GetString(rec.sSessionFlags, session.sSessionFlags) &&
+		GetString(rec.sDomainName, session.sDomainName) &&
+		GetString(rec.sUserName, session.sUserName) &&
+		GetString(rec.sTokenError, session.sTokenError) &&
+		GetToken(rec.token, session.token) &&
+		GetToken(rec.linkedToken, session.linkedToken) &&
+		GetString(rec.processes.error, session.processes.sErrorInfo);
+
+	for (uint64_t ix = rec.processes.first; bOk && ix < (uint64_t)rec.processes.first + rec.processes.count; ++ix)
+	{
+		const ProcessRecord_t* pProcess = Process((size_t)ix);
+		ProcessSnapshot_t processSnapshot;
+		bOk = (nullptr != pProcess);
+		if (bOk)
+		{
+			processSnapshot.dwPID = pProcess->dwPID;
+			processSnapshot.createTime = pProcess->createTime;
+			bOk = GetString(pProcess->sProcessName, processSnapshot.sProcessName) && GetSid(pProcess->userSid, processSnapshot.user);
+		}
+		if (bOk && HasProcessUsage())
+		{
+			processSnapshot.threadCount = pProcess->threadCount;
+			processSnapshot.handleCount = pProcess->handleCount;
+			processSnapshot.workingSetSize = pProcess->workingSetSize;
+			processSnapshot.pagefileUsage = pProcess->pagefileUsage;
+			processSnapshot.userTime = pProcess->userTime;
+			processSnapshot.kernelTime = pProcess->kernelTime;
+		}
+		if (bOk)
+			session.processes.value.push_back(processSnapshot);
+	}
+	return bOk;
+}
+
+bool SnapshotFile::GetWindowStation(const WindowStationRecord_t& rec, WindowStationSnapshot_t& winsta) const
+{
+	winsta.bOpened = (0 != rec.bOpened);
+	winsta.desktops.bValid = (0 != rec.desktops.bValid);
+	bool bOk =
+		GetString(rec.sName, winsta.sName) &&
+		GetString(rec.sOpenError, winsta.sOpenError) &&
+		GetCapturedStr(rec.flags, winsta.flags) &&
+		GetCapturedSid(rec.user, winsta.user) &&
+		GetSecurityDescriptor(rec.securityDescriptor, winsta.securityDescriptor) &&
+		GetString(rec.desktops.error, winsta.desktops.sErrorInfo);
+
+	for (uint64_t ix = rec.desktops.first; bOk && ix < (uint64_t)rec.desktops.first + rec.desktops.count; ++ix)
+	{
+		const DesktopRecord_t* pDesktop = Desktop((size_t)ix);
+		DesktopSnapshot_t desktopSnapshot;
+		bOk = (nullptr != pDesktop) && GetDesktop(*pDesktop, desktopSnapshot);
+		if (bOk)
+			winsta.desktops.value.push_back(desktopSnapshot);
+	}
+	return bOk;
+}
+
+bool SnapshotFile::GetDesktop(const DesktopRecord_t& rec, DesktopSnapshot_t& desktop) const
+{
+	desktop.bOpened = (0 != rec.bOpened);
+	desktop.bWindowsCollected = (0 != rec.bWindowsCollected);
+	desktop.receivingInput.bValid = (0 != rec.receivingInput.bValid);
+	desktop.receivingInput.value = (0 != rec.receivingInput.value);
+	desktop.windows.bValid = (0 != rec.windows.bValid);
+	bool bOk =
+		GetString(rec.sName, desktop.sName) &&
+		GetString(rec.sOpenError, desktop.sOpenError) &&
+		GetCapturedStr(rec.flags, desktop.flags) &&
+		GetCapturedSid(rec.user, desktop.user) &&
+		GetCapturedU32(rec.heapSizeKb, desktop.heapSizeKb) &&
+		GetString(rec.receivingInput.error, desktop.receivingInput.sErrorInfo) &&
+		GetSecurityDescriptor(rec.securityDescriptor, desktop.securityDescriptor) &&
+		GetString(rec.windows.error, desktop.windows.sErrorInfo);
+
+	for (uint64_t ix = rec.windows.first; bOk && ix < (uint64_t)rec.windows.first + rec.windows.count; ++ix)
+	{
+		const WindowRecord_t* pWindow = Window((size_t)ix);
+		WindowSnapshot_t windowSnapshot;
+		bOk = (nullptr != pWindow);
+		if (bOk)
+		{
+			windowSnapshot.hwnd = pWindow->hwnd;
+			windowSnapshot.bIsValid = (0 != (pWindow->flags & WindowFlag_Valid));
+			windowSnapshot.bIsVisible = (0 != (pWindow->flags & WindowFlag_Visible));
+			windowSnapshot.PID = pWindow->PID;
+			windowSnapshot.TID = pWindow->TID;
+			bOk =
+				GetString(pWindow->sProcessPath, windowSnapshot.sProcessPath) &&
+				GetString(pWindow->sClassName, windowSnapshot.sClassName) &&
+				GetString(pWindow->sWindowText, windowSnapshot.sWindowText);
+		}
+		if (bOk)
+			desktop.windows.value.push_back(windowSnapshot);
+	}
+	return bOk;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+// SnapshotReader.h: memory-mapped reader for binary snapshot files (see SnapshotFormat.h).
+// Accessors return pointers and views into the mapped file without copying; ToSnapshot
+// converts the whole file into a SystemSnapshot_t.
+// Portable C++ (no Windows dependencies).
+
+#include "SystemSnapshot.h"
+#include "SnapshotFormat.h"
+#include "MappedFile.h"
+
+/// <summary>
+/// Zero-copy view of a string in the string table (UTF-16, not null-terminated)
+/// </summary>
+struct Utf16View_t
+{
+	const char16_t* psz = nullptr;
+	size_t length = 0;
+
+	std::wstring ToWString() const { return SnapshotFormat::Utf16ToWString(psz, length); }
+};
+
+/// <summary>
+/// Zero-copy view of bytes in the blob table
+/// </summary>
+struct ByteView_t
+{
+	const uint8_t* pBytes = nullptr;
+	size_t length = 0;
+};
+
+/// <summary>
+/// A validated binary snapshot, either mapped from a file or attached to a caller-owned buffer.
+/// Record accessors return nullptr for out-of-range indexes, and string/blob/SID accessors return
+/// false for references that fall outside their tables, so a corrupt file can't cause reads outside it.
+/// </summary>
+class SnapshotFile
+{
+public:
+	SnapshotFile() = default;
+	~SnapshotFile() = default;
+
+	/// <summary>
+	/// Map and validate a snapshot file.
+	/// </summary>
+	/// <param name="sPath">Input: path of the snapshot file</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Open(const std::wstring& sPath, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Validate and use a snapshot image already in memory. The buffer must remain valid and unchanged
+	/// while this object is in use, and must be 8-byte aligned.
+	/// </summary>
+	/// <param name="pData">Input: start of the snapshot image</param>
+	/// <param name="size">Input: size of the snapshot image in bytes</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool Attach(const uint8_t* pData, size_t size, std::wstring& sErrorInfo);
+
+	// Top-level record (always present in a valid file)
+	const SnapshotFormat::SnapshotRecord_t& Snapshot() const { return *(const SnapshotFormat::SnapshotRecord_t*)m_snapshot.pBase; }
+
+	// Record counts and accessors
+	size_t SessionCount() const { return m_sessions.count; }
+	size_t ProcessCount() const { return m_processes.count; }
+	size_t WindowStationCount() const { return m_windowStations.count; }
+	size_t DesktopCount() const { return m_desktops.count; }
+	size_t WindowCount() const { return m_windows.count; }
+	size_t SidCount() const { return m_sids.count; }
+	const SnapshotFormat::SessionRecord_t* Session(size_t ix) const { return (const SnapshotFormat::SessionRecord_t*)m_sessions.At(ix); }
+	const SnapshotFormat::ProcessRecord_t* Process(size_t ix) const { return (const SnapshotFormat::ProcessRecord_t*)m_processes.At(ix); }
+	// Whether process records include the resource usage fields; if not, only the fields through createTime may be read.
+	bool HasProcessUsage() const { return m_processes.recordSize >= sizeof(SnapshotFormat::ProcessRecord_t); }
+	const SnapshotFormat::WindowStationRecord_t* WindowStation(size_t ix) const { return (const SnapshotFormat::WindowStationRecord_t*)m_windowStations.At(ix); }
+	const SnapshotFormat::DesktopRecord_t* Desktop(size_t ix) const { return (const SnapshotFormat::DesktopRecord_t*)m_desktops.At(ix); }
+	const SnapshotFormat::WindowRecord_t* Window(size_t ix) const { return (const SnapshotFormat::WindowRecord_t*)m_windows.At(ix); }
+	// Returns nullptr for NoSid as well as for out-of-range indexes
+	const SnapshotFormat::SidRecord_t* Sid(uint32_t ix) const { return (const SnapshotFormat::SidRecord_t*)m_sids.At(ix); }
+
+	/// <summary>
+	/// View of a string in the string table; false if the reference is out of range.
+	/// </summary>
+	bool String(const SnapshotFormat::StrRef_t& ref, Utf16View_t& view) const;
+
+	/// <summary>
+	/// View of bytes in the blob table; false if the reference is out of range.
+	/// </summary>
+	bool Blob(const SnapshotFormat::BlobRef_t& ref, ByteView_t& view) const;
+
+	/// <summary>
+	/// Convert the entire file into a SystemSnapshot_t.
+	/// </summary>
+	/// <param name="snapshot">Output: the snapshot</param>
+	/// <param name="sErrorInfo">Output: error information if the file is internally inconsistent</param>
+	/// <returns>true on success, false otherwise</returns>
+	bool ToSnapshot(SystemSnapshot_t& snapshot, std::wstring& sErrorInfo) const;
+
+private:
+	/// <summary>
+	/// Internal: location of one section's records
+	/// </summary>
+	struct Section_t
+	{
+		const uint8_t* pBase = nullptr;
+		size_t recordSize = 0;
+		size_t count = 0;
+
+		const uint8_t* At(size_t ix) const { return ix < count ? pBase + ix * recordSize : nullptr; }
+	};
+
+	bool Validate(std::wstring& sErrorInfo);
+
+	// Conversion helpers for ToSnapshot
+	bool GetString(const SnapshotFormat::StrRef_t& ref, std::wstring& str) const;
+	bool GetSid(uint32_t ix, SidInfo_t& sidInfo) const;
+	bool GetCapturedStr(const SnapshotFormat::CapturedStr_t& rec, Captured_t<std::wstring>& captured) const;
+	bool GetCapturedU32(const SnapshotFormat::CapturedU32_t& rec, Captured_t<uint32_t>& captured) const;
+	bool GetCapturedSid(const SnapshotFormat::CapturedU32_t& rec, Captured_t<SidInfo_t>& captured) const;
+	bool GetToken(const SnapshotFormat::TokenRecord_t& rec, TokenSnapshot_t& token) const;
+	bool GetSecurityDescriptor(const SnapshotFormat::SecurityDescriptorRecord_t& rec, SecurityDescriptorSnapshot_t& sd) const;
+	bool GetSession(const SnapshotFormat::SessionRecord_t& rec, SessionSnapshot_t& session) const;
+	bool GetWindowStation(const SnapshotFormat::WindowStationRecord_t& rec, WindowStationSnapshot_t& winsta) const;
+	bool GetDesktop(const SnapshotFormat::DesktopRecord_t& rec, DesktopSnapshot_t& desktop) const;
+
+private:
+	MappedFile m_mappedFile;
+	const uint8_t* m_pData = nullptr;
+	size_t m_size = 0;
+	Section_t m_strings, m_blobs, m_sids, m_snapshot, m_sessions, m_processes, m_windowStations, m_desktops, m_windows;
+	// Names of the SID records, read on first use by GetSid
+	mutable std::vector<std::shared_ptr<const std::wstring>> m_sidNames;
+
+private:
+	// Not implemented
+	SnapshotFile(const SnapshotFile&) = delete;
+	SnapshotFile& operator = (const SnapshotFile&) = delete;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+// SnapshotRenderer.h: interface for the components that turn a SystemSnapshot_t into output.
+
+#include <iostream>
+#include "SystemSnapshot.h"
+#include "QueryPlan.h"
+
+/// <summary>
+/// Base class for renderers. A renderer only formats what's in the snapshot; it doesn't collect anything.
+/// </summary>
+class SnapshotRenderer
+{
+public:
+	SnapshotRenderer() = default;
+	virtual ~SnapshotRenderer() = default;
+
+	/// <summary>
+	/// Write the snapshot to the output stream
+	/// </summary>
+	virtual void Render(std::wostream& sOut, const SystemSnapshot_t& snapshot) const = 0;
+
+	/// <summary>
+	/// The fields this renderer outputs; the collector needs to query only these.
+	/// </summary>
+	virtual FieldSet_t RequiredFields() const = 0;
+
+private:
+	// Not implemented
+	SnapshotRenderer(const SnapshotRenderer&) = delete;
+	SnapshotRenderer& operator = (const SnapshotRenderer&) = delete;
+};
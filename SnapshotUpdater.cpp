@@ -0,0 +1,87 @@
+// SnapshotUpdater.cpp: keeps a SystemSnapshot_t current in response to session events.
+
+#include "SnapshotUpdater.h"
+#include <utility>
+
+SnapshotUpdater::SnapshotUpdater(const SnapshotCollector& collector, ISnapshotDeltaTarget& deltaTarget, SystemSnapshot_t& snapshot)
+	: m_collector(collector), m_deltaTarget(deltaTarget), m_snapshot(snapshot)
+{
+}
+
+/// <summary>
+/// Re-query the refreshed sessions together, and update, add, or remove each one in the snapshot in place.
+/// A session that can no longer be queried is removed.
+/// </summary>
+void SnapshotUpdater::UpdateSessions(const SessionUpdateList_t& updates)
+{
+	// Sessions aren't being reported at all.
+	if (!m_collector.Plan().bSessions)
+		return;
+
+	// Without a valid session list there's nothing to patch; start over.
+	if (!m_snapshot.sessions.bValid)
+	{
+		FullResync();
+		return;
+	}
+
+	std::vector<uint32_t> refreshIds;
+	SessionUpdateList_t::const_iterator updateIter;
+	for (updateIter = updates.begin(); updateIter != updates.end(); updateIter++)
+	{
+		if (!updateIter->bRemove)
+			refreshIds.push_back(updateIter->dwSessionId);
+	}
+	std::vector<Captured_t<SessionSnapshot_t>> collected;
+	m_collector.CollectSessions(refreshIds, collected);
+
+	// The differences are computed over just the updated sessions: before and after hold only those.
+	SystemSnapshot_t before, after;
+	before.sessions.bValid = true;
+	after.sessions.bValid = true;
+	SessionSnapshotList_t& sessions = m_snapshot.sessions.value;
+	size_t ixCollected = 0;
+	for (updateIter = updates.begin(); updateIter != updates.end(); updateIter++)
+	{
+		SessionSnapshotList_t::iterator sessionIter;
+		for (sessionIter = sessions.begin(); sessionIter != sessions.end(); sessionIter++)
+		{
+			if (sessionIter->dwSessionId == updateIter->dwSessionId)
+				break;
+		}
+		Captured_t<SessionSnapshot_t>* pCollected = (updateIter->bRemove ? nullptr : &collected[ixCollected++]);
+
+		if (sessionIter != sessions.end())
+			before.sessions.value.push_back(std::move(*sessionIter));
+		if (nullptr != pCollected && pCollected->bValid)
+		{
+			after.sessions.value.push_back(pCollected->value);
+			if (sessionIter != sessions.end())
+				*sessionIter = std::move(pCollected->value);
+			else
+				sessions.push_back(std::move(pCollected->value));
+		}
+		else if (sessionIter != sessions.end())
+		{
+			sessions.erase(sessionIter);
+		}
+	}
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(before, after, diff);
+	m_deltaTarget.ReportDelta(diff, after);
+}
+
+/// <summary>
+/// Re-collect everything.
+/// </summary>
+void SnapshotUpdater::FullResync()
+{
+	m_deltaTarget.BeginFullResync();
+	SystemSnapshot_t nextSnapshot;
+	m_collector.Collect(nextSnapshot);
+	SnapshotDiff_t diff;
+	DiffSnapshots(m_snapshot, nextSnapshot, diff);
+	m_deltaTarget.ReportDelta(diff, nextSnapshot);
+	std::swap(m_snapshot, nextSnapshot);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+// SnapshotUpdater.h: keeps a SystemSnapshot_t current in response to session events, and
+// reports the differences each update makes.
+// Portable C++ (no Windows dependencies): the differences go to an ISnapshotDeltaTarget.
+
+#include "SessionEvents.h"
+#include "SnapshotCollector.h"
+#include "SnapshotDiff.h"
+
+/// <summary>
+/// Receives the differences each update makes (e.g., to render them)
+/// </summary>
+class ISnapshotDeltaTarget
+{
+public:
+	virtual ~ISnapshotDeltaTarget() = default;
+
+	/// <summary>
+	/// Report the differences an update made.
+	/// </summary>
+	/// <param name="diff">Differences</param>
+	/// <param name="after">The later sample; after a session update, only the sessions the differences refer to</param>
+	virtual void ReportDelta(const SnapshotDiff_t& diff, const SystemSnapshot_t& after) = 0;
+
+	/// <summary>
+	/// Called before a full resync re-collects everything, to discard whatever is cached between samples
+	/// (e.g., resolved SID names), as each polled sample does.
+	/// </summary>
+	virtual void BeginFullResync() = 0;
+};
+
+/// <summary>
+/// Refresh target for the session event dispatcher. Updating sessions re-queries only those sessions,
+/// with one process enumeration per batch, and patches them into the snapshot in place; a full resync
+/// re-collects everything. Each update's differences are reported to an ISnapshotDeltaTarget.
+/// </summary>
+class SnapshotUpdater : public ISessionRefreshTarget
+{
+public:
+	/// <summary>
+	/// Constructor. All the referenced objects must outlive this object.
+	/// </summary>
+	/// <param name="collector">Collector configured from the command-line options</param>
+	/// <param name="deltaTarget">Receives the differences each update makes</param>
+	/// <param name="snapshot">The current snapshot; updated in place</param>
+	SnapshotUpdater(const SnapshotCollector& collector, ISnapshotDeltaTarget& deltaTarget, SystemSnapshot_t& snapshot);
+	virtual ~SnapshotUpdater() = default;
+
+	virtual void UpdateSessions(const SessionUpdateList_t& updates) override;
+	virtual void FullResync() override;
+
+private:
+	const SnapshotCollector& m_collector;
+	ISnapshotDeltaTarget& m_deltaTarget;
+	SystemSnapshot_t& m_snapshot;
+
+private:
+	// Not implemented
+	SnapshotUpdater(const SnapshotUpdater&) = delete;
+	SnapshotUpdater& operator = (const SnapshotUpdater&) = delete;
+};
@@ -0,0 +1,400 @@
+// SnapshotWriter.cpp: serializes a SystemSnapshot_t into the binary snapshot format.
+//
+// Records are copied into the file image as-is, so this assumes a little-endian host (as are all
+// platforms TSSessions and its consumers run on).
+
+#include <cstring>
+#include "SnapshotWriter.h"
+#include "MappedFile.h"
+
+using namespace SnapshotFormat;
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: append raw bytes to the file image
+/// </summary>
+static void AppendBytes(std::vector<uint8_t>& data, const void* pBytes, size_t nBytes)
+{
+	if (nBytes > 0)
+	{
+		size_t offset = data.size();
+		data.resize(offset + nBytes);
+		memcpy(data.data() + offset, pBytes, nBytes);
+	}
+}
+
+/// <summary>
+/// Internal: a section to be laid out in the file image
+/// </summary>
+struct PendingSection_t
+{
+	uint32_t id;
+	uint32_t recordSize;
+	const void* pData;
+	size_t count;
+};
+
+template <typename T>
+static PendingSection_t Section(uint32_t id, const std::vector<T>& records)
+{
+	PendingSection_t section = { id, (uint32_t)sizeof(T), records.data(), records.size() };
+	return section;
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Serialize a snapshot.
+/// </summary>
+bool SnapshotWriter::Write(const SystemSnapshot_t& snapshot, std::vector<uint8_t>& data, std::wstring& sErrorInfo)
+{
+	sErrorInfo.clear();
+	data.clear();
+	Reset();
+
+	const CurrentInfoSnapshot_t& currentInfo = snapshot.currentInfo;
+	SnapshotRecord_t snapshotRec = {};
+	snapshotRec.sessionId = CapturedU32(currentInfo.sessionId);
+	snapshotRec.winstaName = CapturedStr(currentInfo.winstaName);
+	snapshotRec.winstaFlags = CapturedStr(currentInfo.winstaFlags);
+	snapshotRec.winstaUser = CapturedSid(currentInfo.winstaUser);
+	snapshotRec.desktopName = CapturedStr(currentInfo.desktopName);
+	snapshotRec.desktopFlags = CapturedStr(currentInfo.desktopFlags);
+	snapshotRec.desktopUser = CapturedSid(currentInfo.desktopUser);
+	snapshotRec.desktopHeapSizeKb = CapturedU32(currentInfo.desktopHeapSizeKb);
+	snapshotRec.inputDesktopName = CapturedStr(currentInfo.inputDesktopName);
+	snapshotRec.runningAs = AddSid(currentInfo.runningAs);
+	snapshotRec.activeConsoleSessionId = currentInfo.activeConsoleSessionId;
+	snapshotRec.bChildSessionsEnabled = currentInfo.bChildSessionsEnabled;
+
+	snapshotRec.sessions.bValid = snapshot.sessions.bValid;
+	snapshotRec.sessions.error = AddString(snapshot.sessions.sErrorInfo);
+	snapshotRec.sessions.count = (uint32_t)snapshot.sessions.value.size();
+	// Sessions are added first so that their processes are contiguous in session order.
+	m_sessions.reserve(snapshot.sessions.value.size());
+	for (SessionSnapshotList_t::const_iterator sessionIter = snapshot.sessions.value.begin(); sessionIter != snapshot.sessions.value.end(); sessionIter++)
+	{
+		AddSession(*sessionIter);
+	}
+
+	snapshotRec.windowStations.bValid = snapshot.windowStations.bValid;
+	snapshotRec.windowStations.error = AddString(snapshot.windowStations.sErrorInfo);
+	snapshotRec.windowStations.count = (uint32_t)snapshot.windowStations.value.size();
+	m_windowStations.reserve(snapshot.windowStations.value.size());
+	for (WindowStationSnapshotList_t::const_iterator winstaIter = snapshot.windowStations.value.begin(); winstaIter != snapshot.windowStations.value.end(); winstaIter++)
+	{
+		AddWindowStation(*winstaIter);
+	}
+
+	if (m_bOverflow || m_strings.size() > UINT32_MAX || m_blobs.size() > UINT32_MAX)
+	{
+		sErrorInfo = L"Snapshot exceeds the binary format's 4 GB table limit";
+		return false;
+	}
+
+	// Lay out the file image: header, section directory, then each section 8-byte aligned.
+	std::vector<PendingSection_t> sections;
+	sections.push_back(Section(Section_Strings, m_strings));
+	sections.push_back(Section(Section_Blobs, m_blobs));
+	sections.push_back(Section(Section_Sids, m_sids));
+	PendingSection_t snapshotSection = { Section_Snapshot, (uint32_t)sizeof(SnapshotRecord_t), &snapshotRec, 1 };
+	sections.push_back(snapshotSection);
+	sections.push_back(Section(Section_Sessions, m_sessions));
+	sections.push_back(Section(Section_Processes, m_processes));
+	sections.push_back(Section(Section_WindowStations, m_windowStations));
+	sections.push_back(Section(Section_Desktops, m_desktops));
+	sections.push_back(Section(Section_Windows, m_windows));
+
+	std::vector<SectionEntry_t> directory;
+	size_t offset = sizeof(FileHeader_t) + sections.size() * sizeof(SectionEntry_t);
+	for (std::vector<PendingSection_t>::const_iterator sectionIter = sections.begin(); sectionIter != sections.end(); sectionIter++)
+	{
+		offset = (offset + 7) & ~(size_t)7;
+		SectionEntry_t entry = {};
+		entry.id = sectionIter->id;
+		entry.recordSize = sectionIter->recordSize;
+		entry.offset = offset;
+		entry.count = sectionIter->count;
+		directory.push_back(entry);
+		offset += sectionIter->count * sectionIter->recordSize;
+	}
+
+	FileHeader_t header = {};
+	memcpy(header.magic, Magic, sizeof(header.magic));
+	header.version = CurrentVersion;
+	header.sectionCount = (uint32_t)sections.size();
+	header.fileSize = offset;
+
+	data.reserve(offset);
+	AppendBytes(data, &header, sizeof(header));
+	AppendBytes(data, directory.data(), directory.size() * sizeof(SectionEntry_t));
+	for (size_t ixSection = 0; ixSection < sections.size(); ++ixSection)
+	{
+		data.resize((size_t)directory[ixSection].offset, 0);
+		AppendBytes(data, sections[ixSection].pData, sections[ixSection].count * sections[ixSection].recordSize);
+	}
+
+	Reset();
+	return true;
+}
+
+/// <summary>
+/// Internal: discard all tables and records
+/// </summary>
+void SnapshotWriter::Reset()
+{
+	m_strings.clear();
+	m_stringIndex.clear();
+	m_blobs.clear();
+	m_sids.clear();
+	m_sidIndex.clear();
+	m_sessions.clear();
+	m_processes.clear();
+	m_windowStations.clear();
+	m_desktops.clear();
+	m_windows.clear();
+	m_bOverflow = false;
+}
+
+// ------------------------------------------------------------------------------------------
+// Table builders
+
+/// <summary>
+/// Internal: add a string to the deduplicated string table. Empty strings aren't stored.
+/// </summary>
+StrRef_t SnapshotWriter::AddString(const std::wstring& str)
+{
+	StrRef_t ref = {};
+	if (str.empty())
+		return ref;
+
+	std::unordered_map<std::wstring, StrRef_t>::const_iterator found = m_stringIndex.find(str);
+	if (found != m_stringIndex.end())
+		return found->second;
+
+	size_t offset = m_strings.size();
+	AppendUtf16(str, m_strings);
+	if (m_strings.size() > UINT32_MAX)
+		m_bOverflow = true;
+	ref.offset = (uint32_t)offset;
+	ref.length = (uint32_t)(m_strings.size() - offset);
+	m_stringIndex[str] = ref;
+	return ref;
+}
+
+/// <summary>
+/// Internal: add bytes to the blob table. Empty blobs aren't stored.
+/// </summary>
+BlobRef_t SnapshotWriter::AddBlob(const std::vector<uint8_t>& blob)
+{
+	BlobRef_t ref = {};
+	if (blob.empty())
+		return ref;
+
+	size_t offset = m_blobs.size();
+	m_blobs.insert(m_blobs.end(), blob.begin(), blob.end());
+	if (m_blobs.size() > UINT32_MAX)
+		m_bOverflow = true;
+	ref.offset = (uint32_t)offset;
+	ref.length = (uint32_t)blob.size();
+	return ref;
+}
+
+/// <summary>
+/// Internal: add a SID to the deduplicated SID table; returns its index, or NoSid for an empty SID.
+/// </summary>
+uint32_t SnapshotWriter::AddSid(const SidInfo_t& sidInfo)
+{
+	if (sidInfo.IsEmpty())
+		return NoSid;
+
+	std::pair<std::vector<uint8_t>, std::wstring> key(std::vector<uint8_t>(sidInfo.Data(), sidInfo.Data() + sidInfo.Length()), sidInfo.Name());
+	std::map<std::pair<std::vector<uint8_t>, std::wstring>, uint32_t>::const_iterator found = m_sidIndex.find(key);
+	if (found != m_sidIndex.end())
+		return found->second;
+
+	SidRecord_t rec = {};
+	rec.bytes = AddBlob(key.first);
+	rec.sSid = AddString(sidInfo.ToString());
+	rec.sDomainAndUsername = AddString(key.second);
+	uint32_t index = (uint32_t)m_sids.size();
+	m_sids.push_back(rec);
+	m_sidIndex[key] = index;
+	return index;
+}
+
+// ------------------------------------------------------------------------------------------
+// Capture-status converters
+
+CapturedStr_t SnapshotWriter::CapturedStr(const Captured_t<std::wstring>& captured)
+{
+	CapturedStr_t rec = {};
+	rec.value = AddString(captured.value);
+	rec.error = AddString(captured.sErrorInfo);
+	rec.bValid = captured.bValid;
+	return rec;
+}
+
+CapturedU32_t SnapshotWriter::CapturedU32(const Captured_t<uint32_t>& captured)
+{
+	CapturedU32_t rec = {};
+	rec.value = captured.value;
+	rec.bValid = captured.bValid;
+	rec.error = AddString(captured.sErrorInfo);
+	return rec;
+}
+
+CapturedU32_t SnapshotWriter::CapturedBool(const Captured_t<bool>& captured)
+{
+	CapturedU32_t rec = {};
+	rec.value = captured.value;
+	rec.bValid = captured.bValid;
+	rec.error = AddString(captured.sErrorInfo);
+	return rec;
+}
+
+CapturedU32_t SnapshotWriter::CapturedSid(const Captured_t<SidInfo_t>& captured)
+{
+	CapturedU32_t rec = {};
+	rec.value = AddSid(captured.value);
+	rec.bValid = captured.bValid;
+	rec.error = AddString(captured.sErrorInfo);
+	return rec;
+}
+
+// ------------------------------------------------------------------------------------------
+// Record builders
+
+void SnapshotWriter::AddToken(const TokenSnapshot_t& token, TokenRecord_t& rec)
+{
+	rec.userSid = AddSid(token.user);
+	rec.logonSessionHigh = token.logonSessionHigh;
+	rec.logonSessionLow = token.logonSessionLow;
+	rec.integrityLevel = token.integrityLevel;
+	rec.sIntegrityLevelName = AddString(token.sIntegrityLevelName);
+}
+
+void SnapshotWriter::AddSecurityDescriptor(const SecurityDescriptorSnapshot_t& sd, SecurityDescriptorRecord_t& rec)
+{
+	rec.bCollected = sd.bCollected;
+	rec.securityInformation = sd.securityInformation;
+	rec.sd.value = AddBlob(sd.sd.value);
+	rec.sd.bValid = sd.sd.bValid;
+	rec.sd.error = AddString(sd.sd.sErrorInfo);
+}
+
+void SnapshotWriter::AddSession(const SessionSnapshot_t& session)
+{
+	SessionRecord_t rec = {};
+	rec.dwSessionId = session.dwSessionId;
+	rec.state = session.state;
+	rec.sessionFlags = session.sessionFlags;
+	rec.tokenStatus = (uint32_t)session.tokenStatus;
+	rec.sName = AddString(session.sName);
+	rec.sState = AddString(session.sState);
+	rec.sSessionFlags = AddString(session.sSessionFlags);
+	rec.sDomainName = AddString(session.sDomainName);
+	rec.sUserName = AddString(session.sUserName);
+	rec.sTokenError = AddString(session.sTokenError);
+	rec.logonTime = session.logonTime;
+	rec.connectTime = session.connectTime;
+	rec.disconnectTime = session.disconnectTime;
+	rec.lastInputTime = session.lastInputTime;
+	rec.currentTime = session.currentTime;
+	AddToken(session.token, rec.token);
+	rec.bHasLinkedToken = session.bHasLinkedToken;
+	AddToken(session.linkedToken, rec.linkedToken);
+	rec.bProcessesCollected = session.bProcessesCollected;
+
+	rec.processes.first = (uint32_t)m_processes.size();
+	rec.processes.count = (uint32_t)session.processes.value.size();
+	rec.processes.bValid = session.processes.bValid;
+	rec.processes.error = AddString(session.processes.sErrorInfo);
+	for (ProcessSnapshotList_t::const_iterator procIter = session.processes.value.begin(); procIter != session.processes.value.end(); procIter++)
+	{
+		ProcessRecord_t procRec = {};
+		procRec.dwPID = procIter->dwPID;
+		procRec.userSid = AddSid(procIter->user);
+		procRec.sProcessName = AddString(procIter->sProcessName);
+		procRec.createTime = procIter->createTime;
+		procRec.threadCount = procIter->threadCount;
+		procRec.handleCount = procIter->handleCount;
+		procRec.workingSetSize = procIter->workingSetSize;
+		procRec.pagefileUsage = procIter->pagefileUsage;
+		procRec.userTime = procIter->userTime;
+		procRec.kernelTime = procIter->kernelTime;
+		m_processes.push_back(procRec);
+	}
+
+	m_sessions.push_back(rec);
+}
+
+void SnapshotWriter::AddWindowStation(const WindowStationSnapshot_t& winsta)
+{
+	WindowStationRecord_t rec = {};
+	rec.sName = AddString(winsta.sName);
+	rec.sOpenError = AddString(winsta.sOpenError);
+	rec.bOpened = winsta.bOpened;
+	rec.flags = CapturedStr(winsta.flags);
+	rec.user = CapturedSid(winsta.user);
+	AddSecurityDescriptor(winsta.securityDescriptor, rec.securityDescriptor);
+
+	rec.desktops.first = (uint32_t)m_desktops.size();
+	rec.desktops.count = (uint32_t)winsta.desktops.value.size();
+	rec.desktops.bValid = winsta.desktops.bValid;
+	rec.desktops.error = AddString(winsta.desktops.sErrorInfo);
+	for (DesktopSnapshotList_t::const_iterator desktopIter = winsta.desktops.value.begin(); desktopIter != winsta.desktops.value.end(); desktopIter++)
+	{
+		AddDesktop(*desktopIter);
+	}
+
+	m_windowStations.push_back(rec);
+}
+
+void SnapshotWriter::AddDesktop(const DesktopSnapshot_t& desktop)
+{
+	DesktopRecord_t rec = {};
+	rec.sName = AddString(desktop.sName);
+	rec.sOpenError = AddString(desktop.sOpenError);
+	rec.bOpened = desktop.bOpened;
+	rec.bWindowsCollected = desktop.bWindowsCollected;
+	rec.flags = CapturedStr(desktop.flags);
+	rec.user = CapturedSid(desktop.user);
+	rec.heapSizeKb = CapturedU32(desktop.heapSizeKb);
+	rec.receivingInput = CapturedBool(desktop.receivingInput);
+	AddSecurityDescriptor(desktop.securityDescriptor, rec.securityDescriptor);
+
+	rec.windows.first = (uint32_t)m_windows.size();
+	rec.windows.count = (uint32_t)desktop.windows.value.size();
+	rec.windows.bValid = desktop.windows.bValid;
+	rec.windows.error = AddString(desktop.windows.sErrorInfo);
+	for (WindowSnapshotList_t::const_iterator windowIter = desktop.windows.value.begin(); windowIter != desktop.windows.value.end(); windowIter++)
+	{
+		WindowRecord_t windowRec = {};
+		windowRec.hwnd = windowIter->hwnd;
+		windowRec.PID = windowIter->PID;
+		windowRec.TID = windowIter->TID;
+		windowRec.flags = (windowIter->bIsValid ? (uint32_t)WindowFlag_Valid : 0) | (windowIter->bIsVisible ? (uint32_t)WindowFlag_Visible : 0);
+		windowRec.sProcessPath = AddString(windowIter->sProcessPath);
+		windowRec.sClassName = AddString(windowIter->sClassName);
+		windowRec.sWindowText = AddString(windowIter->sWindowText);
+		m_windows.push_back(windowRec);
+	}
+
+	m_desktops.push_back(rec);
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Serialize a snapshot and write it to a file.
+/// </summary>
+bool WriteSnapshotFile(const SystemSnapshot_t& snapshot, const std::wstring& sPath, std::wstring& sErrorInfo)
+{
+	std::vector<uint8_t> data;
+	SnapshotWriter writer;
+	if (!writer.Write(snapshot, data, sErrorInfo))
+		return false;
+	return WriteBinaryFile(sPath, data, sErrorInfo);
+}
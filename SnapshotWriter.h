@@ -0,0 +1,79 @@
+#pragma once
+
+// SnapshotWriter.h: serializes a SystemSnapshot_t into the binary snapshot format (see SnapshotFormat.h).
+// Portable C++ (no Windows dependencies).
+
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include "SystemSnapshot.h"
+#include "SnapshotFormat.h"
+
+/// <summary>
+/// Builds the string, blob, and SID tables and the record arrays for one snapshot, then lays them out as a file image.
+/// </summary>
+class SnapshotWriter
+{
+public:
+	SnapshotWriter() = default;
+	~SnapshotWriter() = default;
+
+	/// <summary>
+	/// Serialize a snapshot.
+	/// </summary>
+	/// <param name="snapshot">Input: the snapshot to serialize</param>
+	/// <param name="data">Output: the complete file image</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true on success; false if the snapshot exceeds the format's limits</returns>
+	bool Write(const SystemSnapshot_t& snapshot, std::vector<uint8_t>& data, std::wstring& sErrorInfo);
+
+private:
+	void Reset();
+
+	// Table builders
+	SnapshotFormat::StrRef_t AddString(const std::wstring& str);
+	SnapshotFormat::BlobRef_t AddBlob(const std::vector<uint8_t>& blob);
+	uint32_t AddSid(const SidInfo_t& sidInfo);
+
+	// Capture-status converters
+	SnapshotFormat::CapturedStr_t CapturedStr(const Captured_t<std::wstring>& captured);
+	SnapshotFormat::CapturedU32_t CapturedU32(const Captured_t<uint32_t>& captured);
+	SnapshotFormat::CapturedU32_t CapturedBool(const Captured_t<bool>& captured);
+	SnapshotFormat::CapturedU32_t CapturedSid(const Captured_t<SidInfo_t>& captured);
+
+	// Record builders
+	void AddToken(const TokenSnapshot_t& token, SnapshotFormat::TokenRecord_t& rec);
+	void AddSecurityDescriptor(const SecurityDescriptorSnapshot_t& sd, SnapshotFormat::SecurityDescriptorRecord_t& rec);
+	void AddSession(const SessionSnapshot_t& session);
+	void AddWindowStation(const WindowStationSnapshot_t& winsta);
+	void AddDesktop(const DesktopSnapshot_t& desktop);
+
+private:
+	std::vector<char16_t> m_strings;
+	std::unordered_map<std::wstring, SnapshotFormat::StrRef_t> m_stringIndex;
+	std::vector<uint8_t> m_blobs;
+	std::vector<SnapshotFormat::SidRecord_t> m_sids;
+	// SIDs are deduplicated by binary SID and looked-up name (the same SID can have a name in one place and not another)
+	std::map<std::pair<std::vector<uint8_t>, std::wstring>, uint32_t> m_sidIndex;
+	std::vector<SnapshotFormat::SessionRecord_t> m_sessions;
+	std::vector<SnapshotFormat::ProcessRecord_t> m_processes;
+	std::vector<SnapshotFormat::WindowStationRecord_t> m_windowStations;
+	std::vector<SnapshotFormat::DesktopRecord_t> m_desktops;
+	std::vector<SnapshotFormat::WindowRecord_t> m_windows;
+	// Set when a table outgrows its 32-bit offsets
+	bool m_bOverflow = false;
+
+private:
+	// Not implemented
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator = (const SnapshotWriter&) = delete;
+};
+
+/// <summary>
+/// Serialize a snapshot and write it to a file.
+/// </summary>
+/// <param name="snapshot">Input: the snapshot to save</param>
+/// <param name="sPath">Input: path of the file to create or overwrite</param>
+/// <param name="sErrorInfo">Output: error information on failure</param>
+/// <returns>true on success, false otherwise</returns>
+bool WriteSnapshotFile(const SystemSnapshot_t& snapshot, const std::wstring& sPath, std::wstring& sErrorInfo);
@@ -0,0 +1,510 @@
+// SourceCapture.cpp: recorded SystemSource responses (.tsscap files), for replaying collection on any platform.
+
+#include <cstring>
+#include "SourceCapture.h"
+#include "SnapshotFormat.h"
+#include "MappedFile.h"
+
+using namespace SourceCapture;
+
+// ------------------------------------------------------------------------------------------
+
+Key_t SourceCapture::MakeKey(Call_t call, const std::wstring& sArg1 /*= std::wstring()*/, const std::wstring& sArg2 /*= std::wstring()*/)
+{
+	Key_t key;
+	key.call = call;
+	key.sArg1 = sArg1;
+	key.sArg2 = sArg2;
+	return key;
+}
+
+Key_t SourceCapture::MakeKey(Call_t call, uint32_t dwId)
+{
+	return MakeKey(call, std::to_wstring(dwId));
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Add a response. If the call was already recorded, the first response is kept.
+/// </summary>
+void Capture::Add(const Key_t& key, const Response_t& response)
+{
+	m_responses.insert(std::make_pair(key, response));
+}
+
+/// <summary>
+/// The recorded response for a call; nullptr if the call wasn't recorded.
+/// </summary>
+const Response_t* Capture::Find(const Key_t& key) const
+{
+	std::map<Key_t, Response_t>::const_iterator iter = m_responses.find(key);
+	if (m_responses.end() == iter)
+		return nullptr;
+	return &iter->second;
+}
+
+/// <summary>
+/// Serialize the capture to a file image.
+/// </summary>
+void Capture::Write(std::vector<uint8_t>& data) const
+{
+	data.assign(Magic, Magic + sizeof(Magic));
+	CaptureEncoder encoder(data);
+	encoder.U32(CurrentVersion);
+	encoder.U32((uint32_t)m_responses.size());
+	std::map<Key_t, Response_t>::const_iterator iter;
+	for (iter = m_responses.begin(); iter != m_responses.end(); iter++)
+	{
+		encoder.U32(iter->first.call);
+		encoder.String(iter->first.sArg1);
+		encoder.String(iter->first.sArg2);
+		encoder.U64(iter->second.latencyNs);
+		encoder.Bool(iter->second.bResult);
+		encoder.String(iter->second.sErrorInfo);
+		encoder.Bytes(iter->second.payload);
+	}
+}
+
+/// <summary>
+/// Parse a file image, replacing the current contents.
+/// </summary>
+bool Capture::Read(const uint8_t* pData, size_t size, std::wstring& sErrorInfo)
+{
+	m_responses.clear();
+	if (size < sizeof(Magic) || 0 != memcmp(pData, Magic, sizeof(Magic)))
+	{
+		sErrorInfo = L"Not a TSSessions capture file";
+		return false;
+	}
+	CaptureDecoder decoder(pData + sizeof(Magic), size - sizeof(Magic));
+	uint32_t version = decoder.U32();
+	if (decoder.Ok() && version != CurrentVersion)
+	{
+		sErrorInfo = L"Unsupported capture file version " + std::to_wstring(version);
+		return false;
+	}
+	uint32_t nEntries = decoder.U32();
+	for (uint32_t ix = 0; ix < nEntries && decoder.Ok(); ++ix)
+	{
+		Key_t key;
+		Response_t response;
+		key.call = decoder.U32();
+		key.sArg1 = decoder.String();
+		key.sArg2 = decoder.String();
+		response.latencyNs = decoder.U64();
+		response.bResult = decoder.Bool();
+		response.sErrorInfo = decoder.String();
+		response.payload = decoder.Bytes();
+		if (decoder.Ok())
+			Add(key, response);
+	}
+	if (!decoder.Done())
+	{
+		m_responses.clear();
+		sErrorInfo = L"Capture file is truncated or corrupt";
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Write to a file.
+/// </summary>
+bool Capture::Save(const std::wstring& sPath, std::wstring& sErrorInfo) const
+{
+	std::vector<uint8_t> data;
+	Write(data);
+	return WriteBinaryFile(sPath, data, sErrorInfo);
+}
+
+/// <summary>
+/// Read from a file.
+/// </summary>
+bool Capture::Load(const std::wstring& sPath, std::wstring& sErrorInfo)
+{
+	MappedFile file;
+	if (!file.Open(sPath, sErrorInfo))
+		return false;
+	return Read(file.Data(), file.Size(), sErrorInfo);
+}
+
+// ------------------------------------------------------------------------------------------
+
+void CaptureEncoder::U32(uint32_t value)
+{
+	for (int shift = 0; shift < 32; shift += 8)
+		m_data.push_back((uint8_t)(value >> shift));
+}
+
+void CaptureEncoder::U64(uint64_t value)
+{
+	for (int shift = 0; shift < 64; shift += 8)
+		m_data.push_back((uint8_t)(value >> shift));
+}
+
+void CaptureEncoder::String(const std::wstring& str)
+{
+	std::vector<char16_t> utf16;
+	SnapshotFormat::AppendUtf16(str, utf16);
+	U32((uint32_t)utf16.size());
+	for (size_t ix = 0; ix < utf16.size(); ++ix)
+	{
+		m_data.push_back((uint8_t)utf16[ix]);
+		m_data.push_back((uint8_t)(utf16[ix] >> 8));
+	}
+}
+
+void CaptureEncoder::Bytes(const std::vector<uint8_t>& bytes)
+{
+	U32((uint32_t)bytes.size());
+	m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+}
+
+void CaptureEncoder::StringList(const std::vector<std::wstring>& strings)
+{
+	U32((uint32_t)strings.size());
+	for (size_t ix = 0; ix < strings.size(); ++ix)
+		String(strings[ix]);
+}
+
+void CaptureEncoder::Sid(const SidInfo_t& sid)
+{
+	// Same layout as when SidInfo_t held the string form, so existing captures still replay.
+	U32((uint32_t)sid.Length());
+	m_data.insert(m_data.end(), sid.Data(), sid.Data() + sid.Length());
+	String(sid.ToString());
+	String(sid.Name());
+}
+
+void CaptureEncoder::Token(const TokenSnapshot_t& token)
+{
+	Sid(token.user);
+	U32(token.logonSessionHigh);
+	U32(token.logonSessionLow);
+	U32(token.integrityLevel);
+	String(token.sIntegrityLevelName);
+}
+
+void CaptureEncoder::TokenStatus(const SessionSnapshot_t& session)
+{
+	U32((uint32_t)session.tokenStatus);
+	String(session.sTokenError);
+	Token(session.token);
+	Bool(session.bHasLinkedToken);
+	Token(session.linkedToken);
+}
+
+void CaptureEncoder::Session(const SessionSnapshot_t& session)
+{
+	U32(session.dwSessionId);
+	String(session.sName);
+	U32(session.state);
+	String(session.sState);
+	U32((uint32_t)session.sessionFlags);
+	String(session.sSessionFlags);
+	String(session.sDomainName);
+	String(session.sUserName);
+	I64(session.logonTime);
+	I64(session.connectTime);
+	I64(session.disconnectTime);
+	I64(session.lastInputTime);
+	I64(session.currentTime);
+}
+
+void CaptureEncoder::Sessions(const SessionSnapshotList_t& sessions)
+{
+	U32((uint32_t)sessions.size());
+	for (size_t ix = 0; ix < sessions.size(); ++ix)
+		Session(sessions[ix]);
+}
+
+void CaptureEncoder::Process(const ProcessSnapshot_t& process)
+{
+	U32(process.dwPID);
+	I64(process.createTime);
+	String(process.sProcessName);
+	Sid(process.user);
+	U32(process.threadCount);
+	U32(process.handleCount);
+	U64(process.workingSetSize);
+	U64(process.pagefileUsage);
+	I64(process.userTime);
+	I64(process.kernelTime);
+}
+
+void CaptureEncoder::Processes(const ProcessTable& processes)
+{
+	U32((uint32_t)processes.Size());
+	for (size_t ix = 0; ix < processes.Size(); ++ix)
+	{
+		U32(processes.SessionId(ix));
+		Process(processes.Process(ix));
+	}
+}
+
+void CaptureEncoder::Windows(const WindowSnapshotList_t& windows)
+{
+	U32((uint32_t)windows.size());
+	for (size_t ix = 0; ix < windows.size(); ++ix)
+	{
+		const WindowSnapshot_t& window = windows[ix];
+		U64(window.hwnd);
+		Bool(window.bIsValid);
+		Bool(window.bIsVisible);
+		U32(window.PID);
+		U32(window.TID);
+		String(window.sProcessPath);
+		String(window.sClassName);
+		String(window.sWindowText);
+	}
+}
+
+void CaptureEncoder::CurrentInfo(const CurrentInfoSnapshot_t& currentInfo)
+{
+	CapturedU32(currentInfo.sessionId);
+	CapturedString(currentInfo.winstaName);
+	CapturedString(currentInfo.winstaFlags);
+	CapturedSid(currentInfo.winstaUser);
+	CapturedString(currentInfo.desktopName);
+	CapturedString(currentInfo.desktopFlags);
+	CapturedSid(currentInfo.desktopUser);
+	CapturedU32(currentInfo.desktopHeapSizeKb);
+	Sid(currentInfo.runningAs);
+	CapturedString(currentInfo.inputDesktopName);
+	U32(currentInfo.activeConsoleSessionId);
+	Bool(currentInfo.bChildSessionsEnabled);
+}
+
+void CaptureEncoder::CapturedString(const Captured_t<std::wstring>& captured)
+{
+	Bool(captured.bValid);
+	String(captured.value);
+	String(captured.sErrorInfo);
+}
+
+void CaptureEncoder::CapturedU32(const Captured_t<uint32_t>& captured)
+{
+	Bool(captured.bValid);
+	U32(captured.value);
+	String(captured.sErrorInfo);
+}
+
+void CaptureEncoder::CapturedSid(const Captured_t<SidInfo_t>& captured)
+{
+	Bool(captured.bValid);
+	Sid(captured.value);
+	String(captured.sErrorInfo);
+}
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Consume nBytes; nullptr (and failed) if fewer remain.
+/// </summary>
+const uint8_t* CaptureDecoder::Raw(size_t nBytes)
+{
+	if (!m_bOk || nBytes > m_size - m_pos)
+	{
+		m_bOk = false;
+		return nullptr;
+	}
+	const uint8_t* pBytes = m_pData + m_pos;
+	m_pos += nBytes;
+	return pBytes;
+}
+
+uint32_t CaptureDecoder::U32()
+{
+	const uint8_t* pBytes = Raw(4);
+	if (nullptr == pBytes)
+		return 0;
+	return (uint32_t)pBytes[0] | ((uint32_t)pBytes[1] << 8) | ((uint32_t)pBytes[2] << 16) | ((uint32_t)pBytes[3] << 24);
+}
+
+uint64_t CaptureDecoder::U64()
+{
+	uint64_t low = U32();
+	uint64_t high = U32();
+	return low | (high << 32);
+}
+
+size_t CaptureDecoder::Count(size_t minElementSize)
+{
+	size_t count = U32();
+	// Checking against the remaining data keeps corrupt counts from triggering huge allocations.
+	if (m_bOk && count > (m_size - m_pos) / minElementSize)
+	{
+		m_bOk = false;
+		return 0;
+	}
+	return count;
+}
+
+std::wstring CaptureDecoder::String()
+{
+	size_t length = Count(2);
+	const uint8_t* pBytes = Raw(length * 2);
+	if (nullptr == pBytes)
+		return std::wstring();
+	std::vector<char16_t> utf16(length);
+	for (size_t ix = 0; ix < length; ++ix)
+		utf16[ix] = (char16_t)(pBytes[ix * 2] | (pBytes[ix * 2 + 1] << 8));
+	return SnapshotFormat::Utf16ToWString(utf16.data(), length);
+}
+
+std::vector<uint8_t> CaptureDecoder::Bytes()
+{
+	size_t length = Count(1);
+	const uint8_t* pBytes = Raw(length);
+	if (nullptr == pBytes)
+		return std::vector<uint8_t>();
+	return std::vector<uint8_t>(pBytes, pBytes + length);
+}
+
+void CaptureDecoder::StringList(std::vector<std::wstring>& strings)
+{
+	strings.resize(Count(4));
+	for (size_t ix = 0; ix < strings.size(); ++ix)
+		strings[ix] = String();
+}
+
+void CaptureDecoder::Sid(SidInfo_t& sid)
+{
+	size_t length = Count(1);
+	const uint8_t* pBytes = Raw(length);
+	if (nullptr == pBytes || !sid.Assign(pBytes, length))
+	{
+		m_bOk = false;
+		sid = SidInfo_t();
+	}
+	// The string form is derived from the binary SID.
+	String();
+	sid.SetName(String());
+}
+
+void CaptureDecoder::Token(TokenSnapshot_t& token)
+{
+	Sid(token.user);
+	token.logonSessionHigh = U32();
+	token.logonSessionLow = U32();
+	token.integrityLevel = U32();
+	token.sIntegrityLevelName = String();
+}
+
+void CaptureDecoder::TokenStatus(SessionSnapshot_t& session)
+{
+	uint32_t tokenStatus = U32();
+	if (tokenStatus > (uint32_t)TokenStatus_t::Error)
+		m_bOk = false;
+	session.tokenStatus = (TokenStatus_t)tokenStatus;
+	session.sTokenError = String();
+	Token(session.token);
+	session.bHasLinkedToken = Bool();
+	Token(session.linkedToken);
+}
+
+void CaptureDecoder::Session(SessionSnapshot_t& session)
+{
+	session.dwSessionId = U32();
+	session.sName = String();
+	session.state = U32();
+	session.sState = String();
+	session.sessionFlags = (int32_t)U32();
+	session.sSessionFlags = String();
+	session.sDomainName = String();
+	session.sUserName = String();
+	session.logonTime = I64();
+	session.connectTime = I64();
+	session.disconnectTime = I64();
+	session.lastInputTime = I64();
+	session.currentTime = I64();
+}
+
+void CaptureDecoder::Sessions(SessionSnapshotList_t& sessions)
+{
+	sessions.resize(Count(4));
+	for (size_t ix = 0; ix < sessions.size(); ++ix)
+		Session(sessions[ix]);
+}
+
+void CaptureDecoder::Process(ProcessSnapshot_t& process)
+{
+	process.dwPID = U32();
+	process.createTime = I64();
+	process.sProcessName = String();
+	Sid(process.user);
+	process.threadCount = U32();
+	process.handleCount = U32();
+	process.workingSetSize = U64();
+	process.pagefileUsage = U64();
+	process.userTime = I64();
+	process.kernelTime = I64();
+}
+
+void CaptureDecoder::Processes(ProcessTable& processes)
+{
+	processes.Clear();
+	size_t count = Count(8);
+	for (size_t ix = 0; ix < count && m_bOk; ++ix)
+	{
+		uint32_t dwSessionId = U32();
+		ProcessSnapshot_t process;
+		Process(process);
+		processes.Add(dwSessionId, process);
+	}
+}
+
+void CaptureDecoder::Windows(WindowSnapshotList_t& windows)
+{
+	windows.resize(Count(8));
+	for (size_t ix = 0; ix < windows.size(); ++ix)
+	{
+		WindowSnapshot_t& window = windows[ix];
+		window.hwnd = U64();
+		window.bIsValid = Bool();
+		window.bIsVisible = Bool();
+		window.PID = U32();
+		window.TID = U32();
+		window.sProcessPath = String();
+		window.sClassName = String();
+		window.sWindowText = String();
+	}
+}
+
+void CaptureDecoder::CurrentInfo(CurrentInfoSnapshot_t& currentInfo)
+{
+	CapturedU32(currentInfo.sessionId);
+	CapturedString(currentInfo.winstaName);
+	CapturedString(currentInfo.winstaFlags);
+	CapturedSid(currentInfo.winstaUser);
+	CapturedString(currentInfo.desktopName);
+	CapturedString(currentInfo.desktopFlags);
+	CapturedSid(currentInfo.desktopUser);
+	CapturedU32(currentInfo.desktopHeapSizeKb);
+	Sid(currentInfo.runningAs);
+	CapturedString(currentInfo.inputDesktopName);
+	currentInfo.activeConsoleSessionId = U32();
+	currentInfo.bChildSessionsEnabled = Bool();
+}
+
+void CaptureDecoder::CapturedString(Captured_t<std::wstring>& captured)
+{
+	captured.bValid = Bool();
+	captured.value = String();
+	captured.sErrorInfo = String();
+}
+
+void CaptureDecoder::CapturedU32(Captured_t<uint32_t>& captured)
+{
+	captured.bValid = Bool();
+	captured.value = U32();
+	captured.sErrorInfo = String();
+}
+
+void CaptureDecoder::CapturedSid(Captured_t<SidInfo_t>& captured)
+{
+	captured.bValid = Bool();
+	Sid(captured.value);
+	captured.sErrorInfo = String();
+}
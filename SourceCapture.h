@@ -0,0 +1,230 @@
+#pragma once
+
+// SourceCapture.h: recorded SystemSource responses (.tsscap files), for replaying collection on any platform.
+//
+// A capture maps each call -- identified by a call ID and up to two string arguments (session ID, SID string,
+// window station and desktop names) -- to its recorded response: the result, error information, the latency
+// of the original call, and the output data encoded as a payload.
+//
+// File layout: 8-byte magic, uint32 version, uint32 entry count, then the entries. Each entry is
+// uint32 call ID, string arg1, string arg2, uint64 latency in nanoseconds, uint32 result, string error,
+// uint32 payload length, payload bytes. Strings are a uint32 count of UTF-16 code units followed by the code units.
+// All integers are little-endian and unaligned, independent of the host's byte order.
+//
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "SystemSnapshot.h"
+#include "ProcessTable.h"
+
+namespace SourceCapture
+{
+	// "TSSCAP" + two bytes that catch text-mode newline conversion
+	const char Magic[8] = { 'T', 'S', 'S', 'C', 'A', 'P', '\r', '\n' };
+	// Incremented only for changes that older readers can't handle
+	const uint32_t CurrentVersion = 1;
+
+	/// <summary>
+	/// Recorded calls. Values are stored in capture files; don't renumber.
+	/// </summary>
+	enum Call_t : uint32_t
+	{
+		Call_CurrentInfo = 1,
+		Call_EnumerateSessions = 2,
+		Call_QuerySessionInfo = 3,        // arg1: session ID
+		Call_QueryUserToken = 4,          // arg1: session ID
+		// 5 was a per-session process enumeration, replaced by Call_EnumerateAllProcesses
+		Call_LookupSidName = 6,           // arg1: SID string; batch lookups are recorded as one of these per SID
+		Call_WindowStationNames = 7,
+		Call_OpenWindowStation = 8,       // arg1: window station
+		Call_WindowStationFlags = 9,      // arg1: window station
+		Call_WindowStationUser = 10,      // arg1: window station
+		Call_WindowStationSecurity = 11,  // arg1: window station
+		Call_DesktopNames = 12,           // arg1: window station
+		Call_OpenDesktop = 13,            // arg1: window station, arg2: desktop (likewise for the rest)
+		Call_DesktopFlags = 14,
+		Call_DesktopUser = 15,
+		Call_DesktopSecurity = 16,
+		Call_DesktopHeapSize = 17,
+		Call_DesktopInput = 18,
+		Call_DesktopWindows = 19,
+		Call_EnumerateAllProcesses = 20,
+		Call_ProcessImagePath = 21,       // arg1: PID
+	};
+
+	/// <summary>
+	/// Identifies one recorded call
+	/// </summary>
+	struct Key_t
+	{
+		uint32_t call = 0;
+		std::wstring sArg1, sArg2;
+
+		bool operator < (const Key_t& other) const
+		{
+			return std::tie(call, sArg1, sArg2) < std::tie(other.call, other.sArg1, other.sArg2);
+		}
+	};
+
+	/// <summary>
+	/// One recorded response
+	/// </summary>
+	struct Response_t
+	{
+		uint64_t latencyNs = 0;
+		bool bResult = false;
+		// Error information on failure; can also hold a warning on success
+		std::wstring sErrorInfo;
+		// Output data, encoded with Encoder; empty on failure
+		std::vector<uint8_t> payload;
+	};
+
+	/// <summary>
+	/// Key for a call with no arguments or with string arguments
+	/// </summary>
+	Key_t MakeKey(Call_t call, const std::wstring& sArg1 = std::wstring(), const std::wstring& sArg2 = std::wstring());
+
+	/// <summary>
+	/// Key for a per-session or per-process call
+	/// </summary>
+	Key_t MakeKey(Call_t call, uint32_t dwId);
+}
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// A set of recorded responses, and its file format.
+/// </summary>
+class Capture
+{
+public:
+	Capture() = default;
+	~Capture() = default;
+
+	/// <summary>
+	/// Add a response. If the call was already recorded, the first response is kept.
+	/// </summary>
+	void Add(const SourceCapture::Key_t& key, const SourceCapture::Response_t& response);
+
+	/// <summary>
+	/// The recorded response for a call; nullptr if the call wasn't recorded.
+	/// </summary>
+	const SourceCapture::Response_t* Find(const SourceCapture::Key_t& key) const;
+
+	size_t Size() const { return m_responses.size(); }
+
+	/// <summary>
+	/// Serialize the capture to a file image / parse a file image, replacing the current contents.
+	/// </summary>
+	void Write(std::vector<uint8_t>& data) const;
+	bool Read(const uint8_t* pData, size_t size, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Write to / read from a file.
+	/// </summary>
+	bool Save(const std::wstring& sPath, std::wstring& sErrorInfo) const;
+	bool Load(const std::wstring& sPath, std::wstring& sErrorInfo);
+
+private:
+	std::map<SourceCapture::Key_t, SourceCapture::Response_t> m_responses;
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Encodes snapshot data as a response payload (or a capture file)
+/// </summary>
+class CaptureEncoder
+{
+public:
+	explicit CaptureEncoder(std::vector<uint8_t>& data) : m_data(data) {}
+
+	void U32(uint32_t value);
+	void U64(uint64_t value);
+	void I64(int64_t value) { U64((uint64_t)value); }
+	void Bool(bool value) { U32(value ? 1 : 0); }
+	void String(const std::wstring& str);
+	void Bytes(const std::vector<uint8_t>& bytes);
+	void StringList(const std::vector<std::wstring>& strings);
+	void Sid(const SidInfo_t& sid);
+	void Token(const TokenSnapshot_t& token);
+	void TokenStatus(const SessionSnapshot_t& session);
+	void Session(const SessionSnapshot_t& session);
+	void Sessions(const SessionSnapshotList_t& sessions);
+	void Process(const ProcessSnapshot_t& process);
+	void Processes(const ProcessTable& processes);
+	void Windows(const WindowSnapshotList_t& windows);
+	void CurrentInfo(const CurrentInfoSnapshot_t& currentInfo);
+
+private:
+	void CapturedString(const Captured_t<std::wstring>& captured);
+	void CapturedU32(const Captured_t<uint32_t>& captured);
+	void CapturedSid(const Captured_t<SidInfo_t>& captured);
+
+private:
+	std::vector<uint8_t>& m_data;
+
+private:
+	// Not implemented
+	CaptureEncoder(const CaptureEncoder&) = delete;
+	CaptureEncoder& operator = (const CaptureEncoder&) = delete;
+};
+
+/// <summary>
+/// Decodes what CaptureEncoder encoded. Reading past the end (or a count that exceeds the remaining data)
+/// marks the decoder failed and yields default values; check Ok() after decoding.
+/// </summary>
+class CaptureDecoder
+{
+public:
+	CaptureDecoder(const uint8_t* pData, size_t size) : m_pData(pData), m_size(size) {}
+	explicit CaptureDecoder(const std::vector<uint8_t>& data) : m_pData(data.data()), m_size(data.size()) {}
+
+	/// <summary>
+	/// true if everything decoded so far was within bounds
+	/// </summary>
+	bool Ok() const { return m_bOk; }
+
+	/// <summary>
+	/// true if decoding succeeded and consumed all of the data
+	/// </summary>
+	bool Done() const { return m_bOk && m_pos == m_size; }
+
+	uint32_t U32();
+	uint64_t U64();
+	int64_t I64() { return (int64_t)U64(); }
+	bool Bool() { return 0 != U32(); }
+	std::wstring String();
+	std::vector<uint8_t> Bytes();
+	const uint8_t* Raw(size_t nBytes);
+	void StringList(std::vector<std::wstring>& strings);
+	void Sid(SidInfo_t& sid);
+	void Token(TokenSnapshot_t& token);
+	void TokenStatus(SessionSnapshot_t& session);
+	void Session(SessionSnapshot_t& session);
+	void Sessions(SessionSnapshotList_t& sessions);
+	void Process(ProcessSnapshot_t& process);
+	void Processes(ProcessTable& processes);
+	void Windows(WindowSnapshotList_t& windows);
+	void CurrentInfo(CurrentInfoSnapshot_t& currentInfo);
+
+private:
+	void CapturedString(Captured_t<std::wstring>& captured);
+	void CapturedU32(Captured_t<uint32_t>& captured);
+	void CapturedSid(Captured_t<SidInfo_t>& captured);
+	// Validate an element count against the remaining data, given each element's minimum encoded size
+	size_t Count(size_t minElementSize);
+
+private:
+	const uint8_t* m_pData;
+	size_t m_size;
+	size_t m_pos = 0;
+	bool m_bOk = true;
+
+private:
+	// Not implemented
+	CaptureDecoder(const CaptureDecoder&) = delete;
+	CaptureDecoder& operator = (const CaptureDecoder&) = delete;
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+// SystemSnapshot.h: in-memory data model of everything TSSessions collects -- the current
+// process' context, terminal sessions with their tokens and processes, window stations,
+// desktops, top-level windows, and security descriptors.
+// A SnapshotCollector fills it; renderers consume it without making any further queries.
+// Plain data only (no Windows headers), so snapshots can be built and inspected on any platform.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SidCodec.h"
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// A collected value, or the error information explaining why it couldn't be collected.
+/// (A few collection functions report a warning alongside a valid value; in that case
+/// bValid is true and sErrorInfo is non-empty.)
+/// </summary>
+template <typename T>
+struct Captured_t
+{
+	bool bValid = false;
+	T value = T();
+	std::wstring sErrorInfo;
+
+	/// <summary>
+	/// Store a successfully-collected value
+	/// </summary>
+	void Set(const T& val)
+	{
+		bValid = true;
+		value = val;
+		sErrorInfo.clear();
+	}
+
+	/// <summary>
+	/// Record a collection failure
+	/// </summary>
+	void SetError(const std::wstring& sError)
+	{
+		bValid = false;
+		value = T();
+		sErrorInfo = sError;
+	}
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// A SID, stored inline so that snapshot rows don't allocate for it, plus its DOMAIN\username if name lookup succeeded.
+/// Names aren't stored per reference: each distinct SID's name is resolved once (SidNameBatch), and every SidInfo_t
+/// for that SID shares it.
+/// </summary>
+struct SidInfo_t
+{
+	// Binary SID; only the first cbSid bytes are meaningful. 0 length if there is no SID.
+	uint8_t bytes[SidCodec::MaxBinaryLength] = {};
+	uint8_t cbSid = 0;
+	// Result of name lookup, shared by every SidInfo_t for the SID; null if there is no SID or if lookup failed.
+	std::shared_ptr<const std::wstring> pName;
+
+	bool IsEmpty() const { return 0 == cbSid; }
+	const uint8_t* Data() const { return bytes; }
+	size_t Length() const { return cbSid; }
+
+	/// <summary>
+	/// Set the binary SID, without a name. Returns false, leaving no SID, if it's longer than any SID can be.
+	/// </summary>
+	bool Assign(const uint8_t* pSid, size_t cb)
+	{
+		pName.reset();
+		cbSid = 0;
+		if (cb > sizeof(bytes))
+			return false;
+		if (0 != cb)
+			memcpy(bytes, pSid, cb);
+		cbSid = (uint8_t)cb;
+		return true;
+	}
+
+	// String form (S-1-...); empty if there is no SID.
+	std::wstring ToString() const { return SidCodec::ToString(bytes, cbSid); }
+
+	// DOMAIN\username; empty if there is no SID or if lookup failed.
+	const std::wstring& Name() const
+	{
+		static const std::wstring sNoName;
+		return pName ? *pName : sNoName;
+	}
+
+	// Set the name for this SID only; SidNameBatch shares one name among all the references to a SID.
+	void SetName(const std::wstring& sName)
+	{
+		if (sName.empty())
+			pName.reset();
+		else
+			pName = std::make_shared<const std::wstring>(sName);
+	}
+
+	// DOMAIN\username, or the string form if the name wasn't resolved
+	std::wstring DisplayName() const { return pName ? *pName : ToString(); }
+
+	// The same SID; names aren't compared
+	bool operator == (const SidInfo_t& other) const { return cbSid == other.cbSid && 0 == memcmp(bytes, other.bytes, cbSid); }
+	bool operator != (const SidInfo_t& other) const { return !(*this == other); }
+
+	// FNV-1a over the SID bytes, for hash maps keyed by SID
+	struct Hash_t
+	{
+		size_t operator()(const SidInfo_t& sid) const
+		{
+			uint64_t hash = 0xCBF29CE484222325ULL;
+			for (size_t ix = 0; ix < sid.cbSid; ++ix)
+			{
+				hash ^= sid.bytes[ix];
+				hash *= 0x100000001B3ULL;
+			}
+			return (size_t)hash;
+		}
+	};
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Attributes of a session's user token
+/// </summary>
+struct TokenSnapshot_t
+{
+	SidInfo_t user;
+	uint32_t logonSessionHigh = 0, logonSessionLow = 0;
+	uint32_t integrityLevel = 0;
+	std::wstring sIntegrityLevelName;
+};
+
+/// <summary>
+/// Outcome of trying to retrieve a session's user token
+/// </summary>
+enum class TokenStatus_t { NotCollected, Retrieved, PrivilegeNotHeld, NoToken, Error };
+
+/// <summary>
+/// A process running in a terminal session
+/// </summary>
+struct ProcessSnapshot_t
+{
+	uint32_t dwPID = 0;
+	// 100-nanosecond intervals since January 1, 1601 (UTC); 0 if not known.
+	// Together with the PID, identifies the process across samples even if the PID is reused.
+	int64_t createTime = 0;
+	std::wstring sProcessName;
+	SidInfo_t user;
+
+	// Resource usage at enumeration time. Memory sizes are in bytes; CPU times are 100-nanosecond intervals.
+	uint32_t threadCount = 0;
+	uint32_t handleCount = 0;
+	uint64_t workingSetSize = 0;
+	uint64_t pagefileUsage = 0;
+	int64_t userTime = 0;
+	int64_t kernelTime = 0;
+};
+typedef std::vector<ProcessSnapshot_t> ProcessSnapshotList_t;
+
+/// <summary>
+/// A terminal session, its user token(s), and optionally its processes
+/// </summary>
+struct SessionSnapshot_t
+{
+	uint32_t dwSessionId = 0xFFFFFFFF;
+	std::wstring sName;
+	// WTS_CONNECTSTATE_CLASS value and its display name
+	uint32_t state = 0;
+	std::wstring sState;
+	// WTS_SESSIONSTATE_x value and its display name
+	int32_t sessionFlags = 0;
+	std::wstring sSessionFlags;
+	std::wstring sDomainName, sUserName;
+	// Times are 100-nanosecond intervals since January 1, 1601 (UTC); 0 if not set.
+	int64_t logonTime = 0, connectTime = 0, disconnectTime = 0, lastInputTime = 0, currentTime = 0;
+
+	TokenStatus_t tokenStatus = TokenStatus_t::NotCollected;
+	// Error text when tokenStatus is TokenStatus_t::Error
+	std::wstring sTokenError;
+	TokenSnapshot_t token;
+	bool bHasLinkedToken = false;
+	TokenSnapshot_t linkedToken;
+
+	bool bProcessesCollected = false;
+	Captured_t<ProcessSnapshotList_t> processes;
+};
+typedef std::vector<SessionSnapshot_t> SessionSnapshotList_t;
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// A window station's or desktop's security descriptor
+/// </summary>
+struct SecurityDescriptorSnapshot_t
+{
+	// Whether collection was requested
+	bool bCollected = false;
+	// Self-relative security descriptor
+	Captured_t<std::vector<uint8_t>> sd;
+	// The SECURITY_INFORMATION flags the descriptor was retrieved with
+	uint32_t securityInformation = 0;
+};
+
+/// <summary>
+/// A top-level window
+/// </summary>
+struct WindowSnapshot_t
+{
+	uint64_t hwnd = 0;
+	bool bIsValid = false, bIsVisible = false;
+	uint32_t PID = 0, TID = 0;
+	std::wstring sProcessPath, sClassName, sWindowText;
+};
+typedef std::vector<WindowSnapshot_t> WindowSnapshotList_t;
+
+/// <summary>
+/// A desktop and optionally its security descriptor and top-level windows.
+/// For the user SID: valid and empty means the object has no user.
+/// </summary>
+struct DesktopSnapshot_t
+{
+	std::wstring sName;
+	bool bOpened = false;
+	std::wstring sOpenError;
+	Captured_t<std::wstring> flags;
+	Captured_t<SidInfo_t> user;
+	Captured_t<uint32_t> heapSizeKb;
+	Captured_t<bool> receivingInput;
+	SecurityDescriptorSnapshot_t securityDescriptor;
+	bool bWindowsCollected = false;
+	// Sorted by HWND. sErrorInfo can hold a warning even when the list is valid.
+	Captured_t<WindowSnapshotList_t> windows;
+};
+typedef std::vector<DesktopSnapshot_t> DesktopSnapshotList_t;
+
+/// <summary>
+/// A window station in the current session, and its desktops.
+/// For the user SID: valid and empty means the object has no user.
+/// </summary>
+struct WindowStationSnapshot_t
+{
+	std::wstring sName;
+	bool bOpened = false;
+	std::wstring sOpenError;
+	Captured_t<std::wstring> flags;
+	Captured_t<SidInfo_t> user;
+	SecurityDescriptorSnapshot_t securityDescriptor;
+	Captured_t<DesktopSnapshotList_t> desktops;
+};
+typedef std::vector<WindowStationSnapshot_t> WindowStationSnapshotList_t;
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Information about the context this process is running in
+/// </summary>
+struct CurrentInfoSnapshot_t
+{
+	Captured_t<uint32_t> sessionId;
+	Captured_t<std::wstring> winstaName, winstaFlags;
+	Captured_t<SidInfo_t> winstaUser;
+	Captured_t<std::wstring> desktopName, desktopFlags;
+	Captured_t<SidInfo_t> desktopUser;
+	Captured_t<uint32_t> desktopHeapSizeKb;
+	SidInfo_t runningAs;
+	Captured_t<std::wstring> inputDesktopName;
+	// 0xFFFFFFFF if the console session is in transition
+	uint32_t activeConsoleSessionId = 0xFFFFFFFF;
+	bool bChildSessionsEnabled = false;
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Everything collected in one run
+/// </summary>
+struct SystemSnapshot_t
+{
+	CurrentInfoSnapshot_t currentInfo;
+	Captured_t<SessionSnapshotList_t> sessions;
+	Captured_t<WindowStationSnapshotList_t> windowStations;
+};
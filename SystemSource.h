@@ -0,0 +1,153 @@
+#pragma once
+
+// SystemSource.h: the operating-system queries that SnapshotCollector makes, behind an interface so that collection
+// can run against the live system (LiveSystemSource), be recorded (RecordingSystemSource), or be replayed from a
+// recorded capture on any platform (ReplaySystemSource).
+// Portable C++ (no Windows dependencies); results are expressed with the snapshot data types.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "SystemSnapshot.h"
+#include "ProcessTable.h"
+
+// SIDs returned by a source carry their binary and string forms only; names are looked up separately
+// through SystemSource::LookupSidNames (or LookupSidName).
+
+/// <summary>
+/// An opened window station or desktop
+/// </summary>
+class SourceUserObject
+{
+public:
+	virtual ~SourceUserObject() = default;
+
+	/// <summary>
+	/// Object flags as display text
+	/// </summary>
+	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const = 0;
+
+	/// <summary>
+	/// The object's user SID. Returns true with an empty SidInfo_t if the object has no user.
+	/// </summary>
+	virtual bool User(SidInfo_t& user, std::wstring& sErrorInfo) const = 0;
+
+	/// <summary>
+	/// Self-relative security descriptor, with SACL if it can be retrieved
+	/// </summary>
+	/// <param name="sd">Output: the security descriptor</param>
+	/// <param name="securityInformation">Output: the SECURITY_INFORMATION flags it was retrieved with</param>
+	/// <param name="sErrorInfo">Output: error information on failure</param>
+	/// <returns>true if successful, false otherwise</returns>
+	virtual bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const = 0;
+
+protected:
+	SourceUserObject() = default;
+
+private:
+	// Not implemented
+	SourceUserObject(const SourceUserObject&) = delete;
+	SourceUserObject& operator = (const SourceUserObject&) = delete;
+};
+
+/// <summary>
+/// An opened desktop. Must not outlive the window station it was opened from.
+/// </summary>
+class SourceDesktop : public SourceUserObject
+{
+public:
+	virtual bool HeapSize(uint32_t& heapSizeKb, std::wstring& sErrorInfo) const = 0;
+	virtual bool IsReceivingInput(bool& bReceivingInput, std::wstring& sErrorInfo) const = 0;
+
+	/// <summary>
+	/// Top-level windows, sorted by HWND. Can succeed with a warning in sErrorInfo.
+	/// sProcessPath is left empty: callers join windows to processes by PID (see SystemSource::ProcessImagePath).
+	/// Not thread-safe: the live implementation switches the process' window station.
+	/// </summary>
+	virtual bool TopLevelWindows(WindowSnapshotList_t& windows, std::wstring& sErrorInfo) = 0;
+};
+
+/// <summary>
+/// An opened window station
+/// </summary>
+class SourceWindowStation : public SourceUserObject
+{
+public:
+	virtual bool DesktopNames(std::vector<std::wstring>& desktopNames, std::wstring& sErrorInfo) const = 0;
+
+	/// <summary>
+	/// Open a desktop in this window station; returns nullptr with error information on failure.
+	/// </summary>
+	virtual std::unique_ptr<SourceDesktop> OpenDesktop(const std::wstring& sDesktopName, std::wstring& sErrorInfo) const = 0;
+};
+
+/// <summary>
+/// Source of everything SnapshotCollector collects. The session and SID lookup functions must be safe to call
+/// concurrently; window station and desktop functions are called from one thread at a time.
+/// </summary>
+class SystemSource
+{
+public:
+	virtual ~SystemSource() = default;
+
+	/// <summary>
+	/// Information about the context this process is running in (SIDs without names)
+	/// </summary>
+	virtual void CurrentInfo(CurrentInfoSnapshot_t& currentInfo) = 0;
+
+	/// <summary>
+	/// Enumerate terminal sessions. Fills in only the ID, name, and state of each session.
+	/// </summary>
+	virtual bool EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// Query a session's detailed information: ID, name, state, session flags, user, and times.
+	/// Fails if the session no longer exists.
+	/// </summary>
+	virtual bool QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// Retrieve a session's user token(s). Fills in tokenStatus, sTokenError, token, bHasLinkedToken, and linkedToken.
+	/// </summary>
+	virtual void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) = 0;
+
+	/// <summary>
+	/// Enumerate the processes in all sessions with one system-wide query. User SIDs are without names.
+	/// </summary>
+	virtual bool EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// The full path of a process' executable image
+	/// </summary>
+	virtual bool ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// Look up DOMAIN\username for a SID; returns false if the name can't be resolved.
+	/// </summary>
+	virtual bool LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) = 0;
+
+	/// <summary>
+	/// Look up DOMAIN\username for many SIDs at once, with as few round trips as possible.
+	/// Sets each SID's name (SidInfo_t::SetName), leaving it empty if the name can't be resolved.
+	/// Returns false only if the batch request as a whole fails.
+	/// </summary>
+	virtual bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// Enumerate the window stations in the current session
+	/// </summary>
+	virtual bool WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo) = 0;
+
+	/// <summary>
+	/// Open a window station; returns nullptr with error information on failure.
+	/// </summary>
+	virtual std::unique_ptr<SourceWindowStation> OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo) = 0;
+
+protected:
+	SystemSource() = default;
+
+private:
+	// Not implemented
+	SystemSource(const SystemSource&) = delete;
+	SystemSource& operator = (const SystemSource&) = delete;
+};
@@ -6,22 +6,29 @@
 #include <io.h>
 #include <fcntl.h>
 #include <iostream>
-#include <algorithm>
-#include "TerminalSessions.h"
-#include "WinstaDesktop.h"
-#include "SecurityDescriptorUtils.h"
 #include "SecurityUtils.h"
-#include "WhoAmI.h"
-#include "SysErrorMessage.h"
-#include "HEX.h"
 #include "DbgOut.h"
-#include "Token.h"
 #include "StringUtils.h"
 #include "FileOutput.h"
-
-// Undefine macros from the SDK so that we can use the std algorithms.
-#undef max
-#undef min
+#include "SysErrorMessage.h"
+#include "SnapshotCollector.h"
+#include "TextRenderer.h"
+#include "QueryPlan.h"
+#include "Timings.h"
+#include "CSid.h"
+#include "SidNameCache.h"
+#include "SidCacheFile.h"
+#include "SecDescRenderCache.h"
+#include "SnapshotDiff.h"
+#include "DeltaRenderer.h"
+#include "SessionEvents.h"
+#include "SessionNotifications.h"
+#include "SnapshotUpdater.h"
+#include "SnapshotWriter.h"
+#include "SnapshotReader.h"
+#include "LiveSystemSource.h"
+#include "RecordingSystemSource.h"
+#include "ReplaySystemSource.h"
 
 //TODO: add ability to create window stations and desktops
 // https://learn.microsoft.com/en-us/windows/win32/api/winuser/nf-winuser-createwindowstationw
@@ -29,8 +36,6 @@
 
 //TODO: incorporate RunInSession0_Framework so it can run as System without needing PsExec.
 
-enum class SecDescOptions_t { None, SecDesc, SDDL };
-
 // ----------------------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------------------
 
@@ -55,15 +60,48 @@ static void Usage(const wchar_t* argv0, const wchar_t* szError = nullptr, const
         << std::endl
         << L"Usage:" << std::endl
         << std::endl
-        << L"  " << sExe << L" [-p] [-w|-wv] [-sd|-sddl] [-o outfile]" << std::endl
+        << L"  " << sExe << L" [-p] [--usage N] [--top N [--by m] [--top-interval S]] [-w|-wv] [-sd|-sddl] [-j N] [--sid-timeout ms] [--sid-cache file [--sid-cache-days N]] [--fields list] [selectors] [--watch N [--events]] [--save file] [--load file] [--record file|--replay file] [--timings] [--timings-json file] [--sd-cache-stats] [-o outfile]" << std::endl
+        << L"  " << sExe << L" [-wv] [-sd|-sddl] --diff before after [-o outfile]" << std::endl
         << std::endl
         << L"-p         : List the processes associated with each terminal session" << std::endl
+        << L"--usage N  : Summarize process resource usage (threads, handles, memory, CPU time) for all sessions, each session," << std::endl
+        << L"             and each user, listing the N heaviest processes in each." << std::endl
+        << L"--top N    : List the N heaviest processes host-wide and in each session." << std::endl
+        << L"--by m     : Rank processes for --top and --usage by cpu (CPU time, the default), ws (working set), or handles." << std::endl
+        << L"--top-interval S: With --top and CPU ranking, sample twice S seconds apart and rank by CPU time used in between." << std::endl
         << L"-w         : List the top-level windows associated with each desktop" << std::endl
         << L"-wv        : List the visible top-level windows associated with each desktop" << std::endl
         << L"-sd        : Show the detailed security descriptors of window stations and desktops" << std::endl
         << L"-sddl      : Show the security descriptos of window stations and desktops in Security Descriptor Definition Language" << std::endl
+        << L"-j N       : Collect per-session information on N worker threads (default 1). Output order is unchanged." << std::endl
+        << L"--sid-timeout ms: Wait at most ms milliseconds (default " << SidNameCache::DefaultTimeoutMilliseconds << L") for each SID (or batch of SIDs collected together) to resolve to a name, then show the SID." << std::endl
+        << L"             SIDs that fail to resolve aren't retried for the rest of the run. 0 waits without limit." << std::endl
+        << L"--sid-cache file: Reuse SID names resolved by earlier runs from this file, and add names resolved by this run to it at exit." << std::endl
+        << L"--sid-cache-days N: Names in the --sid-cache file older than N days (default " << SidCacheFile::DefaultMaxAgeDays << L") are looked up again." << std::endl
+        << L"--fields f : Report only these comma-separated fields (or \"all\"); queries needed only for other fields are skipped." << std::endl
+        << L"             Fields: " << FieldNames() << std::endl
+        << L"             processes, usage, top, windows, and sd are the same as -p, --usage 5, --top 5, -w, and -sddl (or -sd if also specified)." << std::endl
+        << L"--watch N  : Stay resident; every N seconds, re-sample and report only what was added, removed, or changed. Ctrl+C to stop." << std::endl
+        << L"--events   : With --watch, refresh individual sessions when they change (logon, logoff, connect, disconnect, lock, unlock)." << std::endl
+        << L"             N becomes the interval for a full re-sample, including window stations and desktops." << std::endl
+        << L"--save file: Also save what was collected to a binary snapshot file." << std::endl
+        << L"--load file: Report from a binary snapshot file instead of collecting from this system. Not compatible with --watch." << std::endl
+        << L"--record file: Also record every system query, its response, and its latency to a capture file." << std::endl
+        << L"--replay file: Collect from a capture file made with --record instead of from this system. Not compatible with --watch." << std::endl
+        << L"--diff before after: Report what was added, removed, or changed between two binary snapshot files." << std::endl
+        << L"--timings  : At the end, write wall time per collection phase, call counts and latency per Win32 API, and SID name cache hits, misses, and timeouts to stderr." << std::endl
+        << L"--timings-json file: Write the same timings, and SID name and security descriptor cache hits, misses, timeouts, and sizes, to a JSON file." << std::endl
+        << L"--sd-cache-stats: At the end, write security descriptor render cache hits (repeated descriptors output from the cache) and misses to stderr." << std::endl
         << L"-o outfile : output to a named UTF-8 file. If -o not used, outputs to stdout." << std::endl
         << std::endl
+        << L"Selectors limit what is collected; sessions, window stations, and desktops that aren't selected are skipped" << std::endl
+        << L"before they are queried. Each takes comma-separated glob patterns (* and ?, case-insensitive) and can be repeated." << std::endl
+        << L"--session s: Sessions whose ID or name matches (e.g., 1, Console, RDP-Tcp#*)" << std::endl
+        << L"--user s   : Sessions whose user (DOMAIN\\user or user) matches" << std::endl
+        << L"--state s  : Sessions whose state matches (e.g., Active, Disconnected)" << std::endl
+        << L"--winsta s : Window stations whose name matches" << std::endl
+        << L"--desktop s: Desktops whose name matches" << std::endl
+        << std::endl
         ;
 
     exit(-1);
@@ -71,13 +109,9 @@ static void Usage(const wchar_t* argv0, const wchar_t* szError = nullptr, const
 
 // ----------------------------------------------------------------------------------------------------
 // Forward declarations:
-static void OutputCurrentInfo(std::wostream& sOut);
-static void OutputCurrentUserInputDesktop(std::wostream& sOut);
-static void OutputActiveConsoleSessionId(std::wostream& sOut, DWORD dwSessionId);
-static void OutputTerminalSessions(std::wostream& sOut, bool bShowProcesses);
-static void OutputUserObjectPermissions(std::wostream& sOut, UserObject& obj, bool bWindowStation, SecDescOptions_t secDescOption, size_t indent);
-static void OutputDesktopWindows(std::wostream& sOut, Desktop& desktop, bool bVisibleOnly);
-static void OutputWinstaDesktopInfo(std::wostream& sOut, bool bShowWindows, bool bShowOnlyVisibleWindows, SecDescOptions_t secDescOption);
+static void Watch(std::wostream& sOut, const SnapshotCollector& collector, const TextRenderOptions_t& renderOptions, SystemSnapshot_t& snapshot, DWORD dwIntervalSeconds, bool bSessionEvents);
+static bool LoadSnapshotFile(const std::wstring& sFile, SystemSnapshot_t& snapshot, std::wstring& sErrorInfo);
+static bool DiffSnapshotFiles(std::wostream& sOut, const TextRenderOptions_t& renderOptions, const std::wstring& sBeforeFile, const std::wstring& sAfterFile);
 
 // ----------------------------------------------------------------------------------------------------
 
@@ -95,6 +129,29 @@ int wmain(int argc, wchar_t** argv)
     // ----------------------------------------------------------------------------------------------------
     // Options
     bool bShowProcesses = false;
+    bool bShowUsage = false;
+    size_t nUsageTop = 5;
+    bool bShowTop = false;
+    size_t nTop = 5;
+    UsageMetric_t usageMetric = UsageMetric_t::Cpu;
+    DWORD dwTopIntervalSeconds = 0;
+    size_t nThreads = 1;
+    uint32_t sidTimeoutMilliseconds = SidNameCache::DefaultTimeoutMilliseconds;
+    std::wstring sSidCacheFile;
+    DWORD dwSidCacheDays = SidCacheFile::DefaultMaxAgeDays;
+    DWORD dwWatchIntervalSeconds = 0;
+    bool bSessionEvents = false;
+    std::wstring sSaveFile, sLoadFile;
+    std::wstring sRecordFile, sReplayFile;
+    std::wstring sDiffBeforeFile, sDiffAfterFile;
+    bool bSecDescCacheStats = false;
+#ifndef TSSESSIONS_DISABLE_TIMINGS
+    bool bTimings = false;
+    std::wstring sTimingsJsonFile;
+#endif
+    SelectionOptions_t selection;
+    bool bFieldsSpecified = false;
+    FieldSet_t fields = Field_Default;
     bool bShowWindows = false, bShowOnlyVisibleWindows = false;
     SecDescOptions_t secDescOption = SecDescOptions_t::None;
     bool bOut_toFile = false;
@@ -110,6 +167,49 @@ int wmain(int argc, wchar_t** argv)
         {
             bShowProcesses = true;
         }
+        else if (0 == _wcsicmp(L"--usage", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --usage");
+            int nArg = _wtoi(argv[ixArg]);
+            if (nArg < 0)
+                Usage(argv[0], L"Invalid arg for --usage", argv[ixArg]);
+            bShowUsage = true;
+            nUsageTop = (size_t)nArg;
+        }
+        else if (0 == _wcsicmp(L"--top", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --top");
+            int nArg = _wtoi(argv[ixArg]);
+            if (nArg < 1)
+                Usage(argv[0], L"Invalid arg for --top", argv[ixArg]);
+            bShowTop = true;
+            nTop = (size_t)nArg;
+        }
+        else if (0 == _wcsicmp(L"--by", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --by");
+            if (0 == _wcsicmp(L"cpu", argv[ixArg]))
+                usageMetric = UsageMetric_t::Cpu;
+            else if (0 == _wcsicmp(L"ws", argv[ixArg]))
+                usageMetric = UsageMetric_t::WorkingSet;
+            else if (0 == _wcsicmp(L"handles", argv[ixArg]))
+                usageMetric = UsageMetric_t::Handles;
+            else
+                Usage(argv[0], L"Invalid arg for --by", argv[ixArg]);
+        }
+        else if (0 == _wcsicmp(L"--top-interval", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --top-interval");
+            int nArg = _wtoi(argv[ixArg]);
+            // Interval is converted to milliseconds for the wait; reject values that would overflow.
+            if (nArg < 1 || (DWORD)nArg >= INFINITE / 1000)
+                Usage(argv[0], L"Invalid arg for --top-interval", argv[ixArg]);
+            dwTopIntervalSeconds = (DWORD)nArg;
+        }
         else if (0 == _wcsicmp(L"-w", argv[ixArg]))
         {
             bShowWindows = true;
@@ -126,6 +226,136 @@ int wmain(int argc, wchar_t** argv)
         {
             secDescOption = SecDescOptions_t::SDDL;
         }
+        else if (0 == _wcsicmp(L"-j", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for -j");
+            int nArg = _wtoi(argv[ixArg]);
+            if (nArg < 1)
+                Usage(argv[0], L"Invalid arg for -j", argv[ixArg]);
+            nThreads = (size_t)nArg;
+        }
+        else if (0 == _wcsicmp(L"--sid-timeout", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --sid-timeout");
+            int nArg = _wtoi(argv[ixArg]);
+            if (nArg < 0 || (0 == nArg && L'0' != argv[ixArg][0]))
+                Usage(argv[0], L"Invalid arg for --sid-timeout", argv[ixArg]);
+            sidTimeoutMilliseconds = (uint32_t)nArg;
+        }
+        else if (0 == _wcsicmp(L"--sid-cache", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --sid-cache");
+            sSidCacheFile = argv[ixArg];
+        }
+        else if (0 == _wcsicmp(L"--sid-cache-days", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --sid-cache-days");
+            int nArg = _wtoi(argv[ixArg]);
+            if (nArg < 1)
+                Usage(argv[0], L"Invalid arg for --sid-cache-days", argv[ixArg]);
+            dwSidCacheDays = (DWORD)nArg;
+        }
+        else if (0 == _wcsicmp(L"--fields", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --fields");
+            FieldSet_t argFields = Field_None;
+            std::wstring sErrorInfo;
+            if (!ParseFieldList(argv[ixArg], argFields, sErrorInfo))
+                Usage(argv[0], L"Invalid field for --fields", sErrorInfo.c_str());
+            // Repeated --fields options accumulate.
+            fields = (bFieldsSpecified ? fields : Field_None) | argFields;
+            bFieldsSpecified = true;
+        }
+        else if (
+            0 == _wcsicmp(L"--session", argv[ixArg]) ||
+            0 == _wcsicmp(L"--user", argv[ixArg]) ||
+            0 == _wcsicmp(L"--state", argv[ixArg]) ||
+            0 == _wcsicmp(L"--winsta", argv[ixArg]) ||
+            0 == _wcsicmp(L"--desktop", argv[ixArg])
+            )
+        {
+            const wchar_t* szOption = argv[ixArg];
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for selector", szOption);
+            Selector* pSelector = &selection.desktops;
+            if (0 == _wcsicmp(L"--session", szOption))
+                pSelector = &selection.sessions;
+            else if (0 == _wcsicmp(L"--user", szOption))
+                pSelector = &selection.users;
+            else if (0 == _wcsicmp(L"--state", szOption))
+                pSelector = &selection.states;
+            else if (0 == _wcsicmp(L"--winsta", szOption))
+                pSelector = &selection.windowStations;
+            std::wstring sErrorInfo;
+            if (!pSelector->Add(argv[ixArg], sErrorInfo))
+                Usage(argv[0], L"Invalid arg for selector", szOption);
+        }
+        else if (0 == _wcsicmp(L"--watch", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --watch");
+            int nArg = _wtoi(argv[ixArg]);
+            // Interval is converted to milliseconds for the wait; reject values that would overflow.
+            if (nArg < 1 || (DWORD)nArg >= INFINITE / 1000)
+                Usage(argv[0], L"Invalid arg for --watch", argv[ixArg]);
+            dwWatchIntervalSeconds = (DWORD)nArg;
+        }
+        else if (0 == _wcsicmp(L"--events", argv[ixArg]))
+        {
+            bSessionEvents = true;
+        }
+        else if (0 == _wcsicmp(L"--save", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --save");
+            sSaveFile = argv[ixArg];
+        }
+        else if (0 == _wcsicmp(L"--load", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --load");
+            sLoadFile = argv[ixArg];
+        }
+        else if (0 == _wcsicmp(L"--record", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --record");
+            sRecordFile = argv[ixArg];
+        }
+        else if (0 == _wcsicmp(L"--replay", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --replay");
+            sReplayFile = argv[ixArg];
+        }
+        else if (0 == _wcsicmp(L"--diff", argv[ixArg]))
+        {
+            if (ixArg + 2 >= argc)
+                Usage(argv[0], L"Missing args for --diff");
+            sDiffBeforeFile = argv[++ixArg];
+            sDiffAfterFile = argv[++ixArg];
+        }
+        else if (0 == _wcsicmp(L"--sd-cache-stats", argv[ixArg]))
+        {
+            bSecDescCacheStats = true;
+        }
+#ifndef TSSESSIONS_DISABLE_TIMINGS
+        else if (0 == _wcsicmp(L"--timings", argv[ixArg]))
+        {
+            bTimings = true;
+        }
+        else if (0 == _wcsicmp(L"--timings-json", argv[ixArg]))
+        {
+            if (++ixArg >= argc)
+                Usage(argv[0], L"Missing arg for --timings-json");
+            sTimingsJsonFile = argv[ixArg];
+        }
+#endif
         else if (0 == _wcsicmp(L"-o", argv[ixArg]))
         {
             bOut_toFile = true;
@@ -149,6 +379,35 @@ int wmain(int argc, wchar_t** argv)
         ++ixArg;
     }
 
+    if (bSessionEvents && 0 == dwWatchIntervalSeconds)
+    {
+        Usage(argv[0], L"--events requires --watch");
+    }
+    if (dwTopIntervalSeconds > 0 && (!bShowTop || UsageMetric_t::Cpu != usageMetric))
+    {
+        Usage(argv[0], L"--top-interval requires --top, ranked by cpu");
+    }
+    if (dwTopIntervalSeconds > 0 && (sLoadFile.length() > 0 || sReplayFile.length() > 0))
+    {
+        Usage(argv[0], L"--top-interval cannot be combined with --load or --replay");
+    }
+    if (sLoadFile.length() > 0 && dwWatchIntervalSeconds > 0)
+    {
+        Usage(argv[0], L"--load cannot be combined with --watch");
+    }
+    if (sReplayFile.length() > 0 && (dwWatchIntervalSeconds > 0 || sLoadFile.length() > 0 || sRecordFile.length() > 0))
+    {
+        Usage(argv[0], L"--replay cannot be combined with --watch, --load, or --record");
+    }
+    if (sRecordFile.length() > 0 && sLoadFile.length() > 0)
+    {
+        Usage(argv[0], L"--record cannot be combined with --load");
+    }
+    if (sDiffBeforeFile.length() > 0 && (dwWatchIntervalSeconds > 0 || sLoadFile.length() > 0 || sSaveFile.length() > 0 || sRecordFile.length() > 0 || sReplayFile.length() > 0))
+    {
+        Usage(argv[0], L"--diff cannot be combined with --watch, --load, --save, --record, or --replay");
+    }
+
     // ----------------------------------------------------------------------------------------------------
     // Define a wostream output; create a UTF-8 wofstream if sOutFile defined; point it to *pStream otherwise.
     // pStream points to whatever ostream we're writing to.
@@ -168,6 +427,45 @@ int wmain(int argc, wchar_t** argv)
     }
     std::wostream& sOut = *pStream;
 
+    // -p, --usage, -w/-wv, and -sd/-sddl add their fields; sd in --fields without -sd/-sddl shows SDDL.
+    if (bShowProcesses)
+        fields |= Field_Processes;
+    if (bShowUsage)
+        fields |= Field_ProcessUsage;
+    if (bShowTop)
+        fields |= Field_TopProcesses;
+    if (bShowWindows)
+        fields |= Field_Windows;
+    if (SecDescOptions_t::None != secDescOption)
+        fields |= Field_SecurityDescriptor;
+    else if (0 != (fields & Field_SecurityDescriptor))
+        secDescOption = SecDescOptions_t::SDDL;
+    // Without --fields, saved snapshots are shown with whatever processes and windows they contain.
+    if (!bFieldsSpecified && (sLoadFile.length() > 0 || sDiffBeforeFile.length() > 0))
+        fields |= Field_Processes | Field_Windows;
+
+    TextRenderOptions_t renderOptions;
+    renderOptions.bVisibleWindowsOnly = bShowOnlyVisibleWindows;
+    renderOptions.secDescOption = secDescOption;
+    renderOptions.fields = fields;
+    renderOptions.nUsageTop = nUsageTop;
+    renderOptions.usageMetric = usageMetric;
+    renderOptions.nTop = nTop;
+    renderOptions.topMetric = usageMetric;
+    // Filled in by the first sample if --top-interval is used
+    SystemSnapshot_t topEarlierSample;
+    if (dwTopIntervalSeconds > 0)
+    {
+        renderOptions.pTopEarlierSample = &topEarlierSample.sessions;
+        renderOptions.topIntervalSeconds = dwTopIntervalSeconds;
+    }
+
+    // Comparing two saved snapshots doesn't look at this system at all.
+    if (sDiffBeforeFile.length() > 0)
+    {
+        return DiffSnapshotFiles(sOut, renderOptions, sDiffBeforeFile, sDiffAfterFile) ? 0 : -1;
+    }
+
     // ----------------------------------------------------------------------------------------------------
     // Enable Security privilege if possible; ignore if it can't be enabled.
     if (ImpersonateSelf(SecurityImpersonation))
@@ -179,519 +477,329 @@ int wmain(int argc, wchar_t** argv)
     // ----------------------------------------------------------------------------------------------------
     // Do the work
 
-    OutputCurrentInfo(sOut);
-
-    OutputCurrentUserInputDesktop(sOut);
-
-    OutputActiveConsoleSessionId(sOut, TerminalSession::ActiveConsoleSessionId());
-
-    sOut << L"Are child sessions enabled? " << (TerminalSession::AreChildSessionsEnabled() ? L"Yes" : L"No")
-        << std::endl
-        << std::endl;
-
-    OutputTerminalSessions(sOut, bShowProcesses);
-
-    OutputWinstaDesktopInfo(sOut, bShowWindows, bShowOnlyVisibleWindows, secDescOption);
-
-    RevertToSelf();
-
-    // ------------------------------------------------------------------------------------------
-    // If output to a file, close the file.
-    if (bOut_toFile)
+    // Collect only what the renderer outputs.
+    TextRenderer renderer(renderOptions);
+    CollectionOptions_t collectionOptions;
+    collectionOptions.fields = renderer.RequiredFields();
+    collectionOptions.nThreads = nThreads;
+    collectionOptions.selection = selection;
+    CSid::NameCache().SetTimeout(sidTimeoutMilliseconds);
+
+    // Names resolved by earlier runs; a missing file is created at exit.
+    SidCacheFile sidCacheFile;
+    const int64_t sidCacheMaxAgeSeconds = (int64_t)dwSidCacheDays * 24 * 60 * 60;
+    if (sSidCacheFile.length() > 0 && INVALID_FILE_ATTRIBUTES != GetFileAttributesW(sSidCacheFile.c_str()))
     {
-        fs.close();
+        std::wstring sErrorInfo;
+        if (sidCacheFile.Open(sSidCacheFile, sErrorInfo))
+            CSid::NameCache().SetStore(&sidCacheFile, sidCacheMaxAgeSeconds);
+        else
+            std::wcerr << L"Cannot load SID cache file: " << sErrorInfo << std::endl;
     }
 
-    return 0;
-}
-
-// ----------------------------------------------------------------------------------------------------
-
-static void OutputCurrentInfo(std::wostream& sOut)
-{
-    std::wstring sErrorInfo;
-
-    CSid sid;
-    DWORD dwSessionId;
-    std::wstring sTextData;
-    ULONG heapSize = 0;
+    // Collect from this system unless replaying a capture; --record wraps whichever source is used.
+    LiveSystemSource liveSource;
+    ReplaySystemSource replaySource;
+    SystemSource* pSource = &liveSource;
+    if (sReplayFile.length() > 0)
+    {
+        std::wstring sErrorInfo;
+        if (!replaySource.Load(sReplayFile, sErrorInfo))
+        {
+            std::wcerr << L"Cannot load capture file: " << sErrorInfo << std::endl;
+            RevertToSelf();
+            return -1;
+        }
+        pSource = &replaySource;
+    }
+    RecordingSystemSource recordingSource(*pSource);
+    if (sRecordFile.length() > 0)
+    {
+        pSource = &recordingSource;
+    }
 
-    sOut << L"This process/thread running in:" << std::endl << std::endl;
-    sOut 
-        << L"    TS Session:  ";
-    if (TerminalSession::CurrentProcessSessionId(dwSessionId, sErrorInfo))
+    SystemSnapshot_t snapshot;
+    SnapshotCollector collector(*pSource, collectionOptions);
+    if (sLoadFile.length() > 0)
     {
-        sOut << dwSessionId << std::endl;
+        std::wstring sErrorInfo;
+        if (!LoadSnapshotFile(sLoadFile, snapshot, sErrorInfo))
+        {
+            std::wcerr << L"Cannot load snapshot file: " << sErrorInfo << std::endl;
+            RevertToSelf();
+            return -1;
+        }
     }
     else
     {
-        sOut << sErrorInfo << std::endl;
+        if (dwTopIntervalSeconds > 0)
+        {
+            // First sample: only the sessions' processes
+            CollectionOptions_t sampleOptions = collectionOptions;
+            sampleOptions.fields = Field_TopProcesses;
+            SnapshotCollector(*pSource, sampleOptions).Collect(topEarlierSample);
+            Sleep(dwTopIntervalSeconds * 1000);
+        }
+        collector.Collect(snapshot);
     }
-    sOut << std::endl;
-
-    const Desktop& desktop = Desktop::Original();
-    const WindowStation& winsta = desktop.WinSta();
-
-    sOut
-        << L"    WinSta:      "
-        << (winsta.Name(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
-
-    sOut
-        << L"    User:        "
-        << (winsta.UserNameAndSid(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
-
-    //sOut
-    //    << L"    Type:        "
-    //    << (winsta.Type(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-    //    << std::endl;
 
-    sOut
-        << L"    Flags:       "
-        << (winsta.Flags(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
-
-    sOut << std::endl;
+    if (sSaveFile.length() > 0)
+    {
+        std::wstring sErrorInfo;
+        if (!WriteSnapshotFile(snapshot, sSaveFile, sErrorInfo))
+        {
+            std::wcerr << L"Cannot save snapshot file: " << sErrorInfo << std::endl;
+        }
+    }
 
-    sOut
-        << L"    Desktop:     "
-        << (desktop.Name(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
+    renderer.Render(sOut, snapshot);
 
-    sOut
-        << L"    User:        "
-        << (desktop.UserNameAndSid(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
+    if (dwWatchIntervalSeconds > 0)
+    {
+        Watch(sOut, collector, renderOptions, snapshot, dwWatchIntervalSeconds, bSessionEvents);
+    }
 
-    //sOut
-    //    << L"    Type:        "
-    //    << (desktop.Type(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-    //    << std::endl;
+    if (sRecordFile.length() > 0)
+    {
+        std::wstring sErrorInfo;
+        if (!recordingSource.Save(sRecordFile, sErrorInfo))
+        {
+            std::wcerr << L"Cannot save capture file: " << sErrorInfo << std::endl;
+        }
+    }
 
-    sOut
-        << L"    Flags:       "
-        << (desktop.Flags(sTextData, sErrorInfo) ? sTextData : sErrorInfo)
-        << std::endl;
+    if (sSidCacheFile.length() > 0)
+    {
+        SidCacheEntryList_t newEntries;
+        CSid::NameCache().SetStore(nullptr, 0);
+        CSid::NameCache().Entries(newEntries);
+        std::wstring sErrorInfo;
+        if (!SidCacheFile::Update(sSidCacheFile, sidCacheFile, newEntries, sidCacheMaxAgeSeconds, sErrorInfo))
+        {
+            std::wcerr << L"Cannot save SID cache file: " << sErrorInfo << std::endl;
+        }
+    }
 
-    sOut
-        << L"    Heap size:   ";
-    if (desktop.HeapSize(heapSize, sErrorInfo))
+#ifndef TSSESSIONS_DISABLE_TIMINGS
+    // Timings go to stderr so that the report itself is unchanged.
+    if (bTimings)
     {
-        sOut << heapSize << L" KB" << std::endl;
+        Timings::WriteText(std::wcerr);
+        const SidNameCache& nameCache = CSid::NameCache();
+        std::wcerr
+            << L"SID name cache: " << nameCache.Hits() << L" hits, " << nameCache.Misses() << L" misses, "
+            << nameCache.Timeouts() << L" timeouts, " << nameCache.Size() << L" SIDs" << std::endl << std::endl;
     }
-    else
+    if (sTimingsJsonFile.length() > 0)
     {
-        sOut << sErrorInfo << std::endl;
+        // JSON is UTF-8 without a BOM.
+        std::wofstream jsonFs;
+        ImbueStreamUtf8(jsonFs, false);
+        jsonFs.open(sTimingsJsonFile.c_str());
+        if (jsonFs.fail())
+            std::wcerr << L"Cannot open timings file " << sTimingsJsonFile << std::endl;
+        else
+        {
+            const SidNameCache& nameCache = CSid::NameCache();
+            const SecDescRenderCache& secDescCache = TextRenderer::SecDescCache();
+            Timings::CacheCountersList_t caches;
+            Timings::CacheCounters_t sidNames = { L"sidNames", nameCache.Hits(), nameCache.Misses(), nameCache.Timeouts(), nameCache.Size() };
+            Timings::CacheCounters_t securityDescriptors = { L"securityDescriptors", secDescCache.Hits(), secDescCache.Misses(), 0, secDescCache.Size() };
+            caches.push_back(sidNames);
+            caches.push_back(securityDescriptors);
+            Timings::WriteJson(jsonFs, caches);
+        }
     }
+#endif
 
-    sOut << std::endl;
+    // Security descriptor cache counts also go to stderr.
+    if (bSecDescCacheStats)
+    {
+        const SecDescRenderCache& secDescCache = TextRenderer::SecDescCache();
+        std::wcerr
+            << L"Security descriptor cache: " << secDescCache.Hits() << L" hits, " << secDescCache.Misses() << L" misses, "
+            << secDescCache.Size() << L" descriptors" << std::endl << std::endl;
+    }
 
-    WhoAmI whoAmI;
-    sOut
-        << L"    Running as:  "
-        << whoAmI.GetUserCSid().toSidString()
-        << L" - "
-        << whoAmI.GetUserCSid().toDomainAndUsername()
-        << std::endl;
+    RevertToSelf();
 
-    sOut << std::endl;
+    // ------------------------------------------------------------------------------------------
+    // If output to a file, close the file.
+    if (bOut_toFile)
+    {
+        fs.close();
+    }
+
+    return 0;
 }
 
-static void OutputCurrentUserInputDesktop(std::wostream& sOut)
+// ----------------------------------------------------------------------------------------------------
+
+// Signaled when the user presses Ctrl+C (or Ctrl+Break, or closes the console) to end watch mode.
+static HANDLE st_hStopWatchEvent = NULL;
+// Session event queue for watch mode with --events; also stopped by Ctrl+C. Static so that it outlives the handler.
+static SessionEventQueue st_watchEventQueue;
+
+static BOOL WINAPI WatchCtrlHandler(DWORD dwCtrlType)
 {
-    std::wstring sErrorInfo, sName;
-    Desktop desktop(WindowStation::Original());
-    sOut
-        << L"Current user input Desktop: ";
-    if (desktop.InitFromInputDesktop(MAXIMUM_ALLOWED, sErrorInfo) && desktop.Name(sName, sErrorInfo))
+    switch (dwCtrlType)
     {
-        sOut << sName << std::endl;
+    case CTRL_C_EVENT:
+    case CTRL_BREAK_EVENT:
+    case CTRL_CLOSE_EVENT:
+        SetEvent(st_hStopWatchEvent);
+        st_watchEventQueue.Stop();
+        return TRUE;
+    default:
+        return FALSE;
     }
-    else
-    {
-        sOut << sErrorInfo << std::endl;
-    }
-    sOut << std::endl;
 }
 
-static void OutputActiveConsoleSessionId(std::wostream& sOut, DWORD dwSessionId)
+/// <summary>
+/// Before each full sample in watch mode: pick up accounts renamed or deleted since the last sample. Rendered
+/// security descriptors hold the names resolved when they were rendered, so they're discarded with the names.
+/// </summary>
+static void FlushSampleCaches()
 {
-    sOut
-        << L"Console Session = ";
-    if (0xFFFFFFFF == dwSessionId)
-        sOut << L"(transition)" << std::endl << std::endl;
-    else
-        sOut << dwSessionId << std::endl << std::endl;
+    CSid::NameCache().Flush();
+    TextRenderer::SecDescCache().Flush();
 }
 
-static void OutputTerminalSessions(std::wostream& sOut, bool bShowProcesses)
+/// <summary>
+/// Renders the differences each session event update makes
+/// </summary>
+class WatchDeltaOutput : public ISnapshotDeltaTarget
 {
-    TerminalSessionList_t tsList;
-    std::wstring sErrorInfo;
-    if (!TerminalSession::GetTerminalSessions(tsList, sErrorInfo))
+public:
+    WatchDeltaOutput(const DeltaRenderer& deltaRenderer, std::wostream& sOut)
+        : m_deltaRenderer(deltaRenderer), m_sOut(sOut)
     {
-        sOut << L"Unable to enumerate terminal sessions: " << sErrorInfo << std::endl;
-        return;
     }
 
-    sOut << L"Terminal sessions: " << tsList.size() << std::endl << std::endl;
-
-    TerminalSessionList_t::const_iterator sessionIter;
-    for (sessionIter = tsList.begin(); sessionIter != tsList.end(); sessionIter++)
-    {
-        sOut
-            << L"    Session ID           : " << sessionIter->ID() << std::endl
-            << L"    Session Name         : " << sessionIter->Name() << std::endl
-            << L"    State                : " << sessionIter->State() << std::endl
-            << L"    SessionFlags         : " << sessionIter->SessionFlags() << std::endl
-            << L"    DomainName           : " << sessionIter->DomainName() << std::endl
-            << L"    UserName             : " << sessionIter->UserName() << std::endl
-            << L"    LogonTime            : " << sessionIter->LogonTime() << std::endl
-            << L"    ConnectTime          : " << sessionIter->ConnectTime() << std::endl
-            << L"    DisconnectTime       : " << sessionIter->DisconnectTime() << std::endl
-            << L"    LastInputTime        : " << sessionIter->LastInputTime() << std::endl
-            << L"    CurrentTime          : " << sessionIter->CurrentTime() << std::endl
-            ;
-
-        HANDLE hToken = NULL, hLinkedToken = NULL;
-        DWORD dwLastErr;
-        if (sessionIter->GetUserToken(hToken, dwLastErr))
-        {
-            TokenInfo_t tokenInfo, linkedTokenInfo;
-            Token::GetTokenInfo(hToken, tokenInfo, sErrorInfo);
-            sOut
-                << L"    * User token:" << std::endl
-                << L"    Token user SID       : " << tokenInfo.sid.toSidString() << std::endl
-                << L"    Token logon session  : " << HEX(tokenInfo.logonSession.HighPart) << L":" << HEX(tokenInfo.logonSession.LowPart) << std::endl
-                << L"    Token integrity level: " << tokenInfo.IntegrityLevelName() << std::endl
-                ;
-            if (Token::GetLinkedToken(hToken, hLinkedToken))
-            {
-                Token::GetTokenInfo(hLinkedToken, linkedTokenInfo, sErrorInfo);
-                sOut
-                    << L"    * Linked token:" << std::endl
-                    << L"    Token user SID       : " << linkedTokenInfo.sid.toSidString() << std::endl
-                    << L"    Token logon session  : " << HEX(linkedTokenInfo.logonSession.HighPart) << L":" << HEX(linkedTokenInfo.logonSession.LowPart) << std::endl
-                    << L"    Token integrity level: " << linkedTokenInfo.IntegrityLevelName() << std::endl
-                    ;
-                CloseHandle(hLinkedToken);
-            }
-            CloseHandle(hToken);
-        }
-        else
-        {
-            switch (dwLastErr)
-            {
-            case ERROR_PRIVILEGE_NOT_HELD:
-                sOut << L"    [Insufficient privilege to retrieve token]" << std::endl;
-                break;
-            case ERROR_NO_TOKEN:
-            case ERROR_FILE_NOT_FOUND: // seeing sessions in Listen state returning ERROR_FILE_NOT_FOUND for some reason
-                sOut << L"    No Token" << std::endl;
-                break;
-            default:
-                sOut << L"    Error retrieving token: " << SysErrorMessageWithCode(dwLastErr) << std::endl;
-                break;
-            }
-        }
-
-        if (bShowProcesses)
-        {
-            TSProcessInfoList_t procList;
-            if (sessionIter->GetProcesses(procList, sErrorInfo))
-            {
-                if (procList.size() > 0)
-                {
-                    sOut << L"    Processes:" << std::endl;
-
-                    TSProcessInfoList_t::const_iterator procIter;
-                    size_t nMaxProcNameLength = 0;
-                    for (procIter = procList.begin(); procIter != procList.end(); procIter++)
-                    {
-                        size_t nProcNameLength = procIter->sProcessName.length();
-                        if (nProcNameLength > nMaxProcNameLength)
-                            nMaxProcNameLength = nProcNameLength;
-                    }
-                    for (procIter = procList.begin(); procIter != procList.end(); procIter++)
-                    {
-                        sOut
-                            << L"        "
-                            << std::left << std::setw(7) << procIter->dwPID
-                            << std::left << std::setw(nMaxProcNameLength + 2) << procIter->sProcessName
-                            << procIter->userSid.toDomainAndUsername(true)
-                            << std::endl;
-                    }
-                }
-                else
-                {
-                    sOut << L"    No processes" << std::endl;
-                }
-            }
-            else
-            {
-                sOut << L"    Error enumerating processes: " << sErrorInfo << std::endl;
-            }
-        }
-
-        sOut << std::endl;
+    virtual void ReportDelta(const SnapshotDiff_t& diff, const SystemSnapshot_t& after) override
+    {
+        m_deltaRenderer.Render(m_sOut, diff, after);
     }
-}
 
-static void OutputUserObjectPermissions(std::wostream& sOut, UserObject& obj, bool bWindowStation, SecDescOptions_t secDescOption, size_t indent)
-{
-    if (SecDescOptions_t::None != secDescOption)
+    virtual void BeginFullResync() override
     {
-        std::wstring sErrorInfo, sSDDL;
-        bool bWithSacl = false;
-        SecurityDescriptor objSD;
-        SECURITY_INFORMATION siWithSacl =
-            OWNER_SECURITY_INFORMATION |
-            GROUP_SECURITY_INFORMATION |
-            DACL_SECURITY_INFORMATION |
-            LABEL_SECURITY_INFORMATION |
-            SACL_SECURITY_INFORMATION;
-        SECURITY_INFORMATION siNoSacl =
-            OWNER_SECURITY_INFORMATION |
-            GROUP_SECURITY_INFORMATION |
-            DACL_SECURITY_INFORMATION |
-            LABEL_SECURITY_INFORMATION;
-        // Try to get SD with SACL; if that fails, try without.
-        if (!(bWithSacl = obj.GetSecurity(objSD, siWithSacl, sErrorInfo)) && !obj.GetSecurity(objSD, siNoSacl, sErrorInfo))
-        {
-            sOut << std::setw(indent) << L"" << L"Sec desc : " << sErrorInfo << std::endl;
-        }
-        else
-        {
-            switch (secDescOption)
-            {
-            case SecDescOptions_t::SDDL:
-                sOut << std::setw(indent) << L"" << L"SDDL     : ";
-                if (SecDescriptorToSDDL(objSD.GetSD(), (bWithSacl ? siWithSacl : siNoSacl), sSDDL, sErrorInfo))
-                {
-                    sOut << sSDDL << std::endl;
-                }
-                else
-                {
-                    sOut << sErrorInfo << std::endl;
-                }
-                break;
-            case SecDescOptions_t::SecDesc:
-                sOut << std::setw(indent) << L"" << L"Security descriptor:" << std::endl;
-                OutputSecurityDescriptor(sOut, objSD.GetSD(), bWindowStation ? L"winsta" : L"desktop", true, indent + 2);
-                sOut << std::endl;
-                break;
-            }
-        }
+        FlushSampleCaches();
     }
-}
 
-static void OutputDesktopWindows(std::wostream& sOut, Desktop& desktop, bool bVisibleOnly)
-{
-    //const wchar_t* const szTab = L"\t";
-    const wchar_t* const szIndent = L"          ";
+private:
+    const DeltaRenderer& m_deltaRenderer;
+    std::wostream& m_sOut;
 
-    WindowInfoCollection_t windowInfoCollection;
-    std::wstring sErrorInfo;
-    if (desktop.GetTopLevelWindows(windowInfoCollection, sErrorInfo))
+private:
+    // Not implemented
+    WatchDeltaOutput(const WatchDeltaOutput&) = delete;
+    WatchDeltaOutput& operator = (const WatchDeltaOutput&) = delete;
+};
+
+/// <summary>
+/// Watch mode: re-sample at the specified interval and output only the differences from the previous sample,
+/// until the user presses Ctrl+C.
+/// </summary>
+/// <param name="sOut">Output stream</param>
+/// <param name="collector">Collector configured from the command-line options</param>
+/// <param name="renderOptions">Rendering options from the command line</param>
+/// <param name="snapshot">Input: the sample already reported in full; updated with each new sample</param>
+/// <param name="dwIntervalSeconds">Seconds between samples (between full re-samples if bSessionEvents)</param>
+/// <param name="bSessionEvents">true to refresh individual sessions on session-change notifications</param>
+static void Watch(std::wostream& sOut, const SnapshotCollector& collector, const TextRenderOptions_t& renderOptions, SystemSnapshot_t& snapshot, DWORD dwIntervalSeconds, bool bSessionEvents)
+{
+    st_hStopWatchEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (NULL == st_hStopWatchEvent)
     {
-        if (!sErrorInfo.empty())
-        {
-            sOut << L"!!! " << sErrorInfo << std::endl;
-        }
+        std::wcerr << L"Unable to start watch mode: " << SysErrorMessageWithCode() << std::endl;
+        return;
+    }
+    SetConsoleCtrlHandler(WatchCtrlHandler, TRUE);
+    sOut.flush();
 
-        size_t numWindows = windowInfoCollection.size();
+    DeltaRenderer deltaRenderer(renderOptions);
 
-        if (numWindows == 0)
+    if (bSessionEvents)
+    {
+        // Session notifications arrive on a separate thread and are queued; the dispatcher runs here,
+        // refreshing only the affected sessions, with a full re-sample at each interval as a safety net.
+        WtsSessionEventSource eventSource;
+        std::wstring sErrorInfo;
+        if (eventSource.Start(st_watchEventQueue, sErrorInfo))
         {
-            sOut << szIndent << L"No top-level windows." << std::endl;
+            WatchDeltaOutput deltaOutput(deltaRenderer, sOut);
+            SnapshotUpdater updater(collector, deltaOutput, snapshot);
+            SessionEventDispatcher dispatcher(updater);
+            dispatcher.Run(st_watchEventQueue, dwIntervalSeconds * 1000);
+            eventSource.Stop();
         }
         else
         {
-            bool bListingAny = false;
-            // iterate through and get the sizes from the data
-            size_t lenClassName = 12, lenWindowText = 11, lenPID = 4; // , lenProcessPath = 0;
-            WindowInfoCollection_t::const_iterator infoCollIter;
-            for (infoCollIter = windowInfoCollection.begin(); infoCollIter != windowInfoCollection.end(); infoCollIter++)
-            {
-                const WindowInfo_t& windowInfo = infoCollIter->second;
-                if (windowInfo.bIsValid && (windowInfo.bIsVisible || !bVisibleOnly))
-                {
-                    bListingAny = true;
-                    lenClassName = std::max(escapeCrLfTabNul(windowInfo.sClassName).size(), lenClassName);
-                    lenWindowText = std::max(escapeCrLfTabNul(windowInfo.sWindowText).size(), lenWindowText);
-                    //lenProcessPath = std::max(windowInfo.sProcessPath.size(), lenProcessPath);
-                    if (windowInfo.PID >= 1000000)
-                        lenPID = std::max((size_t)7, lenPID);
-                    else if (windowInfo.PID >= 100000)
-                        lenPID = std::max((size_t)6, lenPID);
-                    else if (windowInfo.PID >= 10000)
-                        lenPID = std::max((size_t)5, lenPID);
-                }
-            }
-
-            // Set some limits
-            lenClassName = std::min((size_t)35, lenClassName);
-            lenWindowText = std::min((size_t)55, lenWindowText);
-
-            if (!bListingAny)
-            {
-                sOut << szIndent << L"Top-level windows: " << numWindows << L". None are visible." << std::endl;
-            }
-            else
-            {
-                sOut << szIndent << L"Top-level windows: " << numWindows << (bVisibleOnly ? L". Showing visible windows only." : L"") << std::endl;
-                // Output headers
-                sOut
-                    << szIndent << L"  "
-                    << std::left << std::setw(9) << L"HWND"
-                    << std::left << std::setw(8) << L"IsVis?"
-                    << std::left << std::setw(lenClassName + 1) << L"Window class"
-                    << std::left << std::setw(lenWindowText + 1) << L"Window text"
-                    << std::left << std::setw(lenPID + 1) << L"PID"
-                    << L"Process name" << std::endl;
-
-                for (infoCollIter = windowInfoCollection.begin(); infoCollIter != windowInfoCollection.end(); infoCollIter++)
-                {
-                    const WindowInfo_t& windowInfo = infoCollIter->second;
-                    if (windowInfo.bIsValid)
-                    {
-                        if (windowInfo.bIsVisible || !bVisibleOnly)
-                        {
-                            // Trim them if necessary
-                            std::wstring sClassName = escapeCrLfTabNul(windowInfo.sClassName);
-                            std::wstring sWindowText = escapeCrLfTabNul(windowInfo.sWindowText);
-                            if (sClassName.length() > lenClassName)
-                                sClassName = sClassName.substr(0, lenClassName - 3) + L"...";
-                            if (sWindowText.length() > lenWindowText)
-                                sWindowText = sWindowText.substr(0, lenWindowText - 3) + L"...";
-                            sOut
-                                << szIndent << L"  "
-                                << std::left << std::setw(9) << HEX((unsigned long long)windowInfo.hwnd, 8, true, false)
-                                << std::left << std::setw(8) << (windowInfo.bIsVisible ? L"Visible" : L"Hidden")
-                                << std::left << std::setw(lenClassName + 1) << sClassName
-                                << std::left << std::setw(lenWindowText + 1) << sWindowText
-                                << std::left << std::setw(lenPID + 1) << windowInfo.PID
-                                << GetFileNameFromFilePath(windowInfo.sProcessPath) << std::endl;
-                        }
-                    }
-                    else
-                    {
-                        sOut
-                            << szIndent
-                            << windowInfo.hwnd
-                            << L"(INVALID)"
-
-
-
-                            << std::endl;
-                    }
-                }
-            }
+            std::wcerr << L"Unable to subscribe to session notifications (" << sErrorInfo << L"); polling instead." << std::endl;
+            bSessionEvents = false;
         }
     }
-    else
+
+    if (!bSessionEvents)
     {
-        sOut << L"            Unable to enumerate windows: " << sErrorInfo << std::endl;
+        while (WAIT_TIMEOUT == WaitForSingleObject(st_hStopWatchEvent, dwIntervalSeconds * 1000))
+        {
+            FlushSampleCaches();
+            SystemSnapshot_t nextSnapshot;
+            collector.Collect(nextSnapshot);
+            SnapshotDiff_t diff;
+            DiffSnapshots(snapshot, nextSnapshot, diff);
+            deltaRenderer.Render(sOut, diff, nextSnapshot);
+            std::swap(snapshot, nextSnapshot);
+        }
     }
+
+    SetConsoleCtrlHandler(WatchCtrlHandler, FALSE);
+    CloseHandle(st_hStopWatchEvent);
+    st_hStopWatchEvent = NULL;
 }
 
-static void OutputWinstaDesktopInfo(std::wostream& sOut, bool bShowWindows, bool bShowOnlyVisibleWindows, SecDescOptions_t secDescOption)
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Read a binary snapshot file into memory.
+/// </summary>
+/// <param name="sFile">Input: snapshot file written with --save</param>
+/// <param name="snapshot">Output: the snapshot</param>
+/// <param name="sErrorInfo">Output: error information on failure</param>
+/// <returns>true on success, false otherwise</returns>
+static bool LoadSnapshotFile(const std::wstring& sFile, SystemSnapshot_t& snapshot, std::wstring& sErrorInfo)
 {
-    WindowStationNameList_t wsNameList;
-    std::wstring sErrorInfo;
+    SnapshotFile snapshotFile;
+    return snapshotFile.Open(sFile, sErrorInfo) && snapshotFile.ToSnapshot(snapshot, sErrorInfo);
+}
 
-    if (WindowStation::GetWindowStationNames(wsNameList, sErrorInfo))
-    {
-        sOut << L"Window stations in the current session: " << wsNameList.size() << std::endl << std::endl;
-
-        WindowStationNameList_t::iterator wsNameIter;
-        for (wsNameIter = wsNameList.begin(); wsNameIter != wsNameList.end(); wsNameIter++)
-        {
-            sOut << L"    WS name    : " << *wsNameIter << std::endl;
-            WindowStation ws;
-            if (ws.Open(wsNameIter->c_str(), MAXIMUM_ALLOWED, sErrorInfo))
-            {
-                std::wstring sName, sFlags, sUserNameAndSid, sSDDL;
-                //std::wstring sType;
-                sOut
-                    //<< L"      Type     : " << (ws.Type(sType, sErrorInfo) ? sType : sErrorInfo) << std::endl
-                    << L"      Flags    : " << (ws.Flags(sFlags, sErrorInfo) ? sFlags : sErrorInfo) << std::endl
-                    << L"      User     : " << (ws.UserNameAndSid(sUserNameAndSid, sErrorInfo) ? sUserNameAndSid : sErrorInfo) << std::endl
-                    ;
-
-                OutputUserObjectPermissions(sOut, ws, true, secDescOption, 6);
-
-                DesktopNameList_t desktopNameList;
-                if (ws.GetDesktopNames(desktopNameList, sErrorInfo))
-                {
-                    sOut << L"      Desktops in WS " << *wsNameIter << L": " << desktopNameList.size() << std::endl << std::endl;
-                    DesktopNameList_t::const_iterator desktopNameIter;
-                    for (desktopNameIter = desktopNameList.begin(); desktopNameIter != desktopNameList.end(); desktopNameIter++)
-                    {
-                        sOut << L"        Name : " << *desktopNameIter << std::endl;
-                        Desktop desk(ws);
-
-                        if (desk.Open(desktopNameIter->c_str(), MAXIMUM_ALLOWED, sErrorInfo))
-                        {
-                            ULONG heapSizeKb = 0;
-                            BOOL bIsReceivingInput = FALSE;
-                            sOut
-                                //<< L"          Type     : " << (desk.Type(sType, sErrorInfo) ? sType : sErrorInfo) << std::endl
-                                << L"          Flags    : " << (desk.Flags(sFlags, sErrorInfo) ? sFlags : sErrorInfo) << std::endl
-                                << L"          User     : " << (desk.UserNameAndSid(sUserNameAndSid, sErrorInfo) ? sUserNameAndSid : sErrorInfo) << std::endl
-                                << L"          Heap size: "
-                                ;
-                            if (desk.HeapSize(heapSizeKb, sErrorInfo))
-                            {
-                                sOut << heapSizeKb << L" KB" << std::endl;
-                            }
-                            else
-                            {
-                                sOut << sErrorInfo << std::endl;
-                            }
-                            sOut
-                                << L"          UserInput: ";
-                            if (desk.IsReceivingInput(bIsReceivingInput, sErrorInfo))
-                            {
-                                sOut << (bIsReceivingInput ? L"Yes" : L"No") << std::endl;
-                            }
-                            else
-                            {
-                                sOut << sErrorInfo << std::endl;
-                            }
-
-                            OutputUserObjectPermissions(sOut, desk, false, secDescOption, 10);
-
-                            if (bShowWindows)
-                            {
-                                OutputDesktopWindows(sOut, desk, bShowOnlyVisibleWindows);
-                            }
-                        }
-                        else
-                        {
-                            sOut << L"          Error: " << sErrorInfo << std::endl;
-                        }
-                        sOut << std::endl;
-                    }
-                }
-                else
-                {
-                    sOut << L"      Unable to enumerate desktops: " << sErrorInfo << std::endl;
-                }
-            }
-            else
-            {
-                sOut << L"    Error: " << sErrorInfo << std::endl;
-            }
-            sOut << std::endl;
-        }
-    }
-    else
+/// <summary>
+/// Report the differences between two binary snapshot files.
+/// </summary>
+/// <param name="sOut">Output stream</param>
+/// <param name="renderOptions">Rendering options from the command line</param>
+/// <param name="sBeforeFile">Input: the earlier snapshot file</param>
+/// <param name="sAfterFile">Input: the later snapshot file</param>
+/// <returns>true if both files could be loaded, false otherwise</returns>
+static bool DiffSnapshotFiles(std::wostream& sOut, const TextRenderOptions_t& renderOptions, const std::wstring& sBeforeFile, const std::wstring& sAfterFile)
+{
+    SystemSnapshot_t before, after;
+    std::wstring sErrorInfo;
+    if (!LoadSnapshotFile(sBeforeFile, before, sErrorInfo) || !LoadSnapshotFile(sAfterFile, after, sErrorInfo))
     {
-        sOut << L"Unable to enumerate window stations: " << sErrorInfo << std::endl;
+        std::wcerr << L"Cannot load snapshot file: " << sErrorInfo << std::endl;
+        return false;
     }
 
+    SnapshotDiff_t diff;
+    DiffSnapshots(before, after, diff);
+    if (diff.IsEmpty())
+    {
+        sOut << L"No differences." << std::endl;
+        return true;
+    }
+    DeltaRenderer deltaRenderer(renderOptions);
+    deltaRenderer.Render(sOut, diff, after);
+    return true;
 }
-
-
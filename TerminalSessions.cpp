@@ -1,7 +1,14 @@
 #include "TerminalSessions.h"
 #pragma comment(lib, "Wtsapi32.lib")
+#pragma comment(lib, "ntdll.lib")
+#include <Psapi.h>
+#include <winternl.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 #include "SysErrorMessage.h"
 #include "StringUtils.h"
+#include "Timings.h"
 
 // --------------------------------------------------------------------------------
 // --------------------------------------------------------------------------------
@@ -14,14 +21,14 @@
 /// <param name="tsList">Output: collection to populate</param>
 /// <param name="sErrorInfo">Output: information if an error occurs</param>
 /// <returns>true if successful, false otherwise</returns>
-bool TerminalSession::GetTerminalSessions(TerminalSessionList_t& tsList, std::wstring& sErrorInfo)
+bool TerminalSession::GetTerminalSessions(TerminalSessionList_t& tsList, std::wstring& sErrorInfo, bool bQuerySessionInfoEx /*= true*/)
 {
     tsList.clear();
     sErrorInfo.clear();
 
     PWTS_SESSION_INFOW pSessInfo = NULL;
     DWORD dwSessCount = 0;
-    BOOL ret = WTSEnumerateSessionsW(WTS_CURRENT_SERVER_HANDLE, 0, 1, &pSessInfo, &dwSessCount);
+    BOOL ret = TIMED_CALL(WTSEnumerateSessions, WTSEnumerateSessionsW(WTS_CURRENT_SERVER_HANDLE, 0, 1, &pSessInfo, &dwSessCount));
     if (!ret)
     {
         sErrorInfo = SysErrorMessageWithCode();
@@ -31,7 +38,7 @@ bool TerminalSession::GetTerminalSessions(TerminalSessionList_t& tsList, std::ws
     for (DWORD ix = 0; ix < dwSessCount; ++ix)
     {
         TerminalSession ts;
-        ts.Initialize(pSessInfo[ix], sErrorInfo);
+        ts.Initialize(pSessInfo[ix], sErrorInfo, bQuerySessionInfoEx);
         tsList.push_back(ts);
     }
 
@@ -104,13 +111,21 @@ bool TerminalSession::AreChildSessionsEnabled()
 /// <summary>
 /// Initialize this object from a WTS_SESSION_INFOW
 /// </summary>
-bool TerminalSession::Initialize(const WTS_SESSION_INFOW& sessionInfo, std::wstring& sErrorInfo)
+bool TerminalSession::Initialize(const WTS_SESSION_INFOW& sessionInfo, std::wstring& sErrorInfo, bool bQuerySessionInfoEx /*= true*/)
 {
     sErrorInfo.clear();
     m_dwSessionId = sessionInfo.SessionId;
     m_sSessionName = sessionInfo.pWinStationName ? sessionInfo.pWinStationName : L"(null)";
     m_state = sessionInfo.State;
-    return InitWtsInfo(m_dwSessionId, sErrorInfo);
+    if (bQuerySessionInfoEx)
+        return InitWtsInfo(m_dwSessionId, sErrorInfo);
+
+    // Fill in what the enumeration already provided so that ID(), Name(), and State() still work.
+    m_tsInfo = WTSINFOEX_LEVEL1_W();
+    m_tsInfo.SessionId = m_dwSessionId;
+    m_tsInfo.SessionState = m_state;
+    wcsncpy_s(m_tsInfo.WinStationName, m_sSessionName.c_str(), _TRUNCATE);
+    return true;
 }
 
 /// <summary>
@@ -150,7 +165,7 @@ bool TerminalSession::InitWtsInfo(DWORD dwSessionId, std::wstring& sErrorInfo)
 
     PWTSINFOEXW pWtsInfo = nullptr;
     DWORD dwBytesReturned = 0;
-    BOOL ret = WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, dwSessionId, WTSSessionInfoEx, (LPWSTR*)&pWtsInfo, &dwBytesReturned);
+    BOOL ret = TIMED_CALL(WTSQuerySessionInformation, WTSQuerySessionInformationW(WTS_CURRENT_SERVER_HANDLE, dwSessionId, WTSSessionInfoEx, (LPWSTR*)&pWtsInfo, &dwBytesReturned));
     if (ret)
     {
         m_tsInfo = pWtsInfo->Data.WTSInfoExLevel1;
@@ -272,7 +287,7 @@ std::wstring TerminalSession::CurrentTime() const
 /// <returns>true if successful, false otherwise</returns>
 bool TerminalSession::GetUserToken(HANDLE& hToken, DWORD& dwLastErr) const
 {
-    if (WTSQueryUserToken(m_dwSessionId, &hToken))
+    if (TIMED_CALL(WTSQueryUserToken, WTSQueryUserToken(m_dwSessionId, &hToken)))
     {
         return true;
     }
@@ -283,25 +298,80 @@ bool TerminalSession::GetUserToken(HANDLE& hToken, DWORD& dwLastErr) const
     }
 }
 
+// Internal: NtQuerySystemInformation status when the buffer is too small (from ntstatus.h, which conflicts with Windows.h)
+static const NTSTATUS StatusInfoLengthMismatch = (NTSTATUS)0xC0000004L;
+// Internal: SYSTEM_PROCESS_INFORMATION as declared in winternl.h hides CreateTime in Reserved1; it's the
+// LARGE_INTEGER at this offset (after WorkingSetPrivateSize, HardFaultCount, NumberOfThreadsHighWatermark, and CycleTime).
+static const size_t CreateTimeOffsetInReserved1 = 24;
+static_assert(CreateTimeOffsetInReserved1 + sizeof(LARGE_INTEGER) <= sizeof(((SYSTEM_PROCESS_INFORMATION*)nullptr)->Reserved1), "CreateTime must be within Reserved1");
+
+// Internal: creation time and image name of a process, by PID
+struct ProcessCreateInfo_t
+{
+    LONGLONG createTime;
+    std::wstring sImageName;
+};
+typedef std::unordered_map<DWORD, ProcessCreateInfo_t> ProcessCreateTimeMap_t;
+
 /// <summary>
-/// Return a list of all processes associated with the terminal session.
+/// Internal: the creation times of all processes, with one NtQuerySystemInformation(SystemProcessInformation) call,
+/// instead of opening each process (which also fails for protected processes and with insufficient access).
+/// Creation times are 100-nanosecond intervals since January 1, 1601 (UTC).
 /// </summary>
-/// <param name="processList">Output: collection to populate</param>
-/// <param name="sErrorInfo">Output: information if an error occurred</param>
-/// <returns>true if successful, false otherwise</returns>
-bool TerminalSession::GetProcesses(TSProcessInfoList_t& processList, std::wstring& sErrorInfo) const
+/// <returns>false if the processes couldn't be queried; the map is then empty</returns>
+static bool GetProcessCreateTimes(ProcessCreateTimeMap_t& createTimes)
+{
+    createTimes.clear();
+
+    // Grow the buffer until the snapshot fits; processes can start between calls, so leave some headroom.
+    // ULONGLONG elements keep the records 8-byte aligned.
+    std::vector<ULONGLONG> buffer(64 * 1024);
+    NTSTATUS status;
+    for (;;)
+    {
+        ULONG cbNeeded = 0;
+        status = TIMED_CALL(NtQuerySystemInformation, NtQuerySystemInformation(SystemProcessInformation, buffer.data(), (ULONG)(buffer.size() * sizeof(ULONGLONG)), &cbNeeded));
+        if (StatusInfoLengthMismatch != status)
+            break;
+        size_t cbNext = (size_t)cbNeeded + (size_t)cbNeeded / 4;
+        buffer.resize((std::max)(buffer.size() * 2, cbNext / sizeof(ULONGLONG) + 1));
+    }
+    if (status < 0)
+        return false;
+
+    const BYTE* pRecord = (const BYTE*)buffer.data();
+    for (;;)
+    {
+        const SYSTEM_PROCESS_INFORMATION* pProcess = (const SYSTEM_PROCESS_INFORMATION*)pRecord;
+        LARGE_INTEGER createTime;
+        memcpy(&createTime, pProcess->Reserved1 + CreateTimeOffsetInReserved1, sizeof(createTime));
+        ProcessCreateInfo_t& createInfo = createTimes[(DWORD)(ULONG_PTR)pProcess->UniqueProcessId];
+        createInfo.createTime = createTime.QuadPart;
+        if (NULL != pProcess->ImageName.Buffer)
+            createInfo.sImageName.assign(pProcess->ImageName.Buffer, pProcess->ImageName.Length / sizeof(wchar_t));
+        if (0 == pProcess->NextEntryOffset)
+            break;
+        pRecord += pProcess->NextEntryOffset;
+    }
+    return true;
+}
+
+/// <summary>
+/// Internal: enumerate the processes in one session, or in all sessions with WTS_ANY_SESSION.
+/// </summary>
+static bool EnumerateProcesses(DWORD dwSessionId, TSProcessInfoList_t& processList, std::wstring& sErrorInfo)
 {
     processList.clear();
     sErrorInfo.clear();
 
-    WTS_PROCESS_INFOW* pProcessesInfo = nullptr;
+    WTS_PROCESS_INFO_EXW* pProcessesInfo = nullptr;
     DWORD dwProcessCount = 0;
-    DWORD dwLevel = 0;
+    DWORD dwLevel = 1;
 #pragma warning(push)
 #pragma warning(disable: 6387) 
     // Disable this false positive:
     // Warning	C6387	'_Param_(1)' could be '0':  this does not adhere to the specification for the function 'WTSEnumerateProcessesExW'.
-    BOOL ret = WTSEnumerateProcessesExW(WTS_CURRENT_SERVER_HANDLE, &dwLevel, m_dwSessionId, (LPWSTR*)&pProcessesInfo, &dwProcessCount);
+    BOOL ret = TIMED_CALL(WTSEnumerateProcessesEx, WTSEnumerateProcessesExW(WTS_CURRENT_SERVER_HANDLE, &dwLevel, dwSessionId, (LPWSTR*)&pProcessesInfo, &dwProcessCount));
 #pragma warning(pop)
     if (!ret)
     {
@@ -309,18 +379,87 @@ bool TerminalSession::GetProcesses(TSProcessInfoList_t& processList, std::wstrin
         return false;
     }
 
+    // Creation times come from a second system-wide snapshot. A PID that was reused between the two snapshots
+    // shows up under a different image name; its creation time is left 0 rather than attributed to the wrong process.
+    ProcessCreateTimeMap_t createTimes;
+    GetProcessCreateTimes(createTimes);
+
     for (size_t ix = 0; ix < dwProcessCount; ++ix)
     {
-        WTS_PROCESS_INFOW& wtsCurrProcess = pProcessesInfo[ix];
+        WTS_PROCESS_INFO_EXW& wtsCurrProcess = pProcessesInfo[ix];
         TSProcessInfo_t procInfo;
         procInfo.userSid = CSid(wtsCurrProcess.pUserSid);
+        procInfo.dwSessionId = wtsCurrProcess.SessionId;
         procInfo.dwPID = wtsCurrProcess.ProcessId;
         procInfo.sProcessName = (wtsCurrProcess.pProcessName ? wtsCurrProcess.pProcessName : L"[null]");
-        processList.push_back(procInfo);
+        ProcessCreateTimeMap_t::const_iterator createIter = createTimes.find(wtsCurrProcess.ProcessId);
+        if (createTimes.end() != createIter &&
+            (createIter->second.sImageName.empty() || 0 == _wcsicmp(createIter->second.sImageName.c_str(), procInfo.sProcessName.c_str())))
+        {
+            procInfo.createTime = createIter->second.createTime;
+        }
+        procInfo.dwThreadCount = wtsCurrProcess.NumberOfThreads;
+        procInfo.dwHandleCount = wtsCurrProcess.HandleCount;
+        procInfo.workingSetSize = wtsCurrProcess.WorkingSetSize;
+        procInfo.pagefileUsage = wtsCurrProcess.PagefileUsage;
+        procInfo.userTime = wtsCurrProcess.UserTime.QuadPart;
+        procInfo.kernelTime = wtsCurrProcess.KernelTime.QuadPart;
+        processList.push_back(std::move(procInfo));
     }
 
-    WTSFreeMemoryExW(WTSTypeProcessInfoLevel0, pProcessesInfo, dwProcessCount);
+    WTSFreeMemoryExW(WTSTypeProcessInfoLevel1, pProcessesInfo, dwProcessCount);
 
     return true;
 }
 
+/// <summary>
+/// Return a list of all processes associated with the terminal session.
+/// </summary>
+/// <param name="processList">Output: collection to populate</param>
+/// <param name="sErrorInfo">Output: information if an error occurred</param>
+/// <returns>true if successful, false otherwise</returns>
+bool TerminalSession::GetProcesses(TSProcessInfoList_t& processList, std::wstring& sErrorInfo) const
+{
+    return EnumerateProcesses(m_dwSessionId, processList, sErrorInfo);
+}
+
+/// <summary>
+/// Return a list of all processes in all terminal sessions, with one system-wide enumeration.
+/// </summary>
+/// <param name="processList">Output: collection to populate</param>
+/// <param name="sErrorInfo">Output: information if an error occurred</param>
+/// <returns>true if successful, false otherwise</returns>
+bool TerminalSession::GetAllProcesses(TSProcessInfoList_t& processList, std::wstring& sErrorInfo)
+{
+    return EnumerateProcesses(WTS_ANY_SESSION, processList, sErrorInfo);
+}
+
+/// <summary>
+/// Returns the full path of a process' executable image.
+/// </summary>
+/// <param name="dwPID">Input: process ID</param>
+/// <param name="sImagePath">Output: the image path</param>
+/// <param name="sErrorInfo">Output: information if the process can't be opened or queried</param>
+/// <returns>true if successful, false otherwise</returns>
+bool TerminalSession::GetProcessImagePath(DWORD dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo)
+{
+    sImagePath.clear();
+    sErrorInfo.clear();
+    bool retval = false;
+    HANDLE hProcess = TIMED_CALL(OpenProcess, OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, dwPID));
+    wchar_t szImagePath[2048];
+    if (hProcess && TIMED_CALL(GetModuleFileNameEx, GetModuleFileNameExW(hProcess, NULL, szImagePath, sizeof(szImagePath) / sizeof(szImagePath[0]))) > 0)
+    {
+        sImagePath = szImagePath;
+        retval = true;
+    }
+    else
+    {
+        sErrorInfo = SysErrorMessageWithCode();
+        // Clear the error in this thread now
+        SetLastError(0);
+    }
+    if (hProcess) CloseHandle(hProcess);
+    return retval;
+}
+
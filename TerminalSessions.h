@@ -12,12 +12,23 @@ typedef std::list<TerminalSession> TerminalSessionList_t;
 
 struct TSProcessInfo_t
 {
+	DWORD dwSessionId = 0;
 	DWORD dwPID = 0;
+	// Process creation time as 100-nanosecond intervals since January 1, 1601 (UTC); 0 if not known
+	// (e.g., the process exited, or its PID was reused, during the enumeration)
+	LONGLONG createTime = 0;
 	std::wstring sProcessName;
 	CSid userSid;
 
-	//TODO: Using WTS_PROCESS_INFOW for the above. Could provide a lot more info with WTS_PROCESS_INFO_EXW:
-	// https://learn.microsoft.com/en-us/windows/win32/api/wtsapi32/ns-wtsapi32-wts_process_info_exw
+	// Resource usage from the level-1 enumeration (WTS_PROCESS_INFO_EXW)
+	DWORD dwThreadCount = 0;
+	DWORD dwHandleCount = 0;
+	// Bytes
+	ULONGLONG workingSetSize = 0;
+	ULONGLONG pagefileUsage = 0;
+	// CPU time as 100-nanosecond intervals
+	LONGLONG userTime = 0;
+	LONGLONG kernelTime = 0;
 };
 typedef std::list<TSProcessInfo_t> TSProcessInfoList_t;
 
@@ -38,8 +49,9 @@ public:
 	/// </summary>
 	/// <param name="tsList">Output: collection to populate</param>
 	/// <param name="sErrorInfo">Output: information if an error occurs</param>
+	/// <param name="bQuerySessionInfoEx">Input: false to skip the per-session WTSSessionInfoEx query; only ID, name, and state are then available</param>
 	/// <returns>true if successful, false otherwise</returns>
-	static bool GetTerminalSessions(TerminalSessionList_t& tsList, std::wstring& sErrorInfo);
+	static bool GetTerminalSessions(TerminalSessionList_t& tsList, std::wstring& sErrorInfo, bool bQuerySessionInfoEx = true);
 
 	/// <summary>
 	/// The session identifier of the session that is attached to the physical console. 
@@ -62,6 +74,23 @@ public:
 	/// </summary>
 	static bool AreChildSessionsEnabled();
 
+	/// <summary>
+	/// Return a list of all processes in all terminal sessions, with one system-wide enumeration.
+	/// </summary>
+	/// <param name="processList">Output: collection to populate</param>
+	/// <param name="sErrorInfo">Output: information if an error occurred</param>
+	/// <returns>true if successful, false otherwise</returns>
+	static bool GetAllProcesses(TSProcessInfoList_t& processList, std::wstring& sErrorInfo);
+
+	/// <summary>
+	/// Returns the full path of a process' executable image.
+	/// </summary>
+	/// <param name="dwPID">Input: process ID</param>
+	/// <param name="sImagePath">Output: the image path</param>
+	/// <param name="sErrorInfo">Output: information if the process can't be opened or queried</param>
+	/// <returns>true if successful, false otherwise</returns>
+	static bool GetProcessImagePath(DWORD dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo);
+
 public:
 	// --------------------------------------------------------------------------------
 	// ctor, dtor, cctor, assignment - all defaults
@@ -74,9 +103,10 @@ public:
 	// Initialization functions
 
 	/// <summary>
-	/// Initialize this object from a WTS_SESSION_INFOW
+	/// Initialize this object from a WTS_SESSION_INFOW.
+	/// If bQuerySessionInfoEx is false, WTSSessionInfoEx isn't queried and only ID, name, and state are available.
 	/// </summary>
-	bool Initialize(const WTS_SESSION_INFOW& sessionInfo, std::wstring& sErrorInfo);
+	bool Initialize(const WTS_SESSION_INFOW& sessionInfo, std::wstring& sErrorInfo, bool bQuerySessionInfoEx = true);
 
 	/// <summary>
 	/// Initialize this object from a session ID
@@ -104,6 +134,11 @@ public:
 	std::wstring LastInputTime() const;
 	std::wstring CurrentTime() const;
 
+	/// <summary>
+	/// Raw WTSSessionInfoEx data from which the attributes above are derived (zero-filled if it couldn't be retrieved).
+	/// </summary>
+	const WTSINFOEX_LEVEL1_W& SessionInfoEx() const { return m_tsInfo; }
+
 	/// <summary>
 	/// Get the user token associated with the session. (Must be running as System to do this.)
 	/// Note that the caller must call CloseHandle on the returned hToken.
@@ -0,0 +1,680 @@
+// TextRenderer.cpp: renders a SystemSnapshot_t as the human-readable TSSessions report.
+
+#include "TextRenderer.h"
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "SecurityDescriptorUtils.h"
+#include "SecDescRenderCache.h"
+#include "HEX.h"
+#include "StringUtils.h"
+
+// Undefine macros from the SDK so that we can use the std algorithms.
+#undef max
+#undef min
+
+/// <summary>
+/// Internal helper: the value if collected, the error information otherwise.
+/// </summary>
+static const std::wstring& ValueOrError(const Captured_t<std::wstring>& captured)
+{
+	return (captured.bValid ? captured.value : captured.sErrorInfo);
+}
+
+/// <summary>
+/// Internal helper: CPU time (100-nanosecond intervals) as seconds with millisecond precision.
+/// </summary>
+static std::wstring CpuSeconds(int64_t cpuTime)
+{
+	std::wstringstream str;
+	str << (cpuTime / 10000000) << L"." << std::setw(3) << std::setfill(L'0') << ((cpuTime / 10000) % 1000) << L" s";
+	return str.str();
+}
+
+/// <summary>
+/// Internal helper: format a stored time the same way TerminalSession does.
+/// </summary>
+static std::wstring TimeString(int64_t timeValue)
+{
+	LARGE_INTEGER li;
+	li.QuadPart = timeValue;
+	return LargeIntegerToDateTimeString(li);
+}
+
+TextRenderer::TextRenderer(const TextRenderOptions_t& options)
+	: m_options(options)
+{
+}
+
+/// <summary>
+/// Write the full report
+/// </summary>
+void TextRenderer::Render(std::wostream& sOut, const SystemSnapshot_t& snapshot) const
+{
+	if (ShowField(Field_Current))
+		RenderCurrentInfo(sOut, snapshot.currentInfo);
+	if (ShowField(Field_AnySession & ~Field_ProcessSummaries))
+		RenderSessions(sOut, snapshot.sessions);
+	if (ShowField(Field_ProcessUsage))
+		RenderProcessUsage(sOut, snapshot.sessions);
+	if (ShowField(Field_TopProcesses))
+		RenderTopProcesses(sOut, snapshot.sessions);
+	if (ShowField(Field_AnyWindowStation))
+		RenderWindowStations(sOut, snapshot.windowStations);
+}
+
+/// <summary>
+/// The configured fields, less security descriptors if no format was chosen
+/// </summary>
+FieldSet_t TextRenderer::RequiredFields() const
+{
+	FieldSet_t fields = m_options.fields;
+	if (SecDescOptions_t::None == m_options.secDescOption)
+		fields &= ~(FieldSet_t)Field_SecurityDescriptor;
+	return fields;
+}
+
+/// <summary>
+/// "DOMAIN\user (SID)", the SID alone if name lookup failed, "(no user)", or the collection error.
+/// </summary>
+std::wstring TextRenderer::UserNameAndSid(const Captured_t<SidInfo_t>& user)
+{
+	if (!user.bValid)
+		return user.sErrorInfo;
+	if (user.value.IsEmpty())
+		return L"(no user)";
+	if (user.value.Name().empty())
+		return user.value.ToString();
+	return user.value.Name() + L" (" + user.value.ToString() + L")";
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TextRenderer::RenderCurrentInfo(std::wostream& sOut, const CurrentInfoSnapshot_t& currentInfo) const
+{
+	sOut << L"This process/thread running in:" << std::endl << std::endl;
+	sOut
+		<< L"    TS Session:  ";
+	if (currentInfo.sessionId.bValid)
+		sOut << currentInfo.sessionId.value << std::endl;
+	else
+		sOut << currentInfo.sessionId.sErrorInfo << std::endl;
+	sOut << std::endl;
+
+	sOut
+		<< L"    WinSta:      " << ValueOrError(currentInfo.winstaName) << std::endl
+		<< L"    User:        " << UserNameAndSid(currentInfo.winstaUser) << std::endl
+		<< L"    Flags:       " << ValueOrError(currentInfo.winstaFlags) << std::endl
+		<< std::endl
+		<< L"    Desktop:     " << ValueOrError(currentInfo.desktopName) << std::endl
+		<< L"    User:        " << UserNameAndSid(currentInfo.desktopUser) << std::endl
+		<< L"    Flags:       " << ValueOrError(currentInfo.desktopFlags) << std::endl
+		<< L"    Heap size:   ";
+	if (currentInfo.desktopHeapSizeKb.bValid)
+		sOut << currentInfo.desktopHeapSizeKb.value << L" KB" << std::endl;
+	else
+		sOut << currentInfo.desktopHeapSizeKb.sErrorInfo << std::endl;
+	sOut << std::endl;
+
+	sOut
+		<< L"    Running as:  "
+		<< currentInfo.runningAs.ToString()
+		<< L" - "
+		<< currentInfo.runningAs.Name()
+		<< std::endl;
+	sOut << std::endl;
+
+	sOut
+		<< L"Current user input Desktop: " << ValueOrError(currentInfo.inputDesktopName) << std::endl
+		<< std::endl;
+
+	sOut
+		<< L"Console Session = ";
+	if (0xFFFFFFFF == currentInfo.activeConsoleSessionId)
+		sOut << L"(transition)" << std::endl << std::endl;
+	else
+		sOut << currentInfo.activeConsoleSessionId << std::endl << std::endl;
+
+	sOut << L"Are child sessions enabled? " << (currentInfo.bChildSessionsEnabled ? L"Yes" : L"No")
+		<< std::endl
+		<< std::endl;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TextRenderer::RenderSessions(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const
+{
+	if (!sessions.bValid)
+	{
+		sOut << L"Unable to enumerate terminal sessions: " << sessions.sErrorInfo << std::endl;
+		return;
+	}
+
+	sOut << L"Terminal sessions: " << sessions.value.size() << std::endl << std::endl;
+
+	SessionSnapshotList_t::const_iterator sessionIter;
+	for (sessionIter = sessions.value.begin(); sessionIter != sessions.value.end(); sessionIter++)
+	{
+		RenderSession(sOut, *sessionIter);
+	}
+}
+
+void TextRenderer::RenderSession(std::wostream& sOut, const SessionSnapshot_t& session) const
+{
+	if (ShowField(Field_SessionId))
+		sOut << L"    Session ID           : " << session.dwSessionId << std::endl;
+	if (ShowField(Field_SessionName))
+		sOut << L"    Session Name         : " << session.sName << std::endl;
+	if (ShowField(Field_SessionState))
+		sOut << L"    State                : " << session.sState << std::endl;
+	if (ShowField(Field_SessionFlags))
+		sOut << L"    SessionFlags         : " << session.sSessionFlags << std::endl;
+	if (ShowField(Field_SessionUser))
+	{
+		sOut
+			<< L"    DomainName           : " << session.sDomainName << std::endl
+			<< L"    UserName             : " << session.sUserName << std::endl
+			;
+	}
+	if (ShowField(Field_SessionTimes))
+	{
+		sOut
+			<< L"    LogonTime            : " << TimeString(session.logonTime) << std::endl
+			<< L"    ConnectTime          : " << TimeString(session.connectTime) << std::endl
+			<< L"    DisconnectTime       : " << TimeString(session.disconnectTime) << std::endl
+			<< L"    LastInputTime        : " << TimeString(session.lastInputTime) << std::endl
+			<< L"    CurrentTime          : " << TimeString(session.currentTime) << std::endl
+			;
+	}
+
+	// Not collected unless the token field was requested
+	switch (session.tokenStatus)
+	{
+	case TokenStatus_t::Retrieved:
+		sOut << L"    * User token:" << std::endl;
+		RenderToken(sOut, session.token);
+		if (session.bHasLinkedToken)
+		{
+			sOut << L"    * Linked token:" << std::endl;
+			RenderToken(sOut, session.linkedToken);
+		}
+		break;
+	case TokenStatus_t::PrivilegeNotHeld:
+		sOut << L"    [Insufficient privilege to retrieve token]" << std::endl;
+		break;
+	case TokenStatus_t::NoToken:
+		sOut << L"    No Token" << std::endl;
+		break;
+	case TokenStatus_t::Error:
+		sOut << L"    Error retrieving token: " << session.sTokenError << std::endl;
+		break;
+	case TokenStatus_t::NotCollected:
+		break;
+	}
+
+	if (session.bProcessesCollected && ShowField(Field_Processes))
+	{
+		if (session.processes.bValid)
+		{
+			const ProcessSnapshotList_t& procList = session.processes.value;
+			if (procList.size() > 0)
+			{
+				sOut << L"    Processes:" << std::endl;
+
+				ProcessSnapshotList_t::const_iterator procIter;
+				size_t nMaxProcNameLength = 0;
+				for (procIter = procList.begin(); procIter != procList.end(); procIter++)
+				{
+					size_t nProcNameLength = procIter->sProcessName.length();
+					if (nProcNameLength > nMaxProcNameLength)
+						nMaxProcNameLength = nProcNameLength;
+				}
+				for (procIter = procList.begin(); procIter != procList.end(); procIter++)
+				{
+					sOut
+						<< L"        "
+						<< std::left << std::setw(7) << procIter->dwPID
+						<< std::left << std::setw(nMaxProcNameLength + 2) << procIter->sProcessName
+						<< procIter->user.DisplayName()
+						<< std::endl;
+				}
+			}
+			else
+			{
+				sOut << L"    No processes" << std::endl;
+			}
+		}
+		else
+		{
+			sOut << L"    Error enumerating processes: " << session.processes.sErrorInfo << std::endl;
+		}
+	}
+
+	sOut << std::endl;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal helper: description of a ranking metric
+/// </summary>
+static const wchar_t* MetricName(UsageMetric_t metric)
+{
+	switch (metric)
+	{
+	case UsageMetric_t::WorkingSet:
+		return L"working set";
+	case UsageMetric_t::Handles:
+		return L"handle count";
+	case UsageMetric_t::Cpu:
+	default:
+		return L"CPU time";
+	}
+}
+
+/// <summary>
+/// Internal helper: "Session N (name)"
+/// </summary>
+static std::wstring SessionLabel(const SessionSnapshotList_t& sessions, uint32_t dwSessionId)
+{
+	std::wstringstream strLabel;
+	strLabel << L"Session " << dwSessionId;
+	SessionSnapshotList_t::const_iterator sessionIter;
+	for (sessionIter = sessions.begin(); sessionIter != sessions.end(); sessionIter++)
+	{
+		if (sessionIter->dwSessionId == dwSessionId)
+		{
+			strLabel << L" (" << sessionIter->sName << L")";
+			break;
+		}
+	}
+	return strLabel.str();
+}
+
+/// <summary>
+/// Internal helper: write the error if sessions or processes couldn't be enumerated.
+/// Processes are enumerated once for all sessions, so a failure applies to every session.
+/// </summary>
+/// <returns>true if there are processes to summarize</returns>
+static bool ProcessesEnumerated(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions)
+{
+	if (!sessions.bValid)
+	{
+		sOut << L"    Unable to enumerate terminal sessions: " << sessions.sErrorInfo << std::endl << std::endl;
+		return false;
+	}
+	SessionSnapshotList_t::const_iterator sessionIter;
+	for (sessionIter = sessions.value.begin(); sessionIter != sessions.value.end(); sessionIter++)
+	{
+		if (sessionIter->bProcessesCollected && !sessionIter->processes.bValid)
+		{
+			sOut << L"    Error enumerating processes: " << sessionIter->processes.sErrorInfo << std::endl << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+void TextRenderer::RenderProcessUsage(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const
+{
+	sOut << L"Process resource usage (top " << m_options.nUsageTop << L" by " << MetricName(m_options.usageMetric) << L"):" << std::endl << std::endl;
+	if (!ProcessesEnumerated(sOut, sessions))
+		return;
+
+	ProcessUsageTable table;
+	table.Load(sessions.value);
+	UsageRollup_t rollup;
+	table.RollUp(m_options.usageMetric, m_options.nUsageTop, rollup);
+
+	RenderUsageGroup(sOut, L"All sessions", rollup.all, table);
+	UsageGroupList_t::const_iterator groupIter;
+	for (groupIter = rollup.sessions.begin(); groupIter != rollup.sessions.end(); groupIter++)
+	{
+		RenderUsageGroup(sOut, SessionLabel(sessions.value, groupIter->key), *groupIter, table);
+	}
+	for (groupIter = rollup.users.begin(); groupIter != rollup.users.end(); groupIter++)
+	{
+		const SidInfo_t& user = table.User(groupIter->key);
+		std::wstring sUser = user.IsEmpty() ? L"(no user)" : user.DisplayName();
+		RenderUsageGroup(sOut, L"User " + sUser, *groupIter, table);
+	}
+}
+
+void TextRenderer::RenderTopProcesses(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const
+{
+	// With an earlier sample, CPU time is what each process used between the samples.
+	const Captured_t<SessionSnapshotList_t>* pEarlier = m_options.pTopEarlierSample;
+	bool bInterval = (nullptr != pEarlier && pEarlier->bValid && UsageMetric_t::Cpu == m_options.topMetric);
+	sOut << L"Top " << m_options.nTop << L" processes by " << MetricName(m_options.topMetric);
+	if (bInterval)
+		sOut << L" used in the last " << m_options.topIntervalSeconds << L" seconds";
+	sOut << L":" << std::endl << std::endl;
+	if (!ProcessesEnumerated(sOut, sessions))
+		return;
+
+	ProcessUsageTable table;
+	table.Load(sessions.value);
+	if (bInterval)
+	{
+		ProcessUsageTable earlierTable;
+		earlierTable.Load(pEarlier->value);
+		table.SubtractCpuTime(earlierTable);
+	}
+	UsageRollup_t rollup;
+	table.RollUp(m_options.topMetric, m_options.nTop, rollup);
+
+	RenderUsageGroup(sOut, L"All sessions", rollup.all, table);
+	UsageGroupList_t::const_iterator groupIter;
+	for (groupIter = rollup.sessions.begin(); groupIter != rollup.sessions.end(); groupIter++)
+	{
+		RenderUsageGroup(sOut, SessionLabel(sessions.value, groupIter->key), *groupIter, table);
+	}
+}
+
+void TextRenderer::RenderUsageGroup(std::wostream& sOut, const std::wstring& sLabel, const UsageGroup_t& group, const ProcessUsageTable& table) const
+{
+	const UsageTotals_t& totals = group.totals;
+	sOut
+		<< L"    " << sLabel << L": "
+		<< totals.nProcesses << L" processes, "
+		<< totals.threadCount << L" threads, "
+		<< totals.handleCount << L" handles, working set "
+		<< (totals.workingSetSize / 1024) << L" KB, pagefile "
+		<< (totals.pagefileUsage / 1024) << L" KB, CPU "
+		<< CpuSeconds(totals.userTime + totals.kernelTime)
+		<< std::endl;
+
+	std::vector<size_t>::const_iterator topIter;
+	for (topIter = group.top.begin(); topIter != group.top.end(); topIter++)
+	{
+		const ProcessUsage_t& process = table.Processes()[*topIter];
+		sOut
+			<< L"        "
+			<< std::left << std::setw(7) << process.pProcess->dwPID
+			<< std::left << std::setw(30) << process.pProcess->sProcessName
+			<< L"CPU " << CpuSeconds(process.userTime + process.kernelTime)
+			<< L", working set " << (process.workingSetSize / 1024) << L" KB, "
+			<< process.handleCount << L" handles"
+			<< std::endl;
+	}
+	sOut << std::endl;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TextRenderer::RenderToken(std::wostream& sOut, const TokenSnapshot_t& token) const
+{
+	sOut
+		<< L"    Token user SID       : " << token.user.ToString() << std::endl
+		<< L"    Token logon session  : " << HEX(token.logonSessionHigh) << L":" << HEX(token.logonSessionLow) << std::endl
+		<< L"    Token integrity level: " << token.sIntegrityLevelName << std::endl
+		;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TextRenderer::RenderWindowStations(std::wostream& sOut, const Captured_t<WindowStationSnapshotList_t>& windowStations) const
+{
+	if (!windowStations.bValid)
+	{
+		sOut << L"Unable to enumerate window stations: " << windowStations.sErrorInfo << std::endl;
+		return;
+	}
+
+	sOut << L"Window stations in the current session: " << windowStations.value.size() << std::endl << std::endl;
+
+	WindowStationSnapshotList_t::const_iterator wsIter;
+	for (wsIter = windowStations.value.begin(); wsIter != windowStations.value.end(); wsIter++)
+	{
+		RenderWindowStation(sOut, *wsIter);
+	}
+}
+
+void TextRenderer::RenderWindowStation(std::wostream& sOut, const WindowStationSnapshot_t& ws, bool bIncludeDesktops /*= true*/) const
+{
+	sOut << L"    WS name    : " << ws.sName << std::endl;
+	if (ws.bOpened)
+	{
+		if (ShowField(Field_ObjectFlags))
+			sOut << L"      Flags    : " << ValueOrError(ws.flags) << std::endl;
+		if (ShowField(Field_ObjectUser))
+			sOut << L"      User     : " << UserNameAndSid(ws.user) << std::endl;
+
+		RenderSecurityDescriptor(sOut, ws.securityDescriptor, true, 6);
+
+		if (ShowField(Field_AnyDesktop))
+		{
+			if (ws.desktops.bValid)
+			{
+				sOut << L"      Desktops in WS " << ws.sName << L": " << ws.desktops.value.size() << std::endl << std::endl;
+				if (bIncludeDesktops)
+				{
+					DesktopSnapshotList_t::const_iterator desktopIter;
+					for (desktopIter = ws.desktops.value.begin(); desktopIter != ws.desktops.value.end(); desktopIter++)
+					{
+						RenderDesktop(sOut, *desktopIter);
+					}
+				}
+			}
+			else
+			{
+				sOut << L"      Unable to enumerate desktops: " << ws.desktops.sErrorInfo << std::endl;
+			}
+		}
+	}
+	else if (!ws.sOpenError.empty())
+	{
+		// Not opened without an error if only names were requested
+		sOut << L"    Error: " << ws.sOpenError << std::endl;
+	}
+	sOut << std::endl;
+}
+
+void TextRenderer::RenderDesktop(std::wostream& sOut, const DesktopSnapshot_t& desktop) const
+{
+	sOut << L"        Name : " << desktop.sName << std::endl;
+	if (desktop.bOpened)
+	{
+		if (ShowField(Field_ObjectFlags))
+			sOut << L"          Flags    : " << ValueOrError(desktop.flags) << std::endl;
+		if (ShowField(Field_ObjectUser))
+			sOut << L"          User     : " << UserNameAndSid(desktop.user) << std::endl;
+		if (ShowField(Field_DesktopHeap))
+		{
+			sOut << L"          Heap size: ";
+			if (desktop.heapSizeKb.bValid)
+				sOut << desktop.heapSizeKb.value << L" KB" << std::endl;
+			else
+				sOut << desktop.heapSizeKb.sErrorInfo << std::endl;
+		}
+		if (ShowField(Field_DesktopInput))
+		{
+			sOut << L"          UserInput: ";
+			if (desktop.receivingInput.bValid)
+				sOut << (desktop.receivingInput.value ? L"Yes" : L"No") << std::endl;
+			else
+				sOut << desktop.receivingInput.sErrorInfo << std::endl;
+		}
+
+		RenderSecurityDescriptor(sOut, desktop.securityDescriptor, false, 10);
+
+		if (desktop.bWindowsCollected && ShowField(Field_Windows))
+		{
+			RenderDesktopWindows(sOut, desktop.windows);
+		}
+	}
+	else if (!desktop.sOpenError.empty())
+	{
+		// Not opened without an error if only names were requested
+		sOut << L"          Error: " << desktop.sOpenError << std::endl;
+	}
+	sOut << std::endl;
+}
+
+// ----------------------------------------------------------------------------------------------------
+
+void TextRenderer::RenderSecurityDescriptor(std::wostream& sOut, const SecurityDescriptorSnapshot_t& sdSnapshot, bool bWindowStation, size_t indent) const
+{
+	if (SecDescOptions_t::None == m_options.secDescOption || !sdSnapshot.bCollected || !ShowField(Field_SecurityDescriptor))
+		return;
+
+	if (!sdSnapshot.sd.bValid)
+	{
+		sOut << std::setw(indent) << L"" << L"Sec desc : " << sdSnapshot.sd.sErrorInfo << std::endl;
+		return;
+	}
+
+	// Most window stations and desktops share a handful of security descriptors; render each distinct one once.
+	const std::vector<uint8_t>& sdBytes = sdSnapshot.sd.value;
+	const SecDescRenderCache::Rendering_t rendering = {
+		(uint32_t)m_options.secDescOption, (uint32_t)sdSnapshot.securityInformation, bWindowStation ? L"winsta" : L"desktop", indent };
+	std::wstring sText;
+	if (!SecDescCache().Find(sdBytes.data(), sdBytes.size(), rendering, sText))
+	{
+		std::wostringstream sRendered;
+		RenderSecurityDescriptorText(sRendered, sdSnapshot, bWindowStation, indent);
+		sText = sRendered.str();
+		SecDescCache().Add(sdBytes.data(), sdBytes.size(), rendering, sText);
+	}
+	sOut << sText;
+}
+
+/// <summary>
+/// Internal: render a valid security descriptor in the configured format
+/// </summary>
+void TextRenderer::RenderSecurityDescriptorText(std::wostream& sOut, const SecurityDescriptorSnapshot_t& sdSnapshot, bool bWindowStation, size_t indent) const
+{
+	// The Win32 descriptor functions don't modify the descriptor but aren't declared const.
+	PSECURITY_DESCRIPTOR pSD = (PSECURITY_DESCRIPTOR)sdSnapshot.sd.value.data();
+	std::wstring sSDDL, sErrorInfo;
+	switch (m_options.secDescOption)
+	{
+	case SecDescOptions_t::SDDL:
+		sOut << std::setw(indent) << L"" << L"SDDL     : ";
+		if (SecDescriptorToSDDL(pSD, sdSnapshot.securityInformation, sSDDL, sErrorInfo))
+		{
+			sOut << sSDDL << std::endl;
+		}
+		else
+		{
+			sOut << sErrorInfo << std::endl;
+		}
+		break;
+	case SecDescOptions_t::SecDesc:
+		sOut << std::setw(indent) << L"" << L"Security descriptor:" << std::endl;
+		OutputSecurityDescriptor(sOut, pSD, bWindowStation ? L"winsta" : L"desktop", true, indent + 2);
+		sOut << std::endl;
+		break;
+	case SecDescOptions_t::None:
+		break;
+	}
+}
+
+SecDescRenderCache& TextRenderer::SecDescCache()
+{
+	// Initialized on first use (thread-safe); intentionally never destroyed, like the SID name cache.
+	static SecDescRenderCache* pSecDescCache = new SecDescRenderCache();
+	return *pSecDescCache;
+}
+
+void TextRenderer::RenderDesktopWindows(std::wostream& sOut, const Captured_t<WindowSnapshotList_t>& windows) const
+{
+	const wchar_t* const szIndent = L"          ";
+	const bool bVisibleOnly = m_options.bVisibleWindowsOnly;
+
+	if (!windows.bValid)
+	{
+		sOut << L"            Unable to enumerate windows: " << windows.sErrorInfo << std::endl;
+		return;
+	}
+
+	if (!windows.sErrorInfo.empty())
+	{
+		sOut << L"!!! " << windows.sErrorInfo << std::endl;
+	}
+
+	const WindowSnapshotList_t& windowList = windows.value;
+	size_t numWindows = windowList.size();
+	if (numWindows == 0)
+	{
+		sOut << szIndent << L"No top-level windows." << std::endl;
+		return;
+	}
+
+	bool bListingAny = false;
+	// iterate through and get the sizes from the data
+	size_t lenClassName = 12, lenWindowText = 11, lenPID = 4;
+	WindowSnapshotList_t::const_iterator windowIter;
+	for (windowIter = windowList.begin(); windowIter != windowList.end(); windowIter++)
+	{
+		const WindowSnapshot_t& windowInfo = *windowIter;
+		if (windowInfo.bIsValid && (windowInfo.bIsVisible || !bVisibleOnly))
+		{
+			bListingAny = true;
+			lenClassName = std::max(escapeCrLfTabNul(windowInfo.sClassName).size(), lenClassName);
+			lenWindowText = std::max(escapeCrLfTabNul(windowInfo.sWindowText).size(), lenWindowText);
+			if (windowInfo.PID >= 1000000)
+				lenPID = std::max((size_t)7, lenPID);
+			else if (windowInfo.PID >= 100000)
+				lenPID = std::max((size_t)6, lenPID);
+			else if (windowInfo.PID >= 10000)
+				lenPID = std::max((size_t)5, lenPID);
+		}
+	}
+
+	// Set some limits
+	lenClassName = std::min((size_t)35, lenClassName);
+	lenWindowText = std::min((size_t)55, lenWindowText);
+
+	if (!bListingAny)
+	{
+		sOut << szIndent << L"Top-level windows: " << numWindows << L". None are visible." << std::endl;
+		return;
+	}
+
+	sOut << szIndent << L"Top-level windows: " << numWindows << (bVisibleOnly ? L". Showing visible windows only." : L"") << std::endl;
+	// Output headers
+	sOut
+		<< szIndent << L"  "
+		<< std::left << std::setw(9) << L"HWND"
+		<< std::left << std::setw(8) << L"IsVis?"
+		<< std::left << std::setw(lenClassName + 1) << L"Window class"
+		<< std::left << std::setw(lenWindowText + 1) << L"Window text"
+		<< std::left << std::setw(lenPID + 1) << L"PID"
+		<< L"Process name" << std::endl;
+
+	for (windowIter = windowList.begin(); windowIter != windowList.end(); windowIter++)
+	{
+		const WindowSnapshot_t& windowInfo = *windowIter;
+		if (windowInfo.bIsValid)
+		{
+			if (windowInfo.bIsVisible || !bVisibleOnly)
+			{
+				// Trim them if necessary
+				std::wstring sClassName = escapeCrLfTabNul(windowInfo.sClassName);
+				std::wstring sWindowText = escapeCrLfTabNul(windowInfo.sWindowText);
+				if (sClassName.length() > lenClassName)
+					sClassName = sClassName.substr(0, lenClassName - 3) + L"...";
+				if (sWindowText.length() > lenWindowText)
+					sWindowText = sWindowText.substr(0, lenWindowText - 3) + L"...";
+				sOut
+					<< szIndent << L"  "
+					<< std::left << std::setw(9) << HEX((unsigned long long)windowInfo.hwnd, 8, true, false)
+					<< std::left << std::setw(8) << (windowInfo.bIsVisible ? L"Visible" : L"Hidden")
+					<< std::left << std::setw(lenClassName + 1) << sClassName
+					<< std::left << std::setw(lenWindowText + 1) << sWindowText
+					<< std::left << std::setw(lenPID + 1) << windowInfo.PID
+					<< GetFileNameFromFilePath(windowInfo.sProcessPath) << std::endl;
+			}
+		}
+		else
+		{
+			// Written as a pointer, as the HWND itself used to be.
+			sOut
+				<< szIndent
+				<< (const void*)(uintptr_t)windowInfo.hwnd
+				<< L"(INVALID)"
+				<< std::endl;
+		}
+	}
+}
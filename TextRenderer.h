@@ -0,0 +1,92 @@
+#pragma once
+
+// TextRenderer.h: renders a SystemSnapshot_t as the human-readable TSSessions report.
+
+#include <Windows.h>
+#include "SnapshotRenderer.h"
+#include "ProcessUsage.h"
+
+class SecDescRenderCache;
+
+/// <summary>
+/// How to show window station and desktop security descriptors
+/// </summary>
+enum class SecDescOptions_t { None, SecDesc, SDDL };
+
+/// <summary>
+/// Options controlling the text report
+/// </summary>
+struct TextRenderOptions_t
+{
+	// List only visible top-level windows
+	bool bVisibleWindowsOnly = false;
+	// Security descriptor format; descriptors are shown only if they were collected.
+	SecDescOptions_t secDescOption = SecDescOptions_t::None;
+	// Fields to show. Processes, windows, and security descriptors are shown only if they were also collected.
+	FieldSet_t fields = Field_All;
+	// Process resource usage: number of heaviest processes to list for each group, and what to rank them by
+	size_t nUsageTop = 5;
+	UsageMetric_t usageMetric = UsageMetric_t::Cpu;
+	// Top processes host-wide and per session: how many, and what to rank them by
+	size_t nTop = 5;
+	UsageMetric_t topMetric = UsageMetric_t::Cpu;
+	// Optional earlier sample of the sessions' processes, taken topIntervalSeconds before the snapshot;
+	// if set, processes are ranked by the CPU time used in between. Must outlive the renderer.
+	const Captured_t<SessionSnapshotList_t>* pTopEarlierSample = nullptr;
+	uint32_t topIntervalSeconds = 0;
+};
+
+/// <summary>
+/// Renders the text report. The individual sections are public so that other renderers can reuse them.
+/// </summary>
+class TextRenderer : public SnapshotRenderer
+{
+public:
+	explicit TextRenderer(const TextRenderOptions_t& options);
+	virtual ~TextRenderer() = default;
+
+	/// <summary>
+	/// Write the full report
+	/// </summary>
+	virtual void Render(std::wostream& sOut, const SystemSnapshot_t& snapshot) const override;
+
+	/// <summary>
+	/// The configured fields, less security descriptors if no format was chosen
+	/// </summary>
+	virtual FieldSet_t RequiredFields() const override;
+
+	void RenderCurrentInfo(std::wostream& sOut, const CurrentInfoSnapshot_t& currentInfo) const;
+	void RenderSessions(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const;
+	void RenderSession(std::wostream& sOut, const SessionSnapshot_t& session) const;
+	void RenderProcessUsage(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const;
+	void RenderTopProcesses(std::wostream& sOut, const Captured_t<SessionSnapshotList_t>& sessions) const;
+	void RenderWindowStations(std::wostream& sOut, const Captured_t<WindowStationSnapshotList_t>& windowStations) const;
+	void RenderWindowStation(std::wostream& sOut, const WindowStationSnapshot_t& ws, bool bIncludeDesktops = true) const;
+	void RenderDesktop(std::wostream& sOut, const DesktopSnapshot_t& desktop) const;
+
+	/// <summary>
+	/// "DOMAIN\user (SID)", the SID alone if name lookup failed, "(no user)", or the collection error.
+	/// </summary>
+	static std::wstring UserNameAndSid(const Captured_t<SidInfo_t>& user);
+
+	/// <summary>
+	/// Write a window station's or desktop's security descriptor in the configured format; writes nothing if
+	/// security descriptors weren't requested.
+	/// </summary>
+	void RenderSecurityDescriptor(std::wostream& sOut, const SecurityDescriptorSnapshot_t& sdSnapshot, bool bWindowStation, size_t indent) const;
+
+	/// <summary>
+	/// Process-wide cache of rendered security descriptors, shared by all renderers and, with --watch, all samples.
+	/// </summary>
+	static SecDescRenderCache& SecDescCache();
+
+private:
+	bool ShowField(FieldSet_t fields) const { return 0 != (m_options.fields & fields); }
+	void RenderToken(std::wostream& sOut, const TokenSnapshot_t& token) const;
+	void RenderDesktopWindows(std::wostream& sOut, const Captured_t<WindowSnapshotList_t>& windows) const;
+	void RenderUsageGroup(std::wostream& sOut, const std::wstring& sLabel, const UsageGroup_t& group, const ProcessUsageTable& table) const;
+	void RenderSecurityDescriptorText(std::wostream& sOut, const SecurityDescriptorSnapshot_t& sdSnapshot, bool bWindowStation, size_t indent) const;
+
+private:
+	const TextRenderOptions_t m_options;
+};
@@ -0,0 +1,194 @@
+// Timings.cpp: wall time per collection phase, and call counts and cumulative latency per Win32 API, for --timings.
+
+#include "Timings.h"
+
+#ifndef TSSESSIONS_DISABLE_TIMINGS
+
+#include <iomanip>
+
+// Zero-initialized as statics
+Timings::Counter_t Timings::st_phases[(size_t)TimingPhase_t::Count];
+Timings::Counter_t Timings::st_apis[(size_t)TimedApi_t::Count];
+
+/// <summary>
+/// Add one completed phase
+/// </summary>
+void Timings::AddPhase(TimingPhase_t phase, uint64_t nanoseconds)
+{
+	Counter_t& counter = st_phases[(size_t)phase];
+	counter.count.fetch_add(1, std::memory_order_relaxed);
+	counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Add one completed API call
+/// </summary>
+void Timings::AddApiCall(TimedApi_t api, uint64_t nanoseconds)
+{
+	Counter_t& counter = st_apis[(size_t)api];
+	counter.count.fetch_add(1, std::memory_order_relaxed);
+	counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Zero all counters
+/// </summary>
+void Timings::Reset()
+{
+	for (size_t ix = 0; ix < (size_t)TimingPhase_t::Count; ++ix)
+	{
+		st_phases[ix].count = 0;
+		st_phases[ix].nanoseconds = 0;
+	}
+	for (size_t ix = 0; ix < (size_t)TimedApi_t::Count; ++ix)
+	{
+		st_apis[ix].count = 0;
+		st_apis[ix].nanoseconds = 0;
+	}
+}
+
+const wchar_t* Timings::PhaseName(TimingPhase_t phase)
+{
+	switch (phase)
+	{
+	case TimingPhase_t::CurrentInfo: return L"CurrentInfo";
+	case TimingPhase_t::Sessions: return L"Sessions";
+	case TimingPhase_t::Tokens: return L"Tokens";
+	case TimingPhase_t::Processes: return L"Processes";
+	case TimingPhase_t::WindowStations: return L"WindowStations";
+	case TimingPhase_t::Desktops: return L"Desktops";
+	case TimingPhase_t::Windows: return L"Windows";
+	case TimingPhase_t::SecurityDescriptors: return L"SecurityDescriptors";
+	case TimingPhase_t::SidNames: return L"SidNames";
+	case TimingPhase_t::Count: break;
+	}
+	return L"[unexpected]";
+}
+
+const wchar_t* Timings::ApiName(TimedApi_t api)
+{
+	switch (api)
+	{
+	case TimedApi_t::WTSEnumerateSessions: return L"WTSEnumerateSessionsW";
+	case TimedApi_t::WTSQuerySessionInformation: return L"WTSQuerySessionInformationW";
+	case TimedApi_t::WTSQueryUserToken: return L"WTSQueryUserToken";
+	case TimedApi_t::WTSEnumerateProcessesEx: return L"WTSEnumerateProcessesExW";
+	case TimedApi_t::OpenProcess: return L"OpenProcess";
+	case TimedApi_t::NtQuerySystemInformation: return L"NtQuerySystemInformation";
+	case TimedApi_t::GetModuleFileNameEx: return L"GetModuleFileNameExW";
+	case TimedApi_t::GetTokenInformation: return L"GetTokenInformation";
+	case TimedApi_t::LookupAccountSid: return L"LookupAccountSidW";
+	case TimedApi_t::LsaLookupSids2: return L"LsaLookupSids2";
+	case TimedApi_t::EnumWindowStations: return L"EnumWindowStationsW";
+	case TimedApi_t::OpenWindowStation: return L"OpenWindowStationW";
+	case TimedApi_t::SetProcessWindowStation: return L"SetProcessWindowStation";
+	case TimedApi_t::EnumDesktops: return L"EnumDesktopsW";
+	case TimedApi_t::OpenDesktop: return L"OpenDesktopW";
+	case TimedApi_t::OpenInputDesktop: return L"OpenInputDesktop";
+	case TimedApi_t::SetThreadDesktop: return L"SetThreadDesktop";
+	case TimedApi_t::GetUserObjectInformation: return L"GetUserObjectInformationW";
+	case TimedApi_t::GetUserObjectSecurity: return L"GetUserObjectSecurity";
+	case TimedApi_t::EnumWindows: return L"EnumWindows";
+	case TimedApi_t::Count: break;
+	}
+	return L"[unexpected]";
+}
+
+/// <summary>
+/// Internal helper: nanoseconds as milliseconds (or microseconds) with three decimal places
+/// </summary>
+static std::wostream& WriteDuration(std::wostream& sOut, uint64_t nanoseconds, int width, bool bMicroseconds = false)
+{
+	return sOut << std::right << std::fixed << std::setprecision(3) << std::setw(width) << (double)nanoseconds / (bMicroseconds ? 1000.0 : 1000000.0);
+}
+
+/// <summary>
+/// Write the counters as a human-readable table
+/// </summary>
+void Timings::WriteText(std::wostream& sOut)
+{
+	std::ios_base::fmtflags flags = sOut.flags();
+	std::streamsize precision = sOut.precision();
+
+	sOut
+		<< L"Timings (phases nest, and per-session phases are summed across worker threads):" << std::endl
+		<< std::endl
+		<< L"    " << std::left << std::setw(30) << L"Phase" << std::right << std::setw(10) << L"Count" << std::setw(14) << L"Total ms" << std::endl;
+	for (size_t ix = 0; ix < (size_t)TimingPhase_t::Count; ++ix)
+	{
+		uint64_t count = st_phases[ix].count;
+		if (0 == count)
+			continue;
+		sOut << L"    " << std::left << std::setw(30) << PhaseName((TimingPhase_t)ix) << std::right << std::setw(10) << count;
+		WriteDuration(sOut, st_phases[ix].nanoseconds, 14) << std::endl;
+	}
+	sOut
+		<< std::endl
+		<< L"    " << std::left << std::setw(30) << L"Win32 API" << std::right << std::setw(10) << L"Calls" << std::setw(14) << L"Total ms" << std::setw(14) << L"Average us" << std::endl;
+	for (size_t ix = 0; ix < (size_t)TimedApi_t::Count; ++ix)
+	{
+		uint64_t count = st_apis[ix].count;
+		if (0 == count)
+			continue;
+		uint64_t nanoseconds = st_apis[ix].nanoseconds;
+		sOut << L"    " << std::left << std::setw(30) << ApiName((TimedApi_t)ix) << std::right << std::setw(10) << count;
+		WriteDuration(sOut, nanoseconds, 14);
+		WriteDuration(sOut, nanoseconds / count, 14, true) << std::endl;
+	}
+	sOut << std::endl;
+
+	sOut.flags(flags);
+	sOut.precision(precision);
+}
+
+/// <summary>
+/// Write the counters as a JSON object, with the counters of the caches in effect.
+/// Phases and APIs that were never entered are omitted.
+/// </summary>
+void Timings::WriteJson(std::wostream& sOut, const CacheCountersList_t& caches)
+{
+	std::ios_base::fmtflags flags = sOut.flags();
+	std::streamsize precision = sOut.precision();
+
+	// Names are fixed ASCII identifiers, so nothing needs escaping.
+	bool bFirst = true;
+	sOut << L"{" << std::endl << L"  \"phases\": [";
+	for (size_t ix = 0; ix < (size_t)TimingPhase_t::Count; ++ix)
+	{
+		uint64_t count = st_phases[ix].count;
+		if (0 == count)
+			continue;
+		sOut << (bFirst ? L"" : L",") << std::endl
+			<< L"    { \"name\": \"" << PhaseName((TimingPhase_t)ix) << L"\", \"count\": " << count << L", \"totalMs\": ";
+		WriteDuration(sOut, st_phases[ix].nanoseconds, 0) << L" }";
+		bFirst = false;
+	}
+	sOut << std::endl << L"  ]," << std::endl << L"  \"apis\": [";
+	bFirst = true;
+	for (size_t ix = 0; ix < (size_t)TimedApi_t::Count; ++ix)
+	{
+		uint64_t count = st_apis[ix].count;
+		if (0 == count)
+			continue;
+		sOut << (bFirst ? L"" : L",") << std::endl
+			<< L"    { \"name\": \"" << ApiName((TimedApi_t)ix) << L"\", \"calls\": " << count << L", \"totalMs\": ";
+		WriteDuration(sOut, st_apis[ix].nanoseconds, 0) << L" }";
+		bFirst = false;
+	}
+	sOut << std::endl << L"  ]," << std::endl << L"  \"caches\": [";
+	bFirst = true;
+	CacheCountersList_t::const_iterator cacheIter;
+	for (cacheIter = caches.begin(); cacheIter != caches.end(); cacheIter++)
+	{
+		sOut << (bFirst ? L"" : L",") << std::endl
+			<< L"    { \"name\": \"" << cacheIter->szName << L"\", \"hits\": " << cacheIter->hits << L", \"misses\": " << cacheIter->misses
+			<< L", \"timeouts\": " << cacheIter->timeouts << L", \"entries\": " << cacheIter->entries << L" }";
+		bFirst = false;
+	}
+	sOut << std::endl << L"  ]" << std::endl << L"}" << std::endl;
+
+	sOut.flags(flags);
+	sOut.precision(precision);
+}
+
+#endif
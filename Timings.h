@@ -0,0 +1,191 @@
+#pragma once
+
+// Timings.h: wall time per collection phase, and call counts and cumulative latency per Win32 API, for --timings.
+// Portable C++ (no Windows dependencies).
+//
+// Instrument code with the TIMING_PHASE and TIMED_CALL macros. Defining TSSESSIONS_DISABLE_TIMINGS compiles the
+// instrumentation out entirely: the macros expand to nothing (or to the bare call), and the Timings class isn't declared.
+
+#ifndef TSSESSIONS_DISABLE_TIMINGS
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+/// <summary>
+/// Collection phases. Phases nest (e.g., Tokens within Sessions, Windows within Desktops), and phases that run
+/// on worker threads are summed across threads, so the totals aren't additive.
+/// </summary>
+enum class TimingPhase_t : uint32_t
+{
+	CurrentInfo,
+	Sessions,
+	Tokens,
+	Processes,
+	WindowStations,
+	Desktops,
+	Windows,
+	SecurityDescriptors,
+	SidNames,
+	Count
+};
+
+/// <summary>
+/// Instrumented Win32 APIs
+/// </summary>
+enum class TimedApi_t : uint32_t
+{
+	WTSEnumerateSessions,
+	WTSQuerySessionInformation,
+	WTSQueryUserToken,
+	WTSEnumerateProcessesEx,
+	OpenProcess,
+	NtQuerySystemInformation,
+	GetModuleFileNameEx,
+	GetTokenInformation,
+	LookupAccountSid,
+	LsaLookupSids2,
+	EnumWindowStations,
+	OpenWindowStation,
+	SetProcessWindowStation,
+	EnumDesktops,
+	OpenDesktop,
+	OpenInputDesktop,
+	SetThreadDesktop,
+	GetUserObjectInformation,
+	GetUserObjectSecurity,
+	EnumWindows,
+	Count
+};
+
+/// <summary>
+/// Process-wide timing counters. All members are static and thread-safe.
+/// </summary>
+class Timings
+{
+public:
+	/// <summary>
+	/// Add one completed phase
+	/// </summary>
+	static void AddPhase(TimingPhase_t phase, uint64_t nanoseconds);
+
+	/// <summary>
+	/// Add one completed API call
+	/// </summary>
+	static void AddApiCall(TimedApi_t api, uint64_t nanoseconds);
+
+	/// <summary>
+	/// Time one API call. Only the clock and atomic counters are touched afterward, so the thread's
+	/// last-error value is still the API's when this returns.
+	/// </summary>
+	template <typename Call_t>
+	static auto Call(TimedApi_t api, Call_t call) -> decltype(call())
+	{
+		ApiTimer timer(api);
+		return call();
+	}
+
+	/// <summary>
+	/// Zero all counters
+	/// </summary>
+	static void Reset();
+
+	/// <summary>
+	/// Write the counters as a human-readable table
+	/// </summary>
+	static void WriteText(std::wostream& sOut);
+
+	/// <summary>
+	/// Counters of a cache that the timings depend on (e.g., the SID name cache), reported alongside them
+	/// </summary>
+	struct CacheCounters_t
+	{
+		// Fixed ASCII identifier
+		const wchar_t* szName;
+		uint64_t hits;
+		uint64_t misses;
+		// Lookups that gave up waiting; 0 for caches without a deadline
+		uint64_t timeouts;
+		// Entries currently cached
+		uint64_t entries;
+	};
+	typedef std::vector<CacheCounters_t> CacheCountersList_t;
+
+	/// <summary>
+	/// Write the counters as a JSON object, with the counters of the caches in effect
+	/// </summary>
+	static void WriteJson(std::wostream& sOut, const CacheCountersList_t& caches);
+
+	static const wchar_t* PhaseName(TimingPhase_t phase);
+	static const wchar_t* ApiName(TimedApi_t api);
+
+public:
+	/// <summary>
+	/// Times the enclosing scope as one phase
+	/// </summary>
+	class PhaseTimer
+	{
+	public:
+		explicit PhaseTimer(TimingPhase_t phase) : m_phase(phase), m_start(std::chrono::steady_clock::now()) {}
+		~PhaseTimer() { AddPhase(m_phase, Elapsed(m_start)); }
+	private:
+		const TimingPhase_t m_phase;
+		const std::chrono::steady_clock::time_point m_start;
+	private:
+		// Not implemented
+		PhaseTimer(const PhaseTimer&) = delete;
+		PhaseTimer& operator = (const PhaseTimer&) = delete;
+	};
+
+	/// <summary>
+	/// Times the enclosing scope as one API call
+	/// </summary>
+	class ApiTimer
+	{
+	public:
+		explicit ApiTimer(TimedApi_t api) : m_api(api), m_start(std::chrono::steady_clock::now()) {}
+		~ApiTimer() { AddApiCall(m_api, Elapsed(m_start)); }
+	private:
+		const TimedApi_t m_api;
+		const std::chrono::steady_clock::time_point m_start;
+	private:
+		// Not implemented
+		ApiTimer(const ApiTimer&) = delete;
+		ApiTimer& operator = (const ApiTimer&) = delete;
+	};
+
+private:
+	static uint64_t Elapsed(const std::chrono::steady_clock::time_point& start)
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	struct Counter_t
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> nanoseconds;
+	};
+	static Counter_t st_phases[(size_t)TimingPhase_t::Count];
+	static Counter_t st_apis[(size_t)TimedApi_t::Count];
+
+private:
+	// Not implemented
+	Timings() = delete;
+};
+
+#define TIMING_CONCAT_INNER(a, b) a##b
+#define TIMING_CONCAT(a, b) TIMING_CONCAT_INNER(a, b)
+
+// Time the rest of the enclosing scope as a TimingPhase_t phase, e.g., TIMING_PHASE(Sessions);
+#define TIMING_PHASE(phase) Timings::PhaseTimer TIMING_CONCAT(phaseTimer_, __LINE__)(TimingPhase_t::phase)
+// Time one Win32 API call and yield its result, e.g., TIMED_CALL(OpenDesktop, OpenDesktopW(...))
+#define TIMED_CALL(api, call) (Timings::Call(TimedApi_t::api, [&]() { return (call); }))
+
+#else
+
+#define TIMING_PHASE(phase)
+#define TIMED_CALL(api, call) (call)
+
+#endif
@@ -1,5 +1,6 @@
 #include "Token.h"
 #include "SysErrorMessage.h"
+#include "Timings.h"
 #include <sstream>
 
 /// <summary>
@@ -16,7 +17,7 @@ bool Token::GetTokenInfo(HANDLE hToken, TokenInfo_t& tokenInfo, std::wstring& sE
 	DWORD dwLen = sizeof(pBuffer), dwReturnLength = 0;
 	std::wstringstream strErrorInfo;
 
-	if (GetTokenInformation(hToken, TokenUser, pBuffer, dwLen, &dwReturnLength))
+	if (TIMED_CALL(GetTokenInformation, GetTokenInformation(hToken, TokenUser, pBuffer, dwLen, &dwReturnLength)))
 	{
 		PTOKEN_USER pTokInfo = (PTOKEN_USER)pBuffer;
 		tokenInfo.sid = CSid(pTokInfo->User.Sid);
@@ -26,7 +27,7 @@ bool Token::GetTokenInfo(HANDLE hToken, TokenInfo_t& tokenInfo, std::wstring& sE
 		strErrorInfo << SysErrorMessageWithCode();
 	}
 
-	if (GetTokenInformation(hToken, TokenStatistics, pBuffer, dwLen, &dwReturnLength))
+	if (TIMED_CALL(GetTokenInformation, GetTokenInformation(hToken, TokenStatistics, pBuffer, dwLen, &dwReturnLength)))
 	{
 		PTOKEN_STATISTICS pTokInfo = (PTOKEN_STATISTICS)pBuffer;
 		tokenInfo.logonSession = pTokInfo->AuthenticationId;
@@ -36,7 +37,7 @@ bool Token::GetTokenInfo(HANDLE hToken, TokenInfo_t& tokenInfo, std::wstring& sE
 		strErrorInfo << SysErrorMessageWithCode();
 	}
 
-	if (GetTokenInformation(hToken, TokenIntegrityLevel, pBuffer, dwLen, &dwReturnLength))
+	if (TIMED_CALL(GetTokenInformation, GetTokenInformation(hToken, TokenIntegrityLevel, pBuffer, dwLen, &dwReturnLength)))
 	{
 		PTOKEN_MANDATORY_LABEL pTokInfo = (PTOKEN_MANDATORY_LABEL)pBuffer;
 		tokenInfo.integrityLevel = *GetSidSubAuthority(pTokInfo->Label.Sid, (DWORD)(UCHAR)(*GetSidSubAuthorityCount(pTokInfo->Label.Sid) - 1));
@@ -64,7 +65,7 @@ bool Token::GetLinkedToken(HANDLE hToken, HANDLE& hLinkedToken)
 	hLinkedToken = NULL;
 	DWORD dwLength = sizeof(TOKEN_LINKED_TOKEN);
 	TOKEN_LINKED_TOKEN linkedToken = { 0 };
-	if (GetTokenInformation(hToken, TokenLinkedToken, &linkedToken, dwLength, &dwLength))
+	if (TIMED_CALL(GetTokenInformation, GetTokenInformation(hToken, TokenLinkedToken, &linkedToken, dwLength, &dwLength)))
 	{
 		hLinkedToken = linkedToken.LinkedToken;
 		return true;
@@ -87,7 +88,7 @@ bool Token::GetHighestToken(HANDLE& hToken)
 	DWORD dwLength = sizeof(TOKEN_ELEVATION_TYPE);
 	TOKEN_ELEVATION_TYPE elevType;
 	// Determine the input token's elevation type
-	if (GetTokenInformation(hToken, TokenElevationType, &elevType, dwLength, &dwLength))
+	if (TIMED_CALL(GetTokenInformation, GetTokenInformation(hToken, TokenElevationType, &elevType, dwLength, &dwLength)))
 	{
 		// If the input token is the limited one of a pair, get the other one.
 		if (TokenElevationTypeLimited == elevType)
@@ -0,0 +1,432 @@
+// WellKnownSids.cpp: built-in table of well-known SIDs, looked up through a compile-time perfect hash.
+
+#include "WellKnownSids.h"
+#include "SidCodec.h"
+
+using namespace WellKnownSids;
+
+// ------------------------------------------------------------------------------------------
+// The table
+
+// Most subauthorities of any SID in the table
+static const size_t MaxEntrySubAuthorities = 6;
+
+struct Entry_t
+{
+	// Identifier authority; all well-known authorities fit in a byte
+	uint8_t authority;
+	uint8_t subAuthorityCount;
+	uint32_t subAuthorities[MaxEntrySubAuthorities];
+	Category_t category;
+	const wchar_t* szDomainName;
+	const wchar_t* szUserName;
+};
+
+static constexpr const wchar_t* szNtAuthority = L"NT AUTHORITY";
+static constexpr const wchar_t* szBuiltin = L"BUILTIN";
+static constexpr const wchar_t* szMandatoryLabel = L"Mandatory Label";
+static constexpr const wchar_t* szAppPackageAuthority = L"APPLICATION PACKAGE AUTHORITY";
+
+// Account entries are the well-known RIDs of domain and local accounts, keyed as S-1-5-21-RID: they're matched
+// only against the RID of a five-subauthority S-1-5-21-x-y-z-RID SID, never directly.
+static constexpr Entry_t Entries[] = {
+	{  0, 1, { 0 },                   Category_t::Universal,    L"",                   L"NULL SID" },
+	{  1, 1, { 0 },                   Category_t::Universal,    L"",                   L"Everyone" },
+	{  2, 1, { 0 },                   Category_t::Universal,    L"",                   L"LOCAL" },
+	{  2, 1, { 1 },                   Category_t::Universal,    L"",                   L"CONSOLE LOGON" },
+	{  3, 1, { 0 },                   Category_t::Universal,    L"",                   L"CREATOR OWNER" },
+	{  3, 1, { 1 },                   Category_t::Universal,    L"",                   L"CREATOR GROUP" },
+	{  3, 1, { 2 },                   Category_t::Universal,    L"",                   L"CREATOR OWNER SERVER" },
+	{  3, 1, { 3 },                   Category_t::Universal,    L"",                   L"CREATOR GROUP SERVER" },
+	{  3, 1, { 4 },                   Category_t::Universal,    L"",                   L"OWNER RIGHTS" },
+
+	{  5, 1, { 1 },                   Category_t::NtAuthority,  szNtAuthority,         L"DIALUP" },
+	{  5, 1, { 2 },                   Category_t::NtAuthority,  szNtAuthority,         L"NETWORK" },
+	{  5, 1, { 3 },                   Category_t::NtAuthority,  szNtAuthority,         L"BATCH" },
+	{  5, 1, { 4 },                   Category_t::NtAuthority,  szNtAuthority,         L"INTERACTIVE" },
+	{  5, 1, { 6 },                   Category_t::NtAuthority,  szNtAuthority,         L"SERVICE" },
+	{  5, 1, { 7 },                   Category_t::NtAuthority,  szNtAuthority,         L"ANONYMOUS LOGON" },
+	{  5, 1, { 8 },                   Category_t::NtAuthority,  szNtAuthority,         L"PROXY" },
+	{  5, 1, { 9 },                   Category_t::NtAuthority,  szNtAuthority,         L"ENTERPRISE DOMAIN CONTROLLERS" },
+	{  5, 1, { 10 },                  Category_t::NtAuthority,  szNtAuthority,         L"SELF" },
+	{  5, 1, { 11 },                  Category_t::NtAuthority,  szNtAuthority,         L"Authenticated Users" },
+	{  5, 1, { 12 },                  Category_t::NtAuthority,  szNtAuthority,         L"RESTRICTED" },
+	{  5, 1, { 13 },                  Category_t::NtAuthority,  szNtAuthority,         L"TERMINAL SERVER USER" },
+	{  5, 1, { 14 },                  Category_t::NtAuthority,  szNtAuthority,         L"REMOTE INTERACTIVE LOGON" },
+	{  5, 1, { 15 },                  Category_t::NtAuthority,  szNtAuthority,         L"This Organization" },
+	{  5, 1, { 17 },                  Category_t::NtAuthority,  szNtAuthority,         L"IUSR" },
+	{  5, 1, { 18 },                  Category_t::NtAuthority,  szNtAuthority,         L"SYSTEM" },
+	{  5, 1, { 19 },                  Category_t::NtAuthority,  szNtAuthority,         L"LOCAL SERVICE" },
+	{  5, 1, { 20 },                  Category_t::NtAuthority,  szNtAuthority,         L"NETWORK SERVICE" },
+	{  5, 1, { 33 },                  Category_t::NtAuthority,  szNtAuthority,         L"WRITE RESTRICTED" },
+	{  5, 1, { 113 },                 Category_t::NtAuthority,  szNtAuthority,         L"Local account" },
+	{  5, 1, { 114 },                 Category_t::NtAuthority,  szNtAuthority,         L"Local account and member of Administrators group" },
+	{  5, 1, { 1000 },                Category_t::NtAuthority,  szNtAuthority,         L"Other Organization" },
+	{  5, 2, { 64, 10 },              Category_t::NtAuthority,  szNtAuthority,         L"NTLM Authentication" },
+	{  5, 2, { 64, 14 },              Category_t::NtAuthority,  szNtAuthority,         L"SChannel Authentication" },
+	{  5, 2, { 64, 21 },              Category_t::NtAuthority,  szNtAuthority,         L"Digest Authentication" },
+	{  5, 2, { 83, 0 },               Category_t::NtAuthority,  L"NT VIRTUAL MACHINE", L"Virtual Machines" },
+	{  5, 2, { 90, 0 },               Category_t::NtAuthority,  L"Window Manager",     L"Window Manager Group" },
+	{  5, 6, { 84, 0, 0, 0, 0, 0 },   Category_t::NtAuthority,  szNtAuthority,         L"USER MODE DRIVERS" },
+	{  5, 2, { 80, 0 },               Category_t::Service,      L"NT SERVICE",         L"ALL SERVICES" },
+
+	{  5, 2, { 32, 544 },             Category_t::Builtin,      szBuiltin,             L"Administrators" },
+	{  5, 2, { 32, 545 },             Category_t::Builtin,      szBuiltin,             L"Users" },
+	{  5, 2, { 32, 546 },             Category_t::Builtin,      szBuiltin,             L"Guests" },
+	{  5, 2, { 32, 547 },             Category_t::Builtin,      szBuiltin,             L"Power Users" },
+	{  5, 2, { 32, 548 },             Category_t::Builtin,      szBuiltin,             L"Account Operators" },
+	{  5, 2, { 32, 549 },             Category_t::Builtin,      szBuiltin,             L"Server Operators" },
+	{  5, 2, { 32, 550 },             Category_t::Builtin,      szBuiltin,             L"Print Operators" },
+	{  5, 2, { 32, 551 },             Category_t::Builtin,      szBuiltin,             L"Backup Operators" },
+	{  5, 2, { 32, 552 },             Category_t::Builtin,      szBuiltin,             L"Replicator" },
+	{  5, 2, { 32, 554 },             Category_t::Builtin,      szBuiltin,             L"Pre-Windows 2000 Compatible Access" },
+	{  5, 2, { 32, 555 },             Category_t::Builtin,      szBuiltin,             L"Remote Desktop Users" },
+	{  5, 2, { 32, 556 },             Category_t::Builtin,      szBuiltin,             L"Network Configuration Operators" },
+	{  5, 2, { 32, 557 },             Category_t::Builtin,      szBuiltin,             L"Incoming Forest Trust Builders" },
+	{  5, 2, { 32, 558 },             Category_t::Builtin,      szBuiltin,             L"Performance Monitor Users" },
+	{  5, 2, { 32, 559 },             Category_t::Builtin,      szBuiltin,             L"Performance Log Users" },
+	{  5, 2, { 32, 560 },             Category_t::Builtin,      szBuiltin,             L"Windows Authorization Access Group" },
+	{  5, 2, { 32, 561 },             Category_t::Builtin,      szBuiltin,             L"Terminal Server License Servers" },
+	{  5, 2, { 32, 562 },             Category_t::Builtin,      szBuiltin,             L"Distributed COM Users" },
+	{  5, 2, { 32, 568 },             Category_t::Builtin,      szBuiltin,             L"IIS_IUSRS" },
+	{  5, 2, { 32, 569 },             Category_t::Builtin,      szBuiltin,             L"Cryptographic Operators" },
+	{  5, 2, { 32, 573 },             Category_t::Builtin,      szBuiltin,             L"Event Log Readers" },
+	{  5, 2, { 32, 574 },             Category_t::Builtin,      szBuiltin,             L"Certificate Service DCOM Access" },
+	{  5, 2, { 32, 575 },             Category_t::Builtin,      szBuiltin,             L"RDS Remote Access Servers" },
+	{  5, 2, { 32, 576 },             Category_t::Builtin,      szBuiltin,             L"RDS Endpoint Servers" },
+	{  5, 2, { 32, 577 },             Category_t::Builtin,      szBuiltin,             L"RDS Management Servers" },
+	{  5, 2, { 32, 578 },             Category_t::Builtin,      szBuiltin,             L"Hyper-V Administrators" },
+	{  5, 2, { 32, 579 },             Category_t::Builtin,      szBuiltin,             L"Access Control Assistance Operators" },
+	{  5, 2, { 32, 580 },             Category_t::Builtin,      szBuiltin,             L"Remote Management Users" },
+	{  5, 2, { 32, 583 },             Category_t::Builtin,      szBuiltin,             L"Device Owners" },
+
+	{  5, 2, { 21, 500 },             Category_t::Account,      L"",                   L"Administrator" },
+	{  5, 2, { 21, 501 },             Category_t::Account,      L"",                   L"Guest" },
+	{  5, 2, { 21, 502 },             Category_t::Account,      L"",                   L"krbtgt" },
+	{  5, 2, { 21, 503 },             Category_t::Account,      L"",                   L"DefaultAccount" },
+	{  5, 2, { 21, 504 },             Category_t::Account,      L"",                   L"WDAGUtilityAccount" },
+	{  5, 2, { 21, 512 },             Category_t::Account,      L"",                   L"Domain Admins" },
+	{  5, 2, { 21, 513 },             Category_t::Account,      L"",                   L"Domain Users" },
+	{  5, 2, { 21, 514 },             Category_t::Account,      L"",                   L"Domain Guests" },
+	{  5, 2, { 21, 515 },             Category_t::Account,      L"",                   L"Domain Computers" },
+	{  5, 2, { 21, 516 },             Category_t::Account,      L"",                   L"Domain Controllers" },
+	{  5, 2, { 21, 517 },             Category_t::Account,      L"",                   L"Cert Publishers" },
+	{  5, 2, { 21, 518 },             Category_t::Account,      L"",                   L"Schema Admins" },
+	{  5, 2, { 21, 519 },             Category_t::Account,      L"",                   L"Enterprise Admins" },
+	{  5, 2, { 21, 520 },             Category_t::Account,      L"",                   L"Group Policy Creator Owners" },
+	{  5, 2, { 21, 521 },             Category_t::Account,      L"",                   L"Read-only Domain Controllers" },
+	{  5, 2, { 21, 522 },             Category_t::Account,      L"",                   L"Cloneable Domain Controllers" },
+	{  5, 2, { 21, 525 },             Category_t::Account,      L"",                   L"Protected Users" },
+	{  5, 2, { 21, 526 },             Category_t::Account,      L"",                   L"Key Admins" },
+	{  5, 2, { 21, 527 },             Category_t::Account,      L"",                   L"Enterprise Key Admins" },
+	{  5, 2, { 21, 553 },             Category_t::Account,      L"",                   L"RAS and IAS Servers" },
+	{  5, 2, { 21, 571 },             Category_t::Account,      L"",                   L"Allowed RODC Password Replication Group" },
+	{  5, 2, { 21, 572 },             Category_t::Account,      L"",                   L"Denied RODC Password Replication Group" },
+
+	{ 15, 2, { 2, 1 },                Category_t::AppPackage,   szAppPackageAuthority, L"ALL APPLICATION PACKAGES" },
+	{ 15, 2, { 2, 2 },                Category_t::AppPackage,   szAppPackageAuthority, L"ALL RESTRICTED APPLICATION PACKAGES" },
+	{ 15, 2, { 3, 1 },                Category_t::Capability,   szAppPackageAuthority, L"Your Internet connection" },
+	{ 15, 2, { 3, 2 },                Category_t::Capability,   szAppPackageAuthority, L"Your Internet connection, including incoming connections from the Internet" },
+	{ 15, 2, { 3, 3 },                Category_t::Capability,   szAppPackageAuthority, L"Your home or work networks" },
+	{ 15, 2, { 3, 4 },                Category_t::Capability,   szAppPackageAuthority, L"Your pictures library" },
+	{ 15, 2, { 3, 5 },                Category_t::Capability,   szAppPackageAuthority, L"Your videos library" },
+	{ 15, 2, { 3, 6 },                Category_t::Capability,   szAppPackageAuthority, L"Your music library" },
+	{ 15, 2, { 3, 7 },                Category_t::Capability,   szAppPackageAuthority, L"Your documents library" },
+	{ 15, 2, { 3, 8 },                Category_t::Capability,   szAppPackageAuthority, L"Your Windows credentials" },
+	{ 15, 2, { 3, 9 },                Category_t::Capability,   szAppPackageAuthority, L"Software and hardware certificates or a smart card" },
+	{ 15, 2, { 3, 10 },               Category_t::Capability,   szAppPackageAuthority, L"Removable storage" },
+
+	{ 16, 1, { 0 },                   Category_t::IntegrityLabel, szMandatoryLabel,    L"Untrusted Mandatory Level" },
+	{ 16, 1, { 4096 },                Category_t::IntegrityLabel, szMandatoryLabel,    L"Low Mandatory Level" },
+	{ 16, 1, { 8192 },                Category_t::IntegrityLabel, szMandatoryLabel,    L"Medium Mandatory Level" },
+	{ 16, 1, { 8448 },                Category_t::IntegrityLabel, szMandatoryLabel,    L"Medium Plus Mandatory Level" },
+	{ 16, 1, { 12288 },               Category_t::IntegrityLabel, szMandatoryLabel,    L"High Mandatory Level" },
+	{ 16, 1, { 16384 },               Category_t::IntegrityLabel, szMandatoryLabel,    L"System Mandatory Level" },
+	{ 16, 1, { 20480 },               Category_t::IntegrityLabel, szMandatoryLabel,    L"Protected Process Mandatory Level" },
+	{ 16, 1, { 28672 },               Category_t::IntegrityLabel, szMandatoryLabel,    L"Secure Process Mandatory Level" },
+};
+
+static const size_t EntryCount = sizeof(Entries) / sizeof(Entries[0]);
+
+// ------------------------------------------------------------------------------------------
+// The perfect hash, computed at compile time by hash-and-displace: each key goes to a bucket by one hash, and
+// each bucket has a seed, found at compile time, for a second hash that puts its keys in empty slots.
+
+static const size_t BucketCount = 64;
+// A power of two, comfortably more than EntryCount so that seeds are found quickly
+static const size_t SlotCount = 256;
+// Upper bound on the search for a bucket's seed; reaching it means the table has duplicate keys.
+static const uint32_t MaxSeed = 100000;
+
+static_assert(EntryCount < SlotCount && SlotCount <= 256, "Slots hold entry indexes + 1 in a byte");
+
+struct PerfectHash_t
+{
+	// Second-level seed for each bucket; 0 if no seed was found
+	uint32_t seeds[BucketCount];
+	// Entry index + 1 for each slot; 0 if the slot is empty
+	uint8_t slots[SlotCount];
+};
+
+/// <summary>
+/// Internal helper: 32-bit multiply, wrapping. Computed in 64 bits so that it's not an overflow in a constant expression.
+/// </summary>
+static constexpr uint32_t Multiply(uint32_t x, uint32_t y)
+{
+	return (uint32_t)(((uint64_t)x * y) & 0xFFFFFFFF);
+}
+
+/// <summary>
+/// Internal helper: hash of a SID's identifier authority and subauthorities (FNV-1a over 32-bit words, then mixed)
+/// </summary>
+static constexpr uint32_t HashKey(uint32_t seed, uint64_t authority, size_t subAuthorityCount, const uint32_t* subAuthorities)
+{
+	uint32_t hash = 0x811C9DC5 ^ seed;
+	hash = Multiply(hash ^ (uint32_t)(authority & 0xFFFFFFFF), 0x01000193);
+	hash = Multiply(hash ^ (uint32_t)(authority >> 32) ^ ((uint32_t)subAuthorityCount << 16), 0x01000193);
+	for (size_t ix = 0; ix < subAuthorityCount; ++ix)
+		hash = Multiply(hash ^ subAuthorities[ix], 0x01000193);
+	hash ^= hash >> 16;
+	hash = Multiply(hash, 0x85EBCA6B);
+	hash ^= hash >> 13;
+	hash = Multiply(hash, 0xC2B2AE35);
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static constexpr uint32_t HashEntry(uint32_t seed, const Entry_t& entry)
+{
+	return HashKey(seed, entry.authority, entry.subAuthorityCount, entry.subAuthorities);
+}
+
+/// <summary>
+/// Internal: build the perfect hash. Buckets are placed largest first, each with the first seed that puts
+/// all of its keys in distinct empty slots.
+/// </summary>
+static constexpr PerfectHash_t BuildPerfectHash()
+{
+	PerfectHash_t perfectHash = {};
+	size_t bucketOf[EntryCount] = {};
+	size_t bucketSize[BucketCount] = {};
+	for (size_t ixEntry = 0; ixEntry < EntryCount; ++ixEntry)
+	{
+		bucketOf[ixEntry] = HashEntry(0, Entries[ixEntry]) % BucketCount;
+		++bucketSize[bucketOf[ixEntry]];
+	}
+
+	bool bPlaced[BucketCount] = {};
+	for (size_t nPlaced = 0; nPlaced < BucketCount; ++nPlaced)
+	{
+		size_t ixBucket = 0;
+		for (size_t ix = 0; ix < BucketCount; ++ix)
+		{
+			if (!bPlaced[ix] && (bPlaced[ixBucket] || bucketSize[ix] > bucketSize[ixBucket]))
+				ixBucket = ix;
+		}
+		bPlaced[ixBucket] = true;
+		if (0 == bucketSize[ixBucket])
+			continue;
+
+		for (uint32_t seed = 1; seed <= MaxSeed && 0 == perfectHash.seeds[ixBucket]; ++seed)
+		{
+			size_t slotOf[EntryCount] = {};
+			bool bFits = true;
+			for (size_t ixEntry = 0; bFits && ixEntry < EntryCount; ++ixEntry)
+			{
+				if (ixBucket != bucketOf[ixEntry])
+					continue;
+				slotOf[ixEntry] = HashEntry(seed, Entries[ixEntry]) % SlotCount;
+				bFits = (0 == perfectHash.slots[slotOf[ixEntry]]);
+				// Also distinct from the bucket's other keys
+				for (size_t ixOther = 0; bFits && ixOther < ixEntry; ++ixOther)
+					bFits = !(ixBucket == bucketOf[ixOther] && slotOf[ixOther] == slotOf[ixEntry]);
+			}
+			if (bFits)
+			{
+				perfectHash.seeds[ixBucket] = seed;
+				for (size_t ixEntry = 0; ixEntry < EntryCount; ++ixEntry)
+				{
+					if (ixBucket == bucketOf[ixEntry])
+						perfectHash.slots[slotOf[ixEntry]] = (uint8_t)(ixEntry + 1);
+				}
+			}
+		}
+	}
+	return perfectHash;
+}
+
+static constexpr PerfectHash_t PerfectHash = BuildPerfectHash();
+
+/// <summary>
+/// Internal: slot of a key in the perfect hash
+/// </summary>
+static constexpr size_t Slot(uint64_t authority, size_t subAuthorityCount, const uint32_t* subAuthorities)
+{
+	return HashKey(PerfectHash.seeds[HashKey(0, authority, subAuthorityCount, subAuthorities) % BucketCount],
+		authority, subAuthorityCount, subAuthorities) % SlotCount;
+}
+
+/// <summary>
+/// Internal: whether every entry is found in its own slot, i.e., the hash is perfect
+/// </summary>
+static constexpr bool PerfectHashIsValid()
+{
+	for (size_t ixEntry = 0; ixEntry < EntryCount; ++ixEntry)
+	{
+		const Entry_t& entry = Entries[ixEntry];
+		if (entry.subAuthorityCount > MaxEntrySubAuthorities ||
+			ixEntry + 1 != PerfectHash.slots[Slot(entry.authority, entry.subAuthorityCount, entry.subAuthorities)])
+			return false;
+	}
+	return true;
+}
+
+static_assert(PerfectHashIsValid(), "Well-known SID table has duplicate entries");
+
+// ------------------------------------------------------------------------------------------
+
+/// <summary>
+/// Internal: the table entry for a SID, or nullptr
+/// </summary>
+static const Entry_t* FindEntry(uint64_t authority, size_t subAuthorityCount, const uint32_t* subAuthorities)
+{
+	if (subAuthorityCount > MaxEntrySubAuthorities)
+		return nullptr;
+	size_t ixSlot = PerfectHash.slots[Slot(authority, subAuthorityCount, subAuthorities)];
+	if (0 == ixSlot)
+		return nullptr;
+	const Entry_t* pEntry = &Entries[ixSlot - 1];
+	if (pEntry->authority != authority || pEntry->subAuthorityCount != subAuthorityCount)
+		return nullptr;
+	for (size_t ix = 0; ix < subAuthorityCount; ++ix)
+	{
+		if (pEntry->subAuthorities[ix] != subAuthorities[ix])
+			return nullptr;
+	}
+	return pEntry;
+}
+
+/// <summary>
+/// Internal: identify a SID. pEntry is set if the SID (or, for an account, its RID) has a table entry.
+/// </summary>
+static Category_t Identify(const uint8_t* pSid, size_t cbSid, const Entry_t*& pEntry, uint32_t subAuthorities[SidCodec::MaxSubAuthorities])
+{
+	pEntry = nullptr;
+	if (0 == SidCodec::BinaryLength(pSid, cbSid))
+		return Category_t::None;
+	uint64_t authority = 0;
+	for (size_t ix = 2; ix < 8; ++ix)
+		authority = (authority << 8) | pSid[ix];
+	const size_t subAuthorityCount = pSid[1];
+	for (size_t ix = 0; ix < subAuthorityCount; ++ix)
+	{
+		const uint8_t* pSubAuth = pSid + 8 + 4 * ix;
+		subAuthorities[ix] = (uint32_t)pSubAuth[0] | ((uint32_t)pSubAuth[1] << 8) | ((uint32_t)pSubAuth[2] << 16) | ((uint32_t)pSubAuth[3] << 24);
+	}
+
+	pEntry = FindEntry(authority, subAuthorityCount, subAuthorities);
+	if (nullptr != pEntry && Category_t::Account != pEntry->category)
+		return pEntry->category;
+	pEntry = nullptr;
+
+	const uint32_t firstSubAuth = (subAuthorityCount > 0) ? subAuthorities[0] : 0;
+	switch (authority)
+	{
+	case 0:
+	case 1:
+	case 2:
+	case 3:
+		return Category_t::Universal;
+	case 5:
+		if (3 == subAuthorityCount && 5 == firstSubAuth)
+			return Category_t::LogonSession;
+		if (subAuthorityCount > 0 && 21 == firstSubAuth)
+		{
+			// S-1-5-21-x-y-z-RID: look up the RID
+			if (5 == subAuthorityCount)
+			{
+				const uint32_t ridKey[] = { 21, subAuthorities[4] };
+				pEntry = FindEntry(5, 2, ridKey);
+			}
+			return Category_t::Account;
+		}
+		if (subAuthorityCount > 0 && 80 == firstSubAuth)
+			return Category_t::Service;
+		if (subAuthorityCount > 0 && 32 == firstSubAuth)
+			return Category_t::Builtin;
+		return Category_t::NtAuthority;
+	case 15:
+		if (subAuthorityCount > 0 && 2 == firstSubAuth)
+			return Category_t::AppContainer;
+		if (subAuthorityCount > 0 && 3 == firstSubAuth)
+			return Category_t::Capability;
+		return Category_t::None;
+	case 16:
+		return Category_t::IntegrityLabel;
+	default:
+		return Category_t::None;
+	}
+}
+
+/// <summary>
+/// Identify a SID and, if it has one, its canonical name.
+/// </summary>
+bool WellKnownSids::Lookup(const uint8_t* pSid, size_t cbSid, Category_t& category, std::wstring& sDomainName, std::wstring& sUserName)
+{
+	sDomainName.clear();
+	sUserName.clear();
+	const Entry_t* pEntry = nullptr;
+	uint32_t subAuthorities[SidCodec::MaxSubAuthorities] = {};
+	category = Identify(pSid, cbSid, pEntry, subAuthorities);
+	if (nullptr != pEntry)
+	{
+		sDomainName = pEntry->szDomainName;
+		sUserName = pEntry->szUserName;
+	}
+	else if (Category_t::LogonSession == category)
+	{
+		// As LSA names them: NT AUTHORITY\LogonSessionId_x_y
+		sDomainName = szNtAuthority;
+		sUserName = L"LogonSessionId_" + std::to_wstring(subAuthorities[1]) + L"_" + std::to_wstring(subAuthorities[2]);
+	}
+	return Category_t::None != category;
+}
+
+/// <summary>
+/// Category of a SID, without building names
+/// </summary>
+Category_t WellKnownSids::Classify(const uint8_t* pSid, size_t cbSid)
+{
+	const Entry_t* pEntry = nullptr;
+	uint32_t subAuthorities[SidCodec::MaxSubAuthorities] = {};
+	return Identify(pSid, cbSid, pEntry, subAuthorities);
+}
+
+/// <summary>
+/// Whether a SID has the same name on every system.
+/// </summary>
+bool WellKnownSids::IsFixedName(Category_t category)
+{
+	return Category_t::None != category && Category_t::Account != category;
+}
+
+/// <summary>
+/// Every entry of the built-in table, in table order
+/// </summary>
+std::vector<TableEntry_t> WellKnownSids::TableEntries()
+{
+	std::vector<TableEntry_t> entries;
+	for (size_t ixEntry = 0; ixEntry < EntryCount; ++ixEntry)
+	{
+		const Entry_t& entry = Entries[ixEntry];
+		TableEntry_t tableEntry;
+		tableEntry.sSid = L"S-1-" + std::to_wstring(entry.authority);
+		for (size_t ix = 0; ix < entry.subAuthorityCount; ++ix)
+			tableEntry.sSid += L"-" + std::to_wstring(entry.subAuthorities[ix]);
+		tableEntry.category = entry.category;
+		tableEntry.sDomainName = entry.szDomainName;
+		tableEntry.sUserName = entry.szUserName;
+		entries.push_back(tableEntry);
+	}
+	return entries;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// WellKnownSids.h: identifies well-known SIDs (NT AUTHORITY, BUILTIN, logon sessions, services, integrity labels,
+// app packages and capabilities, and the well-known RIDs of domain and local accounts) from a built-in table,
+// without calling LSA. The table is looked up by binary SID through a perfect hash computed at compile time.
+// Names are the canonical English names that LSA returns on English-language systems.
+// Portable C++ (no Windows dependencies).
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace WellKnownSids
+{
+	enum class Category_t
+	{
+		// Not a recognized SID
+		None,
+		// Null, world, local, and creator SIDs (S-1-0 through S-1-3)
+		Universal,
+		// NT AUTHORITY (S-1-5-x), other than those below
+		NtAuthority,
+		// BUILTIN aliases (S-1-5-32-x)
+		Builtin,
+		// Logon session SIDs (S-1-5-5-x-y)
+		LogonSession,
+		// Service SIDs (S-1-5-80-...)
+		Service,
+		// Domain and local accounts and groups (S-1-5-21-...); names vary by system
+		Account,
+		// Mandatory integrity labels (S-1-16-x)
+		IntegrityLabel,
+		// App package groups (S-1-15-2-1, S-1-15-2-2)
+		AppPackage,
+		// App container SIDs (S-1-15-2-...)
+		AppContainer,
+		// Capability SIDs (S-1-15-3-...)
+		Capability,
+	};
+
+	/// <summary>
+	/// Identify a SID and, if it has one, its canonical name.
+	/// </summary>
+	/// <param name="pSid">Input: binary SID</param>
+	/// <param name="cbSid">Input: number of bytes available at pSid</param>
+	/// <param name="category">Output: the SID's category; None if it isn't recognized</param>
+	/// <param name="sDomainName">Output: canonical domain name; empty if none</param>
+	/// <param name="sUserName">Output: canonical name; empty if the SID's name isn't known (e.g., a domain user or a service)</param>
+	/// <returns>true if the SID is recognized</returns>
+	bool Lookup(const uint8_t* pSid, size_t cbSid, Category_t& category, std::wstring& sDomainName, std::wstring& sUserName);
+
+	/// <summary>
+	/// Category of a SID, without building names
+	/// </summary>
+	Category_t Classify(const uint8_t* pSid, size_t cbSid);
+
+	/// <summary>
+	/// Whether a SID has the same name on every system, so that the table's name can stand in for an LSA lookup.
+	/// True for well-known SIDs with canonical names; false for domain and local accounts, whose RIDs are
+	/// well-known but whose names can be changed.
+	/// </summary>
+	bool IsFixedName(Category_t category);
+
+	/// <summary>
+	/// One entry of the built-in table
+	/// </summary>
+	struct TableEntry_t
+	{
+		// The entry's key in string form. Account entries are keyed by RID alone, as S-1-5-21-RID, and match
+		// only the RID of an S-1-5-21-x-y-z-RID SID.
+		std::wstring sSid;
+		Category_t category = Category_t::None;
+		std::wstring sDomainName, sUserName;
+	};
+
+	/// <summary>
+	/// Every entry of the built-in table, in table order (e.g., to check that each one is found)
+	/// </summary>
+	std::vector<TableEntry_t> TableEntries();
+}
@@ -2,13 +2,14 @@
 // WinstaDesktop.cpp: encapsulation of information about window stations and desktops.
 
 #include <Windows.h>
-#include <Psapi.h>
 #include <sstream>
 #include <sddl.h>
 #include "WinstaDesktop.h"
 #include "SysErrorMessage.h"
+#include "TerminalSessions.h"
 #include "HEX.h"
 #include "DbgOut.h"
+#include "Timings.h"
 
 // Ensure that a static singleton instance is initialized early
 static const WindowStation st_OriginalWS(GetProcessWindowStation(), false);
@@ -92,11 +93,11 @@ PVOID UserObject::GetUOInfo(int index, HeapMem& mem, std::wstring& sErrorInfo) c
 
 	DWORD dwDataLength = 0;
 	// Try with a default buffer size; if that fails, create a bigger allocation and try again.
-	if (!GetUserObjectInformationW(GetUOHandle(), index, mem.Get(), dwDefaultSize, &dwDataLength))
+	if (!TIMED_CALL(GetUserObjectInformation, GetUserObjectInformationW(GetUOHandle(), index, mem.Get(), dwDefaultSize, &dwDataLength)))
 	{
 		if (!mem.Alloc(dwDataLength, sErrorInfo))
 			return nullptr;
-		if (!GetUserObjectInformationW(GetUOHandle(), index, mem.Get(), dwDataLength, &dwDataLength))
+		if (!TIMED_CALL(GetUserObjectInformation, GetUserObjectInformationW(GetUOHandle(), index, mem.Get(), dwDataLength, &dwDataLength)))
 		{
 			sErrorInfo = SysErrorMessageWithCode();
 			return nullptr;
@@ -224,13 +225,13 @@ bool UserObject::GetSecurity(SecurityDescriptor& memSecurityDescriptor, SECURITY
 	memSecurityDescriptor.Dealloc();
 	sErrorInfo.clear();
 	DWORD nLenNeeded = 0;
-	BOOL ret = GetUserObjectSecurity(GetUOHandle(), &si, nullptr, 0, &nLenNeeded);
+	BOOL ret = TIMED_CALL(GetUserObjectSecurity, GetUserObjectSecurity(GetUOHandle(), &si, nullptr, 0, &nLenNeeded));
 	DWORD dwLastErr = GetLastError();
 	if (ERROR_INSUFFICIENT_BUFFER == dwLastErr)
 	{
 		if (memSecurityDescriptor.Alloc(nLenNeeded, sErrorInfo))
 		{
-			ret = GetUserObjectSecurity(GetUOHandle(), &si, memSecurityDescriptor.GetSD(), nLenNeeded, &nLenNeeded);
+			ret = TIMED_CALL(GetUserObjectSecurity, GetUserObjectSecurity(GetUOHandle(), &si, memSecurityDescriptor.GetSD(), nLenNeeded, &nLenNeeded));
 			if (ret)
 				return true;
 			else
@@ -373,7 +374,7 @@ bool WindowStation::Open(const wchar_t* szWinSta, DWORD dwDesiredAccess, std::ws
 	sErrorInfo.clear();
 	CloseUOHandle();
 	m_OpenedName = szWinSta;
-	HWINSTA hWinsta = OpenWindowStationW(szWinSta, FALSE, dwDesiredAccess);
+	HWINSTA hWinsta = TIMED_CALL(OpenWindowStation, OpenWindowStationW(szWinSta, FALSE, dwDesiredAccess));
 	if (hWinsta)
 	{
 		AssignUOHandle(m_hObj, hWinsta, true);
@@ -422,7 +423,7 @@ bool WindowStation::AssignThisProcess(std::wstring& sErrorInfo) const
 	if (!this->Name(sName, sForDbgout))
 		sName = L"***Error: " + sForDbgout;
 
-	if (SetProcessWindowStation(m_hObj))
+	if (TIMED_CALL(SetProcessWindowStation, SetProcessWindowStation(m_hObj)))
 	{
 		return true;
 	}
@@ -508,7 +509,7 @@ bool WindowStation::GetDesktops(DesktopList_t& desktopList, std::wstring& sError
 	if (this->AssignThisProcess(sSwitchError))
 	{
 		EnumDesktopProcData_t enumDeskData = { this, &desktopList };
-		retval = (EnumDesktopsW(m_hObj, EnumDesktopProcW, (LPARAM)&enumDeskData) ? true : false);
+		retval = (TIMED_CALL(EnumDesktops, EnumDesktopsW(m_hObj, EnumDesktopProcW, (LPARAM)&enumDeskData)) ? true : false);
 		if (!retval)
 		{
 			sErrorInfo = SysErrorMessageWithCode();
@@ -551,7 +552,7 @@ bool WindowStation::GetDesktopNames(DesktopNameList_t& desktopNameList, std::wst
 {
 	desktopNameList.clear();
 	sErrorInfo.clear();
-	if (EnumDesktopsW(m_hObj, EnumDesktopNamesProcW, (LPARAM)&desktopNameList))
+	if (TIMED_CALL(EnumDesktops, EnumDesktopsW(m_hObj, EnumDesktopNamesProcW, (LPARAM)&desktopNameList)))
 	{
 		return true;
 	}
@@ -597,7 +598,7 @@ bool WindowStation::GetWindowStations(WindowStationList_t& windowStationList, st
 {
 	windowStationList.clear();
 	sErrorInfo.clear();
-	if (EnumWindowStationsW(EnumWindowStationProcW, (LPARAM)&windowStationList))
+	if (TIMED_CALL(EnumWindowStations, EnumWindowStationsW(EnumWindowStationProcW, (LPARAM)&windowStationList)))
 	{
 		return true;
 	}
@@ -633,7 +634,7 @@ bool WindowStation::GetWindowStationNames(WindowStationNameList_t& windowStation
 {
 	windowStationNameList.clear();
 	sErrorInfo.clear();
-	if (EnumWindowStationsW(EnumWindowStationNamesProcW, (LPARAM)&windowStationNameList))
+	if (TIMED_CALL(EnumWindowStations, EnumWindowStationsW(EnumWindowStationNamesProcW, (LPARAM)&windowStationNameList)))
 	{
 		return true;
 	}
@@ -720,7 +721,7 @@ bool Desktop::Open(const wchar_t* szDesktop, DWORD dwDesiredAccess, std::wstring
 		return false;
 		
 	m_OpenedName = szDesktop;
-	HDESK hDesk = OpenDesktopW(szDesktop, 0, FALSE, dwDesiredAccess);
+	HDESK hDesk = TIMED_CALL(OpenDesktop, OpenDesktopW(szDesktop, 0, FALSE, dwDesiredAccess));
 	if (hDesk)
 	{
 		AssignUOHandle(m_hObj, hDesk, true);
@@ -777,7 +778,7 @@ bool Desktop::InitFromInputDesktop(DWORD dwDesiredAccess, std::wstring& sErrorIn
 	sErrorInfo.clear();
 	CloseUOHandle();
 	// OpenInputDesktop: "When you are finished using the handle, call the CloseDesktop function to close it."
-	HDESK hDesk = OpenInputDesktop(0, FALSE, dwDesiredAccess);
+	HDESK hDesk = TIMED_CALL(OpenInputDesktop, OpenInputDesktop(0, FALSE, dwDesiredAccess));
 	if (hDesk)
 	{
 		AssignUOHandle(m_hObj, hDesk, true);
@@ -818,7 +819,7 @@ bool Desktop::SwitchTo(std::wstring& sErrorInfo) const
 bool Desktop::AssignThisThread(std::wstring& sErrorInfo) const
 {
 	sErrorInfo.clear();
-	if (SetThreadDesktop(m_hObj))
+	if (TIMED_CALL(SetThreadDesktop, SetThreadDesktop(m_hObj)))
 	{
 		return true;
 	}
@@ -1017,8 +1018,9 @@ struct ForEnumWinInfo_t
 {
 	HeapMem* pHeapMem;
 	WindowInfoCollection_t* pWindowInfoCollection;
+	bool bProcessPaths;
 };
-static void AddHwndToCollection(HWND hwnd, WindowInfoCollection_t& windowInfoCollection, HeapMem& buffer);
+static void AddHwndToCollection(HWND hwnd, WindowInfoCollection_t& windowInfoCollection, HeapMem& buffer, bool bProcessPaths);
 /// <summary>
 /// Windows enumeration callback function that populates a collection of WindowInfo objects.
 /// </summary>
@@ -1029,7 +1031,7 @@ static BOOL __stdcall EnumWindowsProc_InfoCollection(HWND hwnd, LPARAM lParam)
 	ForEnumWinInfo_t* pParamsForEnum = (ForEnumWinInfo_t*)lParam;
 	HeapMem& buffer = *pParamsForEnum->pHeapMem;
 	WindowInfoCollection_t& windowInfoCollection = *pParamsForEnum->pWindowInfoCollection;
-	AddHwndToCollection(hwnd, windowInfoCollection, buffer);
+	AddHwndToCollection(hwnd, windowInfoCollection, buffer, pParamsForEnum->bProcessPaths);
 	return TRUE;
 }
 
@@ -1040,7 +1042,8 @@ static BOOL __stdcall EnumWindowsProc_InfoCollection(HWND hwnd, LPARAM lParam)
 /// <param name="hwnd">HWND to add</param>
 /// <param name="windowInfoCollection">Collection to populate</param>
 /// <param name="buffer">Buffer pre-allocated for data collection</param>
-static void AddHwndToCollection(HWND hwnd, WindowInfoCollection_t& windowInfoCollection, HeapMem& buffer)
+/// <param name="bProcessPaths">true to look up the image path of the window's process</param>
+static void AddHwndToCollection(HWND hwnd, WindowInfoCollection_t& windowInfoCollection, HeapMem& buffer, bool bProcessPaths)
 {
 	// Early exit if HWND is null.
 	if (NULL == hwnd)
@@ -1063,26 +1066,17 @@ static void AddHwndToCollection(HWND hwnd, WindowInfoCollection_t& windowInfoCol
 			windowInfo.sClassName = (const wchar_t*)buffer.Get();
 		if (GetWindowTextW(hwnd, (wchar_t*)buffer.Get(), dwBufferSize) > 0)
 			windowInfo.sWindowText = (const wchar_t*)buffer.Get();
-		if (0 != windowInfo.PID)
+		if (bProcessPaths && 0 != windowInfo.PID)
 		{
-			HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, windowInfo.PID);
-			if (hProcess && GetModuleFileNameExW(hProcess, NULL, (wchar_t*)buffer.Get(), dwBufferSize) > 0)
-			{
-				windowInfo.sProcessPath = (const wchar_t*)buffer.Get();
-			}
-			else
-			{
-				windowInfo.sProcessPath = SysErrorMessageWithCode();
-				// Clear the error in this thread now
-				SetLastError(0);
-			}
-			if (hProcess) CloseHandle(hProcess);
+			std::wstring sErrorInfo;
+			if (!TerminalSession::GetProcessImagePath(windowInfo.PID, windowInfo.sProcessPath, sErrorInfo))
+				windowInfo.sProcessPath = sErrorInfo;
 		}
 	}
 	windowInfoCollection[hwnd] = windowInfo;
 }
 
-bool Desktop::GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, std::wstring& sErrorInfo)
+bool Desktop::GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, std::wstring& sErrorInfo, bool bProcessPaths /*= true*/)
 {
 	windowInfoCollection.clear();
 	sErrorInfo.clear();
@@ -1096,9 +1090,9 @@ bool Desktop::GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, s
 	std::wstring sSwitchError;
 	if (AssignToWinstaDesktop(bSwitchedWS, bSwitchedDesktop, sSwitchError))
 	{
-		ForEnumWinInfo_t paramsForEnum = { &buffer, &windowInfoCollection };
+		ForEnumWinInfo_t paramsForEnum = { &buffer, &windowInfoCollection, bProcessPaths };
 		SetLastError(0);
-		retval = EnumWindows(EnumWindowsProc_InfoCollection, (LPARAM)&paramsForEnum);
+		retval = TIMED_CALL(EnumWindows, EnumWindows(EnumWindowsProc_InfoCollection, (LPARAM)&paramsForEnum));
 		DWORD dwLastErr = GetLastError();
 		if (retval || ERROR_SUCCESS == dwLastErr)
 		{
@@ -1106,11 +1100,11 @@ bool Desktop::GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, s
 			// If the collection is empty, try to find items to add.
 			if (windowInfoCollection.size() == 0)
 			{
-				AddHwndToCollection(GetForegroundWindow(), windowInfoCollection, buffer);
-				AddHwndToCollection(GetDesktopWindow(), windowInfoCollection, buffer);
-				AddHwndToCollection(FindWindowW(nullptr, nullptr), windowInfoCollection, buffer);
-				AddHwndToCollection(GetShellWindow(), windowInfoCollection, buffer);
-				AddHwndToCollection(GetTopWindow(NULL), windowInfoCollection, buffer);
+				AddHwndToCollection(GetForegroundWindow(), windowInfoCollection, buffer, bProcessPaths);
+				AddHwndToCollection(GetDesktopWindow(), windowInfoCollection, buffer, bProcessPaths);
+				AddHwndToCollection(FindWindowW(nullptr, nullptr), windowInfoCollection, buffer, bProcessPaths);
+				AddHwndToCollection(GetShellWindow(), windowInfoCollection, buffer, bProcessPaths);
+				AddHwndToCollection(GetTopWindow(NULL), windowInfoCollection, buffer, bProcessPaths);
 			}
 		}
 		else
@@ -370,7 +370,14 @@ public:
 	virtual bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override;
 
 	bool GetTopLevelWindows(HwndList_t& hwndList, std::wstring& sErrorInfo);
-	bool GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, std::wstring& sErrorInfo);
+	/// <summary>
+	/// Collect information about the desktop's top-level windows.
+	/// </summary>
+	/// <param name="windowInfoCollection">Output: collection to populate</param>
+	/// <param name="sErrorInfo">Output: error information; can hold a warning on success</param>
+	/// <param name="bProcessPaths">Input: false to leave sProcessPath empty, e.g., if the caller resolves image paths once per process</param>
+	/// <returns>true if successful, false otherwise</returns>
+	bool GetTopLevelWindows(WindowInfoCollection_t& windowInfoCollection, std::wstring& sErrorInfo, bool bProcessPaths = true);
 
 protected:
 	/// <summary>
@@ -0,0 +1,65 @@
+// WorkerPool.cpp: fixed-size pool of worker threads.
+
+#include "WorkerPool.h"
+
+/// <summary>
+/// Create a pool with the specified number of worker threads (at least one is always created).
+/// </summary>
+WorkerPool::WorkerPool(size_t nThreads)
+{
+	if (0 == nThreads)
+		nThreads = 1;
+	m_threads.reserve(nThreads);
+	for (size_t ix = 0; ix < nThreads; ++ix)
+	{
+		m_threads.push_back(std::thread(&WorkerPool::WorkerThreadProc, this));
+	}
+}
+
+/// <summary>
+/// Lets the worker threads finish all queued jobs, then joins them.
+/// </summary>
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStopping = true;
+	}
+	m_cv.notify_all();
+	for (size_t ix = 0; ix < m_threads.size(); ++ix)
+	{
+		m_threads[ix].join();
+	}
+}
+
+/// <summary>
+/// Internal: add a job to the queue and wake a worker.
+/// </summary>
+void WorkerPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+	}
+	m_cv.notify_one();
+}
+
+/// <summary>
+/// Internal: worker thread body; runs jobs until the pool is stopping and the queue is empty.
+/// </summary>
+void WorkerPool::WorkerThreadProc()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this]() { return m_bStopping || !m_jobs.empty(); });
+			if (m_jobs.empty())
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+// WorkerPool.h: a fixed-size pool of worker threads, and a helper that fans a sequence of
+// work items out to the pool and hands the results back in the original sequence order.
+// Uses only the standard library so that it can be exercised off-Windows.
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <iterator>
+#include <utility>
+#include <deque>
+#include <vector>
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Fixed-size pool of worker threads that execute queued jobs in FIFO order.
+/// </summary>
+class WorkerPool
+{
+public:
+	/// <summary>
+	/// Create a pool with the specified number of worker threads (at least one is always created).
+	/// </summary>
+	explicit WorkerPool(size_t nThreads);
+
+	/// <summary>
+	/// Lets the worker threads finish all queued jobs, then joins them.
+	/// </summary>
+	~WorkerPool();
+
+	/// <summary>
+	/// Number of worker threads in the pool.
+	/// </summary>
+	size_t ThreadCount() const { return m_threads.size(); }
+
+	/// <summary>
+	/// Queue a callable for execution on a worker thread.
+	/// </summary>
+	/// <param name="fn">Callable taking no arguments</param>
+	/// <returns>A future that delivers the callable's return value (or the exception it threw)</returns>
+	template <typename Fn_t>
+	std::future<decltype(std::declval<Fn_t&>()())> Submit(Fn_t fn)
+	{
+		typedef decltype(std::declval<Fn_t&>()()) result_t;
+		std::shared_ptr<std::packaged_task<result_t()>> pTask = std::make_shared<std::packaged_task<result_t()>>(std::move(fn));
+		std::future<result_t> result = pTask->get_future();
+		Enqueue([pTask]() { (*pTask)(); });
+		return result;
+	}
+
+private:
+	/// <summary>
+	/// Internal: add a job to the queue and wake a worker.
+	/// </summary>
+	void Enqueue(std::function<void()> job);
+
+	/// <summary>
+	/// Internal: worker thread body; runs jobs until the pool is stopping and the queue is empty.
+	/// </summary>
+	void WorkerThreadProc();
+
+private:
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bStopping = false;
+
+private:
+	// Not implemented
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator = (const WorkerPool&) = delete;
+};
+
+// ------------------------------------------------------------------------------------------
+/// <summary>
+/// Runs work(item) on the pool's worker threads for each item in [first, last), and calls
+/// emit(result) on the calling thread for each result, in the same order as the input sequence.
+/// Each result is emitted as soon as it and all the results before it are available.
+/// The work callable is invoked concurrently and must be safe to call from multiple threads; the jobs share a copy of it.
+/// The items must remain valid until this function returns (e.g., elements of a container).
+/// If work or emit throws, the exception is rethrown only after every job already queued has finished, so no job
+/// outlives the items it refers to. Results not yet emitted are discarded.
+/// </summary>
+template <typename InputIt_t, typename Work_t, typename Emit_t>
+void ForEachOrdered(WorkerPool& pool, InputIt_t first, InputIt_t last, const Work_t& work, Emit_t emit)
+{
+	typedef typename std::iterator_traits<InputIt_t>::value_type item_t;
+	typedef decltype(work(std::declval<const item_t&>())) result_t;
+
+	// Waits on destruction for the jobs whose results haven't been retrieved
+	struct OutstandingJobs_t
+	{
+		std::vector<std::future<result_t>> results;
+		~OutstandingJobs_t()
+		{
+			for (size_t ix = 0; ix < results.size(); ++ix)
+			{
+				if (results[ix].valid())
+					results[ix].wait();
+			}
+		}
+	};
+
+	std::shared_ptr<const Work_t> pWork = std::make_shared<const Work_t>(work);
+	OutstandingJobs_t jobs;
+	for (InputIt_t iter = first; iter != last; ++iter)
+	{
+		const item_t* pItem = &(*iter);
+		jobs.results.push_back(pool.Submit([pWork, pItem]() { return (*pWork)(*pItem); }));
+	}
+	for (size_t ix = 0; ix < jobs.results.size(); ++ix)
+	{
+		emit(jobs.results[ix].get());
+	}
+}
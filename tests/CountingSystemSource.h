@@ -0,0 +1,428 @@
+#pragma once
+
+// CountingSystemSource.h: a SystemSource test double that serves a small fixed system -- two sessions with a few
+// processes, and two window stations with their desktops -- and counts every call made on it, so that tests can
+// assert which queries a collection made and which it skipped. Tests can add and end sessions between samples.
+// Portable C++ (no Windows dependencies).
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "SystemSource.h"
+#include "SidCodec.h"
+
+/// <summary>
+/// SystemSource over a fixed, in-memory system that counts every call
+/// </summary>
+class CountingSystemSource : public SystemSource
+{
+public:
+	/// <summary>
+	/// Number of calls to each query. Sessions can be collected concurrently, so the counters are atomic.
+	/// </summary>
+	struct Counts_t
+	{
+		std::atomic<size_t> nCurrentInfo{ 0 };
+		std::atomic<size_t> nEnumerateSessions{ 0 };
+		std::atomic<size_t> nQuerySessionInfo{ 0 };
+		std::atomic<size_t> nQueryUserToken{ 0 };
+		std::atomic<size_t> nEnumerateProcesses{ 0 };
+		std::atomic<size_t> nProcessImagePath{ 0 };
+		std::atomic<size_t> nLookupSidName{ 0 };
+		std::atomic<size_t> nLookupSidNames{ 0 };
+		// Total number of SIDs passed to LookupSidNames
+		std::atomic<size_t> nSidsLookedUp{ 0 };
+		std::atomic<size_t> nWindowStationNames{ 0 };
+		std::atomic<size_t> nOpenWindowStation{ 0 };
+		std::atomic<size_t> nDesktopNames{ 0 };
+		std::atomic<size_t> nOpenDesktop{ 0 };
+		// SourceUserObject calls, on window stations and desktops together
+		std::atomic<size_t> nFlags{ 0 };
+		std::atomic<size_t> nUser{ 0 };
+		std::atomic<size_t> nSecurity{ 0 };
+		// SourceDesktop calls
+		std::atomic<size_t> nHeapSize{ 0 };
+		std::atomic<size_t> nIsReceivingInput{ 0 };
+		std::atomic<size_t> nTopLevelWindows{ 0 };
+	};
+
+	// SIDs of the fixed system
+	static const wchar_t* SystemSid() { return L"S-1-5-18"; }
+	static const wchar_t* AdministratorsSid() { return L"S-1-5-32-544"; }
+	static const wchar_t* AliceSid() { return L"S-1-5-21-1004336348-1177238915-682003330-1001"; }
+	// A SID whose name can't be resolved
+	static const wchar_t* OrphanSid() { return L"S-1-5-21-1004336348-1177238915-682003330-4242"; }
+
+	CountingSystemSource()
+	{
+		m_names[SystemSid()] = L"NT AUTHORITY\\SYSTEM";
+		m_names[AdministratorsSid()] = L"BUILTIN\\Administrators";
+		m_names[AliceSid()] = L"CONTOSO\\alice";
+
+		SessionSnapshot_t services;
+		services.dwSessionId = 0;
+		services.sName = L"Services";
+		services.state = 4;
+		services.sState = L"Disconnected";
+		m_sessions.push_back(services);
+
+		SessionSnapshot_t console;
+		console.dwSessionId = 1;
+		console.sName = L"Console";
+		console.state = 0;
+		console.sState = L"Active";
+		console.sSessionFlags = L"Unlocked";
+		console.sDomainName = L"CONTOSO";
+		console.sUserName = L"alice";
+		console.logonTime = 133000000000000000LL;
+		m_sessions.push_back(console);
+
+		AddProcess(0, 4, L"System", SystemSid());
+		AddProcess(0, 640, L"services.exe", SystemSid());
+		AddProcess(1, 4200, L"explorer.exe", AliceSid());
+		AddProcess(1, 4300, L"notepad.exe", AliceSid());
+		AddProcess(1, 4400, L"orphan.exe", OrphanSid());
+
+		m_desktops[L"WinSta0"].push_back(L"Default");
+		m_desktops[L"WinSta0"].push_back(L"Winlogon");
+		m_desktops[L"Service-0x0-3e7$"].push_back(L"Default");
+	}
+
+	const Counts_t& Counts() const { return m_counts; }
+
+	// ------------------------------------------------------------------------------------------
+	// Changes to the fixed system
+
+	/// <summary>
+	/// Add a session, or replace the one with the same ID
+	/// </summary>
+	void SetSession(const SessionSnapshot_t& session)
+	{
+		for (size_t ix = 0; ix < m_sessions.size(); ++ix)
+		{
+			if (m_sessions[ix].dwSessionId == session.dwSessionId)
+			{
+				m_sessions[ix] = session;
+				return;
+			}
+		}
+		m_sessions.push_back(session);
+	}
+
+	/// <summary>
+	/// Remove a session and its processes
+	/// </summary>
+	void EndSession(uint32_t dwSessionId)
+	{
+		for (size_t ix = m_sessions.size(); ix-- > 0; )
+		{
+			if (m_sessions[ix].dwSessionId == dwSessionId)
+				m_sessions.erase(m_sessions.begin() + ix);
+		}
+		for (size_t ix = m_processes.size(); ix-- > 0; )
+		{
+			if (m_processSessionIds[ix] == dwSessionId)
+			{
+				m_processSessionIds.erase(m_processSessionIds.begin() + ix);
+				m_processes.erase(m_processes.begin() + ix);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Add a process to a session
+	/// </summary>
+	void AddProcess(uint32_t dwSessionId, uint32_t dwPID, const wchar_t* szName, const wchar_t* szUserSid)
+	{
+		ProcessSnapshot_t process;
+		process.dwPID = dwPID;
+		process.createTime = 133000000000000000LL + dwPID;
+		process.sProcessName = szName;
+		process.user = MakeSid(szUserSid);
+		process.threadCount = 4;
+		process.handleCount = 100 + dwPID % 97;
+		process.workingSetSize = (uint64_t)dwPID * 4096;
+		m_processSessionIds.push_back(dwSessionId);
+		m_processes.push_back(process);
+	}
+
+	/// <summary>
+	/// A SID from its string form
+	/// </summary>
+	static SidInfo_t MakeSid(const wchar_t* szSid)
+	{
+		SidInfo_t sid;
+		std::vector<uint8_t> bytes;
+		SidCodec::Parse(szSid, bytes);
+		sid.Assign(bytes.data(), bytes.size());
+		return sid;
+	}
+
+	/// <summary>
+	/// Self-relative security descriptor with the given owner and group, and no ACLs
+	/// </summary>
+	static std::vector<uint8_t> MakeSecurityDescriptor(const wchar_t* szOwner, const wchar_t* szGroup)
+	{
+		std::vector<uint8_t> owner, group;
+		SidCodec::Parse(szOwner, owner);
+		SidCodec::Parse(szGroup, group);
+		const uint32_t ownerOffset = 20;
+		const uint32_t groupOffset = ownerOffset + (uint32_t)owner.size();
+		// Revision 1; control SE_SELF_RELATIVE; owner, group, SACL, and DACL offsets (little-endian)
+		std::vector<uint8_t> sd = { 1, 0, 0x00, 0x80 };
+		const uint32_t offsets[] = { ownerOffset, groupOffset, 0, 0 };
+		for (size_t ix = 0; ix < 4; ++ix)
+		{
+			for (size_t byteIx = 0; byteIx < 4; ++byteIx)
+				sd.push_back((uint8_t)(offsets[ix] >> (8 * byteIx)));
+		}
+		sd.insert(sd.end(), owner.begin(), owner.end());
+		sd.insert(sd.end(), group.begin(), group.end());
+		return sd;
+	}
+
+	// ------------------------------------------------------------------------------------------
+	// SystemSource
+
+	void CurrentInfo(CurrentInfoSnapshot_t& currentInfo) override
+	{
+		++m_counts.nCurrentInfo;
+		currentInfo = CurrentInfoSnapshot_t();
+		currentInfo.sessionId.Set(1);
+		currentInfo.winstaName.Set(L"WinSta0");
+		currentInfo.winstaUser.Set(MakeSid(AliceSid()));
+		currentInfo.desktopName.Set(L"Default");
+		currentInfo.desktopUser.Set(MakeSid(AliceSid()));
+		currentInfo.runningAs = MakeSid(AliceSid());
+		currentInfo.activeConsoleSessionId = 1;
+	}
+
+	bool EnumerateSessions(SessionSnapshotList_t& sessions, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nEnumerateSessions;
+		sErrorInfo.clear();
+		sessions.clear();
+		for (size_t ix = 0; ix < m_sessions.size(); ++ix)
+		{
+			SessionSnapshot_t session;
+			session.dwSessionId = m_sessions[ix].dwSessionId;
+			session.sName = m_sessions[ix].sName;
+			session.state = m_sessions[ix].state;
+			session.sState = m_sessions[ix].sState;
+			sessions.push_back(session);
+		}
+		return true;
+	}
+
+	bool QuerySessionInfo(uint32_t dwSessionId, SessionSnapshot_t& session, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nQuerySessionInfo;
+		for (size_t ix = 0; ix < m_sessions.size(); ++ix)
+		{
+			if (m_sessions[ix].dwSessionId == dwSessionId)
+			{
+				session = m_sessions[ix];
+				return true;
+			}
+		}
+		sErrorInfo = L"No such session";
+		return false;
+	}
+
+	void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) override
+	{
+		++m_counts.nQueryUserToken;
+		if (1 == dwSessionId)
+		{
+			session.tokenStatus = TokenStatus_t::Retrieved;
+			session.token.user = MakeSid(AliceSid());
+		}
+		else
+		{
+			session.tokenStatus = TokenStatus_t::NoToken;
+		}
+	}
+
+	bool EnumerateProcesses(ProcessTable& processes, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nEnumerateProcesses;
+		sErrorInfo.clear();
+		processes.Clear();
+		for (size_t ix = 0; ix < m_processes.size(); ++ix)
+			processes.Add(m_processSessionIds[ix], m_processes[ix]);
+		return true;
+	}
+
+	bool ProcessImagePath(uint32_t dwPID, std::wstring& sImagePath, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nProcessImagePath;
+		sImagePath = L"C:\\Windows\\process" + std::to_wstring(dwPID) + L".exe";
+		sErrorInfo.clear();
+		return true;
+	}
+
+	bool LookupSidName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) override
+	{
+		++m_counts.nLookupSidName;
+		return FindName(sid, sDomainAndUsername);
+	}
+
+	bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nLookupSidNames;
+		m_counts.nSidsLookedUp += sids.size();
+		sErrorInfo.clear();
+		std::vector<SidInfo_t>::iterator sidIter;
+		for (sidIter = sids.begin(); sidIter != sids.end(); sidIter++)
+		{
+			std::wstring sDomainAndUsername;
+			FindName(*sidIter, sDomainAndUsername);
+			sidIter->SetName(sDomainAndUsername);
+		}
+		return true;
+	}
+
+	bool WindowStationNames(std::vector<std::wstring>& windowStationNames, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nWindowStationNames;
+		sErrorInfo.clear();
+		windowStationNames.clear();
+		DesktopMap_t::const_iterator wsIter;
+		for (wsIter = m_desktops.begin(); wsIter != m_desktops.end(); wsIter++)
+			windowStationNames.push_back(wsIter->first);
+		return true;
+	}
+
+	std::unique_ptr<SourceWindowStation> OpenWindowStation(const std::wstring& sWindowStationName, std::wstring& sErrorInfo) override
+	{
+		++m_counts.nOpenWindowStation;
+		DesktopMap_t::const_iterator wsIter = m_desktops.find(sWindowStationName);
+		if (m_desktops.end() == wsIter)
+		{
+			sErrorInfo = L"No such window station";
+			return nullptr;
+		}
+		return std::unique_ptr<SourceWindowStation>(new WindowStation_t(m_counts, wsIter->second));
+	}
+
+private:
+	typedef std::map<std::wstring, std::vector<std::wstring>> DesktopMap_t;
+
+	// Flags, user, and security descriptor shared by the window stations and desktops
+	template <typename Base_t>
+	class UserObject_t : public Base_t
+	{
+	public:
+		explicit UserObject_t(Counts_t& counts) : m_counts(counts) {}
+
+		bool Flags(std::wstring& sFlags, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nFlags;
+			sFlags = L"Inherit = false";
+			sErrorInfo.clear();
+			return true;
+		}
+		bool User(SidInfo_t& user, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nUser;
+			user = MakeSid(AliceSid());
+			sErrorInfo.clear();
+			return true;
+		}
+		bool Security(std::vector<uint8_t>& sd, uint32_t& securityInformation, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nSecurity;
+			sd = MakeSecurityDescriptor(SystemSid(), AdministratorsSid());
+			// OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION
+			securityInformation = 0x7;
+			sErrorInfo.clear();
+			return true;
+		}
+
+	protected:
+		Counts_t& m_counts;
+	};
+
+	class Desktop_t : public UserObject_t<SourceDesktop>
+	{
+	public:
+		explicit Desktop_t(Counts_t& counts) : UserObject_t<SourceDesktop>(counts) {}
+
+		bool HeapSize(uint32_t& heapSizeKb, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nHeapSize;
+			heapSizeKb = 20480;
+			sErrorInfo.clear();
+			return true;
+		}
+		bool IsReceivingInput(bool& bReceivingInput, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nIsReceivingInput;
+			bReceivingInput = false;
+			sErrorInfo.clear();
+			return true;
+		}
+		bool TopLevelWindows(WindowSnapshotList_t& windows, std::wstring& sErrorInfo) override
+		{
+			++m_counts.nTopLevelWindows;
+			windows.clear();
+			WindowSnapshot_t window;
+			window.hwnd = 0x10010;
+			window.bIsValid = true;
+			window.PID = 4200;
+			window.sClassName = L"Shell_TrayWnd";
+			windows.push_back(window);
+			sErrorInfo.clear();
+			return true;
+		}
+	};
+
+	class WindowStation_t : public UserObject_t<SourceWindowStation>
+	{
+	public:
+		WindowStation_t(Counts_t& counts, const std::vector<std::wstring>& desktopNames)
+			: UserObject_t<SourceWindowStation>(counts), m_desktopNames(desktopNames)
+		{
+		}
+
+		bool DesktopNames(std::vector<std::wstring>& desktopNames, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nDesktopNames;
+			desktopNames = m_desktopNames;
+			sErrorInfo.clear();
+			return true;
+		}
+		std::unique_ptr<SourceDesktop> OpenDesktop(const std::wstring& /*sDesktopName*/, std::wstring& sErrorInfo) const override
+		{
+			++m_counts.nOpenDesktop;
+			sErrorInfo.clear();
+			return std::unique_ptr<SourceDesktop>(new Desktop_t(m_counts));
+		}
+
+	private:
+		std::vector<std::wstring> m_desktopNames;
+	};
+
+	bool FindName(const SidInfo_t& sid, std::wstring& sDomainAndUsername) const
+	{
+		std::map<std::wstring, std::wstring>::const_iterator nameIter = m_names.find(sid.ToString());
+		if (m_names.end() == nameIter)
+		{
+			sDomainAndUsername.clear();
+			return false;
+		}
+		sDomainAndUsername = nameIter->second;
+		return true;
+	}
+
+private:
+	Counts_t m_counts;
+	SessionSnapshotList_t m_sessions;
+	std::vector<uint32_t> m_processSessionIds;
+	ProcessSnapshotList_t m_processes;
+	DesktopMap_t m_desktops;
+	// SID string -> DOMAIN\username
+	std::map<std::wstring, std::wstring> m_names;
+};
@@ -0,0 +1,224 @@
+// PermDecoderTests.cpp: tests of the permission decoding tables -- the names a PermDecoder_t gives an access mask
+// are the ones the greedy scan it replaced outputs, for tables like SecurityDescriptorUtils.cpp's and for random
+// tables.
+
+#include <random>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "PermDecoder.h"
+
+// Copies of SecurityDescriptorUtils.cpp's tables, with the values of the winnt.h constants
+static constexpr perm_t standardMask[] = {
+	{ 0x00010000, L"DELETE" },
+	{ 0x00020000, L"READ_CONTROL" },
+	{ 0x00040000, L"WRITE_DAC" },
+	{ 0x00080000, L"WRITE_OWNER" },
+	{ 0x00100000, L"SYNCHRONIZE" },
+	{ 0x01000000, L"ACCESS_SYSTEM_SECURITY" },
+	{ 0x02000000, L"MAXIMUM_ALLOWED" },
+	{ 0, nullptr } };
+
+static constexpr perm_t genericMask[] = {
+	{ 0x80000000, L"GENERIC_READ" },
+	{ 0x40000000, L"GENERIC_WRITE" },
+	{ 0x20000000, L"GENERIC_EXECUTE" },
+	{ 0x10000000, L"GENERIC_ALL" },
+	{ 0, nullptr } };
+
+static constexpr perm_t standardAndGenericMask[] = {
+	{ 0x00010000, L"DELETE" },
+	{ 0x00020000, L"READ_CONTROL" },
+	{ 0x00040000, L"WRITE_DAC" },
+	{ 0x00080000, L"WRITE_OWNER" },
+	{ 0x00100000, L"SYNCHRONIZE" },
+	{ 0x000F0000, L"STANDARD_RIGHTS_REQUIRED" },
+	{ 0x01000000, L"ACCESS_SYSTEM_SECURITY" },
+	{ 0x02000000, L"MAXIMUM_ALLOWED" },
+	{ 0x80000000, L"GENERIC_READ" },
+	{ 0x40000000, L"GENERIC_WRITE" },
+	{ 0x20000000, L"GENERIC_EXECUTE" },
+	{ 0x10000000, L"GENERIC_ALL" },
+	{ 0, nullptr } };
+
+static constexpr perm_t fileSpecific[] = {
+	{ 0x0001, L"FILE_READ_DATA" },
+	{ 0x0002, L"FILE_WRITE_DATA" },
+	{ 0x0004, L"FILE_APPEND_DATA" },
+	{ 0x0008, L"FILE_READ_EA" },
+	{ 0x0010, L"FILE_WRITE_EA" },
+	{ 0x0020, L"FILE_EXECUTE" },
+	{ 0x0080, L"FILE_READ_ATTRIBUTES" },
+	{ 0x0100, L"FILE_WRITE_ATTRIBUTES" },
+	{ 0, nullptr } };
+
+static constexpr perm_t fileMatch[] = {
+	{ 0x001F01FF, L"FILE_ALL_ACCESS" },
+	{ 0x00120089, L"FILE_GENERIC_READ" },
+	{ 0, nullptr } };
+
+static constexpr perm_t processSpecific[] = {
+	{ 0x0001, L"PROCESS_TERMINATE" },
+	{ 0x0002, L"PROCESS_CREATE_THREAD" },
+	{ 0x0004, L"PROCESS_SET_SESSIONID" },
+	{ 0x0008, L"PROCESS_VM_OPERATION" },
+	{ 0x0010, L"PROCESS_VM_READ" },
+	{ 0x0020, L"PROCESS_VM_WRITE" },
+	{ 0x0040, L"PROCESS_DUP_HANDLE" },
+	{ 0x0080, L"PROCESS_CREATE_PROCESS" },
+	{ 0x0100, L"PROCESS_SET_QUOTA" },
+	{ 0x0200, L"PROCESS_SET_INFORMATION" },
+	{ 0x0400, L"PROCESS_QUERY_INFORMATION" },
+	{ 0x0800, L"PROCESS_SUSPEND_RESUME" },
+	{ 0x1000, L"PROCESS_QUERY_LIMITED_INFORMATION" },
+	{ 0x2000, L"PROCESS_SET_LIMITED_INFORMATION" },
+	{ 0, nullptr } };
+
+// Built at compile time, as SecurityDescriptorUtils.cpp builds its tables
+static constexpr PermDecoder_t fileDecoder = BuildPermDecoder(genericMask, fileSpecific, standardMask, fileMatch);
+static_assert(fileDecoder.bSingleBitNames, "File permission names are single bits");
+
+/// <summary>
+/// Names given to an access mask, and its bits that have none
+/// </summary>
+struct Decoded_t
+{
+	std::vector<std::wstring> names;
+	uint32_t remainder = 0;
+
+	bool operator==(const Decoded_t& other) const { return names == other.names && remainder == other.remainder; }
+};
+
+// Internal helper: the scan that PermDecoder_t replaced. Each array in turn, each entry whose bits are all in the
+// mask is output and its bits removed.
+static Decoded_t GreedyScan(const perm_t* const* scanOrder, size_t nArrays, uint32_t mask)
+{
+	Decoded_t decoded;
+	for (size_t ixArray = 0; ixArray < nArrays; ++ixArray)
+	{
+		for (const perm_t* pPerm = scanOrder[ixArray]; nullptr != pPerm && nullptr != pPerm->szName; pPerm++)
+		{
+			if (pPerm->mask == (pPerm->mask & mask))
+			{
+				decoded.names.push_back(pPerm->szName);
+				mask -= pPerm->mask;
+			}
+		}
+	}
+	decoded.remainder = mask;
+	return decoded;
+}
+
+// Internal helper: the names a decoding table gives an access mask
+static Decoded_t Decode(const PermDecoder_t& decoder, uint32_t mask)
+{
+	Decoded_t decoded;
+	uint32_t nameBits = decoder.NameBits(mask);
+	for (size_t ixName = 0; 0 != nameBits; ++ixName, nameBits >>= 1)
+	{
+		if (0 != (nameBits & 1))
+			decoded.names.push_back(decoder.szNames[ixName]);
+	}
+	decoded.remainder = mask & ~decoder.namedBits;
+	return decoded;
+}
+
+// Internal helper: report each mask for which the decoder and the greedy scan disagree
+static void CheckMatchesGreedyScan(const perm_t* const* scanOrder, const std::vector<uint32_t>& masks)
+{
+	const PermDecoder_t decoder = BuildPermDecoder(scanOrder[0], scanOrder[1], scanOrder[2], nullptr);
+	CHECK(decoder.bSingleBitNames);
+	size_t nMismatches = 0;
+	for (size_t ix = 0; ix < masks.size(); ++ix)
+	{
+		if (!(GreedyScan(scanOrder, 3, masks[ix]) == Decode(decoder, masks[ix])) && nMismatches++ < 5)
+			TestHarness::ReportFailure(__FILE__, __LINE__, "decoded differently: mask " + std::to_string(masks[ix]));
+	}
+}
+
+// Internal helper: every single bit, no bits, all bits, and random masks, dense and sparse
+static std::vector<uint32_t> TestMasks(std::mt19937& random)
+{
+	std::vector<uint32_t> masks;
+	for (size_t ixBit = 0; ixBit < 32; ++ixBit)
+		masks.push_back(1u << ixBit);
+	masks.push_back(0);
+	masks.push_back(0xFFFFFFFF);
+	for (size_t ix = 0; ix < 5000; ++ix)
+	{
+		masks.push_back((uint32_t)random());
+		masks.push_back((uint32_t)(random() & random() & random()));
+	}
+	return masks;
+}
+
+TEST_CASE(PermDecoder_MatchesGreedyScanForObjectTypes)
+{
+	std::mt19937 random(20240601);
+	const std::vector<uint32_t> masks = TestMasks(random);
+	const perm_t* file[] = { genericMask, fileSpecific, standardMask };
+	const perm_t* process[] = { genericMask, processSpecific, standardMask };
+	// STANDARD_RIGHTS_REQUIRED spans bits named before it, so it never matches
+	const perm_t* standard[] = { genericMask, standardAndGenericMask, standardMask };
+	CheckMatchesGreedyScan(file, masks);
+	CheckMatchesGreedyScan(process, masks);
+	CheckMatchesGreedyScan(standard, masks);
+
+	// Names in scan order; unnamed bits left over
+	Decoded_t decoded = Decode(fileDecoder, 0x80120089 | 0x00000400);
+	CHECK_EQUAL((size_t)6, decoded.names.size());
+	CHECK_EQUAL(std::wstring(L"GENERIC_READ"), decoded.names[0]);
+	CHECK_EQUAL(std::wstring(L"FILE_READ_DATA"), decoded.names[1]);
+	CHECK_EQUAL(std::wstring(L"SYNCHRONIZE"), decoded.names[5]);
+	CHECK_EQUAL((uint32_t)0x00000400, decoded.remainder);
+	CHECK(fileDecoder.pPermsMatch == fileMatch);
+}
+
+TEST_CASE(PermDecoder_MatchesGreedyScanForRandomTables)
+{
+	std::mt19937 random(7);
+	const std::vector<uint32_t> masks = TestMasks(random);
+	static const wchar_t* const names[] = { L"A", L"B", L"C", L"D", L"E", L"F", L"G", L"H" };
+	for (size_t ixTable = 0; ixTable < 200; ++ixTable)
+	{
+		// Three arrays of single bits, some repeated across and within arrays, and multi-bit entries made only of
+		// bits already named, which the scan can never match
+		std::vector<perm_t> arrays[3];
+		uint32_t namedBits = 0;
+		for (size_t ixArray = 0; ixArray < 3; ++ixArray)
+		{
+			const size_t nEntries = random() % 12;
+			for (size_t ixEntry = 0; ixEntry < nEntries; ++ixEntry)
+			{
+				perm_t perm = { 1u << (random() % 32), names[random() % 8] };
+				if (0 != namedBits && 0 == random() % 4)
+					perm.mask = namedBits & (uint32_t)random();
+				if (0 == perm.mask)
+					continue;
+				if (0 == (perm.mask & (perm.mask - 1)))
+					namedBits |= perm.mask;
+				arrays[ixArray].push_back(perm);
+			}
+			const perm_t terminator = { 0, nullptr };
+			arrays[ixArray].push_back(terminator);
+		}
+		const perm_t* scanOrder[] = { arrays[0].data(), arrays[1].data(), arrays[2].data() };
+		CheckMatchesGreedyScan(scanOrder, masks);
+	}
+}
+
+TEST_CASE(PermDecoder_DetectsMultiBitNames)
+{
+	// A name whose bits aren't all named before it could match, which the per-bit table can't express
+	static const perm_t overlapping[] = {
+		{ 0x0001, L"ONE" },
+		{ 0x0006, L"TWO_AND_FOUR" },
+		{ 0, nullptr } };
+	CHECK(!BuildPermDecoder(genericMask, overlapping, standardMask, nullptr).bSingleBitNames);
+	static const perm_t zero[] = { { 0, L"NOTHING" }, { 0, nullptr } };
+	CHECK(!BuildPermDecoder(genericMask, zero, standardMask, nullptr).bSingleBitNames);
+	// With no xSpecific array, only the generic and standard rights are named
+	const PermDecoder_t decoder = BuildPermDecoder(genericMask, nullptr, standardMask, nullptr);
+	CHECK(decoder.bSingleBitNames);
+	CHECK_EQUAL((uint32_t)0xF31F0000, decoder.namedBits);
+}
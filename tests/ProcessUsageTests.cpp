@@ -0,0 +1,199 @@
+// ProcessUsageTests.cpp: tests of the --usage rollups and the --top ranking and sampling math.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "TestHarness.h"
+#include "ProcessUsage.h"
+#include "SidCodec.h"
+
+// Internal helper: a process with the given usage
+static ProcessSnapshot_t MakeProcess(uint32_t dwPID, const wchar_t* szUserSid, uint64_t workingSetSize, uint32_t handleCount, int64_t userTime, int64_t kernelTime)
+{
+	ProcessSnapshot_t process;
+	process.dwPID = dwPID;
+	process.createTime = 1000 + dwPID;
+	std::vector<uint8_t> userSid;
+	SidCodec::Parse(szUserSid, userSid);
+	process.user.Assign(userSid.data(), userSid.size());
+	process.threadCount = 2;
+	process.handleCount = handleCount;
+	process.workingSetSize = workingSetSize;
+	process.pagefileUsage = workingSetSize / 2;
+	process.userTime = userTime;
+	process.kernelTime = kernelTime;
+	return process;
+}
+
+// Internal helper: PIDs of a group's heaviest processes, heaviest first
+static std::vector<uint32_t> TopPids(const ProcessUsageTable& table, const UsageGroup_t& group)
+{
+	std::vector<uint32_t> pids;
+	for (size_t ix = 0; ix < group.top.size(); ++ix)
+		pids.push_back(table.Processes()[group.top[ix]].pProcess->dwPID);
+	return pids;
+}
+
+// Two sessions, two users
+static SessionSnapshotList_t SampleSessions()
+{
+	const wchar_t* szSystem = L"S-1-5-18";
+	const wchar_t* szAlice = L"S-1-5-21-1-2-3-1001";
+	SessionSnapshotList_t sessions(2);
+	sessions[0].dwSessionId = 0;
+	sessions[0].processes.value.push_back(MakeProcess(4, szSystem, 100, 3000, 50, 900));
+	sessions[0].processes.value.push_back(MakeProcess(640, szSystem, 800, 700, 200, 300));
+	sessions[1].dwSessionId = 1;
+	sessions[1].processes.value.push_back(MakeProcess(4200, szAlice, 5000, 900, 4000, 1000));
+	sessions[1].processes.value.push_back(MakeProcess(4300, szAlice, 300, 200, 10, 10));
+	sessions[1].processes.value.push_back(MakeProcess(4400, szSystem, 900, 700, 500, 0));
+	return sessions;
+}
+
+TEST_CASE(ProcessUsage_Totals)
+{
+	SessionSnapshotList_t sessions = SampleSessions();
+	ProcessUsageTable table;
+	table.Load(sessions);
+	CHECK_EQUAL((size_t)5, table.Processes().size());
+	CHECK_EQUAL((size_t)2, table.UserCount());
+	CHECK_EQUAL(std::wstring(L"S-1-5-18"), table.User(0).ToString());
+
+	UsageRollup_t rollup;
+	table.RollUp(UsageMetric_t::WorkingSet, 0, rollup);
+	CHECK_EQUAL((uint64_t)5, rollup.all.totals.nProcesses);
+	CHECK_EQUAL((uint64_t)7100, rollup.all.totals.workingSetSize);
+	CHECK_EQUAL((uint64_t)5500, rollup.all.totals.handleCount);
+	CHECK_EQUAL((int64_t)4760, rollup.all.totals.userTime);
+	CHECK_EQUAL((int64_t)2210, rollup.all.totals.kernelTime);
+	// nTop 0: totals only
+	CHECK(rollup.all.top.empty());
+
+	CHECK_EQUAL((size_t)2, rollup.sessions.size());
+	CHECK_EQUAL((uint32_t)1, rollup.sessions[1].key);
+	CHECK_EQUAL((uint64_t)3, rollup.sessions[1].totals.nProcesses);
+	CHECK_EQUAL((uint64_t)6200, rollup.sessions[1].totals.workingSetSize);
+
+	CHECK_EQUAL((size_t)2, rollup.users.size());
+	// SYSTEM has processes in both sessions
+	CHECK_EQUAL((uint64_t)3, rollup.users[0].totals.nProcesses);
+	CHECK_EQUAL((uint64_t)1800, rollup.users[0].totals.workingSetSize);
+}
+
+TEST_CASE(ProcessUsage_TopByEachMetric)
+{
+	SessionSnapshotList_t sessions = SampleSessions();
+	ProcessUsageTable table;
+	table.Load(sessions);
+	UsageRollup_t rollup;
+
+	table.RollUp(UsageMetric_t::Cpu, 3, rollup);
+	CHECK(TopPids(table, rollup.all) == std::vector<uint32_t>({ 4200, 4, 640 }));
+	CHECK(TopPids(table, rollup.sessions[1]) == std::vector<uint32_t>({ 4200, 4400, 4300 }));
+	CHECK(TopPids(table, rollup.users[0]) == std::vector<uint32_t>({ 4, 640, 4400 }));
+
+	table.RollUp(UsageMetric_t::WorkingSet, 2, rollup);
+	CHECK(TopPids(table, rollup.all) == std::vector<uint32_t>({ 4200, 4400 }));
+	CHECK(TopPids(table, rollup.sessions[0]) == std::vector<uint32_t>({ 640, 4 }));
+
+	// 640 and 4400 tie on handles; the earlier in the table ranks first
+	table.RollUp(UsageMetric_t::Handles, 4, rollup);
+	CHECK(TopPids(table, rollup.all) == std::vector<uint32_t>({ 4, 4200, 640, 4400 }));
+}
+
+TEST_CASE(ProcessUsage_TopMatchesFullSort)
+{
+	// The bounded heaps must pick the same processes, in the same order, as sorting every process
+	std::mt19937 random(12345);
+	const wchar_t* userSids[] = { L"S-1-5-18", L"S-1-5-19", L"S-1-5-21-1-2-3-1001", L"S-1-5-21-1-2-3-1002" };
+	SessionSnapshotList_t sessions(4);
+	for (size_t ixSession = 0; ixSession < sessions.size(); ++ixSession)
+	{
+		sessions[ixSession].dwSessionId = (uint32_t)ixSession;
+		for (uint32_t ix = 0; ix < 250; ++ix)
+		{
+			// Few distinct values, so there are plenty of ties
+			sessions[ixSession].processes.value.push_back(MakeProcess(
+				(uint32_t)(ixSession * 1000 + ix) * 4, userSids[random() % 4],
+				(random() % 20) * 4096, (uint32_t)(random() % 30), (int64_t)(random() % 10), (int64_t)(random() % 10)));
+		}
+	}
+	ProcessUsageTable table;
+	table.Load(sessions);
+
+	const UsageMetric_t metrics[] = { UsageMetric_t::Cpu, UsageMetric_t::WorkingSet, UsageMetric_t::Handles };
+	const size_t topCounts[] = { 1, 5, 17, 2000 };
+	for (size_t ixMetric = 0; ixMetric < 3; ++ixMetric)
+	{
+		for (size_t ixTop = 0; ixTop < 4; ++ixTop)
+		{
+			const size_t nTop = topCounts[ixTop];
+			UsageRollup_t rollup;
+			table.RollUp(metrics[ixMetric], nTop, rollup);
+
+			std::vector<size_t> expected(table.Processes().size());
+			for (size_t ix = 0; ix < expected.size(); ++ix)
+				expected[ix] = ix;
+			std::stable_sort(expected.begin(), expected.end(), [&table, &metrics, ixMetric](size_t ixA, size_t ixB)
+			{
+				return ProcessUsageTable::Weight(table.Processes()[ixA], metrics[ixMetric]) > ProcessUsageTable::Weight(table.Processes()[ixB], metrics[ixMetric]);
+			});
+			expected.resize(std::min(nTop, expected.size()));
+			CHECK(expected == rollup.all.top);
+
+			for (size_t ixUser = 0; ixUser < rollup.users.size(); ++ixUser)
+			{
+				std::vector<size_t> expectedUser;
+				for (size_t ix = 0; ix < table.Processes().size(); ++ix)
+				{
+					if (table.Processes()[ix].userIndex == ixUser)
+						expectedUser.push_back(ix);
+				}
+				std::stable_sort(expectedUser.begin(), expectedUser.end(), [&table, &metrics, ixMetric](size_t ixA, size_t ixB)
+				{
+					return ProcessUsageTable::Weight(table.Processes()[ixA], metrics[ixMetric]) > ProcessUsageTable::Weight(table.Processes()[ixB], metrics[ixMetric]);
+				});
+				expectedUser.resize(std::min(nTop, expectedUser.size()));
+				CHECK(expectedUser == rollup.users[ixUser].top);
+			}
+		}
+	}
+}
+
+TEST_CASE(ProcessUsage_SubtractCpuTimeBetweenSamples)
+{
+	const wchar_t* szAlice = L"S-1-5-21-1-2-3-1001";
+	SessionSnapshotList_t before(1), after(1);
+	before[0].processes.value.push_back(MakeProcess(100, szAlice, 0, 0, 1000, 500));
+	before[0].processes.value.push_back(MakeProcess(200, szAlice, 0, 0, 9000, 9000));
+	before[0].processes.value.push_back(MakeProcess(300, szAlice, 0, 0, 700, 700));
+
+	// 100 kept running; 200 exited and its PID was reused by a new process; 300's times went backward
+	// (a mismatched process); 400 started since the first sample.
+	after[0].processes.value.push_back(MakeProcess(100, szAlice, 0, 0, 1600, 900));
+	after[0].processes.value.push_back(MakeProcess(200, szAlice, 0, 0, 30, 20));
+	after[0].processes.value.back().createTime = 99999;
+	after[0].processes.value.push_back(MakeProcess(300, szAlice, 0, 0, 100, 800));
+	after[0].processes.value.push_back(MakeProcess(400, szAlice, 0, 0, 250, 250));
+
+	ProcessUsageTable earlierTable, laterTable;
+	earlierTable.Load(before);
+	laterTable.Load(after);
+	laterTable.SubtractCpuTime(earlierTable);
+
+	const std::vector<ProcessUsage_t>& processes = laterTable.Processes();
+	CHECK_EQUAL((int64_t)600, processes[0].userTime);
+	CHECK_EQUAL((int64_t)400, processes[0].kernelTime);
+	CHECK_EQUAL((int64_t)30, processes[1].userTime);
+	CHECK_EQUAL((int64_t)20, processes[1].kernelTime);
+	CHECK_EQUAL((int64_t)0, processes[2].userTime);
+	CHECK_EQUAL((int64_t)100, processes[2].kernelTime);
+	CHECK_EQUAL((int64_t)250, processes[3].userTime);
+
+	// Ranked by CPU used in the interval, not lifetime totals
+	UsageRollup_t rollup;
+	laterTable.RollUp(UsageMetric_t::Cpu, 2, rollup);
+	CHECK(TopPids(laterTable, rollup.all) == std::vector<uint32_t>({ 100, 400 }));
+	// The snapshot itself is unchanged
+	CHECK_EQUAL((int64_t)1600, after[0].processes.value[0].userTime);
+}
@@ -0,0 +1,102 @@
+// RecordReplayTests.cpp: tests of --record and --replay -- a collection recorded through RecordingSystemSource and
+// saved to a capture file replays through ReplaySystemSource to the same snapshot.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "RecordingSystemSource.h"
+#include "ReplaySystemSource.h"
+#include "SnapshotCollector.h"
+#include "SnapshotDiff.h"
+#include "SnapshotWriter.h"
+
+// Capture file written and removed by the tests, in the working directory
+static const wchar_t* const CapturePath = L"RecordReplayTests.tsscap";
+static const char* const CapturePathA = "RecordReplayTests.tsscap";
+
+// Internal helper: collect every field from a source
+static void CollectAll(SystemSource& source, size_t nThreads, SystemSnapshot_t& snapshot)
+{
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"all", options.fields, sErrorInfo));
+	options.nThreads = nThreads;
+	SnapshotCollector collector(source, options);
+	collector.Collect(snapshot);
+}
+
+// Internal helper: a snapshot's binary image, which holds every collected field
+static std::vector<uint8_t> SnapshotImage(const SystemSnapshot_t& snapshot)
+{
+	SnapshotWriter writer;
+	std::vector<uint8_t> image;
+	std::wstring sErrorInfo;
+	CHECK(writer.Write(snapshot, image, sErrorInfo));
+	return image;
+}
+
+TEST_CASE(RecordReplay_ReplaysTheRecordedSnapshot)
+{
+	CountingSystemSource source;
+	RecordingSystemSource recorder(source);
+	SystemSnapshot_t recorded;
+	CollectAll(recorder, 1, recorded);
+	std::wstring sErrorInfo;
+	CHECK(recorder.Save(CapturePath, sErrorInfo));
+
+	ReplaySystemSource replay;
+	CHECK(replay.Load(CapturePath, sErrorInfo));
+	std::remove(CapturePathA);
+	CHECK(replay.GetCapture().Size() > 0);
+
+	// The same snapshot, serially and with workers
+	const std::vector<uint8_t> recordedImage = SnapshotImage(recorded);
+	for (size_t nThreads = 1; nThreads <= 4; nThreads += 3)
+	{
+		SystemSnapshot_t replayed;
+		CollectAll(replay, nThreads, replayed);
+		SnapshotDiff_t diff;
+		DiffSnapshots(recorded, replayed, diff);
+		CHECK(diff.IsEmpty());
+		CHECK(recordedImage == SnapshotImage(replayed));
+		CHECK_EQUAL((size_t)2, replayed.sessions.value.size());
+		CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), replayed.sessions.value[1].processes.value[0].user.Name());
+	}
+
+	// Calls that weren't recorded fail, rather than returning made-up data
+	SessionSnapshot_t session;
+	CHECK(!replay.QuerySessionInfo(7, session, sErrorInfo));
+	CHECK_EQUAL(std::wstring(L"Not recorded"), sErrorInfo);
+	CHECK(nullptr == replay.OpenWindowStation(L"NoSuchStation", sErrorInfo));
+}
+
+TEST_CASE(RecordReplay_ReplaysASessionRefresh)
+{
+	// The per-session queries an --events refresh makes are recorded and replayed too
+	CountingSystemSource source;
+	RecordingSystemSource recorder(source);
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"all", options.fields, sErrorInfo));
+	SessionSnapshot_t recorded;
+	CHECK(SnapshotCollector(recorder, options).CollectSession(1, recorded, sErrorInfo));
+	CHECK(recorder.Save(CapturePath, sErrorInfo));
+
+	ReplaySystemSource replay;
+	CHECK(replay.Load(CapturePath, sErrorInfo));
+	std::remove(CapturePathA);
+	SessionSnapshot_t replayed;
+	CHECK(SnapshotCollector(replay, options).CollectSession(1, replayed, sErrorInfo));
+	SystemSnapshot_t recordedSample, replayedSample;
+	recordedSample.sessions.Set(SessionSnapshotList_t(1, recorded));
+	replayedSample.sessions.Set(SessionSnapshotList_t(1, replayed));
+	CHECK(SnapshotImage(recordedSample) == SnapshotImage(replayedSample));
+	CHECK_EQUAL((size_t)3, replayed.processes.value.size());
+	CHECK(replayed.token.user == CountingSystemSource::MakeSid(CountingSystemSource::AliceSid()));
+
+	// Sessions that weren't queried weren't recorded
+	CHECK(!SnapshotCollector(replay, options).CollectSession(0, replayed, sErrorInfo));
+	CHECK_EQUAL(std::wstring(L"Not recorded"), sErrorInfo);
+}
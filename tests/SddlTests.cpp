@@ -0,0 +1,162 @@
+// SddlTests.cpp: tests of the SDDL parser and formatter -- SDDL -> binary security descriptor -> SDDL round trips
+// over descriptors like those Windows writes, and a corpus of malformed SDDL that Parse must reject.
+
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "Sddl.h"
+#include "SecDescModel.h"
+#include "SidCodec.h"
+
+// Every part of a security descriptor that Format can write
+static const uint32_t AllSecurityInformation =
+	Sddl::OwnerSecurityInformation | Sddl::GroupSecurityInformation | Sddl::DaclSecurityInformation |
+	Sddl::SaclSecurityInformation | Sddl::LabelSecurityInformation | Sddl::AttributeSecurityInformation |
+	Sddl::ScopeSecurityInformation | Sddl::ProcessTrustLabelSecurityInformation | Sddl::AccessFilterSecurityInformation;
+
+// Internal helper: domains for the domain-relative aliases (LA, DU, DA, EA, ...)
+static Sddl::Domains_t TestDomains()
+{
+	Sddl::Domains_t domains;
+	SidCodec::Parse(L"S-1-5-21-1004336348-1177238915-682003330", domains.accountDomain);
+	SidCodec::Parse(L"S-1-5-21-3623811015-3361044348-30300820", domains.primaryDomain);
+	domains.rootDomain = domains.primaryDomain;
+	return domains;
+}
+
+// Internal helper: parse SDDL and convert it to a binary self-relative security descriptor
+static bool ParseToBinary(const std::wstring& sSddl, const Sddl::Domains_t* pDomains, std::vector<uint8_t>& binary, std::wstring& sErrorInfo)
+{
+	SecDescModel::SecurityDescriptor_t sd;
+	return Sddl::Parse(sSddl, pDomains, sd, sErrorInfo) && SecDescModel::ToSelfRelative(sd, binary, sErrorInfo);
+}
+
+TEST_CASE(Sddl_RoundTripsRealisticDescriptors)
+{
+	// Each is already in the form Format writes, so it comes back unchanged
+	const wchar_t* corpus[] = {
+		// File system: explicit, protected and inherited ACEs
+		L"O:BAG:SYD:(A;;FA;;;SY)(A;;FA;;;BA)(A;;0x1200a9;;;BU)",
+		L"O:SYG:SYD:PAI(A;OICI;FA;;;SY)(A;OICIIO;GA;;;CO)(A;OICIID;0x1200a9;;;BU)",
+		L"D:AI(A;ID;FA;;;SY)",
+		// Service control manager
+		L"D:(A;;CCLCSWRPWPDTLOCRRC;;;SY)(A;;CCDCLCSWRPWPDTLOCRSDRCWDWO;;;BA)(A;;CCLCSWLOCRRC;;;AU)(A;;CCLCSWRPWPDTLOCRRC;;;PU)",
+		// Domain-relative aliases
+		L"O:LAG:DUD:(A;;FA;;;LA)(D;;FA;;;LG)(A;;FR;;;DA)(A;;GA;;;EA)",
+		// Active Directory object ACEs, with and without an inherited object type
+		L"D:(OA;;CR;ab721a53-1e2f-11d0-9819-00aa0040529b;;PS)(OA;CIIO;RP;4c164200-20c0-11d0-a768-00aa006e0529;4828cc14-1437-45bc-9b07-ad6f015e5f28;RU)",
+		// SACLs: auditing and mandatory labels
+		L"S:(ML;;NW;;;LW)",
+		L"S:(AU;SAFA;FA;;;WD)(ML;;NWNRNX;;;HI)",
+		// Null and empty DACLs
+		L"D:NO_ACCESS_CONTROL",
+		L"D:P",
+		// SIDs with no alias
+		L"O:S-1-5-21-1-2-3-1001G:S-1-5-21-1-2-3-513D:(A;;0x1f0fff;;;S-1-5-21-1-2-3-1001)",
+		// Resource attribute
+		L"S:(RA;;;;;WD;(\"Secrecy\",TU,0x0,3))",
+	};
+	const Sddl::Domains_t domains = TestDomains();
+	for (size_t ix = 0; ix < sizeof(corpus) / sizeof(corpus[0]); ++ix)
+	{
+		std::vector<uint8_t> binary;
+		std::wstring sSddl, sErrorInfo;
+		if (!ParseToBinary(corpus[ix], &domains, binary, sErrorInfo) ||
+			!Sddl::Format(binary.data(), binary.size(), AllSecurityInformation, &domains, sSddl, sErrorInfo))
+		{
+			TestHarness::ReportFailure(__FILE__, __LINE__, "rejected " + TestHarness::Describe(corpus[ix]) + ": " + TestHarness::Describe(sErrorInfo));
+			continue;
+		}
+		CHECK_EQUAL(std::wstring(corpus[ix]), sSddl);
+	}
+}
+
+TEST_CASE(Sddl_FormatsCanonicalForm)
+{
+	// Input that Format writes differently; its output parses back to the same binary descriptor
+	const wchar_t* corpus[][2] = {
+		// Rights in Format's order, and a SID with an alias written as its alias
+		{ L"D:(A;;GRGX;;;AC)(A;;GRGX;;;S-1-15-2-1)", L"D:(A;;GXGR;;;AC)(A;;GXGR;;;AC)" },
+		// Conditional expressions fully parenthesized, with attribute prefixes uppercase
+		{ L"D:(XA;;FX;;;WD;(@User.Title == \"PM\" && Member_of {SID(BA)}))", L"D:(XA;;FX;;;WD;((@USER.Title == \"PM\") && (Member_of {SID(BA)})))" },
+	};
+	const Sddl::Domains_t domains = TestDomains();
+	for (size_t ix = 0; ix < sizeof(corpus) / sizeof(corpus[0]); ++ix)
+	{
+		std::vector<uint8_t> binary, reparsed;
+		std::wstring sSddl, sErrorInfo;
+		CHECK(ParseToBinary(corpus[ix][0], &domains, binary, sErrorInfo));
+		CHECK(Sddl::Format(binary.data(), binary.size(), AllSecurityInformation, &domains, sSddl, sErrorInfo));
+		CHECK_EQUAL(std::wstring(corpus[ix][1]), sSddl);
+		CHECK(ParseToBinary(sSddl, &domains, reparsed, sErrorInfo));
+		CHECK(binary == reparsed);
+	}
+}
+
+TEST_CASE(Sddl_FormatSelectsPartsAndReportsLength)
+{
+	const Sddl::Domains_t domains = TestDomains();
+	std::vector<uint8_t> binary;
+	std::wstring sSddl, sErrorInfo;
+	CHECK(ParseToBinary(L"O:BAG:SYD:(A;;FA;;;SY)S:(ML;;NW;;;HI)", &domains, binary, sErrorInfo));
+	CHECK(Sddl::Format(binary.data(), binary.size(), Sddl::OwnerSecurityInformation | Sddl::DaclSecurityInformation, &domains, sSddl, sErrorInfo));
+	CHECK_EQUAL(std::wstring(L"O:BAD:(A;;FA;;;SY)"), sSddl);
+	CHECK(Sddl::Format(binary.data(), binary.size(), Sddl::LabelSecurityInformation, &domains, sSddl, sErrorInfo));
+	CHECK_EQUAL(std::wstring(L"S:(ML;;NW;;;HI)"), sSddl);
+
+	// A buffer too small for the null reports the length needed
+	wchar_t szBuf[18];
+	size_t cchSddl = 0;
+	CHECK(Sddl::Format(binary.data(), binary.size(), Sddl::OwnerSecurityInformation | Sddl::DaclSecurityInformation, &domains, szBuf, 18, cchSddl, sErrorInfo));
+	CHECK_EQUAL((size_t)18, cchSddl);
+	CHECK(Sddl::Format(binary.data(), binary.size(), Sddl::OwnerSecurityInformation | Sddl::DaclSecurityInformation, &domains, nullptr, 0, cchSddl, sErrorInfo));
+	CHECK_EQUAL((size_t)18, cchSddl);
+
+	// Truncated binary
+	CHECK(!Sddl::Format(binary.data(), 10, AllSecurityInformation, &domains, sSddl, sErrorInfo));
+}
+
+TEST_CASE(Sddl_RejectsMalformedInput)
+{
+	const wchar_t* malformed[] = {
+		// Components
+		L"X:BA", L"O:", L"O:BAO:SY", L"G:SYG:SY", L"D:(A;OICI;FA;;;SY)D:(A;;FA;;;BA)", L"D:(A;;FA;;;SY) ", L"D:(A;;FA;;;SY)x",
+		// SIDs: unknown and lowercase aliases, malformed strings, domain-relative aliases without domains
+		L"O:XX", L"O:ba", L"O:S-1-5-", L"O:S-1-5-21-1-2-3-1001-1-2-3-4-5-6-7-8-9-10-11-12", L"O:DA", L"D:(A;;FA;;;)",
+		// ACL flags and ACE structure
+		L"D:ZZ(A;;FA;;;SY)", L"D:A;;FA;;;SY)", L"D:(A;;FA;;;SY", L"D:(A;;FA;;SY)", L"D:((A;;FA;;;SY))", L"S:(ML;;NW;;;LW)(",
+		L"D:NO_ACCESS_CONTROL(A;;FA;;;SY)",
+		// ACE fields
+		L"D:(Q;;FA;;;SY)", L"D:(a;;FA;;;SY)", L"D:(A;XX;FA;;;SY)", L"D:(A;;QQ;;;SY)", L"D:(A;;0x;;;SY)", L"D:(A;;0x100000000;;;SY)",
+		L"D:(A;;FA;;;SY;)",
+		// Object types
+		L"D:(OA;;CR;ab721a53-1e2f-11d0-9819-00aa0040529;;PS)", L"D:(OA;;CR;{ab721a53-1e2f-11d0-9819-00aa0040529b};;PS)",
+		L"D:(A;;FA;ab721a53-1e2f-11d0-9819-00aa0040529b;;SY)",
+		// Conditions and resource attributes
+		L"D:(XA;;FX;;;WD;(@User.Title ==))", L"D:(XA;;FX;;;WD;(@User.Title == \"PM\")", L"S:(RA;;;;;WD;(\"Secrecy\",QQ,0x0,3))",
+	};
+	for (size_t ix = 0; ix < sizeof(malformed) / sizeof(malformed[0]); ++ix)
+	{
+		SecDescModel::SecurityDescriptor_t sd;
+		std::wstring sErrorInfo;
+		if (Sddl::Parse(malformed[ix], nullptr, sd, sErrorInfo))
+			TestHarness::ReportFailure(__FILE__, __LINE__, "accepted " + TestHarness::Describe(malformed[ix]));
+		else if (std::wstring::npos == sErrorInfo.find(L"offset"))
+			TestHarness::ReportFailure(__FILE__, __LINE__, "no offset in the error for " + TestHarness::Describe(malformed[ix]));
+	}
+}
+
+TEST_CASE(Sddl_TruncatedInputIsParsedSafely)
+{
+	// Every prefix of valid SDDL either parses or is rejected with an error, without reading past its end
+	const std::wstring sSddl = L"O:BAG:SYD:PAI(A;OICI;FA;;;SY)(OA;CIIO;RP;4c164200-20c0-11d0-a768-00aa006e0529;;RU)"
+		L"(XA;;FX;;;WD;(@User.Title == \"PM\"))S:(ML;;NW;;;LW)(RA;;;;;WD;(\"Secrecy\",TU,0x0,3))";
+	for (size_t cch = 0; cch < sSddl.size(); ++cch)
+	{
+		const std::vector<wchar_t> prefix(sSddl.begin(), sSddl.begin() + cch);
+		SecDescModel::SecurityDescriptor_t sd;
+		std::wstring sErrorInfo;
+		if (!Sddl::Parse(prefix.data(), cch, nullptr, sd, sErrorInfo))
+			CHECK(!sErrorInfo.empty());
+	}
+}
@@ -0,0 +1,119 @@
+// SecDescRenderCacheTests.cpp: tests of the rendered security descriptor cache -- text is found only for the same
+// bytes rendered the same way, the cache is emptied when it's full, and Flush discards everything.
+
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "SecDescRenderCache.h"
+
+// Internal helper: a rendering with the given parts
+static SecDescRenderCache::Rendering_t Rendering(uint32_t format, uint32_t securityInformation, const wchar_t* szObjType, size_t indent)
+{
+	SecDescRenderCache::Rendering_t rendering = { format, securityInformation, szObjType, indent };
+	return rendering;
+}
+
+// Internal helper: a distinct stand-in for a binary security descriptor
+static std::vector<uint8_t> Descriptor(uint32_t n)
+{
+	std::vector<uint8_t> sd(20, 0);
+	sd[0] = 1;
+	for (size_t ix = 0; ix < 4; ++ix)
+		sd[4 + ix] = (uint8_t)(n >> (8 * ix));
+	return sd;
+}
+
+TEST_CASE(SecDescRenderCache_KeyedByBytesAndRendering)
+{
+	SecDescRenderCache cache;
+	const std::vector<uint8_t> sd = Descriptor(1);
+	const SecDescRenderCache::Rendering_t rendering = Rendering(1, 0x7, L"desktop", 4);
+	std::wstring sText;
+	CHECK(!cache.Find(sd.data(), sd.size(), rendering, sText));
+	cache.Add(sd.data(), sd.size(), rendering, L"D:(A;;GA;;;SY)");
+	CHECK(cache.Find(sd.data(), sd.size(), rendering, sText));
+	CHECK_EQUAL(std::wstring(L"D:(A;;GA;;;SY)"), sText);
+
+	// Any part of the rendering that differs is a different key
+	const SecDescRenderCache::Rendering_t others[] = {
+		Rendering(2, 0x7, L"desktop", 4),
+		Rendering(1, 0x4, L"desktop", 4),
+		Rendering(1, 0x7, L"winsta", 4),
+		Rendering(1, 0x7, L"desktop", 8),
+	};
+	for (size_t ix = 0; ix < sizeof(others) / sizeof(others[0]); ++ix)
+	{
+		CHECK(!cache.Find(sd.data(), sd.size(), others[ix], sText));
+		CHECK(sText.empty());
+	}
+
+	// So are different bytes, and the same bytes with one more or one fewer
+	const std::vector<uint8_t> other = Descriptor(2);
+	CHECK(!cache.Find(other.data(), other.size(), rendering, sText));
+	CHECK(!cache.Find(sd.data(), sd.size() - 1, rendering, sText));
+	std::vector<uint8_t> longer(sd);
+	longer.push_back(0);
+	CHECK(!cache.Find(longer.data(), longer.size(), rendering, sText));
+
+	// The same bytes at another address are the same key; adding again replaces the text
+	const std::vector<uint8_t> copy(sd);
+	CHECK(cache.Find(copy.data(), copy.size(), rendering, sText));
+	cache.Add(copy.data(), copy.size(), rendering, L"D:P");
+	CHECK(cache.Find(sd.data(), sd.size(), rendering, sText));
+	CHECK_EQUAL(std::wstring(L"D:P"), sText);
+	CHECK_EQUAL((size_t)1, cache.Size());
+	CHECK_EQUAL((uint64_t)3, cache.Hits());
+	CHECK_EQUAL((uint64_t)8, cache.Misses());
+}
+
+TEST_CASE(SecDescRenderCache_EmptiedWhenFull)
+{
+	SecDescRenderCache cache;
+	const SecDescRenderCache::Rendering_t rendering = Rendering(1, 0x7, L"desktop", 0);
+	for (uint32_t n = 0; n < SecDescRenderCache::MaxEntries; ++n)
+	{
+		const std::vector<uint8_t> sd = Descriptor(n);
+		cache.Add(sd.data(), sd.size(), rendering, std::to_wstring(n));
+	}
+	CHECK_EQUAL(SecDescRenderCache::MaxEntries, cache.Size());
+
+	// Replacing text that's already cached doesn't empty a full cache
+	std::wstring sText;
+	const std::vector<uint8_t> first = Descriptor(0);
+	cache.Add(first.data(), first.size(), rendering, L"replaced");
+	CHECK_EQUAL(SecDescRenderCache::MaxEntries, cache.Size());
+	CHECK(cache.Find(first.data(), first.size(), rendering, sText));
+	CHECK_EQUAL(std::wstring(L"replaced"), sText);
+
+	// Adding one more empties it first
+	const std::vector<uint8_t> next = Descriptor(SecDescRenderCache::MaxEntries);
+	cache.Add(next.data(), next.size(), rendering, L"next");
+	CHECK_EQUAL((size_t)1, cache.Size());
+	CHECK(!cache.Find(first.data(), first.size(), rendering, sText));
+	CHECK(cache.Find(next.data(), next.size(), rendering, sText));
+	CHECK_EQUAL(std::wstring(L"next"), sText);
+}
+
+TEST_CASE(SecDescRenderCache_FlushDiscardsEverything)
+{
+	SecDescRenderCache cache;
+	const SecDescRenderCache::Rendering_t rendering = Rendering(1, 0x7, L"winsta", 2);
+	for (uint32_t n = 0; n < 10; ++n)
+	{
+		const std::vector<uint8_t> sd = Descriptor(n);
+		cache.Add(sd.data(), sd.size(), rendering, L"text");
+	}
+	std::wstring sText;
+	const std::vector<uint8_t> sd = Descriptor(3);
+	CHECK(cache.Find(sd.data(), sd.size(), rendering, sText));
+	cache.Flush();
+	CHECK_EQUAL((size_t)0, cache.Size());
+	CHECK(!cache.Find(sd.data(), sd.size(), rendering, sText));
+
+	// The counters are kept
+	CHECK_EQUAL((uint64_t)1, cache.Hits());
+	CHECK_EQUAL((uint64_t)1, cache.Misses());
+	cache.Add(sd.data(), sd.size(), rendering, L"new text");
+	CHECK(cache.Find(sd.data(), sd.size(), rendering, sText));
+	CHECK_EQUAL(std::wstring(L"new text"), sText);
+}
@@ -0,0 +1,270 @@
+// SecDescViewTests.cpp: tests of the security descriptor views over malformed buffers -- offsets past the end,
+// ACL and ACE sizes that don't fit, and truncated SIDs are rejected when the view is constructed, and nothing is
+// read outside the buffer.
+
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "SecDescView.h"
+#include "Sddl.h"
+#include "SidCodec.h"
+
+using namespace SecDescModel;
+
+// Header offsets of the owner, group, SACL and DACL offsets
+static const size_t OwnerOffsetField = 4;
+static const size_t GroupOffsetField = 8;
+static const size_t SaclOffsetField = 12;
+static const size_t DaclOffsetField = 16;
+
+// Internal helper: a valid binary security descriptor with an owner, a group, a two-ACE DACL and a SACL
+static std::vector<uint8_t> ValidDescriptor()
+{
+	SecurityDescriptor_t sd;
+	std::vector<uint8_t> binary;
+	std::wstring sErrorInfo;
+	CHECK(Sddl::Parse(L"O:BAG:SYD:(A;;FA;;;SY)(A;;FA;;;BA)S:(ML;;NW;;;LW)", nullptr, sd, sErrorInfo));
+	CHECK(ToSelfRelative(sd, binary, sErrorInfo));
+	return binary;
+}
+
+// Internal helpers: little-endian fields of a binary security descriptor
+static uint32_t Read32(const std::vector<uint8_t>& sd, size_t offset)
+{
+	return (uint32_t)sd[offset] | ((uint32_t)sd[offset + 1] << 8) | ((uint32_t)sd[offset + 2] << 16) | ((uint32_t)sd[offset + 3] << 24);
+}
+
+static uint16_t Read16(const std::vector<uint8_t>& sd, size_t offset)
+{
+	return (uint16_t)(sd[offset] | (sd[offset + 1] << 8));
+}
+
+static void Write32(std::vector<uint8_t>& sd, size_t offset, uint32_t value)
+{
+	for (size_t ix = 0; ix < 4; ++ix)
+		sd[offset + ix] = (uint8_t)(value >> (8 * ix));
+}
+
+static void Write16(std::vector<uint8_t>& sd, size_t offset, uint16_t value)
+{
+	sd[offset] = (uint8_t)value;
+	sd[offset + 1] = (uint8_t)(value >> 8);
+}
+
+// Internal helper: report a view that accepted a malformed descriptor, or rejected it with the wrong reason
+static void CheckRejected(const char* szFile, int line, const std::vector<uint8_t>& sd, const std::wstring& sExpectedError)
+{
+	// View a copy of exactly the descriptor's size, so that a read past the end is caught by the sanitizers
+	const std::vector<uint8_t> exact(sd);
+	SecurityDescriptorView view(exact.data(), exact.size());
+	if (view.IsValid())
+		TestHarness::ReportFailure(szFile, line, "accepted a malformed security descriptor");
+	else if (view.ErrorInfo() != sExpectedError)
+		TestHarness::ReportFailure(szFile, line, "rejected with " + TestHarness::Describe(view.ErrorInfo()) + ", expected " + TestHarness::Describe(sExpectedError));
+}
+
+#define CHECK_REJECTED(sd, sExpectedError) CheckRejected(__FILE__, __LINE__, sd, sExpectedError)
+
+// Internal helper: the error message for an offset within a security descriptor
+static std::wstring ErrorAt(size_t offset, const wchar_t* szReason)
+{
+	return L"Invalid security descriptor at offset " + std::to_wstring(offset) + L": " + szReason;
+}
+
+TEST_CASE(SecDescView_ViewsAValidDescriptor)
+{
+	const std::vector<uint8_t> sd = ValidDescriptor();
+	SecurityDescriptorView view(sd.data(), sd.size());
+	CHECK(view.IsValid());
+	CHECK(view.ErrorInfo().empty());
+
+	std::vector<uint8_t> expected;
+	SidCodec::Parse(L"S-1-5-32-544", expected);
+	CHECK(nullptr != view.Owner() && std::vector<uint8_t>(view.Owner(), view.Owner() + view.OwnerLength()) == expected);
+	SidCodec::Parse(L"S-1-5-18", expected);
+	CHECK(nullptr != view.Group() && std::vector<uint8_t>(view.Group(), view.Group() + view.GroupLength()) == expected);
+
+	CHECK(view.Dacl().IsPresent() && !view.Dacl().IsNull());
+	CHECK_EQUAL((size_t)2, view.Dacl().AceCount());
+	const wchar_t* szTrustees[] = { L"S-1-5-18", L"S-1-5-32-544" };
+	size_t nAces = 0;
+	for (AclView::const_iterator iter = view.Dacl().begin(); iter != view.Dacl().end(); ++iter, ++nAces)
+	{
+		CHECK_EQUAL(AccessAllowedAceType, iter->Type());
+		CHECK_EQUAL((uint32_t)0x1F01FF, iter->Mask());
+		SidCodec::Parse(szTrustees[nAces], expected);
+		CHECK(nullptr != iter->Sid() && std::vector<uint8_t>(iter->Sid(), iter->Sid() + iter->SidLength()) == expected);
+		CHECK_EQUAL((size_t)0, iter->ApplicationDataLength());
+	}
+	CHECK_EQUAL((size_t)2, nAces);
+	CHECK_EQUAL((size_t)1, view.Sacl().AceCount());
+	CHECK_EQUAL(SystemMandatoryLabelAceType, view.Sacl().begin()->Type());
+}
+
+TEST_CASE(SecDescView_RejectsOffsetsPastTheEnd)
+{
+	const std::vector<uint8_t> valid = ValidDescriptor();
+	const uint32_t badOffsets[] = { (uint32_t)valid.size(), (uint32_t)valid.size() + 1, (uint32_t)valid.size() - 1, 0x7FFFFFFF, 0xFFFFFFFF };
+	for (size_t ix = 0; ix < sizeof(badOffsets) / sizeof(badOffsets[0]); ++ix)
+	{
+		const uint32_t offset = badOffsets[ix];
+		std::vector<uint8_t> sd = valid;
+		Write32(sd, OwnerOffsetField, offset);
+		CHECK_REJECTED(sd, ErrorAt(offset, L"invalid SID"));
+
+		sd = valid;
+		Write32(sd, GroupOffsetField, offset);
+		CHECK_REJECTED(sd, ErrorAt(offset, L"invalid SID"));
+		SecurityDescriptorView view(sd.data(), sd.size());
+		CHECK(nullptr == view.Group() && 0 == view.GroupLength());
+		// The parts that are valid can still be used
+		CHECK(nullptr != view.Owner() && view.Dacl().IsValid());
+
+		// Offsets at or past the end are out of range; one inside the buffer leaves no room for an ACL header
+		if (offset >= valid.size())
+		{
+			sd = valid;
+			Write32(sd, DaclOffsetField, offset);
+			CHECK_REJECTED(sd, ErrorAt(offset, L"ACL out of range"));
+			sd = valid;
+			Write32(sd, SaclOffsetField, offset);
+			CHECK_REJECTED(sd, ErrorAt(offset, L"ACL out of range"));
+			SecurityDescriptorView aclView(sd.data(), sd.size());
+			CHECK(aclView.Sacl().IsPresent() && !aclView.Sacl().IsNull());
+			CHECK(aclView.Sacl().begin() == aclView.Sacl().end());
+		}
+		else
+		{
+			sd = valid;
+			Write32(sd, DaclOffsetField, offset);
+			CHECK_REJECTED(sd, ErrorAt(offset, L"truncated ACL header"));
+		}
+	}
+}
+
+TEST_CASE(SecDescView_RejectsAclSizesLargerThanTheBuffer)
+{
+	const std::vector<uint8_t> valid = ValidDescriptor();
+	const size_t daclOffset = Read32(valid, DaclOffsetField);
+	const uint16_t cbAcl = Read16(valid, daclOffset + 2);
+	const size_t cbAvailable = valid.size() - daclOffset;
+	const uint16_t badSizes[] = { (uint16_t)(cbAvailable + 1), 0xFFFF, (uint16_t)(AclHeaderSize - 1), 0 };
+	for (size_t ix = 0; ix < sizeof(badSizes) / sizeof(badSizes[0]); ++ix)
+	{
+		std::vector<uint8_t> sd = valid;
+		Write16(sd, daclOffset + 2, badSizes[ix]);
+		CHECK_REJECTED(sd, ErrorAt(daclOffset + 2, L"invalid ACL size"));
+		SecurityDescriptorView view(sd.data(), sd.size());
+		CHECK(view.Dacl().begin() == view.Dacl().end());
+	}
+
+	// An ACL that ends before its ACEs do
+	std::vector<uint8_t> sd = valid;
+	Write16(sd, daclOffset + 2, (uint16_t)(cbAcl - 1));
+	CHECK_REJECTED(sd, ErrorAt(daclOffset + AclHeaderSize + Read16(valid, daclOffset + AclHeaderSize + 2), L"invalid ACE"));
+
+	// More ACEs than fit in the ACL
+	sd = valid;
+	Write16(sd, daclOffset + 4, 3);
+	CHECK_REJECTED(sd, ErrorAt(daclOffset + cbAcl, L"invalid ACE"));
+
+	// An unknown revision
+	sd = valid;
+	sd[daclOffset] = AclRevisionDs + 1;
+	CHECK_REJECTED(sd, ErrorAt(daclOffset, L"unknown ACL revision"));
+}
+
+TEST_CASE(SecDescView_RejectsAceSizesThatDontFit)
+{
+	const std::vector<uint8_t> valid = ValidDescriptor();
+	const size_t daclOffset = Read32(valid, DaclOffsetField);
+	const size_t firstAce = daclOffset + AclHeaderSize;
+	const uint16_t cbFirstAce = Read16(valid, firstAce + 2);
+	const size_t secondAce = firstAce + cbFirstAce;
+	const uint16_t cbAcl = Read16(valid, daclOffset + 2);
+
+	// Size 0, and sizes smaller than an ACE header
+	for (uint16_t cbAce = 0; cbAce < AceHeaderSize; ++cbAce)
+	{
+		std::vector<uint8_t> sd = valid;
+		Write16(sd, firstAce + 2, cbAce);
+		CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+		sd = valid;
+		Write16(sd, secondAce + 2, cbAce);
+		CHECK_REJECTED(sd, ErrorAt(secondAce, L"invalid ACE"));
+	}
+
+	// Sizes that overrun the ACL, though not the buffer
+	const uint16_t overruns[] = { (uint16_t)(cbAcl - AclHeaderSize + 1), (uint16_t)(cbAcl - AclHeaderSize + 4), 0xFFFF };
+	for (size_t ix = 0; ix < sizeof(overruns) / sizeof(overruns[0]); ++ix)
+	{
+		std::vector<uint8_t> sd = valid;
+		Write16(sd, firstAce + 2, overruns[ix]);
+		CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+	}
+	std::vector<uint8_t> sd = valid;
+	Write16(sd, secondAce + 2, (uint16_t)(cbAcl - (secondAce - daclOffset) + 1));
+	CHECK_REJECTED(sd, ErrorAt(secondAce, L"invalid ACE"));
+
+	// Too small for its access mask and SID
+	sd = valid;
+	Write16(sd, firstAce + 2, AceHeaderSize + 4);
+	CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+
+	// Object ACEs: too small for the object flags, and flags for GUIDs that aren't there
+	AceView ace;
+	const uint8_t objectAce[] = { AccessAllowedObjectAceType, 0, 12, 0, 0xFF, 0x01, 0x1F, 0x00, ObjectTypePresent, 0, 0, 0 };
+	CHECK(!ace.Init(objectAce, sizeof(objectAce)));
+	const uint8_t shortObjectAce[] = { AccessAllowedObjectAceType, 0, 10, 0, 0xFF, 0x01, 0x1F, 0x00, 0, 0 };
+	CHECK(!ace.Init(shortObjectAce, sizeof(shortObjectAce)));
+
+	// A compound ACE's layout isn't known; it only has to fit
+	const uint8_t compoundAce[] = { AccessAllowedCompoundAceType, 0, 8, 0, 0xFF, 0x01, 0x1F, 0x00 };
+	CHECK(ace.Init(compoundAce, sizeof(compoundAce)));
+	CHECK(nullptr == ace.Sid());
+	CHECK(!ace.Init(compoundAce, sizeof(compoundAce) - 1));
+}
+
+TEST_CASE(SecDescView_RejectsTruncatedSids)
+{
+	const std::vector<uint8_t> valid = ValidDescriptor();
+	const size_t ownerOffset = Read32(valid, OwnerOffsetField);
+	const size_t groupOffset = Read32(valid, GroupOffsetField);
+	const size_t daclOffset = Read32(valid, DaclOffsetField);
+	const size_t firstAce = daclOffset + AclHeaderSize;
+
+	// Owner and group SIDs whose subauthority counts run past the end of the buffer
+	std::vector<uint8_t> sd = valid;
+	sd[ownerOffset + 1] = 15;
+	if (ownerOffset + 8 + 15 * 4 <= sd.size())
+		sd.resize(ownerOffset + 8 + 15 * 4 - 1);
+	CHECK_REJECTED(sd, ErrorAt(ownerOffset, L"invalid SID"));
+	sd = valid;
+	sd[groupOffset] = 2;
+	CHECK_REJECTED(sd, ErrorAt(groupOffset, L"invalid SID"));
+
+	// An ACE's SID whose subauthority count runs past the end of the ACE, and one with too many subauthorities
+	sd = valid;
+	sd[firstAce + AceHeaderSize + 4 + 1] = 2;
+	CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+	sd = valid;
+	sd[firstAce + AceHeaderSize + 4 + 1] = 16;
+	CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+
+	// An ACE just big enough for its mask and a SID header
+	sd = valid;
+	Write16(sd, firstAce + 2, AceHeaderSize + 4 + 8);
+	CHECK_REJECTED(sd, ErrorAt(firstAce, L"invalid ACE"));
+
+	// Every truncation of the descriptor is rejected without reading past the end
+	for (size_t cb = 0; cb < valid.size(); ++cb)
+	{
+		const std::vector<uint8_t> truncated(valid.begin(), valid.begin() + cb);
+		SecurityDescriptorView view(truncated.data(), truncated.size());
+		if (view.IsValid())
+			TestHarness::ReportFailure(__FILE__, __LINE__, "accepted " + std::to_string(cb) + " of " + std::to_string(valid.size()) + " bytes");
+		CHECK(!view.ErrorInfo().empty());
+		for (AclView::const_iterator iter = view.Dacl().begin(); iter != view.Dacl().end(); ++iter)
+			CHECK(nullptr != iter->Sid());
+	}
+}
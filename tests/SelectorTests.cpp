@@ -0,0 +1,139 @@
+// SelectorTests.cpp: tests of the --session, --user, --state, --winsta, and --desktop selectors -- glob matching,
+// pattern lists, and how a session's attributes are matched.
+
+#include <string>
+#include "TestHarness.h"
+#include "Selector.h"
+
+TEST_CASE(GlobMatch_Wildcards)
+{
+	// '*' matches any run, including none
+	CHECK(GlobMatch(L"*", L""));
+	CHECK(GlobMatch(L"*", L"Console"));
+	CHECK(GlobMatch(L"**", L"Console"));
+	CHECK(GlobMatch(L"RDP-Tcp#*", L"RDP-Tcp#"));
+	CHECK(GlobMatch(L"RDP-Tcp#*", L"RDP-Tcp#12"));
+	CHECK(GlobMatch(L"*-Tcp#*", L"RDP-Tcp#12"));
+	CHECK(GlobMatch(L"Service-0x*$", L"Service-0x0-3e7$"));
+	CHECK(!GlobMatch(L"RDP-Tcp#*", L"RDP-Tcp"));
+	CHECK(!GlobMatch(L"*$", L"WinSta0"));
+
+	// '?' matches exactly one character
+	CHECK(GlobMatch(L"?", L"1"));
+	CHECK(!GlobMatch(L"?", L""));
+	CHECK(!GlobMatch(L"?", L"12"));
+	CHECK(GlobMatch(L"WinSta?", L"WinSta0"));
+	CHECK(GlobMatch(L"?*", L"x"));
+	CHECK(!GlobMatch(L"?*", L""));
+
+	// A '*' that has to give back characters to a later part of the pattern
+	CHECK(GlobMatch(L"*a*b", L"aaab"));
+	CHECK(GlobMatch(L"*ab*ab", L"abxabyab"));
+	CHECK(!GlobMatch(L"*ab*ab", L"abxaby"));
+	CHECK(GlobMatch(L"a*b*c", L"abbbbc"));
+	CHECK(!GlobMatch(L"a*b*c", L"abbbb"));
+}
+
+TEST_CASE(GlobMatch_WholeTextAndCase)
+{
+	// The whole text has to match: no implicit wildcards at either end
+	CHECK(!GlobMatch(L"Console", L"Console2"));
+	CHECK(!GlobMatch(L"Console", L"MyConsole"));
+	CHECK(!GlobMatch(L"Cons", L"Console"));
+
+	// The empty pattern matches only empty text
+	CHECK(GlobMatch(L"", L""));
+	CHECK(!GlobMatch(L"", L"Console"));
+
+	// Case-insensitive both ways, including around wildcards
+	CHECK(GlobMatch(L"console", L"Console"));
+	CHECK(GlobMatch(L"CONSOLE", L"console"));
+	CHECK(GlobMatch(L"winsta?", L"WINSTA0"));
+	CHECK(GlobMatch(L"contoso\\*", L"CONTOSO\\Alice"));
+
+	// Only '*' and '?' are special
+	CHECK(GlobMatch(L"[a]", L"[A]"));
+	CHECK(!GlobMatch(L"[a]", L"a"));
+	CHECK(GlobMatch(L"Service-0x0-3e7$", L"service-0X0-3E7$"));
+}
+
+TEST_CASE(Selector_PatternLists)
+{
+	// An empty selector matches everything
+	Selector selector;
+	CHECK(selector.IsEmpty());
+	CHECK(selector.Matches(L""));
+	CHECK(selector.Matches(L"anything"));
+
+	// Comma-separated alternatives; empty entries are skipped
+	std::wstring sErrorInfo;
+	CHECK(selector.Add(L"Console,,RDP-Tcp#*,", sErrorInfo));
+	CHECK(sErrorInfo.empty());
+	CHECK(!selector.IsEmpty());
+	CHECK(selector.Matches(L"console"));
+	CHECK(selector.Matches(L"RDP-Tcp#3"));
+	CHECK(!selector.Matches(L"Services"));
+	CHECK(!selector.Matches(L""));
+
+	// Repeated options accumulate
+	CHECK(selector.Add(L"Serv?ces", sErrorInfo));
+	CHECK(selector.Matches(L"Services"));
+	CHECK(selector.Matches(L"Console"));
+}
+
+TEST_CASE(Selector_RejectsEmptyPatternLists)
+{
+	// A selector with no patterns would select everything, so an option that gives none is an error
+	const wchar_t* empty[] = { L"", L",", L",,," };
+	for (size_t ix = 0; ix < sizeof(empty) / sizeof(empty[0]); ++ix)
+	{
+		Selector selector;
+		std::wstring sErrorInfo;
+		CHECK(!selector.Add(empty[ix], sErrorInfo));
+		CHECK(!sErrorInfo.empty());
+		CHECK(selector.IsEmpty());
+	}
+
+	// Patterns added earlier are kept
+	Selector selector;
+	std::wstring sErrorInfo;
+	CHECK(selector.Add(L"Console", sErrorInfo));
+	CHECK(!selector.Add(L",", sErrorInfo));
+	CHECK(selector.Matches(L"Console"));
+	CHECK(!selector.Matches(L"Services"));
+}
+
+TEST_CASE(SelectionOptions_MatchesSessions)
+{
+	SelectionOptions_t selection;
+	CHECK(selection.IsEmpty());
+	CHECK(selection.MatchesSession(0, L"Services", L"", L"", L"Disconnected"));
+
+	// Sessions by ID or name
+	std::wstring sErrorInfo;
+	CHECK(selection.sessions.Add(L"1?,Console", sErrorInfo));
+	CHECK(!selection.IsEmpty());
+	CHECK(selection.MatchesSession(12, L"RDP-Tcp#0", L"CONTOSO", L"bob", L"Active"));
+	CHECK(selection.MatchesSession(1, L"Console", L"CONTOSO", L"alice", L"Active"));
+	CHECK(!selection.MatchesSession(1, L"RDP-Tcp#1", L"CONTOSO", L"alice", L"Active"));
+
+	// Users as user or DOMAIN\user; a session with no domain matches only by user
+	SelectionOptions_t byUser;
+	CHECK(byUser.users.Add(L"alice,contoso\\b*", sErrorInfo));
+	CHECK(byUser.MatchesSession(1, L"Console", L"CONTOSO", L"Alice", L"Active"));
+	CHECK(byUser.MatchesSession(2, L"RDP-Tcp#0", L"CONTOSO", L"bob", L"Active"));
+	CHECK(!byUser.MatchesSession(2, L"RDP-Tcp#0", L"FABRIKAM", L"bob", L"Active"));
+	CHECK(!byUser.MatchesSession(2, L"RDP-Tcp#0", L"", L"bob", L"Active"));
+	CHECK(!byUser.MatchesSession(0, L"Services", L"", L"", L"Disconnected"));
+
+	// Every selector that's set has to match
+	CHECK(byUser.states.Add(L"Active", sErrorInfo));
+	CHECK(byUser.MatchesSession(1, L"Console", L"CONTOSO", L"alice", L"Active"));
+	CHECK(!byUser.MatchesSession(1, L"Console", L"CONTOSO", L"alice", L"Disconnected"));
+
+	// Window stations and desktops are matched by name
+	CHECK(selection.windowStations.Add(L"WinSta0", sErrorInfo));
+	CHECK(selection.MatchesWindowStation(L"winsta0"));
+	CHECK(!selection.MatchesWindowStation(L"Service-0x0-3e7$"));
+	CHECK(selection.MatchesDesktop(L"Winlogon"));
+}
@@ -0,0 +1,248 @@
+// SessionEventsTests.cpp: tests of the --events path over synthetic session events -- how the dispatcher batches
+// them, and how SnapshotUpdater patches the snapshot and reports what changed.
+
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SessionEvents.h"
+#include "SnapshotUpdater.h"
+
+// Internal helper: an event
+static SessionEvent_t Event(SessionEventType_t type, uint32_t dwSessionId)
+{
+	SessionEvent_t event;
+	event.type = type;
+	event.dwSessionId = dwSessionId;
+	return event;
+}
+
+/// <summary>
+/// Refresh target that records the calls made on it
+/// </summary>
+class RecordingRefreshTarget : public ISessionRefreshTarget
+{
+public:
+	std::vector<SessionUpdateList_t> batches;
+	size_t nFullResyncs = 0;
+
+	void UpdateSessions(const SessionUpdateList_t& updates) override { batches.push_back(updates); }
+	void FullResync() override { ++nFullResyncs; }
+};
+
+/// <summary>
+/// Delta target that keeps each update's differences, the sessions it was given as the later sample, and how
+/// many differences had been reported when each full resync began
+/// </summary>
+class RecordingDeltaTarget : public ISnapshotDeltaTarget
+{
+public:
+	std::vector<SnapshotDiff_t> diffs;
+	std::vector<size_t> afterSessionCounts;
+	std::vector<size_t> resyncDiffCounts;
+
+	void ReportDelta(const SnapshotDiff_t& diff, const SystemSnapshot_t& after) override
+	{
+		diffs.push_back(diff);
+		afterSessionCounts.push_back(after.sessions.value.size());
+	}
+
+	void BeginFullResync() override
+	{
+		resyncDiffCounts.push_back(diffs.size());
+	}
+};
+
+// Internal helper: the session IDs of the changes of one kind, in diff order
+static std::vector<uint32_t> SessionIds(const SnapshotDiff_t& diff, ChangeKind_t kind)
+{
+	std::vector<uint32_t> ids;
+	for (size_t ix = 0; ix < diff.sessions.size(); ++ix)
+	{
+		if (kind == diff.sessions[ix].kind)
+			ids.push_back(ChangeKind_t::Removed == kind ? diff.sessions[ix].before.dwSessionId : diff.sessions[ix].after.dwSessionId);
+	}
+	return ids;
+}
+
+// Internal helper: the session IDs in a snapshot, in order
+static std::vector<uint32_t> SnapshotSessionIds(const SystemSnapshot_t& snapshot)
+{
+	std::vector<uint32_t> ids;
+	for (size_t ix = 0; ix < snapshot.sessions.value.size(); ++ix)
+		ids.push_back(snapshot.sessions.value[ix].dwSessionId);
+	return ids;
+}
+
+// Internal helper: a user's session, as the fake source serves it
+static SessionSnapshot_t UserSession(uint32_t dwSessionId, uint32_t state, const wchar_t* szState, const wchar_t* szUserName)
+{
+	SessionSnapshot_t session;
+	session.dwSessionId = dwSessionId;
+	session.sName = L"RDP-Tcp#" + std::to_wstring(dwSessionId);
+	session.state = state;
+	session.sState = szState;
+	session.sDomainName = L"CONTOSO";
+	session.sUserName = szUserName;
+	return session;
+}
+
+// Internal helper: collection options for the given fields
+static CollectionOptions_t Options(const wchar_t* szFieldList)
+{
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(szFieldList, options.fields, sErrorInfo));
+	return options;
+}
+
+TEST_CASE(SessionEventDispatcher_BatchesEventsPerSession)
+{
+	RecordingRefreshTarget target;
+	SessionEventDispatcher dispatcher(target);
+	dispatcher.Dispatch({
+		Event(SessionEventType_t::Create, 2), Event(SessionEventType_t::Logon, 2), Event(SessionEventType_t::Lock, 1),
+		Event(SessionEventType_t::Terminate, 3), Event(SessionEventType_t::Unlock, 1), Event(SessionEventType_t::Logoff, 2),
+		Event(SessionEventType_t::Terminate, 2), Event(SessionEventType_t::Terminate, 4), Event(SessionEventType_t::Create, 4) });
+
+	// One call for the whole batch; each session once, in order of its first event, its last event deciding
+	CHECK_EQUAL((size_t)1, target.batches.size());
+	const SessionUpdateList_t& updates = target.batches[0];
+	CHECK_EQUAL((size_t)4, updates.size());
+	const uint32_t expectedIds[] = { 2, 1, 3, 4 };
+	const bool expectedRemove[] = { true, false, true, false };
+	for (size_t ix = 0; ix < updates.size() && ix < 4; ++ix)
+	{
+		CHECK_EQUAL(expectedIds[ix], updates[ix].dwSessionId);
+		CHECK_EQUAL(expectedRemove[ix], updates[ix].bRemove);
+	}
+
+	// Nothing to do for no events
+	dispatcher.Dispatch(std::vector<SessionEvent_t>());
+	CHECK_EQUAL((size_t)1, target.batches.size());
+	CHECK_EQUAL((size_t)0, target.nFullResyncs);
+}
+
+TEST_CASE(SessionEventQueue_DeliversUntilStopped)
+{
+	SessionEventQueue queue;
+	std::vector<SessionEvent_t> events;
+	// Times out with nothing queued
+	CHECK(queue.Wait(1, events));
+	CHECK(events.empty());
+
+	queue.Post(Event(SessionEventType_t::Logon, 2));
+	queue.Post(Event(SessionEventType_t::Lock, 1));
+	CHECK(queue.Wait(1000, events));
+	CHECK_EQUAL((size_t)2, events.size());
+	CHECK_EQUAL((uint32_t)1, events[1].dwSessionId);
+	CHECK(queue.Wait(1, events));
+	CHECK(events.empty());
+
+	queue.Stop();
+	queue.Post(Event(SessionEventType_t::Logoff, 2));
+	CHECK(!queue.Wait(1000, events));
+	CHECK(events.empty());
+}
+
+TEST_CASE(SnapshotUpdater_PatchesSessionsInPlace)
+{
+	CountingSystemSource source;
+	SnapshotCollector collector(source, Options(L"id,state,user,processes"));
+	SystemSnapshot_t snapshot;
+	collector.Collect(snapshot);
+	const ProcessSnapshot_t* pServicesProcesses = snapshot.sessions.value[0].processes.value.data();
+	RecordingDeltaTarget deltaTarget;
+	SnapshotUpdater updater(collector, deltaTarget, snapshot);
+	SessionEventDispatcher dispatcher(updater);
+	const size_t nEnumerateSessions = source.Counts().nEnumerateSessions;
+	const size_t nEnumerateProcesses = source.Counts().nEnumerateProcesses;
+
+	// Alice disconnects while bob logs on to a new session
+	source.SetSession(UserSession(1, 4, L"Disconnected", L"alice"));
+	source.SetSession(UserSession(2, 0, L"Active", L"bob"));
+	source.AddProcess(2, 5200, L"explorer.exe", CountingSystemSource::AliceSid());
+	dispatcher.Dispatch({ Event(SessionEventType_t::RemoteDisconnect, 1), Event(SessionEventType_t::Create, 2), Event(SessionEventType_t::Logon, 2) });
+
+	// One process enumeration for both sessions, and no session enumeration
+	CHECK_EQUAL(nEnumerateProcesses + 1, (size_t)source.Counts().nEnumerateProcesses);
+	CHECK_EQUAL(nEnumerateSessions, (size_t)source.Counts().nEnumerateSessions);
+
+	// Only the two sessions are compared and reported
+	CHECK_EQUAL((size_t)1, deltaTarget.diffs.size());
+	CHECK_EQUAL((size_t)2, deltaTarget.afterSessionCounts[0]);
+	CHECK(std::vector<uint32_t>({ 1 }) == SessionIds(deltaTarget.diffs[0], ChangeKind_t::Changed));
+	CHECK(std::vector<uint32_t>({ 2 }) == SessionIds(deltaTarget.diffs[0], ChangeKind_t::Added));
+	CHECK(deltaTarget.diffs[0].processes.empty());
+
+	// Updated in place: the untouched session keeps its process list, and the new session goes at the end
+	CHECK(std::vector<uint32_t>({ 0, 1, 2 }) == SnapshotSessionIds(snapshot));
+	CHECK(pServicesProcesses == snapshot.sessions.value[0].processes.value.data());
+	CHECK_EQUAL(std::wstring(L"Disconnected"), snapshot.sessions.value[1].sState);
+	CHECK_EQUAL((size_t)1, snapshot.sessions.value[2].processes.value.size());
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), snapshot.sessions.value[2].processes.value[0].user.Name());
+
+	// A session that reconnects with nothing changed is reported as unchanged
+	dispatcher.Dispatch({ Event(SessionEventType_t::RemoteConnect, 2) });
+	CHECK_EQUAL((size_t)2, deltaTarget.diffs.size());
+	CHECK(deltaTarget.diffs[1].IsEmpty());
+
+	// Session updates keep the caches
+	CHECK(deltaTarget.resyncDiffCounts.empty());
+}
+
+TEST_CASE(SnapshotUpdater_RemovesEndedSessions)
+{
+	CountingSystemSource source;
+	SnapshotCollector collector(source, Options(L"id,state,processes"));
+	SystemSnapshot_t snapshot;
+	collector.Collect(snapshot);
+	RecordingDeltaTarget deltaTarget;
+	SnapshotUpdater updater(collector, deltaTarget, snapshot);
+	SessionEventDispatcher dispatcher(updater);
+	const size_t nEnumerateProcesses = source.Counts().nEnumerateProcesses;
+
+	// Terminate removes without querying; a session that has ended before it's refreshed is removed too
+	source.SetSession(UserSession(2, 0, L"Active", L"bob"));
+	dispatcher.Dispatch({ Event(SessionEventType_t::Create, 2) });
+	source.EndSession(1);
+	source.EndSession(2);
+	dispatcher.Dispatch({ Event(SessionEventType_t::Terminate, 1) });
+	CHECK_EQUAL(nEnumerateProcesses + 1, (size_t)source.Counts().nEnumerateProcesses);
+	dispatcher.Dispatch({ Event(SessionEventType_t::Logoff, 2) });
+	CHECK_EQUAL(nEnumerateProcesses + 1, (size_t)source.Counts().nEnumerateProcesses);
+
+	CHECK(std::vector<uint32_t>({ 0 }) == SnapshotSessionIds(snapshot));
+	CHECK_EQUAL((size_t)3, deltaTarget.diffs.size());
+	CHECK(std::vector<uint32_t>({ 1 }) == SessionIds(deltaTarget.diffs[1], ChangeKind_t::Removed));
+	CHECK(std::vector<uint32_t>({ 2 }) == SessionIds(deltaTarget.diffs[2], ChangeKind_t::Removed));
+
+	// Ending a session the snapshot doesn't have reports nothing
+	dispatcher.Dispatch({ Event(SessionEventType_t::Terminate, 7) });
+	CHECK(deltaTarget.diffs.back().IsEmpty());
+}
+
+TEST_CASE(SnapshotUpdater_ResyncsWithoutSessionList)
+{
+	CountingSystemSource source;
+	SnapshotCollector collector(source, Options(L"id,state"));
+	SystemSnapshot_t snapshot;
+	snapshot.sessions.SetError(L"Access is denied.");
+	RecordingDeltaTarget deltaTarget;
+	SnapshotUpdater updater(collector, deltaTarget, snapshot);
+	SessionEventDispatcher dispatcher(updater);
+
+	// Nothing to patch, so the event brings a full collection
+	dispatcher.Dispatch({ Event(SessionEventType_t::Logon, 1) });
+	CHECK_EQUAL((size_t)1, (size_t)source.Counts().nEnumerateSessions);
+	CHECK(snapshot.sessions.bValid);
+	CHECK(std::vector<uint32_t>({ 0, 1 }) == SnapshotSessionIds(snapshot));
+	CHECK_EQUAL((size_t)1, deltaTarget.diffs.size());
+	CHECK(deltaTarget.diffs[0].bSessionEnumChanged);
+
+	// The caches were flushed before the collection, as each polled sample does
+	CHECK(std::vector<size_t>({ 0 }) == deltaTarget.resyncDiffCounts);
+	updater.FullResync();
+	CHECK(std::vector<size_t>({ 0, 1 }) == deltaTarget.resyncDiffCounts);
+	CHECK_EQUAL((size_t)2, deltaTarget.diffs.size());
+}
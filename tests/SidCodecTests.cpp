@@ -0,0 +1,150 @@
+// SidCodecTests.cpp: tests of SID formatting and parsing -- known forms, binary -> string -> binary round trips,
+// and strings ConvertStringSidToSid rejects.
+
+#include <random>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "SidCodec.h"
+
+// Internal helper: binary SID from an identifier authority and subauthorities
+static std::vector<uint8_t> MakeSid(uint64_t authority, const std::vector<uint32_t>& subAuthorities)
+{
+	std::vector<uint8_t> sid;
+	sid.push_back(1);
+	sid.push_back((uint8_t)subAuthorities.size());
+	for (size_t ix = 0; ix < 6; ++ix)
+		sid.push_back((uint8_t)(authority >> (8 * (5 - ix))));
+	for (size_t ixSub = 0; ixSub < subAuthorities.size(); ++ixSub)
+	{
+		for (size_t ix = 0; ix < 4; ++ix)
+			sid.push_back((uint8_t)(subAuthorities[ixSub] >> (8 * ix)));
+	}
+	return sid;
+}
+
+TEST_CASE(SidCodec_FormatsKnownSids)
+{
+	std::vector<uint8_t> system = MakeSid(5, { 18 });
+	CHECK_EQUAL(std::wstring(L"S-1-5-18"), SidCodec::ToString(system.data(), system.size()));
+	std::vector<uint8_t> user = MakeSid(5, { 21, 1004336348, 1177238915, 682003330, 1001 });
+	CHECK_EQUAL(std::wstring(L"S-1-5-21-1004336348-1177238915-682003330-1001"), SidCodec::ToString(user.data(), user.size()));
+	// No subauthorities
+	std::vector<uint8_t> null = MakeSid(0, {});
+	CHECK_EQUAL(std::wstring(L"S-1-0"), SidCodec::ToString(null.data(), null.size()));
+	// Authorities of 2^32 and above are hexadecimal, all 12 digits, uppercase
+	std::vector<uint8_t> hex = MakeSid(0x123456789ABCULL, { 7 });
+	CHECK_EQUAL(std::wstring(L"S-1-0x123456789ABC-7"), SidCodec::ToString(hex.data(), hex.size()));
+	std::vector<uint8_t> twoTo32 = MakeSid(0x100000000ULL, { 4294967295U });
+	CHECK_EQUAL(std::wstring(L"S-1-0x000100000000-4294967295"), SidCodec::ToString(twoTo32.data(), twoTo32.size()));
+	std::vector<uint8_t> below = MakeSid(0xFFFFFFFFULL, {});
+	CHECK_EQUAL(std::wstring(L"S-1-4294967295"), SidCodec::ToString(below.data(), below.size()));
+}
+
+TEST_CASE(SidCodec_LongestSidFillsMaxStringLength)
+{
+	std::vector<uint8_t> longest = MakeSid(0xFFFFFFFFFFFFULL, std::vector<uint32_t>(SidCodec::MaxSubAuthorities, 4294967295U));
+	CHECK_EQUAL(SidCodec::MaxBinaryLength, longest.size());
+	wchar_t szSid[SidCodec::MaxStringLength + 1];
+	CHECK_EQUAL(SidCodec::MaxStringLength, SidCodec::Format(longest.data(), longest.size(), szSid, SidCodec::MaxStringLength + 1));
+	// No room for the terminating null
+	CHECK_EQUAL((size_t)0, SidCodec::Format(longest.data(), longest.size(), szSid, SidCodec::MaxStringLength));
+
+	uint8_t buf[SidCodec::MaxBinaryLength];
+	CHECK_EQUAL(SidCodec::MaxBinaryLength, SidCodec::Parse(szSid, SidCodec::MaxStringLength, buf, sizeof(buf)));
+	CHECK(std::vector<uint8_t>(buf, buf + sizeof(buf)) == longest);
+	CHECK_EQUAL((size_t)0, SidCodec::Parse(szSid, SidCodec::MaxStringLength, buf, sizeof(buf) - 1));
+}
+
+TEST_CASE(SidCodec_BinaryLength)
+{
+	std::vector<uint8_t> sid = MakeSid(5, { 21, 1, 2, 3 });
+	CHECK_EQUAL((size_t)24, SidCodec::BinaryLength(sid.data(), sid.size()));
+	// Trailing bytes are ignored; truncated SIDs are invalid
+	sid.push_back(0xAA);
+	CHECK_EQUAL((size_t)24, SidCodec::BinaryLength(sid.data(), sid.size()));
+	CHECK_EQUAL((size_t)0, SidCodec::BinaryLength(sid.data(), 23));
+	CHECK_EQUAL((size_t)0, SidCodec::BinaryLength(sid.data(), 7));
+	CHECK_EQUAL((size_t)0, SidCodec::BinaryLength(nullptr, 24));
+	// Revision other than 1; more than 15 subauthorities
+	sid[0] = 2;
+	CHECK_EQUAL((size_t)0, SidCodec::BinaryLength(sid.data(), sid.size()));
+	std::vector<uint8_t> tooMany = MakeSid(5, std::vector<uint32_t>(16, 1));
+	CHECK_EQUAL((size_t)0, SidCodec::BinaryLength(tooMany.data(), tooMany.size()));
+	CHECK(SidCodec::ToString(tooMany.data(), tooMany.size()).empty());
+}
+
+TEST_CASE(SidCodec_RoundTripsRandomSids)
+{
+	std::mt19937_64 random(20240601);
+	for (size_t ixSid = 0; ixSid < 5000; ++ixSid)
+	{
+		// Small, 32-bit, and 48-bit authorities; any number of subauthorities, with small and large values
+		uint64_t authority = random();
+		switch (ixSid % 3)
+		{
+		case 0: authority %= 20; break;
+		case 1: authority &= 0xFFFFFFFFULL; break;
+		default: authority &= 0xFFFFFFFFFFFFULL; break;
+		}
+		std::vector<uint32_t> subAuthorities(random() % (SidCodec::MaxSubAuthorities + 1));
+		for (size_t ix = 0; ix < subAuthorities.size(); ++ix)
+			subAuthorities[ix] = (0 == random() % 4) ? (uint32_t)(random() % 1000) : (uint32_t)random();
+		std::vector<uint8_t> sid = MakeSid(authority, subAuthorities);
+
+		std::wstring sSid = SidCodec::ToString(sid.data(), sid.size());
+		std::vector<uint8_t> parsed;
+		CHECK(SidCodec::Parse(sSid, parsed));
+		CHECK(sid == parsed);
+		CHECK_EQUAL(sSid, SidCodec::ToString(parsed.data(), parsed.size()));
+	}
+}
+
+TEST_CASE(SidCodec_ParsesWhatWindowsAccepts)
+{
+	std::vector<uint8_t> sid;
+	CHECK(SidCodec::Parse(L"s-1-5-18", sid));
+	CHECK(MakeSid(5, { 18 }) == sid);
+	// Hexadecimal authorities are accepted in either case and formatted in decimal when they fit in 32 bits
+	CHECK(SidCodec::Parse(L"S-1-0x5-18", sid));
+	CHECK_EQUAL(std::wstring(L"S-1-5-18"), SidCodec::ToString(sid.data(), sid.size()));
+	CHECK(SidCodec::Parse(L"S-1-0X123456789abc-7", sid));
+	CHECK(MakeSid(0x123456789ABCULL, { 7 }) == sid);
+	// Leading zeros
+	CHECK(SidCodec::Parse(L"S-1-005-0018", sid));
+	CHECK(MakeSid(5, { 18 }) == sid);
+	CHECK(SidCodec::Parse(L"S-1-5", sid));
+	CHECK(MakeSid(5, {}) == sid);
+	// Only the given length is parsed
+	uint8_t buf[SidCodec::MaxBinaryLength];
+	CHECK_EQUAL((size_t)12, SidCodec::Parse(L"S-1-5-18-544", 8, buf, sizeof(buf)));
+}
+
+TEST_CASE(SidCodec_RejectsMalformedStrings)
+{
+	const wchar_t* malformed[] = {
+		L"", L"S", L"S-", L"S-1", L"S-1-", L"X-1-5-18", L"S1-5-18", L" S-1-5-18", L"S-1-5-18 ",
+		// Revision other than 1
+		L"S-0-5-18", L"S-2-5-18", L"S-01x-5",
+		// Empty fields and stray separators
+		L"S-1--18", L"S-1-5-", L"S-1-5--18", L"S-1-5-18-", L"S--1-5-18",
+		// Non-digits
+		L"S-1-5-1a", L"S-1-5-+18", L"S-1-5--1", L"S-1-x5-18", L"S-1-0x-18", L"S-1-0xG-18", L"S-1-5-0x12",
+		// Values too large: a decimal authority over 32 bits, a hex authority over 48, a subauthority over 32
+		L"S-1-4294967296-18", L"S-1-0x1000000000000-18", L"S-1-5-4294967296", L"S-1-5-99999999999999999999999",
+		// 16 subauthorities
+		L"S-1-5-1-2-3-4-5-6-7-8-9-10-11-12-13-14-15-16",
+	};
+	for (size_t ix = 0; ix < sizeof(malformed) / sizeof(malformed[0]); ++ix)
+	{
+		std::vector<uint8_t> sid(1, 0xFF);
+		if (SidCodec::Parse(malformed[ix], sid))
+			TestHarness::ReportFailure(__FILE__, __LINE__, "accepted " + TestHarness::Describe(malformed[ix]));
+		CHECK(sid.empty());
+	}
+	// 15 subauthorities is the most allowed
+	std::vector<uint8_t> sid;
+	CHECK(SidCodec::Parse(L"S-1-5-1-2-3-4-5-6-7-8-9-10-11-12-13-14-15", sid));
+	uint8_t buf[SidCodec::MaxBinaryLength];
+	CHECK_EQUAL((size_t)0, SidCodec::Parse(nullptr, 8, buf, sizeof(buf)));
+}
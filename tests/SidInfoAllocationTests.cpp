@@ -0,0 +1,173 @@
+// SidInfoAllocationTests.cpp: allocation benchmark of the SIDs in snapshot rows. Counts heap allocations (this file
+// replaces the global operator new for the whole test program) while building process rows and resolving their
+// owners' names, and compares with the old layout, a byte vector plus the string form and name as strings. Also
+// checks that SID name cache hits don't allocate.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SidNameBatch.h"
+#include "SidNameCache.h"
+
+// GCC warns about the free below when it inlines these replacements, not seeing that they pair malloc with free.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<size_t> nAllocations(0);
+
+void* operator new(size_t size)
+{
+	++nAllocations;
+	void* p = malloc(0 == size ? 1 : size);
+	if (nullptr == p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept
+{
+	free(p);
+}
+
+// SidInfo_t as it was: the binary SID, its string form, and its name, each allocated per row
+struct LegacySidInfo_t
+{
+	std::vector<uint8_t> bytes;
+	std::wstring sSid;
+	std::wstring sDomainAndUsername;
+};
+
+struct LegacyProcess_t
+{
+	uint32_t dwPID = 0;
+	LegacySidInfo_t user;
+};
+
+// Number of process rows per measurement
+static const size_t RowCount = 10000;
+
+// Internal helper: microseconds since start
+static long long Microseconds(const std::chrono::steady_clock::time_point& start)
+{
+	return (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST_CASE(Benchmark_SidInfoRowAllocations)
+{
+	const wchar_t* userSids[] = { CountingSystemSource::SystemSid(), CountingSystemSource::AliceSid(), CountingSystemSource::OrphanSid() };
+	std::vector<SidInfo_t> owners;
+	std::vector<LegacySidInfo_t> legacyOwners;
+	for (size_t ix = 0; ix < 3; ++ix)
+	{
+		owners.push_back(CountingSystemSource::MakeSid(userSids[ix]));
+		owners.back().SetName(L"CONTOSO\\owner-of-many-processes");
+		LegacySidInfo_t legacy;
+		legacy.bytes.assign(owners.back().Data(), owners.back().Data() + owners.back().Length());
+		legacy.sSid = userSids[ix];
+		legacy.sDomainAndUsername = owners.back().Name();
+		legacyOwners.push_back(legacy);
+	}
+
+	// Rows with the old layout: every copied owner allocates its bytes and both strings.
+	std::vector<LegacyProcess_t> legacyRows;
+	legacyRows.reserve(RowCount);
+	size_t nBefore = nAllocations;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t ix = 0; ix < RowCount; ++ix)
+	{
+		legacyRows.push_back(LegacyProcess_t());
+		legacyRows.back().dwPID = (uint32_t)ix * 4;
+		legacyRows.back().user = legacyOwners[ix % 3];
+	}
+	const long long legacyMicroseconds = Microseconds(start);
+	const size_t nLegacyAllocations = nAllocations - nBefore;
+
+	// Rows with inline SIDs and shared names
+	SessionSnapshot_t session;
+	session.processes.value.reserve(RowCount);
+	nBefore = nAllocations;
+	start = std::chrono::steady_clock::now();
+	for (size_t ix = 0; ix < RowCount; ++ix)
+	{
+		session.processes.value.push_back(ProcessSnapshot_t());
+		session.processes.value.back().dwPID = (uint32_t)ix * 4;
+		session.processes.value.back().user = owners[ix % 3];
+	}
+	const long long inlineMicroseconds = Microseconds(start);
+	const size_t nInlineAllocations = nAllocations - nBefore;
+
+	printf("  %zu process rows: %zu allocations, %lld us with byte vector and strings; %zu allocations, %lld us inline\n",
+		RowCount, nLegacyAllocations, legacyMicroseconds, nInlineAllocations, inlineMicroseconds);
+	CHECK_EQUAL((size_t)3 * RowCount, nLegacyAllocations);
+	CHECK_EQUAL((size_t)0, nInlineAllocations);
+}
+
+TEST_CASE(Benchmark_SidNameResolutionAllocations)
+{
+	// Resolving the owners' names allocates per distinct SID, not per row: one shared name each, plus the
+	// batch's bookkeeping, which grows logarithmically with the rows.
+	CountingSystemSource source;
+	const wchar_t* userSids[] = { CountingSystemSource::SystemSid(), CountingSystemSource::AliceSid(), CountingSystemSource::OrphanSid() };
+	size_t nAllocationsForRows[2] = { 0, 0 };
+	const size_t rowCounts[2] = { 100, RowCount };
+	for (size_t ixRun = 0; ixRun < 2; ++ixRun)
+	{
+		SessionSnapshot_t session;
+		for (size_t ix = 0; ix < rowCounts[ixRun]; ++ix)
+		{
+			session.processes.value.push_back(ProcessSnapshot_t());
+			session.processes.value.back().user = CountingSystemSource::MakeSid(userSids[ix % 3]);
+		}
+
+		size_t nBefore = nAllocations;
+		{
+			SidNameBatch batch;
+			batch.AddSession(session);
+			batch.Resolve(source);
+		}
+		nAllocationsForRows[ixRun] = nAllocations - nBefore;
+
+		CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), session.processes.value[1].user.Name());
+		// Every reference to a SID shares its one name
+		CHECK(session.processes.value[1].user.pName == session.processes.value[4].user.pName);
+	}
+	printf("  Resolving names: %zu allocations for %zu rows, %zu for %zu rows\n",
+		nAllocationsForRows[0], rowCounts[0], nAllocationsForRows[1], rowCounts[1]);
+	CHECK(nAllocationsForRows[1] < nAllocationsForRows[0] + 32);
+}
+
+TEST_CASE(Benchmark_SidNameCacheHitAllocations)
+{
+	// A cached SID is found without allocating: the cache is keyed by the SID bytes held inline, and the names are
+	// copied into strings that already have room for them.
+	SidNameCache cache([](const uint8_t* /*pSid*/, size_t /*cbSid*/, std::wstring& sDomainName, std::wstring& sUserName) {
+		sDomainName = L"CONTOSO";
+		sUserName = L"owner-of-many-processes";
+		return true;
+	}, 1);
+	cache.SetTimeout(0);
+	const SidInfo_t sid = CountingSystemSource::MakeSid(CountingSystemSource::AliceSid());
+	std::wstring sDomainName, sUserName;
+	CHECK(cache.Lookup(sid.Data(), sid.Length(), sDomainName, sUserName));
+
+	const size_t nBefore = nAllocations;
+	for (size_t ix = 0; ix < RowCount; ++ix)
+		CHECK(cache.Lookup(sid.Data(), sid.Length(), sDomainName, sUserName));
+	const size_t nHitAllocations = nAllocations - nBefore;
+	printf("  %zu cache hits: %zu allocations\n", RowCount, nHitAllocations);
+	CHECK_EQUAL((size_t)0, nHitAllocations);
+	CHECK_EQUAL(std::wstring(L"owner-of-many-processes"), sUserName);
+	CHECK_EQUAL((uint64_t)RowCount, cache.Hits());
+}
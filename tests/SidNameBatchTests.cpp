@@ -0,0 +1,226 @@
+// SidNameBatchTests.cpp: tests of collect -> resolve -> render with a fake batch resolver: the SIDs a collection
+// gathers are resolved through a SidNameCache's batch lookup, under its deadline, the way LiveSystemSource does.
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SnapshotCollector.h"
+#include "SidNameCache.h"
+#include "SidCodec.h"
+#include "QueryPlan.h"
+
+/// <summary>
+/// Fake batch resolver that names the CountingSystemSource SIDs (except its orphan), counts its calls, and can be
+/// made to fail or to block until released
+/// </summary>
+class FakeBatchLookup
+{
+public:
+	FakeBatchLookup() : m_nBatches(0), m_nSids(0), m_nSingles(0), m_bFail(false), m_bBlocked(false)
+	{
+		m_names[CountingSystemSource::SystemSid()] = L"NT AUTHORITY|SYSTEM";
+		m_names[CountingSystemSource::AliceSid()] = L"CONTOSO|alice";
+	}
+
+	SidNameCache::BatchLookupFn_t BatchFn()
+	{
+		return [this](SidNameCache::BatchItemList_t& items, std::wstring& sErrorInfo)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			++m_nBatches;
+			m_nSids += items.size();
+			m_cv.wait(lock, [this]() { return !m_bBlocked; });
+			if (m_bFail)
+			{
+				sErrorInfo = L"batch failed";
+				return false;
+			}
+			for (size_t ix = 0; ix < items.size(); ++ix)
+				items[ix].bFound = Name(items[ix].pSid, items[ix].cbSid, items[ix].sDomainName, items[ix].sUserName);
+			return true;
+		};
+	}
+
+	SidNameCache::LookupFn_t SingleFn()
+	{
+		return [this](const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_nSingles;
+			return Name(pSid, cbSid, sDomainName, sUserName);
+		};
+	}
+
+	void SetFail(bool bFail) { std::lock_guard<std::mutex> lock(m_mutex); m_bFail = bFail; }
+	void Block() { std::lock_guard<std::mutex> lock(m_mutex); m_bBlocked = true; }
+	void Release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bBlocked = false;
+		}
+		m_cv.notify_all();
+	}
+
+	size_t Batches() { std::lock_guard<std::mutex> lock(m_mutex); return m_nBatches; }
+	size_t Sids() { std::lock_guard<std::mutex> lock(m_mutex); return m_nSids; }
+	size_t Singles() { std::lock_guard<std::mutex> lock(m_mutex); return m_nSingles; }
+
+private:
+	// The caller must hold the lock
+	bool Name(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName) const
+	{
+		std::map<std::wstring, std::wstring>::const_iterator nameIter = m_names.find(SidCodec::ToString(pSid, cbSid));
+		if (m_names.end() == nameIter)
+			return false;
+		const size_t ixSeparator = nameIter->second.find(L'|');
+		sDomainName = nameIter->second.substr(0, ixSeparator);
+		sUserName = nameIter->second.substr(ixSeparator + 1);
+		return true;
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::map<std::wstring, std::wstring> m_names;
+	size_t m_nBatches, m_nSids, m_nSingles;
+	bool m_bFail, m_bBlocked;
+};
+
+/// <summary>
+/// CountingSystemSource whose batch lookup goes through a SidNameCache, as LiveSystemSource's does
+/// </summary>
+class CachedNamesSource : public CountingSystemSource
+{
+public:
+	explicit CachedNamesSource(SidNameCache& nameCache) : m_nameCache(nameCache) {}
+
+	bool LookupSidNames(std::vector<SidInfo_t>& sids, std::wstring& sErrorInfo) override
+	{
+		sErrorInfo.clear();
+		SidNameCache::BatchItemList_t items(sids.size());
+		for (size_t ix = 0; ix < sids.size(); ++ix)
+		{
+			items[ix].pSid = sids[ix].Data();
+			items[ix].cbSid = sids[ix].Length();
+		}
+		m_nameCache.LookupBatch(items);
+		for (size_t ix = 0; ix < sids.size(); ++ix)
+		{
+			sids[ix].SetName(items[ix].bFound ? items[ix].sDomainName + L"\\" + items[ix].sUserName : std::wstring());
+		}
+		return true;
+	}
+
+private:
+	SidNameCache& m_nameCache;
+};
+
+// Internal helper: collect the sessions' processes, and render each process's user as the report does
+static std::vector<std::wstring> CollectProcessUsers(CachedNamesSource& source)
+{
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"id,processes", options.fields, sErrorInfo));
+	SnapshotCollector collector(source, options);
+	SystemSnapshot_t snapshot;
+	collector.Collect(snapshot);
+
+	std::vector<std::wstring> users;
+	const SessionSnapshot_t& console = snapshot.sessions.value[1];
+	for (size_t ix = 0; ix < console.processes.value.size(); ++ix)
+		users.push_back(console.processes.value[ix].user.DisplayName());
+	return users;
+}
+
+TEST_CASE(SidNameBatch_ResolvesInOneBatchThenFromCache)
+{
+	FakeBatchLookup fake;
+	SidNameCache cache(fake.SingleFn(), fake.BatchFn());
+	CachedNamesSource source(cache);
+
+	std::vector<std::wstring> users = CollectProcessUsers(source);
+	CHECK_EQUAL((size_t)3, users.size());
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), users[0]);
+	// A SID that doesn't resolve renders as its string form
+	CHECK_EQUAL(std::wstring(CountingSystemSource::OrphanSid()), users[2]);
+	// The three distinct owners in one batch, on a resolver thread
+	CHECK_EQUAL((size_t)1, fake.Batches());
+	CHECK_EQUAL((size_t)3, fake.Sids());
+	CHECK_EQUAL((size_t)0, fake.Singles());
+	CHECK_EQUAL((uint64_t)3, cache.Misses());
+
+	// Collecting again is answered from the cache, including the failure
+	users = CollectProcessUsers(source);
+	CHECK_EQUAL(std::wstring(CountingSystemSource::OrphanSid()), users[2]);
+	CHECK_EQUAL((size_t)1, fake.Batches());
+	CHECK_EQUAL((uint64_t)3, cache.Hits());
+}
+
+TEST_CASE(SidNameBatch_TimeoutRendersSidStrings)
+{
+	FakeBatchLookup fake;
+	SidNameCache cache(fake.SingleFn(), fake.BatchFn());
+	cache.SetTimeout(50);
+	CachedNamesSource source(cache);
+	fake.Block();
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::wstring> users = CollectProcessUsers(source);
+	const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+	// The collection waited out one deadline for the whole batch, not one per SID
+	CHECK(elapsed < std::chrono::milliseconds(1000));
+	CHECK_EQUAL((size_t)3, users.size());
+	CHECK_EQUAL(std::wstring(CountingSystemSource::AliceSid()), users[0]);
+	CHECK_EQUAL(std::wstring(CountingSystemSource::AliceSid()), users[1]);
+	CHECK_EQUAL(std::wstring(CountingSystemSource::OrphanSid()), users[2]);
+	CHECK_EQUAL((uint64_t)3, cache.Timeouts());
+
+	// While the batch is still running, its SIDs fail at once instead of waiting again
+	std::vector<uint8_t> alice;
+	SidCodec::Parse(CountingSystemSource::AliceSid(), alice);
+	std::wstring sDomainName, sUserName;
+	CHECK(!cache.Lookup(alice.data(), alice.size(), sDomainName, sUserName));
+	CHECK_EQUAL((uint64_t)4, cache.Timeouts());
+
+	// Once it finishes, its results are cached as usual
+	fake.Release();
+	bool bFound = false;
+	for (size_t ixTry = 0; ixTry < 500 && !cache.Find(alice.data(), alice.size(), bFound, sDomainName, sUserName); ++ixTry)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(bFound);
+	CHECK_EQUAL(std::wstring(L"alice"), sUserName);
+	CHECK_EQUAL((size_t)1, fake.Batches());
+}
+
+TEST_CASE(SidNameBatch_FailedBatchFallsBackToSingleLookups)
+{
+	FakeBatchLookup fake;
+	fake.SetFail(true);
+	SidNameCache cache(fake.SingleFn(), fake.BatchFn());
+	CachedNamesSource source(cache);
+
+	std::vector<std::wstring> users = CollectProcessUsers(source);
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), users[0]);
+	CHECK_EQUAL(std::wstring(CountingSystemSource::OrphanSid()), users[2]);
+	CHECK_EQUAL((size_t)1, fake.Batches());
+	CHECK_EQUAL((size_t)3, fake.Singles());
+}
+
+TEST_CASE(SidNameBatch_WithoutBatchLookup)
+{
+	// A cache with only the single lookup resolves a batch's SIDs one at a time, in parallel
+	FakeBatchLookup fake;
+	SidNameCache cache(fake.SingleFn());
+	CachedNamesSource source(cache);
+
+	std::vector<std::wstring> users = CollectProcessUsers(source);
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), users[1]);
+	CHECK_EQUAL(std::wstring(CountingSystemSource::OrphanSid()), users[2]);
+	CHECK_EQUAL((size_t)0, fake.Batches());
+	CHECK_EQUAL((size_t)3, fake.Singles());
+}
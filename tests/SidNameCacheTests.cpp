@@ -0,0 +1,346 @@
+// SidNameCacheTests.cpp: tests of the SID name cache -- sharing lookups across threads, the lookup deadline,
+// the negative TTL, batch results, and the on-disk cache -- with a fake lookup function.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "TestHarness.h"
+#include "SidNameCache.h"
+#include "SidCacheFile.h"
+#include "SidCodec.h"
+
+/// <summary>
+/// Fake lookup: names SIDs whose last subauthority is below 1000, optionally after a delay or once released
+/// </summary>
+class FakeLookup
+{
+public:
+	FakeLookup() : m_nCalls(0), m_delayMilliseconds(0), m_bGated(false) {}
+
+	SidNameCache::LookupFn_t Fn()
+	{
+		return [this](const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+		{
+			return Lookup(pSid, cbSid, sDomainName, sUserName);
+		};
+	}
+
+	size_t Calls() const { return m_nCalls; }
+	std::thread::id LastThread()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_lastThread;
+	}
+	void SetDelay(uint32_t milliseconds) { m_delayMilliseconds = milliseconds; }
+
+	// Lookups block until Release
+	void Gate()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bGated = true;
+	}
+	void Release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bGated = false;
+		}
+		m_cv.notify_all();
+	}
+
+private:
+	bool Lookup(const uint8_t* pSid, size_t cbSid, std::wstring& sDomainName, std::wstring& sUserName)
+	{
+		++m_nCalls;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_lastThread = std::this_thread::get_id();
+			m_cv.wait(lock, [this]() { return !m_bGated; });
+		}
+		if (0 != m_delayMilliseconds)
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_delayMilliseconds));
+		uint32_t rid = pSid[cbSid - 4] | (pSid[cbSid - 3] << 8) | (pSid[cbSid - 2] << 16) | ((uint32_t)pSid[cbSid - 1] << 24);
+		if (rid >= 1000)
+			return false;
+		sDomainName = L"CONTOSO";
+		sUserName = L"user" + std::to_wstring(rid);
+		return true;
+	}
+
+	std::atomic<size_t> m_nCalls;
+	std::atomic<uint32_t> m_delayMilliseconds;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_bGated;
+	std::thread::id m_lastThread;
+};
+
+// Internal helper: binary SID S-1-5-21-1-2-3-rid
+static std::vector<uint8_t> Sid(uint32_t rid)
+{
+	std::vector<uint8_t> sid;
+	SidCodec::Parse(L"S-1-5-21-1-2-3-" + std::to_wstring(rid), sid);
+	return sid;
+}
+
+// Internal helper: look up a SID and return its user name, or "(none)"
+static std::wstring LookupUser(SidNameCache& cache, const std::vector<uint8_t>& sid)
+{
+	std::wstring sDomainName, sUserName;
+	if (!cache.Lookup(sid.data(), sid.size(), sDomainName, sUserName))
+		return L"(none)";
+	return sUserName;
+}
+
+// Internal helper: wait until a lookup running in the background has completed
+static bool WaitForResult(SidNameCache& cache, const std::vector<uint8_t>& sid)
+{
+	for (int ix = 0; ix < 500; ++ix)
+	{
+		bool bFound;
+		std::wstring sDomainName, sUserName;
+		if (cache.Find(sid.data(), sid.size(), bFound, sDomainName, sUserName))
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+TEST_CASE(SidNameCache_EachSidLookedUpOnce)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	for (int ix = 0; ix < 100; ++ix)
+	{
+		CHECK_EQUAL(std::wstring(L"user500"), LookupUser(cache, Sid(500)));
+		CHECK_EQUAL(std::wstring(L"user501"), LookupUser(cache, Sid(501)));
+	}
+	CHECK_EQUAL((size_t)2, fake.Calls());
+	CHECK_EQUAL((uint64_t)2, cache.Misses());
+	CHECK_EQUAL((uint64_t)198, cache.Hits());
+	CHECK_EQUAL((size_t)2, cache.Size());
+
+	std::wstring sDomainName, sUserName;
+	CHECK(!cache.Lookup(nullptr, 0, sDomainName, sUserName));
+}
+
+TEST_CASE(SidNameCache_ConcurrentCallersShareOneLookup)
+{
+	FakeLookup fake;
+	fake.SetDelay(20);
+	SidNameCache cache(fake.Fn(), 4);
+	std::atomic<size_t> nWrong(0);
+	std::vector<std::thread> threads;
+	for (uint32_t ixThread = 0; ixThread < 16; ++ixThread)
+	{
+		threads.push_back(std::thread([&cache, &nWrong, ixThread]()
+		{
+			for (uint32_t ix = 0; ix < 8; ++ix)
+			{
+				uint32_t rid = 100 + (ix + ixThread) % 8;
+				if (LookupUser(cache, Sid(rid)) != L"user" + std::to_wstring(rid))
+					++nWrong;
+			}
+		}));
+	}
+	for (size_t ix = 0; ix < threads.size(); ++ix)
+		threads[ix].join();
+
+	CHECK_EQUAL((size_t)0, nWrong.load());
+	// One lookup per distinct SID, however many callers asked for it at once
+	CHECK_EQUAL((size_t)8, fake.Calls());
+	CHECK_EQUAL((uint64_t)8, cache.Misses());
+	CHECK_EQUAL((uint64_t)(16 * 8 - 8), cache.Hits());
+	CHECK_EQUAL((uint64_t)0, cache.Timeouts());
+}
+
+TEST_CASE(SidNameCache_DeadlineGivesUpAndLaterCallersDontWait)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetTimeout(50);
+	fake.Gate();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(7)));
+	std::chrono::steady_clock::duration firstWait = std::chrono::steady_clock::now() - start;
+	CHECK(firstWait >= std::chrono::milliseconds(45));
+	CHECK_EQUAL((uint64_t)1, cache.Timeouts());
+
+	// The lookup is still running; later callers fail at once instead of waiting out the deadline again
+	start = std::chrono::steady_clock::now();
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(7)));
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(40));
+	CHECK_EQUAL((uint64_t)2, cache.Timeouts());
+	CHECK_EQUAL((size_t)1, fake.Calls());
+
+	// Once it finishes, its result is cached as usual
+	fake.Release();
+	CHECK(WaitForResult(cache, Sid(7)));
+	CHECK_EQUAL(std::wstring(L"user7"), LookupUser(cache, Sid(7)));
+	CHECK_EQUAL((size_t)1, fake.Calls());
+}
+
+TEST_CASE(SidNameCache_NoDeadlineLooksUpOnCallingThread)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetTimeout(0);
+	CHECK_EQUAL(std::wstring(L"user9"), LookupUser(cache, Sid(9)));
+	CHECK(std::this_thread::get_id() == fake.LastThread());
+}
+
+TEST_CASE(SidNameCache_NegativeTtl)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetNegativeTtl(60);
+
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(4242)));
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(4242)));
+	// The failure is remembered, not retried
+	CHECK_EQUAL((size_t)1, fake.Calls());
+	bool bFound = true;
+	std::wstring sDomainName, sUserName;
+	std::vector<uint8_t> sid = Sid(4242);
+	CHECK(cache.Find(sid.data(), sid.size(), bFound, sDomainName, sUserName));
+	CHECK(!bFound);
+
+	// Until the TTL passes
+	std::this_thread::sleep_for(std::chrono::milliseconds(80));
+	CHECK(!cache.Find(sid.data(), sid.size(), bFound, sDomainName, sUserName));
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(4242)));
+	CHECK_EQUAL((size_t)2, fake.Calls());
+	CHECK_EQUAL((uint64_t)2, cache.Misses());
+}
+
+TEST_CASE(SidNameCache_AddCompletesWaitingLookup)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetTimeout(5000);
+	fake.Gate();
+
+	std::wstring sWaiterResult;
+	std::thread waiter([&cache, &sWaiterResult]() { sWaiterResult = LookupUser(cache, Sid(12)); });
+	// Let the waiter start its lookup, then supply the result as a batch translation would
+	while (0 == fake.Calls())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::vector<uint8_t> sid = Sid(12);
+	cache.Add(sid.data(), sid.size(), true, L"BATCH", L"batch12");
+	waiter.join();
+	CHECK_EQUAL(std::wstring(L"batch12"), sWaiterResult);
+
+	// The running lookup's later result doesn't replace the batch result
+	fake.Release();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	CHECK_EQUAL(std::wstring(L"batch12"), LookupUser(cache, Sid(12)));
+	CHECK_EQUAL((uint64_t)0, cache.Timeouts());
+}
+
+TEST_CASE(SidNameCache_FlushKeepsEntriesForSaving)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	LookupUser(cache, Sid(1));
+	LookupUser(cache, Sid(2));
+	LookupUser(cache, Sid(2000));
+	cache.Flush();
+	// Only the failure, within its TTL, is kept
+	CHECK_EQUAL((size_t)1, cache.Size());
+
+	// Looked up again after a flush
+	CHECK_EQUAL(std::wstring(L"user1"), LookupUser(cache, Sid(1)));
+	CHECK_EQUAL((size_t)4, fake.Calls());
+
+	// Successful lookups from before the flush are still saved; failures never are
+	SidCacheEntryList_t entries;
+	cache.Entries(entries);
+	size_t nUser2 = 0, nUser2000 = 0;
+	for (size_t ix = 0; ix < entries.size(); ++ix)
+	{
+		if (entries[ix].sid == Sid(2))
+			++nUser2;
+		if (entries[ix].sid == Sid(2000))
+			++nUser2000;
+	}
+	CHECK_EQUAL((size_t)1, nUser2);
+	CHECK_EQUAL((size_t)0, nUser2000);
+}
+
+TEST_CASE(SidNameCache_FlushKeepsFailuresAndRunningLookups)
+{
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetTimeout(50);
+	cache.SetNegativeTtl(200);
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(3000)));
+	fake.Gate();
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(33)));
+	CHECK_EQUAL((size_t)2, fake.Calls());
+	CHECK_EQUAL((uint64_t)1, cache.Timeouts());
+
+	// After a flush, as --watch does before each sample: the failed SID isn't retried within its TTL, and the hung
+	// lookup isn't submitted again -- its SID fails at once.
+	cache.Flush();
+	CHECK_EQUAL((size_t)2, cache.Size());
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(3000)));
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(33)));
+	CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(40));
+	CHECK_EQUAL((size_t)2, fake.Calls());
+	CHECK_EQUAL((uint64_t)2, cache.Timeouts());
+
+	// Once the hung lookup finishes, its result is cached; the next flush discards it like any name.
+	fake.Release();
+	CHECK(WaitForResult(cache, Sid(33)));
+	CHECK_EQUAL(std::wstring(L"user33"), LookupUser(cache, Sid(33)));
+	CHECK_EQUAL((size_t)2, fake.Calls());
+	cache.Flush();
+	CHECK_EQUAL(std::wstring(L"user33"), LookupUser(cache, Sid(33)));
+	CHECK_EQUAL((size_t)3, fake.Calls());
+
+	// A failure whose TTL has passed is discarded by a flush.
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+	cache.Flush();
+	CHECK_EQUAL((size_t)0, cache.Size());
+	CHECK_EQUAL(std::wstring(L"(none)"), LookupUser(cache, Sid(3000)));
+	CHECK_EQUAL((size_t)4, fake.Calls());
+}
+
+TEST_CASE(SidNameCache_OnDiskStore)
+{
+	SidCacheEntryList_t stored(2);
+	stored[0].sid = Sid(30);
+	stored[0].sDomainName = L"DISK";
+	stored[0].sUserName = L"fresh";
+	stored[0].timestamp = SidCacheFile::Now() - 60;
+	stored[1].sid = Sid(31);
+	stored[1].sDomainName = L"DISK";
+	stored[1].sUserName = L"stale";
+	stored[1].timestamp = SidCacheFile::Now() - 30 * 24 * 3600;
+	std::vector<uint8_t> data;
+	SidCacheFile::Write(stored, data);
+	SidCacheFile store;
+	std::wstring sErrorInfo;
+	CHECK(store.Attach(data.data(), data.size(), sErrorInfo));
+
+	FakeLookup fake;
+	SidNameCache cache(fake.Fn());
+	cache.SetStore(&store, 7 * 24 * 3600);
+	CHECK_EQUAL(std::wstring(L"fresh"), LookupUser(cache, Sid(30)));
+	CHECK_EQUAL((size_t)0, fake.Calls());
+	// Entries older than the maximum age are looked up again
+	CHECK_EQUAL(std::wstring(L"user31"), LookupUser(cache, Sid(31)));
+	CHECK_EQUAL((size_t)1, fake.Calls());
+
+	// Only what was looked up is saved back
+	cache.SetStore(nullptr, 0);
+	SidCacheEntryList_t entries;
+	cache.Entries(entries);
+	CHECK_EQUAL((size_t)1, entries.size());
+	CHECK(entries[0].sid == Sid(31));
+}
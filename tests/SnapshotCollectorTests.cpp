@@ -0,0 +1,195 @@
+// SnapshotCollectorTests.cpp: tests of --fields projection -- which queries SnapshotCollector makes, and which it
+// skips, for a field list -- and of collection through a SystemSource.
+
+#include <string>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SnapshotCollector.h"
+#include "QueryPlan.h"
+
+// Internal helper: collect with the fields of a --fields list
+static void CollectFields(CountingSystemSource& source, const wchar_t* szFieldList, SystemSnapshot_t& snapshot, size_t nThreads = 1)
+{
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(szFieldList, options.fields, sErrorInfo));
+	options.nThreads = nThreads;
+	SnapshotCollector collector(source, options);
+	collector.Collect(snapshot);
+}
+
+TEST_CASE(Fields_ParseFieldList)
+{
+	FieldSet_t fields = Field_None;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"id,STATE,,user", fields, sErrorInfo));
+	CHECK_EQUAL((FieldSet_t)(Field_SessionId | Field_SessionState | Field_SessionUser), fields);
+	CHECK(ParseFieldList(L"all", fields, sErrorInfo));
+	CHECK_EQUAL(Field_All, fields);
+	CHECK(!ParseFieldList(L"id,bogus", fields, sErrorInfo));
+	CHECK_EQUAL(std::wstring(L"bogus"), sErrorInfo);
+	CHECK(!ParseFieldList(L",", fields, sErrorInfo));
+}
+
+TEST_CASE(Fields_IdStateSkipsSessionInfoAndDesktops)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"id,state", snapshot);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	CHECK_EQUAL((size_t)1, counts.nEnumerateSessions.load());
+	// No WTSSessionInfoEx, token, or process queries
+	CHECK_EQUAL((size_t)0, counts.nQuerySessionInfo.load());
+	CHECK_EQUAL((size_t)0, counts.nQueryUserToken.load());
+	CHECK_EQUAL((size_t)0, counts.nEnumerateProcesses.load());
+	// Nothing about window stations or desktops
+	CHECK_EQUAL((size_t)0, counts.nCurrentInfo.load());
+	CHECK_EQUAL((size_t)0, counts.nWindowStationNames.load());
+	CHECK_EQUAL((size_t)0, counts.nOpenWindowStation.load());
+	CHECK_EQUAL((size_t)0, counts.nOpenDesktop.load());
+	CHECK_EQUAL((size_t)0, counts.nHeapSize.load());
+	CHECK_EQUAL((size_t)0, counts.nIsReceivingInput.load());
+	// No SIDs were collected, so none are looked up
+	CHECK_EQUAL((size_t)0, counts.nLookupSidNames.load());
+	CHECK_EQUAL((size_t)0, counts.nLookupSidName.load());
+
+	CHECK(snapshot.sessions.bValid);
+	CHECK_EQUAL((size_t)2, snapshot.sessions.value.size());
+	CHECK_EQUAL(std::wstring(L"Console"), snapshot.sessions.value[1].sName);
+	CHECK_EQUAL(std::wstring(L"Active"), snapshot.sessions.value[1].sState);
+	CHECK(snapshot.sessions.value[1].sUserName.empty());
+	CHECK(!snapshot.windowStations.bValid);
+}
+
+TEST_CASE(Fields_UserQueriesSessionInfoOnly)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"id,user", snapshot);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	CHECK_EQUAL((size_t)2, counts.nQuerySessionInfo.load());
+	CHECK_EQUAL((size_t)0, counts.nQueryUserToken.load());
+	CHECK_EQUAL((size_t)0, counts.nEnumerateProcesses.load());
+	CHECK_EQUAL(std::wstring(L"alice"), snapshot.sessions.value[1].sUserName);
+}
+
+TEST_CASE(Fields_UserSelectorQueriesSessionInfo)
+{
+	// The user selector needs WTSSessionInfoEx even when no field does
+	CountingSystemSource source;
+	CollectionOptions_t options;
+	options.fields = Field_SessionId;
+	std::wstring sErrorInfo;
+	CHECK(options.selection.users.Add(L"alice", sErrorInfo));
+	SnapshotCollector collector(source, options);
+	SystemSnapshot_t snapshot;
+	collector.Collect(snapshot);
+
+	CHECK_EQUAL((size_t)2, source.Counts().nQuerySessionInfo.load());
+	CHECK_EQUAL((size_t)1, snapshot.sessions.value.size());
+	CHECK_EQUAL((uint32_t)1, snapshot.sessions.value[0].dwSessionId);
+}
+
+TEST_CASE(Fields_ProcessesEnumerateOnceForAllSessions)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"id,processes", snapshot, 4);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	CHECK_EQUAL((size_t)1, counts.nEnumerateProcesses.load());
+	CHECK_EQUAL((size_t)0, counts.nQuerySessionInfo.load());
+	// One batch lookup for the distinct process owners, none individually
+	CHECK_EQUAL((size_t)1, counts.nLookupSidNames.load());
+	CHECK_EQUAL((size_t)3, counts.nSidsLookedUp.load());
+	CHECK_EQUAL((size_t)0, counts.nLookupSidName.load());
+
+	const SessionSnapshot_t& console = snapshot.sessions.value[1];
+	CHECK(console.processes.bValid);
+	CHECK_EQUAL((size_t)3, console.processes.value.size());
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), console.processes.value[0].user.Name());
+	// Names that can't be resolved are left empty
+	CHECK(console.processes.value[2].user.Name().empty());
+}
+
+TEST_CASE(Fields_DesktopNamesDontOpenDesktops)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"winsta,desktop", snapshot);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	CHECK_EQUAL((size_t)0, counts.nEnumerateSessions.load());
+	CHECK_EQUAL((size_t)1, counts.nWindowStationNames.load());
+	// Window stations are opened to list their desktops, but nothing else is asked of them
+	CHECK_EQUAL((size_t)2, counts.nOpenWindowStation.load());
+	CHECK_EQUAL((size_t)2, counts.nDesktopNames.load());
+	CHECK_EQUAL((size_t)0, counts.nOpenDesktop.load());
+	CHECK_EQUAL((size_t)0, counts.nFlags.load());
+	CHECK_EQUAL((size_t)0, counts.nUser.load());
+	CHECK_EQUAL((size_t)0, counts.nSecurity.load());
+
+	CHECK(snapshot.windowStations.bValid);
+	CHECK_EQUAL((size_t)2, snapshot.windowStations.value.size());
+}
+
+TEST_CASE(Fields_WinstaOnlyDoesntOpenWindowStations)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"winsta", snapshot);
+	CHECK_EQUAL((size_t)1, source.Counts().nWindowStationNames.load());
+	CHECK_EQUAL((size_t)0, source.Counts().nOpenWindowStation.load());
+}
+
+TEST_CASE(Fields_HeapQueriesOnlyHeapSize)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"desktop,heap", snapshot);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	// Three desktops across the two window stations
+	CHECK_EQUAL((size_t)3, counts.nOpenDesktop.load());
+	CHECK_EQUAL((size_t)3, counts.nHeapSize.load());
+	CHECK_EQUAL((size_t)0, counts.nIsReceivingInput.load());
+	CHECK_EQUAL((size_t)0, counts.nTopLevelWindows.load());
+	CHECK_EQUAL((size_t)0, counts.nSecurity.load());
+	CHECK_EQUAL((size_t)0, counts.nFlags.load());
+}
+
+TEST_CASE(Fields_AllMakesEveryQuery)
+{
+	CountingSystemSource source;
+	SystemSnapshot_t snapshot;
+	CollectFields(source, L"all", snapshot, 2);
+	const CountingSystemSource::Counts_t& counts = source.Counts();
+
+	CHECK_EQUAL((size_t)1, counts.nCurrentInfo.load());
+	CHECK_EQUAL((size_t)2, counts.nQuerySessionInfo.load());
+	CHECK_EQUAL((size_t)2, counts.nQueryUserToken.load());
+	CHECK_EQUAL((size_t)1, counts.nEnumerateProcesses.load());
+	CHECK_EQUAL((size_t)3, counts.nOpenDesktop.load());
+	CHECK_EQUAL((size_t)3, counts.nHeapSize.load());
+	CHECK_EQUAL((size_t)3, counts.nIsReceivingInput.load());
+	CHECK_EQUAL((size_t)3, counts.nTopLevelWindows.load());
+	// Window stations and desktops
+	CHECK_EQUAL((size_t)5, counts.nSecurity.load());
+	CHECK_EQUAL((size_t)5, counts.nFlags.load());
+	CHECK_EQUAL((size_t)5, counts.nUser.load());
+	// Every window belongs to the same process, so its image path is looked up once
+	CHECK_EQUAL((size_t)1, counts.nProcessImagePath.load());
+	// Every SID in the snapshot -- current context, process owners, object users, and security descriptor
+	// owners and groups -- is resolved in one batch
+	CHECK_EQUAL((size_t)1, counts.nLookupSidNames.load());
+	CHECK_EQUAL((size_t)4, counts.nSidsLookedUp.load());
+
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), snapshot.currentInfo.runningAs.Name());
+	const DesktopSnapshot_t& desktop = snapshot.windowStations.value[0].desktops.value[0];
+	CHECK(desktop.heapSizeKb.bValid);
+	CHECK_EQUAL((uint32_t)20480, desktop.heapSizeKb.value);
+	CHECK(desktop.windows.bValid);
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), desktop.user.value.Name());
+}
@@ -0,0 +1,313 @@
+// SnapshotDiffTests.cpp: tests of the differences between samples -- sessions, processes, windows, and security
+// descriptors -- over scripted sequences of snapshots as --watch takes them.
+
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SnapshotDiff.h"
+
+// WTS_CONNECTSTATE_CLASS values used by the scripts
+static const uint32_t WTSActive = 0;
+static const uint32_t WTSDisconnected = 4;
+
+// Internal helper: a session as the collector reports it
+static SessionSnapshot_t Session(uint32_t dwSessionId, uint32_t state, const wchar_t* szUserName)
+{
+	SessionSnapshot_t session;
+	session.dwSessionId = dwSessionId;
+	session.sName = (0 == dwSessionId) ? L"Services" : L"RDP-Tcp#" + std::to_wstring(dwSessionId);
+	session.state = state;
+	session.sState = (WTSActive == state) ? L"Active" : L"Disconnected";
+	session.sUserName = szUserName;
+	session.logonTime = 132000000000000000LL + dwSessionId;
+	session.currentTime = 133000000000000000LL;
+	return session;
+}
+
+// Internal helper: a sample with the given sessions
+static SystemSnapshot_t Sample(const SessionSnapshotList_t& sessions)
+{
+	SystemSnapshot_t snapshot;
+	snapshot.sessions.Set(sessions);
+	snapshot.windowStations.Set(WindowStationSnapshotList_t());
+	return snapshot;
+}
+
+// Internal helper: the session IDs of the changes of one kind, in diff order
+static std::vector<uint32_t> SessionIds(const SnapshotDiff_t& diff, ChangeKind_t kind)
+{
+	std::vector<uint32_t> ids;
+	for (size_t ix = 0; ix < diff.sessions.size(); ++ix)
+	{
+		if (kind == diff.sessions[ix].kind)
+			ids.push_back(ChangeKind_t::Removed == kind ? diff.sessions[ix].before.dwSessionId : diff.sessions[ix].after.dwSessionId);
+	}
+	return ids;
+}
+
+TEST_CASE(SnapshotDiff_SessionsAcrossSamples)
+{
+	// Services and one user; a second user logs on while the first disconnects; the first logs off; then nothing
+	// changes but the clock.
+	std::vector<SystemSnapshot_t> samples;
+	samples.push_back(Sample({ Session(0, WTSDisconnected, L""), Session(1, WTSActive, L"alice") }));
+	samples.push_back(Sample({ Session(0, WTSDisconnected, L""), Session(1, WTSDisconnected, L"alice"), Session(2, WTSActive, L"bob") }));
+	samples.push_back(Sample({ Session(0, WTSDisconnected, L""), Session(2, WTSActive, L"bob") }));
+	samples.push_back(samples.back());
+	for (size_t ix = 0; ix < samples.back().sessions.value.size(); ++ix)
+	{
+		samples.back().sessions.value[ix].currentTime += 50000000;
+		samples.back().sessions.value[ix].lastInputTime += 30000000;
+	}
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(samples[0], samples[1], diff);
+	CHECK_EQUAL((size_t)2, diff.ChangeCount());
+	CHECK(std::vector<uint32_t>({ 2 }) == SessionIds(diff, ChangeKind_t::Added));
+	CHECK(std::vector<uint32_t>({ 1 }) == SessionIds(diff, ChangeKind_t::Changed));
+	const Change_t<SessionSnapshot_t>& disconnected = diff.sessions[0];
+	CHECK_EQUAL(std::wstring(L"Active"), disconnected.before.sState);
+	CHECK_EQUAL(std::wstring(L"Disconnected"), disconnected.after.sState);
+	CHECK_EQUAL(std::wstring(L"bob"), diff.sessions[1].after.sUserName);
+
+	DiffSnapshots(samples[1], samples[2], diff);
+	CHECK_EQUAL((size_t)1, diff.ChangeCount());
+	CHECK(std::vector<uint32_t>({ 1 }) == SessionIds(diff, ChangeKind_t::Removed));
+	CHECK_EQUAL(std::wstring(L"alice"), diff.sessions[0].before.sUserName);
+	CHECK(diff.sessions[0].after.sUserName.empty());
+
+	// Only the clock moved: nothing to report, so --watch writes nothing for this sample
+	DiffSnapshots(samples[2], samples[3], diff);
+	CHECK(diff.IsEmpty());
+	CHECK(diff.sessions.empty());
+}
+
+TEST_CASE(SnapshotDiff_SessionReconnectsAndLogsBackOn)
+{
+	// A session ID that goes away and comes back is removed, then added; a reconnect is a change.
+	const SystemSnapshot_t connected = Sample({ Session(3, WTSActive, L"carol") });
+	const SystemSnapshot_t disconnected = Sample({ Session(3, WTSDisconnected, L"carol") });
+	const SystemSnapshot_t none = Sample(SessionSnapshotList_t());
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(connected, disconnected, diff);
+	CHECK(std::vector<uint32_t>({ 3 }) == SessionIds(diff, ChangeKind_t::Changed));
+	DiffSnapshots(disconnected, connected, diff);
+	CHECK(std::vector<uint32_t>({ 3 }) == SessionIds(diff, ChangeKind_t::Changed));
+	DiffSnapshots(connected, none, diff);
+	CHECK(std::vector<uint32_t>({ 3 }) == SessionIds(diff, ChangeKind_t::Removed));
+	DiffSnapshots(none, connected, diff);
+	CHECK(std::vector<uint32_t>({ 3 }) == SessionIds(diff, ChangeKind_t::Added));
+	CHECK_EQUAL((size_t)1, diff.ChangeCount());
+
+	// Order in the list doesn't matter, only the IDs
+	SystemSnapshot_t forward = Sample({ Session(1, WTSActive, L"a"), Session(2, WTSActive, L"b") });
+	SystemSnapshot_t backward = Sample({ Session(2, WTSActive, L"b"), Session(1, WTSActive, L"a") });
+	DiffSnapshots(forward, backward, diff);
+	CHECK(diff.IsEmpty());
+}
+
+TEST_CASE(SnapshotDiff_SessionEnumerationFailure)
+{
+	// A failed enumeration is reported once, not as every session removed and then added back.
+	const SystemSnapshot_t ok = Sample({ Session(0, WTSDisconnected, L""), Session(1, WTSActive, L"alice") });
+	SystemSnapshot_t failed = ok;
+	failed.sessions.SetError(L"WTSEnumerateSessionsEx failed: RPC server unavailable");
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(ok, failed, diff);
+	CHECK(diff.bSessionEnumChanged);
+	CHECK(diff.sessions.empty());
+	CHECK_EQUAL((size_t)1, diff.ChangeCount());
+	DiffSnapshots(failed, failed, diff);
+	CHECK(diff.IsEmpty());
+	DiffSnapshots(failed, ok, diff);
+	CHECK(diff.bSessionEnumChanged);
+	CHECK(diff.sessions.empty());
+}
+
+TEST_CASE(SnapshotDiff_SessionTokenUser)
+{
+	// Two samples of the same session with its token differ in nothing.
+	const SidInfo_t alice = CountingSystemSource::MakeSid(CountingSystemSource::AliceSid());
+	SystemSnapshot_t before = Sample({ Session(1, WTSActive, L"alice") });
+	before.sessions.value[0].tokenStatus = TokenStatus_t::Retrieved;
+	before.sessions.value[0].token.user = alice;
+	before.sessions.value[0].token.user.SetName(L"CONTOSO\\alice");
+	SystemSnapshot_t after = before;
+	SnapshotDiff_t diff;
+	DiffSnapshots(before, after, diff);
+	CHECK(diff.IsEmpty());
+
+	// A token whose user resolves to a different name (an account renamed) is a change
+	after.sessions.value[0].token.user.SetName(L"CONTOSO\\alice.smith");
+	DiffSnapshots(before, after, diff);
+	CHECK(std::vector<uint32_t>({ 1 }) == SessionIds(diff, ChangeKind_t::Changed));
+}
+
+// Internal helper: a process in a session
+static ProcessSnapshot_t Process(uint32_t dwPID, int64_t createTime, const wchar_t* szName)
+{
+	ProcessSnapshot_t process;
+	process.dwPID = dwPID;
+	process.createTime = createTime;
+	process.sProcessName = szName;
+	process.user = CountingSystemSource::MakeSid(CountingSystemSource::AliceSid());
+	return process;
+}
+
+// Internal helper: a sample with one session and its processes
+static SystemSnapshot_t ProcessSample(const ProcessSnapshotList_t& processes)
+{
+	SessionSnapshot_t session = Session(1, WTSActive, L"alice");
+	session.bProcessesCollected = true;
+	session.processes.Set(processes);
+	return Sample({ session });
+}
+
+// Internal helper: a window
+static WindowSnapshot_t Window(uint64_t hwnd, uint32_t PID, const wchar_t* szWindowText)
+{
+	WindowSnapshot_t window;
+	window.hwnd = hwnd;
+	window.bIsValid = window.bIsVisible = true;
+	window.PID = PID;
+	window.TID = PID + 4;
+	window.sClassName = L"Notepad";
+	window.sWindowText = szWindowText;
+	return window;
+}
+
+// Internal helper: a sample with WinSta0\Default, its windows, and the security descriptors of both
+static SystemSnapshot_t DesktopSample(const WindowSnapshotList_t& windows, const std::vector<uint8_t>& winstaSd, const std::vector<uint8_t>& desktopSd)
+{
+	DesktopSnapshot_t desktop;
+	desktop.sName = L"Default";
+	desktop.bOpened = true;
+	desktop.securityDescriptor.bCollected = true;
+	desktop.securityDescriptor.securityInformation = 0x7;
+	desktop.securityDescriptor.sd.Set(desktopSd);
+	desktop.bWindowsCollected = true;
+	desktop.windows.Set(windows);
+
+	WindowStationSnapshot_t winsta;
+	winsta.sName = L"WinSta0";
+	winsta.bOpened = true;
+	winsta.securityDescriptor.bCollected = true;
+	winsta.securityDescriptor.securityInformation = 0x7;
+	winsta.securityDescriptor.sd.Set(winstaSd);
+	winsta.desktops.Set({ desktop });
+
+	SystemSnapshot_t snapshot = Sample(SessionSnapshotList_t());
+	snapshot.windowStations.Set({ winsta });
+	return snapshot;
+}
+
+TEST_CASE(SnapshotDiff_ProcessesStartExitAndReusedPid)
+{
+	const SystemSnapshot_t before = ProcessSample({ Process(100, 1000, L"explorer.exe"), Process(200, 2000, L"notepad.exe"), Process(300, 3000, L"cmd.exe") });
+	// notepad.exe exits and its PID is reused by calc.exe; cmd.exe exits; a new process starts
+	const SystemSnapshot_t after = ProcessSample({ Process(100, 1000, L"explorer.exe"), Process(200, 5000, L"calc.exe"), Process(400, 4000, L"mspaint.exe") });
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(before, after, diff);
+	CHECK(diff.sessions.empty());
+	CHECK_EQUAL((size_t)4, diff.processes.size());
+	size_t nAdded = 0, nRemoved = 0, nChanged = 0;
+	for (size_t ix = 0; ix < diff.processes.size(); ++ix)
+	{
+		const ProcessChange_t& processChange = diff.processes[ix];
+		CHECK_EQUAL((uint32_t)1, processChange.dwSessionId);
+		switch (processChange.change.kind)
+		{
+		case ChangeKind_t::Added: ++nAdded; break;
+		case ChangeKind_t::Removed: ++nRemoved; break;
+		default: ++nChanged; break;
+		}
+	}
+	// The reused PID is one process removed and another added, not a change
+	CHECK_EQUAL((size_t)2, nAdded);
+	CHECK_EQUAL((size_t)2, nRemoved);
+	CHECK_EQUAL((size_t)0, nChanged);
+	// Removed in "before" order, then added in "after" order
+	CHECK_EQUAL(std::wstring(L"notepad.exe"), diff.processes[0].change.before.sProcessName);
+	CHECK_EQUAL(std::wstring(L"cmd.exe"), diff.processes[1].change.before.sProcessName);
+	CHECK_EQUAL(std::wstring(L"calc.exe"), diff.processes[2].change.after.sProcessName);
+	CHECK_EQUAL((int64_t)5000, diff.processes[2].change.after.createTime);
+	CHECK_EQUAL(std::wstring(L"mspaint.exe"), diff.processes[3].change.after.sProcessName);
+
+	// Resource usage changes on every sample and isn't a change; the owner is
+	SystemSnapshot_t busier = before;
+	busier.sessions.value[0].processes.value[0].workingSetSize += 4096;
+	busier.sessions.value[0].processes.value[0].kernelTime += 100000;
+	DiffSnapshots(before, busier, diff);
+	CHECK(diff.IsEmpty());
+	busier.sessions.value[0].processes.value[1].user = CountingSystemSource::MakeSid(CountingSystemSource::SystemSid());
+	DiffSnapshots(before, busier, diff);
+	CHECK_EQUAL((size_t)1, diff.processes.size());
+	CHECK(ChangeKind_t::Changed == diff.processes[0].change.kind);
+	CHECK_EQUAL((uint32_t)200, diff.processes[0].change.after.dwPID);
+}
+
+TEST_CASE(SnapshotDiff_WindowsKeyedByHwnd)
+{
+	const std::vector<uint8_t> sd = CountingSystemSource::MakeSecurityDescriptor(CountingSystemSource::SystemSid(), CountingSystemSource::AdministratorsSid());
+	const SystemSnapshot_t before = DesktopSample({ Window(0x10010, 100, L"Untitled - Notepad"), Window(0x20020, 200, L"Calculator") }, sd, sd);
+	// The first window's title changes; the second is destroyed and a window from the same process is created
+	const SystemSnapshot_t after = DesktopSample({ Window(0x10010, 100, L"notes.txt - Notepad"), Window(0x30030, 200, L"Calculator") }, sd, sd);
+
+	SnapshotDiff_t diff;
+	DiffSnapshots(before, after, diff);
+	CHECK(diff.windowStations.empty());
+	CHECK(diff.desktops.empty());
+	CHECK(diff.securityDescriptors.empty());
+	CHECK_EQUAL((size_t)3, diff.windows.size());
+	CHECK(ChangeKind_t::Removed == diff.windows[0].change.kind);
+	CHECK_EQUAL((uint64_t)0x20020, diff.windows[0].change.before.hwnd);
+	CHECK(ChangeKind_t::Changed == diff.windows[1].change.kind);
+	CHECK_EQUAL(std::wstring(L"Untitled - Notepad"), diff.windows[1].change.before.sWindowText);
+	CHECK_EQUAL(std::wstring(L"notes.txt - Notepad"), diff.windows[1].change.after.sWindowText);
+	CHECK(ChangeKind_t::Added == diff.windows[2].change.kind);
+	CHECK_EQUAL((uint64_t)0x30030, diff.windows[2].change.after.hwnd);
+	CHECK_EQUAL(std::wstring(L"WinSta0"), diff.windows[2].sWindowStation);
+	CHECK_EQUAL(std::wstring(L"Default"), diff.windows[2].sDesktop);
+
+	DiffSnapshots(after, after, diff);
+	CHECK(diff.IsEmpty());
+}
+
+TEST_CASE(SnapshotDiff_SecurityDescriptorBytesChange)
+{
+	const std::vector<uint8_t> sd = CountingSystemSource::MakeSecurityDescriptor(CountingSystemSource::SystemSid(), CountingSystemSource::AdministratorsSid());
+	const std::vector<uint8_t> newOwner = CountingSystemSource::MakeSecurityDescriptor(CountingSystemSource::AliceSid(), CountingSystemSource::AdministratorsSid());
+	const SystemSnapshot_t before = DesktopSample(WindowSnapshotList_t(), sd, sd);
+
+	// The desktop's owner changes
+	SnapshotDiff_t diff;
+	DiffSnapshots(before, DesktopSample(WindowSnapshotList_t(), sd, newOwner), diff);
+	CHECK_EQUAL((size_t)1, diff.ChangeCount());
+	CHECK_EQUAL((size_t)1, diff.securityDescriptors.size());
+	CHECK_EQUAL(std::wstring(L"WinSta0"), diff.securityDescriptors[0].sWindowStation);
+	CHECK_EQUAL(std::wstring(L"Default"), diff.securityDescriptors[0].sDesktop);
+	CHECK(sd == diff.securityDescriptors[0].change.before.sd.value);
+	CHECK(newOwner == diff.securityDescriptors[0].change.after.sd.value);
+
+	// The window station's: no desktop name
+	DiffSnapshots(before, DesktopSample(WindowSnapshotList_t(), newOwner, sd), diff);
+	CHECK_EQUAL((size_t)1, diff.securityDescriptors.size());
+	CHECK(diff.securityDescriptors[0].sDesktop.empty());
+
+	// A single byte anywhere in the descriptor
+	std::vector<uint8_t> flipped = sd;
+	flipped.back() ^= 1;
+	DiffSnapshots(before, DesktopSample(WindowSnapshotList_t(), sd, flipped), diff);
+	CHECK_EQUAL((size_t)1, diff.securityDescriptors.size());
+
+	// Retrieval starting to fail is a change too
+	SystemSnapshot_t denied = before;
+	denied.windowStations.value[0].desktops.value[0].securityDescriptor.sd.SetError(L"Access is denied.");
+	DiffSnapshots(before, denied, diff);
+	CHECK_EQUAL((size_t)1, diff.securityDescriptors.size());
+	CHECK(!diff.securityDescriptors[0].change.after.sd.bValid);
+}
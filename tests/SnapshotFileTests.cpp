@@ -0,0 +1,311 @@
+// SnapshotFileTests.cpp: tests of the binary snapshot format -- SnapshotWriter -> SnapshotFile round trips, and
+// corrupt images that SnapshotFile must reject without reading outside them.
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "CountingSystemSource.h"
+#include "SnapshotCollector.h"
+#include "SnapshotDiff.h"
+#include "SnapshotWriter.h"
+#include "SnapshotReader.h"
+
+using namespace SnapshotFormat;
+
+// Internal helper: a snapshot with every kind of record, some failed captures, and a string outside the BMP
+static SystemSnapshot_t TestSnapshot()
+{
+	CountingSystemSource source;
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"all", options.fields, sErrorInfo));
+	SnapshotCollector collector(source, options);
+	SystemSnapshot_t snapshot;
+	collector.Collect(snapshot);
+	snapshot.currentInfo.winstaFlags.SetError(L"Access is denied.");
+	snapshot.sessions.value[0].processes.SetError(L"Access is denied.");
+	snapshot.windowStations.value[0].desktops.value[0].windows.value[0].sWindowText = L"café \U0001F600";
+	return snapshot;
+}
+
+// Internal helper: serialize a snapshot
+static std::vector<uint8_t> WriteImage(const SystemSnapshot_t& snapshot)
+{
+	SnapshotWriter writer;
+	std::vector<uint8_t> image;
+	std::wstring sErrorInfo;
+	CHECK(writer.Write(snapshot, image, sErrorInfo));
+	return image;
+}
+
+// Internal helper: attach to an image and convert it; the error from whichever step failed
+static bool ReadImage(const std::vector<uint8_t>& image, SystemSnapshot_t& snapshot, std::wstring& sErrorInfo)
+{
+	SnapshotFile file;
+	return file.Attach(image.data(), image.size(), sErrorInfo) && file.ToSnapshot(snapshot, sErrorInfo);
+}
+
+// Internal helper: the directory entry of a section
+static size_t EntryOffset(const std::vector<uint8_t>& image, uint32_t id)
+{
+	FileHeader_t header;
+	memcpy(&header, image.data(), sizeof(header));
+	for (uint32_t ixSection = 0; ixSection < header.sectionCount; ++ixSection)
+	{
+		const size_t entryOffset = sizeof(FileHeader_t) + ixSection * sizeof(SectionEntry_t);
+		SectionEntry_t entry;
+		memcpy(&entry, image.data() + entryOffset, sizeof(entry));
+		if (id == entry.id)
+			return entryOffset;
+	}
+	TestHarness::ReportFailure(__FILE__, __LINE__, "no section " + std::to_string(id));
+	return 0;
+}
+
+static SectionEntry_t GetEntry(const std::vector<uint8_t>& image, uint32_t id)
+{
+	SectionEntry_t entry;
+	memcpy(&entry, image.data() + EntryOffset(image, id), sizeof(entry));
+	return entry;
+}
+
+static void SetEntry(std::vector<uint8_t>& image, const SectionEntry_t& entry)
+{
+	memcpy(image.data() + EntryOffset(image, entry.id), &entry, sizeof(entry));
+}
+
+// Internal helper: copy a record out of a section, and back in
+template <typename T>
+static T GetRecord(const std::vector<uint8_t>& image, uint32_t id, size_t ix)
+{
+	const SectionEntry_t entry = GetEntry(image, id);
+	T rec;
+	memcpy(&rec, image.data() + entry.offset + ix * entry.recordSize, sizeof(rec));
+	return rec;
+}
+
+template <typename T>
+static void SetRecord(std::vector<uint8_t>& image, uint32_t id, size_t ix, const T& rec)
+{
+	const SectionEntry_t entry = GetEntry(image, id);
+	memcpy(image.data() + entry.offset + ix * entry.recordSize, &rec, sizeof(rec));
+}
+
+// Internal helper: report an image that's accepted, or rejected without saying why it's corrupt
+static void CheckRejected(const char* szFile, int line, const std::vector<uint8_t>& image, const wchar_t* szExpectedError)
+{
+	SystemSnapshot_t snapshot;
+	std::wstring sErrorInfo;
+	if (ReadImage(image, snapshot, sErrorInfo))
+		TestHarness::ReportFailure(szFile, line, "accepted corrupt image; expected " + TestHarness::Describe(szExpectedError));
+	else if (std::wstring::npos == sErrorInfo.find(szExpectedError))
+		TestHarness::ReportFailure(szFile, line, "expected " + TestHarness::Describe(szExpectedError) + ", got " + TestHarness::Describe(sErrorInfo));
+}
+
+#define CHECK_REJECTED(image, szExpectedError) CheckRejected(__FILE__, __LINE__, image, szExpectedError)
+
+TEST_CASE(SnapshotFile_RoundTrip)
+{
+	const SystemSnapshot_t snapshot = TestSnapshot();
+	const std::vector<uint8_t> image = WriteImage(snapshot);
+	SnapshotFile file;
+	std::wstring sErrorInfo;
+	CHECK(file.Attach(image.data(), image.size(), sErrorInfo));
+	CHECK_EQUAL((size_t)2, file.SessionCount());
+	CHECK_EQUAL((size_t)3, file.ProcessCount());
+	CHECK(file.HasProcessUsage());
+
+	SystemSnapshot_t readBack;
+	CHECK(file.ToSnapshot(readBack, sErrorInfo));
+	SnapshotDiff_t diff;
+	DiffSnapshots(snapshot, readBack, diff);
+	CHECK(diff.IsEmpty());
+	// Every serialized field comes back: writing what was read gives the same image
+	CHECK(image == WriteImage(readBack));
+
+	// Spot checks of fields the diff doesn't compare
+	const SessionSnapshot_t& console = readBack.sessions.value[1];
+	CHECK_EQUAL(snapshot.sessions.value[1].currentTime, console.currentTime);
+	CHECK_EQUAL(std::wstring(L"CONTOSO\\alice"), console.processes.value[0].user.Name());
+	CHECK(console.processes.value[0].user == CountingSystemSource::MakeSid(CountingSystemSource::AliceSid()));
+	CHECK_EQUAL(std::wstring(L"Access is denied."), readBack.sessions.value[0].processes.sErrorInfo);
+	CHECK(!readBack.sessions.value[0].processes.bValid);
+	CHECK_EQUAL(std::wstring(L"Access is denied."), readBack.currentInfo.winstaFlags.sErrorInfo);
+	CHECK_EQUAL(std::wstring(L"café \U0001F600"), readBack.windowStations.value[0].desktops.value[0].windows.value[0].sWindowText);
+	CHECK(snapshot.windowStations.value[0].securityDescriptor.sd.value == readBack.windowStations.value[0].securityDescriptor.sd.value);
+
+	// An empty snapshot round-trips too
+	const std::vector<uint8_t> emptyImage = WriteImage(SystemSnapshot_t());
+	CHECK(ReadImage(emptyImage, readBack, sErrorInfo));
+	CHECK(!readBack.sessions.bValid);
+	CHECK(readBack.sessions.value.empty());
+}
+
+TEST_CASE(SnapshotFile_RejectsTruncatedImages)
+{
+	const std::vector<uint8_t> image = WriteImage(TestSnapshot());
+	for (size_t size = 0; size < sizeof(FileHeader_t); ++size)
+	{
+		const std::vector<uint8_t> truncated(image.begin(), image.begin() + size);
+		CHECK_REJECTED(truncated, L"too small");
+	}
+	// Every other prefix is shorter than the size in the header
+	for (size_t size = sizeof(FileHeader_t); size < image.size(); ++size)
+	{
+		const std::vector<uint8_t> truncated(image.begin(), image.begin() + size);
+		CHECK_REJECTED(truncated, L"truncated");
+	}
+
+	// A header claiming more sections than fit
+	std::vector<uint8_t> corrupt = image;
+	FileHeader_t header;
+	memcpy(&header, corrupt.data(), sizeof(header));
+	header.sectionCount = 0x10000000;
+	memcpy(corrupt.data(), &header, sizeof(header));
+	CHECK_REJECTED(corrupt, L"section directory is truncated");
+
+	corrupt = image;
+	corrupt[0] = 'X';
+	CHECK_REJECTED(corrupt, L"Not a TSSessions snapshot file");
+	memcpy(&header, image.data(), sizeof(header));
+	header.version = CurrentVersion + 1;
+	corrupt = image;
+	memcpy(corrupt.data(), &header, sizeof(header));
+	CHECK_REJECTED(corrupt, L"Unsupported snapshot file version");
+}
+
+TEST_CASE(SnapshotFile_RejectsBadSections)
+{
+	const std::vector<uint8_t> image = WriteImage(TestSnapshot());
+	const uint32_t ids[] = { Section_Strings, Section_Blobs, Section_Sids, Section_Snapshot, Section_Sessions, Section_Processes, Section_WindowStations, Section_Desktops, Section_Windows };
+	for (size_t ixId = 0; ixId < sizeof(ids) / sizeof(ids[0]); ++ixId)
+	{
+		const SectionEntry_t entry = GetEntry(image, ids[ixId]);
+		const uint64_t fileSize = image.size();
+
+		// Offsets past the end, or not aligned
+		SectionEntry_t corruptEntry = entry;
+		std::vector<uint8_t> corrupt = image;
+		corruptEntry.offset = fileSize + 8;
+		SetEntry(corrupt, corruptEntry);
+		CHECK_REJECTED(corrupt, L"out of bounds");
+		corruptEntry.offset = entry.offset + 4;
+		SetEntry(corrupt, corruptEntry);
+		CHECK_REJECTED(corrupt, L"out of bounds");
+
+		// Counts that run past the end, including ones whose size overflows
+		corruptEntry = entry;
+		corruptEntry.count = (fileSize - entry.offset) / entry.recordSize + 1;
+		SetEntry(corrupt, corruptEntry);
+		CHECK_REJECTED(corrupt, L"out of bounds");
+		corruptEntry.count = UINT64_MAX;
+		SetEntry(corrupt, corruptEntry);
+		CHECK_REJECTED(corrupt, L"out of bounds");
+
+		// Record sizes: the tables' are fixed; records can't be smaller than the known fields, or unaligned
+		corruptEntry = entry;
+		if (Section_Strings == entry.id || Section_Blobs == entry.id)
+			corruptEntry.recordSize = 4;
+		else
+			corruptEntry.recordSize = (uint32_t)(Section_Processes == entry.id ? ProcessRecordBaseSize : entry.recordSize) - 8;
+		SetEntry(corrupt, corruptEntry);
+		CHECK_REJECTED(corrupt, L"Invalid record size");
+		if (Section_Strings != entry.id && Section_Blobs != entry.id)
+		{
+			corruptEntry.recordSize = entry.recordSize + 4;
+			SetEntry(corrupt, corruptEntry);
+			CHECK_REJECTED(corrupt, L"Invalid record size");
+		}
+	}
+
+	// The same section twice, and no snapshot record
+	std::vector<uint8_t> corrupt = image;
+	SectionEntry_t entry = GetEntry(image, Section_Windows);
+	entry.id = Section_Desktops;
+	memcpy(corrupt.data() + EntryOffset(image, Section_Windows), &entry, sizeof(entry));
+	CHECK_REJECTED(corrupt, L"Duplicate snapshot section");
+	corrupt = image;
+	entry = GetEntry(image, Section_Snapshot);
+	entry.id = 99;
+	memcpy(corrupt.data() + EntryOffset(image, Section_Snapshot), &entry, sizeof(entry));
+	CHECK_REJECTED(corrupt, L"no snapshot record");
+}
+
+TEST_CASE(SnapshotFile_RejectsOutOfRangeReferences)
+{
+	const std::vector<uint8_t> image = WriteImage(TestSnapshot());
+	const uint32_t nStrings = (uint32_t)GetEntry(image, Section_Strings).count;
+	const uint32_t nBlobs = (uint32_t)GetEntry(image, Section_Blobs).count;
+	const uint32_t nSids = (uint32_t)GetEntry(image, Section_Sids).count;
+	const uint32_t nProcesses = (uint32_t)GetEntry(image, Section_Processes).count;
+
+	// String references past the end of the table, including one whose end wraps around 32 bits
+	std::vector<uint8_t> corrupt = image;
+	SessionRecord_t session = GetRecord<SessionRecord_t>(image, Section_Sessions, 1);
+	session.sName.offset = nStrings;
+	session.sName.length = 1;
+	SetRecord(corrupt, Section_Sessions, 1, session);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+	session.sName.offset = 0xFFFFFFFF;
+	session.sName.length = 2;
+	SetRecord(corrupt, Section_Sessions, 1, session);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+
+	// SID indexes past the end of the SID table, from a process and from the snapshot record
+	corrupt = image;
+	ProcessRecord_t process = GetRecord<ProcessRecord_t>(image, Section_Processes, 0);
+	process.userSid = nSids;
+	SetRecord(corrupt, Section_Processes, 0, process);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+	corrupt = image;
+	SnapshotRecord_t snapshotRec = GetRecord<SnapshotRecord_t>(image, Section_Snapshot, 0);
+	snapshotRec.runningAs = nSids + 1;
+	SetRecord(corrupt, Section_Snapshot, 0, snapshotRec);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+
+	// A SID record whose bytes are outside the blob table, or aren't a SID
+	corrupt = image;
+	SidRecord_t sid = GetRecord<SidRecord_t>(image, Section_Sids, 0);
+	sid.bytes.offset = nBlobs - 1;
+	SetRecord(corrupt, Section_Sids, 0, sid);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+	sid.bytes.offset = 0;
+	sid.bytes.length = 3;
+	SetRecord(corrupt, Section_Sids, 0, sid);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+
+	// Child ranges past the end of their section
+	corrupt = image;
+	session = GetRecord<SessionRecord_t>(image, Section_Sessions, 1);
+	session.processes.first = nProcesses - 1;
+	SetRecord(corrupt, Section_Sessions, 1, session);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+	session.processes.first = 0xFFFFFFFF;
+	session.processes.count = 2;
+	SetRecord(corrupt, Section_Sessions, 1, session);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+	corrupt = image;
+	snapshotRec = GetRecord<SnapshotRecord_t>(image, Section_Snapshot, 0);
+	snapshotRec.windowStations.count = (uint32_t)GetEntry(image, Section_WindowStations).count + 1;
+	SetRecord(corrupt, Section_Snapshot, 0, snapshotRec);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+
+	// A token status the reader doesn't know
+	corrupt = image;
+	session = GetRecord<SessionRecord_t>(image, Section_Sessions, 0);
+	session.tokenStatus = 0x100;
+	SetRecord(corrupt, Section_Sessions, 0, session);
+	CHECK_REJECTED(corrupt, L"reference out of range");
+
+	// NoSid isn't out of range
+	corrupt = image;
+	process = GetRecord<ProcessRecord_t>(image, Section_Processes, 0);
+	process.userSid = NoSid;
+	SetRecord(corrupt, Section_Processes, 0, process);
+	SystemSnapshot_t readBack;
+	std::wstring sErrorInfo;
+	CHECK(ReadImage(corrupt, readBack, sErrorInfo));
+	CHECK_EQUAL(std::wstring(CountingSystemSource::AliceSid()), readBack.sessions.value[1].processes.value[1].user.ToString());
+	CHECK(readBack.sessions.value[1].processes.value[0].user == SidInfo_t());
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// TestHarness.h: minimal self-registering test cases for the tests of the portable modules.
+// Portable C++ (no Windows dependencies).
+//
+// Define a test case with TEST_CASE(Name) { ... } in any test source file, and check conditions with CHECK and
+// CHECK_EQUAL. A failed check is reported and the test case continues; TestMain.cpp runs every registered test case.
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace TestHarness
+{
+	typedef void(*TestFn_t)();
+
+	struct TestCase_t
+	{
+		const char* szName;
+		TestFn_t fn;
+	};
+
+	/// <summary>
+	/// Every registered test case, in registration order.
+	/// </summary>
+	std::vector<TestCase_t>& TestCases();
+
+	/// <summary>
+	/// Report a failed check in the test case currently running.
+	/// </summary>
+	void ReportFailure(const char* szFile, int line, const std::string& sMessage);
+
+	/// <summary>
+	/// Registers a test case at static initialization time.
+	/// </summary>
+	struct Registrar_t
+	{
+		Registrar_t(const char* szName, TestFn_t fn)
+		{
+			TestCase_t testCase = { szName, fn };
+			TestCases().push_back(testCase);
+		}
+	};
+
+	// Internal helper: text for a value in a failure message; wide strings are reported as their ASCII characters.
+	template <typename Value_t>
+	std::string Describe(const Value_t& value)
+	{
+		std::ostringstream str;
+		str << value;
+		return str.str();
+	}
+
+	inline std::string Describe(const std::wstring& value)
+	{
+		std::string sNarrow;
+		for (size_t ix = 0; ix < value.size(); ++ix)
+			sNarrow += (value[ix] < 0x80) ? (char)value[ix] : '?';
+		return "L\"" + sNarrow + "\"";
+	}
+
+	inline std::string Describe(const wchar_t* value)
+	{
+		return Describe(std::wstring(value));
+	}
+
+	inline std::string Describe(bool value)
+	{
+		return value ? "true" : "false";
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static TestHarness::Registrar_t name##_registrar(#name, name); \
+	static void name()
+
+#define CHECK(expr) \
+	do { if (!(expr)) TestHarness::ReportFailure(__FILE__, __LINE__, "CHECK(" #expr ")"); } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+	do { \
+		if (!((expected) == (actual))) \
+			TestHarness::ReportFailure(__FILE__, __LINE__, "CHECK_EQUAL(" #expected ", " #actual "): expected " + \
+				TestHarness::Describe(expected) + ", got " + TestHarness::Describe(actual)); \
+	} while (0)
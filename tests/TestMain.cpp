@@ -0,0 +1,68 @@
+// TestMain.cpp: runs the registered test cases of the portable modules.
+//
+// Usage: PortableTests [name ...]
+// With no arguments every test case runs; otherwise only the test cases whose names contain one of the arguments.
+// Exits with 0 if every check passed, 1 otherwise.
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include "TestHarness.h"
+
+static size_t nFailures = 0;
+
+std::vector<TestHarness::TestCase_t>& TestHarness::TestCases()
+{
+	static std::vector<TestCase_t> testCases;
+	return testCases;
+}
+
+void TestHarness::ReportFailure(const char* szFile, int line, const std::string& sMessage)
+{
+	++nFailures;
+	fprintf(stderr, "%s(%d): %s\n", szFile, line, sMessage.c_str());
+}
+
+// Internal helper: whether a test case was selected on the command line
+static bool IsSelected(const char* szName, int argc, char** argv)
+{
+	if (argc <= 1)
+		return true;
+	for (int ix = 1; ix < argc; ++ix)
+	{
+		if (NULL != strstr(szName, argv[ix]))
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	size_t nRun = 0, nFailed = 0;
+	const std::vector<TestHarness::TestCase_t>& testCases = TestHarness::TestCases();
+	for (size_t ix = 0; ix < testCases.size(); ++ix)
+	{
+		if (!IsSelected(testCases[ix].szName, argc, argv))
+			continue;
+		++nRun;
+		size_t nFailuresBefore = nFailures;
+		try
+		{
+			testCases[ix].fn();
+		}
+		catch (const std::exception& ex)
+		{
+			TestHarness::ReportFailure(testCases[ix].szName, 0, std::string("unexpected exception: ") + ex.what());
+		}
+		catch (...)
+		{
+			TestHarness::ReportFailure(testCases[ix].szName, 0, "unexpected exception");
+		}
+		bool bPassed = (nFailures == nFailuresBefore);
+		if (!bPassed)
+			++nFailed;
+		printf("%s %s\n", bPassed ? "[ OK ]" : "[FAIL]", testCases[ix].szName);
+	}
+	printf("%zu test cases, %zu failed\n", nRun, nFailed);
+	return (0 == nFailed) ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+// TimingsTests.cpp: tests of the --timings-json output.
+
+#include <sstream>
+#include <string>
+#include "TestHarness.h"
+#include "Timings.h"
+
+TEST_CASE(Timings_JsonIncludesPhasesApisAndCaches)
+{
+	Timings::Reset();
+	Timings::AddPhase(TimingPhase_t::Sessions, 2500000);
+	Timings::AddApiCall(TimedApi_t::LsaLookupSids2, 1000000);
+	Timings::AddApiCall(TimedApi_t::LsaLookupSids2, 3000000);
+
+	Timings::CacheCountersList_t caches;
+	Timings::CacheCounters_t sidNames = { L"sidNames", 40, 7, 2, 45 };
+	Timings::CacheCounters_t securityDescriptors = { L"securityDescriptors", 12, 3, 0, 3 };
+	caches.push_back(sidNames);
+	caches.push_back(securityDescriptors);
+
+	std::wostringstream sOut;
+	Timings::WriteJson(sOut, caches);
+	std::wstring sJson = sOut.str();
+
+	CHECK(std::wstring::npos != sJson.find(L"{ \"name\": \"Sessions\", \"count\": 1, \"totalMs\": 2.500 }"));
+	CHECK(std::wstring::npos != sJson.find(L"{ \"name\": \"LsaLookupSids2\", \"calls\": 2, \"totalMs\": 4.000 }"));
+	CHECK(std::wstring::npos != sJson.find(L"{ \"name\": \"sidNames\", \"hits\": 40, \"misses\": 7, \"timeouts\": 2, \"entries\": 45 }"));
+	CHECK(std::wstring::npos != sJson.find(L"{ \"name\": \"securityDescriptors\", \"hits\": 12, \"misses\": 3, \"timeouts\": 0, \"entries\": 3 }"));
+	// Phases and APIs never entered are omitted
+	CHECK(std::wstring::npos == sJson.find(L"\"Desktops\""));
+	Timings::Reset();
+}
+
+TEST_CASE(Timings_JsonWithoutCaches)
+{
+	Timings::Reset();
+	std::wostringstream sOut;
+	Timings::WriteJson(sOut, Timings::CacheCountersList_t());
+	CHECK_EQUAL(std::wstring(L"{\n  \"phases\": [\n  ],\n  \"apis\": [\n  ],\n  \"caches\": [\n  ]\n}\n"), sOut.str());
+}
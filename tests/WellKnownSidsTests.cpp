@@ -0,0 +1,196 @@
+// WellKnownSidsTests.cpp: tests of the built-in well-known SID table -- every entry is found through the perfect
+// hash with its own name, and SIDs that differ from an entry only slightly aren't given its name.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "TestHarness.h"
+#include "WellKnownSids.h"
+#include "SidCodec.h"
+
+using namespace WellKnownSids;
+
+// A machine's account domain, for account SIDs
+static const wchar_t* const AccountDomain = L"S-1-5-21-1004336348-1177238915-682003330";
+
+/// <summary>
+/// What Lookup returns for a SID
+/// </summary>
+struct Result_t
+{
+	bool bRecognized = false;
+	Category_t category = Category_t::None;
+	std::wstring sDomainName, sUserName;
+};
+
+// Internal helper: look up a binary SID
+static Result_t Lookup(const std::vector<uint8_t>& sid)
+{
+	Result_t result;
+	result.bRecognized = WellKnownSids::Lookup(sid.data(), sid.size(), result.category, result.sDomainName, result.sUserName);
+	return result;
+}
+
+// Internal helper: look up a SID in string form
+static Result_t Lookup(const std::wstring& sSid)
+{
+	std::vector<uint8_t> sid;
+	if (!SidCodec::Parse(sSid, sid))
+		TestHarness::ReportFailure(__FILE__, __LINE__, "can't parse " + TestHarness::Describe(sSid));
+	return Lookup(sid);
+}
+
+// Internal helper: the SID a table entry's key stands for; account keys get a domain
+static std::wstring EntrySid(const TableEntry_t& entry)
+{
+	if (Category_t::Account != entry.category)
+		return entry.sSid;
+	return AccountDomain + entry.sSid.substr(std::wstring(L"S-1-5-21").size());
+}
+
+// Internal helper: report a result that isn't the expected category and name
+static void CheckResult(const char* szFile, int line, const std::wstring& sSid, const Result_t& result, Category_t category, const std::wstring& sDomainName, const std::wstring& sUserName)
+{
+	if (result.category != category || result.bRecognized != (Category_t::None != category))
+		TestHarness::ReportFailure(szFile, line, TestHarness::Describe(sSid) + ": category " + std::to_string((int)result.category) + ", expected " + std::to_string((int)category));
+	if (result.sDomainName != sDomainName || result.sUserName != sUserName)
+		TestHarness::ReportFailure(szFile, line, TestHarness::Describe(sSid) + ": named " + TestHarness::Describe(result.sDomainName + L"\\" + result.sUserName) + ", expected " + TestHarness::Describe(sDomainName + L"\\" + sUserName));
+}
+
+#define CHECK_LOOKUP(sSid, category, sDomainName, sUserName) CheckResult(__FILE__, __LINE__, sSid, Lookup(std::wstring(sSid)), category, sDomainName, sUserName)
+
+TEST_CASE(WellKnownSids_EveryEntryIsFound)
+{
+	const std::vector<TableEntry_t> entries = TableEntries();
+	CHECK(entries.size() > 100);
+	std::map<std::wstring, size_t> sidCounts;
+	for (size_t ix = 0; ix < entries.size(); ++ix)
+	{
+		const TableEntry_t& entry = entries[ix];
+		if (1 < ++sidCounts[entry.sSid])
+			TestHarness::ReportFailure(__FILE__, __LINE__, "duplicate entry " + TestHarness::Describe(entry.sSid));
+		const std::wstring sSid = EntrySid(entry);
+		const Result_t result = Lookup(sSid);
+		CheckResult(__FILE__, __LINE__, sSid, result, entry.category, entry.sDomainName, entry.sUserName);
+		std::vector<uint8_t> sid;
+		SidCodec::Parse(sSid, sid);
+		CHECK(entry.category == Classify(sid.data(), sid.size()));
+		CHECK_EQUAL(Category_t::Account != entry.category, IsFixedName(entry.category));
+	}
+
+	// Spot checks against names written out independently of the table
+	CHECK_LOOKUP(L"S-1-5-18", Category_t::NtAuthority, L"NT AUTHORITY", L"SYSTEM");
+	CHECK_LOOKUP(L"S-1-1-0", Category_t::Universal, L"", L"Everyone");
+	CHECK_LOOKUP(L"S-1-5-32-544", Category_t::Builtin, L"BUILTIN", L"Administrators");
+	CHECK_LOOKUP(L"S-1-5-32-555", Category_t::Builtin, L"BUILTIN", L"Remote Desktop Users");
+	CHECK_LOOKUP(L"S-1-5-80-0", Category_t::Service, L"NT SERVICE", L"ALL SERVICES");
+	CHECK_LOOKUP(L"S-1-5-84-0-0-0-0-0", Category_t::NtAuthority, L"NT AUTHORITY", L"USER MODE DRIVERS");
+	CHECK_LOOKUP(L"S-1-15-2-1", Category_t::AppPackage, L"APPLICATION PACKAGE AUTHORITY", L"ALL APPLICATION PACKAGES");
+	CHECK_LOOKUP(L"S-1-16-12288", Category_t::IntegrityLabel, L"Mandatory Label", L"High Mandatory Level");
+	CHECK_LOOKUP(std::wstring(AccountDomain) + L"-500", Category_t::Account, L"", L"Administrator");
+	CHECK_LOOKUP(std::wstring(AccountDomain) + L"-512", Category_t::Account, L"", L"Domain Admins");
+}
+
+TEST_CASE(WellKnownSids_GeneratedAndUnnamedSids)
+{
+	// Logon sessions are named from their subauthorities
+	CHECK_LOOKUP(L"S-1-5-5-0-999", Category_t::LogonSession, L"NT AUTHORITY", L"LogonSessionId_0_999");
+	CHECK_LOOKUP(L"S-1-5-5-4294967295-1", Category_t::LogonSession, L"NT AUTHORITY", L"LogonSessionId_4294967295_1");
+
+	// Recognized categories without names
+	CHECK_LOOKUP(std::wstring(AccountDomain) + L"-1001", Category_t::Account, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-80-956008885-3418522649-1831038044-1853292631-2271478464", Category_t::Service, L"", L"");
+	CHECK_LOOKUP(L"S-1-15-2-2434737943-167758768-3180539153-984336765-1107280622-3591121930-2677285773", Category_t::AppContainer, L"", L"");
+	CHECK_LOOKUP(L"S-1-15-3-1024-1065365936-1281604716-3511738428-1654721687-432734479-3232135806-4053264122-3456934681", Category_t::Capability, L"", L"");
+	CHECK_LOOKUP(L"S-1-16-8193", Category_t::IntegrityLabel, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-1000-1", Category_t::NtAuthority, L"", L"");
+
+	// Not recognized
+	CHECK_LOOKUP(L"S-1-4-1", Category_t::None, L"", L"");
+	CHECK_LOOKUP(L"S-1-15-1", Category_t::None, L"", L"");
+	CHECK_LOOKUP(L"S-1-9-1", Category_t::None, L"", L"");
+
+	// Malformed binary SIDs: truncated, wrong revision, too many subauthorities
+	std::vector<uint8_t> sid;
+	SidCodec::Parse(L"S-1-5-18", sid);
+	for (size_t cb = 0; cb < sid.size(); ++cb)
+	{
+		const std::vector<uint8_t> truncated(sid.begin(), sid.begin() + cb);
+		CHECK(!Lookup(truncated).bRecognized);
+	}
+	std::vector<uint8_t> corrupt = sid;
+	corrupt[0] = 2;
+	CHECK(!Lookup(corrupt).bRecognized);
+	corrupt = sid;
+	corrupt[1] = 16;
+	corrupt.resize(8 + 16 * 4, 0);
+	CHECK(!Lookup(corrupt).bRecognized);
+}
+
+TEST_CASE(WellKnownSids_NearMissesHaveNoName)
+{
+	// Wrong subauthority count: a table SID with a subauthority added or removed
+	CHECK_LOOKUP(L"S-1-5-18-0", Category_t::NtAuthority, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-32", Category_t::Builtin, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-32-544-0", Category_t::Builtin, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-84-0-0-0-0", Category_t::NtAuthority, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-84-0-0-0-0-0-0", Category_t::NtAuthority, L"", L"");
+	CHECK_LOOKUP(L"S-1-16", Category_t::IntegrityLabel, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-5-0", Category_t::NtAuthority, L"", L"");
+
+	// Account keys are matched only as the RID of a full account SID
+	CHECK_LOOKUP(L"S-1-5-21-500", Category_t::Account, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-21-1-2-500", Category_t::Account, L"", L"");
+	CHECK_LOOKUP(std::wstring(AccountDomain) + L"-500-0", Category_t::Account, L"", L"");
+	CHECK_LOOKUP(std::wstring(AccountDomain) + L"-500", Category_t::Account, L"", L"Administrator");
+
+	// Wrong authority: the same subauthorities under another authority
+	CHECK_LOOKUP(L"S-1-3-18", Category_t::Universal, L"", L"");
+	CHECK_LOOKUP(L"S-1-16-32-544", Category_t::IntegrityLabel, L"", L"");
+	CHECK_LOOKUP(L"S-1-15-32-544", Category_t::None, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-4096", Category_t::NtAuthority, L"", L"");
+	std::vector<uint8_t> sid;
+	SidCodec::Parse(L"S-1-5-18", sid);
+	// Authority 0x010000000005: the low byte is SYSTEM's
+	sid[2] = 1;
+	const Result_t result = Lookup(sid);
+	CHECK(!result.bRecognized);
+	CHECK(result.sUserName.empty());
+
+	// The service prefix: only S-1-5-80-0 has a name
+	CHECK_LOOKUP(L"S-1-5-80", Category_t::Service, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-80-1", Category_t::Service, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-80-0-0", Category_t::Service, L"", L"");
+	CHECK_LOOKUP(L"S-1-5-80-0-1-2-3-4", Category_t::Service, L"", L"");
+
+	// Every entry's neighbours -- last subauthority off by one, one added, one removed -- have a name only if
+	// they're in the table themselves
+	const std::vector<TableEntry_t> entries = TableEntries();
+	std::map<std::wstring, const TableEntry_t*> bySid;
+	for (size_t ix = 0; ix < entries.size(); ++ix)
+		bySid[EntrySid(entries[ix])] = &entries[ix];
+	for (size_t ix = 0; ix < entries.size(); ++ix)
+	{
+		const std::wstring sSid = EntrySid(entries[ix]);
+		const size_t ixLastDash = sSid.rfind(L'-');
+		const uint32_t last = (uint32_t)std::stoul(sSid.substr(ixLastDash + 1));
+		std::vector<std::wstring> neighbours;
+		neighbours.push_back(sSid.substr(0, ixLastDash + 1) + std::to_wstring(last + 1));
+		if (0 != last)
+			neighbours.push_back(sSid.substr(0, ixLastDash + 1) + std::to_wstring(last - 1));
+		neighbours.push_back(sSid + L"-0");
+		if (std::count(sSid.begin(), sSid.end(), L'-') > 3)
+			neighbours.push_back(sSid.substr(0, ixLastDash));
+		for (size_t ixNeighbour = 0; ixNeighbour < neighbours.size(); ++ixNeighbour)
+		{
+			const Result_t neighbour = Lookup(neighbours[ixNeighbour]);
+			if (Category_t::LogonSession == neighbour.category)
+				continue;
+			std::map<std::wstring, const TableEntry_t*>::const_iterator found = bySid.find(neighbours[ixNeighbour]);
+			const std::wstring sExpected = (bySid.end() == found) ? std::wstring() : found->second->sUserName;
+			if (sExpected != neighbour.sUserName)
+				TestHarness::ReportFailure(__FILE__, __LINE__, TestHarness::Describe(neighbours[ixNeighbour]) + " named " + TestHarness::Describe(neighbour.sUserName));
+		}
+	}
+}
@@ -0,0 +1,276 @@
+// WorkerPoolTests.cpp: tests of WorkerPool and ForEachOrdered, and of the collection they run with -j: sessions
+// collected by several workers come out in the same order, with the same contents, as a serial collection.
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "TestHarness.h"
+#include "WorkerPool.h"
+#include "CountingSystemSource.h"
+#include "SnapshotCollector.h"
+#include "SnapshotDiff.h"
+#include "SnapshotWriter.h"
+
+// Internal helper: sleep for a pseudo-random few milliseconds, so that jobs finish out of order
+static void SleepAFew(int n)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds((n * 7) % 5));
+}
+
+TEST_CASE(WorkerPool_SubmitReturnsResults)
+{
+	WorkerPool pool(3);
+	CHECK_EQUAL((size_t)3, pool.ThreadCount());
+	std::vector<std::future<int>> results;
+	for (int ix = 0; ix < 20; ++ix)
+		results.push_back(pool.Submit([ix]() { SleepAFew(ix); return ix * ix; }));
+	for (int ix = 0; ix < 20; ++ix)
+		CHECK_EQUAL(ix * ix, results[(size_t)ix].get());
+}
+
+TEST_CASE(WorkerPool_ZeroThreadsCreatesOne)
+{
+	WorkerPool pool(0);
+	CHECK_EQUAL((size_t)1, pool.ThreadCount());
+	CHECK_EQUAL(42, pool.Submit([]() { return 42; }).get());
+}
+
+TEST_CASE(WorkerPool_SubmitDeliversExceptions)
+{
+	WorkerPool pool(2);
+	std::future<int> result = pool.Submit([]() -> int { throw std::runtime_error("job failed"); });
+	bool bThrew = false;
+	try
+	{
+		result.get();
+	}
+	catch (const std::runtime_error&)
+	{
+		bThrew = true;
+	}
+	CHECK(bThrew);
+	// The worker survives the exception
+	CHECK_EQUAL(7, pool.Submit([]() { return 7; }).get());
+}
+
+TEST_CASE(WorkerPool_DestructorFinishesQueuedJobs)
+{
+	std::atomic<int> nRun(0);
+	{
+		WorkerPool pool(2);
+		for (int ix = 0; ix < 50; ++ix)
+			pool.Submit([&nRun, ix]() { SleepAFew(ix); ++nRun; });
+	}
+	CHECK_EQUAL(50, nRun.load());
+}
+
+TEST_CASE(ForEachOrdered_EmitsInInputOrder)
+{
+	WorkerPool pool(4);
+	std::vector<int> items;
+	for (int ix = 0; ix < 100; ++ix)
+		items.push_back(ix);
+	std::vector<int> emitted;
+	ForEachOrdered(
+		pool, items.begin(), items.end(),
+		[](const int& item) { SleepAFew(item); return item * 2; },
+		[&emitted](int result) { emitted.push_back(result); });
+	CHECK_EQUAL((size_t)100, emitted.size());
+	for (size_t ix = 0; ix < emitted.size(); ++ix)
+		CHECK_EQUAL((int)ix * 2, emitted[ix]);
+}
+
+TEST_CASE(ForEachOrdered_EmptyRange)
+{
+	WorkerPool pool(2);
+	std::vector<int> items;
+	size_t nEmitted = 0;
+	ForEachOrdered(pool, items.begin(), items.end(), [](const int& item) { return item; }, [&nEmitted](int) { ++nEmitted; });
+	CHECK_EQUAL((size_t)0, nEmitted);
+}
+
+// Work callable that counts the jobs in progress, and marks itself destroyed so that a job using a destroyed
+// callable is detected.
+struct TrackedWork_t
+{
+	std::atomic<int>* pnActive;
+	std::atomic<int>* pnMisuse;
+	int failAt;
+	bool bAlive;
+
+	TrackedWork_t(std::atomic<int>* pnActive_, std::atomic<int>* pnMisuse_, int failAt_)
+		: pnActive(pnActive_), pnMisuse(pnMisuse_), failAt(failAt_), bAlive(true)
+	{
+	}
+	TrackedWork_t(const TrackedWork_t& other)
+		: pnActive(other.pnActive), pnMisuse(other.pnMisuse), failAt(other.failAt), bAlive(true)
+	{
+	}
+	~TrackedWork_t()
+	{
+		bAlive = false;
+	}
+
+	int operator()(const int& item) const
+	{
+		++*pnActive;
+		SleepAFew(item);
+		if (!bAlive)
+			++*pnMisuse;
+		--*pnActive;
+		if (item == failAt)
+			throw std::runtime_error("work failed");
+		return item;
+	}
+};
+
+TEST_CASE(ForEachOrdered_WorkExceptionWaitsForOutstandingJobs)
+{
+	std::atomic<int> nActive(0), nMisuse(0);
+	WorkerPool pool(4);
+	std::vector<int> items;
+	for (int ix = 0; ix < 40; ++ix)
+		items.push_back(ix);
+	std::vector<int> emitted;
+	bool bThrew = false;
+	try
+	{
+		// The callable is a temporary that's destroyed as soon as ForEachOrdered returns or throws
+		ForEachOrdered(
+			pool, items.begin(), items.end(),
+			TrackedWork_t(&nActive, &nMisuse, 5),
+			[&emitted](int result) { emitted.push_back(result); });
+	}
+	catch (const std::runtime_error&)
+	{
+		bThrew = true;
+		// No job is still running when the exception reaches the caller
+		CHECK_EQUAL(0, nActive.load());
+	}
+	CHECK(bThrew);
+	// The results before the failed item were emitted in order; none after it
+	CHECK_EQUAL((size_t)5, emitted.size());
+	for (size_t ix = 0; ix < emitted.size(); ++ix)
+		CHECK_EQUAL((int)ix, emitted[ix]);
+	// Drain the pool, then confirm no job ran with a destroyed callable
+	pool.Submit([]() {}).get();
+	CHECK_EQUAL(0, nMisuse.load());
+}
+
+TEST_CASE(ForEachOrdered_EmitExceptionWaitsForOutstandingJobs)
+{
+	std::atomic<int> nActive(0), nMisuse(0);
+	WorkerPool pool(4);
+	std::vector<int> items;
+	for (int ix = 0; ix < 40; ++ix)
+		items.push_back(ix);
+	bool bThrew = false;
+	try
+	{
+		ForEachOrdered(
+			pool, items.begin(), items.end(),
+			TrackedWork_t(&nActive, &nMisuse, -1),
+			[](int result) { if (2 == result) throw std::logic_error("emit failed"); });
+	}
+	catch (const std::logic_error&)
+	{
+		bThrew = true;
+		CHECK_EQUAL(0, nActive.load());
+	}
+	CHECK(bThrew);
+	pool.Submit([]() {}).get();
+	CHECK_EQUAL(0, nMisuse.load());
+}
+
+/// <summary>
+/// Fake system with many sessions, where the earlier a session comes in the session list, the longer its queries
+/// take, so that workers finish sessions in the reverse of their order. Counts the queries running at once.
+/// </summary>
+class SlowSessionSource : public CountingSystemSource
+{
+public:
+	static const uint32_t SessionCount = 12;
+
+	std::atomic<int> nActive{ 0 };
+	std::atomic<int> nMostActive{ 0 };
+
+	SlowSessionSource()
+	{
+		for (uint32_t dwSessionId = 2; dwSessionId < SessionCount; ++dwSessionId)
+		{
+			SessionSnapshot_t session;
+			session.dwSessionId = dwSessionId;
+			session.sName = L"RDP-Tcp#" + std::to_wstring(dwSessionId);
+			session.sState = L"Active";
+			session.sDomainName = L"CONTOSO";
+			session.sUserName = L"user" + std::to_wstring(dwSessionId);
+			SetSession(session);
+			AddProcess(dwSessionId, 10000 + dwSessionId * 4, L"explorer.exe", AliceSid());
+			AddProcess(dwSessionId, 20000 + dwSessionId * 4, L"notepad.exe", OrphanSid());
+		}
+	}
+
+	// The per-session query that each worker makes
+	void QueryUserToken(uint32_t dwSessionId, SessionSnapshot_t& session) override
+	{
+		const int nNowActive = ++nActive;
+		int nMost = nMostActive;
+		while (nNowActive > nMost && !nMostActive.compare_exchange_weak(nMost, nNowActive))
+		{
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2 * (SessionCount - dwSessionId)));
+		CountingSystemSource::QueryUserToken(dwSessionId, session);
+		--nActive;
+	}
+};
+
+// Internal helper: collect every field with nThreads workers, and return the snapshot's binary image
+static std::vector<uint8_t> CollectImage(SystemSource& source, size_t nThreads, SystemSnapshot_t& snapshot)
+{
+	CollectionOptions_t options;
+	std::wstring sErrorInfo;
+	CHECK(ParseFieldList(L"all", options.fields, sErrorInfo));
+	options.nThreads = nThreads;
+	SnapshotCollector(source, options).Collect(snapshot);
+	SnapshotWriter writer;
+	std::vector<uint8_t> image;
+	CHECK(writer.Write(snapshot, image, sErrorInfo));
+	return image;
+}
+
+TEST_CASE(ParallelCollection_MatchesSerialOrder)
+{
+	SlowSessionSource serialSource;
+	SystemSnapshot_t serial;
+	const std::vector<uint8_t> serialImage = CollectImage(serialSource, 1, serial);
+	CHECK_EQUAL(1, serialSource.nMostActive.load());
+	CHECK_EQUAL((size_t)SlowSessionSource::SessionCount, serial.sessions.value.size());
+
+	const size_t threadCounts[] = { 2, 4, SlowSessionSource::SessionCount + 4 };
+	for (size_t ix = 0; ix < sizeof(threadCounts) / sizeof(threadCounts[0]); ++ix)
+	{
+		SlowSessionSource source;
+		SystemSnapshot_t parallel;
+		const std::vector<uint8_t> image = CollectImage(source, threadCounts[ix], parallel);
+		// The sessions really were collected concurrently
+		CHECK(source.nMostActive.load() > 1);
+
+		// Sessions in the order enumerated, each with its own processes, and nothing else different
+		CHECK_EQUAL(serial.sessions.value.size(), parallel.sessions.value.size());
+		for (size_t ixSession = 0; ixSession < parallel.sessions.value.size(); ++ixSession)
+		{
+			const SessionSnapshot_t& session = parallel.sessions.value[ixSession];
+			const SessionSnapshot_t& serialSession = serial.sessions.value[ixSession];
+			CHECK_EQUAL(serialSession.dwSessionId, session.dwSessionId);
+			CHECK_EQUAL(serialSession.processes.value.size(), session.processes.value.size());
+			for (size_t ixProcess = 0; ixProcess < session.processes.value.size() && ixProcess < serialSession.processes.value.size(); ++ixProcess)
+				CHECK_EQUAL(serialSession.processes.value[ixProcess].dwPID, session.processes.value[ixProcess].dwPID);
+		}
+		SnapshotDiff_t diff;
+		DiffSnapshots(serial, parallel, diff);
+		CHECK(diff.IsEmpty());
+		CHECK(serialImage == image);
+	}
+}